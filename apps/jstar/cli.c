@@ -32,6 +32,9 @@
 #define JSTAR_PATH   "JSTARPATH"
 #define INDENT       "    "
 
+// Sampling interval of the profiler in microseconds
+#define PROFILE_INTERVAL 1000
+
 static const int tokenDepth[TOK_EOF] = {
     // Tokens that start a new block
     [TOK_LSQUARE] = 1,
@@ -59,7 +62,13 @@ typedef struct Options {
     bool ignoreEnv;
     bool disableColors;
     bool disableHints;
+    bool printStats;
+    bool bytecodeCache;
+    bool lazyImports;
+    bool importTimes;
+    char* cacheDir;
     char* execStmt;
+    char* profileOut;
     char** args;
     int argsCount;
 } Options;
@@ -341,6 +350,26 @@ static void parseArguments(int argc, char** argv) {
         OPT_BOOLEAN('C', "no-colors", &opts.disableColors,
                     "Disable output coloring. Hints are disabled as well", 0, 0, 0),
         OPT_BOOLEAN('H', "no-hints", &opts.disableHints, "Disable hinting support", 0, 0, 0),
+        OPT_STRING('p', "profile", &opts.profileOut,
+                   "Sample the J* call stack while running and write the samples to the given "
+                   "file, in folded stacks format",
+                   0, 0, 0),
+        OPT_BOOLEAN('B', "bytecode-cache", &opts.bytecodeCache,
+                    "Cache the compiled code of imported modules in __jscache__ directories next "
+                    "to their sources, and import them from it when their sources didn't change",
+                    0, 0, 0),
+        OPT_STRING(0, "cache-dir", &opts.cacheDir,
+                   "Store the compiled code cached by '-B' in the given directory. Implies '-B'", 0,
+                   0, 0),
+        OPT_BOOLEAN('L', "lazy-imports", &opts.lazyImports,
+                    "Load imported modules the first time one of their names is used", 0, 0, 0),
+        OPT_BOOLEAN(0, "import-times", &opts.importTimes,
+                    "Print the time taken to load and execute every imported module at exit", 0, 0,
+                    0),
+        OPT_BOOLEAN('s', "stats", &opts.printStats,
+                    "Print opcode and function statistics at exit. Requires J* to be built with "
+                    "JSTAR_OPCODE_STATS",
+                    0, 0, 0),
         OPT_BOOLEAN('v', "version", &opts.showVersion, "Print version information and exit", 0, 0,
                     0),
         OPT_END(),
@@ -375,6 +404,10 @@ static void initApp(int argc, char** argv) {
     PROFILE_BEGIN_SESSION("jstar-init.json")
     JStarConf conf = jsrGetConf();
     conf.errorCallback = &errorCallback;
+    conf.bytecodeCache = opts.bytecodeCache || opts.cacheDir != NULL;
+    conf.bytecodeCacheDir = opts.cacheDir;
+    conf.lazyImports = opts.lazyImports;
+    conf.traceImports = opts.importTimes;
     vm = jsrNewVM(&conf);
     jsrBufferInit(vm, &completionBuf);
     PROFILE_END_SESSION()
@@ -387,8 +420,56 @@ static void initApp(int argc, char** argv) {
     if(!opts.disableColors && !opts.disableHints) replxx_set_hint_callback(replxx, &hints, vm);
 }
 
+// Stop the profiler and write the samples to the file passed to `--profile`
+static void writeProfile(void) {
+    jsrStopProfiler(vm);
+
+    JStarBuffer profile;
+    jsrBufferInit(vm, &profile);
+    jsrGetProfile(vm, &profile);
+
+    FILE* out = fopen(opts.profileOut, "w");
+    if(out) {
+        fwrite(profile.data, 1, profile.size, out);
+        fclose(out);
+    } else {
+        fConsolePrint(replxx, REPLXX_STDERR, COLOR_RED, "Error writing profile %s: %s\n",
+                      opts.profileOut, strerror(errno));
+    }
+
+    jsrBufferFree(&profile);
+}
+
+// Print the opcode statistics requested with `--stats`
+static void printStats(void) {
+    JStarBuffer stats;
+    jsrBufferInit(vm, &stats);
+
+    if(jsrGetOpcodeStats(vm, &stats)) {
+        fwrite(stats.data, 1, stats.size, stderr);
+    } else {
+        fConsolePrint(replxx, REPLXX_STDERR, COLOR_RED,
+                      "Opcode statistics are not available, build J* with JSTAR_OPCODE_STATS\n");
+    }
+
+    jsrBufferFree(&stats);
+}
+
+// Print the import times requested with `--import-times`
+static void printImportTimes(void) {
+    JStarBuffer times;
+    jsrBufferInit(vm, &times);
+    jsrGetImportTimes(vm, &times);
+    fwrite(times.data, 1, times.size, stderr);
+    jsrBufferFree(&times);
+}
+
 // Free the app state
 static void freeApp(void) {
+    if(opts.profileOut) writeProfile();
+    if(opts.printStats) printStats();
+    if(opts.importTimes) printImportTimes();
+
     // Free  the J* VM
     PROFILE_BEGIN_SESSION("jstar-free.json")
     jsrBufferFree(&completionBuf);
@@ -460,6 +541,11 @@ int main(int argc, char** argv) {
     atexit(&freeApp);
     initImportPaths();
 
+    if(opts.profileOut && !jsrStartProfiler(vm, PROFILE_INTERVAL)) {
+        fConsolePrint(replxx, REPLXX_STDERR, COLOR_RED, "Profiling is not supported\n");
+        opts.profileOut = NULL;
+    }
+
     if(opts.execStmt) {
         JStarResult res = evaluateString("<string>", opts.execStmt);
         if(opts.script) {
@@ -6,12 +6,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "jstar/jstar.h"
 #include "profiler.h"
+#include "sync.h"
 
 #define JSR_EXT ".jsr"
 #define JSC_EXT ".jsc"
+#define JSB_EXT ".jsb"
+
+#define PACKAGE_FILE "__package__"
 
 typedef struct Options {
     char *input, *output;
@@ -20,27 +25,66 @@ typedef struct Options {
     bool recursive;
     bool showVersion;
     bool list;
+    bool bundle;
+    bool incremental;
+    int jobs;
 } Options;
 
+// Modules compiled so far when building a bundle
+typedef struct Bundle {
+    char** names;
+    JStarBuffer* codes;
+    int count, capacity;
+} Bundle;
+
+// A file to compile during directory compilation
+typedef struct Job {
+    char* path;
+    char* out;             // Output file, or module name when building a bundle
+    JStarBuffer compiled;  // Compiled code, only kept when building a bundle
+    bool ok;
+} Job;
+
+// Files to compile during directory compilation, in the order they were found.
+// Jobs are taken in order by the workers, each compiling on its own VM
+typedef struct JobQueue {
+    Job* jobs;
+    int count, capacity;
+    int next;  // Next job to be taken, protected by `lock`
+    Mutex lock;
+} JobQueue;
+
+// A thread compiling the jobs of the queue
+typedef struct Worker {
+    JStarVM* vm;
+    Thread thread;
+    bool started;
+} Worker;
+
 // -----------------------------------------------------------------------------
 // APP STATE
 // -----------------------------------------------------------------------------
 
 static Options opts;
 static JStarVM* vm;
+static Bundle bundle;
+static JobQueue queue;
+// The workers are freed only at exit, as their VMs own the compiled code of the bundle
+static Worker* workers;
+static int workerCount;
 
 // -----------------------------------------------------------------------------
 // CALLBACKS AND HOOKS
 // -----------------------------------------------------------------------------
 
 // Custom J* error callback.
+// Errors are printed with a single call, so that errors of files compiled in parallel don't mix
 static void errorCallback(JStarVM* vm, JStarResult res, const char* file, int ln, const char* err) {
     PROFILE_FUNC()
     switch(res) {
     case JSR_SYNTAX_ERR:
     case JSR_COMPILE_ERR:
-        fprintf(stderr, "File %s [line:%d]:\n", file, ln);
-        fprintf(stderr, "%s\n", err);
+        fprintf(stderr, "File %s [line:%d]:\n%s\n", file, ln, err);
         break;
     default:
         break;
@@ -67,6 +111,24 @@ static bool isDirectory(const char* path) {
     return false;
 }
 
+// Returns whether the file at `out` exists and was modified after the file at `path`.
+// Modification times only have a resolution of a second, so files modified in the same second
+// are considered out of date.
+static bool isUpToDate(const char* path, const char* out) {
+    struct stat src, dst;
+    if(stat(path, &src) != 0 || stat(out, &dst) != 0) {
+        return false;
+    }
+    return dst.st_mtime > src.st_mtime;
+}
+
+static char* copyString(const char* str) {
+    size_t len = strlen(str);
+    char* copy = malloc(len + 1);
+    memcpy(copy, str, len + 1);
+    return copy;
+}
+
 // -----------------------------------------------------------------------------
 // FILE COMPILATION AND DISASSEMBLY
 // -----------------------------------------------------------------------------
@@ -95,12 +157,9 @@ static bool writeToFile(const JStarBuffer* buf, const char* path) {
     return true;
 }
 
-// Compile the file at `path` and store the result in a new file at `out`.
-// If `out` is NULL, then an output path will be generated from the input one by changing
-// the file extension.
-// If `-l` or `-c` were passed to the application, then no output file is generated.
+// Compile the source file at `path`, placing the resulting bytecode in `out`.
 // Returns true on success, false on failure.
-static bool compileFile(const char* path, const char* out) {
+static bool compileSource(JStarVM* vm, const char* path, JStarBuffer* out) {
     PROFILE_FUNC()
 
     JStarBuffer src;
@@ -109,6 +168,25 @@ static bool compileFile(const char* path, const char* out) {
         return false;
     }
 
+    JStarResult res = jsrCompileCode(vm, path, src.data, out);
+    jsrBufferFree(&src);
+    if(res != JSR_SUCCESS) {
+        fprintf(stderr, "Error compiling file %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+// Compile the file at `path` and store the result in a new file at `out`.
+// If `out` is NULL, then an output path will be generated from the input one by changing
+// the file extension.
+// If `-l` or `-c` were passed to the application, then no output file is generated.
+// If `-i` was passed, the file is skipped if its output is newer than the source.
+// Returns true on success, false on failure.
+static bool compileFile(JStarVM* vm, const char* path, const char* out) {
+    PROFILE_FUNC()
+
     char outPath[FILENAME_MAX];
     if(out != NULL) {
         cwk_path_normalize(out, outPath, sizeof(outPath));
@@ -116,14 +194,16 @@ static bool compileFile(const char* path, const char* out) {
         cwk_path_change_extension(path, JSC_EXT, outPath, sizeof(outPath));
     }
 
+    bool writesOutput = !opts.list && !opts.compileOnly;
+    if(opts.incremental && writesOutput && isUpToDate(path, outPath)) {
+        return true;
+    }
+
     printf("Compiling %s to %s...\n", path, outPath);
     fflush(stdout);
 
     JStarBuffer compiled;
-    JStarResult res = jsrCompileCode(vm, path, src.data, &compiled);
-    jsrBufferFree(&src);
-    if(res != JSR_SUCCESS) {
-        fprintf(stderr, "Error compiling file %s\n", path);
+    if(!compileSource(vm, path, &compiled)) {
         return false;
     }
 
@@ -143,7 +223,7 @@ static bool compileFile(const char* path, const char* out) {
 
 // Disassemble the file at `path` and print the bytecode to standard output.
 // Returns true on success, false on failure.
-static bool disassembleFile(const char* path) {
+static bool disassembleFile(JStarVM* vm, const char* path) {
     PROFILE_FUNC()
 
     JStarBuffer code;
@@ -165,6 +245,203 @@ static bool disassembleFile(const char* path) {
     return true;
 }
 
+// -----------------------------------------------------------------------------
+// BUNDLE COMPILATION
+// -----------------------------------------------------------------------------
+
+// Generate the name of the module defined by a file using its path relative to the input root
+// directory, so that `pkg/mod.jsr` becomes `pkg.mod`. Package files (`pkg/__package__.jsr`) take
+// the name of their directory.
+// Returns false if the file doesn't define a valid module name.
+static bool makeModuleName(const char* root, const char* currDir, const char* fileName,
+                           char* dest, size_t size) {
+    const char* relDir = &currDir[cwk_path_get_intersection(root, currDir)];
+    while(*relDir == '/' || *relDir == '\\') relDir++;
+
+    if(strlen(relDir) != 0) {
+        cwk_path_join(relDir, fileName, dest, size);
+    } else {
+        cwk_path_normalize(fileName, dest, size);
+    }
+
+    size_t extLen;
+    const char* ext;
+    if(cwk_path_get_extension(dest, &ext, &extLen)) {
+        dest[ext - dest] = '\0';
+    }
+
+    for(char* c = dest; *c; c++) {
+        if(*c == '/' || *c == '\\') *c = '.';
+    }
+
+    size_t len = strlen(dest), pkgLen = strlen(PACKAGE_FILE);
+    if(len >= pkgLen && strcmp(dest + len - pkgLen, PACKAGE_FILE) == 0) {
+        if(len == pkgLen) return false;
+        dest[len - pkgLen - 1] = '\0';
+    }
+
+    return strlen(dest) != 0;
+}
+
+// Compile the file at `path`, placing the code of the module `name` in `out`.
+// Returns true on success, false on failure.
+static bool compileModule(JStarVM* vm, const char* path, const char* name, JStarBuffer* out) {
+    PROFILE_FUNC()
+
+    printf("Compiling %s as module %s...\n", path, name);
+    fflush(stdout);
+
+    return compileSource(vm, path, out);
+}
+
+// Add the compiled code of the module `name` to the bundle, that takes ownership of it.
+static void addToBundle(const char* name, JStarBuffer compiled) {
+    if(bundle.count == bundle.capacity) {
+        bundle.capacity = bundle.capacity ? bundle.capacity * 2 : 8;
+        bundle.names = realloc(bundle.names, sizeof(char*) * bundle.capacity);
+        bundle.codes = realloc(bundle.codes, sizeof(JStarBuffer) * bundle.capacity);
+    }
+
+    size_t nameLen = strlen(name);
+    bundle.names[bundle.count] = malloc(nameLen + 1);
+    memcpy(bundle.names[bundle.count], name, nameLen + 1);
+    bundle.codes[bundle.count] = compiled;
+    bundle.count++;
+}
+
+// Pack all the modules compiled so far in a single bundle file at `out`.
+// Returns true on success, false on failure.
+static bool writeBundle(const char* out) {
+    PROFILE_FUNC()
+
+    printf("Writing %d modules to %s...\n", bundle.count, out);
+    fflush(stdout);
+
+    JStarBuffer packed;
+    JStarResult res = jsrBundleCode(vm, (const char**)bundle.names, bundle.codes, bundle.count,
+                                    &packed);
+    if(res != JSR_SUCCESS) {
+        fprintf(stderr, "Error writing bundle %s: duplicate module names\n", out);
+        return false;
+    }
+
+    if(!writeToFile(&packed, out)) {
+        fprintf(stderr, "Failed to write %s: %s\n", out, strerror(errno));
+        jsrBufferFree(&packed);
+        return false;
+    }
+
+    jsrBufferFree(&packed);
+    return true;
+}
+
+static void freeBundle(void) {
+    for(int i = 0; i < bundle.count; i++) {
+        free(bundle.names[i]);
+        jsrBufferFree(&bundle.codes[i]);
+    }
+    free(bundle.names);
+    free(bundle.codes);
+    bundle = (Bundle){0};
+}
+
+// -----------------------------------------------------------------------------
+// PARALLEL COMPILATION
+// -----------------------------------------------------------------------------
+
+static void addJob(const char* path, const char* out) {
+    if(queue.count == queue.capacity) {
+        queue.capacity = queue.capacity ? queue.capacity * 2 : 8;
+        queue.jobs = realloc(queue.jobs, sizeof(Job) * queue.capacity);
+    }
+    queue.jobs[queue.count++] = (Job){copyString(path), copyString(out), {0}, false};
+}
+
+static void runJob(JStarVM* vm, Job* job) {
+    if(opts.bundle) {
+        job->ok = compileModule(vm, job->path, job->out, &job->compiled);
+    } else {
+        job->ok = compileFile(vm, job->path, job->out);
+    }
+}
+
+// Run the jobs of the queue on `vm` until there are none left.
+static void runJobs(void* vm) {
+    for(;;) {
+        lockMutex(&queue.lock);
+        int next = queue.next < queue.count ? queue.next++ : -1;
+        unlockMutex(&queue.lock);
+
+        if(next < 0) break;
+        runJob(vm, &queue.jobs[next]);
+    }
+}
+
+// Number of threads used to compile `jobCount` files, as requested with `-j`.
+// Listing the bytecode always uses a single thread, so that listings don't mix.
+static int threadCount(int jobCount) {
+    int threads = opts.jobs > 0 ? opts.jobs : cpuCount();
+    if(opts.list) threads = 1;
+    if(threads > jobCount) threads = jobCount;
+    return threads > 1 ? threads : 1;
+}
+
+// Compile all the queued files, each on one of the `-j` threads.
+// The calling thread compiles alongside the workers on the main VM.
+// Returns true if all files compiled successfully, false otherwise.
+static bool compileJobs(void) {
+    PROFILE_FUNC()
+
+    int threads = threadCount(queue.count);
+    workerCount = threads - 1;
+    workers = calloc(workerCount > 0 ? workerCount : 1, sizeof(Worker));
+
+    JStarConf conf = jsrGetConf();
+    conf.errorCallback = &errorCallback;
+
+    for(int i = 0; i < workerCount; i++) {
+        workers[i].vm = jsrNewVM(&conf);
+        workers[i].started = startThread(&workers[i].thread, &runJobs, workers[i].vm);
+    }
+
+    // If a worker couldn't be started its share of the jobs is run here
+    runJobs(vm);
+
+    for(int i = 0; i < workerCount; i++) {
+        if(workers[i].started) joinThread(&workers[i].thread);
+    }
+
+    bool allok = true;
+    for(int i = 0; i < queue.count; i++) {
+        Job* job = &queue.jobs[i];
+        allok &= job->ok;
+        if(opts.bundle && job->ok) {
+            addToBundle(job->out, job->compiled);
+        }
+    }
+
+    return allok;
+}
+
+static void freeJobs(void) {
+    for(int i = 0; i < queue.count; i++) {
+        free(queue.jobs[i].path);
+        free(queue.jobs[i].out);
+    }
+    free(queue.jobs);
+    queue.jobs = NULL;
+    queue.count = queue.capacity = queue.next = 0;
+}
+
+static void freeWorkers(void) {
+    for(int i = 0; i < workerCount; i++) {
+        jsrFreeVM(workers[i].vm);
+    }
+    free(workers);
+    workers = NULL;
+    workerCount = 0;
+}
+
 // -----------------------------------------------------------------------------
 // DIRECTORY COMPILATION
 // -----------------------------------------------------------------------------
@@ -188,19 +465,28 @@ static void makeOutputPath(const char* root, const char* outRoot, const char* cu
 // Process a J* source file during directory compilation.
 // It generates the the full file path and an output path using the input root directory,
 // output root directory, the current position in the directory tree and a file name.
-// It then compiles or disassembles the file based on application options.
+// It then disassembles the file, or queues it for compilation, based on application options.
 // Returns true on success, false on failure.
 static bool processDirFile(const char* root, const char* outRoot, const char* currDir,
                            const char* fileName) {
     char filePath[FILENAME_MAX];
     cwk_path_join(currDir, fileName, filePath, sizeof(filePath));
 
-    if(!opts.disassemble) {
+    if(opts.bundle) {
+        char moduleName[FILENAME_MAX];
+        if(!makeModuleName(root, currDir, fileName, moduleName, sizeof(moduleName))) {
+            fprintf(stderr, "Cannot bundle %s: not a valid module\n", filePath);
+            return false;
+        }
+        addJob(filePath, moduleName);
+        return true;
+    } else if(!opts.disassemble) {
         char outPath[FILENAME_MAX];
         makeOutputPath(root, outRoot, currDir, fileName, outPath, sizeof(outPath));
-        return compileFile(filePath, outPath);
+        addJob(filePath, outPath);
+        return true;
     } else {
-        return disassembleFile(filePath);
+        return disassembleFile(vm, filePath);
     }
 }
 
@@ -259,6 +545,8 @@ static bool walkDirectory(const char* root, const char* currDir, const char* out
 // It normalizes the diretory path and either normalizes or generates an out
 // path depending if the `out` argument is null or not.
 // It then delegates the actual directory scan to `walkDirectory`.
+// If `-b` was passed to the application, `out` is the path of the bundle file, generated by
+// adding the bundle extension to the directory path if null.
 // Returns true on success, false on failure.
 static bool processDirectory(const char* dir, const char* out) {
     char inputDir[FILENAME_MAX];
@@ -267,11 +555,24 @@ static bool processDirectory(const char* dir, const char* out) {
     char outputDir[FILENAME_MAX];
     if(out != NULL) {
         cwk_path_normalize(out, outputDir, sizeof(outputDir));
+    } else if(opts.bundle) {
+        int len = snprintf(outputDir, sizeof(outputDir), "%s%s", inputDir, JSB_EXT);
+        if(len < 0 || (size_t)len >= sizeof(outputDir)) {
+            fprintf(stderr, "Bundle path too long for directory %s\n", inputDir);
+            return false;
+        }
     } else {
         strcpy(outputDir, inputDir);
     }
 
-    return walkDirectory(inputDir, inputDir, outputDir);
+    bool ok = walkDirectory(inputDir, inputDir, outputDir);
+    ok &= compileJobs();
+
+    if(opts.bundle && ok && !opts.compileOnly) {
+        ok = writeBundle(outputDir);
+    }
+
+    return ok;
 }
 
 // -----------------------------------------------------------------------------
@@ -281,6 +582,7 @@ static bool processDirectory(const char* dir, const char* out) {
 // Parse the app arguments into an Options struct
 static void parseArguments(int argc, char** argv) {
     opts = (Options){0};
+    opts.jobs = 1;
 
     static const char* const usage[] = {
         "jstarc [options] <file>",
@@ -303,6 +605,16 @@ static void parseArguments(int argc, char** argv) {
         OPT_BOOLEAN('c', "compile-only", &opts.compileOnly,
                     "Compile files but do not generate output files. Used for syntax checking", 0,
                     0, 0),
+        OPT_BOOLEAN('b', "bundle", &opts.bundle,
+                    "Compile all files in <directory> into a single bundle file, that can be added "
+                    "to the import paths",
+                    0, 0, 0),
+        OPT_INTEGER('j', "jobs", &opts.jobs,
+                    "Compile the files in <directory> in parallel on the given number of threads. "
+                    "0 uses a thread per processor",
+                    0, 0, 0),
+        OPT_BOOLEAN('i', "incremental", &opts.incremental,
+                    "Skip files whose output file is newer than the source", 0, 0, 0),
         OPT_BOOLEAN('v', "version", &opts.showVersion, "Print version information and exit", 0, 0,
                     0),
         OPT_END(),
@@ -319,7 +631,7 @@ static void parseArguments(int argc, char** argv) {
         exit(EXIT_SUCCESS);
     }
 
-    if(nonOpts != 1) {
+    if(nonOpts != 1 || (opts.bundle && opts.disassemble) || opts.jobs < 0) {
         argparse_usage(&argparse);
         exit(EXIT_FAILURE);
     }
@@ -335,12 +647,17 @@ static void initApp(int argc, char** argv) {
     JStarConf conf = jsrGetConf();
     conf.errorCallback = &errorCallback;
     vm = jsrNewVM(&conf);
+    initMutex(&queue.lock);
     PROFILE_END_SESSION()
 }
 
 // Free the app state
 static void freeApp(void) {
     PROFILE_BEGIN_SESSION("jstar-free.json")
+    freeBundle();
+    freeJobs();
+    freeWorkers();
+    freeMutex(&queue.lock);
     jsrFreeVM(vm);
     PROFILE_END_SESSION()
 }
@@ -354,10 +671,13 @@ int main(int argc, char** argv) {
     bool ok;
     if(isDirectory(opts.input)) {
         ok = processDirectory(opts.input, opts.output);
+    } else if(opts.bundle) {
+        fprintf(stderr, "Bundles can only be built from a <directory>\n");
+        ok = false;
     } else if(opts.disassemble) {
-        ok = disassembleFile(opts.input);
+        ok = disassembleFile(vm, opts.input);
     } else {
-        ok = compileFile(opts.input, opts.output);
+        ok = compileFile(vm, opts.input, opts.output);
     }
 
     PROFILE_END_SESSION()
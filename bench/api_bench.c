@@ -0,0 +1,399 @@
+#include <argparse.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jstar/jstar.h"
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#define DEFAULT_ITERATIONS 1000000
+#define DEFAULT_RUNS       5
+
+typedef struct Options {
+    int iterations;
+    int runs;
+    bool list;
+} Options;
+
+// Slots of the values used by the benchmarks, pushed on the stack by `setup`, and the symbols
+// used by the benchmarks of the symbol API
+typedef struct Slots {
+    int instance, list, tuple, add, callback;
+    JStarSymbol *x, *y, *point, *len2;
+} Slots;
+
+typedef void (*BenchFn)(JStarVM* vm, const Slots* s, int iterations);
+
+typedef struct Benchmark {
+    const char* name;
+    BenchFn fn;
+    const char* description;
+} Benchmark;
+
+static const char setupCode[] =
+    "class Point\n"
+    "    fun new(x, y)\n"
+    "        this.x, this.y = x, y\n"
+    "    end\n"
+    "    fun len2()\n"
+    "        return this.x * this.x + this.y * this.y\n"
+    "    end\n"
+    "end\n"
+    "fun add(a, b)\n"
+    "    return a + b\n"
+    "end\n"
+    "fun callback(n)\n"
+    "    return nativeDouble(n)\n"
+    "end\n"
+    "var point = Point(3, 4)\n"
+    "var list = [1, 2, 3, 4, 5, 6, 7, 8]\n"
+    "var tuple = (1, 2, 3, 4, 5, 6, 7, 8)\n";
+
+// -----------------------------------------------------------------------------
+// APP STATE
+// -----------------------------------------------------------------------------
+
+static Options opts;
+static const char** selected;
+static int selectedCount;
+
+// Set by benchmarks on API errors, so that the results are not reported
+static bool failed;
+
+// -----------------------------------------------------------------------------
+// UTILITY FUNCTIONS
+// -----------------------------------------------------------------------------
+
+static double now(void) {
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    if(freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static void check(JStarVM* vm, bool ok) {
+    if(!ok && !failed) {
+        failed = true;
+        jsrPrintStacktrace(vm, -1);
+    }
+}
+
+static JSR_NATIVE(jsr_nativeDouble) {
+    JSR_CHECK(Number, 1, "n");
+    jsrPushNumber(vm, jsrGetNumber(vm, 1) * 2);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// BENCHMARKS
+// -----------------------------------------------------------------------------
+
+static void benchPushPop(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushNumber(vm, i);
+        jsrPushBoolean(vm, true);
+        jsrPushNull(vm);
+        jsrPop(vm);
+        jsrPop(vm);
+        jsrPop(vm);
+    }
+}
+
+static void benchPushString(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushString(vm, "benchmark string");
+        jsrPop(vm);
+    }
+}
+
+static void benchGetField(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        check(vm, jsrGetField(vm, s->instance, "x"));
+        jsrPop(vm);
+    }
+}
+
+static void benchSetField(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushNumber(vm, i);
+        check(vm, jsrSetField(vm, s->instance, "y"));
+        jsrPop(vm);
+    }
+}
+
+static void benchGetGlobal(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        check(vm, jsrGetGlobal(vm, JSR_MAIN_MODULE, "point"));
+        jsrPop(vm);
+    }
+}
+
+static void benchCall(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushValue(vm, s->add);
+        jsrPushNumber(vm, i);
+        jsrPushNumber(vm, 1);
+        check(vm, jsrCall(vm, 2) == JSR_SUCCESS);
+        jsrPop(vm);
+    }
+}
+
+static void benchCallMethod(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushValue(vm, s->instance);
+        check(vm, jsrCallMethod(vm, "len2", 0) == JSR_SUCCESS);
+        jsrPop(vm);
+    }
+}
+
+static void benchCallNativeMethod(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushValue(vm, s->list);
+        check(vm, jsrCallMethod(vm, "__len__", 0) == JSR_SUCCESS);
+        jsrPop(vm);
+    }
+}
+
+static void benchGetFieldSym(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        check(vm, jsrGetFieldSym(vm, s->instance, s->x));
+        jsrPop(vm);
+    }
+}
+
+static void benchSetFieldSym(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushNumber(vm, i);
+        check(vm, jsrSetFieldSym(vm, s->instance, s->y));
+        jsrPop(vm);
+    }
+}
+
+static void benchGetGlobalSym(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        check(vm, jsrGetGlobalSym(vm, JSR_MAIN_MODULE, s->point));
+        jsrPop(vm);
+    }
+}
+
+static void benchCallMethodSym(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushValue(vm, s->instance);
+        check(vm, jsrCallMethodSym(vm, s->len2, 0) == JSR_SUCCESS);
+        jsrPop(vm);
+    }
+}
+
+static void benchListAccess(JStarVM* vm, const Slots* s, int iterations) {
+    size_t length = jsrListGetLength(vm, s->list);
+    for(int i = 0; i < iterations; i++) {
+        jsrListGet(vm, i % length, s->list);
+        jsrPop(vm);
+    }
+}
+
+static void benchTupleAccess(JStarVM* vm, const Slots* s, int iterations) {
+    size_t length = jsrTupleGetLength(vm, s->tuple);
+    for(int i = 0; i < iterations; i++) {
+        jsrTupleGet(vm, i % length, s->tuple);
+        jsrPop(vm);
+    }
+}
+
+static void benchSubscript(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushNumber(vm, i % 8);
+        check(vm, jsrSubscriptGet(vm, s->list));
+        jsrPop(vm);
+    }
+}
+
+static void benchNativeCallback(JStarVM* vm, const Slots* s, int iterations) {
+    for(int i = 0; i < iterations; i++) {
+        jsrPushValue(vm, s->callback);
+        jsrPushNumber(vm, i);
+        check(vm, jsrCall(vm, 1) == JSR_SUCCESS);
+        jsrPop(vm);
+    }
+}
+
+static const Benchmark benchmarks[] = {
+    {"push-pop",        &benchPushPop,          "Push and pop a Number, a Boolean and null"},
+    {"push-string",     &benchPushString,       "Push and pop a String"},
+    {"get-field",       &benchGetField,         "jsrGetField on an instance"},
+    {"set-field",       &benchSetField,         "jsrSetField on an instance"},
+    {"get-global",      &benchGetGlobal,        "jsrGetGlobal from the main module"},
+    {"call",            &benchCall,             "jsrCall of a J* function"},
+    {"call-method",     &benchCallMethod,       "jsrCallMethod of a J* method"},
+    {"call-native",     &benchCallNativeMethod, "jsrCallMethod of a native method"},
+    {"get-field-sym",   &benchGetFieldSym,      "jsrGetFieldSym on an instance"},
+    {"set-field-sym",   &benchSetFieldSym,      "jsrSetFieldSym on an instance"},
+    {"get-global-sym",  &benchGetGlobalSym,     "jsrGetGlobalSym from the main module"},
+    {"call-method-sym", &benchCallMethodSym,    "jsrCallMethodSym of a J* method"},
+    {"list-get",        &benchListAccess,       "jsrListGet"},
+    {"tuple-get",       &benchTupleAccess,      "jsrTupleGet"},
+    {"subscript",       &benchSubscript,        "jsrSubscriptGet on a List"},
+    {"callback",        &benchNativeCallback,   "jsrCall of a J* function calling a C native"},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// -----------------------------------------------------------------------------
+// BENCHMARK EXECUTION
+// -----------------------------------------------------------------------------
+
+static bool pushGlobal(JStarVM* vm, const char* name, int* slot) {
+    if(!jsrGetGlobal(vm, JSR_MAIN_MODULE, name)) {
+        jsrPrintStacktrace(vm, -1);
+        return false;
+    }
+    *slot = jsrTop(vm);
+    return true;
+}
+
+// Evaluate the setup code and push the values used by the benchmarks
+static bool setup(JStarVM* vm, Slots* s) {
+    if(jsrEvalString(vm, "<api-bench>", setupCode) != JSR_SUCCESS) {
+        return false;
+    }
+
+    // Resolved at call time by `callback`, so it can be defined after the setup code runs
+    jsrPushNative(vm, JSR_MAIN_MODULE, "nativeDouble", &jsr_nativeDouble, 1);
+    jsrSetGlobal(vm, JSR_MAIN_MODULE, "nativeDouble");
+    jsrPop(vm);
+
+    s->x = jsrInternSymbol(vm, "x");
+    s->y = jsrInternSymbol(vm, "y");
+    s->point = jsrInternSymbol(vm, "point");
+    s->len2 = jsrInternSymbol(vm, "len2");
+
+    return pushGlobal(vm, "point", &s->instance) && pushGlobal(vm, "list", &s->list) &&
+           pushGlobal(vm, "tuple", &s->tuple) && pushGlobal(vm, "add", &s->add) &&
+           pushGlobal(vm, "callback", &s->callback);
+}
+
+static bool isSelected(const Benchmark* b) {
+    if(selectedCount == 0) return true;
+    for(int i = 0; i < selectedCount; i++) {
+        if(strcmp(selected[i], b->name) == 0) return true;
+    }
+    return false;
+}
+
+// Returns the median time of a single iteration in nanoseconds, or a negative value on error
+static double runBenchmark(JStarVM* vm, const Slots* s, const Benchmark* b) {
+    double* samples = malloc(sizeof(double) * opts.runs);
+
+    // Warm up caches and let the heap reach a steady state
+    b->fn(vm, s, opts.iterations / 10);
+
+    for(int run = 0; run < opts.runs; run++) {
+        int top = jsrTop(vm);
+        double start = now();
+        b->fn(vm, s, opts.iterations);
+        samples[run] = (now() - start) * 1e9 / opts.iterations;
+
+        if(jsrTop(vm) != top) {
+            fprintf(stderr, "Benchmark %s left the stack unbalanced\n", b->name);
+            failed = true;
+        }
+    }
+
+    qsort(samples, opts.runs, sizeof(double), &compareDoubles);
+    double median = samples[opts.runs / 2];
+    free(samples);
+    return failed ? -1 : median;
+}
+
+// -----------------------------------------------------------------------------
+// APP INITIALIZATION AND MAIN FUNCTION
+// -----------------------------------------------------------------------------
+
+static void parseArguments(int argc, char** argv) {
+    opts = (Options){.iterations = DEFAULT_ITERATIONS, .runs = DEFAULT_RUNS};
+
+    static const char* const usage[] = {
+        "jstar-api-bench [options] [benchmark...]",
+        NULL,
+    };
+
+    struct argparse_option options[] = {
+        OPT_HELP(),
+        OPT_GROUP("Options"),
+        OPT_INTEGER('i', "iterations", &opts.iterations, "Iterations of every sample", 0, 0, 0),
+        OPT_INTEGER('n', "runs", &opts.runs, "Number of samples taken for every benchmark", 0, 0,
+                    0),
+        OPT_BOOLEAN('l', "list", &opts.list, "List the available benchmarks and exit", 0, 0, 0),
+        OPT_END(),
+    };
+
+    struct argparse argparse;
+    argparse_init(&argparse, options, usage, 0);
+    argparse_describe(&argparse, "jstar-api-bench measures the overhead of the J* C API", NULL);
+    int nonOpts = argparse_parse(&argparse, argc, (const char**)argv);
+
+    if(opts.list) {
+        for(size_t i = 0; i < BENCHMARK_COUNT; i++) {
+            printf("%-14s %s\n", benchmarks[i].name, benchmarks[i].description);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    if(opts.iterations <= 0 || opts.runs <= 0) {
+        argparse_usage(&argparse);
+        exit(EXIT_FAILURE);
+    }
+
+    selected = (const char**)argv;
+    selectedCount = nonOpts;
+}
+
+int main(int argc, char** argv) {
+    parseArguments(argc, argv);
+
+    JStarConf conf = jsrGetConf();
+    JStarVM* vm = jsrNewVM(&conf);
+    jsrEnsureStack(vm, 64);
+
+    Slots slots;
+    if(!setup(vm, &slots)) {
+        jsrFreeVM(vm);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-14s %10s\n", "benchmark", "ns/op");
+    for(size_t i = 0; i < BENCHMARK_COUNT && !failed; i++) {
+        const Benchmark* b = &benchmarks[i];
+        if(!isSelected(b)) continue;
+
+        double ns = runBenchmark(vm, &slots, b);
+        if(ns < 0) {
+            fprintf(stderr, "Benchmark %s failed\n", b->name);
+            break;
+        }
+
+        printf("%-14s %10.1f\n", b->name, ns);
+        fflush(stdout);
+    }
+
+    jsrFreeVM(vm);
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
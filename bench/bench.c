@@ -0,0 +1,401 @@
+#include <argparse.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jstar/jstar.h"
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#define JSR_EXT ".jsr"
+
+#define DEFAULT_RUNS      5
+#define DEFAULT_THRESHOLD 10
+
+typedef struct Options {
+    const char* dir;
+    const char* output;
+    const char* compare;
+    int runs;
+    int threshold;
+    bool list;
+} Options;
+
+// A workload of the suite, implemented by the script `<dir>/<name>.jsr`
+typedef struct Benchmark {
+    const char* name;
+    int repeat;  // Number of times the script is run to take a single sample
+    const char* description;
+} Benchmark;
+
+// Measurements of a benchmark. `time` is the median of the samples, the other values are taken
+// from the last one (they are deterministic for a given build)
+typedef struct Result {
+    char name[64];
+    double time;
+    double minTime, maxTime;
+    size_t allocations;
+    size_t bytes;
+    size_t collections;
+    double pause;
+    double maxPause;
+} Result;
+
+static const Benchmark benchmarks[] = {
+    {"oop",     1,   "Method call heavy object oriented code"},
+    {"numeric", 1,   "Numeric loops and recursion"},
+    {"strings", 1,   "String building and searching"},
+    {"tables",  1,   "Table insertion, lookup and deletion"},
+    {"regex",   1,   "Pattern matching with the re module"},
+    {"sort",    1,   "List.sort with and without callbacks"},
+    {"startup", 200, "VM creation and builtin imports"},
+    {"gc",      1,   "Many small objects and a large heap"},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// -----------------------------------------------------------------------------
+// APP STATE
+// -----------------------------------------------------------------------------
+
+static Options opts;
+static const char** selected;
+static int selectedCount;
+
+// -----------------------------------------------------------------------------
+// UTILITY FUNCTIONS
+// -----------------------------------------------------------------------------
+
+static double now(void) {
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    if(freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static bool isSelected(const Benchmark* b) {
+    if(selectedCount == 0) return true;
+    for(int i = 0; i < selectedCount; i++) {
+        if(strcmp(selected[i], b->name) == 0) return true;
+    }
+    return false;
+}
+
+static void errorCallback(JStarVM* vm, JStarResult res, const char* file, int ln, const char* err) {
+    (void)vm;
+    (void)res;
+    if(ln >= 0) {
+        fprintf(stderr, "File %s [line:%d]:\n", file, ln);
+    } else {
+        fprintf(stderr, "File %s:\n", file);
+    }
+    fprintf(stderr, "%s\n", err);
+}
+
+// -----------------------------------------------------------------------------
+// BENCHMARK EXECUTION
+// -----------------------------------------------------------------------------
+
+// Run the script at `path` in a fresh VM, accumulating its memory statistics in `res`.
+// Returns the time taken in seconds, or a negative value on error.
+static double runScript(const char* path, Result* res) {
+    JStarConf conf = jsrGetConf();
+    conf.errorCallback = &errorCallback;
+
+    double start = now();
+
+    JStarVM* vm = jsrNewVM(&conf);
+    jsrAddImportPath(vm, opts.dir);
+
+    JStarBuffer code;
+    if(!jsrReadFile(vm, path, &code)) {
+        fprintf(stderr, "Cannot open file %s: %s\n", path, strerror(errno));
+        jsrFreeVM(vm);
+        return -1;
+    }
+
+    JStarResult evalRes = jsrEval(vm, path, &code);
+    jsrBufferFree(&code);
+
+    double elapsed = now() - start;
+
+    JStarGCStats stats;
+    jsrGetGCStats(vm, &stats);
+    jsrFreeVM(vm);
+
+    if(evalRes != JSR_SUCCESS) return -1;
+
+    for(size_t i = 0; i < stats.objTypeCount; i++) {
+        res->allocations += stats.objects[i].allocations;
+        res->bytes += stats.objects[i].bytes;
+    }
+    res->collections += stats.fullCollections + stats.minorCollections;
+    res->pause += stats.totalPause;
+    if(stats.maxPause > res->maxPause) res->maxPause = stats.maxPause;
+
+    return elapsed;
+}
+
+static bool runBenchmark(const Benchmark* b, Result* res) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s" JSR_EXT, opts.dir, b->name);
+
+    double* samples = malloc(sizeof(double) * opts.runs);
+
+    for(int run = 0; run < opts.runs; run++) {
+        *res = (Result){0};
+        snprintf(res->name, sizeof(res->name), "%s", b->name);
+
+        double sample = 0;
+        for(int i = 0; i < b->repeat; i++) {
+            double t = runScript(path, res);
+            if(t < 0) {
+                free(samples);
+                return false;
+            }
+            sample += t;
+        }
+        samples[run] = sample;
+    }
+
+    qsort(samples, opts.runs, sizeof(double), &compareDoubles);
+    res->time = samples[opts.runs / 2];
+    res->minTime = samples[0];
+    res->maxTime = samples[opts.runs - 1];
+
+    free(samples);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// RESULTS
+// -----------------------------------------------------------------------------
+
+static void printHeader(void) {
+    printf("%-10s %10s %10s %10s %12s %14s %6s %10s %10s\n", "benchmark", "median(s)", "min(s)",
+           "max(s)", "objects", "bytes", "GCs", "pause(s)", "maxpause");
+}
+
+static void printResult(const Result* r) {
+    printf("%-10s %10.4f %10.4f %10.4f %12zu %14zu %6zu %10.4f %10.4f\n", r->name, r->time,
+           r->minTime, r->maxTime, r->allocations, r->bytes, r->collections, r->pause,
+           r->maxPause);
+}
+
+static bool saveResults(const char* path, const Result* results, int count) {
+    FILE* f = fopen(path, "w");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fprintf(f, "# J* %s benchmark results\n", JSTAR_VERSION_STRING);
+    fprintf(f, "# name time min max objects bytes collections pause maxpause\n");
+    for(int i = 0; i < count; i++) {
+        const Result* r = &results[i];
+        fprintf(f, "%s %.6f %.6f %.6f %zu %zu %zu %.6f %.6f\n", r->name, r->time, r->minTime,
+                r->maxTime, r->allocations, r->bytes, r->collections, r->pause, r->maxPause);
+    }
+
+    fclose(f);
+    return true;
+}
+
+static int loadResults(const char* path, Result** out) {
+    FILE* f = fopen(path, "r");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    Result* results = NULL;
+    int count = 0, capacity = 0;
+
+    char line[512];
+    while(fgets(line, sizeof(line), f)) {
+        if(line[0] == '#' || line[0] == '\n') continue;
+
+        if(count + 1 > capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            results = realloc(results, sizeof(Result) * capacity);
+        }
+
+        Result* r = &results[count];
+        *r = (Result){0};
+        int n = sscanf(line, "%63s %lf %lf %lf %zu %zu %zu %lf %lf", r->name, &r->time,
+                       &r->minTime, &r->maxTime, &r->allocations, &r->bytes, &r->collections,
+                       &r->pause, &r->maxPause);
+        if(n != 9) {
+            fprintf(stderr, "Malformed results line in %s: %s", path, line);
+            continue;
+        }
+        count++;
+    }
+
+    fclose(f);
+    *out = results;
+    return count;
+}
+
+static double percentChange(double baseline, double value) {
+    if(baseline == 0) return 0;
+    return (value - baseline) * 100.0 / baseline;
+}
+
+// Compare the results against a baseline, returning false if any benchmark regressed by more
+// than the threshold either in time or in allocated bytes
+static bool compareResults(const Result* results, int count, const Result* base, int baseCount) {
+    printf("\nComparison with %s (threshold %d%%):\n", opts.compare, opts.threshold);
+    printf("%-10s %10s %10s %8s %14s %8s\n", "benchmark", "base(s)", "new(s)", "time", "bytes",
+           "alloc");
+
+    bool ok = true;
+    for(int i = 0; i < count; i++) {
+        const Result* r = &results[i];
+
+        const Result* b = NULL;
+        for(int j = 0; j < baseCount; j++) {
+            if(strcmp(base[j].name, r->name) == 0) {
+                b = &base[j];
+                break;
+            }
+        }
+
+        if(b == NULL) {
+            printf("%-10s %10s %10.4f %8s %14zu %8s\n", r->name, "-", r->time, "-", r->bytes, "-");
+            continue;
+        }
+
+        double timeChange = percentChange(b->time, r->time);
+        double allocChange = percentChange((double)b->bytes, (double)r->bytes);
+        bool regressed = timeChange > opts.threshold || allocChange > opts.threshold;
+
+        printf("%-10s %10.4f %10.4f %+7.1f%% %14zu %+7.1f%%%s\n", r->name, b->time, r->time,
+               timeChange, r->bytes, allocChange, regressed ? "  REGRESSION" : "");
+
+        if(regressed) ok = false;
+    }
+
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+// APP INITIALIZATION AND MAIN FUNCTION
+// -----------------------------------------------------------------------------
+
+static void listBenchmarks(void) {
+    for(size_t i = 0; i < BENCHMARK_COUNT; i++) {
+        printf("%-10s %s\n", benchmarks[i].name, benchmarks[i].description);
+    }
+}
+
+static void parseArguments(int argc, char** argv) {
+    opts = (Options){.dir = ".", .runs = DEFAULT_RUNS, .threshold = DEFAULT_THRESHOLD};
+
+    static const char* const usage[] = {
+        "jstar-bench [options] [benchmark...]",
+        NULL,
+    };
+
+    struct argparse_option options[] = {
+        OPT_HELP(),
+        OPT_GROUP("Options"),
+        OPT_STRING('d', "dir", &opts.dir, "Directory containing the benchmark scripts", 0, 0, 0),
+        OPT_INTEGER('n', "runs", &opts.runs, "Number of samples taken for every benchmark", 0, 0,
+                    0),
+        OPT_STRING('o', "output", &opts.output, "Save the results to file", 0, 0, 0),
+        OPT_STRING('c', "compare", &opts.compare,
+                   "Compare the results with the ones saved in file by a previous run", 0, 0, 0),
+        OPT_INTEGER('t', "threshold", &opts.threshold,
+                    "Percentage of slowdown or allocation increase reported as a regression", 0,
+                    0, 0),
+        OPT_BOOLEAN('l', "list", &opts.list, "List the available benchmarks and exit", 0, 0, 0),
+        OPT_END(),
+    };
+
+    struct argparse argparse;
+    argparse_init(&argparse, options, usage, 0);
+    argparse_describe(&argparse, "jstar-bench runs the J* benchmark suite", NULL);
+    int nonOpts = argparse_parse(&argparse, argc, (const char**)argv);
+
+    if(opts.list) {
+        listBenchmarks();
+        exit(EXIT_SUCCESS);
+    }
+
+    if(opts.runs <= 0 || opts.threshold < 0) {
+        argparse_usage(&argparse);
+        exit(EXIT_FAILURE);
+    }
+
+    selected = (const char**)argv;
+    selectedCount = nonOpts;
+
+    for(int i = 0; i < selectedCount; i++) {
+        bool found = false;
+        for(size_t j = 0; j < BENCHMARK_COUNT; j++) {
+            if(strcmp(selected[i], benchmarks[j].name) == 0) found = true;
+        }
+        if(!found) {
+            fprintf(stderr, "Unknown benchmark %s\n", selected[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    parseArguments(argc, argv);
+
+    Result results[BENCHMARK_COUNT];
+    int count = 0;
+    bool ok = true;
+
+    printHeader();
+    for(size_t i = 0; i < BENCHMARK_COUNT; i++) {
+        const Benchmark* b = &benchmarks[i];
+        if(!isSelected(b)) continue;
+
+        if(!runBenchmark(b, &results[count])) {
+            fprintf(stderr, "Benchmark %s failed\n", b->name);
+            ok = false;
+            continue;
+        }
+
+        printResult(&results[count]);
+        fflush(stdout);
+        count++;
+    }
+
+    if(opts.output && !saveResults(opts.output, results, count)) {
+        ok = false;
+    }
+
+    if(opts.compare) {
+        Result* base = NULL;
+        int baseCount = loadResults(opts.compare, &base);
+        if(baseCount < 0 || !compareResults(results, count, base, baseCount)) {
+            ok = false;
+        }
+        free(base);
+    }
+
+    exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,351 @@
+#include <argparse.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jstar/jstar.h"
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#define DEFAULT_OPS  1000000
+#define DEFAULT_RUNS 5
+
+// The index of a Table has a power of two number of slots and a maximum load of 75%, so a table of
+// `fill * capacity` keys, with `fill` between 37.5% and 75%, has exactly `capacity` slots
+static const size_t capacities[] = {1 << 8, 1 << 12, 1 << 16, 1 << 20};
+static const double fills[] = {0.40, 0.50, 0.625, 0.75};
+
+#define CAPACITY_COUNT (sizeof(capacities) / sizeof(capacities[0]))
+#define FILL_COUNT     (sizeof(fills) / sizeof(fills[0]))
+
+typedef struct Options {
+    int ops;
+    int runs;
+    bool list;
+} Options;
+
+// Slots of the values used by a benchmark case, pushed on the stack by `setupCase`
+typedef struct Slots {
+    int keys;     // Keys inserted in the table, in insertion order
+    int lookups;  // The same keys shuffled, so that lookups don't follow the order of the entries
+    int misses;   // Keys of the same type never inserted
+    int table;    // A table holding all of `keys`
+} Slots;
+
+// Runs `ops` operations on tables of `size` keys, returning the seconds spent in them
+typedef double (*BenchFn)(JStarVM* vm, const Slots* s, size_t size, size_t ops);
+
+typedef struct Benchmark {
+    const char* name;
+    BenchFn fn;
+    const char* description;
+} Benchmark;
+
+// -----------------------------------------------------------------------------
+// APP STATE
+// -----------------------------------------------------------------------------
+
+static Options opts;
+static const char** selected;
+static int selectedCount;
+static bool failed;
+
+// -----------------------------------------------------------------------------
+// UTILITY FUNCTIONS
+// -----------------------------------------------------------------------------
+
+static double now(void) {
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    if(freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static void check(JStarVM* vm, bool ok) {
+    if(!ok && !failed) {
+        failed = true;
+        jsrPrintStacktrace(vm, -1);
+    }
+}
+
+// Fixed seed generator, so that every run shuffles the keys in the same way
+static uint64_t nextRandom(uint64_t* state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+static void pushKey(JStarVM* vm, bool strings, const char* prefix, size_t i) {
+    if(strings) {
+        char key[32];
+        snprintf(key, sizeof(key), "%s%zu", prefix, i);
+        jsrPushString(vm, key);
+    } else {
+        jsrPushNumber(vm, i);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// BENCHMARKS
+// -----------------------------------------------------------------------------
+
+static void insertKeys(JStarVM* vm, const Slots* s, int table, size_t size) {
+    for(size_t i = 0; i < size; i++) {
+        jsrListGet(vm, i, s->keys);
+        jsrPushNumber(vm, i);
+        check(vm, jsrSubscriptSet(vm, table));
+        jsrPop(vm);
+    }
+}
+
+static double benchLookupHit(JStarVM* vm, const Slots* s, size_t size, size_t ops) {
+    double start = now();
+    for(size_t i = 0; i < ops; i++) {
+        jsrListGet(vm, i % size, s->lookups);
+        check(vm, jsrSubscriptGet(vm, s->table));
+        jsrPop(vm);
+    }
+    return now() - start;
+}
+
+static double benchLookupMiss(JStarVM* vm, const Slots* s, size_t size, size_t ops) {
+    double start = now();
+    for(size_t i = 0; i < ops; i++) {
+        jsrListGet(vm, i % size, s->misses);
+        check(vm, jsrSubscriptGet(vm, s->table));
+        jsrPop(vm);
+    }
+    return now() - start;
+}
+
+// Fills new tables from empty, so the time includes their growth
+static double benchInsert(JStarVM* vm, const Slots* s, size_t size, size_t ops) {
+    double time = 0;
+    for(size_t done = 0; done < ops; done += size) {
+        jsrPushTable(vm);
+        double start = now();
+        insertKeys(vm, s, jsrTop(vm), size);
+        time += now() - start;
+        jsrPop(vm);
+    }
+    return time;
+}
+
+// Empties filled tables in insertion order. Only the deletions are timed
+static double benchDelete(JStarVM* vm, const Slots* s, size_t size, size_t ops) {
+    double time = 0;
+    for(size_t done = 0; done < ops; done += size) {
+        jsrPushTable(vm);
+        int table = jsrTop(vm);
+        insertKeys(vm, s, table, size);
+
+        double start = now();
+        for(size_t i = 0; i < size; i++) {
+            jsrPushValue(vm, table);
+            jsrListGet(vm, i, s->keys);
+            check(vm, jsrCallMethod(vm, "delete", 1) == JSR_SUCCESS);
+            jsrPop(vm);
+        }
+        time += now() - start;
+        jsrPop(vm);
+    }
+    return time;
+}
+
+static const Benchmark benchmarks[] = {
+    {"lookup-hit",  &benchLookupHit,  "Subscript of keys in the table, in shuffled order"},
+    {"lookup-miss", &benchLookupMiss, "Subscript of keys not in the table"},
+    {"insert",      &benchInsert,     "Insertion of new keys, growing the table from empty"},
+    {"delete",      &benchDelete,     "Table.delete() of all the keys of a filled table"},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// -----------------------------------------------------------------------------
+// BENCHMARK EXECUTION
+// -----------------------------------------------------------------------------
+
+// Push the keys of a case of `size` keys and a table holding them
+static void setupCase(JStarVM* vm, Slots* s, bool strings, size_t size) {
+    jsrPushList(vm);
+    s->keys = jsrTop(vm);
+    jsrPushList(vm);
+    s->lookups = jsrTop(vm);
+    jsrPushList(vm);
+    s->misses = jsrTop(vm);
+
+    size_t* order = malloc(sizeof(size_t) * size);
+    for(size_t i = 0; i < size; i++) {
+        order[i] = i;
+    }
+
+    uint64_t state = 42;
+    for(size_t i = size - 1; i > 0; i--) {
+        size_t j = nextRandom(&state) % (i + 1);
+        size_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for(size_t i = 0; i < size; i++) {
+        pushKey(vm, strings, "key", i);
+        jsrListAppend(vm, s->keys);
+        jsrPop(vm);
+        pushKey(vm, strings, "miss", strings ? i : size + i);
+        jsrListAppend(vm, s->misses);
+        jsrPop(vm);
+    }
+
+    for(size_t i = 0; i < size; i++) {
+        jsrListGet(vm, order[i], s->keys);
+        jsrListAppend(vm, s->lookups);
+        jsrPop(vm);
+    }
+
+    free(order);
+
+    jsrPushTable(vm);
+    s->table = jsrTop(vm);
+    insertKeys(vm, s, s->table, size);
+}
+
+static bool isSelected(const Benchmark* b) {
+    if(selectedCount == 0) return true;
+    for(int i = 0; i < selectedCount; i++) {
+        if(strcmp(selected[i], b->name) == 0) return true;
+    }
+    return false;
+}
+
+// Returns the median time of a single operation in nanoseconds, or a negative value on error
+static double runBenchmark(JStarVM* vm, const Slots* s, const Benchmark* b, size_t size) {
+    double* samples = malloc(sizeof(double) * opts.runs);
+    size_t ops = (size_t)opts.ops > size ? (size_t)opts.ops : size;
+
+    // Warm up caches and let the heap reach a steady state
+    b->fn(vm, s, size, size);
+
+    for(int run = 0; run < opts.runs; run++) {
+        int top = jsrTop(vm);
+        samples[run] = b->fn(vm, s, size, ops) * 1e9 / ops;
+
+        if(jsrTop(vm) != top) {
+            fprintf(stderr, "Benchmark %s left the stack unbalanced\n", b->name);
+            failed = true;
+        }
+    }
+
+    qsort(samples, opts.runs, sizeof(double), &compareDoubles);
+    double median = samples[opts.runs / 2];
+    free(samples);
+    return failed ? -1 : median;
+}
+
+static void runCases(JStarVM* vm, bool strings) {
+    for(size_t c = 0; c < CAPACITY_COUNT && !failed; c++) {
+        for(size_t f = 0; f < FILL_COUNT && !failed; f++) {
+            size_t size = (size_t)(capacities[c] * fills[f]);
+
+            Slots slots;
+            setupCase(vm, &slots, strings, size);
+
+            for(size_t i = 0; i < BENCHMARK_COUNT && !failed; i++) {
+                const Benchmark* b = &benchmarks[i];
+                if(!isSelected(b)) continue;
+
+                double ns = runBenchmark(vm, &slots, b, size);
+                if(ns < 0) {
+                    fprintf(stderr, "Benchmark %s failed\n", b->name);
+                    break;
+                }
+
+                printf("%-12s %-7s %8zu %8zu %6.1f%% %10.1f\n", b->name, strings ? "String" : "Number",
+                       size, capacities[c], fills[f] * 100, ns);
+                fflush(stdout);
+            }
+
+            jsrPop(vm);
+            jsrPop(vm);
+            jsrPop(vm);
+            jsrPop(vm);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// APP INITIALIZATION AND MAIN FUNCTION
+// -----------------------------------------------------------------------------
+
+static void parseArguments(int argc, char** argv) {
+    opts = (Options){.ops = DEFAULT_OPS, .runs = DEFAULT_RUNS};
+
+    static const char* const usage[] = {
+        "jstar-table-bench [options] [benchmark...]",
+        NULL,
+    };
+
+    struct argparse_option options[] = {
+        OPT_HELP(),
+        OPT_GROUP("Options"),
+        OPT_INTEGER('o', "ops", &opts.ops, "Minimum operations of every sample", 0, 0, 0),
+        OPT_INTEGER('n', "runs", &opts.runs, "Number of samples taken for every benchmark", 0, 0,
+                    0),
+        OPT_BOOLEAN('l', "list", &opts.list, "List the available benchmarks and exit", 0, 0, 0),
+        OPT_END(),
+    };
+
+    struct argparse argparse;
+    argparse_init(&argparse, options, usage, 0);
+    argparse_describe(&argparse,
+                      "jstar-table-bench measures the throughput of Table operations at "
+                      "different sizes and fill ratios",
+                      NULL);
+    int nonOpts = argparse_parse(&argparse, argc, (const char**)argv);
+
+    if(opts.list) {
+        for(size_t i = 0; i < BENCHMARK_COUNT; i++) {
+            printf("%-12s %s\n", benchmarks[i].name, benchmarks[i].description);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    if(opts.ops <= 0 || opts.runs <= 0) {
+        argparse_usage(&argparse);
+        exit(EXIT_FAILURE);
+    }
+
+    selected = (const char**)argv;
+    selectedCount = nonOpts;
+}
+
+int main(int argc, char** argv) {
+    parseArguments(argc, argv);
+
+    JStarConf conf = jsrGetConf();
+    JStarVM* vm = jsrNewVM(&conf);
+    jsrEnsureStack(vm, 64);
+
+    printf("%-12s %-7s %8s %8s %7s %10s\n", "benchmark", "keys", "size", "slots", "fill",
+           "ns/op");
+    runCases(vm, false);
+    runCases(vm, true);
+
+    jsrFreeVM(vm);
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -1,4 +1,8 @@
 include(CMakeFindDependencyMacro)
+if(UNIX)
+    set(THREADS_PREFER_PTHREAD_FLAG ON)
+    find_dependency(Threads)
+endif()
 include("${CMAKE_CURRENT_LIST_DIR}/JStarConfigVersion.cmake")
 include("${CMAKE_CURRENT_LIST_DIR}/JStarTargets.cmake")
 message(STATUS "Found J* version ${PACKAGE_VERSION}")
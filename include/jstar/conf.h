@@ -21,12 +21,15 @@
 /* #undef JSTAR_DBG_PRINT_EXEC */
 /* #undef JSTAR_DBG_PRINT_GC */
 /* #undef JSTAR_DBG_STRESS_GC */
+/* #undef JSTAR_OPCODE_STATS */
 
 #define JSTAR_SYS
 #define JSTAR_IO
 #define JSTAR_MATH
 #define JSTAR_DEBUG
 #define JSTAR_RE
+#define JSTAR_EVENT
+#define JSTAR_THREAD
 
 // Platform detection
 #if defined(_WIN32) && (defined(__WIN32__) || defined(WIN32) || defined(__MINGW32__))
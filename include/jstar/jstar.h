@@ -57,11 +57,58 @@ typedef void (*JStarErrorCB)(JStarVM* vm, JStarResult err, const char* file, int
 JSTAR_API void jsrPrintErrorCB(JStarVM* vm, JStarResult err, const char* file, int line,
                                const char* error);
 
+// J* page allocation callback, used as the page source of the small object allocator.
+// Called with `page == NULL` to allocate `size` bytes and with `size == 0` to free `page`.
+typedef void* (*JStarPageAllocCB)(JStarVM* vm, void* page, size_t size);
+
+// Cache of compiled modules that can be shared by VMs running on different threads.
+// A VM configured with a cache stores in it, in compiled form, every module it imports from a file.
+// Other VMs sharing the cache then import the module from memory, without reading or compiling its
+// file again, and deserialize the body of its functions only when they are first called.
+// Modules are loaded again if their file has been modified since they were cached.
+// Only the compiled code is shared: every VM still executes the modules it imports, and owns
+// their globals and all the objects they create.
+typedef struct JStarCodeCache JStarCodeCache;
+
+// Allocate a new empty code cache
+JSTAR_API JStarCodeCache* jsrNewCodeCache(void);
+
+// Free a code cache. Must be called only after all the VMs using it have been freed
+JSTAR_API void jsrFreeCodeCache(JStarCodeCache* cache);
+
+// A VM configured with `bytecodeCache` writes the compiled code of every source module it imports
+// to a cache file, and imports the module from it on later runs, as long as the source file keeps
+// the same modification time and size (or contents). Cache files are stored in a `__jscache__`
+// directory next to each source, or all in `bytecodeCacheDir` if set. Code compiled by another
+// version of J* is ignored and replaced. Failing to write the cache is not an error
+
+// Sources at least `streamCompileSize` bytes long are compiled while being parsed, one top level
+// statement at a time, so that the syntax tree of the whole module is never kept in memory. As a
+// consequence compile errors in the statements preceding a syntax error are reported as well
+
+// With `lazyImports` the modules imported by an `import` statement are not loaded right away: the
+// statement binds a placeholder module, that is found, loaded and executed the first time one of
+// its names is accessed. Errors raised while loading are reported at that point.
+// With `traceImports` the time taken to load and execute every module is recorded, and can be
+// retrieved with `jsrGetImportTimes`
+
 typedef struct JstarConf {
     size_t startingStackSize;       // Initial stack size in bytes
     size_t firstGCCollectionPoint;  // first GC collection point in bytes
     int heapGrowRate;               // The rate at which the heap will grow after a GC pass
+    bool generationalGC;            // Collect young objects separately from old ones
+    size_t nurserySize;             // Bytes allocated between minor GC passes (generational only)
+    size_t memoryLimit;             // Bytes the VM can allocate before a MemoryException (0 = none)
+    size_t maxInternedLength;       // Longest string that is interned when created from C data
     JStarErrorCB errorCallback;     // Error callback
+    JStarPageAllocCB pageAllocator; // Page source of the small object allocator (NULL uses malloc)
+    JStarCodeCache* codeCache;      // Compiled modules shared with other VMs (NULL disables it)
+    size_t evalCacheSize;           // Sources compiled by eval kept for reuse (0 disables it)
+    bool bytecodeCache;             // Cache the compiled code of imported sources on disk
+    const char* bytecodeCacheDir;   // Directory of the cached code (NULL uses __jscache__ dirs)
+    size_t streamCompileSize;       // Shortest source compiled as it's parsed (0 disables it)
+    bool lazyImports;               // Load imported modules on first use
+    bool traceImports;              // Record the time taken by every import
     void* customData;               // Custom data associated with the VM
 } JStarConf;
 
@@ -74,6 +121,22 @@ JSTAR_API JStarVM* jsrNewVM(const JStarConf* conf);
 // Free a previously obtained VM along with all of its state
 JSTAR_API void jsrFreeVM(JStarVM* vm);
 
+// Save the current state of the VM as the one restored by `jsrResetVM`: the loaded modules with
+// the values of their globals, and the import paths. `jsrNewVM` saves the state of the VM right
+// after its initialization. Call this after configuring the VM and importing the modules shared
+// by all the code it will run, so that resetting doesn't have to load them again
+JSTAR_API void jsrCheckpointVM(JStarVM* vm);
+
+// Restore the VM to its last checkpoint, so that it can be reused to run unrelated code in a
+// fraction of the time needed to create a new one. Modules loaded after the checkpoint are
+// dropped, and the globals of the other ones get back the values they had. Globals defined after
+// the checkpoint in the other modules are set to null.
+// Only the globals themselves are restored: changes to the contents of the objects they refer to
+// (e.g. a List held by a global of a module imported before the checkpoint) persist.
+// All the memory not reachable from the restored state is then reclaimed by a full collection.
+// Must not be called during the execution of code (i.e. from a native)
+JSTAR_API void jsrResetVM(JStarVM* vm);
+
 // Get the custom data associated with the VM at configuration time (if any)
 JSTAR_API void* jsrGetCustomData(JStarVM* vm);
 
@@ -107,6 +170,14 @@ JSTAR_API JStarResult jsrEvalModuleString(JStarVM* vm, const char* path, const c
 JSTAR_API JStarResult jsrCompileCode(JStarVM* vm, const char* path, const char* src,
                                      JStarBuffer* out);
 
+// Packs the compiled modules in `codes`, as produced by `jsrCompileCode`, in a single bundle
+// placing the result in `out`. `names` contains the full name of every module (e.g. `pkg.mod`).
+// Adding the path of a bundle file (with a `.jsb` extension) to the import paths makes the VM
+// import its modules directly from the file, that is mapped in memory once and never copied.
+// Returns JSR_DESERIALIZE_ERR if a buffer doesn't contain compiled code or a name is repeated.
+JSTAR_API JStarResult jsrBundleCode(JStarVM* vm, const char** names, const JStarBuffer* codes,
+                                    int count, JStarBuffer* out);
+
 // Disassembles the bytecode provided in `code` and prints it to stdout
 // The `path` argument is the file path that will passed to the forward callback on errors
 // Prints nothing if the provided `code` buffer doesn't contain valid bytecode
@@ -154,7 +225,9 @@ JSTAR_API void jsrGetStacktrace(JStarVM* vm, int slot);
 // Init the sys.args list with a list of arguments (usually main arguments)
 JSTAR_API void jsrInitCommandLineArgs(JStarVM* vm, int argc, const char** argv);
 
-// Add a path to be searched during module imports
+// Add a path to be searched during module imports.
+// This also clears the cache of import path resolution, so that files created after the last
+// import in any of the import directories become visible
 JSTAR_API void jsrAddImportPath(JStarVM* vm, const char* path);
 
 // Raises the axception at 'slot'. If the object at 'slot' is not an exception instance it
@@ -166,6 +239,134 @@ JSTAR_API void jsrRaiseException(JStarVM* vm, int slot);
 // If "cls" cannot be found in current module a NameException is raised instead.
 JSTAR_API void jsrRaise(JStarVM* vm, const char* cls, const char* err, ...);
 
+// -----------------------------------------------------------------------------
+// MEMORY STATISTICS
+// -----------------------------------------------------------------------------
+
+// When a memory limit is configured and the heap grows past it, the VM runs a full collection.
+// If the live memory is still over the limit, the running code is interrupted with a
+// MemoryException at the first possible point (the same ones checked by `jsrEvalBreak`).
+// The exception can be caught: the memory exceeding the limit is reclaimed as soon as the values
+// holding it are no longer reachable. Allocations themselves never fail, so natives can
+// temporarily exceed the limit.
+
+#define JSR_GC_PAUSE_BUCKETS 7
+#define JSR_MAX_OBJ_TYPES    32
+
+// Allocation statistics of a type of object
+typedef struct JStarObjStats {
+    const char* type;    // Name of the object type
+    size_t allocations;  // Objects allocated since the creation of the VM
+    size_t bytes;        // Bytes allocated for them, excluding separate buffers (e.g. List storage)
+    size_t live;         // Objects currently allocated
+} JStarObjStats;
+
+typedef struct JStarGCStats {
+    size_t allocated;         // Bytes currently allocated
+    size_t nextGC;            // Bytes at which the next full collection will be triggered
+    size_t memoryLimit;       // Configured memory limit (0 if none)
+    size_t fullCollections;   // Full collections performed
+    size_t minorCollections;  // Minor collections performed (generational mode only)
+    size_t bytesFreed;        // Bytes freed by all collections
+    double totalPause;        // Seconds spent collecting
+    double maxPause;          // Longest collection, in seconds
+    // Histogram of collection pauses. Bucket `i` counts the pauses shorter than 10^(i+1)
+    // microseconds not counted by the previous ones, the last bucket all the longer pauses
+    size_t pauses[JSR_GC_PAUSE_BUCKETS];
+    size_t objTypeCount;                       // Number of valid entries of `objects`
+    JStarObjStats objects[JSR_MAX_OBJ_TYPES];  // Statistics of each type of object
+} JStarGCStats;
+
+// Fill `stats` with the memory statistics of the VM
+JSTAR_API void jsrGetGCStats(JStarVM* vm, JStarGCStats* stats);
+
+// -----------------------------------------------------------------------------
+// SAMPLING PROFILER
+// -----------------------------------------------------------------------------
+
+// Start sampling the J* call stack of the VM every `interval` microseconds of CPU time, dropping
+// the samples of the previous session. Samples are taken at the same points where `jsrEvalBreak`
+// is checked (loops, calls and returns), and code in between runs at full speed.
+// The samples are requested by a process wide timer signal, so only one VM per process can be
+// profiled at a time. Returns false if another VM is being profiled, if `interval` is not
+// positive or if profiling is not supported on the platform.
+JSTAR_API bool jsrStartProfiler(JStarVM* vm, int interval);
+
+// Stop sampling. The samples are kept until the next session is started or the VM is freed
+JSTAR_API void jsrStopProfiler(JStarVM* vm);
+
+// Append the samples taken to `out` in the folded stacks format read by flame graph tools: one
+// line for every distinct stack, with its frames (`module.function:line`, outermost first)
+// separated by ';' and followed by the number of times it has been sampled
+JSTAR_API void jsrGetProfile(JStarVM* vm, JStarBuffer* out);
+
+// Append to `out` a report of the opcode statistics of the VM: how many times each opcode and the
+// most frequent pairs of consecutive opcodes have been executed, and the number of calls and self
+// time of the functions that took the most time. Returns false, leaving `out` untouched, if J*
+// has been built without the JSTAR_OPCODE_STATS option
+JSTAR_API bool jsrGetOpcodeStats(JStarVM* vm, JStarBuffer* out);
+
+// Append to `out` a report of the time taken by every module imported so far, both by itself
+// and including the modules it imported, slowest first. Lazily imported modules that have not been
+// loaded are listed as well. Returns false, leaving `out` untouched, if the VM has been created
+// without `traceImports`
+JSTAR_API bool jsrGetImportTimes(JStarVM* vm, JStarBuffer* out);
+
+// -----------------------------------------------------------------------------
+// EVENT TRACING
+// -----------------------------------------------------------------------------
+
+// Events recorded by the tracer. The values are bit flags, so that they can be combined in the
+// mask passed to `jsrStartTracing`
+typedef enum JStarTraceEventType {
+    JSR_TRACE_CALL = 1 << 0,          // A function has been called
+    JSR_TRACE_RETURN = 1 << 1,        // A function returned, or its frame has been unwound
+    JSR_TRACE_GC_START = 1 << 2,      // A garbage collection is starting
+    JSR_TRACE_GC_END = 1 << 3,        // A garbage collection has ended
+    JSR_TRACE_IMPORT_BEGIN = 1 << 4,  // A module is being imported
+    JSR_TRACE_IMPORT_END = 1 << 5,    // A module has been imported (and executed)
+    JSR_TRACE_EXCEPTION = 1 << 6,     // An exception has been raised
+} JStarTraceEventType;
+
+#define JSR_TRACE_ALL       0x7f
+#define JSR_TRACE_NAME_SIZE 32
+
+// A fixed size record of an event. The meaning of `data` depends on the type of the event:
+//  - CALL, RETURN: data[0] is 1 for native functions, data[1] is 1 for frames unwound by an
+//    exception. A tail call is recorded as the return of the caller followed by a call
+//  - GC_START: data[0] is the number of bytes allocated, data[1] is 1 for minor collections
+//  - GC_END: data[0] is the number of bytes allocated, data[1] the number of bytes freed
+//  - IMPORT_END: data[0] is 1 if the module has been imported successfully
+// `name` is the qualified name of the function (`module.function`), the name of the module or
+// the class of the exception, truncated to fit and always NUL terminated
+typedef struct JStarTraceEvent {
+    double time;     // Seconds from an arbitrary point, from the same clock of the GC pauses
+    uint32_t type;   // A JStarTraceEventType
+    uint32_t depth;  // Frames on the call stack, the same for a call and its return
+    uint64_t data[2];
+    char name[JSR_TRACE_NAME_SIZE];
+} JStarTraceEvent;
+
+// Start recording the events in `mask` in a ring buffer holding (at least) `capacity` events,
+// dropping the events of the previous session. When tracing is stopped, or the events are not in
+// the mask, the hooks only cost a branch on the mask. Events recorded while the buffer is full are
+// dropped and counted. Returns false if `capacity` or `mask` is 0.
+// Tracing must be started and stopped by the thread running the VM
+JSTAR_API bool jsrStartTracing(JStarVM* vm, size_t capacity, uint32_t mask);
+
+// Stop recording events. The events still in the buffer can be drained until the next session is
+// started or the VM is freed
+JSTAR_API void jsrStopTracing(JStarVM* vm);
+
+// Move up to `max` of the oldest events recorded into `out`, returning their number.
+// The buffer is lock free with a single producer and a single consumer: it can be drained by one
+// thread at a time, which doesn't have to be the thread running the VM
+JSTAR_API size_t jsrDrainTrace(JStarVM* vm, JStarTraceEvent* out, size_t max);
+
+// Number of events dropped since tracing was started because the buffer was full. Can be called
+// from the draining thread
+JSTAR_API size_t jsrTraceDropped(JStarVM* vm);
+
 // -----------------------------------------------------------------------------
 // UTILITY FUNCTIONS AND DEFINITIONS
 // -----------------------------------------------------------------------------
@@ -200,6 +401,11 @@ typedef bool (*JStarNative)(JStarVM* vm);
 // -----------------------------------------------------------------------------
 
 // J* native registry, used to associate names to native pointers in native c extension modules.
+// Natives registered as `leaf` are called without pushing a new stack frame, which makes calling
+// them cheaper. A leaf native must not call back into the VM (calling functions or methods,
+// evaluating code, importing modules or any API function that may do so, like `jsrIter` or
+// `jsrEquals`). Leaf natives can still raise exceptions as usual.
+// A leaf native called with default arguments omitted uses the normal calling convention.
 typedef struct JStarNativeReg {
     enum { REG_METHOD, REG_FUNCTION, REG_SENTINEL } type;
     union {
@@ -213,10 +419,13 @@ typedef struct JStarNativeReg {
             JStarNative fun;
         } function;
     } as;
+    bool leaf;
 } JStarNativeReg;
 
-#define JSR_REGFUNC(name, func)      {REG_FUNCTION, {.function = {#name, func}}},
-#define JSR_REGMETH(cls, name, meth) {REG_METHOD, {.method = {#cls, #name, meth}}},
+#define JSR_REGFUNC(name, func)           {REG_FUNCTION, {.function = {#name, func}}, false},
+#define JSR_REGMETH(cls, name, meth)      {REG_METHOD, {.method = {#cls, #name, meth}}, false},
+#define JSR_REGFUNC_LEAF(name, func)      {REG_FUNCTION, {.function = {#name, func}}, true},
+#define JSR_REGMETH_LEAF(cls, name, meth) {REG_METHOD, {.method = {#cls, #name, meth}}, true},
 #define JSR_REGEND                     \
     {                                  \
         REG_SENTINEL, {                \
@@ -256,6 +465,10 @@ JSTAR_API void jsrPushNull(JStarVM* vm);
 JSTAR_API void jsrPushList(JStarVM* vm);
 JSTAR_API void jsrPushTuple(JStarVM* vm, size_t size);
 JSTAR_API void jsrPushTable(JStarVM* vm);
+// Like jsrPushList and jsrPushTable, but the containers are pre-allocated to hold `capacity`
+// elements. Use these when the final size is known to avoid repeated reallocations
+JSTAR_API void jsrPushListCapacity(JStarVM* vm, size_t capacity);
+JSTAR_API void jsrPushTableCapacity(JStarVM* vm, size_t capacity);
 JSTAR_API void jsrPushValue(JStarVM* vm, int slot);
 JSTAR_API void* jsrPushUserdata(JStarVM* vm, size_t size, void (*finalize)(void*));
 JSTAR_API void jsrPushNative(JStarVM* vm, const char* module, const char* name, JStarNative nat,
@@ -285,6 +498,11 @@ JSTAR_API size_t jsrGetStringSz(JStarVM* vm, int slot);
 // from the stack  while retaining this buffer, because
 // if a GC occurs and the string is not found to be
 // reachable it'll be collected.
+// The buffer stays NUL terminated and unchanged while the
+// String is alive, even if J* code is called in between.
+// Retrieving it may allocate (Strings built by concatenation
+// can be given their own copy of the data), so it can
+// trigger a garbage collection.
 JSTAR_API const char* jsrGetString(JStarVM* vm, int slot);
 
 // -----------------------------------------------------------------------------
@@ -329,6 +547,13 @@ JSTAR_API void jsrListInsert(JStarVM* vm, size_t i, int slot);
 JSTAR_API void jsrListRemove(JStarVM* vm, size_t i, int slot);
 JSTAR_API void jsrListGet(JStarVM* vm, size_t i, int slot);
 JSTAR_API size_t jsrListGetLength(JStarVM* vm, int slot);
+// Grows the List at `slot` so that it can hold at least `capacity` elements
+JSTAR_API void jsrListReserve(JStarVM* vm, size_t capacity, int slot);
+// Appends the `n` values on top of the stack to the List at `slot` and pops them.
+// The List must not be one of the appended values
+JSTAR_API void jsrListAppendN(JStarVM* vm, size_t n, int slot);
+// Appends `count` numbers from a C buffer to the List at `slot`
+JSTAR_API void jsrListAppendNumbers(JStarVM* vm, const double* nums, size_t count, int slot);
 
 // -----------------------------------------------------------------------------
 // TUPLE MANIPULATION FUNCTIONS
@@ -395,6 +620,25 @@ JSTAR_API void jsrSetGlobal(JStarVM* vm, const char* module, const char* name);
 // If calling inside a native "module" can be NULL, and the used module will be the current one
 JSTAR_API bool jsrGetGlobal(JStarVM* vm, const char* module, const char* name);
 
+// -----------------------------------------------------------------------------
+// SYMBOLS
+// -----------------------------------------------------------------------------
+
+// A name resolved ahead of time, for code that repeatedly calls the same methods or accesses the
+// same fields and globals. The functions taking a symbol behave like their counterparts taking a
+// C string, but skip hashing and interning the name, and cache the result of their lookups (as
+// the interpreter does for the call sites of the code it executes).
+// Symbols remain valid until freed with `jsrFreeSymbol` or until the VM is freed.
+typedef struct JStarSymbol JStarSymbol;
+
+JSTAR_API JStarSymbol* jsrInternSymbol(JStarVM* vm, const char* name);
+JSTAR_API void jsrFreeSymbol(JStarVM* vm, JStarSymbol* sym);
+
+JSTAR_API JStarResult jsrCallMethodSym(JStarVM* vm, JStarSymbol* sym, uint8_t argc);
+JSTAR_API bool jsrSetFieldSym(JStarVM* vm, int slot, JStarSymbol* sym);
+JSTAR_API bool jsrGetFieldSym(JStarVM* vm, int slot, JStarSymbol* sym);
+JSTAR_API bool jsrGetGlobalSym(JStarVM* vm, const char* module, JStarSymbol* sym);
+
 // -----------------------------------------------------------------------------
 // CLASS MANIPULATION FUNCTIONS
 // -----------------------------------------------------------------------------
@@ -412,6 +656,24 @@ JSTAR_API void jsrBindNative(JStarVM* vm, int clsSlot, int natSlot);
 // Does not perform type checking, the user must ensure `slot` is a Userdatum
 JSTAR_API void* jsrGetUserdata(JStarVM* vm, int slot);
 
+// -----------------------------------------------------------------------------
+// NUMERIC ARRAY MANIPULATION FUNCTIONS
+// -----------------------------------------------------------------------------
+
+// Element types of the numeric arrays defined in the math module
+typedef enum JStarArrayType {
+    JSR_ARRAY_FLOAT64,  // math.Float64Array, elements are `double`s
+    JSR_ARRAY_INT32,    // math.Int32Array, elements are `int32_t`s
+    JSR_ARRAY_UINT8,    // math.Uint8Array, elements are `uint8_t`s
+} JStarArrayType;
+
+// Get a pointer to the elements of the numeric array at `slot`, which are stored contiguously in
+// native format. `type` and `length`, if not NULL, receive the type and number of the elements.
+// The elements can be freely read and written, but the memory is owned by J* and it's only valid
+// as long as the array is reachable. Views of an array share its memory.
+// Does not perform type checking, the user must ensure `slot` is a numeric array
+JSTAR_API void* jsrGetArray(JStarVM* vm, int slot, JStarArrayType* type, size_t* length);
+
 // -----------------------------------------------------------------------------
 // TYPE CHECKING FUNCTIONS
 // -----------------------------------------------------------------------------
@@ -429,6 +691,7 @@ JSTAR_API bool jsrIsInstance(JStarVM* vm, int slot);
 JSTAR_API bool jsrIsTable(JStarVM* vm, int slot);
 JSTAR_API bool jsrIsFunction(JStarVM* vm, int slot);
 JSTAR_API bool jsrIsUserdata(JStarVM* vm, int slot);
+JSTAR_API bool jsrIsArray(JStarVM* vm, int slot);
 
 // These functions return true if the slot is of the given type, false otherwise
 // leaving a TypeException on top of the stack with a message customized with `name`
@@ -443,6 +706,7 @@ JSTAR_API bool jsrCheckHandle(JStarVM* vm, int slot, const char* name);
 JSTAR_API bool jsrCheckTable(JStarVM* vm, int slot, const char* name);
 JSTAR_API bool jsrCheckFunction(JStarVM* vm, int slot, const char* name);
 JSTAR_API bool jsrCheckUserdata(JStarVM* vm, int slot, const char* name);
+JSTAR_API bool jsrCheckArray(JStarVM* vm, int slot, const char* name);
 
 // Utility macro for checking a value type in the stack.
 // In case of error it exits signaling the error
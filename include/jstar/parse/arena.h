@@ -0,0 +1,23 @@
+#ifndef JSTAR_ARENA_H
+#define JSTAR_ARENA_H
+
+#include <stddef.h>
+
+#include "../conf.h"
+
+// Bump allocator holding all the nodes, identifiers and vectors of a parse.
+// Trees allocated in an arena must not be freed with `jsrStmtFree`/`jsrExprFree` (the calls are
+// no-ops on them), they are released all at once by resetting or freeing the arena.
+// An arena can be reused across parses by resetting it, which keeps its first chunk around.
+typedef struct JStarASTArena JStarASTArena;
+
+JSTAR_API JStarASTArena* jsrNewASTArena(void);
+JSTAR_API void jsrFreeASTArena(JStarASTArena* a);
+JSTAR_API void jsrResetASTArena(JStarASTArena* a);
+
+JSTAR_API void* jsrASTArenaAlloc(JStarASTArena* a, size_t size);
+// Grows the allocation `ptr` of `oldSize` bytes in place when it's the last one, otherwise
+// allocates a new block and copies the old contents over
+JSTAR_API void* jsrASTArenaRealloc(JStarASTArena* a, void* ptr, size_t oldSize, size_t newSize);
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #include "../conf.h"
+#include "arena.h"
 #include "lex.h"
 #include "vector.h"
 
@@ -37,11 +38,13 @@ typedef enum JStarExprType {
     JSR_TERNARY,
     JSR_COMPUND_ASS,
     JSR_FUNC_LIT,
+    JSR_YIELD,
 } JStarExprType;
 
 struct JStarExpr {
     int line;
     JStarExprType type;
+    bool inArena;  // Owned by a `JStarASTArena`, not freed by `jsrExprFree`
     union {
         struct {
             JStarTokType op;
@@ -97,6 +100,9 @@ struct JStarExpr {
         struct {
             JStarStmt* func;
         } funLit;
+        struct {
+            JStarExpr* expr;
+        } yield;
         struct {
             JStarIdentifier name;
             JStarExpr* args;
@@ -132,6 +138,7 @@ typedef enum JStarStmtType {
 struct JStarStmt {
     int line;
     JStarStmtType type;
+    bool inArena;  // Owned by a `JStarASTArena`, not freed by `jsrStmtFree`
     union {
         struct {
             JStarExpr* cond;
@@ -168,6 +175,7 @@ struct JStarStmt {
             Vector formalArgs, defArgs;
             bool isVararg;
             bool isStatic;
+            bool isGenerator;
             JStarStmt* body;
         } funcDecl;
         struct {
@@ -213,62 +221,79 @@ struct JStarStmt {
 // IDENTIFIER FUNCTIONS
 // -----------------------------------------------------------------------------
 
-JSTAR_API JStarIdentifier* jsrNewIdentifier(size_t length, const char* name);
+// All the allocation functions below take the arena the node is allocated in, or NULL to
+// allocate it on the heap. Heap allocated trees must be freed with `jsrExprFree`/`jsrStmtFree`.
+
+JSTAR_API JStarIdentifier* jsrNewIdentifier(JStarASTArena* a, size_t length, const char* name);
 JSTAR_API bool jsrIdentifierEq(JStarIdentifier* id1, JStarIdentifier* id2);
 
 // -----------------------------------------------------------------------------
 // EXPRESSIONS ALLOCATION
 // -----------------------------------------------------------------------------
 
-JSTAR_API JStarExpr* jsrFuncLiteral(int line, Vector* args, Vector* defArgs, bool vararg,
-                                    JStarStmt* body);
-JSTAR_API JStarExpr* jsrTernaryExpr(int line, JStarExpr* cond, JStarExpr* thenExpr,
-                                    JStarExpr* elseExpr);
-JSTAR_API JStarExpr* jsrCompundAssExpr(int line, JStarTokType op, JStarExpr* lval, JStarExpr* rval);
-JSTAR_API JStarExpr* jsrAccessExpr(int line, JStarExpr* left, const char* name, size_t length);
-JSTAR_API JStarExpr* jsrSuperLiteral(int line, JStarTok* name, JStarExpr* args, bool unpackArg);
-JSTAR_API JStarExpr* jsrCallExpr(int line, JStarExpr* callee, JStarExpr* args, bool unpackArg);
-JSTAR_API JStarExpr* jsrVarLiteral(int line, const char* str, size_t len);
-JSTAR_API JStarExpr* jsrStrLiteral(int line, const char* str, size_t len);
-JSTAR_API JStarExpr* jsrArrayAccExpr(int line, JStarExpr* left, JStarExpr* index);
-JSTAR_API JStarExpr* jsrBinaryExpr(int line, JStarTokType op, JStarExpr* l, JStarExpr* r);
-JSTAR_API JStarExpr* jsrUnaryExpr(int line, JStarTokType op, JStarExpr* operand);
-JSTAR_API JStarExpr* jsrAssignExpr(int line, JStarExpr* lval, JStarExpr* rval);
-JSTAR_API JStarExpr* jsrPowExpr(int line, JStarExpr* base, JStarExpr* exp);
-JSTAR_API JStarExpr* jsrTableLiteral(int line, JStarExpr* keyVals);
-JSTAR_API JStarExpr* jsrExprList(int line, Vector* exprs);
-JSTAR_API JStarExpr* jsrBoolLiteral(int line, bool boolean);
-JSTAR_API JStarExpr* jsrTupleLiteral(int line, JStarExpr* exprs);
-JSTAR_API JStarExpr* jsrArrLiteral(int line, JStarExpr* exprs);
-JSTAR_API JStarExpr* jsrNumLiteral(int line, double num);
-JSTAR_API JStarExpr* jsrNullLiteral(int line);
+JSTAR_API JStarExpr* jsrFuncLiteral(JStarASTArena* a, int line, Vector* args, Vector* defArgs,
+                                    bool vararg, JStarStmt* body);
+JSTAR_API JStarExpr* jsrTernaryExpr(JStarASTArena* a, int line, JStarExpr* cond,
+                                    JStarExpr* thenExpr, JStarExpr* elseExpr);
+JSTAR_API JStarExpr* jsrCompundAssExpr(JStarASTArena* a, int line, JStarTokType op,
+                                       JStarExpr* lval, JStarExpr* rval);
+JSTAR_API JStarExpr* jsrAccessExpr(JStarASTArena* a, int line, JStarExpr* left, const char* name,
+                                   size_t length);
+JSTAR_API JStarExpr* jsrSuperLiteral(JStarASTArena* a, int line, JStarTok* name, JStarExpr* args,
+                                     bool unpackArg);
+JSTAR_API JStarExpr* jsrCallExpr(JStarASTArena* a, int line, JStarExpr* callee, JStarExpr* args,
+                                 bool unpackArg);
+JSTAR_API JStarExpr* jsrVarLiteral(JStarASTArena* a, int line, const char* str, size_t len);
+JSTAR_API JStarExpr* jsrStrLiteral(JStarASTArena* a, int line, const char* str, size_t len);
+JSTAR_API JStarExpr* jsrArrayAccExpr(JStarASTArena* a, int line, JStarExpr* left, JStarExpr* index);
+JSTAR_API JStarExpr* jsrBinaryExpr(JStarASTArena* a, int line, JStarTokType op, JStarExpr* l,
+                                   JStarExpr* r);
+JSTAR_API JStarExpr* jsrUnaryExpr(JStarASTArena* a, int line, JStarTokType op, JStarExpr* operand);
+JSTAR_API JStarExpr* jsrAssignExpr(JStarASTArena* a, int line, JStarExpr* lval, JStarExpr* rval);
+JSTAR_API JStarExpr* jsrPowExpr(JStarASTArena* a, int line, JStarExpr* base, JStarExpr* exp);
+JSTAR_API JStarExpr* jsrTableLiteral(JStarASTArena* a, int line, JStarExpr* keyVals);
+JSTAR_API JStarExpr* jsrExprList(JStarASTArena* a, int line, Vector* exprs);
+JSTAR_API JStarExpr* jsrBoolLiteral(JStarASTArena* a, int line, bool boolean);
+JSTAR_API JStarExpr* jsrTupleLiteral(JStarASTArena* a, int line, JStarExpr* exprs);
+JSTAR_API JStarExpr* jsrArrLiteral(JStarASTArena* a, int line, JStarExpr* exprs);
+JSTAR_API JStarExpr* jsrNumLiteral(JStarASTArena* a, int line, double num);
+JSTAR_API JStarExpr* jsrNullLiteral(JStarASTArena* a, int line);
+JSTAR_API JStarExpr* jsrYieldExpr(JStarASTArena* a, int line, JStarExpr* expr);
 JSTAR_API void jsrExprFree(JStarExpr* e);
 
 // -----------------------------------------------------------------------------
 // STATEMENTS ALLOCATION
 // -----------------------------------------------------------------------------
 
-JSTAR_API JStarStmt* jsrFuncDecl(int line, JStarTok* name, Vector* args, Vector* defArgs,
-                                 bool vararg, JStarStmt* body);
-JSTAR_API JStarStmt* jsrNativeDecl(int line, JStarTok* name, Vector* args, Vector* defArgs,
-                                   bool vararg);
-JSTAR_API JStarStmt* jsrForStmt(int line, JStarStmt* init, JStarExpr* cond, JStarExpr* act,
-                                JStarStmt* body);
-JSTAR_API JStarStmt* jsrIfStmt(int line, JStarExpr* cond, JStarStmt* thenStmt, JStarStmt* elseStmt);
-JSTAR_API JStarStmt* jsrForEachStmt(int line, JStarStmt* varDecl, JStarExpr* iter, JStarStmt* body);
-JSTAR_API JStarStmt* jsrExceptStmt(int line, JStarExpr* cls, JStarTok* varName, JStarStmt* block);
-JSTAR_API JStarStmt* jsrClassDecl(int line, JStarTok* clsName, JStarExpr* sup, Vector* methods);
-JSTAR_API JStarStmt* jsrImportStmt(int line, Vector* modules, Vector* impNames, JStarTok* as);
-JSTAR_API JStarStmt* jsrWithStmt(int line, JStarExpr* e, JStarTok* varName, JStarStmt* block);
-JSTAR_API JStarStmt* jsrVarDecl(int line, bool isUnpack, Vector* ids, JStarExpr* init);
-JSTAR_API JStarStmt* jsrTryStmt(int line, JStarStmt* blck, Vector* excs, JStarStmt* ensure);
-JSTAR_API JStarStmt* jsrWhileStmt(int line, JStarExpr* cond, JStarStmt* body);
-JSTAR_API JStarStmt* jsrBlockStmt(int line, Vector* list);
-JSTAR_API JStarStmt* jsrReturnStmt(int line, JStarExpr* e);
-JSTAR_API JStarStmt* jsrRaiseStmt(int line, JStarExpr* e);
-JSTAR_API JStarStmt* jsrExprStmt(int line, JStarExpr* e);
-JSTAR_API JStarStmt* jsrContinueStmt(int line);
-JSTAR_API JStarStmt* jsrBreakStmt(int line);
+JSTAR_API JStarStmt* jsrFuncDecl(JStarASTArena* a, int line, JStarTok* name, Vector* args,
+                                 Vector* defArgs, bool vararg, JStarStmt* body);
+JSTAR_API JStarStmt* jsrNativeDecl(JStarASTArena* a, int line, JStarTok* name, Vector* args,
+                                   Vector* defArgs, bool vararg);
+JSTAR_API JStarStmt* jsrForStmt(JStarASTArena* a, int line, JStarStmt* init, JStarExpr* cond,
+                                JStarExpr* act, JStarStmt* body);
+JSTAR_API JStarStmt* jsrIfStmt(JStarASTArena* a, int line, JStarExpr* cond, JStarStmt* thenStmt,
+                               JStarStmt* elseStmt);
+JSTAR_API JStarStmt* jsrForEachStmt(JStarASTArena* a, int line, JStarStmt* varDecl,
+                                    JStarExpr* iter, JStarStmt* body);
+JSTAR_API JStarStmt* jsrExceptStmt(JStarASTArena* a, int line, JStarExpr* cls, JStarTok* varName,
+                                   JStarStmt* block);
+JSTAR_API JStarStmt* jsrClassDecl(JStarASTArena* a, int line, JStarTok* clsName, JStarExpr* sup,
+                                  Vector* methods);
+JSTAR_API JStarStmt* jsrImportStmt(JStarASTArena* a, int line, Vector* modules, Vector* impNames,
+                                   JStarTok* as);
+JSTAR_API JStarStmt* jsrWithStmt(JStarASTArena* a, int line, JStarExpr* e, JStarTok* varName,
+                                 JStarStmt* block);
+JSTAR_API JStarStmt* jsrVarDecl(JStarASTArena* a, int line, bool isUnpack, Vector* ids,
+                                JStarExpr* init);
+JSTAR_API JStarStmt* jsrTryStmt(JStarASTArena* a, int line, JStarStmt* blck, Vector* excs,
+                                JStarStmt* ensure);
+JSTAR_API JStarStmt* jsrWhileStmt(JStarASTArena* a, int line, JStarExpr* cond, JStarStmt* body);
+JSTAR_API JStarStmt* jsrBlockStmt(JStarASTArena* a, int line, Vector* list);
+JSTAR_API JStarStmt* jsrReturnStmt(JStarASTArena* a, int line, JStarExpr* e);
+JSTAR_API JStarStmt* jsrRaiseStmt(JStarASTArena* a, int line, JStarExpr* e);
+JSTAR_API JStarStmt* jsrExprStmt(JStarASTArena* a, int line, JStarExpr* e);
+JSTAR_API JStarStmt* jsrContinueStmt(JStarASTArena* a, int line);
+JSTAR_API JStarStmt* jsrBreakStmt(JStarASTArena* a, int line);
 JSTAR_API void jsrStmtFree(JStarStmt* s);
 
 #endif
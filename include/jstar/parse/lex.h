@@ -20,6 +20,7 @@ typedef struct JStarLex {
     const char* source;
     const char* tokenStart;
     const char* current;
+    const char* end;  // The terminating NUL of `source`
     int currLine;
 } JStarLex;
 
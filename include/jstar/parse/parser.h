@@ -2,12 +2,29 @@
 #define JSTAR_PARSER_H
 
 #include "../conf.h"
+#include "arena.h"
 #include "ast.h"
 
 typedef void (*ParseErrorCB)(const char* file, int line, const char* error, void* userData);
+typedef void (*ParseStmtCB)(JStarStmt* stmt, void* userData);
 
 JSTAR_API JStarStmt* jsrParse(const char* path, const char* src, ParseErrorCB errFn, void* data);
 JSTAR_API JStarExpr* jsrParseExpression(const char* path, const char* src, ParseErrorCB errFn,
                                         void* data);
 
+// Variants of the above allocating the whole tree in `arena`. The returned tree stays valid until
+// the arena is reset or freed, and on error its partial allocations are reclaimed the same way
+JSTAR_API JStarStmt* jsrParseArena(const char* path, const char* src, JStarASTArena* arena,
+                                   ParseErrorCB errFn, void* data);
+JSTAR_API JStarExpr* jsrParseExpressionArena(const char* path, const char* src,
+                                             JStarASTArena* arena, ParseErrorCB errFn, void* data);
+
+// Parses `src` one top level statement at a time, handing each one to `stmtFn` as soon as it's
+// parsed instead of building the tree of the whole program. Statements are freed (or the arena is
+// reset, if not NULL) when `stmtFn` returns, so it must not retain them. After a syntax error no
+// more statements are passed, but parsing continues to report further errors.
+// Returns false if there were syntax errors
+JSTAR_API bool jsrParseStream(const char* path, const char* src, JStarASTArena* arena,
+                              ParseStmtCB stmtFn, ParseErrorCB errFn, void* data);
+
 #endif
@@ -5,6 +5,7 @@
 #include <stddef.h>
 
 #include "../conf.h"
+#include "arena.h"
 
 #define vecForeach(elem, vec)                                                            \
     for(size_t __cont = 1, __i = 0; __cont && __i < (vec).size; __cont = !__cont, __i++) \
@@ -13,9 +14,11 @@
 typedef struct Vector {
     size_t size, capacity;
     void** data;
+    JStarASTArena* arena;  // When set, `data` is allocated in the arena and never freed
 } Vector;
 
 JSTAR_API Vector vecNew(void);
+JSTAR_API Vector vecNewArena(JStarASTArena* arena);
 
 JSTAR_API Vector vecCopy(const Vector* vec);
 JSTAR_API void vecCopyAssign(Vector* dest, const Vector* src);
@@ -30,16 +30,27 @@
     #include "re.jsc.inc"
 #endif
 
+#ifdef JSTAR_EVENT
+    #include "event.h"
+    #include "event.jsc.inc"
+#endif
+
+#ifdef JSTAR_THREAD
+    #include "thread.h"
+    #include "thread.jsc.inc"
+#endif
+
 typedef enum { TYPE_FUNC, TYPE_CLASS } Type;
 
 typedef struct {
     const char* name;
     JStarNative func;
+    bool leaf;  // Called without a frame, see JStarNativeReg
 } Func;
 
 typedef struct {
     const char* name;
-    Func methods[17];
+    Func methods[22];
 } Class;
 
 typedef struct {
@@ -54,14 +65,14 @@ typedef struct {
     const char* name;
     const char** bytecode;
     const size_t* len;
-    ModuleElem elems[31];
+    ModuleElem elems[40];
 } Module;
 
 // clang-format off
 
 #define ELEMS_END        {TYPE_FUNC, .as = { .function = METHODS_END } },
 #define MODULES_END      {NULL, NULL, 0, { ELEMS_END }}
-#define METHODS_END      {NULL, NULL}
+#define METHODS_END      {NULL, NULL, false}
 
 #define MODULE(name)     { #name, &name##_jsc, &name##_jsc_len, {
 #define ENDMODULE        ELEMS_END } },
@@ -69,40 +80,42 @@ typedef struct {
 #define COREMODULE       {"__core__", &core_jsc, &core_jsc_len, {
 
 #define CLASS(name)      { TYPE_CLASS, .as = { .class = { #name, {
-#define METHOD(name, fn) { #name, fn },
+#define METHOD(name, fn)      { #name, fn, false },
+#define LEAF_METHOD(name, fn) { #name, fn, true },
 #define ENDCLASS         METHODS_END } } } },
 
-#define FUNCTION(name, fn) { TYPE_FUNC, .as = { .function = { #name, fn } } },
+#define FUNCTION(name, fn)      { TYPE_FUNC, .as = { .function = { #name, fn, false } } },
+#define LEAF_FUNCTION(name, fn) { TYPE_FUNC, .as = { .function = { #name, fn, true } } },
 
 static Module builtInModules[] = {
     COREMODULE
-        FUNCTION(ascii,          jsr_ascii)
-        FUNCTION(char,           jsr_char)
+        LEAF_FUNCTION(ascii,     jsr_ascii)
+        LEAF_FUNCTION(char,      jsr_char)
         FUNCTION(eval,           jsr_eval)
-        FUNCTION(int,            jsr_int)
+        LEAF_FUNCTION(int,       jsr_int)
         FUNCTION(print,          jsr_print)
-        FUNCTION(type,           jsr_type)
+        LEAF_FUNCTION(type,      jsr_type)
         FUNCTION(garbageCollect, jsr_garbageCollect)
         CLASS(Number)
-            METHOD(new,        jsr_Number_new)
-            METHOD(isInt,      jsr_Number_isInt)
-            METHOD(__string__, jsr_Number_string)
-            METHOD(__hash__,   jsr_Number_hash)
+            METHOD(new,             jsr_Number_new)
+            LEAF_METHOD(isInt,      jsr_Number_isInt)
+            LEAF_METHOD(__string__, jsr_Number_string)
+            LEAF_METHOD(__hash__,   jsr_Number_hash)
         ENDCLASS
         CLASS(Boolean)
-            METHOD(new,        jsr_Boolean_new)
-            METHOD(__string__, jsr_Boolean_string)
-            METHOD(__hash__,   jsr_Boolean_hash)
+            LEAF_METHOD(new,        jsr_Boolean_new)
+            LEAF_METHOD(__string__, jsr_Boolean_string)
+            LEAF_METHOD(__hash__,   jsr_Boolean_hash)
         ENDCLASS
         CLASS(Null)
-            METHOD(__string__, jsr_Null_string)
+            LEAF_METHOD(__string__, jsr_Null_string)
         ENDCLASS
         CLASS(Function)
-            METHOD(__string__, jsr_Function_string)
-            METHOD(arity,      jsr_Function_arity)
-            METHOD(vararg,     jsr_Function_vararg)
-            METHOD(defaults,   jsr_Function_defaults)
-            METHOD(getName,    jsr_Function_getName)
+            METHOD(__string__,    jsr_Function_string)
+            LEAF_METHOD(arity,    jsr_Function_arity)
+            LEAF_METHOD(vararg,   jsr_Function_vararg)
+            LEAF_METHOD(defaults, jsr_Function_defaults)
+            LEAF_METHOD(getName,  jsr_Function_getName)
         ENDCLASS
         CLASS(Module)
             METHOD(__string__, jsr_Module_string)
@@ -112,58 +125,79 @@ static Module builtInModules[] = {
             METHOD(join,       jsr_Iterable_join)
         ENDCLASS
         CLASS(List)
-            METHOD(new,      jsr_List_new)
-            METHOD(add,      jsr_List_add)
-            METHOD(insert,   jsr_List_insert)
-            METHOD(removeAt, jsr_List_removeAt)
-            METHOD(clear,    jsr_List_clear)
-            METHOD(sort,     jsr_List_sort)
-            METHOD(__len__,  jsr_List_len)
-            METHOD(__add__,  jsr_List_plus)
-            METHOD(__eq__,   jsr_List_eq)
-            METHOD(__iter__, jsr_List_iter)
-            METHOD(__next__, jsr_List_next)
+            METHOD(new,           jsr_List_new)
+            LEAF_METHOD(add,      jsr_List_add)
+            METHOD(extend,        jsr_List_extend)
+            LEAF_METHOD(insert,   jsr_List_insert)
+            LEAF_METHOD(removeAt, jsr_List_removeAt)
+            LEAF_METHOD(clear,    jsr_List_clear)
+            LEAF_METHOD(reserve,  jsr_List_reserve)
+            METHOD(sort,          jsr_List_sort)
+            METHOD(sum,           jsr_List_sum)
+            LEAF_METHOD(__len__,  jsr_List_len)
+            METHOD(__add__,       jsr_List_plus)
+            METHOD(__eq__,        jsr_List_eq)
+            LEAF_METHOD(__iter__, jsr_List_iter)
+            LEAF_METHOD(__next__, jsr_List_next)
         ENDCLASS
         CLASS(Tuple)
-            METHOD(new,      jsr_Tuple_new)
-            METHOD(__len__,  jsr_Tuple_len)
-            METHOD(__add__,  jsr_Tuple_add)
-            METHOD(__eq__,   jsr_Tuple_eq)
-            METHOD(__iter__, jsr_Tuple_iter)
-            METHOD(__next__, jsr_Tuple_next)
-            METHOD(__hash__, jsr_Tuple_hash)
+            METHOD(new,           jsr_Tuple_new)
+            LEAF_METHOD(__len__,  jsr_Tuple_len)
+            METHOD(__add__,       jsr_Tuple_add)
+            METHOD(__eq__,        jsr_Tuple_eq)
+            METHOD(sum,           jsr_Tuple_sum)
+            LEAF_METHOD(__iter__, jsr_Tuple_iter)
+            LEAF_METHOD(__next__, jsr_Tuple_next)
+            METHOD(__hash__,      jsr_Tuple_hash)
         ENDCLASS
         CLASS(String)
-            METHOD(new,        jsr_String_new)
-            METHOD(charAt,     jsr_String_charAt)
-            METHOD(startsWith, jsr_String_startsWith)
-            METHOD(endsWith,   jsr_String_endsWith)
-            METHOD(split,      jsr_String_split)
-            METHOD(strip,      jsr_String_strip)
-            METHOD(chomp,      jsr_String_chomp)
-            METHOD(escaped,    jsr_String_escaped)
-            METHOD(__mul__,    jsr_String_mul)
-            METHOD(__mod__,    jsr_String_mod)
-            METHOD(__eq__,     jsr_String_eq)
-            METHOD(__len__,    jsr_String_len)
-            METHOD(__hash__,   jsr_String_hash)
-            METHOD(__iter__,   jsr_String_iter)
-            METHOD(__next__,   jsr_String_next)
-            METHOD(__string__, jsr_String_string)
+            METHOD(new,             jsr_String_new)
+            LEAF_METHOD(charAt,     jsr_String_charAt)
+            LEAF_METHOD(startsWith, jsr_String_startsWith)
+            LEAF_METHOD(endsWith,   jsr_String_endsWith)
+            LEAF_METHOD(split,      jsr_String_split)
+            LEAF_METHOD(find,       jsr_String_find)
+            LEAF_METHOD(rfind,      jsr_String_rfind)
+            LEAF_METHOD(count,      jsr_String_count)
+            LEAF_METHOD(replace,    jsr_String_replace)
+            LEAF_METHOD(strip,      jsr_String_strip)
+            LEAF_METHOD(chomp,      jsr_String_chomp)
+            LEAF_METHOD(escaped,    jsr_String_escaped)
+            LEAF_METHOD(__mul__,    jsr_String_mul)
+            METHOD(__mod__,         jsr_String_mod)
+            LEAF_METHOD(__eq__,     jsr_String_eq)
+            LEAF_METHOD(__len__,    jsr_String_len)
+            LEAF_METHOD(__hash__,   jsr_String_hash)
+            LEAF_METHOD(__iter__,   jsr_String_iter)
+            LEAF_METHOD(__next__,   jsr_String_next)
+            LEAF_METHOD(__string__, jsr_String_string)
         ENDCLASS
         CLASS(Table)
-            METHOD(new,        jsr_Table_new)
-            METHOD(__get__,    jsr_Table_get)
-            METHOD(__set__,    jsr_Table_set)
-            METHOD(__len__,    jsr_Table_len)
-            METHOD(delete,     jsr_Table_delete)
-            METHOD(clear,      jsr_Table_clear)
-            METHOD(contains,   jsr_Table_contains)
-            METHOD(keys,       jsr_Table_keys)
-            METHOD(values,     jsr_Table_values)
-            METHOD(__iter__,   jsr_Table_iter)
-            METHOD(__next__,   jsr_Table_next)
-            METHOD(__string__, jsr_Table_string)
+            METHOD(new,           jsr_Table_new)
+            METHOD(__get__,       jsr_Table_get)
+            METHOD(__set__,       jsr_Table_set)
+            LEAF_METHOD(__len__,  jsr_Table_len)
+            METHOD(delete,        jsr_Table_delete)
+            LEAF_METHOD(clear,    jsr_Table_clear)
+            METHOD(contains,      jsr_Table_contains)
+            METHOD(keys,          jsr_Table_keys)
+            METHOD(values,        jsr_Table_values)
+            LEAF_METHOD(__iter__, jsr_Table_iter)
+            LEAF_METHOD(__next__, jsr_Table_next)
+            METHOD(__string__,    jsr_Table_string)
+        ENDCLASS
+        CLASS(WeakTable)
+            METHOD(new, jsr_WeakTable_new)
+        ENDCLASS
+        CLASS(Generator)
+            METHOD(__iter__,    jsr_Generator_iter)
+            METHOD(__next__,    jsr_Generator_next)
+            LEAF_METHOD(isDone, jsr_Generator_isDone)
+            METHOD(__string__,  jsr_Generator_string)
+        ENDCLASS
+        CLASS(WeakRef)
+            METHOD(new,      jsr_WeakRef_new)
+            LEAF_METHOD(get, jsr_WeakRef_get)
         ENDCLASS
         CLASS(Enum)
             METHOD(new,   jsr_Enum_new)
@@ -189,17 +223,35 @@ static Module builtInModules[] = {
 #endif
 #ifdef JSTAR_IO
     MODULE(io)
+        CLASS(LineIter)
+            METHOD(new,      jsr_LineIter_new)
+            METHOD(__iter__, jsr_LineIter_iter)
+        ENDCLASS
         CLASS(File)
-            METHOD(new,      jsr_File_new)
-            METHOD(read,     jsr_File_read)
-            METHOD(readAll,  jsr_File_readAll)
-            METHOD(readLine, jsr_File_readLine)
-            METHOD(write,    jsr_File_write)
-            METHOD(close,    jsr_File_close)
-            METHOD(seek,     jsr_File_seek)
-            METHOD(tell,     jsr_File_tell)
-            METHOD(rewind,   jsr_File_rewind)
-            METHOD(flush,    jsr_File_flush)
+            METHOD(new,       jsr_File_new)
+            METHOD(read,      jsr_File_read)
+            METHOD(readAll,   jsr_File_readAll)
+            METHOD(readLine,  jsr_File_readLine)
+            METHOD(write,     jsr_File_write)
+            METHOD(close,     jsr_File_close)
+            METHOD(seek,      jsr_File_seek)
+            METHOD(tell,      jsr_File_tell)
+            METHOD(rewind,    jsr_File_rewind)
+            METHOD(flush,     jsr_File_flush)
+            METHOD(fileno,    jsr_File_fileno)
+            METHOD(writeAll,  jsr_File_writeAll)
+            METHOD(readInto,  jsr_File_readInto)
+            METHOD(writeFrom, jsr_File_writeFrom)
+            METHOD(setBuffer, jsr_File_setBuffer)
+        ENDCLASS
+        CLASS(MappedFile)
+            METHOD(new,      jsr_MappedFile_new)
+            METHOD(close,    jsr_MappedFile_close)
+            METHOD(find,     jsr_MappedFile_find)
+            METHOD(__len__,  jsr_MappedFile_len)
+            METHOD(__get__,  jsr_MappedFile_get)
+            METHOD(__iter__, jsr_MappedFile_iter)
+            METHOD(__next__, jsr_MappedFile_next)
         ENDCLASS
         CLASS(Popen)
             METHOD(new,   jsr_Popen_new)
@@ -212,33 +264,72 @@ static Module builtInModules[] = {
 #endif
 #ifdef JSTAR_MATH
     MODULE(math)
-        FUNCTION(abs,    jsr_abs)
-        FUNCTION(acos,   jsr_acos)
-        FUNCTION(asin,   jsr_asin)
-        FUNCTION(atan,   jsr_atan)
-        FUNCTION(atan2,  jsr_atan2)
-        FUNCTION(ceil,   jsr_ceil)
-        FUNCTION(cos,    jsr_cos)
-        FUNCTION(cosh,   jsr_cosh)
-        FUNCTION(deg,    jsr_deg)
-        FUNCTION(exp,    jsr_exp)
-        FUNCTION(floor,  jsr_floor)
-        FUNCTION(frexp,  jsr_frexp)
-        FUNCTION(ldexp,  jsr_ldexp)
-        FUNCTION(log,    jsr_log)
-        FUNCTION(log10,  jsr_log10)
-        FUNCTION(max,    jsr_max)
-        FUNCTION(min,    jsr_min)
-        FUNCTION(rad,    jsr_rad)
-        FUNCTION(sin,    jsr_sin)
-        FUNCTION(sinh,   jsr_sinh)
-        FUNCTION(sqrt,   jsr_sqrt)
-        FUNCTION(tan,    jsr_tan)
-        FUNCTION(tanh,   jsr_tanh)
-        FUNCTION(modf,   jsr_modf)
-        FUNCTION(random, jsr_random)
-        FUNCTION(seed,   jsr_seed)
-        FUNCTION(init,   jsr_math_init)
+        LEAF_FUNCTION(abs,    jsr_abs)
+        LEAF_FUNCTION(acos,   jsr_acos)
+        LEAF_FUNCTION(asin,   jsr_asin)
+        LEAF_FUNCTION(atan,   jsr_atan)
+        LEAF_FUNCTION(atan2,  jsr_atan2)
+        LEAF_FUNCTION(ceil,   jsr_ceil)
+        LEAF_FUNCTION(cos,    jsr_cos)
+        LEAF_FUNCTION(cosh,   jsr_cosh)
+        LEAF_FUNCTION(deg,    jsr_deg)
+        LEAF_FUNCTION(exp,    jsr_exp)
+        LEAF_FUNCTION(floor,  jsr_floor)
+        LEAF_FUNCTION(frexp,  jsr_frexp)
+        LEAF_FUNCTION(ldexp,  jsr_ldexp)
+        LEAF_FUNCTION(log,    jsr_log)
+        LEAF_FUNCTION(log10,  jsr_log10)
+        LEAF_FUNCTION(max,    jsr_max)
+        LEAF_FUNCTION(min,    jsr_min)
+        LEAF_FUNCTION(rad,    jsr_rad)
+        LEAF_FUNCTION(sin,    jsr_sin)
+        LEAF_FUNCTION(sinh,   jsr_sinh)
+        LEAF_FUNCTION(sqrt,   jsr_sqrt)
+        LEAF_FUNCTION(tan,    jsr_tan)
+        LEAF_FUNCTION(tanh,   jsr_tanh)
+        LEAF_FUNCTION(modf,   jsr_modf)
+        LEAF_FUNCTION(random, jsr_random)
+        LEAF_FUNCTION(seed,   jsr_seed)
+        LEAF_FUNCTION(randomList, jsr_randomList)
+        LEAF_FUNCTION(randomFill, jsr_randomFill)
+        LEAF_FUNCTION(shuffle,    jsr_shuffle)
+        LEAF_FUNCTION(sample,     jsr_sample)
+        FUNCTION(init,        jsr_math_init)
+        CLASS(NumArray)
+            LEAF_METHOD(__len__,  jsr_NumArray_len)
+            LEAF_METHOD(__iter__, jsr_NumArray_iter)
+            LEAF_METHOD(__next__, jsr_NumArray_next)
+            METHOD(copy,          jsr_NumArray_copy)
+            METHOD(toList,        jsr_NumArray_toList)
+            METHOD(fill,          jsr_NumArray_fill)
+            LEAF_METHOD(sum,      jsr_NumArray_sum)
+            LEAF_METHOD(dot,      jsr_NumArray_dot)
+            LEAF_METHOD(min,      jsr_NumArray_min)
+            LEAF_METHOD(max,      jsr_NumArray_max)
+            METHOD(add,           jsr_NumArray_add)
+            METHOD(sub,           jsr_NumArray_sub)
+            METHOD(mul,           jsr_NumArray_mul)
+            METHOD(map,           jsr_NumArray_map)
+            METHOD(__string__,    jsr_NumArray_string)
+        ENDCLASS
+        CLASS(Float64Array)
+            METHOD(new, jsr_Float64Array_new)
+        ENDCLASS
+        CLASS(Int32Array)
+            METHOD(new, jsr_Int32Array_new)
+        ENDCLASS
+        CLASS(Uint8Array)
+            METHOD(new, jsr_Uint8Array_new)
+        ENDCLASS
+        CLASS(Random)
+            METHOD(new,               jsr_Random_new)
+            LEAF_METHOD(random,       jsr_Random_random)
+            LEAF_METHOD(seed,         jsr_Random_seed)
+            LEAF_METHOD(randomList,   jsr_Random_randomList)
+            LEAF_METHOD(randomFill,   jsr_Random_randomFill)
+            LEAF_METHOD(shuffle,      jsr_Random_shuffle)
+            LEAF_METHOD(sample,       jsr_Random_sample)
+        ENDCLASS
     ENDMODULE
 #endif
 #ifdef JSTAR_RE
@@ -247,12 +338,63 @@ static Module builtInModules[] = {
         FUNCTION(find,   jsr_re_find)
         FUNCTION(gmatch, jsr_re_gmatch)
         FUNCTION(gsub,   jsr_re_gsub)
+        CLASS(MatchIter)
+            METHOD(__iter__, jsr_re_MatchIter_iter)
+        ENDCLASS
+        CLASS(Pattern)
+            METHOD(new, jsr_re_Pattern_new)
+        ENDCLASS
+    ENDMODULE
+#endif
+#ifdef JSTAR_EVENT
+    MODULE(event)
+        FUNCTION(now,            jsr_event_now)
+        FUNCTION(poll,           jsr_event_poll)
+        FUNCTION(read,           jsr_event_read)
+        FUNCTION(write,          jsr_event_write)
+        FUNCTION(close,          jsr_event_close)
+        FUNCTION(setNonBlocking, jsr_event_setNonBlocking)
+        FUNCTION(connect,        jsr_event_connect)
+        FUNCTION(listen,         jsr_event_listen)
+        FUNCTION(accept,         jsr_event_accept)
+        CLASS(Process)
+            METHOD(new,  jsr_Process_new)
+            METHOD(poll, jsr_Process_poll)
+            METHOD(wait, jsr_Process_wait)
+            METHOD(kill, jsr_Process_kill)
+        ENDCLASS
+    ENDMODULE
+#endif
+#ifdef JSTAR_THREAD
+    MODULE(thread)
+        FUNCTION(cpuCount, jsr_thread_cpuCount)
+        CLASS(Thread)
+            METHOD(new,     jsr_Thread_new)
+            METHOD(join,    jsr_Thread_join)
+            METHOD(isAlive, jsr_Thread_isAlive)
+        ENDCLASS
+        CLASS(Channel)
+            METHOD(new,      jsr_Channel_new)
+            METHOD(send,     jsr_Channel_send)
+            METHOD(receive,  jsr_Channel_receive)
+            METHOD(close,    jsr_Channel_close)
+            METHOD(isClosed, jsr_Channel_isClosed)
+            METHOD(__iter__, jsr_Channel_iter)
+        ENDCLASS
     ENDMODULE
 #endif
 #ifdef JSTAR_DEBUG
     MODULE(debug)
-        FUNCTION(printStack,  jsr_printStack)
-        FUNCTION(disassemble, jsr_disassemble)
+        FUNCTION(printStack,        jsr_printStack)
+        FUNCTION(disassemble,       jsr_disassemble)
+        FUNCTION(cacheStats,        jsr_cacheStats)
+        FUNCTION(captureStacktrace, jsr_captureStacktrace)
+        FUNCTION(importStats,       jsr_importStats)
+        FUNCTION(importTimes,       jsr_importTimes)
+        FUNCTION(gcStats,           jsr_gcStats)
+        FUNCTION(startProfiler,     jsr_startProfiler)
+        FUNCTION(stopProfiler,      jsr_stopProfiler)
+        FUNCTION(opcodeStats,       jsr_opcodeStats)
     ENDMODULE
 #endif
     MODULES_END
@@ -282,39 +424,42 @@ static Class* getClass(Module* module, const char* name) {
     }
 }
 
-static JStarNative getNativeMethod(Class* cls, const char* name) {
+static Func* getNativeMethod(Class* cls, const char* name) {
     for(int i = 0; cls->methods[i].name != NULL; i++) {
         if(strcmp(cls->methods[i].name, name) == 0) {
-            return cls->methods[i].func;
+            return &cls->methods[i];
         }
     }
     return NULL;
 }
 
-static JStarNative getNativeFunc(Module* module, const char* name) {
+static Func* getNativeFunc(Module* module, const char* name) {
     for(int i = 0;; i++) {
         if(module->elems[i].type == TYPE_FUNC) {
             if(module->elems[i].as.function.name == NULL) return NULL;
 
             if(strcmp(module->elems[i].as.function.name, name) == 0) {
-                return module->elems[i].as.function.func;
+                return &module->elems[i].as.function;
             }
         }
     }
 }
 
-JStarNative resolveBuiltIn(const char* module, const char* cls, const char* name) {
+JStarNative resolveBuiltIn(const char* module, const char* cls, const char* name, bool* leaf) {
     Module* m = getModule(module);
     if(m == NULL) return NULL;
 
+    Func* f;
     if(cls == NULL) {
-        return getNativeFunc(m, name);
+        f = getNativeFunc(m, name);
+    } else {
+        Class* c = getClass(m, cls);
+        f = c ? getNativeMethod(c, name) : NULL;
     }
 
-    Class* c = getClass(m, cls);
-    if(c == NULL) return NULL;
-
-    return getNativeMethod(c, name);
+    if(f == NULL) return NULL;
+    *leaf = f->leaf;
+    return f->func;
 }
 
 const char* readBuiltInModule(const char* name, size_t* len) {
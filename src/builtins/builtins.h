@@ -5,7 +5,9 @@
 
 #include "jstar.h"
 
-JStarNative resolveBuiltIn(const char* module, const char* cls, const char* name);
+// Returns the builtin native `name` of class `cls` (NULL for functions) in `module`, setting `leaf`
+// to whether it can be called without a frame. Returns NULL if there's no such native
+JStarNative resolveBuiltIn(const char* module, const char* cls, const char* name, bool* leaf);
 const char* readBuiltInModule(const char* name, size_t* len);
 
 #endif
@@ -12,12 +12,11 @@
 #include <string.h>
 
 #include "builtins.h"
+#include "ctrlgroup.h"
 #include "gc.h"
 #include "hashtable.h"
 #include "import.h"
 #include "object.h"
-#include "parse/ast.h"
-#include "parse/parser.h"
 #include "profiler.h"
 #include "util.h"
 #include "value.h"
@@ -28,23 +27,24 @@ static ObjClass* createClass(JStarVM* vm, ObjModule* m, ObjClass* sup, const cha
     push(vm, OBJ_VAL(n));
     ObjClass* c = newClass(vm, n, sup);
     pop(vm);
-    hashTablePut(&m->globals, n, OBJ_VAL(c));
+    moduleSetGlobal(m, n, OBJ_VAL(c));
     return c;
 }
 
 static Value getDefinedName(JStarVM* vm, ObjModule* m, const char* name) {
     Value v = NULL_VAL;
-    hashTableGet(&m->globals, copyString(vm, name, strlen(name)), &v);
+    moduleGetGlobal(m, copyString(vm, name, strlen(name)), &v);
     return v;
 }
 
 static void defMethod(JStarVM* vm, ObjModule* m, ObjClass* cls, JStarNative nat, const char* name,
-                      uint8_t argc) {
+                      uint8_t argc, bool leaf) {
     ObjString* strName = copyString(vm, name, strlen(name));
     push(vm, OBJ_VAL(strName));
     ObjNative* native = newNative(vm, m, argc, 0, false);
     native->proto.name = strName;
     native->fn = nat;
+    native->leaf = leaf;
     pop(vm);
     hashTablePut(&cls->methods, strName, OBJ_VAL(native));
 }
@@ -79,6 +79,38 @@ static bool compareValues(JStarVM* vm, const Value* v1, const Value* v2, size_t
     return true;
 }
 
+// Appends the String representation of `v` to `buf`. Values of the builtin types are converted
+// directly, all the others by calling their `__string__` method
+static bool bufferAppendValue(JStarVM* vm, JStarBuffer* buf, Value v) {
+    if(IS_STRING(v)) {
+        jsrBufferAppend(buf, AS_STRING(v)->data, AS_STRING(v)->length);
+        return true;
+    }
+    if(IS_NUM(v)) {
+        char str[NUM_STR_MAX];
+        jsrBufferAppend(buf, str, numberToString(AS_NUM(v), str));
+        return true;
+    }
+    if(IS_BOOL(v)) {
+        jsrBufferAppendStr(buf, AS_BOOL(v) ? "true" : "false");
+        return true;
+    }
+    if(IS_NULL(v)) {
+        jsrBufferAppendStr(buf, "null");
+        return true;
+    }
+
+    push(vm, v);
+    if(jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS) return false;
+    if(!jsrIsString(vm, -1)) {
+        JSR_RAISE(vm, "TypeException", "%s.__string__() didn't return a String",
+                  getClass(vm, v)->name->data);
+    }
+    jsrBufferAppend(buf, jsrGetString(vm, -1), jsrGetStringSz(vm, -1));
+    pop(vm);
+    return true;
+}
+
 // -----------------------------------------------------------------------------
 // CLASS AND OBJECT CLASSES AND CORE MODULE INITIALIZATION
 // -----------------------------------------------------------------------------
@@ -139,15 +171,15 @@ void initCoreModule(JStarVM* vm) {
 
     // Setup the base class of the object hierarchy
     vm->objClass = createClass(vm, core, NULL, "Object");  // Object has no superclass
-    defMethod(vm, core, vm->objClass, &jsr_Object_string, "__string__", 0);
-    defMethod(vm, core, vm->objClass, &jsr_Object_hash, "__hash__", 0);
-    defMethod(vm, core, vm->objClass, &jsr_Object_eq, "__eq__", 1);
+    defMethod(vm, core, vm->objClass, &jsr_Object_string, "__string__", 0, true);
+    defMethod(vm, core, vm->objClass, &jsr_Object_hash, "__hash__", 0, true);
+    defMethod(vm, core, vm->objClass, &jsr_Object_eq, "__eq__", 1, true);
 
     // Patch up Class object information
     vm->clsClass->superCls = vm->objClass;
     hashTableMerge(&vm->clsClass->methods, &vm->objClass->methods);
-    defMethod(vm, core, vm->clsClass, &jsr_Class_getName, "getName", 0);
-    defMethod(vm, core, vm->clsClass, &jsr_Class_string, "__string__", 0);
+    defMethod(vm, core, vm->clsClass, &jsr_Class_getName, "getName", 0, true);
+    defMethod(vm, core, vm->clsClass, &jsr_Class_string, "__string__", 0, true);
 
     {
         PROFILE("{core-runEval}::initCore")
@@ -156,10 +188,23 @@ void initCoreModule(JStarVM* vm) {
         size_t len;
         const char* coreBytecode = readBuiltInModule(JSR_CORE_MODULE, &len);
 
-        // Execute core module
+        // Execute core module. Its bytecode is static, so function bodies can be loaded lazily.
+        // The embedded module can also be source code, used to bootstrap a new bytecode format
         JStarBuffer code = jsrBufferWrap(vm, coreBytecode, len);
-        JStarResult res = jsrEvalModule(vm, JSR_CORE_MODULE, JSR_CORE_MODULE, &code);
-        
+        JStarResult res;
+        if(isCompiledCode(&code)) {
+            ObjFunction* fn = deserializeModule(vm, JSR_CORE_MODULE, core->name, &code,
+                                                DESERIALIZE_LAZY, &res);
+            ASSERT(fn != NULL, "Core module deserialization failed");
+
+            push(vm, OBJ_VAL(fn));
+            vm->sp[-1] = OBJ_VAL(newClosure(vm, fn));
+            res = jsrCall(vm, 0);
+            pop(vm);
+        } else {
+            res = jsrEvalModule(vm, JSR_CORE_MODULE, JSR_CORE_MODULE, &code);
+        }
+
         ASSERT(res == JSR_SUCCESS, "Core module bootsrap failed");
         (void)res; // Not actually used aside from the assert
     }
@@ -180,6 +225,9 @@ void initCoreModule(JStarVM* vm) {
         vm->excClass = AS_CLASS(getDefinedName(vm, core, "Exception"));
         vm->tableClass = AS_CLASS(getDefinedName(vm, core, "Table"));
         vm->udataClass = AS_CLASS(getDefinedName(vm, core, "Userdata"));
+        vm->genClass = AS_CLASS(getDefinedName(vm, core, "Generator"));
+        vm->weakRefClass = AS_CLASS(getDefinedName(vm, core, "WeakRef"));
+        vm->weakTableClass = AS_CLASS(getDefinedName(vm, core, "WeakTable"));
         core->base.cls = vm->modClass;
 
         // Cache core module global objects in vm
@@ -192,6 +240,7 @@ void initCoreModule(JStarVM* vm) {
 
         // Patch up the class field of any object that was allocated
         // before the creation of its corresponding class object
+        gcCompleteSweep(vm);
         for(Obj* o = vm->objects; o != NULL; o = o->next) {
             if(o->type == OBJ_STRING) {
                 o->cls = vm->strClass;
@@ -247,9 +296,9 @@ JSR_NATIVE(jsr_Number_isInt) {
 }
 
 JSR_NATIVE(jsr_Number_string) {
-    char string[24];  // enough for .*g with DBL_DIG
-    snprintf(string, sizeof(string), "%.*g", DBL_DIG, jsrGetNumber(vm, 0));
-    jsrPushString(vm, string);
+    char string[NUM_STR_MAX];
+    int len = numberToString(jsrGetNumber(vm, 0), string);
+    jsrPushStringSz(vm, string, len);
     return true;
 }
 
@@ -374,13 +423,17 @@ JSR_NATIVE(jsr_Module_string) {
 
 JSR_NATIVE(jsr_Module_globals) {
     ObjModule* module = AS_MODULE(vm->apiStack[0]);
-    const HashTable* globals = &module->globals;
+    if(module->lazy && !resolveLazyModule(vm, module)) {
+        return false;
+    }
+
+    const HashTable* names = &module->globalNames;
 
     jsrPushTable(vm);
-    for(const Entry* e = globals->entries; e < globals->entries + globals->sizeMask + 1; e++) {
+    for(const Entry* e = names->entries; e < names->entries + names->sizeMask + 1; e++) {
         if(e->key) {
             push(vm, OBJ_VAL(e->key));
-            push(vm, e->value);
+            push(vm, module->globals.arr[(size_t)AS_NUM(e->value)]);
             if(!jsrSubscriptSet(vm, -3)) return false;
             pop(vm);
         }
@@ -391,26 +444,45 @@ JSR_NATIVE(jsr_Module_globals) {
 // end
 
 // class Iterable
+
+// Joins the elements of a List or Tuple with a single allocation of the final size.
+// Returns false, without pushing anything, if not all the elements are Strings
+static bool joinStrings(JStarVM* vm, const Value* items, size_t count, ObjString* sep) {
+    size_t length = count > 0 ? sep->length * (count - 1) : 0;
+    for(size_t i = 0; i < count; i++) {
+        if(!IS_STRING(items[i])) return false;
+        length += AS_STRING(items[i])->length;
+    }
+
+    JStarBuffer joined;
+    jsrBufferInitCapacity(vm, &joined, length + 1);
+    for(size_t i = 0; i < count; i++) {
+        if(i > 0) jsrBufferAppend(&joined, sep->data, sep->length);
+        jsrBufferAppend(&joined, AS_STRING(items[i])->data, AS_STRING(items[i])->length);
+    }
+
+    jsrBufferPush(&joined);
+    return true;
+}
+
 JSR_NATIVE(jsr_Iterable_join) {
     JSR_CHECK(String, 1, "sep");
 
+    if(IS_LIST(vm->apiStack[0]) || IS_TUPLE(vm->apiStack[0])) {
+        size_t count;
+        Value* items = getValues(AS_OBJ(vm->apiStack[0]), &count);
+        if(joinStrings(vm, items, count, AS_STRING(vm->apiStack[1]))) return true;
+    }
+
     JStarBuffer joined;
     jsrBufferInit(vm, &joined);
 
     JSR_FOREACH(0, {
-        if(!jsrIsString(vm, -1)) {
-            if((jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS)) {
-                jsrBufferFree(&joined);
-                return false;
-            }
-            if(!jsrIsString(vm, -1)) {
-                jsrBufferFree(&joined);
-                JSR_RAISE(vm, "TypeException", "s.__string__() didn't return a String");
-            }
+        if(!bufferAppendValue(vm, &joined, pop(vm))) {
+            jsrBufferFree(&joined);
+            return false;
         }
-        jsrBufferAppend(&joined, jsrGetString(vm, -1), jsrGetStringSz(vm, -1));
         jsrBufferAppend(&joined, jsrGetString(vm, 1), jsrGetStringSz(vm, 1));
-        jsrPop(vm);
     },
     jsrBufferFree(&joined))
 
@@ -442,12 +514,21 @@ JSR_NATIVE(jsr_List_new) {
                 jsrPushNumber(vm, i);
                 if(jsrCall(vm, 1) != JSR_SUCCESS) return false;
                 lst->arr[lst->size++] = pop(vm);
+                GC_WRITE_BARRIER(vm, lst);
             }
         } else {
             for(size_t i = 0; i < count; i++) {
                 lst->arr[lst->size++] = vm->apiStack[2];
             }
+            GC_WRITE_BARRIER(vm, lst);
         }
+    } else if(IS_LIST(vm->apiStack[1]) || IS_TUPLE(vm->apiStack[1])) {
+        size_t size;
+        getValues(AS_OBJ(vm->apiStack[1]), &size);
+        ObjList* lst = newList(vm, size);
+        push(vm, OBJ_VAL(lst));
+        Value* values = getValues(AS_OBJ(vm->apiStack[1]), &size);
+        listAppendValues(vm, lst, values, size);
     } else {
         jsrPushList(vm);
         JSR_FOREACH(1, {
@@ -465,6 +546,30 @@ JSR_NATIVE(jsr_List_add) {
     return true;
 }
 
+JSR_NATIVE(jsr_List_extend) {
+    ObjList* lst = AS_LIST(vm->apiStack[0]);
+    Value iterable = vm->apiStack[1];
+
+    if(IS_LIST(iterable) || IS_TUPLE(iterable)) {
+        // When extending a List with itself grow it beforehand, as the values must not be
+        // read from an array that gets reallocated
+        if(AS_OBJ(iterable) == (Obj*)lst) {
+            listReserve(vm, lst, lst->size * 2);
+        }
+        size_t size;
+        Value* values = getValues(AS_OBJ(iterable), &size);
+        listAppendValues(vm, lst, values, size);
+    } else {
+        JSR_FOREACH(1, {
+            jsrListAppend(vm, 0);
+            jsrPop(vm);
+        },)
+    }
+
+    jsrPushNull(vm);
+    return true;
+}
+
 JSR_NATIVE(jsr_List_insert) {
     ObjList* l = AS_LIST(vm->apiStack[0]);
     size_t index = jsrCheckIndex(vm, 1, l->size + 1, "i");
@@ -534,12 +639,16 @@ JSR_NATIVE(jsr_List_clear) {
     return true;
 }
 
-typedef struct MergeState {
-    JStarVM* vm;
-    Value *list, *tmp;
-    int64_t length;
-    Value comparator;
-} MergeState;
+JSR_NATIVE(jsr_List_reserve) {
+    JSR_CHECK(Int, 1, "n");
+    double n = jsrGetNumber(vm, 1);
+    if(n < 0) {
+        JSR_RAISE(vm, "TypeException", "n must be >= 0");
+    }
+    listReserve(vm, AS_LIST(vm->apiStack[0]), (size_t)n);
+    jsrPushNull(vm);
+    return true;
+}
 
 // Compare two values, calling the appropriate functions depending on the types
 static bool lessEqCompare(JStarVM* vm, Value a, Value b, Value comparator, bool* out) {
@@ -569,68 +678,579 @@ static bool lessEqCompare(JStarVM* vm, Value a, Value b, Value comparator, bool*
     return true;
 }
 
-// Merge two ordered sublists [left:mid] [mid + 1 : right]
-static bool merge(MergeState* state, int64_t left, int64_t mid, int64_t right) {
-    Value* list = state->list;
-    Value* tmp = state->tmp;
-    int64_t length = state->length;
-    Value comparator = state->comparator;
+// The list is sorted using TimSort: natural runs of ordered elements are detected, extended to a
+// minimum length using binary insertion sort and then merged, switching to galloping mode when
+// one of the runs being merged consistently wins. See CPython's `listsort.txt` for the details.
 
-    int64_t k = left, i = left, j = mid + 1;
-    while(i <= mid && j <= right) {
-        bool isLessEq = false;
-        if(!lessEqCompare(state->vm, list[i], list[j], comparator, &isLessEq)) {
-            return false;
+// Minimum number of consecutive wins of a run before switching to galloping mode
+#define MIN_GALLOP 7
+// Enough for lists of 2^64 elements, given the invariants kept on the lengths of pending runs
+#define MAX_PENDING_RUNS 85
+
+// How elements are compared. When all keys are Numbers or all keys are Strings, they are compared
+// directly, without calling back into the VM
+typedef enum SortMode {
+    SORT_NUMBERS,
+    SORT_STRINGS,
+    SORT_VALUES,
+} SortMode;
+
+// The element being sorted along with its sort key. `key` is the element itself if no key
+// function was provided
+typedef struct SortItem {
+    Value key, val;
+} SortItem;
+
+typedef struct SortRun {
+    SortItem* base;
+    size_t length;
+} SortRun;
+
+typedef struct SortState {
+    JStarVM* vm;
+    SortMode mode;
+    Value comparator;
+    size_t minGallop;
+    SortItem* tmp;
+    size_t tmpCapacity;
+    SortRun runs[MAX_PENDING_RUNS];
+    int runCount;
+} SortState;
+
+static int stringCompare(ObjString* s1, ObjString* s2) {
+    size_t len = s1->length < s2->length ? s1->length : s2->length;
+    int cmp = memcmp(s1->data, s2->data, len);
+    if(cmp != 0) return cmp;
+    return (s1->length > s2->length) - (s1->length < s2->length);
+}
+
+// Sets `out` to true if `a` sorts strictly before `b`
+static inline bool sortLess(SortState* s, const SortItem* a, const SortItem* b, bool* out) {
+    switch(s->mode) {
+    case SORT_NUMBERS:
+        *out = AS_NUM(a->key) < AS_NUM(b->key);
+        return true;
+    case SORT_STRINGS:
+        *out = stringCompare(AS_STRING(a->key), AS_STRING(b->key)) < 0;
+        return true;
+    case SORT_VALUES: {
+        // `a < b` is expressed as `!(b <= a)`, so that the ordering is still defined in terms of
+        // `__le__` and comparators returning `<= 0`
+        bool lessEq;
+        if(!lessEqCompare(s->vm, b->key, a->key, s->comparator, &lessEq)) return false;
+        *out = !lessEq;
+        return true;
+    }
+    }
+    UNREACHABLE();
+    return false;
+}
+
+#define SORT_LESS(s, a, b, out) \
+    if(!sortLess(s, a, b, out)) return false
+
+static void reverseItems(SortItem* lo, SortItem* hi) {
+    for(hi--; lo < hi; lo++, hi--) {
+        SortItem t = *lo;
+        *lo = *hi;
+        *hi = t;
+    }
+}
+
+// Sorts [lo, hi) knowing that [lo, start) is already sorted
+static bool binaryInsertionSort(SortState* s, SortItem* lo, SortItem* hi, SortItem* start) {
+    for(; start < hi; start++) {
+        SortItem pivot = *start;
+        SortItem *l = lo, *r = start;
+        while(l < r) {
+            SortItem* p = l + ((r - l) >> 1);
+            bool less;
+            SORT_LESS(s, &pivot, p, &less);
+            if(less) {
+                r = p;
+            } else {
+                l = p + 1;
+            }
         }
+        memmove(l + 1, l, sizeof(SortItem) * (start - l));
+        *l = pivot;
+    }
+    return true;
+}
+
+// Computes the length of the run starting at `lo`. Strictly descending runs are reversed in place,
+// so that the returned run is always ascending
+static bool countRun(SortState* s, SortItem* lo, SortItem* hi, size_t* length) {
+    SortItem* p = lo + 1;
+    if(p == hi) {
+        *length = 1;
+        return true;
+    }
+
+    bool descending;
+    SORT_LESS(s, p, lo, &descending);
+
+    for(p++; p < hi; p++) {
+        bool less;
+        SORT_LESS(s, p, p - 1, &less);
+        if(less != descending) break;
+    }
+
+    if(descending) reverseItems(lo, p);
+    *length = p - lo;
+    return true;
+}
 
-        if(isLessEq) {
-            tmp[k++] = list[i++];
+// Locates the position at which `key` should be inserted in the sorted array `a` of length `n`,
+// before all the elements equal to it. The search starts at `hint` and gallops away from it
+static bool gallopLeft(SortState* s, const SortItem* key, SortItem* a, ptrdiff_t n, ptrdiff_t hint,
+                       ptrdiff_t* out) {
+    ptrdiff_t lastOfs = 0, ofs = 1;
+    bool less;
+
+    SORT_LESS(s, &a[hint], key, &less);
+    if(less) {
+        // a[hint] < key: gallop right until a[hint + lastOfs] < key <= a[hint + ofs]
+        ptrdiff_t maxOfs = n - hint;
+        while(ofs < maxOfs) {
+            SORT_LESS(s, &a[hint + ofs], key, &less);
+            if(!less) break;
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > maxOfs) ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
+    } else {
+        // key <= a[hint]: gallop left until a[hint - ofs] < key <= a[hint - lastOfs]
+        ptrdiff_t maxOfs = hint + 1;
+        while(ofs < maxOfs) {
+            SORT_LESS(s, &a[hint - ofs], key, &less);
+            if(less) break;
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > maxOfs) ofs = maxOfs;
+        ptrdiff_t k = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - k;
+    }
+
+    // Now a[lastOfs] < key <= a[ofs], binary search in between
+    for(lastOfs++; lastOfs < ofs;) {
+        ptrdiff_t m = lastOfs + ((ofs - lastOfs) >> 1);
+        SORT_LESS(s, &a[m], key, &less);
+        if(less) {
+            lastOfs = m + 1;
         } else {
-            tmp[k++] = list[j++];
+            ofs = m;
         }
     }
 
-    while(i < length && i <= mid) {
-        tmp[k++] = list[i++];
+    *out = ofs;
+    return true;
+}
+
+// Like gallopLeft, but the position is after all the elements equal to `key`
+static bool gallopRight(SortState* s, const SortItem* key, SortItem* a, ptrdiff_t n,
+                        ptrdiff_t hint, ptrdiff_t* out) {
+    ptrdiff_t lastOfs = 0, ofs = 1;
+    bool less;
+
+    SORT_LESS(s, key, &a[hint], &less);
+    if(less) {
+        // key < a[hint]: gallop left until a[hint - ofs] <= key < a[hint - lastOfs]
+        ptrdiff_t maxOfs = hint + 1;
+        while(ofs < maxOfs) {
+            SORT_LESS(s, key, &a[hint - ofs], &less);
+            if(!less) break;
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > maxOfs) ofs = maxOfs;
+        ptrdiff_t k = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - k;
+    } else {
+        // a[hint] <= key: gallop right until a[hint + lastOfs] <= key < a[hint + ofs]
+        ptrdiff_t maxOfs = n - hint;
+        while(ofs < maxOfs) {
+            SORT_LESS(s, key, &a[hint + ofs], &less);
+            if(less) break;
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > maxOfs) ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
     }
 
-    for(int64_t i = left; i <= right; i++) {
-        list[i] = tmp[i];
+    // Now a[lastOfs] <= key < a[ofs], binary search in between
+    for(lastOfs++; lastOfs < ofs;) {
+        ptrdiff_t m = lastOfs + ((ofs - lastOfs) >> 1);
+        SORT_LESS(s, key, &a[m], &less);
+        if(less) {
+            ofs = m;
+        } else {
+            lastOfs = m + 1;
+        }
     }
 
+    *out = ofs;
     return true;
 }
 
-// Iterative bottom-up mergesort
-static bool mergeSort(JStarVM* vm, Value* list, int64_t length, Value comp) {
-    Value* tmp = malloc(sizeof(Value) * length);
-    memcpy(tmp, list, sizeof(Value) * length);
-    MergeState state = {vm, list, tmp, length, comp};
+static void ensureSortTmp(SortState* s, size_t size) {
+    if(size > s->tmpCapacity) {
+        free(s->tmp);
+        s->tmp = malloc(sizeof(SortItem) * size);
+        s->tmpCapacity = size;
+    }
+}
 
-    int64_t high = length - 1;
-    for(int64_t blk = 1; blk <= high; blk *= 2) {
-        for(int64_t i = 0; i < high; i += 2 * blk) {
-            int64_t left = i, mid = i + blk - 1, right = i + 2 * blk - 1;
-            if(right > high) right = high;
-            if(!merge(&state, left, mid, right)) {
-                free(tmp);
-                return false;
+// Merges the adjacent runs `a` and `b` in place, with `na <= nb`. The first element of `b` must
+// sort before the first of `a`, and the last element of `a` after all the elements of `b`
+static bool mergeLow(SortState* s, SortItem* a, ptrdiff_t na, SortItem* b, ptrdiff_t nb) {
+    ensureSortTmp(s, na);
+    memcpy(s->tmp, a, sizeof(SortItem) * na);
+
+    SortItem* dest = a;
+    a = s->tmp;
+
+    *dest++ = *b++;
+    if(--nb == 0) goto done;
+    if(na == 1) goto copyB;
+
+    for(;;) {
+        ptrdiff_t aCount = 0, bCount = 0;
+
+        // Merge one element at a time until one of the runs wins consistently
+        for(;;) {
+            bool less;
+            SORT_LESS(s, b, a, &less);
+            if(less) {
+                *dest++ = *b++;
+                bCount++, aCount = 0;
+                if(--nb == 0) goto done;
+                if((size_t)bCount >= s->minGallop) break;
+            } else {
+                *dest++ = *a++;
+                aCount++, bCount = 0;
+                if(--na == 1) goto copyB;
+                if((size_t)aCount >= s->minGallop) break;
             }
         }
+
+        // Gallop as long as it pays off, making it easier to enter galloping mode again
+        s->minGallop++;
+        do {
+            s->minGallop -= s->minGallop > 1;
+
+            ptrdiff_t k;
+            if(!gallopRight(s, b, a, na, 0, &k)) return false;
+            aCount = k;
+            if(k) {
+                memcpy(dest, a, sizeof(SortItem) * k);
+                dest += k, a += k, na -= k;
+                if(na == 1) goto copyB;
+                // Only possible if the comparison function is inconsistent
+                if(na == 0) goto done;
+            }
+            *dest++ = *b++;
+            if(--nb == 0) goto done;
+
+            if(!gallopLeft(s, a, b, nb, 0, &k)) return false;
+            bCount = k;
+            if(k) {
+                memmove(dest, b, sizeof(SortItem) * k);
+                dest += k, b += k, nb -= k;
+                if(nb == 0) goto done;
+            }
+            *dest++ = *a++;
+            if(--na == 1) goto copyB;
+        } while(aCount >= MIN_GALLOP || bCount >= MIN_GALLOP);
+        s->minGallop++;
     }
 
-    free(tmp);
+done:
+    if(na) memcpy(dest, a, sizeof(SortItem) * na);
+    return true;
+
+copyB:
+    // The last element of `a` goes after all the remaining elements of `b`
+    memmove(dest, b, sizeof(SortItem) * nb);
+    dest[nb] = *a;
     return true;
 }
 
+// Like mergeLow, but merges from the end with `na >= nb`
+static bool mergeHigh(SortState* s, SortItem* a, ptrdiff_t na, SortItem* b, ptrdiff_t nb) {
+    ensureSortTmp(s, nb);
+    memcpy(s->tmp, b, sizeof(SortItem) * nb);
+
+    SortItem *baseA = a, *baseB = s->tmp;
+    SortItem* dest = b + nb - 1;
+    a += na - 1;
+    b = baseB + nb - 1;
+
+    *dest-- = *a--;
+    if(--na == 0) goto done;
+    if(nb == 1) goto copyA;
+
+    for(;;) {
+        ptrdiff_t aCount = 0, bCount = 0;
+
+        for(;;) {
+            bool less;
+            SORT_LESS(s, b, a, &less);
+            if(less) {
+                *dest-- = *a--;
+                aCount++, bCount = 0;
+                if(--na == 0) goto done;
+                if((size_t)aCount >= s->minGallop) break;
+            } else {
+                *dest-- = *b--;
+                bCount++, aCount = 0;
+                if(--nb == 1) goto copyA;
+                if((size_t)bCount >= s->minGallop) break;
+            }
+        }
+
+        s->minGallop++;
+        do {
+            s->minGallop -= s->minGallop > 1;
+
+            ptrdiff_t k;
+            if(!gallopRight(s, b, baseA, na, na - 1, &k)) return false;
+            k = na - k;
+            aCount = k;
+            if(k) {
+                dest -= k, a -= k, na -= k;
+                memmove(dest + 1, a + 1, sizeof(SortItem) * k);
+                if(na == 0) goto done;
+            }
+            *dest-- = *b--;
+            if(--nb == 1) goto copyA;
+
+            if(!gallopLeft(s, a, baseB, nb, nb - 1, &k)) return false;
+            k = nb - k;
+            bCount = k;
+            if(k) {
+                dest -= k, b -= k, nb -= k;
+                memcpy(dest + 1, b + 1, sizeof(SortItem) * k);
+                if(nb == 1) goto copyA;
+                // Only possible if the comparison function is inconsistent
+                if(nb == 0) goto done;
+            }
+            *dest-- = *a--;
+            if(--na == 0) goto done;
+        } while(aCount >= MIN_GALLOP || bCount >= MIN_GALLOP);
+        s->minGallop++;
+    }
+
+done:
+    if(nb) memcpy(dest - (nb - 1), baseB, sizeof(SortItem) * nb);
+    return true;
+
+copyA:
+    // The first element of `b` goes before all the remaining elements of `a`
+    dest -= na, a -= na;
+    memmove(dest + 1, a + 1, sizeof(SortItem) * na);
+    *dest = *b;
+    return true;
+}
+
+// Merges the pending runs `i` and `i + 1`
+static bool mergeAt(SortState* s, int i) {
+    SortItem* a = s->runs[i].base;
+    ptrdiff_t na = s->runs[i].length;
+    SortItem* b = s->runs[i + 1].base;
+    ptrdiff_t nb = s->runs[i + 1].length;
+
+    s->runs[i].length = na + nb;
+    if(i == s->runCount - 3) s->runs[i + 1] = s->runs[i + 2];
+    s->runCount--;
+
+    // Elements of `a` that sort before the first element of `b` are already in place
+    ptrdiff_t k;
+    if(!gallopRight(s, b, a, na, 0, &k)) return false;
+    a += k, na -= k;
+    if(na == 0) return true;
+
+    // And so are the elements of `b` that sort after the last element of `a`
+    if(!gallopLeft(s, &a[na - 1], b, nb, nb - 1, &nb)) return false;
+    if(nb == 0) return true;
+
+    return na <= nb ? mergeLow(s, a, na, b, nb) : mergeHigh(s, a, na, b, nb);
+}
+
+// Merges pending runs until the lengths of the last three satisfy the TimSort invariants
+static bool mergeCollapse(SortState* s) {
+    SortRun* r = s->runs;
+    while(s->runCount > 1) {
+        int n = s->runCount - 2;
+        if((n > 0 && r[n - 1].length <= r[n].length + r[n + 1].length) ||
+           (n > 1 && r[n - 2].length <= r[n - 1].length + r[n].length)) {
+            if(r[n - 1].length < r[n + 1].length) n--;
+            if(!mergeAt(s, n)) return false;
+        } else if(r[n].length <= r[n + 1].length) {
+            if(!mergeAt(s, n)) return false;
+        } else {
+            break;
+        }
+    }
+    return true;
+}
+
+static bool mergeForceCollapse(SortState* s) {
+    SortRun* r = s->runs;
+    while(s->runCount > 1) {
+        int n = s->runCount - 2;
+        if(n > 0 && r[n - 1].length < r[n + 1].length) n--;
+        if(!mergeAt(s, n)) return false;
+    }
+    return true;
+}
+
+// Returns a run length in [32, 64] such that `n / minRun` is a power of two or slightly less
+static size_t computeMinRun(size_t n) {
+    size_t r = 0;
+    while(n >= 64) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+static bool timSort(SortState* s, SortItem* items, size_t length) {
+    size_t minRun = computeMinRun(length);
+    SortItem *lo = items, *hi = items + length;
+
+    while(lo < hi) {
+        size_t runLength;
+        if(!countRun(s, lo, hi, &runLength)) return false;
+
+        // Extend short runs to `minRun` elements
+        if(runLength < minRun) {
+            size_t forced = (size_t)(hi - lo) < minRun ? (size_t)(hi - lo) : minRun;
+            if(!binaryInsertionSort(s, lo, lo + forced, lo + runLength)) return false;
+            runLength = forced;
+        }
+
+        s->runs[s->runCount].base = lo;
+        s->runs[s->runCount].length = runLength;
+        s->runCount++;
+        if(!mergeCollapse(s)) return false;
+
+        lo += runLength;
+    }
+
+    return mergeForceCollapse(s);
+}
+
+static SortMode sortMode(const Value* keys, size_t length, Value comparator) {
+    if(!IS_NULL(comparator)) return SORT_VALUES;
+
+    bool numbers = true, strings = true;
+    for(size_t i = 0; i < length && (numbers || strings); i++) {
+        numbers = numbers && IS_NUM(keys[i]);
+        strings = strings && IS_STRING(keys[i]);
+    }
+
+    return numbers ? SORT_NUMBERS : strings ? SORT_STRINGS : SORT_VALUES;
+}
+
 JSR_NATIVE(jsr_List_sort) {
     ObjList* list = AS_LIST(vm->apiStack[0]);
     Value comp = vm->apiStack[1];
-    if(!mergeSort(vm, list->arr, list->size, comp)) return false;
-    jsrPushNull(vm);
+    Value key = vm->apiStack[2];
+
+    size_t length = list->size;
+    if(length < 2) {
+        jsrPushNull(vm);
+        return true;
+    }
+
+    Value *vals = list->arr, *keys = list->arr;
+
+    // Comparators, key functions and `__le__` overloads can run arbitrary code, possibly
+    // modifying the list. In that case sort a snapshot of its elements, that also keeps them
+    // reachable while they are being moved around
+    if(!IS_NULL(key) || sortMode(list->arr, length, comp) == SORT_VALUES) {
+        ObjTuple* snapshot = newTuple(vm, length);
+        memcpy(snapshot->arr, list->arr, sizeof(Value) * length);
+        push(vm, OBJ_VAL(snapshot));
+        vals = keys = snapshot->arr;
+
+        // Compute the keys once per element, instead of once per comparison
+        if(!IS_NULL(key)) {
+            ObjTuple* keyTuple = newTuple(vm, length);
+            push(vm, OBJ_VAL(keyTuple));
+            for(size_t i = 0; i < length; i++) {
+                push(vm, key);
+                push(vm, vals[i]);
+                if(jsrCall(vm, 1) != JSR_SUCCESS) return false;
+                keyTuple->arr[i] = pop(vm);
+                GC_WRITE_BARRIER(vm, keyTuple);
+            }
+            keys = keyTuple->arr;
+        }
+    }
+
+    SortItem* items = malloc(sizeof(SortItem) * length);
+    for(size_t i = 0; i < length; i++) {
+        items[i].key = keys[i];
+        items[i].val = vals[i];
+    }
+
+    SortState state = {.vm = vm, .comparator = comp, .minGallop = MIN_GALLOP};
+    state.mode = sortMode(keys, length, comp);
+
+    bool res = timSort(&state, items, length);
+    free(state.tmp);
+
+    if(res && list->size != length) {
+        jsrRaise(vm, "Exception", "List modified during sort");
+        res = false;
+    }
+
+    if(res) {
+        for(size_t i = 0; i < length; i++) {
+            list->arr[i] = items[i].val;
+        }
+        GC_WRITE_BARRIER(vm, list);
+        jsrPushNull(vm);
+    }
+
+    free(items);
+    return res;
+}
+
+// Sums the values directly if they are all Numbers. Otherwise falls back to `super.sum()`, i.e.
+// the generic Iterable.sum() that supports operator overloading
+static bool sumValues(JStarVM* vm, const Value* arr, size_t size) {
+    double sum = 0;
+    for(size_t i = 0; i < size; i++) {
+        if(!IS_NUM(arr[i])) {
+            ObjClass* superCls = getClass(vm, vm->apiStack[0])->superCls;
+            push(vm, vm->apiStack[0]);
+            if(!bindMethod(vm, superCls, vm->methodSyms[SYM_SUM])) {
+                JSR_RAISE(vm, "MethodException", "Method %s.sum() doesn't exists",
+                          superCls->name->data);
+            }
+            return jsrCall(vm, 0) == JSR_SUCCESS;
+        }
+        sum += AS_NUM(arr[i]);
+    }
+    push(vm, NUM_VAL(sum));
     return true;
 }
 
+JSR_NATIVE(jsr_List_sum) {
+    ObjList* lst = AS_LIST(vm->apiStack[0]);
+    return sumValues(vm, lst->arr, lst->size);
+}
+
 JSR_NATIVE(jsr_List_iter) {
     ObjList* lst = AS_LIST(vm->apiStack[0]);
 
@@ -641,7 +1261,7 @@ JSR_NATIVE(jsr_List_iter) {
 
     if(IS_NUM(vm->apiStack[1])) {
         size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
-        if(idx < lst->size - 1) {
+        if(idx + 1 < lst->size) {
             push(vm, NUM_VAL(idx + 1));
             return true;
         }
@@ -733,6 +1353,11 @@ JSR_NATIVE(jsr_Tuple_eq) {
     return true;
 }
 
+JSR_NATIVE(jsr_Tuple_sum) {
+    ObjTuple* tup = AS_TUPLE(vm->apiStack[0]);
+    return sumValues(vm, tup->arr, tup->size);
+}
+
 JSR_NATIVE(jsr_Tuple_iter) {
     ObjTuple* tup = AS_TUPLE(vm->apiStack[0]);
 
@@ -743,7 +1368,7 @@ JSR_NATIVE(jsr_Tuple_iter) {
 
     if(IS_NUM(vm->apiStack[1])) {
         size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
-        if(idx < tup->size - 1) {
+        if(idx + 1 < tup->size) {
             push(vm, NUM_VAL(idx + 1));
             return true;
         }
@@ -768,10 +1393,56 @@ JSR_NATIVE(jsr_Tuple_next) {
     return true;
 }
 
+// Tuples nested deeper than this are hashed through `__hash__`
+#define MAX_TUPLE_HASH_DEPTH 16
+
+// Computes the hash of a Tuple made of Numbers, Strings, Booleans and other such Tuples without
+// leaving C, giving the same result as calling `__hash__` on its elements. The hash is cached
+// in the Tuple, since neither it nor its elements can change. Returns false if an element is of
+// another type, whose `__hash__` method must be called
+static bool primitiveTupleHash(ObjTuple* tup, uint32_t* out, int depth) {
+    if(tup->hash != 0) {
+        *out = tup->hash;
+        return true;
+    }
+
+    if(depth > MAX_TUPLE_HASH_DEPTH) return false;
+
+    uint32_t hash = 1;
+    for(size_t i = 0; i < tup->size; i++) {
+        Value v = tup->arr[i];
+
+        uint32_t elemHash;
+        if(IS_NUM(v)) {
+            elemHash = hashNumber(AS_NUM(v));
+        } else if(IS_STRING(v)) {
+            elemHash = stringGetHash(AS_STRING(v));
+        } else if(IS_BOOL(v)) {
+            elemHash = AS_BOOL(v);
+        } else if(IS_TUPLE(v)) {
+            if(!primitiveTupleHash(AS_TUPLE(v), &elemHash, depth + 1)) return false;
+        } else {
+            return false;
+        }
+
+        hash = 31 * hash + elemHash;
+    }
+
+    tup->hash = hash;
+    *out = hash;
+    return true;
+}
+
 JSR_NATIVE(jsr_Tuple_hash) {
     ObjTuple* tup = AS_TUPLE(vm->apiStack[0]);
 
-    uint32_t hash = 1;
+    uint32_t hash;
+    if(primitiveTupleHash(tup, &hash, 0)) {
+        jsrPushNumber(vm, hash);
+        return true;
+    }
+
+    hash = 1;
     for(size_t i = 0; i < tup->size; i++) {
         push(vm, tup->arr[i]);
         if(jsrCallMethod(vm, "__hash__", 0) != JSR_SUCCESS) return false;
@@ -793,16 +1464,10 @@ JSR_NATIVE(jsr_String_new) {
     jsrBufferInit(vm, &string);
 
     JSR_FOREACH(1, {
-        if(jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS) {
+        if(!bufferAppendValue(vm, &string, pop(vm))) {
             jsrBufferFree(&string);
             return false;
         }
-        if(!jsrIsString(vm, -1)) {
-            jsrBufferFree(&string);
-            JSR_RAISE(vm, "TypeException", "__string__() didn't return a String");
-        }
-        jsrBufferAppendStr(&string, jsrGetString(vm, -1));
-        jsrPop(vm);
     },
     jsrBufferFree(&string));
 
@@ -869,6 +1534,34 @@ JSR_NATIVE(jsr_String_endsWith) {
     return true;
 }
 
+// Returns the first occurrence of `sub` in `str`, or NULL if there is none.
+// Candidate positions are located with `memchr`, that libc implementations vectorize
+static const char* findSubstring(const char* str, size_t len, const char* sub, size_t subLen) {
+    if(subLen == 0) return str;
+    if(subLen > len) return NULL;
+
+    const char* end = str + (len - subLen) + 1;
+    for(const char* p = str; p < end; p++) {
+        p = memchr(p, sub[0], end - p);
+        if(p == NULL) return NULL;
+        if(memcmp(p + 1, sub + 1, subLen - 1) == 0) return p;
+    }
+
+    return NULL;
+}
+
+// Returns the last occurrence of `sub` in `str`, or NULL if there is none
+static const char* findLastSubstring(const char* str, size_t len, const char* sub,
+                                     size_t subLen) {
+    if(subLen > len) return NULL;
+    if(subLen == 0) return str + len;
+
+    for(const char* p = str + (len - subLen);; p--) {
+        if(*p == sub[0] && memcmp(p + 1, sub + 1, subLen - 1) == 0) return p;
+        if(p == str) return NULL;
+    }
+}
+
 JSR_NATIVE(jsr_String_split) {
     JSR_CHECK(String, 1, "delimiter");
 
@@ -883,23 +1576,118 @@ JSR_NATIVE(jsr_String_split) {
     push(vm, OBJ_VAL(tokens));
 
     const char* last = str;
+    const char* end = str + size;
 
-    if(delimSize < size) {
-        for(size_t i = 0; i <= size - delimSize; i++) {
-            if(memcmp(str + i, delimiter, delimSize) == 0) {
-                jsrPushStringSz(vm, last, str + i - last);
-                jsrListAppend(vm, -2);
-                jsrPop(vm);
+    const char* match;
+    while((match = findSubstring(last, end - last, delimiter, delimSize)) != NULL) {
+        push(vm, OBJ_VAL(copyString(vm, last, match - last)));
+        listAppend(vm, tokens, peek(vm));
+        pop(vm);
+        last = match + delimSize;
+    }
 
-                last = str + i + delimSize;
-            }
+    push(vm, OBJ_VAL(copyString(vm, last, end - last)));
+    listAppend(vm, tokens, peek(vm));
+    pop(vm);
+
+    return true;
+}
+
+JSR_NATIVE(jsr_String_find) {
+    JSR_CHECK(String, 1, "sub");
+    size_t len = jsrGetStringSz(vm, 0);
+    size_t start = jsrCheckIndex(vm, 2, len + 1, "start");
+    if(start == SIZE_MAX) return false;
+
+    const char* str = jsrGetString(vm, 0);
+    const char* match = findSubstring(str + start, len - start, jsrGetString(vm, 1),
+                                      jsrGetStringSz(vm, 1));
+
+    jsrPushNumber(vm, match ? (double)(match - str) : -1);
+    return true;
+}
+
+JSR_NATIVE(jsr_String_rfind) {
+    JSR_CHECK(String, 1, "sub");
+
+    const char* str = jsrGetString(vm, 0);
+    const char* match = findLastSubstring(str, jsrGetStringSz(vm, 0), jsrGetString(vm, 1),
+                                          jsrGetStringSz(vm, 1));
+
+    jsrPushNumber(vm, match ? (double)(match - str) : -1);
+    return true;
+}
+
+JSR_NATIVE(jsr_String_count) {
+    JSR_CHECK(String, 1, "sub");
+
+    const char* sub = jsrGetString(vm, 1);
+    size_t subLen = jsrGetStringSz(vm, 1);
+
+    // The empty string matches at every position, as in `find`
+    if(subLen == 0) {
+        jsrPushNumber(vm, jsrGetStringSz(vm, 0) + 1);
+        return true;
+    }
+
+    const char* str = jsrGetString(vm, 0);
+    const char* end = str + jsrGetStringSz(vm, 0);
+
+    size_t count = 0;
+    const char* match;
+    while((match = findSubstring(str, end - str, sub, subLen)) != NULL) {
+        count++;
+        str = match + subLen;
+    }
+
+    jsrPushNumber(vm, count);
+    return true;
+}
+
+JSR_NATIVE(jsr_String_replace) {
+    JSR_CHECK(String, 1, "sub");
+    JSR_CHECK(String, 2, "repl");
+
+    const char* sub = jsrGetString(vm, 1);
+    size_t subLen = jsrGetStringSz(vm, 1);
+
+    const char* str = jsrGetString(vm, 0);
+    const char* end = str + jsrGetStringSz(vm, 0);
+
+    // The empty string matches at every position, so `repl` is inserted around every character
+    if(subLen == 0) {
+        const char* repl = jsrGetString(vm, 2);
+        size_t replLen = jsrGetStringSz(vm, 2);
+
+        JStarBuffer buf;
+        jsrBufferInitCapacity(vm, &buf, (end - str) * (replLen + 1) + replLen + 1);
+        jsrBufferAppend(&buf, repl, replLen);
+        for(; str != end; str++) {
+            jsrBufferAppendChar(&buf, *str);
+            jsrBufferAppend(&buf, repl, replLen);
         }
+
+        jsrBufferPush(&buf);
+        return true;
     }
 
-    jsrPushStringSz(vm, last, str + size - last);
-    jsrListAppend(vm, -2);
-    jsrPop(vm);
+    const char* match = findSubstring(str, end - str, sub, subLen);
+    if(match == NULL) {
+        jsrPushValue(vm, 0);
+        return true;
+    }
+
+    JStarBuffer buf;
+    jsrBufferInitCapacity(vm, &buf, jsrGetStringSz(vm, 0) + 1);
+
+    do {
+        jsrBufferAppend(&buf, str, match - str);
+        jsrBufferAppend(&buf, jsrGetString(vm, 2), jsrGetStringSz(vm, 2));
+        str = match + subLen;
+    } while((match = findSubstring(str, end - str, sub, subLen)) != NULL);
 
+    jsrBufferAppend(&buf, str, end - str);
+    jsrBufferPush(&buf);
     return true;
 }
 
@@ -1008,41 +1796,39 @@ JSR_NATIVE(jsr_String_mod) {
     const char* formatEnd = format + jsrGetStringSz(vm, 0);
 
     JStarBuffer buf;
-    jsrBufferInit(vm, &buf);
+    jsrBufferInitCapacity(vm, &buf, formatEnd - format + 1);
 
-    for(const char* ptr = format; ptr < formatEnd; ptr++) {
-        if(*ptr == '{' && isdigit(ptr[1])) {
+    // Copy the text between format specifiers in bulk, locating them with memchr
+    const char* ptr = format;
+    const char* brace;
+    while((brace = memchr(ptr, '{', formatEnd - ptr)) != NULL) {
+        if(isdigit((unsigned char)brace[1])) {
             char* end;
-            int n = strtol(ptr + 1, &end, 10);
-            if(end != ptr + 1 && *end == '}') {
+            unsigned long n = strtoul(brace + 1, &end, 10);
+            if(*end == '}') {
+                jsrBufferAppend(&buf, ptr, brace - ptr);
+
                 Value fmtArg;
                 if(!getFmtArgument(vm, fmtArgs, n, &fmtArg)) {
                     jsrBufferFree(&buf);
                     return false;
                 }
-                push(vm, fmtArg);
 
-                if(jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS) {
+                if(!bufferAppendValue(vm, &buf, fmtArg)) {
                     jsrBufferFree(&buf);
                     return false;
                 }
 
-                if(!jsrIsString(vm, -1)) {
-                    jsrBufferFree(&buf);
-                    JSR_RAISE(vm, "TypeException", "%s.__string__() didn't return a String.",
-                              getClass(vm, fmtArg)->name->data);
-                }
-
-                jsrBufferAppendStr(&buf, jsrGetString(vm, -1));
-                jsrPop(vm);
-
-                ptr = end;  // skip the format specifier
+                ptr = end + 1;  // skip the format specifier
                 continue;
             }
         }
-        jsrBufferAppend(&buf, ptr, 1);
+
+        jsrBufferAppend(&buf, ptr, brace + 1 - ptr);
+        ptr = brace + 1;
     }
 
+    jsrBufferAppend(&buf, ptr, formatEnd - ptr);
     jsrBufferPush(&buf);
     return true;
 }
@@ -1084,7 +1870,7 @@ JSR_NATIVE(jsr_String_iter) {
 
     if(IS_NUM(vm->apiStack[1])) {
         size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
-        if(idx < s->length - 1) {
+        if(idx + 1 < s->length) {
             push(vm, NUM_VAL(idx + 1));
             return true;
         }
@@ -1111,13 +1897,13 @@ JSR_NATIVE(jsr_String_next) {
 // end
 
 // class Table
-#define TOMB_MARKER      TRUE_VAL
-#define INITIAL_CAPACITY 8
+#define INITIAL_CAPACITY GROUP_WIDTH
 #define GROW_FACTOR      2
 
 static bool tableKeyHash(JStarVM* vm, Value key, uint32_t* hash) {
     if(IS_STRING(key)) {
-        *hash = stringGetHash(AS_STRING(key));
+        ObjString* str = AS_STRING(key);
+        *hash = str->hash ? str->hash : stringGetHash(str);
         return true;
     }
     if(IS_NUM(key)) {
@@ -1128,6 +1914,9 @@ static bool tableKeyHash(JStarVM* vm, Value key, uint32_t* hash) {
         *hash = AS_BOOL(key);
         return true;
     }
+    if(IS_TUPLE(key) && primitiveTupleHash(AS_TUPLE(key), hash, 0)) {
+        return true;
+    }
 
     push(vm, key);
     if(jsrCallMethod(vm, "__hash__", 0) != JSR_SUCCESS) return false;
@@ -1138,86 +1927,220 @@ static bool tableKeyHash(JStarVM* vm, Value key, uint32_t* hash) {
 }
 
 static bool tableKeyEquals(JStarVM* vm, Value k1, Value k2, bool* eq) {
-    if(IS_NUM(k1) || IS_BOOL(k1)) {
-        *eq = valueEquals(k1, k2);
-        return true;
-    }
-    if(IS_STRING(k1) && IS_STRING(k2)) {
-        *eq = stringEquals(AS_STRING(k1), AS_STRING(k2));
-        return true;
-    }
-
     push(vm, k1);
     push(vm, k2);
     if(jsrCallMethod(vm, "__eq__", 1) != JSR_SUCCESS) return false;
     *eq = valueToBool(pop(vm));
+    return true;
+}
+
+// The hash of a key stored in a Table has already been computed, so it can be used to tell apart
+// different Strings before comparing their contents
+static inline bool stringKeyEquals(ObjString* str, Value key) {
+    if(!IS_STRING(key)) return false;
+    ObjString* other = AS_STRING(key);
+    if(other == str) return true;
+    if(other->interned && str->interned) return false;
+    return other->hash == str->hash && other->length == str->length &&
+           memcmp(other->data, str->data, str->length) == 0;
+}
+
+static size_t tableMaxEntryLoad(size_t capacity) {
+    return (capacity >> 1) + (capacity >> 2);  // Read as: 3/4 * capacity i.e. a load factor of 75%
+}
+
+// Compares a Tuple key with a cached hash, whose elements are all Numbers, Strings, Booleans or
+// such Tuples, to `key` with the same result of `Tuple.__eq__`
+static bool primitiveTupleEquals(ObjTuple* tup, Value key) {
+    if(!IS_TUPLE(key)) return false;
+    ObjTuple* other = AS_TUPLE(key);
+    if(other == tup) return true;
+    if(other->size != tup->size || (other->hash != 0 && other->hash != tup->hash)) return false;
+
+    for(size_t i = 0; i < tup->size; i++) {
+        Value v1 = tup->arr[i], v2 = other->arr[i];
+        if(IS_STRING(v1)) {
+            if(!IS_STRING(v2) || !stringEquals(AS_STRING(v1), AS_STRING(v2))) return false;
+        } else if(IS_TUPLE(v1)) {
+            if(!primitiveTupleEquals(AS_TUPLE(v1), v2)) return false;
+        } else if(!valueEquals(v1, v2)) {
+            return false;
+        }
+    }
 
     return true;
 }
 
-static bool findEntry(JStarVM* vm, TableEntry* entries, size_t sizeMask, Value key,
-                      TableEntry** out) {
-    uint32_t hash;
-    if(!tableKeyHash(vm, key, &hash)) return false;
+// Probes the index of `t` for `hash`, running the statement `match` for every candidate slot `i`
+// and the key `k` of its entry. The loop ends when `match` returns or an empty slot is reached
+#define PROBE_INDEX(t, hash, match)                                           \
+    do {                                                                      \
+        uint8_t h2 = HASH_H2(hash);                                           \
+        size_t pos = probeStart(hash, (t)->capacityMask), stride = 0;         \
+        for(;;) {                                                             \
+            Group g = groupLoad((t)->ctrl + pos);                             \
+            for(GroupMask m = groupMatch(g, h2); m; m = groupMaskNext(m)) {   \
+                size_t i = pos + groupMaskFirst(m);                           \
+                Value k = (t)->entries[(t)->index[i]].key;                    \
+                match;                                                        \
+            }                                                                 \
+            if(groupMatchEmpty(g)) break;                                     \
+            pos = probeNext(pos, &stride, (t)->capacityMask);                 \
+        }                                                                     \
+    } while(0)
 
-    size_t i = hash & sizeMask;
-    TableEntry* tomb = NULL;
+// Sets `slot` to the index slot of `key`, or to SIZE_MAX if the key is not in the Table.
+// The hash of the key is returned in `hash`, so that it can be reused for inserting it.
+// Numbers, Strings and Booleans are hashed and compared inline, only other keys dispatch to their
+// `__hash__` and `__eq__` methods
+static bool findSlot(JStarVM* vm, ObjTable* t, Value key, uint32_t* hash, size_t* slot) {
+    if(!tableKeyHash(vm, key, hash)) return false;
 
-    for(;;) {
-        TableEntry* e = &entries[i];
-        if(IS_NULL(e->key)) {
-            if(IS_NULL(e->val)) {
-                if(tomb)
-                    *out = tomb;
-                else
-                    *out = e;
-                return true;
-            } else if(!tomb) {
-                tomb = e;
-            }
-        } else {
+    *slot = SIZE_MAX;
+    if(t->entries == NULL) return true;
+
+    if(IS_NUM(key)) {
+        double num = AS_NUM(key);
+        PROBE_INDEX(t, *hash, if(IS_NUM(k) && AS_NUM(k) == num) {
+            *slot = i;
+            return true;
+        });
+    } else if(IS_STRING(key)) {
+        ObjString* str = AS_STRING(key);
+        PROBE_INDEX(t, *hash, if(stringKeyEquals(str, k)) {
+            *slot = i;
+            return true;
+        });
+    } else if(IS_BOOL(key)) {
+        PROBE_INDEX(t, *hash, if(valueEquals(key, k)) {
+            *slot = i;
+            return true;
+        });
+    } else if(IS_TUPLE(key) && AS_TUPLE(key)->hash != 0) {
+        ObjTuple* tup = AS_TUPLE(key);
+        PROBE_INDEX(t, *hash, if(primitiveTupleEquals(tup, k)) {
+            *slot = i;
+            return true;
+        });
+    } else {
+        PROBE_INDEX(t, *hash, {
             bool eq;
-            if(!tableKeyEquals(vm, key, e->key, &eq)) return false;
+            if(!tableKeyEquals(vm, key, k, &eq)) return false;
             if(eq) {
-                *out = e;
+                *slot = i;
                 return true;
             }
-        }
-        i = (i + 1) & sizeMask;
+        });
     }
+
+    return true;
+}
+
+// Sets `out` to the entry associated with `key`, or to NULL if the key is not in the Table
+static bool findEntry(JStarVM* vm, ObjTable* t, Value key, uint32_t* hash, TableEntry** out) {
+    size_t slot;
+    if(!findSlot(vm, t, key, hash, &slot)) return false;
+    *out = slot != SIZE_MAX ? &t->entries[t->index[slot]] : NULL;
+    return true;
 }
 
+// Growing the entries array doesn't require rehashing the keys, so it's grown by smaller steps
+// than the index, up to its maximum load
 static void growEntries(JStarVM* vm, ObjTable* t) {
-    size_t newCap = t->capacityMask ? (t->capacityMask + 1) * GROW_FACTOR : INITIAL_CAPACITY;
-    TableEntry* newEntries = GC_ALLOC(vm, sizeof(TableEntry) * newCap);
-    for(size_t i = 0; i < newCap; i++) {
-        newEntries[i] = (TableEntry){NULL_VAL, NULL_VAL};
-    }
-
-    t->numEntries = 0, t->size = 0;
-    if(t->capacityMask != 0) {
-        for(size_t i = 0; i <= t->capacityMask; i++) {
-            TableEntry* e = &t->entries[i];
-            if(IS_NULL(e->key)) continue;
-
-            TableEntry* dest;
-            findEntry(vm, newEntries, newCap - 1, e->key, &dest);
-            *dest = (TableEntry){e->key, e->val};
-            t->numEntries++, t->size++;
+    size_t maxLoad = tableMaxEntryLoad(t->capacityMask + 1);
+    size_t newCapacity = t->entryCapacity < 4 ? 4 : t->entryCapacity + t->entryCapacity / 2;
+    if(newCapacity > maxLoad) newCapacity = maxLoad;
+
+    t->entries = gcAlloc(vm, t->entries, sizeof(TableEntry) * t->entryCapacity,
+                         sizeof(TableEntry) * newCapacity);
+    t->entryCapacity = newCapacity;
+}
+
+// Rebuilds the index with `newCap` slots, compacting away the deleted entries
+static bool rebuildIndex(JStarVM* vm, ObjTable* t, size_t newCap) {
+    uint8_t* newCtrl = GC_ALLOC(vm, TABLE_INDEX_SIZE(newCap));
+    uint32_t* newIndex = (uint32_t*)(newCtrl + newCap);
+    memset(newCtrl, CTRL_EMPTY, newCap);
+
+    // Index the entries at the position they will have once compacted before moving them, so
+    // that the Table is left untouched if hashing a key fails
+    size_t pos = 0;
+    for(size_t i = 0; i < t->numEntries; i++) {
+        TableEntry* e = &t->entries[i];
+        if(IS_NULL(e->key)) continue;
+
+        uint32_t hash;
+        if(!tableKeyHash(vm, e->key, &hash)) {
+            GC_FREE_ARRAY(vm, uint8_t, newCtrl, TABLE_INDEX_SIZE(newCap));
+            return false;
+        }
+
+        size_t dest = probeFreeSlot(newCtrl, newCap - 1, hash);
+        newCtrl[dest] = HASH_H2(hash);
+        newIndex[dest] = pos++;
+    }
+
+    if(pos != t->numEntries) {
+        pos = 0;
+        for(size_t i = 0; i < t->numEntries; i++) {
+            if(!IS_NULL(t->entries[i].key)) {
+                t->entries[pos++] = t->entries[i];
+            }
         }
-        GC_FREE_ARRAY(vm, TableEntry, t->entries, t->capacityMask + 1);
     }
-    t->entries = newEntries;
+
+    if(t->ctrl != NULL) {
+        GC_FREE_ARRAY(vm, uint8_t, t->ctrl, TABLE_INDEX_SIZE(t->capacityMask + 1));
+    }
+
+    t->ctrl = newCtrl;
+    t->index = newIndex;
     t->capacityMask = newCap - 1;
+    t->numEntries = pos;
+    return true;
 }
 
-JSR_NATIVE(jsr_Table_new) {
-    ObjTable* table = newTable(vm);
+// Makes room for appending an entry. The entries array is grown up to the maximum load of the
+// index, after which the index is rebuilt with twice the slots. If most of the entries are deleted
+// ones they are compacted away instead, keeping the same size
+static bool reserveEntry(JStarVM* vm, ObjTable* t) {
+    if(t->numEntries < t->entryCapacity) return true;
+
+    size_t oldCap = t->ctrl ? t->capacityMask + 1 : 0;
+    size_t newCap = oldCap;
+
+    if(t->size + 1 > t->numEntries / 2) {
+        if(t->entryCapacity < tableMaxEntryLoad(oldCap)) {
+            growEntries(vm, t);
+            return true;
+        }
+        newCap = oldCap ? oldCap * GROW_FACTOR : INITIAL_CAPACITY;
+    }
+
+    if(!rebuildIndex(vm, t, newCap)) return false;
+    if(t->numEntries == t->entryCapacity) growEntries(vm, t);
+
+    return true;
+}
+
+static bool newTableFrom(JStarVM* vm, bool weak) {
+    size_t capacity = 0;
+    if(IS_TABLE(vm->apiStack[1])) {
+        capacity = AS_TABLE(vm->apiStack[1])->size;
+    } else if(IS_LIST(vm->apiStack[1]) || IS_TUPLE(vm->apiStack[1])) {
+        getValues(AS_OBJ(vm->apiStack[1]), &capacity);
+    }
+
+    ObjTable* table = newTable(vm, capacity);
+    if(weak) {
+        table->base.cls = vm->weakTableClass;
+        table->weak = true;
+    }
     push(vm, OBJ_VAL(table));
 
     if(IS_TABLE(vm->apiStack[1])) {
         ObjTable* other = AS_TABLE(vm->apiStack[1]);
-        for(size_t i = 0; i <= other->capacityMask; i++) {
+        for(size_t i = 0; i < other->numEntries; i++) {
             TableEntry* e = &other->entries[i];
             if(!IS_NULL(e->key)) {
                 push(vm, OBJ_VAL(table));
@@ -1230,10 +2153,10 @@ JSR_NATIVE(jsr_Table_new) {
     } else if(!IS_NULL(vm->apiStack[1])) {
         JSR_FOREACH(1, {
             if(!IS_LIST(peek(vm)) && !IS_TUPLE(peek(vm))) {
-                JSR_RAISE(vm, "TypeException", "Can only unpack List or Tuple, got %s", 
+                JSR_RAISE(vm, "TypeException", "Can only unpack List or Tuple, got %s",
                           getClass(vm, peek(vm))->name->data);
             }
-            
+
             size_t size;
             Value *array = getValues(AS_OBJ(peek(vm)), &size);
 
@@ -1255,54 +2178,74 @@ JSR_NATIVE(jsr_Table_new) {
     return true;
 }
 
-JSR_NATIVE(jsr_Table_get) {
-    if(jsrIsNull(vm, 1)) JSR_RAISE(vm, "TypeException", "Key of Table cannot be null.");
+JSR_NATIVE(jsr_Table_new) {
+    return newTableFrom(vm, false);
+}
 
-    ObjTable* t = AS_TABLE(vm->apiStack[0]);
+bool tableGet(JStarVM* vm, ObjTable* t, Value key, Value* out) {
     if(t->entries == NULL) {
-        push(vm, NULL_VAL);
+        *out = NULL_VAL;
         return true;
     }
 
+    uint32_t hash;
     TableEntry* e;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &e)) {
+    if(!findEntry(vm, t, key, &hash, &e)) {
         return false;
     }
 
-    if(!IS_NULL(e->key)) {
-        push(vm, e->val);
-    } else {
-        push(vm, NULL_VAL);
-    }
-
+    *out = e ? e->val : NULL_VAL;
     return true;
 }
 
-static size_t tableMaxEntryLoad(size_t capacity) {
-    return (capacity >> 1) + (capacity >> 2);  // Read as: 3/4 * capacity i.e. a load factor of 75%
-}
-
-JSR_NATIVE(jsr_Table_set) {
+JSR_NATIVE(jsr_Table_get) {
     if(jsrIsNull(vm, 1)) JSR_RAISE(vm, "TypeException", "Key of Table cannot be null.");
 
-    ObjTable* t = AS_TABLE(vm->apiStack[0]);
-    if(t->numEntries + 1 > tableMaxEntryLoad(t->capacityMask + 1)) {
-        growEntries(vm, t);
+    Value val;
+    if(!tableGet(vm, AS_TABLE(vm->apiStack[0]), vm->apiStack[1], &val)) {
+        return false;
     }
 
+    push(vm, val);
+    return true;
+}
+
+bool tableSet(JStarVM* vm, ObjTable* t, Value key, Value val, bool* inserted) {
+    uint32_t hash;
     TableEntry* e;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &e)) {
+    if(!findEntry(vm, t, key, &hash, &e)) {
         return false;
     }
 
-    bool newEntry = IS_NULL(e->key);
-    if(newEntry) {
-        t->size++;
-        if(IS_NULL(e->val)) t->numEntries++;
+    if(e) {
+        e->val = val;
+        GC_WRITE_BARRIER(vm, t);
+        *inserted = false;
+        return true;
+    }
+
+    if(!reserveEntry(vm, t)) return false;
+
+    size_t i = probeFreeSlot(t->ctrl, t->capacityMask, hash);
+    t->ctrl[i] = HASH_H2(hash);
+    t->index[i] = t->numEntries;
+    t->entries[t->numEntries++] = (TableEntry){key, val};
+    t->size++;
+
+    GC_WRITE_BARRIER(vm, t);
+    *inserted = true;
+    return true;
+}
+
+JSR_NATIVE(jsr_Table_set) {
+    if(jsrIsNull(vm, 1)) JSR_RAISE(vm, "TypeException", "Key of Table cannot be null.");
+
+    bool inserted;
+    if(!tableSet(vm, AS_TABLE(vm->apiStack[0]), vm->apiStack[1], vm->apiStack[2], &inserted)) {
+        return false;
     }
 
-    *e = (TableEntry){vm->apiStack[1], vm->apiStack[2]};
-    push(vm, BOOL_VAL(newEntry));
+    push(vm, BOOL_VAL(inserted));
     return true;
 }
 
@@ -1315,17 +2258,25 @@ JSR_NATIVE(jsr_Table_delete) {
         return true;
     }
 
-    TableEntry* toDelete;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &toDelete)) {
+    uint32_t hash;
+    size_t i;
+    if(!findSlot(vm, t, vm->apiStack[1], &hash, &i)) {
         return false;
     }
 
-    if(IS_NULL(toDelete->key)) {
+    if(i == SIZE_MAX) {
         jsrPushBoolean(vm, false);
         return true;
     }
 
-    *toDelete = (TableEntry){NULL_VAL, TOMB_MARKER};
+    if(groupHasEmpty(t->ctrl, i)) {
+        t->ctrl[i] = CTRL_EMPTY;
+    } else {
+        t->ctrl[i] = CTRL_DELETED;
+    }
+
+    // The entry stays in the array until the index is rebuilt, so that the order is preserved
+    t->entries[t->index[i]] = (TableEntry){NULL_VAL, NULL_VAL};
     t->size--;
 
     push(vm, BOOL_VAL(true));
@@ -1335,8 +2286,8 @@ JSR_NATIVE(jsr_Table_delete) {
 JSR_NATIVE(jsr_Table_clear) {
     ObjTable* t = AS_TABLE(vm->apiStack[0]);
     t->numEntries = t->size = 0;
-    for(size_t i = 0; i < t->capacityMask + 1; i++) {
-        t->entries[i] = (TableEntry){NULL_VAL, NULL_VAL};
+    if(t->entries != NULL) {
+        memset(t->ctrl, CTRL_EMPTY, t->capacityMask + 1);
     }
     push(vm, NULL_VAL);
     return true;
@@ -1357,72 +2308,53 @@ JSR_NATIVE(jsr_Table_contains) {
         return true;
     }
 
+    uint32_t hash;
     TableEntry* e;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &e)) {
+    if(!findEntry(vm, t, vm->apiStack[1], &hash, &e)) {
         return false;
     }
 
-    push(vm, BOOL_VAL(!IS_NULL(e->key)));
+    push(vm, BOOL_VAL(e != NULL));
     return true;
 }
 
 JSR_NATIVE(jsr_Table_keys) {
     ObjTable* t = AS_TABLE(vm->apiStack[0]);
-    TableEntry* entries = t->entries;
-
-    jsrPushList(vm);
+    ObjList* keys = newList(vm, t->size);
 
-    if(entries != NULL) {
-        for(size_t i = 0; i < t->capacityMask + 1; i++) {
-            if(!IS_NULL(entries[i].key)) {
-                push(vm, entries[i].key);
-                jsrListAppend(vm, -2);
-                jsrPop(vm);
-            }
+    for(size_t i = 0; i < t->numEntries; i++) {
+        if(!IS_NULL(t->entries[i].key)) {
+            keys->arr[keys->size++] = t->entries[i].key;
         }
     }
 
+    push(vm, OBJ_VAL(keys));
     return true;
 }
 
 JSR_NATIVE(jsr_Table_values) {
     ObjTable* t = AS_TABLE(vm->apiStack[0]);
-    TableEntry* entries = t->entries;
-
-    jsrPushList(vm);
+    ObjList* values = newList(vm, t->size);
 
-    if(entries != NULL) {
-        for(size_t i = 0; i < t->capacityMask + 1; i++) {
-            if(!IS_NULL(entries[i].key)) {
-                push(vm, entries[i].val);
-                jsrListAppend(vm, -2);
-                jsrPop(vm);
-            }
+    for(size_t i = 0; i < t->numEntries; i++) {
+        if(!IS_NULL(t->entries[i].key)) {
+            values->arr[values->size++] = t->entries[i].val;
         }
     }
 
+    push(vm, OBJ_VAL(values));
     return true;
 }
 
 JSR_NATIVE(jsr_Table_iter) {
     ObjTable* t = AS_TABLE(vm->apiStack[0]);
 
-    if(IS_NULL(vm->apiStack[1]) && t->entries == NULL) {
-        push(vm, BOOL_VAL(false));
-        return true;
-    }
-
-    size_t lastIdx = 0;
+    size_t i = 0;
     if(IS_NUM(vm->apiStack[1])) {
-        size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
-        if(idx >= t->capacityMask) {
-            push(vm, BOOL_VAL(false));
-            return true;
-        }
-        lastIdx = idx + 1;
+        i = (size_t)AS_NUM(vm->apiStack[1]) + 1;
     }
 
-    for(size_t i = lastIdx; i < t->capacityMask + 1; i++) {
+    for(; i < t->numEntries; i++) {
         if(!IS_NULL(t->entries[i].key)) {
             push(vm, NUM_VAL(i));
             return true;
@@ -1438,7 +2370,7 @@ JSR_NATIVE(jsr_Table_next) {
 
     if(IS_NUM(vm->apiStack[1])) {
         size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
-        if(idx <= t->capacityMask) {
+        if(idx < t->numEntries) {
             push(vm, t->entries[idx].key);
             return true;
         }
@@ -1455,12 +2387,11 @@ JSR_NATIVE(jsr_Table_string) {
     jsrBufferInit(vm, &buf);
     jsrBufferAppendChar(&buf, '{');
 
-    TableEntry* entries = t->entries;
-    if(entries != NULL) {
-        for(size_t i = 0; i < t->capacityMask + 1; i++) {
-            if(IS_NULL(entries[i].key)) continue;
+    if(t->size > 0) {
+        for(size_t i = 0; i < t->numEntries; i++) {
+            if(IS_NULL(t->entries[i].key)) continue;
 
-            push(vm, entries[i].key);
+            push(vm, t->entries[i].key);
             if(jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS || !jsrIsString(vm, -1)) {
                 jsrBufferFree(&buf);
                 return false;
@@ -1469,7 +2400,7 @@ JSR_NATIVE(jsr_Table_string) {
             jsrBufferAppendStr(&buf, " : ");
             jsrPop(vm);
 
-            push(vm, entries[i].val);
+            push(vm, t->entries[i].val);
             if(jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS || !jsrIsString(vm, -1)) {
                 jsrBufferFree(&buf);
                 return false;
@@ -1486,6 +2417,77 @@ JSR_NATIVE(jsr_Table_string) {
 }
 // end
 
+// class WeakTable
+JSR_NATIVE(jsr_WeakTable_new) {
+    return newTableFrom(vm, true);
+}
+// end
+
+// class Generator
+// Used only when a generator is iterated through the methods, the VM resumes them directly in `for`
+JSR_NATIVE(jsr_Generator_iter) {
+    ObjGenerator* gen = AS_GENERATOR(vm->apiStack[0]);
+    if(gen->state == GEN_DONE) {
+        jsrPushBoolean(vm, false);
+        return true;
+    }
+
+    push(vm, OBJ_VAL(gen));
+    if(jsrCall(vm, 0) != JSR_SUCCESS) return false;
+
+    // The generator either yielded, or returned ending the iteration
+    if(gen->state == GEN_DONE) {
+        jsrPushBoolean(vm, false);
+        return true;
+    }
+
+    gen->lastYield = pop(vm);
+    GC_WRITE_BARRIER(vm, gen);
+    jsrPushBoolean(vm, true);
+    return true;
+}
+
+JSR_NATIVE(jsr_Generator_next) {
+    push(vm, AS_GENERATOR(vm->apiStack[0])->lastYield);
+    return true;
+}
+
+JSR_NATIVE(jsr_Generator_isDone) {
+    jsrPushBoolean(vm, AS_GENERATOR(vm->apiStack[0])->state == GEN_DONE);
+    return true;
+}
+
+JSR_NATIVE(jsr_Generator_string) {
+    ObjGenerator* gen = AS_GENERATOR(vm->apiStack[0]);
+    Prototype* proto = &gen->closure->fn->proto;
+
+    JStarBuffer str;
+    jsrBufferInit(vm, &str);
+
+    if(strcmp(proto->module->name->data, JSR_CORE_MODULE) == 0) {
+        jsrBufferAppendf(&str, "<generator %s@%p>", proto->name->data, (void*)gen);
+    } else {
+        jsrBufferAppendf(&str, "<generator %s.%s@%p>", proto->module->name->data,
+                         proto->name->data, (void*)gen);
+    }
+
+    jsrBufferPush(&str);
+    return true;
+}
+// end
+
+// class WeakRef
+JSR_NATIVE(jsr_WeakRef_new) {
+    push(vm, OBJ_VAL(newWeakRef(vm, vm->apiStack[1])));
+    return true;
+}
+
+JSR_NATIVE(jsr_WeakRef_get) {
+    push(vm, AS_WEAKREF(vm->apiStack[0])->referent);
+    return true;
+}
+// end
+
 // class Enum
 #define M_VALUE_NAME "_valueName"
 
@@ -1497,6 +2499,7 @@ static bool checkEnumElem(JStarVM* vm) {
 
     ObjInstance* inst = AS_INSTANCE(vm->apiStack[0]);
     ObjString* enumElem = AS_STRING(peek(vm));
+    stringCString(vm, enumElem);  // Elements become field names, make sure they are terminated
 
     if(isalpha(enumElem->data[0])) {
         for(size_t i = 1; i < enumElem->length; i++) {
@@ -1507,7 +2510,7 @@ static bool checkEnumElem(JStarVM* vm) {
             }
         }
 
-        if(hashTableContainsKey(&inst->fields, enumElem)) {
+        if(instanceHasField(inst, enumElem)) {
             JSR_RAISE(vm, "InvalidArgException", "Duplicate Enum element `%s`", enumElem->data);
         }
 
@@ -1639,37 +2642,33 @@ JSR_NATIVE(jsr_ascii) {
 }
 
 JSR_NATIVE(jsr_print) {
-    jsrPushValue(vm, 1);
-    if(jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS) return false;
-    if(!jsrIsString(vm, -1)) {
-        JSR_RAISE(vm, "TypeException", "s.__string__() didn't return a String");
-    }
+    // The whole line is formatted first and then written with a single call, so that stdout is
+    // locked only once. Output is still buffered by stdout itself, shared with `io.stdout`
+    JStarBuffer line;
+    jsrBufferInit(vm, &line);
 
-    fwrite(jsrGetString(vm, -1), 1, jsrGetStringSz(vm, -1), stdout);
-    jsrPop(vm);
+    if(!bufferAppendValue(vm, &line, vm->apiStack[1])) {
+        jsrBufferFree(&line);
+        return false;
+    }
 
     JSR_FOREACH(2, {
-        if(jsrCallMethod(vm, "__string__", 0) != JSR_SUCCESS) return false;
-        if(!jsrIsString(vm, -1)) {
-            JSR_RAISE(vm, "TypeException", "__string__() didn't return a String");
+        jsrBufferAppendChar(&line, ' ');
+        if(!bufferAppendValue(vm, &line, pop(vm))) {
+            jsrBufferFree(&line);
+            return false;
         }
-        
-        printf(" ");
-        fwrite(jsrGetString(vm, -1), 1, jsrGetStringSz(vm, -1), stdout);
-        jsrPop(vm);
-    },);
+    },
+    jsrBufferFree(&line))
 
-    printf("\n");
+    jsrBufferAppendChar(&line, '\n');
+    fwrite(line.data, 1, line.size, stdout);
+    jsrBufferFree(&line);
 
     jsrPushNull(vm);
     return true;
 }
 
-static void parseError(const char* file, int line, const char* error, void* udata) {
-    JStarVM* vm = udata;
-    vm->errorCallback(vm, JSR_SYNTAX_ERR, file, line, error);
-}
-
 JSR_NATIVE(jsr_eval) {
     JSR_CHECK(String, 1, "source");
 
@@ -1677,14 +2676,10 @@ JSR_NATIVE(jsr_eval) {
         JSR_RAISE(vm, "Exception", "eval() can only be called by another function");
     }
 
-    JStarStmt* program = jsrParse("<eval>", jsrGetString(vm, 1), parseError, vm);
-    if(program == NULL) {
-        JSR_RAISE(vm, "SyntaxException", "Syntax error");
-    }
-
+    JStarResult err;
     Prototype* proto = getPrototype(vm->frames[vm->frameCount - 2].fn);
-    ObjFunction* fn = compileModule(vm, "<eval>", proto->module->name, program);
-    jsrStmtFree(program);
+    ObjFunction* fn = compileModuleSource(vm, "<eval>", proto->module->name, jsrGetString(vm, 1),
+                                          &err);
 
     if(fn == NULL) {
         JSR_RAISE(vm, "SyntaxException", "Syntax error");
@@ -1714,20 +2709,21 @@ JSR_NATIVE(jsr_type) {
 // class Exception
 #define INDENT "    "
 
-static bool recordEquals(FrameRecord* f1, FrameRecord* f2) {
-    return f1 && f2 && (strcmp(f1->moduleName->data, f2->moduleName->data) == 0) &&
-           (strcmp(f1->funcName->data, f2->funcName->data) == 0) && (f1->line == f2->line);
+static bool recordEquals(const FrameInfo* f1, const FrameInfo* f2) {
+    return f1 && f2 && (strcmp(f1->moduleName, f2->moduleName) == 0) &&
+           (strcmp(f1->funcName, f2->funcName) == 0) && (f1->line == f2->line) &&
+           (f1->tailCalls == f2->tailCalls);
 }
 
 JSR_NATIVE(jsr_Exception_printStacktrace) {
     ObjInstance* exc = AS_INSTANCE(vm->apiStack[0]);
 
     Value stacktraceVal = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stacktraceVal);
+    instanceGetField(exc, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stacktraceVal);
 
     if(IS_STACK_TRACE(stacktraceVal)) {
         Value cause = NULL_VAL;
-        hashTableGet(&exc->fields, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
+        instanceGetField(exc, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
 
         if(isInstance(vm, cause, vm->excClass)) {
             push(vm, cause);
@@ -1740,16 +2736,16 @@ JSR_NATIVE(jsr_Exception_printStacktrace) {
         ObjStackTrace* stacktrace = AS_STACK_TRACE(stacktraceVal);
 
         if(stacktrace->recordSize > 0) {
-            FrameRecord* lastRecord = NULL;
+            FrameInfo last, *lastRecord = NULL;
 
             fprintf(stderr, "Traceback (most recent call last):\n");
             for(int i = stacktrace->recordSize - 1; i >= 0; i--) {
-                FrameRecord* record = &stacktrace->records[i];
+                FrameInfo info = stacktraceFrameInfo(&stacktrace->records[i]), *record = &info;
 
                 if(recordEquals(lastRecord, record)) {
                     int repetitions = 1;
                     while(i > 0) {
-                        record = &stacktrace->records[i - 1];
+                        info = stacktraceFrameInfo(&stacktrace->records[i - 1]);
                         if(!recordEquals(lastRecord, record)) break;
                         repetitions++, i--;
                     }
@@ -1758,6 +2754,10 @@ JSR_NATIVE(jsr_Exception_printStacktrace) {
                     continue;
                 }
 
+                if(record->tailCalls > 0) {
+                    fprintf(stderr, INDENT "[%d frames elided by tail calls]\n", record->tailCalls);
+                }
+
                 fprintf(stderr, INDENT);
 
                 if(record->line >= 0) {
@@ -1765,19 +2765,20 @@ JSR_NATIVE(jsr_Exception_printStacktrace) {
                 } else {
                     fprintf(stderr, "[line ?]");
                 }
-                fprintf(stderr, " module %s in %s\n", record->moduleName->data,
-                        record->funcName->data);
+                fprintf(stderr, " module %s in %s\n", record->moduleName, record->funcName);
 
-                lastRecord = record;
+                last = info;
+                lastRecord = &last;
             }
         }
     }
 
     Value err = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
+    instanceGetField(exc, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
 
     if(IS_STRING(err) && AS_STRING(err)->length > 0) {
-        fprintf(stderr, "%s: %s\n", exc->base.cls->name->data, AS_STRING(err)->data);
+        const char* msg = stringCString(vm, AS_STRING(err));
+        fprintf(stderr, "%s: %s\n", exc->base.cls->name->data, msg);
     } else {
         fprintf(stderr, "%s\n", exc->base.cls->name->data);
     }
@@ -1793,11 +2794,11 @@ JSR_NATIVE(jsr_Exception_getStacktrace) {
     jsrBufferInitCapacity(vm, &buf, 64);
 
     Value stval = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stval);
+    instanceGetField(exc, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stval);
 
     if(IS_STACK_TRACE(stval)) {
         Value cause = NULL_VAL;
-        hashTableGet(&exc->fields, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
+        instanceGetField(exc, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
 
         if(isInstance(vm, cause, vm->excClass)) {
             push(vm, cause);
@@ -1814,16 +2815,16 @@ JSR_NATIVE(jsr_Exception_getStacktrace) {
         ObjStackTrace* stacktrace = AS_STACK_TRACE(stval);
 
         if(stacktrace->recordSize > 0) {
-            FrameRecord* lastRecord = NULL;
+            FrameInfo last, *lastRecord = NULL;
 
             jsrBufferAppendf(&buf, "Traceback (most recent call last):\n");
             for(int i = stacktrace->recordSize - 1; i >= 0; i--) {
-                FrameRecord* record = &stacktrace->records[i];
+                FrameInfo info = stacktraceFrameInfo(&stacktrace->records[i]), *record = &info;
 
                 if(recordEquals(lastRecord, record)) {
                     int repetitions = 1;
                     while(i > 0) {
-                        record = &stacktrace->records[i - 1];
+                        info = stacktraceFrameInfo(&stacktrace->records[i - 1]);
                         if(!recordEquals(lastRecord, record)) break;
                         repetitions++, i--;
                     }
@@ -1833,6 +2834,11 @@ JSR_NATIVE(jsr_Exception_getStacktrace) {
                     continue;
                 }
 
+                if(record->tailCalls > 0) {
+                    jsrBufferAppendf(&buf, INDENT "[%d frames elided by tail calls]\n",
+                                     record->tailCalls);
+                }
+
                 jsrBufferAppendStr(&buf, "    ");
 
                 if(record->line >= 0) {
@@ -1841,19 +2847,21 @@ JSR_NATIVE(jsr_Exception_getStacktrace) {
                     jsrBufferAppendStr(&buf, "[line ?]");
                 }
 
-                jsrBufferAppendf(&buf, " module %s in %s\n", record->moduleName->data,
-                                 record->funcName->data);
+                jsrBufferAppendf(&buf, " module %s in %s\n", record->moduleName,
+                                 record->funcName);
 
-                lastRecord = record;
+                last = info;
+                lastRecord = &last;
             }
         }
     }
 
     Value err = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
+    instanceGetField(exc, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
 
     if(IS_STRING(err) && AS_STRING(err)->length > 0) {
-        jsrBufferAppendf(&buf, "%s: %s", exc->base.cls->name->data, AS_STRING(err)->data);
+        const char* msg = stringCString(vm, AS_STRING(err));
+        jsrBufferAppendf(&buf, "%s: %s", exc->base.cls->name->data, msg);
     } else {
         jsrBufferAppendf(&buf, "%s", exc->base.cls->name->data);
     }
@@ -1,7 +1,11 @@
 #ifndef CORE_H
 #define CORE_H
 
+#include <stdbool.h>
+
 #include "jstar.h"
+#include "object.h"
+#include "value.h"
 
 // Excepttion class fields
 #define EXC_ERR   "_err"
@@ -11,6 +15,15 @@
 // J* core module bootstrap
 void initCoreModule(JStarVM* vm);
 
+// Sets `out` to the value associated with `key` in a Table, or to null if the key is not present.
+// Returns false if hashing or comparing the key raised an exception.
+// The key must not be null.
+bool tableGet(JStarVM* vm, ObjTable* t, Value key, Value* out);
+// Insert or overwrite `key` in a Table, `inserted` is set to whether the key was new.
+// Returns false if hashing or comparing the key raised an exception.
+// The key must not be null.
+bool tableSet(JStarVM* vm, ObjTable* t, Value key, Value val, bool* inserted);
+
 // J* core module native functions and methods
 
 // class Number
@@ -50,10 +63,13 @@ JSR_NATIVE(jsr_Iterable_join);
 // class List
 JSR_NATIVE(jsr_List_new);
 JSR_NATIVE(jsr_List_add);
+JSR_NATIVE(jsr_List_extend);
 JSR_NATIVE(jsr_List_insert);
 JSR_NATIVE(jsr_List_removeAt);
 JSR_NATIVE(jsr_List_clear);
+JSR_NATIVE(jsr_List_reserve);
 JSR_NATIVE(jsr_List_sort);
+JSR_NATIVE(jsr_List_sum);
 JSR_NATIVE(jsr_List_len);
 JSR_NATIVE(jsr_List_plus);
 JSR_NATIVE(jsr_List_eq);
@@ -66,6 +82,7 @@ JSR_NATIVE(jsr_Tuple_new);
 JSR_NATIVE(jsr_Tuple_len);
 JSR_NATIVE(jsr_Tuple_add);
 JSR_NATIVE(jsr_Tuple_eq);
+JSR_NATIVE(jsr_Tuple_sum);
 JSR_NATIVE(jsr_Tuple_iter);
 JSR_NATIVE(jsr_Tuple_next);
 JSR_NATIVE(jsr_Tuple_hash);
@@ -77,6 +94,10 @@ JSR_NATIVE(jsr_String_charAt);
 JSR_NATIVE(jsr_String_startsWith);
 JSR_NATIVE(jsr_String_endsWith);
 JSR_NATIVE(jsr_String_split);
+JSR_NATIVE(jsr_String_find);
+JSR_NATIVE(jsr_String_rfind);
+JSR_NATIVE(jsr_String_count);
+JSR_NATIVE(jsr_String_replace);
 JSR_NATIVE(jsr_String_strip);
 JSR_NATIVE(jsr_String_chomp);
 JSR_NATIVE(jsr_String_escaped);
@@ -105,6 +126,22 @@ JSR_NATIVE(jsr_Table_next);
 JSR_NATIVE(jsr_Table_string);
 // end
 
+// class WeakTable
+JSR_NATIVE(jsr_WeakTable_new);
+// end
+
+// class Generator
+JSR_NATIVE(jsr_Generator_iter);
+JSR_NATIVE(jsr_Generator_next);
+JSR_NATIVE(jsr_Generator_isDone);
+JSR_NATIVE(jsr_Generator_string);
+// end
+
+// class WeakRef
+JSR_NATIVE(jsr_WeakRef_new);
+JSR_NATIVE(jsr_WeakRef_get);
+// end
+
 // class Enum
 JSR_NATIVE(jsr_Enum_new);
 JSR_NATIVE(jsr_Enum_value);
@@ -1,11 +1,17 @@
 #include "debug.h"
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "code.h"
 #include "disassemble.h"
 #include "hashtable.h"
 #include "object.h"
+#include "opcode.h"
+#include "opstats.h"
+#include "serialize.h"
 #include "value.h"
 #include "vm.h"
 
@@ -45,9 +51,220 @@ JSR_NATIVE(jsr_disassemble) {
     if(IS_NATIVE(arg)) {
         disassembleNative(AS_NATIVE(arg));
     } else {
-        disassembleFunction(AS_CLOSURE(arg)->fn);
+        ObjFunction* fn = AS_CLOSURE(arg)->fn;
+        if(fn->lazy.data && !deserializeLazyBody(vm, fn)) return false;
+        disassembleFunction(fn);
     }
 
     jsrPushNull(vm);
     return true;
 }
+
+JSR_NATIVE(jsr_cacheStats) {
+    Value arg = vm->apiStack[1];
+    if(IS_BOUND_METHOD(arg)) {
+        arg = OBJ_VAL(AS_BOUND_METHOD(arg)->method);
+    }
+
+    if(!IS_CLOSURE(arg)) {
+        JSR_RAISE(vm, "InvalidArgException", "Cannot get inline cache stats of a %s",
+                  getClass(vm, arg)->name->data);
+    }
+
+    Code* code = &AS_CLOSURE(arg)->fn->code;
+    uint64_t hits = 0, misses = 0;
+    for(size_t i = 0; i < code->cacheCount; i++) {
+        hits += code->caches[i].hits;
+        misses += code->caches[i].misses;
+    }
+
+    jsrPushNumber(vm, (double)hits);
+    jsrPushNumber(vm, (double)misses);
+    jsrPushTuple(vm, 2);
+    return true;
+}
+
+JSR_NATIVE(jsr_captureStacktrace) {
+    Value arg = vm->apiStack[1];
+    JSR_CHECK(Boolean, 2, "enabled");
+
+    bool isException = false;
+    if(IS_CLASS(arg)) {
+        for(ObjClass* cls = AS_CLASS(arg); cls != NULL; cls = cls->superCls) {
+            if(cls == vm->excClass) isException = true;
+        }
+    }
+
+    if(!isException) {
+        ObjClass* cls = IS_CLASS(arg) ? AS_CLASS(arg) : getClass(vm, arg);
+        JSR_RAISE(vm, "InvalidArgException", "%s is not an Exception class", cls->name->data);
+    }
+
+    AS_CLASS(arg)->noStacktrace = !jsrGetBoolean(vm, 2);
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_importStats) {
+    const ImportCache* cache = &vm->importCache;
+    jsrPushNumber(vm, (double)cache->imports);
+    jsrPushNumber(vm, (double)cache->probes);
+    jsrPushNumber(vm, (double)cache->skipped);
+    jsrPushTuple(vm, 3);
+    return true;
+}
+
+JSR_NATIVE(jsr_importTimes) {
+    if(!vm->traceImports) {
+        JSR_RAISE(vm, "NotImplementedException", "Imports are not traced by this VM");
+    }
+
+    const HashTable* modules = &vm->modules;
+    jsrPushTable(vm);
+    for(const Entry* e = modules->entries; e < modules->entries + modules->sizeMask + 1; e++) {
+        if(!e->key) continue;
+        ObjModule* module = AS_MODULE(e->value);
+        if(module->lazy || module->importTime == 0) continue;
+
+        push(vm, OBJ_VAL(e->key));
+        jsrPushNumber(vm, module->importSelfTime);
+        jsrPushNumber(vm, module->importTime);
+        jsrPushTuple(vm, 2);
+        if(!jsrSubscriptSet(vm, -3)) return false;
+        jsrPop(vm);
+    }
+
+    return true;
+}
+
+static bool setStat(JStarVM* vm, const char* name, double value) {
+    jsrPushString(vm, name);
+    jsrPushNumber(vm, value);
+    if(!jsrSubscriptSet(vm, -3)) return false;
+    jsrPop(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_gcStats) {
+    JStarGCStats stats;
+    jsrGetGCStats(vm, &stats);
+
+    jsrPushTable(vm);
+    if(!setStat(vm, "allocated", stats.allocated)) return false;
+    if(!setStat(vm, "nextGC", stats.nextGC)) return false;
+    if(!setStat(vm, "memoryLimit", stats.memoryLimit)) return false;
+    if(!setStat(vm, "fullCollections", stats.fullCollections)) return false;
+    if(!setStat(vm, "minorCollections", stats.minorCollections)) return false;
+    if(!setStat(vm, "bytesFreed", stats.bytesFreed)) return false;
+    if(!setStat(vm, "totalPause", stats.totalPause)) return false;
+    if(!setStat(vm, "maxPause", stats.maxPause)) return false;
+
+    jsrPushString(vm, "pauses");
+    jsrPushList(vm);
+    for(int i = 0; i < JSR_GC_PAUSE_BUCKETS; i++) {
+        jsrPushNumber(vm, stats.pauses[i]);
+        jsrListAppend(vm, -2);
+        jsrPop(vm);
+    }
+    if(!jsrSubscriptSet(vm, -3)) return false;
+    jsrPop(vm);
+
+    jsrPushString(vm, "objects");
+    jsrPushTable(vm);
+    for(size_t i = 0; i < stats.objTypeCount; i++) {
+        const JStarObjStats* obj = &stats.objects[i];
+        jsrPushString(vm, obj->type);
+        jsrPushNumber(vm, obj->allocations);
+        jsrPushNumber(vm, obj->bytes);
+        jsrPushNumber(vm, obj->live);
+        jsrPushTuple(vm, 3);
+        if(!jsrSubscriptSet(vm, -3)) return false;
+        jsrPop(vm);
+    }
+    if(!jsrSubscriptSet(vm, -3)) return false;
+    jsrPop(vm);
+
+    return true;
+}
+
+JSR_NATIVE(jsr_startProfiler) {
+    JSR_CHECK(Int, 1, "interval");
+    double interval = jsrGetNumber(vm, 1);
+    if(interval <= 0 || interval > INT_MAX) {
+        JSR_RAISE(vm, "InvalidArgException", "Invalid sampling interval: %g", interval);
+    }
+    if(!jsrStartProfiler(vm, (int)interval)) {
+        JSR_RAISE(vm, "Exception", "Cannot start the profiler");
+    }
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_stopProfiler) {
+    jsrStopProfiler(vm);
+    JStarBuffer profile;
+    jsrBufferInit(vm, &profile);
+    jsrGetProfile(vm, &profile);
+    jsrBufferPush(&profile);
+    return true;
+}
+
+JSR_NATIVE(jsr_opcodeStats) {
+#ifdef JSTAR_OPCODE_STATS
+    const OpcodeStats* s = &vm->opStats;
+    jsrPushTable(vm);
+
+    jsrPushString(vm, "opcodes");
+    jsrPushTable(vm);
+    for(int i = 0; i < OPCODE_COUNT; i++) {
+        if(s->counts[i] && !setStat(vm, OpcodeNames[i], s->counts[i])) return false;
+    }
+    if(!jsrSubscriptSet(vm, -3)) return false;
+    jsrPop(vm);
+
+    jsrPushString(vm, "pairs");
+    jsrPushTable(vm);
+    for(int i = 0; i < OPCODE_COUNT; i++) {
+        if(i == OP_END) continue;
+        for(int j = 0; j < OPCODE_COUNT; j++) {
+            if(!s->pairs[i][j]) continue;
+            jsrPushString(vm, OpcodeNames[i]);
+            jsrPushString(vm, OpcodeNames[j]);
+            jsrPushTuple(vm, 2);
+            jsrPushNumber(vm, s->pairs[i][j]);
+            if(!jsrSubscriptSet(vm, -3)) return false;
+            jsrPop(vm);
+        }
+    }
+    if(!jsrSubscriptSet(vm, -3)) return false;
+    jsrPop(vm);
+
+    size_t count;
+    Prototype** fns = collectFunctionStats(vm, &count);
+
+    jsrPushString(vm, "functions");
+    jsrPushList(vm);
+    for(size_t i = 0; i < count; i++) {
+        Prototype* proto = fns[i];
+        push(vm, OBJ_VAL(proto->module->name));
+        if(proto->name) {
+            push(vm, OBJ_VAL(proto->name));
+        } else {
+            jsrPushString(vm, "<main>");
+        }
+        jsrPushNumber(vm, proto->calls);
+        jsrPushNumber(vm, proto->selfTime);
+        jsrPushTuple(vm, 4);
+        jsrListAppend(vm, -2);
+        jsrPop(vm);
+    }
+    free(fns);
+
+    if(!jsrSubscriptSet(vm, -3)) return false;
+    jsrPop(vm);
+
+    return true;
+#else
+    JSR_RAISE(vm, "NotImplementedException", "J* has been built without JSTAR_OPCODE_STATS");
+#endif
+}
@@ -5,5 +5,13 @@
 
 JSR_NATIVE(jsr_printStack);
 JSR_NATIVE(jsr_disassemble);
+JSR_NATIVE(jsr_cacheStats);
+JSR_NATIVE(jsr_captureStacktrace);
+JSR_NATIVE(jsr_importStats);
+JSR_NATIVE(jsr_importTimes);
+JSR_NATIVE(jsr_gcStats);
+JSR_NATIVE(jsr_startProfiler);
+JSR_NATIVE(jsr_stopProfiler);
+JSR_NATIVE(jsr_opcodeStats);
 
 #endif
@@ -0,0 +1,425 @@
+#include "event.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "conf.h"
+
+#if defined(JSTAR_POSIX)
+    #include <fcntl.h>
+    #include <math.h>
+    #include <netdb.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <spawn.h>
+    #include <sys/socket.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <time.h>
+    #include <unistd.h>
+
+extern char** environ;
+#endif
+
+#if defined(JSTAR_POSIX)
+
+// static helper functions
+
+static bool setNonBlocking(int fd, bool nonBlocking) {
+    int flags = fcntl(fd, F_GETFL);
+    if(flags == -1) return false;
+    flags = nonBlocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    return fcntl(fd, F_SETFL, flags) != -1;
+}
+
+// Descriptors created by the module are non-blocking, and are not inherited by child processes
+static bool initFd(int fd) {
+    return setNonBlocking(fd, true) && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+static bool checkFd(JStarVM* vm, int slot, const char* name, int* fd) {
+    if(!jsrCheckInt(vm, slot, name)) return false;
+    double num = jsrGetNumber(vm, slot);
+    if(num < 0 || num > INT32_MAX) {
+        JSR_RAISE(vm, "InvalidArgException", "Invalid file descriptor %g", num);
+    }
+    *fd = (int)num;
+    return true;
+}
+
+// Adds a pollfd for every key of the Table at `slot`
+static bool addPollFds(JStarVM* vm, int slot, short events, struct pollfd* fds, size_t* count) {
+    JSR_FOREACH(
+        slot, {
+            int fd;
+            if(!checkFd(vm, -1, "fd", &fd)) return false;
+            fds[*count].fd = fd;
+            fds[*count].events = events;
+            (*count)++;
+            jsrPop(vm);
+        }, );
+    return true;
+}
+
+static bool isReady(const struct pollfd* pfd) {
+    // Errors and hang ups are reported as readiness, so that the following read or
+    // write returns them
+    return pfd->revents & (pfd->events | POLLERR | POLLHUP | POLLNVAL);
+}
+
+static bool getAddrInfo(JStarVM* vm, bool passive, struct addrinfo** res) {
+    JSR_CHECK(Int, 2, "port");
+    const char* host = NULL;
+    if(!jsrIsNull(vm, 1)) {
+        JSR_CHECK(String, 1, "host");
+        host = jsrGetString(vm, 1);
+    }
+
+    char port[16];
+    snprintf(port, sizeof(port), "%d", (int)jsrGetNumber(vm, 2));
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    int err = getaddrinfo(host, port, &hints, res);
+    if(err) {
+        JSR_RAISE(vm, "IOException", "%s:%s: %s", host ? host : "*", port, gai_strerror(err));
+    }
+    return true;
+}
+
+// Functions
+
+JSR_NATIVE(jsr_event_now) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    jsrPushNumber(vm, ts.tv_sec + ts.tv_nsec / 1e9);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_poll) {
+    JSR_CHECK(Table, 1, "readers");
+    JSR_CHECK(Table, 2, "writers");
+    JSR_CHECK(Number, 3, "timeout");
+
+    size_t size = jsrGetLength(vm, 1) + jsrGetLength(vm, 2);
+    struct pollfd* fds = jsrPushUserdata(vm, sizeof(struct pollfd) * (size ? size : 1), NULL);
+
+    size_t count = 0;
+    if(!addPollFds(vm, 1, POLLIN, fds, &count)) return false;
+    size_t readers = count;
+    if(!addPollFds(vm, 2, POLLOUT, fds, &count)) return false;
+
+    double timeout = jsrGetNumber(vm, 3);
+    int ms = timeout < 0 ? -1 : (int)ceil(timeout * 1000);
+
+    // Interrupted polls return no events, the loop will simply poll again
+    int res = poll(fds, count, ms);
+    if(res < 0 && errno != EINTR) JSR_RAISE(vm, "IOException", strerror(errno));
+
+    jsrPushList(vm);
+    jsrPushList(vm);
+    for(size_t i = 0; res > 0 && i < count; i++) {
+        if(isReady(&fds[i])) {
+            jsrPushNumber(vm, fds[i].fd);
+            jsrListAppend(vm, i < readers ? -3 : -2);
+            jsrPop(vm);
+        }
+    }
+    jsrPushTuple(vm, 2);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_read) {
+    int fd;
+    if(!checkFd(vm, 1, "fd", &fd)) return false;
+    JSR_CHECK(Int, 2, "size");
+
+    double size = jsrGetNumber(vm, 2);
+    if(size <= 0) JSR_RAISE(vm, "InvalidArgException", "size must be > 0");
+
+    JStarBuffer data;
+    jsrBufferInitCapacity(vm, &data, size);
+
+    ssize_t n;
+    do {
+        n = read(fd, data.data, size);
+    } while(n < 0 && errno == EINTR);
+
+    if(n < 0) {
+        jsrBufferFree(&data);
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            jsrPushNull(vm);
+            return true;
+        }
+        JSR_RAISE(vm, "IOException", strerror(errno));
+    }
+
+    data.size = n;
+    jsrBufferPush(&data);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_write) {
+    int fd;
+    if(!checkFd(vm, 1, "fd", &fd)) return false;
+    JSR_CHECK(String, 2, "data");
+
+    ssize_t n;
+    do {
+        n = write(fd, jsrGetString(vm, 2), jsrGetStringSz(vm, 2));
+    } while(n < 0 && errno == EINTR);
+
+    if(n < 0) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK) {
+            JSR_RAISE(vm, "IOException", strerror(errno));
+        }
+        n = 0;
+    }
+
+    jsrPushNumber(vm, n);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_close) {
+    int fd;
+    if(!checkFd(vm, 1, "fd", &fd)) return false;
+    if(close(fd) == -1 && errno != EINTR) JSR_RAISE(vm, "IOException", strerror(errno));
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_setNonBlocking) {
+    int fd;
+    if(!checkFd(vm, 1, "fd", &fd)) return false;
+    JSR_CHECK(Boolean, 2, "nonBlocking");
+    if(!setNonBlocking(fd, jsrGetBoolean(vm, 2))) JSR_RAISE(vm, "IOException", strerror(errno));
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_connect) {
+    struct addrinfo* addrs;
+    if(!getAddrInfo(vm, false, &addrs)) return false;
+
+    int fd = -1, err = 0;
+    for(struct addrinfo* a = addrs; a != NULL; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if(fd == -1) {
+            err = errno;
+            continue;
+        }
+        if(initFd(fd) && (connect(fd, a->ai_addr, a->ai_addrlen) == 0 || errno == EINPROGRESS)) {
+            break;
+        }
+        err = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+
+    if(fd == -1) JSR_RAISE(vm, "IOException", strerror(err));
+    jsrPushNumber(vm, fd);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_listen) {
+    JSR_CHECK(Int, 3, "backlog");
+
+    struct addrinfo* addrs;
+    if(!getAddrInfo(vm, true, &addrs)) return false;
+
+    int fd = -1, err = 0, on = 1;
+    for(struct addrinfo* a = addrs; a != NULL; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if(fd == -1) {
+            err = errno;
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(initFd(fd) && bind(fd, a->ai_addr, a->ai_addrlen) == 0 &&
+           listen(fd, (int)jsrGetNumber(vm, 3)) == 0) {
+            break;
+        }
+        err = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+
+    if(fd == -1) JSR_RAISE(vm, "IOException", strerror(err));
+    jsrPushNumber(vm, fd);
+    return true;
+}
+
+JSR_NATIVE(jsr_event_accept) {
+    int fd;
+    if(!checkFd(vm, 1, "fd", &fd)) return false;
+
+    int conn;
+    do {
+        conn = accept(fd, NULL, NULL);
+    } while(conn < 0 && errno == EINTR);
+
+    if(conn < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            jsrPushNull(vm);
+            return true;
+        }
+        JSR_RAISE(vm, "IOException", strerror(errno));
+    }
+
+    if(!initFd(conn)) {
+        int err = errno;
+        close(conn);
+        JSR_RAISE(vm, "IOException", strerror(err));
+    }
+
+    jsrPushNumber(vm, conn);
+    return true;
+}
+
+// class Process
+#define M_PROC_PID    "pid"
+#define M_PROC_STDIN  "stdin"
+#define M_PROC_STDOUT "stdout"
+#define M_PROC_STDERR "stderr"
+#define M_PROC_RETURN "returnCode"
+
+static void closePipes(int (*pipes)[2], int count) {
+    for(int i = 0; i < count; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+}
+
+JSR_NATIVE(jsr_Process_new) {
+    JSR_CHECK(String, 1, "cmd");
+
+    // stdin, stdout and stderr of the child
+    int pipes[3][2];
+    for(int i = 0; i < 3; i++) {
+        if(pipe(pipes[i]) == -1) {
+            int err = errno;
+            closePipes(pipes, i);
+            JSR_RAISE(vm, "IOException", strerror(err));
+        }
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipes[0][0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipes[1][1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipes[2][1], STDERR_FILENO);
+
+    // The parent's ends shouldn't leak into the child (or other children)
+    bool ok = initFd(pipes[0][1]) && initFd(pipes[1][0]) && initFd(pipes[2][0]);
+
+    pid_t pid;
+    char* argv[] = {"/bin/sh", "-c", (char*)jsrGetString(vm, 1), NULL};
+    int err = ok ? posix_spawn(&pid, "/bin/sh", &actions, NULL, argv, environ) : errno;
+    posix_spawn_file_actions_destroy(&actions);
+
+    close(pipes[0][0]);
+    close(pipes[1][1]);
+    close(pipes[2][1]);
+
+    if(err) {
+        close(pipes[0][1]);
+        close(pipes[1][0]);
+        close(pipes[2][0]);
+        JSR_RAISE(vm, "IOException", "%s: %s", jsrGetString(vm, 1), strerror(err));
+    }
+
+    jsrPushNumber(vm, pid);
+    jsrSetField(vm, 0, M_PROC_PID);
+    jsrPushNumber(vm, pipes[0][1]);
+    jsrSetField(vm, 0, M_PROC_STDIN);
+    jsrPushNumber(vm, pipes[1][0]);
+    jsrSetField(vm, 0, M_PROC_STDOUT);
+    jsrPushNumber(vm, pipes[2][0]);
+    jsrSetField(vm, 0, M_PROC_STDERR);
+    jsrPushNull(vm);
+    jsrSetField(vm, 0, M_PROC_RETURN);
+
+    jsrPushValue(vm, 0);
+    return true;
+}
+
+// Waits for the process and sets its return code. Pushes the return code, or null if the
+// process is still running and `block` is false
+static bool waitProcess(JStarVM* vm, bool block) {
+    if(!jsrGetField(vm, 0, M_PROC_RETURN)) return false;
+    if(!jsrIsNull(vm, -1)) return true;
+
+    if(!jsrGetField(vm, 0, M_PROC_PID)) return false;
+    JSR_CHECK(Int, -1, M_PROC_PID);
+    pid_t pid = (pid_t)jsrGetNumber(vm, -1);
+
+    int status;
+    pid_t res;
+    do {
+        res = waitpid(pid, &status, block ? 0 : WNOHANG);
+    } while(res < 0 && errno == EINTR);
+
+    if(res < 0) JSR_RAISE(vm, "IOException", strerror(errno));
+    if(res == 0) {
+        jsrPushNull(vm);
+        return true;
+    }
+
+    // Killed processes return the negated signal number
+    jsrPushNumber(vm, WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status));
+    jsrSetField(vm, 0, M_PROC_RETURN);
+    return true;
+}
+
+JSR_NATIVE(jsr_Process_poll) {
+    return waitProcess(vm, false);
+}
+
+JSR_NATIVE(jsr_Process_wait) {
+    return waitProcess(vm, true);
+}
+
+JSR_NATIVE(jsr_Process_kill) {
+    JSR_CHECK(Int, 1, "signal");
+    if(!jsrGetField(vm, 0, M_PROC_PID)) return false;
+    JSR_CHECK(Int, -1, M_PROC_PID);
+
+    pid_t pid = (pid_t)jsrGetNumber(vm, -1);
+    if(kill(pid, (int)jsrGetNumber(vm, 1)) == -1) {
+        JSR_RAISE(vm, "IOException", strerror(errno));
+    }
+
+    jsrPushNull(vm);
+    return true;
+}
+// end
+
+#else
+
+#define NOT_SUPPORTED(name)                                                         \
+    JSR_NATIVE(name) {                                                              \
+        JSR_RAISE(vm, "NotImplementedException", "Events not supported on current system."); \
+    }
+
+NOT_SUPPORTED(jsr_event_now)
+NOT_SUPPORTED(jsr_event_poll)
+NOT_SUPPORTED(jsr_event_read)
+NOT_SUPPORTED(jsr_event_write)
+NOT_SUPPORTED(jsr_event_close)
+NOT_SUPPORTED(jsr_event_setNonBlocking)
+NOT_SUPPORTED(jsr_event_connect)
+NOT_SUPPORTED(jsr_event_listen)
+NOT_SUPPORTED(jsr_event_accept)
+NOT_SUPPORTED(jsr_Process_new)
+NOT_SUPPORTED(jsr_Process_poll)
+NOT_SUPPORTED(jsr_Process_wait)
+NOT_SUPPORTED(jsr_Process_kill)
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "jstar.h"
+
+JSR_NATIVE(jsr_event_now);
+JSR_NATIVE(jsr_event_poll);
+JSR_NATIVE(jsr_event_read);
+JSR_NATIVE(jsr_event_write);
+JSR_NATIVE(jsr_event_close);
+JSR_NATIVE(jsr_event_setNonBlocking);
+JSR_NATIVE(jsr_event_connect);
+JSR_NATIVE(jsr_event_listen);
+JSR_NATIVE(jsr_event_accept);
+
+// class Process
+JSR_NATIVE(jsr_Process_new);
+JSR_NATIVE(jsr_Process_poll);
+JSR_NATIVE(jsr_Process_wait);
+JSR_NATIVE(jsr_Process_kill);
+// end Process
+
+#endif
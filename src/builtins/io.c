@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "mapfile.h"
 #include "util.h"
 
 #if defined(JSTAR_POSIX)
@@ -20,6 +21,8 @@
 #define JSR_SEEK_CUR 1
 #define JSR_SEEK_END 2
 
+#define READ_CHUNK_SIZE          (16 * 1024)
+
 // static helper functions
 
 static bool readline(JStarVM* vm, FILE* file) {
@@ -205,17 +208,29 @@ JSR_NATIVE(jsr_File_readAll) {
 
     FILE* f = (FILE*)jsrGetHandle(vm, -1);
 
+    // If the size of the file is known read its remaining content directly into the buffer
+    size_t remaining = 0;
+    long pos = ftell(f);
+    if(pos != -1 && fseek(f, 0, SEEK_END) == 0) {
+        long end = ftell(f);
+        if(end > pos) remaining = end - pos;
+        if(fseek(f, pos, SEEK_SET) != 0) {
+            JSR_RAISE(vm, "IOException", strerror(errno));
+        }
+    }
+
     JStarBuffer data;
-    jsrBufferInitCapacity(vm, &data, 512);
+    jsrBufferInitCapacity(vm, &data, remaining + 1);
 
-    size_t read;
-    char buf[4096];
-    while((read = fread(buf, 1, sizeof(buf), f)) == sizeof(buf)) {
-        jsrBufferAppend(&data, buf, read);
-    }
+    size_t read = fread(data.data, 1, remaining, f);
+    data.size = read;
 
-    if(feof(f) && read > 0) {
-        jsrBufferAppend(&data, buf, read);
+    // Read what's left in chunks, as the file may not be seekable or it may have grown
+    if(read == remaining) {
+        char buf[READ_CHUNK_SIZE];
+        while((read = fread(buf, 1, sizeof(buf), f)) > 0) {
+            jsrBufferAppend(&data, buf, read);
+        }
     }
 
     if(ferror(f)) {
@@ -258,6 +273,122 @@ JSR_NATIVE(jsr_File_write) {
     return true;
 }
 
+// Writes the String on top of the stack and pops it
+static bool writeString(JStarVM* vm, FILE* f) {
+    JSR_CHECK(String, -1, "strings element");
+    size_t datalen = jsrGetStringSz(vm, -1);
+    if(fwrite(jsrGetString(vm, -1), 1, datalen, f) < datalen) {
+        JSR_RAISE(vm, "IOException", strerror(errno));
+    }
+    jsrPop(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_File_writeAll) {
+    if(!checkClosed(vm)) return false;
+    if(!jsrGetField(vm, 0, M_FILE_HANDLE)) return false;
+    JSR_CHECK(Handle, -1, M_FILE_HANDLE);
+
+    FILE* f = (FILE*)jsrGetHandle(vm, -1);
+
+    // Lists and Tuples are written directly from their elements, without going through the
+    // iteration protocol
+    if(jsrIsList(vm, 1) || jsrIsTuple(vm, 1)) {
+        bool isList = jsrIsList(vm, 1);
+        size_t count = isList ? jsrListGetLength(vm, 1) : jsrTupleGetLength(vm, 1);
+        for(size_t i = 0; i < count; i++) {
+            if(isList) {
+                jsrListGet(vm, i, 1);
+            } else {
+                jsrTupleGet(vm, i, 1);
+            }
+            if(!writeString(vm, f)) return false;
+        }
+    } else {
+        JSR_FOREACH(1, {
+            if(!writeString(vm, f)) return false;
+        },)
+    }
+
+    jsrPushNull(vm);
+    return true;
+}
+
+static size_t arrayByteSize(JStarArrayType type, size_t length) {
+    switch(type) {
+    case JSR_ARRAY_FLOAT64:
+        return length * sizeof(double);
+    case JSR_ARRAY_INT32:
+        return length * sizeof(int32_t);
+    case JSR_ARRAY_UINT8:
+        return length;
+    }
+    UNREACHABLE();
+    return 0;
+}
+
+JSR_NATIVE(jsr_File_readInto) {
+    if(!checkClosed(vm)) return false;
+    if(!jsrGetField(vm, 0, M_FILE_HANDLE)) return false;
+    JSR_CHECK(Handle, -1, M_FILE_HANDLE);
+    JSR_CHECK(Array, 1, "buf");
+
+    FILE* f = (FILE*)jsrGetHandle(vm, -1);
+
+    JStarArrayType type;
+    size_t length;
+    void* data = jsrGetArray(vm, 1, &type, &length);
+    size_t bytes = arrayByteSize(type, length);
+
+    size_t read = fread(data, 1, bytes, f);
+    if(read < bytes && ferror(f)) {
+        JSR_RAISE(vm, "IOException", strerror(errno));
+    }
+
+    jsrPushNumber(vm, read);
+    return true;
+}
+
+JSR_NATIVE(jsr_File_writeFrom) {
+    if(!checkClosed(vm)) return false;
+    if(!jsrGetField(vm, 0, M_FILE_HANDLE)) return false;
+    JSR_CHECK(Handle, -1, M_FILE_HANDLE);
+    JSR_CHECK(Array, 1, "buf");
+
+    FILE* f = (FILE*)jsrGetHandle(vm, -1);
+
+    JStarArrayType type;
+    size_t length;
+    const void* data = jsrGetArray(vm, 1, &type, &length);
+    size_t bytes = arrayByteSize(type, length);
+
+    if(fwrite(data, 1, bytes, f) < bytes) {
+        JSR_RAISE(vm, "IOException", strerror(errno));
+    }
+
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_File_setBuffer) {
+    if(!checkClosed(vm)) return false;
+    if(!jsrGetField(vm, 0, M_FILE_HANDLE)) return false;
+    JSR_CHECK(Handle, -1, M_FILE_HANDLE);
+    JSR_CHECK(Int, 1, "size");
+
+    double size = jsrGetNumber(vm, 1);
+    if(size < 0) JSR_RAISE(vm, "InvalidArgException", "size must be >= 0");
+
+    // A size of 0 makes the file unbuffered
+    FILE* f = (FILE*)jsrGetHandle(vm, -1);
+    if(setvbuf(f, NULL, size > 0 ? _IOFBF : _IONBF, size) != 0) {
+        JSR_RAISE(vm, "IOException", "Cannot set the buffer of the file");
+    }
+
+    jsrPushNull(vm);
+    return true;
+}
+
 JSR_NATIVE(jsr_File_close) {
     if(!checkClosed(vm)) return false;
     if(!jsrGetField(vm, 0, M_FILE_HANDLE)) return false;
@@ -286,6 +417,280 @@ JSR_NATIVE(jsr_File_flush) {
     jsrPushNull(vm);
     return true;
 }
+
+JSR_NATIVE(jsr_File_fileno) {
+    if(!checkClosed(vm)) return false;
+    if(!jsrGetField(vm, 0, M_FILE_HANDLE)) return false;
+    JSR_CHECK(Handle, -1, M_FILE_HANDLE);
+    FILE* f = (FILE*)jsrGetHandle(vm, -1);
+    jsrPushNumber(vm, fileno(f));
+    return true;
+}
+// end
+
+// class LineIter
+#define M_LINES_FILE   "_file"
+#define M_LINES_BUFFER "_buffer"
+
+// Block of the file read ahead by a LineIter. Lines are searched in it using memchr
+typedef struct LineBuffer {
+    size_t start, end, capacity;
+    char data[];
+} LineBuffer;
+
+JSR_NATIVE(jsr_LineIter_new) {
+    JSR_CHECK(Int, 2, "bufferSize");
+
+    double size = jsrGetNumber(vm, 2);
+    if(size <= 0) JSR_RAISE(vm, "InvalidArgException", "bufferSize must be > 0");
+
+    jsrPushValue(vm, 1);
+    jsrSetField(vm, 0, M_LINES_FILE);
+    jsrPop(vm);
+
+    LineBuffer* buf = jsrPushUserdata(vm, sizeof(LineBuffer) + (size_t)size, NULL);
+    buf->start = buf->end = 0;
+    buf->capacity = size;
+    jsrSetField(vm, 0, M_LINES_BUFFER);
+    jsrPop(vm);
+
+    jsrPushValue(vm, 0);
+    return true;
+}
+
+JSR_NATIVE(jsr_LineIter_iter) {
+    if(!jsrGetField(vm, 0, M_LINES_FILE)) return false;
+    if(!jsrGetField(vm, -1, M_FILE_CLOSED)) return false;
+    if(jsrGetBoolean(vm, -1)) JSR_RAISE(vm, "IOException", "closed file");
+    if(!jsrGetField(vm, -2, M_FILE_HANDLE)) return false;
+    JSR_CHECK(Handle, -1, M_FILE_HANDLE);
+    FILE* f = (FILE*)jsrGetHandle(vm, -1);
+
+    if(!jsrGetField(vm, 0, M_LINES_BUFFER)) return false;
+    JSR_CHECK(Userdata, -1, M_LINES_BUFFER);
+    LineBuffer* buf = jsrGetUserdata(vm, -1);
+
+    // Only used for lines that span more than one block
+    JStarBuffer line = {0};
+
+    for(;;) {
+        if(buf->start == buf->end) {
+            buf->start = 0;
+            buf->end = fread(buf->data, 1, buf->capacity, f);
+            if(buf->end == 0) {
+                if(ferror(f)) {
+                    if(line.data) jsrBufferFree(&line);
+                    JSR_RAISE(vm, "IOException", strerror(errno));
+                }
+                break;
+            }
+        }
+
+        const char* start = buf->data + buf->start;
+        size_t size = buf->end - buf->start;
+        const char* nl = memchr(start, '\n', size);
+        if(nl != NULL) size = nl - start + 1;
+
+        if(nl != NULL && line.data == NULL) {
+            jsrPushStringSz(vm, start, size);
+            buf->start += size;
+            return true;
+        }
+
+        if(line.data == NULL) jsrBufferInit(vm, &line);
+        jsrBufferAppend(&line, start, size);
+        buf->start += size;
+
+        if(nl != NULL) {
+            jsrBufferPush(&line);
+            return true;
+        }
+    }
+
+    // End of file reached
+    if(line.data != NULL) {
+        jsrBufferPush(&line);
+    } else {
+        jsrPushNull(vm);
+    }
+    return true;
+}
+// end
+
+// class MappedFile
+#define M_MAPPED_MAP "_map"
+
+static void finalizeMapping(void* userdata) {
+    MappedFile* map = userdata;
+    if(map->data != NULL) unmapFile(map);
+}
+
+// Empty files cannot be mapped, but are still valid (empty) MappedFiles
+static bool isEmptyFile(JStarVM* vm, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) {
+        if(errno == ENOENT) {
+            JSR_RAISE(vm, "FileNotFoundException", "Couldn't find file `%s`", path);
+        } else {
+            JSR_RAISE(vm, "IOException", "%s: %s", path, strerror(errno));
+        }
+    }
+    bool empty = fgetc(f) == EOF && !ferror(f);
+    fclose(f);
+    if(!empty) JSR_RAISE(vm, "IOException", "Couldn't map file `%s`", path);
+    return true;
+}
+
+static MappedFile* getMapping(JStarVM* vm) {
+    if(!checkClosed(vm)) return NULL;
+    if(!jsrGetField(vm, 0, M_MAPPED_MAP)) return NULL;
+    if(!jsrCheckUserdata(vm, -1, M_MAPPED_MAP)) return NULL;
+    return jsrGetUserdata(vm, -1);
+}
+
+JSR_NATIVE(jsr_MappedFile_new) {
+    JSR_CHECK(String, 1, "path");
+    const char* path = jsrGetString(vm, 1);
+
+    MappedFile* map = jsrPushUserdata(vm, sizeof(MappedFile), &finalizeMapping);
+    *map = (MappedFile){0};
+    if(!mapFile(path, map) && !isEmptyFile(vm, path)) return false;
+    jsrSetField(vm, 0, M_MAPPED_MAP);
+    jsrPop(vm);
+
+    jsrPushBoolean(vm, false);
+    jsrSetField(vm, 0, M_FILE_CLOSED);
+    jsrPop(vm);
+
+    jsrPushValue(vm, 0);
+    return true;
+}
+
+JSR_NATIVE(jsr_MappedFile_close) {
+    MappedFile* map = getMapping(vm);
+    if(!map) return false;
+
+    if(map->data != NULL) unmapFile(map);
+
+    jsrPushBoolean(vm, true);
+    jsrSetField(vm, 0, M_FILE_CLOSED);
+    jsrPop(vm);
+
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_MappedFile_len) {
+    MappedFile* map = getMapping(vm);
+    if(!map) return false;
+    jsrPushNumber(vm, map->size);
+    return true;
+}
+
+JSR_NATIVE(jsr_MappedFile_get) {
+    MappedFile* map = getMapping(vm);
+    if(!map) return false;
+    const unsigned char* data = map->data;
+
+    if(jsrIsTuple(vm, 1)) {
+        if(jsrTupleGetLength(vm, 1) != 2) {
+            JSR_RAISE(vm, "TypeException", "Slice index must have two elements.");
+        }
+
+        jsrTupleGet(vm, 0, 1);
+        size_t low = jsrCheckIndex(vm, -1, map->size + 1, "low");
+        if(low == SIZE_MAX) return false;
+
+        jsrTupleGet(vm, 1, 1);
+        size_t high = jsrCheckIndex(vm, -1, map->size + 1, "high");
+        if(high == SIZE_MAX) return false;
+
+        if(low > high) {
+            JSR_RAISE(vm, "InvalidArgException",
+                      "Invalid slice indices (%zu, %zu), first must be <= than second", low,
+                      high);
+        }
+
+        jsrPushStringSz(vm, (const char*)data + low, high - low);
+        return true;
+    }
+
+    size_t idx = jsrCheckIndex(vm, 1, map->size, "idx");
+    if(idx == SIZE_MAX) return false;
+    jsrPushNumber(vm, data[idx]);
+    return true;
+}
+
+JSR_NATIVE(jsr_MappedFile_find) {
+    MappedFile* map = getMapping(vm);
+    if(!map) return false;
+    JSR_CHECK(String, 1, "str");
+    size_t start = jsrCheckIndex(vm, 2, map->size + 1, "start");
+    if(start == SIZE_MAX) return false;
+
+    const char* str = jsrGetString(vm, 1);
+    size_t length = jsrGetStringSz(vm, 1);
+    const char* data = map->data;
+
+    if(length == 0) {
+        jsrPushNumber(vm, start);
+        return true;
+    }
+
+    // Candidates are located with memchr on the first character, and then compared in full
+    const char* end = data + map->size;
+    const char* cur = data + start;
+    while((size_t)(end - cur) >= length) {
+        cur = memchr(cur, str[0], end - cur - length + 1);
+        if(cur == NULL) break;
+        if(memcmp(cur, str, length) == 0) {
+            jsrPushNumber(vm, cur - data);
+            return true;
+        }
+        cur++;
+    }
+
+    jsrPushNumber(vm, -1);
+    return true;
+}
+
+JSR_NATIVE(jsr_MappedFile_iter) {
+    MappedFile* map = getMapping(vm);
+    if(!map) return false;
+
+    if(jsrIsNull(vm, 1) && map->size != 0) {
+        jsrPushNumber(vm, 0);
+        return true;
+    }
+
+    if(jsrIsNumber(vm, 1)) {
+        size_t idx = (size_t)jsrGetNumber(vm, 1);
+        if(idx + 1 < map->size) {
+            jsrPushNumber(vm, idx + 1);
+            return true;
+        }
+    }
+
+    jsrPushBoolean(vm, false);
+    return true;
+}
+
+JSR_NATIVE(jsr_MappedFile_next) {
+    MappedFile* map = getMapping(vm);
+    if(!map) return false;
+    const unsigned char* data = map->data;
+
+    if(jsrIsNumber(vm, 1)) {
+        size_t idx = (size_t)jsrGetNumber(vm, 1);
+        if(idx < map->size) {
+            jsrPushNumber(vm, data[idx]);
+            return true;
+        }
+    }
+
+    jsrPushNull(vm);
+    return true;
+}
 // end
 
 // class Popen
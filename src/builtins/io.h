@@ -14,8 +14,28 @@ JSR_NATIVE(jsr_File_seek);
 JSR_NATIVE(jsr_File_tell);
 JSR_NATIVE(jsr_File_rewind);
 JSR_NATIVE(jsr_File_flush);
+JSR_NATIVE(jsr_File_fileno);
+JSR_NATIVE(jsr_File_writeAll);
+JSR_NATIVE(jsr_File_readInto);
+JSR_NATIVE(jsr_File_writeFrom);
+JSR_NATIVE(jsr_File_setBuffer);
 // end File
 
+// class LineIter
+JSR_NATIVE(jsr_LineIter_new);
+JSR_NATIVE(jsr_LineIter_iter);
+// end LineIter
+
+// class MappedFile
+JSR_NATIVE(jsr_MappedFile_new);
+JSR_NATIVE(jsr_MappedFile_close);
+JSR_NATIVE(jsr_MappedFile_len);
+JSR_NATIVE(jsr_MappedFile_get);
+JSR_NATIVE(jsr_MappedFile_find);
+JSR_NATIVE(jsr_MappedFile_iter);
+JSR_NATIVE(jsr_MappedFile_next);
+// end MappedFile
+
 // class Popen
 JSR_NATIVE(jsr_Popen_new);
 JSR_NATIVE(jsr_Popen_close);
@@ -1,8 +1,11 @@
 #include "math.h"
 
+#include <float.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "object.h"
@@ -112,18 +115,624 @@ JSR_NATIVE(jsr_modf) {
     return true;
 }
 
-JSR_NATIVE(jsr_random) {
-    jsrPushNumber(vm, (double)rand() / ((unsigned)RAND_MAX + 1));
+// class NumArray
+
+// Expands `BODY(T, U)` once for every element type, with `T` being the C type of the elements and
+// `U` the type used for arithmetic on them. Integer arithmetic is performed on unsigned types, so
+// that it wraps around instead of overflowing.
+// The loops expanded by the bodies work on contiguous elements of a single type, so that the
+// compiler is able to vectorize them
+#define ARRAY_SWITCH(type, BODY)   \
+    switch(type) {                 \
+    case JSR_ARRAY_FLOAT64:        \
+        BODY(double, double)       \
+        break;                     \
+    case JSR_ARRAY_INT32:          \
+        BODY(int32_t, uint32_t)    \
+        break;                     \
+    case JSR_ARRAY_UINT8:          \
+        BODY(uint8_t, uint32_t)    \
+        break;                     \
+    }
+
+static bool checkLength(JStarVM* vm, ObjArray* arr, ObjArray* other) {
+    if(arr->length != other->length) {
+        JSR_RAISE(vm, "InvalidArgException", "Arrays have different lengths (%zu and %zu)",
+                  arr->length, other->length);
+    }
     return true;
 }
 
-JSR_NATIVE(jsr_seed) {
+// The array classes are builtin and can't be subclassed, so that the VM can index their instances
+// directly
+static bool newArrayFrom(JStarVM* vm, ObjClass* cls, JStarArrayType type) {
+    Value init = vm->apiStack[1];
+
+    if(IS_NUM(init)) {
+        JSR_CHECK(Int, 1, "init");
+        double length = AS_NUM(init);
+        if(length < 0 || length > (double)(SIZE_MAX / sizeof(double))) {
+            JSR_RAISE(vm, "InvalidArgException", "Invalid array length %g", length);
+        }
+        push(vm, OBJ_VAL(newArray(vm, cls, type, (size_t)length)));
+        return true;
+    }
+
+    if(IS_ARRAY(init)) {
+        ObjArray* src = AS_ARRAY(init);
+        ObjArray* arr = newArray(vm, cls, type, src->length);
+        if(src->type == type) {
+            memcpy(arr->data, src->data, arrayElemSize(type) * src->length);
+        } else {
+            for(size_t i = 0; i < src->length; i++) {
+                arraySet(arr, i, arrayGet(src, i));
+            }
+        }
+        push(vm, OBJ_VAL(arr));
+        return true;
+    }
+
+    if(!IS_LIST(init) && !IS_TUPLE(init)) {
+        jsrPushList(vm);
+        JSR_FOREACH(1, {
+            jsrListAppend(vm, 2);
+            jsrPop(vm);
+        },)
+        init = vm->sp[-1];
+    }
+
+    size_t size;
+    Value* elems = getValues(AS_OBJ(init), &size);
+
+    ObjArray* arr = newArray(vm, cls, type, size);
+    for(size_t i = 0; i < size; i++) {
+        if(!IS_NUM(elems[i])) {
+            JSR_RAISE(vm, "TypeException", "Elements of %s must be numbers, got %s",
+                      cls->name->data, getClass(vm, elems[i])->name->data);
+        }
+        arraySet(arr, i, AS_NUM(elems[i]));
+    }
+
+    push(vm, OBJ_VAL(arr));
+    return true;
+}
+
+JSR_NATIVE(jsr_Float64Array_new) {
+    return newArrayFrom(vm, vm->f64ArrClass, JSR_ARRAY_FLOAT64);
+}
+
+JSR_NATIVE(jsr_Int32Array_new) {
+    return newArrayFrom(vm, vm->i32ArrClass, JSR_ARRAY_INT32);
+}
+
+JSR_NATIVE(jsr_Uint8Array_new) {
+    return newArrayFrom(vm, vm->u8ArrClass, JSR_ARRAY_UINT8);
+}
+
+JSR_NATIVE(jsr_NumArray_len) {
+    JSR_CHECK(Array, 0, "this");
+    push(vm, NUM_VAL(AS_ARRAY(vm->apiStack[0])->length));
+    return true;
+}
+
+JSR_NATIVE(jsr_NumArray_iter) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+
+    if(IS_NULL(vm->apiStack[1]) && arr->length != 0) {
+        push(vm, NUM_VAL(0));
+        return true;
+    }
+
+    if(IS_NUM(vm->apiStack[1])) {
+        size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
+        if(idx + 1 < arr->length) {
+            push(vm, NUM_VAL(idx + 1));
+            return true;
+        }
+    }
+
+    push(vm, BOOL_VAL(false));
+    return true;
+}
+
+JSR_NATIVE(jsr_NumArray_next) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+
+    if(IS_NUM(vm->apiStack[1])) {
+        size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
+        if(idx < arr->length) {
+            push(vm, NUM_VAL(arrayGet(arr, idx)));
+            return true;
+        }
+    }
+
+    push(vm, NULL_VAL);
+    return true;
+}
+
+JSR_NATIVE(jsr_NumArray_copy) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    ObjArray* copy = newArray(vm, arr->base.cls, arr->type, arr->length);
+    memcpy(copy->data, arr->data, arrayElemSize(arr->type) * arr->length);
+    push(vm, OBJ_VAL(copy));
+    return true;
+}
+
+JSR_NATIVE(jsr_NumArray_toList) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    ObjList* lst = newList(vm, arr->length);
+    for(size_t i = 0; i < arr->length; i++) {
+        lst->arr[i] = NUM_VAL(arrayGet(arr, i));
+    }
+    lst->size = arr->length;
+    push(vm, OBJ_VAL(lst));
+    return true;
+}
+
+#define FILL_LOOP(T, U)                                     \
+    {                                                       \
+        T* x = arr->data;                                   \
+        T s = (T)arrayConvert(arr->type, AS_NUM(val));      \
+        for(size_t i = 0; i < arr->length; i++) x[i] = s;   \
+    }
+
+JSR_NATIVE(jsr_NumArray_fill) {
+    JSR_CHECK(Array, 0, "this");
+    JSR_CHECK(Number, 1, "value");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    Value val = vm->apiStack[1];
+    ARRAY_SWITCH(arr->type, FILL_LOOP)
+    jsrPushValue(vm, 0);
+    return true;
+}
+
+// Floating point reductions are split over multiple accumulators so that they can be computed in
+// parallel. This changes the order of the operations, and so the rounding of the result
+#define SUM_LOOP(T, U)                                      \
+    {                                                       \
+        const T* x = arr->data;                             \
+        size_t i = 0;                                       \
+        for(; i + 4 <= arr->length; i += 4) {               \
+            acc[0] += x[i];                                 \
+            acc[1] += x[i + 1];                             \
+            acc[2] += x[i + 2];                             \
+            acc[3] += x[i + 3];                             \
+        }                                                   \
+        for(; i < arr->length; i++) acc[0] += x[i];         \
+    }
+
+JSR_NATIVE(jsr_NumArray_sum) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    double acc[4] = {0};
+    ARRAY_SWITCH(arr->type, SUM_LOOP)
+    push(vm, NUM_VAL((acc[0] + acc[1]) + (acc[2] + acc[3])));
+    return true;
+}
+
+#define DOT_LOOP(T, U)                                      \
+    {                                                       \
+        const T* x = arr->data;                             \
+        const T* y = other->data;                           \
+        size_t i = 0;                                       \
+        for(; i + 4 <= arr->length; i += 4) {               \
+            acc[0] += (double)x[i] * y[i];                  \
+            acc[1] += (double)x[i + 1] * y[i + 1];          \
+            acc[2] += (double)x[i + 2] * y[i + 2];          \
+            acc[3] += (double)x[i + 3] * y[i + 3];          \
+        }                                                   \
+        for(; i < arr->length; i++) {                       \
+            acc[0] += (double)x[i] * y[i];                  \
+        }                                                   \
+    }
+
+JSR_NATIVE(jsr_NumArray_dot) {
+    JSR_CHECK(Array, 0, "this");
+    JSR_CHECK(Array, 1, "other");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    ObjArray* other = AS_ARRAY(vm->apiStack[1]);
+    if(!checkLength(vm, arr, other)) return false;
+
+    double acc[4] = {0};
+    if(arr->type == other->type) {
+        ARRAY_SWITCH(arr->type, DOT_LOOP)
+    } else {
+        for(size_t i = 0; i < arr->length; i++) {
+            acc[0] += arrayGet(arr, i) * arrayGet(other, i);
+        }
+    }
+
+    push(vm, NUM_VAL((acc[0] + acc[1]) + (acc[2] + acc[3])));
+    return true;
+}
+
+#define MIN_LOOP(T, U)                                      \
+    {                                                       \
+        const T* x = arr->data;                             \
+        T m = x[0];                                         \
+        for(size_t i = 1; i < arr->length; i++) {           \
+            m = x[i] < m ? x[i] : m;                        \
+        }                                                   \
+        res = m;                                            \
+    }
+
+#define MAX_LOOP(T, U)                                      \
+    {                                                       \
+        const T* x = arr->data;                             \
+        T m = x[0];                                         \
+        for(size_t i = 1; i < arr->length; i++) {           \
+            m = x[i] > m ? x[i] : m;                        \
+        }                                                   \
+        res = m;                                            \
+    }
+
+JSR_NATIVE(jsr_NumArray_min) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    if(arr->length == 0) JSR_RAISE(vm, "InvalidArgException", "min() of empty array");
+    double res = 0;
+    ARRAY_SWITCH(arr->type, MIN_LOOP)
+    push(vm, NUM_VAL(res));
+    return true;
+}
+
+JSR_NATIVE(jsr_NumArray_max) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    if(arr->length == 0) JSR_RAISE(vm, "InvalidArgException", "max() of empty array");
+    double res = 0;
+    ARRAY_SWITCH(arr->type, MAX_LOOP)
+    push(vm, NUM_VAL(res));
+    return true;
+}
+
+// Element-wise operations are applied in place. The operand is either a number or an array of the
+// same length, and its elements are converted to the type of `arr` as if stored in it
+#define ELEMENTWISE_LOOP(T, U, op)                                          \
+    {                                                                       \
+        T* x = arr->data;                                                   \
+        if(other == NULL) {                                                 \
+            U s = (T)arrayConvert(arr->type, AS_NUM(vm->apiStack[1]));      \
+            for(size_t i = 0; i < arr->length; i++) {                       \
+                x[i] = (T)((U)x[i] op s);                                   \
+            }                                                               \
+        } else if(other->type == arr->type) {                               \
+            const T* y = other->data;                                       \
+            for(size_t i = 0; i < arr->length; i++) {                       \
+                x[i] = (T)((U)x[i] op (U)y[i]);                             \
+            }                                                               \
+        } else {                                                            \
+            for(size_t i = 0; i < arr->length; i++) {                       \
+                U y = (T)arrayConvert(arr->type, arrayGet(other, i));       \
+                x[i] = (T)((U)x[i] op y);                                   \
+            }                                                               \
+        }                                                                   \
+    }
+
+#define ADD_LOOP(T, U) ELEMENTWISE_LOOP(T, U, +)
+#define SUB_LOOP(T, U) ELEMENTWISE_LOOP(T, U, -)
+#define MUL_LOOP(T, U) ELEMENTWISE_LOOP(T, U, *)
+
+static bool getOperand(JStarVM* vm, ObjArray** other) {
+    if(IS_NUM(vm->apiStack[1])) {
+        *other = NULL;
+        return true;
+    }
+    if(IS_ARRAY(vm->apiStack[1])) {
+        *other = AS_ARRAY(vm->apiStack[1]);
+        return checkLength(vm, AS_ARRAY(vm->apiStack[0]), *other);
+    }
+    JSR_RAISE(vm, "TypeException", "other must be a Number or a numeric array.");
+}
+
+#define ELEMENTWISE_NATIVE(name, BODY)                      \
+    JSR_NATIVE(jsr_NumArray_##name) {                       \
+        JSR_CHECK(Array, 0, "this");                        \
+        ObjArray* arr = AS_ARRAY(vm->apiStack[0]);          \
+        ObjArray* other;                                    \
+        if(!getOperand(vm, &other)) return false;           \
+        ARRAY_SWITCH(arr->type, BODY)                       \
+        jsrPushValue(vm, 0);                                \
+        return true;                                        \
+    }
+
+ELEMENTWISE_NATIVE(add, ADD_LOOP)
+ELEMENTWISE_NATIVE(sub, SUB_LOOP)
+ELEMENTWISE_NATIVE(mul, MUL_LOOP)
+
+JSR_NATIVE(jsr_NumArray_map) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+    ObjArray* res = newArray(vm, arr->base.cls, arr->type, arr->length);
+    push(vm, OBJ_VAL(res));
+
+    for(size_t i = 0; i < arr->length; i++) {
+        jsrPushValue(vm, 1);
+        push(vm, NUM_VAL(arrayGet(arr, i)));
+        if(jsrCall(vm, 1) != JSR_SUCCESS) return false;
+
+        if(!IS_NUM(peek(vm))) {
+            JSR_RAISE(vm, "TypeException", "`fn` didn't return a Number, got %s",
+                      getClass(vm, peek(vm))->name->data);
+        }
+
+        arraySet(res, i, AS_NUM(pop(vm)));
+    }
+
+    return true;
+}
+
+JSR_NATIVE(jsr_NumArray_string) {
+    JSR_CHECK(Array, 0, "this");
+    ObjArray* arr = AS_ARRAY(vm->apiStack[0]);
+
+    JStarBuffer buf;
+    jsrBufferInit(vm, &buf);
+    jsrBufferAppendf(&buf, "%s[", arr->base.cls->name->data);
+    for(size_t i = 0; i < arr->length; i++) {
+        if(i > 0) jsrBufferAppendStr(&buf, ", ");
+        char str[NUM_STR_MAX];
+        jsrBufferAppend(&buf, str, numberToString(arrayGet(arr, i), str));
+    }
+    jsrBufferAppendStr(&buf, "]");
+    jsrBufferPush(&buf);
+    return true;
+}
+// end
+
+// Random number generation
+// The generator is xoshiro256++, seeded by expanding a 64-bit seed with splitmix64. Every VM has a
+// default generator used by the module level functions, `Random` instances carry their own state
+// in a Userdata. The bulk operations take the state and produce all their values in one call
+
+#define M_RANDOM_STATE "_state"
+#define TWO_POW_53     9007199254740992.0
+
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static void seedRandom(uint64_t s[4], uint64_t seed) {
+    for(int i = 0; i < 4; i++) {
+        s[i] = splitmix64(&seed);
+    }
+}
+
+// Seed used when none is provided. `salt` distinguishes generators created in the same second
+static uint64_t timeSeed(const void* salt) {
+    return (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(uintptr_t)salt;
+}
+
+// Seeds are taken from the bits of the number, so that any integer is a valid seed
+static uint64_t numberSeed(double num) {
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+    return bits;
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t nextRandom(uint64_t s[4]) {
+    uint64_t res = rotl(s[0] + s[3], 23) + s[0];
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return res;
+}
+
+// Uniformly distributed number in [0, 1), built from the top 53 bits of the output
+static inline double randomDouble(uint64_t s[4]) {
+    return (double)(nextRandom(s) >> 11) / TWO_POW_53;
+}
+
+// Uniformly distributed integer in [0, n). Outputs below 2^64 mod n are rejected to avoid the
+// bias of the modulo
+static inline uint64_t randomIndex(uint64_t s[4], uint64_t n) {
+    uint64_t threshold = -n % n;
+    for(;;) {
+        uint64_t r = nextRandom(s);
+        if(r >= threshold) return r % n;
+    }
+}
+
+static bool randomNumber(JStarVM* vm, uint64_t s[4]) {
+    jsrPushNumber(vm, randomDouble(s));
+    return true;
+}
+
+static bool randomSeed(JStarVM* vm, uint64_t s[4]) {
     JSR_CHECK(Int, 1, "s");
-    srand(jsrGetNumber(vm, 1));
+    seedRandom(s, numberSeed(jsrGetNumber(vm, 1)));
     jsrPushNull(vm);
     return true;
 }
 
+static bool randomList(JStarVM* vm, uint64_t s[4]) {
+    JSR_CHECK(Int, 1, "n");
+    double n = jsrGetNumber(vm, 1);
+    if(n < 0 || n > (double)(SIZE_MAX / sizeof(Value))) {
+        JSR_RAISE(vm, "InvalidArgException", "Invalid list length %g", n);
+    }
+
+    size_t length = (size_t)n;
+    ObjList* lst = newList(vm, length);
+    for(size_t i = 0; i < length; i++) {
+        lst->arr[i] = NUM_VAL(randomDouble(s));
+    }
+    lst->size = length;
+
+    push(vm, OBJ_VAL(lst));
+    return true;
+}
+
+// Integer arrays receive the floor of the generated numbers, so that their elements are
+// uniformly distributed integers in [low, high)
+#define RANDOM_FILL_LOOP(T, U)                                          \
+    {                                                                   \
+        T* x = arr->data;                                               \
+        for(size_t i = 0; i < arr->length; i++) {                       \
+            double r = low + randomDouble(s) * (high - low);            \
+            x[i] = (T)arrayConvert(arr->type, isFloat ? r : floor(r));  \
+        }                                                               \
+    }
+
+static bool randomFill(JStarVM* vm, uint64_t s[4]) {
+    JSR_CHECK(Array, 1, "array");
+    JSR_CHECK(Number, 2, "low");
+    JSR_CHECK(Number, 3, "high");
+
+    ObjArray* arr = AS_ARRAY(vm->apiStack[1]);
+    double low = jsrGetNumber(vm, 2), high = jsrGetNumber(vm, 3);
+    bool isFloat = arr->type == JSR_ARRAY_FLOAT64;
+
+    if(!(low < high)) {
+        JSR_RAISE(vm, "InvalidArgException", "`low` must be < `high`");
+    }
+
+    ARRAY_SWITCH(arr->type, RANDOM_FILL_LOOP)
+    jsrPushValue(vm, 1);
+    return true;
+}
+
+#define SHUFFLE_LOOP(T, U)                              \
+    {                                                   \
+        T* x = arr->data;                               \
+        for(size_t i = arr->length; i > 1; i--) {       \
+            size_t j = (size_t)randomIndex(s, i);       \
+            T tmp = x[i - 1];                           \
+            x[i - 1] = x[j];                            \
+            x[j] = tmp;                                 \
+        }                                               \
+    }
+
+static bool randomShuffle(JStarVM* vm, uint64_t s[4]) {
+    Value seq = vm->apiStack[1];
+
+    if(IS_LIST(seq)) {
+        ObjList* lst = AS_LIST(seq);
+        for(size_t i = lst->size; i > 1; i--) {
+            size_t j = (size_t)randomIndex(s, i);
+            Value tmp = lst->arr[i - 1];
+            lst->arr[i - 1] = lst->arr[j];
+            lst->arr[j] = tmp;
+        }
+    } else if(IS_ARRAY(seq)) {
+        ObjArray* arr = AS_ARRAY(seq);
+        ARRAY_SWITCH(arr->type, SHUFFLE_LOOP)
+    } else {
+        JSR_RAISE(vm, "TypeException", "Can only shuffle a List or a NumArray, got %s",
+                  getClass(vm, seq)->name->data);
+    }
+
+    jsrPushValue(vm, 1);
+    return true;
+}
+
+// Partial Fisher-Yates shuffle of a copy of the population, the first `k` elements are the sample
+static bool randomSample(JStarVM* vm, uint64_t s[4]) {
+    Value seq = vm->apiStack[1];
+    if(!IS_LIST(seq) && !IS_TUPLE(seq)) {
+        JSR_RAISE(vm, "TypeException", "Can only sample a List or a Tuple, got %s",
+                  getClass(vm, seq)->name->data);
+    }
+    JSR_CHECK(Int, 2, "k");
+
+    size_t size;
+    getValues(AS_OBJ(seq), &size);
+
+    double k = jsrGetNumber(vm, 2);
+    if(k < 0 || k > size) {
+        JSR_RAISE(vm, "InvalidArgException", "Sample size %g out of range [0, %zu]", k, size);
+    }
+
+    ObjList* lst = newList(vm, size);
+    Value* elems = getValues(AS_OBJ(seq), &size);
+    memcpy(lst->arr, elems, sizeof(Value) * size);
+
+    size_t count = (size_t)k;
+    for(size_t i = 0; i < count; i++) {
+        size_t j = i + (size_t)randomIndex(s, size - i);
+        Value tmp = lst->arr[i];
+        lst->arr[i] = lst->arr[j];
+        lst->arr[j] = tmp;
+    }
+    lst->size = count;
+
+    push(vm, OBJ_VAL(lst));
+    return true;
+}
+
+JSR_NATIVE(jsr_random) {
+    return randomNumber(vm, vm->randomState);
+}
+
+JSR_NATIVE(jsr_seed) {
+    return randomSeed(vm, vm->randomState);
+}
+
+JSR_NATIVE(jsr_randomList) {
+    return randomList(vm, vm->randomState);
+}
+
+JSR_NATIVE(jsr_randomFill) {
+    return randomFill(vm, vm->randomState);
+}
+
+JSR_NATIVE(jsr_shuffle) {
+    return randomShuffle(vm, vm->randomState);
+}
+
+JSR_NATIVE(jsr_sample) {
+    return randomSample(vm, vm->randomState);
+}
+
+// class Random
+
+static uint64_t* getRandomState(JStarVM* vm) {
+    if(!jsrGetField(vm, 0, M_RANDOM_STATE)) return NULL;
+    if(!jsrCheckUserdata(vm, -1, M_RANDOM_STATE)) return NULL;
+    return jsrGetUserdata(vm, -1);
+}
+
+JSR_NATIVE(jsr_Random_new) {
+    if(!jsrIsNull(vm, 1)) JSR_CHECK(Int, 1, "seed");
+
+    uint64_t* s = jsrPushUserdata(vm, sizeof(uint64_t) * 4, NULL);
+    seedRandom(s, jsrIsNull(vm, 1) ? timeSeed(s) : numberSeed(jsrGetNumber(vm, 1)));
+    jsrSetField(vm, 0, M_RANDOM_STATE);
+
+    jsrPushValue(vm, 0);
+    return true;
+}
+
+#define RANDOM_METHOD(name, fn)             \
+    JSR_NATIVE(jsr_Random_##name) {         \
+        uint64_t* s = getRandomState(vm);   \
+        if(!s) return false;                \
+        return fn(vm, s);                   \
+    }
+
+RANDOM_METHOD(random, randomNumber)
+RANDOM_METHOD(seed, randomSeed)
+RANDOM_METHOD(randomList, randomList)
+RANDOM_METHOD(randomFill, randomFill)
+RANDOM_METHOD(shuffle, randomShuffle)
+RANDOM_METHOD(sample, randomSample)
+// end
+
 JSR_NATIVE(jsr_math_init) {
     // Init constants
     jsrPushNumber(vm, HUGE_VAL);
@@ -134,8 +743,15 @@ JSR_NATIVE(jsr_math_init) {
     jsrSetGlobal(vm, NULL, "pi");
     jsrPushNumber(vm, JSR_E);
     jsrSetGlobal(vm, NULL, "e");
+    // Register the array classes as builtins
+    jsrGetGlobal(vm, NULL, "Float64Array");
+    vm->f64ArrClass = AS_CLASS(pop(vm));
+    jsrGetGlobal(vm, NULL, "Int32Array");
+    vm->i32ArrClass = AS_CLASS(pop(vm));
+    jsrGetGlobal(vm, NULL, "Uint8Array");
+    vm->u8ArrClass = AS_CLASS(pop(vm));
     jsrPushNull(vm);
-    // Init rand seed
-    srand(time(NULL));
+    // Init the default random generator
+    seedRandom(vm->randomState, timeSeed(vm));
     return true;
 }
\ No newline at end of file
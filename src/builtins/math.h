@@ -29,6 +29,42 @@ JSR_NATIVE(jsr_tanh);
 JSR_NATIVE(jsr_modf);
 JSR_NATIVE(jsr_random);
 JSR_NATIVE(jsr_seed);
+JSR_NATIVE(jsr_randomList);
+JSR_NATIVE(jsr_randomFill);
+JSR_NATIVE(jsr_shuffle);
+JSR_NATIVE(jsr_sample);
 JSR_NATIVE(jsr_math_init);
 
+// class NumArray
+JSR_NATIVE(jsr_NumArray_len);
+JSR_NATIVE(jsr_NumArray_iter);
+JSR_NATIVE(jsr_NumArray_next);
+JSR_NATIVE(jsr_NumArray_copy);
+JSR_NATIVE(jsr_NumArray_toList);
+JSR_NATIVE(jsr_NumArray_fill);
+JSR_NATIVE(jsr_NumArray_sum);
+JSR_NATIVE(jsr_NumArray_dot);
+JSR_NATIVE(jsr_NumArray_min);
+JSR_NATIVE(jsr_NumArray_max);
+JSR_NATIVE(jsr_NumArray_add);
+JSR_NATIVE(jsr_NumArray_sub);
+JSR_NATIVE(jsr_NumArray_mul);
+JSR_NATIVE(jsr_NumArray_map);
+JSR_NATIVE(jsr_NumArray_string);
+// end
+
+JSR_NATIVE(jsr_Float64Array_new);
+JSR_NATIVE(jsr_Int32Array_new);
+JSR_NATIVE(jsr_Uint8Array_new);
+
+// class Random
+JSR_NATIVE(jsr_Random_new);
+JSR_NATIVE(jsr_Random_random);
+JSR_NATIVE(jsr_Random_seed);
+JSR_NATIVE(jsr_Random_randomList);
+JSR_NATIVE(jsr_Random_randomFill);
+JSR_NATIVE(jsr_Random_shuffle);
+JSR_NATIVE(jsr_Random_sample);
+// end
+
 #endif
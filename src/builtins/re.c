@@ -7,6 +7,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +22,17 @@
 #define MAX_ERROR          256
 #define CAPTURE_UNFINISHED -1
 #define CAPTURE_POSITION   -2
+#define REGEX_CACHE_SIZE   16
+#define STREAM_CHUNK_SIZE  (64 * 1024)
+
+#define M_PATTERN_REGEX "_regex"
+#define M_PATTERN_SRC   "regex"
+
+#define M_ITER_STRING     "_string"
+#define M_ITER_REGEX      "_regex"
+#define M_ITER_SPANS      "_spans"
+#define M_ITER_OFFSET     "_offset"
+#define M_ITER_LAST_MATCH "_lastMatch"
 
 typedef struct Substring {
     const char* start;
@@ -64,11 +76,57 @@ static const char* getError(RegexState* rs) {
 }
 
 // -----------------------------------------------------------------------------
-// MATCHING ENGINE
+// REGEX COMPILER
 // -----------------------------------------------------------------------------
 
-// Forward declaration as the regex matching algorithm is mutually recursive
-static const char* match(RegexState* rs, const char* str, const char* regex);
+// A regex is compiled to a sequence of items, each one matching an element of the pattern.
+// Single characters, `.`, `%x` classes and `[]` sets are all expanded into a 256 bit set of the
+// characters they match, so that they don't have to be parsed again at every match attempt
+
+typedef enum ItemType {
+    ITEM_END,         // End of the regex
+    ITEM_CHAR,        // A character, class or set, possibly followed by a repetition operator
+    ITEM_OPEN,        // Start of a capture
+    ITEM_POSITION,    // Position capture `()`
+    ITEM_CLOSE,       // End of a capture
+    ITEM_BACKREF,     // Reference to a previous capture `%n`
+    ITEM_END_ANCHOR,  // `$` at the end of the regex
+} ItemType;
+
+typedef enum Repetition {
+    REP_ONE,
+    REP_OPTIONAL,  // `?`
+    REP_STAR,      // `*`
+    REP_PLUS,      // `+`
+    REP_LAZY,      // `-`
+} Repetition;
+
+typedef struct RegexItem {
+    uint8_t type, rep;
+    int literal;      // The only character matched by an ITEM_CHAR, or -1 if it matches more
+    int capture;      // Capture referenced by an ITEM_BACKREF
+    uint8_t set[32];  // Characters matched by an ITEM_CHAR
+} RegexItem;
+
+typedef struct Regex {
+    bool anchored;  // Whether the regex starts with `^`
+    size_t length;  // Number of items, including the final ITEM_END
+    RegexItem items[];
+} Regex;
+
+// Most recently used compiled regexes, so that the functions taking a regex as a String don't
+// have to compile it again on every call. Entries are sorted from the most recently used
+typedef struct CacheEntry {
+    char* regex;
+    size_t length;
+    uint32_t hash;
+    Regex* compiled;
+} CacheEntry;
+
+struct RegexCache {
+    CacheEntry entries[REGEX_CACHE_SIZE];
+    int count;
+};
 
 static bool isAtEnd(const char* ptr) {
     return *ptr == '\0';
@@ -149,6 +207,170 @@ static bool matchClassOrChar(char c, const char* regex, const char* classEnd) {
     }
 }
 
+static const char* findClassEnd(RegexState* rs, const char* regexPtr) {
+    switch(*regexPtr++) {
+    case ESCAPE:
+        if(isAtEnd(regexPtr)) {
+            setError(rs, "Malformed regex, unmatched `%c`", ESCAPE);
+            return NULL;
+        }
+        return regexPtr + 1;
+    case '[':
+        do {
+            if(isAtEnd(regexPtr)) {
+                setError(rs, "Malformed regex, unmatched `[`");
+                return NULL;
+            }
+            if(*regexPtr++ == ESCAPE && !isAtEnd(regexPtr)) {
+                regexPtr++;
+            }
+        } while(*regexPtr != ']');
+
+        return regexPtr + 1;
+    default:
+        return regexPtr;
+    }
+}
+
+static const char* compileChar(RegexState* rs, RegexItem* item, const char* regexPtr) {
+    const char* classEnd = findClassEnd(rs, regexPtr);
+    if(classEnd == NULL) return NULL;
+
+    item->type = ITEM_CHAR;
+    memset(item->set, 0, sizeof(item->set));
+
+    int matched = 0;
+    for(int c = 0; c <= UINT8_MAX; c++) {
+        if(matchClassOrChar((char)c, regexPtr, classEnd)) {
+            item->set[c >> 3] |= 1 << (c & 7);
+            item->literal = c;
+            matched++;
+        }
+    }
+    if(matched != 1) {
+        item->literal = -1;
+    }
+
+    switch(*classEnd) {
+    case '?':
+        item->rep = REP_OPTIONAL;
+        return classEnd + 1;
+    case '*':
+        item->rep = REP_STAR;
+        return classEnd + 1;
+    case '+':
+        item->rep = REP_PLUS;
+        return classEnd + 1;
+    case '-':
+        item->rep = REP_LAZY;
+        return classEnd + 1;
+    default:
+        return classEnd;
+    }
+}
+
+static size_t regexSize(size_t length) {
+    return sizeof(Regex) + sizeof(RegexItem) * length;
+}
+
+// Compiles a regex, returning a newly allocated Regex or NULL if the regex is malformed
+static Regex* compileRegex(RegexState* rs, const char* regex) {
+    // Every item consumes at least one character of the regex, plus the final ITEM_END
+    Regex* re = malloc(regexSize(strlen(regex) + 1));
+    re->anchored = *regex == '^';
+    if(re->anchored) regex++;
+
+    int captureCount = 1, openCaptures = 0;
+    for(size_t i = 0;; i++) {
+        RegexItem* item = &re->items[i];
+        item->rep = REP_ONE;
+        item->literal = -1;
+        item->capture = 0;
+
+        switch(*regex) {
+        case '\0':
+            item->type = ITEM_END;
+            re->length = i + 1;
+            return re;
+        case '(':
+            if(captureCount >= MAX_CAPTURES) {
+                setError(rs, "Max capture number exceeded: %d", MAX_CAPTURES);
+                free(re);
+                return NULL;
+            }
+            captureCount++;
+            if(regex[1] == ')') {
+                item->type = ITEM_POSITION;
+                regex += 2;
+            } else {
+                item->type = ITEM_OPEN;
+                openCaptures++;
+                regex++;
+            }
+            break;
+        case ')':
+            if(openCaptures == 0) {
+                setError(rs, "Invalid regex capture");
+                free(re);
+                return NULL;
+            }
+            item->type = ITEM_CLOSE;
+            openCaptures--;
+            regex++;
+            break;
+        case '$':
+            // Treat `$` specially only if at regex end
+            if(isAtEnd(regex + 1)) {
+                item->type = ITEM_END_ANCHOR;
+                regex++;
+                break;
+            }
+            if((regex = compileChar(rs, item, regex)) == NULL) {
+                free(re);
+                return NULL;
+            }
+            break;
+        case ESCAPE:
+            // If there are digits after a `%`, then it's a capture reference
+            if(isdigit(regex[1])) {
+                char* end;
+                item->type = ITEM_BACKREF;
+                item->capture = strtol(regex + 1, &end, 10);
+                regex = end;
+                break;
+            }
+            // fallthrough
+        default:
+            if((regex = compileChar(rs, item, regex)) == NULL) {
+                free(re);
+                return NULL;
+            }
+            break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// MATCHING ENGINE
+// -----------------------------------------------------------------------------
+
+// Forward declaration as the regex matching algorithm is mutually recursive
+static const char* match(RegexState* rs, const char* str, const RegexItem* item);
+
+static bool matchSet(const RegexItem* item, char c) {
+    uint8_t u = (uint8_t)c;
+    return item->set[u >> 3] & (1 << (u & 7));
+}
+
+static bool singleMatch(RegexState* rs, const char* stringPtr, const RegexItem* item) {
+    return stringPtr < rs->end && matchSet(item, *stringPtr);
+}
+
+// Returns true if a match of `item` must consume at least one character
+static bool isMandatoryChar(const RegexItem* item) {
+    return item->type == ITEM_CHAR && (item->rep == REP_ONE || item->rep == REP_PLUS);
+}
+
 static int finishCaptures(RegexState* rs) {
     for(int i = rs->captureCount - 1; i > 0; i--) {
         if(rs->captures[i].length == CAPTURE_UNFINISHED) return i;
@@ -157,21 +379,13 @@ static int finishCaptures(RegexState* rs) {
     return -1;
 }
 
-static const char* startCapture(RegexState* rs, const char* stringPtr, const char* regexPtr) {
-    if(rs->captureCount >= MAX_CAPTURES) {
-        setError(rs, "Max capture number exceeded: %d", MAX_CAPTURES);
-        return NULL;
-    }
-
-    if(regexPtr[1] != ')') {
-        rs->captures[rs->captureCount].length = CAPTURE_UNFINISHED;
-    } else {
-        rs->captures[rs->captureCount].length = CAPTURE_POSITION;
-        regexPtr++;
-    }
-
+static const char* startCapture(RegexState* rs, const char* stringPtr, const RegexItem* item,
+                                ptrdiff_t length) {
+    // The number of captures is checked when compiling the regex
+    rs->captures[rs->captureCount].length = length;
     rs->captures[rs->captureCount++].start = stringPtr;
-    const char* res = match(rs, stringPtr, regexPtr + 1);
+
+    const char* res = match(rs, stringPtr, item + 1);
     if(res == NULL) {
         rs->captureCount--;
     }
@@ -179,12 +393,12 @@ static const char* startCapture(RegexState* rs, const char* stringPtr, const cha
     return res;
 }
 
-static const char* endCapture(RegexState* rs, const char* stringPtr, const char* regexPtr) {
+static const char* endCapture(RegexState* rs, const char* stringPtr, const RegexItem* item) {
     int i = finishCaptures(rs);
     if(i == -1) return NULL;
 
     rs->captures[i].length = stringPtr - rs->captures[i].start;
-    const char* res = match(rs, stringPtr, regexPtr + 1);
+    const char* res = match(rs, stringPtr, item + 1);
     if(res == NULL) {
         rs->captures[i].length = CAPTURE_UNFINISHED;
     }
@@ -208,126 +422,105 @@ static const char* matchCapture(RegexState* rs, const char* stringPtr, int captu
     return stringPtr + captureLen;
 }
 
-static const char* greedyMatch(RegexState* rs, const char* stringPtr, const char* regexPtr,
-                               const char* clsEnd) {
+static const char* greedyMatch(RegexState* rs, const char* stringPtr, const RegexItem* item) {
     ptrdiff_t i = 0;
-    while(!isAtEnd(&stringPtr[i]) && matchClassOrChar(stringPtr[i], regexPtr, clsEnd)) {
+    while(singleMatch(rs, stringPtr + i, item)) {
         i++;
     }
 
-    while(i >= 0) {
-        const char* res = match(rs, stringPtr + i, clsEnd + 1);
+    // When backtracking, skip the positions where the next item cannot possibly match
+    const RegexItem* next = item + 1;
+    bool mandatory = isMandatoryChar(next);
+
+    for(; i >= 0; i--) {
+        if(mandatory && !singleMatch(rs, stringPtr + i, next)) {
+            continue;
+        }
+        const char* res = match(rs, stringPtr + i, next);
         if(res != NULL) {
             return res;
         }
         if(rs->hadError) {
             return NULL;
         }
-        i--;
     }
 
     return NULL;
 }
 
-static const char* lazyMatch(RegexState* rs, const char* stringPtr, const char* regexPtr,
-                             const char* clsEnd) {
-    do {
-        const char* res = match(rs, stringPtr, clsEnd + 1);
+static const char* lazyMatch(RegexState* rs, const char* stringPtr, const RegexItem* item) {
+    for(;;) {
+        const char* res = match(rs, stringPtr, item + 1);
         if(res != NULL) {
             return res;
         }
-        if(rs->hadError) {
+        if(rs->hadError || !singleMatch(rs, stringPtr, item)) {
             return NULL;
         }
-    } while(!isAtEnd(stringPtr) && matchClassOrChar(*stringPtr++, regexPtr, clsEnd));
-
-    return NULL;
+        stringPtr++;
+    }
 }
 
-static const char* findClassEnd(RegexState* rs, const char* regexPtr) {
-    switch(*regexPtr++) {
-    case ESCAPE:
-        if(isAtEnd(regexPtr)) {
-            setError(rs, "Malformed regex, unmatched `%c`", ESCAPE);
-            return NULL;
-        }
-        return regexPtr + 1;
-    case '[':
-        do {
-            if(isAtEnd(regexPtr)) {
-                setError(rs, "Malformed regex, unmatched `[`");
+static const char* match(RegexState* rs, const char* stringPtr, const RegexItem* item) {
+    // Items that don't need backtracking are matched iteratively
+    for(;;) {
+        switch(item->type) {
+        case ITEM_END:
+            return stringPtr;
+        case ITEM_OPEN:
+            return startCapture(rs, stringPtr, item, CAPTURE_UNFINISHED);
+        case ITEM_POSITION:
+            return startCapture(rs, stringPtr, item, CAPTURE_POSITION);
+        case ITEM_CLOSE:
+            return endCapture(rs, stringPtr, item);
+        case ITEM_END_ANCHOR:
+            return stringPtr == rs->end ? stringPtr : NULL;
+        case ITEM_BACKREF:
+            if((stringPtr = matchCapture(rs, stringPtr, item->capture)) == NULL) {
                 return NULL;
             }
-            if(*regexPtr++ == ESCAPE && !isAtEnd(regexPtr)) {
-                regexPtr++;
+            item++;
+            break;
+        case ITEM_CHAR: {
+            bool isMatch = singleMatch(rs, stringPtr, item);
+            switch(item->rep) {
+            case REP_OPTIONAL:
+                if(isMatch) {
+                    const char* res = match(rs, stringPtr + 1, item + 1);
+                    if(res != NULL || rs->hadError) return res;
+                }
+                item++;
+                break;
+            case REP_PLUS:
+                return isMatch ? greedyMatch(rs, stringPtr + 1, item) : NULL;
+            case REP_STAR:
+                return greedyMatch(rs, stringPtr, item);
+            case REP_LAZY:
+                return lazyMatch(rs, stringPtr, item);
+            default:
+                if(!isMatch) return NULL;
+                stringPtr++;
+                item++;
+                break;
             }
-        } while(*regexPtr != ']');
-
-        return regexPtr + 1;
-    default:
-        return regexPtr;
+            break;
+        }
+        }
     }
 }
 
-static const char* matchRepOperator(RegexState* rs, const char* stringPtr, const char* regexPtr) {
-    const char* classEnd = findClassEnd(rs, regexPtr);
-    if(classEnd == NULL) return NULL;
-
-    bool isMatch = !isAtEnd(stringPtr) && matchClassOrChar(*stringPtr, regexPtr, classEnd);
-    switch(*classEnd) {
-    case '?': {
-        const char* res;
-        if(isMatch && (res = match(rs, stringPtr + 1, classEnd + 1)) != NULL) return res;
-        return match(rs, stringPtr, classEnd + 1);
-    }
-    case '+':
-        return isMatch ? greedyMatch(rs, stringPtr + 1, regexPtr, classEnd) : NULL;
-    case '*':
-        return greedyMatch(rs, stringPtr, regexPtr, classEnd);
-    case '-':
-        return lazyMatch(rs, stringPtr, regexPtr, classEnd);
-    default:
-        return isMatch ? match(rs, stringPtr + 1, classEnd) : NULL;
-    }
-}
-
-static const char* match(RegexState* rs, const char* stringPtr, const char* regexPtr) {
-    switch(*regexPtr) {
-    case '\0':
-        return stringPtr;
-    case '(':
-        return startCapture(rs, stringPtr, regexPtr);
-    case ')':
-        return endCapture(rs, stringPtr, regexPtr);
-    case '$':
-        // Treat `$` specially only if at string end
-        if(isAtEnd(&regexPtr[1])) {
-            return isAtEnd(stringPtr) ? stringPtr : NULL;
-        }
-        return matchRepOperator(rs, stringPtr, regexPtr);
-    case ESCAPE:
-        // If there are digits after a `%`, then it's a capture reference
-        if(isdigit(regexPtr[1])) {
-            int digitCount = 1;
-            while(isdigit(regexPtr[digitCount])) {
-                digitCount++;
-            }
-
-            int capture = strtol(regexPtr + 1, NULL, 10);
-            if((stringPtr = matchCapture(rs, stringPtr, capture)) == NULL) {
-                return NULL;
-            }
-
-            return match(rs, stringPtr, regexPtr + digitCount);
-        }
-        return matchRepOperator(rs, stringPtr, regexPtr);
-    default:
-        return matchRepOperator(rs, stringPtr, regexPtr);
+static bool matchAt(RegexState* rs, const Regex* re, const char* str) {
+    const char* res = match(rs, str, re->items);
+    if(res != NULL) {
+        rs->captures[0].start = str;
+        rs->captures[0].length = res - str;
+        return true;
     }
+    return false;
 }
 
 // Entry point of the regex matching algorithm
-static bool matchRegex(RegexState* rs, const char* str, size_t len, const char* regex, int offset) {
+static bool matchRegex(RegexState* rs, const Regex* re, const char* str, size_t len, int offset) {
     initState(rs, str, len);
 
     // negative offsets start from end of string
@@ -342,32 +535,158 @@ static bool matchRegex(RegexState* rs, const char* str, size_t len, const char*
 
     str += offset;
 
-    if(*regex == '^') {
-        const char* res = match(rs, str, regex + 1);
-        if(res != NULL) {
-            rs->captures[0].length = res - str;
-            return true;
+    if(re->anchored) {
+        return matchAt(rs, re, str);
+    }
+
+    // If the regex must start with a given character, search it directly instead of attempting a
+    // match at every position of the string
+    const RegexItem* first = &re->items[0];
+    if(isMandatoryChar(first)) {
+        for(; str < rs->end; str++) {
+            if(first->literal >= 0) {
+                str = memchr(str, first->literal, rs->end - str);
+                if(str == NULL) return false;
+            } else if(!matchSet(first, *str)) {
+                continue;
+            }
+            if(matchAt(rs, re, str)) return true;
+            if(rs->hadError) return false;
         }
         return false;
     }
 
     do {
-        const char* res = match(rs, str, regex);
-        if(res != NULL) {
-            rs->captures[0].start = str;
-            rs->captures[0].length = res - str;
-            return true;
-        }
+        if(matchAt(rs, re, str)) return true;
         if(rs->hadError) return false;
-    } while(!isAtEnd(str++));
+    } while(str++ < rs->end);
 
     return false;
 }
 
+// -----------------------------------------------------------------------------
+// REGEX CACHE
+// -----------------------------------------------------------------------------
+
+static Regex* cacheLookup(RegexCache* cache, const ObjString* regex, uint32_t hash) {
+    for(int i = 0; i < cache->count; i++) {
+        if(cache->entries[i].hash == hash && cache->entries[i].length == regex->length &&
+           memcmp(cache->entries[i].regex, regex->data, regex->length) == 0) {
+            // Move the entry to the front, so that the last one is always the least recently used
+            if(i > 0) {
+                CacheEntry entry = cache->entries[i];
+                memmove(&cache->entries[1], &cache->entries[0], sizeof(CacheEntry) * i);
+                cache->entries[0] = entry;
+            }
+            return cache->entries[0].compiled;
+        }
+    }
+    return NULL;
+}
+
+static void cacheInsert(RegexCache* cache, const ObjString* regex, uint32_t hash, Regex* compiled) {
+    if(cache->count == REGEX_CACHE_SIZE) {
+        cache->count--;
+        free(cache->entries[cache->count].regex);
+        free(cache->entries[cache->count].compiled);
+    }
+
+    memmove(&cache->entries[1], &cache->entries[0], sizeof(CacheEntry) * cache->count);
+    cache->count++;
+
+    cache->entries[0].regex = malloc(regex->length);
+    memcpy(cache->entries[0].regex, regex->data, regex->length);
+    cache->entries[0].length = regex->length;
+    cache->entries[0].hash = hash;
+    cache->entries[0].compiled = compiled;
+}
+
+void freeRegexCache(JStarVM* vm) {
+    RegexCache* cache = vm->regexCache;
+    if(cache == NULL) return;
+    for(int i = 0; i < cache->count; i++) {
+        free(cache->entries[i].regex);
+        free(cache->entries[i].compiled);
+    }
+    free(cache);
+    vm->regexCache = NULL;
+}
+
 // -----------------------------------------------------------------------------
 // J* NATIVES AND HELPER FUNCTIONS
 // -----------------------------------------------------------------------------
 
+// Returns the compiled regex in `slot`, either a String or a Pattern object.
+// Strings are compiled only on first use and then retrieved from the VM's cache. A compiled
+// Pattern is instead pushed on the stack, to keep it alive for the duration of the native call
+static const Regex* getRegex(JStarVM* vm, int slot) {
+    Value regexVal = vm->apiStack[slot];
+
+    if(IS_STRING(regexVal)) {
+        ObjString* regex = AS_STRING(regexVal);
+        uint32_t hash = stringGetHash(regex);
+
+        if(vm->regexCache == NULL) {
+            vm->regexCache = calloc(1, sizeof(RegexCache));
+        }
+
+        Regex* compiled = cacheLookup(vm->regexCache, regex, hash);
+        if(compiled != NULL) return compiled;
+
+        RegexState rs;
+        initState(&rs, regex->data, regex->length);
+        if((compiled = compileRegex(&rs, regex->data)) == NULL) {
+            jsrRaise(vm, "RegexException", "%s", getError(&rs));
+            return NULL;
+        }
+
+        cacheInsert(vm->regexCache, regex, hash, compiled);
+        return compiled;
+    }
+
+    if(IS_INSTANCE(regexVal)) {
+        if(!jsrGetField(vm, slot, M_PATTERN_REGEX)) return NULL;
+        if(jsrIsUserdata(vm, -1)) return jsrGetUserdata(vm, -1);
+        jsrPop(vm);
+    }
+
+    jsrRaise(vm, "TypeException", "regex must be either a String or a Pattern, got %s.",
+             getClass(vm, regexVal)->name->data);
+    return NULL;
+}
+
+// Copies a cached regex in a Userdata pushed on the stack. Needed when the regex is used across
+// calls to J* code, that could evict it from the cache
+static const Regex* pinRegex(JStarVM* vm, const Regex* re) {
+    void* pinned = jsrPushUserdata(vm, regexSize(re->length), NULL);
+    memcpy(pinned, re, regexSize(re->length));
+    return pinned;
+}
+
+JSR_NATIVE(jsr_re_Pattern_new) {
+    JSR_CHECK(String, 1, "regex");
+
+    RegexState rs;
+    initState(&rs, jsrGetString(vm, 1), jsrGetStringSz(vm, 1));
+    Regex* re = compileRegex(&rs, jsrGetString(vm, 1));
+    if(re == NULL) {
+        JSR_RAISE(vm, "RegexException", "%s", getError(&rs));
+    }
+
+    pinRegex(vm, re);
+    free(re);
+    jsrSetField(vm, 0, M_PATTERN_REGEX);
+    jsrPop(vm);
+
+    jsrPushValue(vm, 1);
+    jsrSetField(vm, 0, M_PATTERN_SRC);
+    jsrPop(vm);
+
+    // return `this`. required in native constructors
+    jsrPushValue(vm, 0);
+    return true;
+}
+
 typedef enum FindRes {
     FIND_ERR,
     FIND_MATCH,
@@ -375,19 +694,20 @@ typedef enum FindRes {
 } FindRes;
 
 static FindRes find(JStarVM* vm, RegexState* rs) {
-    if(!jsrCheckString(vm, 1, "str") || !jsrCheckString(vm, 2, "regex") ||
-       !jsrCheckInt(vm, 3, "off")) {
+    if(!jsrCheckString(vm, 1, "str") || !jsrCheckInt(vm, 3, "off")) {
         return FIND_ERR;
     }
 
+    const Regex* re = getRegex(vm, 2);
+    if(re == NULL) return FIND_ERR;
+
     size_t len = jsrGetStringSz(vm, 1);
     const char* string = jsrGetString(vm, 1);
-    const char* regex = jsrGetString(vm, 2);
     double offset = jsrGetNumber(vm, 3);
 
-    if(!matchRegex(rs, string, len, regex, offset)) {
+    if(!matchRegex(rs, re, string, len, offset)) {
         if(hadError(rs)) {
-            jsrRaise(vm, "RegexException", "%s\n", getError(rs));
+            jsrRaise(vm, "RegexException", "%s", getError(rs));
             return FIND_ERR;
         }
         jsrPushNull(vm);
@@ -414,6 +734,39 @@ static bool pushCapture(JStarVM* vm, RegexState* rs, int captureIdx) {
     return true;
 }
 
+// Like pushCapture, but pushes the (start, end) offsets of the capture in the string instead of
+// copying it in a new String
+static bool pushSpan(JStarVM* vm, RegexState* rs, int captureIdx) {
+    if(rs->captures[captureIdx].length == CAPTURE_UNFINISHED) {
+        JSR_RAISE(vm, "RegexException", "Unfinished capture");
+    }
+
+    ptrdiff_t start = rs->captures[captureIdx].start - rs->string;
+    if(rs->captures[captureIdx].length == CAPTURE_POSITION) {
+        jsrPushNumber(vm, start);
+    } else {
+        jsrPushNumber(vm, start);
+        jsrPushNumber(vm, start + rs->captures[captureIdx].length);
+        jsrPushTuple(vm, 2);
+    }
+
+    return true;
+}
+
+static bool pushMatch(JStarVM* vm, RegexState* rs, bool spans) {
+    bool (*pushFn)(JStarVM*, RegexState*, int) = spans ? pushSpan : pushCapture;
+
+    if(rs->captureCount <= 2) {
+        return pushFn(vm, rs, rs->captureCount - 1);
+    }
+
+    for(int i = 1; i < rs->captureCount; i++) {
+        if(!pushFn(vm, rs, i)) return false;
+    }
+    jsrPushTuple(vm, rs->captureCount - 1);
+    return true;
+}
+
 JSR_NATIVE(jsr_re_match) {
     RegexState rs;
     FindRes res = find(vm, &rs);
@@ -424,19 +777,7 @@ JSR_NATIVE(jsr_re_match) {
     // No match could be found, return succesfully
     if(res == FIND_NOMATCH) return true;
 
-    if(rs.captureCount <= 2) {
-        if(!pushCapture(vm, &rs, rs.captureCount - 1)) return false;
-    } else {
-        ObjTuple* ret = newTuple(vm, rs.captureCount - 1);
-        push(vm, OBJ_VAL(ret));
-
-        for(int i = 1; i < rs.captureCount; i++) {
-            if(!pushCapture(vm, &rs, i)) return false;
-            ret->arr[i - 1] = pop(vm);
-        }
-    }
-
-    return true;
+    return pushMatch(vm, &rs, false);
 }
 
 JSR_NATIVE(jsr_re_find) {
@@ -472,11 +813,12 @@ static bool madeProgress(const Substring* match, const char* lastMatch) {
 
 JSR_NATIVE(jsr_re_gmatch) {
     JSR_CHECK(String, 1, "str");
-    JSR_CHECK(String, 2, "regex");
+
+    const Regex* re = getRegex(vm, 2);
+    if(re == NULL) return false;
 
     size_t len = jsrGetStringSz(vm, 1);
     const char* str = jsrGetString(vm, 1);
-    const char* regex = jsrGetString(vm, 2);
 
     jsrPushList(vm);
 
@@ -485,7 +827,7 @@ JSR_NATIVE(jsr_re_gmatch) {
 
     while(offset <= len) {
         RegexState rs;
-        if(!matchRegex(&rs, str, len, regex, offset)) {
+        if(!matchRegex(&rs, re, str, len, offset)) {
             if(hadError(&rs)) {
                 JSR_RAISE(vm, "RegexException", getError(&rs));
             }
@@ -500,28 +842,69 @@ JSR_NATIVE(jsr_re_gmatch) {
             continue;
         }
 
-        if(rs.captureCount <= 2) {
-            if(!pushCapture(vm, &rs, rs.captureCount - 1)) return false;
-            jsrListAppend(vm, -2);
-            jsrPop(vm);
-        } else {
-            ObjTuple* tup = newTuple(vm, rs.captureCount - 1);
-            push(vm, OBJ_VAL(tup));
+        if(!pushMatch(vm, &rs, false)) return false;
+        jsrListAppend(vm, -2);
+        jsrPop(vm);
+
+        // An anchored regex can only match at the start of the string
+        if(re->anchored) break;
+
+        lastMatch = match->start + match->length;
+        offset = lastMatch - str;
+    }
+
+    return true;
+}
 
-            for(int i = 1; i < rs.captureCount; i++) {
-                if(!pushCapture(vm, &rs, i)) return false;
-                tup->arr[i - 1] = pop(vm);
+JSR_NATIVE(jsr_re_MatchIter_iter) {
+    // The state of the iteration is kept in the fields of the MatchIter, so that matches are
+    // searched only when requested. Slots 2 to 6 hold the fields
+    if(!jsrGetField(vm, 0, M_ITER_STRING)) return false;
+    JSR_CHECK(String, 2, "string");
+    if(!jsrGetField(vm, 0, M_ITER_REGEX)) return false;
+    if(!jsrGetField(vm, 0, M_ITER_SPANS)) return false;
+    if(!jsrGetField(vm, 0, M_ITER_OFFSET)) return false;
+    if(!jsrGetField(vm, 0, M_ITER_LAST_MATCH)) return false;
+
+    const Regex* re = getRegex(vm, 3);
+    if(re == NULL) return false;
+
+    size_t len = jsrGetStringSz(vm, 2);
+    const char* str = jsrGetString(vm, 2);
+    bool spans = valueToBool(vm->apiStack[4]);
+    size_t offset = jsrGetNumber(vm, 5);
+    const char* lastMatch = jsrIsNull(vm, 6) ? NULL : str + (size_t)jsrGetNumber(vm, 6);
+
+    while(offset <= len) {
+        RegexState rs;
+        if(!matchRegex(&rs, re, str, len, offset)) {
+            if(hadError(&rs)) {
+                JSR_RAISE(vm, "RegexException", getError(&rs));
             }
+            break;
+        }
 
-            jsrListAppend(vm, -2);
-            jsrPop(vm);
+        const Substring* match = &rs.captures[0];
+
+        // We got an empty match, increase the offset and try again
+        if(!madeProgress(match, lastMatch)) {
+            offset++;
+            continue;
         }
 
-        ptrdiff_t offsetSinceLastMatch = match->start - (lastMatch ? lastMatch : str);
-        offset += offsetSinceLastMatch + match->length;
-        lastMatch = match->start + match->length;
+        // Anchored regexes match only once, at the start of the string
+        size_t matchEnd = match->start + match->length - str;
+        jsrPushNumber(vm, re->anchored ? len + 1 : matchEnd);
+        jsrSetField(vm, 0, M_ITER_OFFSET);
+        jsrPop(vm);
+        jsrPushNumber(vm, matchEnd);
+        jsrSetField(vm, 0, M_ITER_LAST_MATCH);
+        jsrPop(vm);
+
+        return pushMatch(vm, &rs, spans);
     }
 
+    jsrPushNull(vm);
     return true;
 }
 
@@ -568,18 +951,39 @@ static bool substituteCall(JStarVM* vm, RegexState* rs, JStarBuffer* b, int fnSl
     return true;
 }
 
+// Writes the content of the buffer to the object in `slot` by calling its `write` method
+static bool flushBuffer(JStarVM* vm, JStarBuffer* b, int slot) {
+    if(b->size == 0) return true;
+    jsrPushValue(vm, slot);
+    jsrPushStringSz(vm, b->data, b->size);
+    if(jsrCallMethod(vm, "write", 1) != JSR_SUCCESS) return false;
+    jsrPop(vm);
+    jsrBufferClear(b);
+    return true;
+}
+
 JSR_NATIVE(jsr_re_gsub) {
     JSR_CHECK(String, 1, "str");
-    JSR_CHECK(String, 2, "regex");
     JSR_CHECK(Int, 4, "num");
 
+    // When an output object is provided the result is written to it in chunks as it is produced,
+    // instead of being accumulated in a String
+    bool stream = !jsrIsNull(vm, 5);
+
     if(!jsrIsString(vm, 3) && !jsrIsFunction(vm, 3)) {
         JSR_RAISE(vm, "TypeException", "sub must be either a String or a Function.");
     }
 
+    const Regex* re = getRegex(vm, 2);
+    if(re == NULL) return false;
+
+    // The substitution function could use other regexes, evicting this one from the cache
+    if(jsrIsFunction(vm, 3) && jsrIsString(vm, 2)) {
+        re = pinRegex(vm, re);
+    }
+
     size_t len = jsrGetStringSz(vm, 1);
     const char* str = jsrGetString(vm, 1);
-    const char* regex = jsrGetString(vm, 2);
     int num = jsrGetNumber(vm, 4);
 
     JStarBuffer buf;
@@ -591,7 +995,7 @@ JSR_NATIVE(jsr_re_gsub) {
 
     while(offset <= len) {
         RegexState rs;
-        if(!matchRegex(&rs, str, len, regex, offset)) {
+        if(!matchRegex(&rs, re, str, len, offset)) {
             if(hadError(&rs)) {
                 jsrBufferFree(&buf);
                 JSR_RAISE(vm, "RegexException", getError(&rs));
@@ -624,16 +1028,39 @@ JSR_NATIVE(jsr_re_gsub) {
             }
         }
 
-        offset += offsetSinceLastMatch + match->length;
+        if(stream && buf.size >= STREAM_CHUNK_SIZE && !flushBuffer(vm, &buf, 5)) {
+            jsrBufferFree(&buf);
+            return false;
+        }
+
         lastMatch = match->start + match->length;
+        offset = lastMatch - str;
 
         numSub++;
-        if(num > 0 && numSub >= num) {
+        if(re->anchored || (num > 0 && numSub >= num)) {
             break;
         }
     }
 
-    if(lastMatch != NULL) {
+    if(stream) {
+        if(lastMatch != NULL) {
+            jsrBufferAppend(&buf, lastMatch, str + len - lastMatch);
+            if(!flushBuffer(vm, &buf, 5)) {
+                jsrBufferFree(&buf);
+                return false;
+            }
+        } else {
+            jsrPushValue(vm, 5);
+            jsrPushValue(vm, 1);
+            if(jsrCallMethod(vm, "write", 1) != JSR_SUCCESS) {
+                jsrBufferFree(&buf);
+                return false;
+            }
+            jsrPop(vm);
+        }
+        jsrBufferFree(&buf);
+        jsrPushNumber(vm, numSub);
+    } else if(lastMatch != NULL) {
         // Append the remaining string to the output
         jsrBufferAppend(&buf, lastMatch, str + len - lastMatch);
         jsrBufferPush(&buf);
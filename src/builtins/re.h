@@ -3,9 +3,22 @@
 
 #include "jstar.h"
 
+// Cache of compiled regexes owned by the VM (see re.c)
+typedef struct RegexCache RegexCache;
+
+void freeRegexCache(JStarVM* vm);
+
 JSR_NATIVE(jsr_re_match);
 JSR_NATIVE(jsr_re_find);
 JSR_NATIVE(jsr_re_gmatch);
 JSR_NATIVE(jsr_re_gsub);
 
+// class MatchIter
+JSR_NATIVE(jsr_re_MatchIter_iter);
+// end MatchIter
+
+// class Pattern
+JSR_NATIVE(jsr_re_Pattern_new);
+// end Pattern
+
 #endif
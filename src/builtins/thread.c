@@ -0,0 +1,921 @@
+#include "thread.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gc.h"
+#include "import.h"
+#include "object.h"
+#include "serialize.h"
+#include "sync.h"
+#include "value.h"
+#include "vm.h"
+
+// Maximum nesting of containers in a transferred value. Also rejects cyclic values
+#define MAX_DEPTH 256
+
+#define M_THREAD_STATE  "_state"
+#define M_CHANNEL_STATE "_channel"
+
+// -----------------------------------------------------------------------------
+// MESSAGES
+// -----------------------------------------------------------------------------
+
+// VMs running on different threads share no objects, so values are transferred between them
+// by encoding them in a Message, a VM independent representation. Encoding performs a deep copy
+// of the value, and its Message is then handed off to the receiving VM that decodes it.
+// Functions are transferred as compiled code, while Modules, and functions and natives that are
+// globals of a module other than the main one, are transferred by name and resolved in the
+// receiving VM, importing their module if needed.
+
+typedef enum MessageTag {
+    MSG_NULL,
+    MSG_TRUE,
+    MSG_FALSE,
+    MSG_NUM,
+    MSG_STRING,
+    MSG_LIST,
+    MSG_TUPLE,
+    MSG_TABLE,
+    MSG_MODULE,
+    MSG_GLOBAL,
+    MSG_FUNCTION,
+    MSG_CHANNEL,
+} MessageTag;
+
+typedef struct SharedChannel SharedChannel;
+
+typedef struct Message {
+    uint8_t* data;
+    size_t size, capacity;
+    SharedChannel** channels;  // Channels referenced by the message, kept alive until it's freed
+    size_t channelCount, channelCapacity;
+    struct Message* next;  // The next message in the queue of a channel
+} Message;
+
+static void releaseChannel(SharedChannel* ch);
+static void retainChannel(SharedChannel* ch);
+
+static Message* newMessage(void) {
+    return calloc(1, sizeof(Message));
+}
+
+static void freeMessage(Message* msg) {
+    for(size_t i = 0; i < msg->channelCount; i++) {
+        releaseChannel(msg->channels[i]);
+    }
+    free(msg->channels);
+    free(msg->data);
+    free(msg);
+}
+
+static void msgWriteData(Message* msg, const void* data, size_t size) {
+    if(msg->size + size > msg->capacity) {
+        size_t newCap = msg->capacity ? msg->capacity : 64;
+        while(newCap < msg->size + size) newCap *= 2;
+        msg->data = realloc(msg->data, newCap);
+        msg->capacity = newCap;
+    }
+    memcpy(msg->data + msg->size, data, size);
+    msg->size += size;
+}
+
+static void msgWriteByte(Message* msg, uint8_t byte) {
+    msgWriteData(msg, &byte, 1);
+}
+
+static void msgWriteSize(Message* msg, size_t size) {
+    msgWriteData(msg, &size, sizeof(size));
+}
+
+static void msgWriteString(Message* msg, const char* str, size_t length) {
+    msgWriteSize(msg, length);
+    msgWriteData(msg, str, length);
+}
+
+static void addChannel(Message* msg, SharedChannel* ch) {
+    if(msg->channelCount == msg->channelCapacity) {
+        msg->channelCapacity = msg->channelCapacity ? msg->channelCapacity * 2 : 4;
+        msg->channels = realloc(msg->channels, sizeof(SharedChannel*) * msg->channelCapacity);
+    }
+    retainChannel(ch);
+    msg->channels[msg->channelCount++] = ch;
+    msgWriteData(msg, &ch, sizeof(ch));
+}
+
+typedef struct Reader {
+    const Message* msg;
+    size_t ptr;
+} Reader;
+
+static void msgReadData(Reader* r, void* out, size_t size) {
+    ASSERT(r->ptr + size <= r->msg->size, "Read past the end of the message");
+    memcpy(out, r->msg->data + r->ptr, size);
+    r->ptr += size;
+}
+
+static uint8_t msgReadByte(Reader* r) {
+    uint8_t byte;
+    msgReadData(r, &byte, 1);
+    return byte;
+}
+
+static size_t msgReadSize(Reader* r) {
+    size_t size;
+    msgReadData(r, &size, sizeof(size));
+    return size;
+}
+
+// Returns a pointer to a string of `length` bytes inside of the message
+static const char* msgReadString(Reader* r, size_t* length) {
+    *length = msgReadSize(r);
+    const char* str = (const char*)r->msg->data + r->ptr;
+    r->ptr += *length;
+    return str;
+}
+
+// -----------------------------------------------------------------------------
+// ENCODING
+// -----------------------------------------------------------------------------
+
+static void finalizeChannel(void* data);
+
+// Whether `v` is the global variable `name` of `mod`, so that it can be transferred by name
+static bool isModuleGlobal(JStarVM* vm, ObjModule* mod, ObjString* name, Value v) {
+    if(mod == NULL || strcmp(mod->name->data, JSR_MAIN_MODULE) == 0) return false;
+    Value global;
+    return moduleGetGlobal(mod, name, &global) && valueEquals(global, v);
+}
+
+static SharedChannel* getSharedChannel(JStarVM* vm, ObjInstance* inst) {
+    Value ud;
+    ObjString* field = copyString(vm, M_CHANNEL_STATE, strlen(M_CHANNEL_STATE));
+    if(!instanceGetField(inst, field, &ud) || !IS_USERDATA(ud)) return NULL;
+
+    ObjUserdata* data = AS_USERDATA(ud);
+    if(data->finalize != &finalizeChannel) return NULL;
+    return *(SharedChannel**)data->data;
+}
+
+static bool encodeValue(JStarVM* vm, Message* msg, Value v, int depth);
+
+static bool encodeContainer(JStarVM* vm, Message* msg, MessageTag tag, const Value* arr,
+                            size_t size, int depth) {
+    msgWriteByte(msg, tag);
+    msgWriteSize(msg, size);
+    for(size_t i = 0; i < size; i++) {
+        if(!encodeValue(vm, msg, arr[i], depth + 1)) return false;
+    }
+    return true;
+}
+
+static bool encodeTable(JStarVM* vm, Message* msg, ObjTable* t, int depth) {
+    msgWriteByte(msg, MSG_TABLE);
+    msgWriteSize(msg, t->size);
+    if(t->entries == NULL) return true;
+
+    for(size_t i = 0; i < t->numEntries; i++) {
+        TableEntry* e = &t->entries[i];
+        if(!IS_NULL(e->key)) {
+            if(!encodeValue(vm, msg, e->key, depth + 1)) return false;
+            if(!encodeValue(vm, msg, e->val, depth + 1)) return false;
+        }
+    }
+    return true;
+}
+
+static void encodeGlobal(Message* msg, ObjModule* mod, ObjString* name) {
+    msgWriteByte(msg, MSG_GLOBAL);
+    msgWriteString(msg, mod->name->data, mod->name->length);
+    msgWriteString(msg, name->data, name->length);
+}
+
+static bool encodeClosure(JStarVM* vm, Message* msg, ObjClosure* closure) {
+    Prototype* proto = &closure->fn->proto;
+    if(isModuleGlobal(vm, proto->module, proto->name, OBJ_VAL(closure))) {
+        encodeGlobal(msg, proto->module, proto->name);
+        return true;
+    }
+
+    if(closure->upvalueCount > 0) {
+        jsrRaise(vm, "TypeException", "Cannot transfer function `%s`: it captures local variables",
+                 proto->name->data);
+        return false;
+    }
+
+    msgWriteByte(msg, MSG_FUNCTION);
+    msgWriteString(msg, proto->module->name->data, proto->module->name->length);
+
+    JStarBuffer code = serialize(vm, closure->fn);
+    msgWriteString(msg, code.data, code.size);
+    jsrBufferFree(&code);
+    return true;
+}
+
+static bool encodeValue(JStarVM* vm, Message* msg, Value v, int depth) {
+    if(depth > MAX_DEPTH) {
+        jsrRaise(vm, "TypeException", "Cannot transfer value: too deeply nested (or cyclic)");
+        return false;
+    }
+
+    if(IS_NULL(v)) {
+        msgWriteByte(msg, MSG_NULL);
+        return true;
+    }
+    if(IS_BOOL(v)) {
+        msgWriteByte(msg, AS_BOOL(v) ? MSG_TRUE : MSG_FALSE);
+        return true;
+    }
+    if(IS_NUM(v)) {
+        double num = AS_NUM(v);
+        msgWriteByte(msg, MSG_NUM);
+        msgWriteData(msg, &num, sizeof(num));
+        return true;
+    }
+
+    if(IS_OBJ(v)) {
+        Obj* o = AS_OBJ(v);
+        switch(o->type) {
+        case OBJ_STRING:
+            msgWriteByte(msg, MSG_STRING);
+            msgWriteString(msg, AS_STRING(v)->data, AS_STRING(v)->length);
+            return true;
+        case OBJ_LIST:
+            return encodeContainer(vm, msg, MSG_LIST, AS_LIST(v)->arr, AS_LIST(v)->size, depth);
+        case OBJ_TUPLE:
+            return encodeContainer(vm, msg, MSG_TUPLE, AS_TUPLE(v)->arr, AS_TUPLE(v)->size, depth);
+        case OBJ_TABLE:
+            return encodeTable(vm, msg, AS_TABLE(v), depth);
+        case OBJ_MODULE:
+            msgWriteByte(msg, MSG_MODULE);
+            msgWriteString(msg, AS_MODULE(v)->name->data, AS_MODULE(v)->name->length);
+            return true;
+        case OBJ_CLOSURE:
+            return encodeClosure(vm, msg, AS_CLOSURE(v));
+        case OBJ_NATIVE: {
+            Prototype* proto = &AS_NATIVE(v)->proto;
+            if(isModuleGlobal(vm, proto->module, proto->name, v)) {
+                encodeGlobal(msg, proto->module, proto->name);
+                return true;
+            }
+            break;
+        }
+        case OBJ_INST: {
+            SharedChannel* ch = getSharedChannel(vm, AS_INSTANCE(v));
+            if(ch != NULL) {
+                msgWriteByte(msg, MSG_CHANNEL);
+                addChannel(msg, ch);
+                return true;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    jsrRaise(vm, "TypeException", "Cannot transfer value of type %s",
+             getClass(vm, v)->name->data);
+    return false;
+}
+
+// Whether a global of the main module is copied in the main module of new threads
+static bool isCopiedGlobal(JStarVM* vm, Value v) {
+    if(IS_NULL(v) || IS_BOOL(v) || IS_NUM(v) || IS_STRING(v) || IS_MODULE(v)) {
+        return true;
+    }
+    if(IS_CLOSURE(v)) {
+        return AS_CLOSURE(v)->upvalueCount == 0;
+    }
+    if(IS_NATIVE(v)) {
+        Prototype* proto = &AS_NATIVE(v)->proto;
+        return isModuleGlobal(vm, proto->module, proto->name, v);
+    }
+    return false;
+}
+
+// The main module can't be imported by other VMs, so a copy of its functions, imported names and
+// constants is sent to new threads for the functions defined in it to work.
+// Everything else (classes, containers and instances) must be passed explicitly
+static bool encodeMainGlobals(JStarVM* vm, Message* msg) {
+    ObjModule* main = getModule(vm, copyString(vm, JSR_MAIN_MODULE, strlen(JSR_MAIN_MODULE)));
+    if(main == NULL) {
+        msgWriteSize(msg, 0);
+        return true;
+    }
+
+    size_t count = 0;
+    const HashTable* names = &main->globalNames;
+    for(const Entry* e = names->entries; e < names->entries + names->sizeMask + 1; e++) {
+        if(e->key && isCopiedGlobal(vm, main->globals.arr[(size_t)AS_NUM(e->value)])) {
+            count++;
+        }
+    }
+
+    msgWriteSize(msg, count);
+    for(const Entry* e = names->entries; e < names->entries + names->sizeMask + 1; e++) {
+        Value v = e->key ? main->globals.arr[(size_t)AS_NUM(e->value)] : NULL_VAL;
+        if(e->key && isCopiedGlobal(vm, v)) {
+            msgWriteString(msg, e->key->data, e->key->length);
+            if(!encodeValue(vm, msg, v, 0)) return false;
+        }
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// DECODING
+// -----------------------------------------------------------------------------
+
+static bool pushChannel(JStarVM* vm, SharedChannel* ch);
+
+// Gets a module, importing it if it isn't loaded yet
+static ObjModule* loadModule(JStarVM* vm, const char* name, size_t length) {
+    jsrEnsureStack(vm, 2);
+    ObjString* modName = copyString(vm, name, length);
+    push(vm, OBJ_VAL(modName));
+
+    ObjModule* mod = getModule(vm, modName);
+    if(mod == NULL || mod->lazy) {
+        mod = importModuleSync(vm, modName);
+        if(mod == NULL) {
+            swapStackSlots(vm, -1, -2);
+            pop(vm);
+            return NULL;
+        }
+    }
+
+    pop(vm);
+    return mod;
+}
+
+static bool decodeFunction(JStarVM* vm, Reader* r) {
+    size_t length;
+    const char* name = msgReadString(r, &length);
+    ObjModule* mod = loadModule(vm, name, length);
+    if(mod == NULL) return false;
+
+    size_t size;
+    const char* data = msgReadString(r, &size);
+    JStarBuffer code = jsrBufferWrap(vm, data, size);
+
+    JStarResult res;
+    ObjFunction* fn = deserialize(vm, mod, &code, DESERIALIZE_COPY, &res);
+    if(fn == NULL) {
+        jsrRaise(vm, "Exception", "Malformed function received from another thread");
+        return false;
+    }
+
+    push(vm, OBJ_VAL(fn));
+    ObjClosure* closure = newClosure(vm, fn);
+    pop(vm);
+    push(vm, OBJ_VAL(closure));
+    return true;
+}
+
+static bool decodeGlobal(JStarVM* vm, Reader* r) {
+    size_t modLength, nameLength;
+    const char* modName = msgReadString(r, &modLength);
+    const char* name = msgReadString(r, &nameLength);
+
+    ObjModule* mod = loadModule(vm, modName, modLength);
+    if(mod == NULL) return false;
+
+    Value global;
+    if(!moduleGetGlobal(mod, copyString(vm, name, nameLength), &global)) {
+        jsrRaise(vm, "NameException", "Name `%.*s` not defined in module `%s`.", (int)nameLength,
+                 name, mod->name->data);
+        return false;
+    }
+
+    push(vm, global);
+    return true;
+}
+
+// Decodes the next value of the message and pushes it on the stack
+static bool decodeValue(JStarVM* vm, Reader* r) {
+    jsrEnsureStack(vm, 3);
+
+    switch((MessageTag)msgReadByte(r)) {
+    case MSG_NULL:
+        push(vm, NULL_VAL);
+        return true;
+    case MSG_TRUE:
+        push(vm, TRUE_VAL);
+        return true;
+    case MSG_FALSE:
+        push(vm, FALSE_VAL);
+        return true;
+    case MSG_NUM: {
+        double num;
+        msgReadData(r, &num, sizeof(num));
+        push(vm, NUM_VAL(num));
+        return true;
+    }
+    case MSG_STRING: {
+        size_t length;
+        const char* str = msgReadString(r, &length);
+        jsrPushStringSz(vm, str, length);
+        return true;
+    }
+    case MSG_LIST: {
+        size_t size = msgReadSize(r);
+        jsrPushListCapacity(vm, size);
+        for(size_t i = 0; i < size; i++) {
+            if(!decodeValue(vm, r)) return false;
+            jsrListAppend(vm, -2);
+            jsrPop(vm);
+        }
+        return true;
+    }
+    case MSG_TUPLE: {
+        size_t size = msgReadSize(r);
+        for(size_t i = 0; i < size; i++) {
+            if(!decodeValue(vm, r)) return false;
+        }
+        jsrPushTuple(vm, size);
+        return true;
+    }
+    case MSG_TABLE: {
+        size_t size = msgReadSize(r);
+        jsrPushTableCapacity(vm, size);
+        for(size_t i = 0; i < size; i++) {
+            if(!decodeValue(vm, r) || !decodeValue(vm, r)) return false;
+            if(!jsrSubscriptSet(vm, -3)) return false;
+            jsrPop(vm);
+        }
+        return true;
+    }
+    case MSG_MODULE: {
+        size_t length;
+        const char* name = msgReadString(r, &length);
+        ObjModule* mod = loadModule(vm, name, length);
+        if(mod == NULL) return false;
+        push(vm, OBJ_VAL(mod));
+        return true;
+    }
+    case MSG_GLOBAL:
+        return decodeGlobal(vm, r);
+    case MSG_FUNCTION:
+        return decodeFunction(vm, r);
+    case MSG_CHANNEL: {
+        SharedChannel* ch;
+        msgReadData(r, &ch, sizeof(ch));
+        return pushChannel(vm, ch);
+    }
+    }
+
+    UNREACHABLE();
+    return false;
+}
+
+// Defines the globals copied from the main module of the parent VM that aren't already defined
+static bool decodeMainGlobals(JStarVM* vm, ObjModule* main, Reader* r) {
+    size_t count = msgReadSize(r);
+    for(size_t i = 0; i < count; i++) {
+        size_t length;
+        const char* name = msgReadString(r, &length);
+        if(!decodeValue(vm, r)) return false;
+
+        ObjString* nameStr = copyString(vm, name, length);
+        Value existing;
+        if(!moduleGetGlobal(main, nameStr, &existing)) {
+            moduleSetGlobal(main, nameStr, peek(vm));
+        }
+        pop(vm);
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// CHANNEL
+// -----------------------------------------------------------------------------
+
+// The state of a channel, shared by the Channel objects of all the VMs that can access it
+struct SharedChannel {
+    Mutex lock;
+    Cond readable, writable;
+    int refs;
+    size_t capacity;  // Maximum number of queued messages, 0 if unbounded
+    size_t count;
+    bool closed;
+    Message *head, *tail;
+};
+
+static SharedChannel* newSharedChannel(size_t capacity) {
+    SharedChannel* ch = calloc(1, sizeof(*ch));
+    initMutex(&ch->lock);
+    initCond(&ch->readable);
+    initCond(&ch->writable);
+    ch->refs = 1;
+    ch->capacity = capacity;
+    return ch;
+}
+
+static void retainChannel(SharedChannel* ch) {
+    lockMutex(&ch->lock);
+    ch->refs++;
+    unlockMutex(&ch->lock);
+}
+
+static void releaseChannel(SharedChannel* ch) {
+    lockMutex(&ch->lock);
+    int refs = --ch->refs;
+    unlockMutex(&ch->lock);
+
+    if(refs == 0) {
+        Message* msg = ch->head;
+        while(msg) {
+            Message* next = msg->next;
+            freeMessage(msg);
+            msg = next;
+        }
+        freeCond(&ch->readable);
+        freeCond(&ch->writable);
+        freeMutex(&ch->lock);
+        free(ch);
+    }
+}
+
+static void finalizeChannel(void* data) {
+    releaseChannel(*(SharedChannel**)data);
+}
+
+// Sets the shared state of the Channel object at the top of the stack, taking a new reference
+static void setSharedChannel(JStarVM* vm, SharedChannel* ch) {
+    SharedChannel** data = jsrPushUserdata(vm, sizeof(SharedChannel*), &finalizeChannel);
+    *data = ch;
+    jsrSetField(vm, -2, M_CHANNEL_STATE);
+    jsrPop(vm);
+}
+
+static bool pushChannel(JStarVM* vm, SharedChannel* ch) {
+    if(!jsrGetGlobal(vm, "thread", "Channel")) return false;
+    push(vm, OBJ_VAL(newInstance(vm, AS_CLASS(peek(vm)))));
+    swapStackSlots(vm, -1, -2);
+    pop(vm);
+
+    retainChannel(ch);
+    setSharedChannel(vm, ch);
+    return true;
+}
+
+static SharedChannel* getChannel(JStarVM* vm) {
+    if(!jsrGetField(vm, 0, M_CHANNEL_STATE)) return NULL;
+    if(!jsrCheckUserdata(vm, -1, M_CHANNEL_STATE)) return NULL;
+    SharedChannel* ch = *(SharedChannel**)jsrGetUserdata(vm, -1);
+    jsrPop(vm);
+    return ch;
+}
+
+// Waits for a message, returning NULL if the channel is closed and empty
+static Message* receiveMessage(SharedChannel* ch) {
+    lockMutex(&ch->lock);
+    while(ch->head == NULL && !ch->closed) {
+        waitCond(&ch->readable, &ch->lock);
+    }
+
+    Message* msg = ch->head;
+    if(msg != NULL) {
+        ch->head = msg->next;
+        if(ch->head == NULL) ch->tail = NULL;
+        ch->count--;
+        signalCond(&ch->writable);
+    }
+
+    unlockMutex(&ch->lock);
+    return msg;
+}
+
+static bool pushMessage(JStarVM* vm, Message* msg) {
+    Reader r = {msg, 0};
+    bool ok = decodeValue(vm, &r);
+    freeMessage(msg);
+    return ok;
+}
+
+JSR_NATIVE(jsr_Channel_new) {
+    JSR_CHECK(Int, 1, "capacity");
+    if(jsrGetNumber(vm, 1) < 0) {
+        JSR_RAISE(vm, "InvalidArgException", "capacity must be >= 0");
+    }
+
+    jsrPushValue(vm, 0);
+    setSharedChannel(vm, newSharedChannel((size_t)jsrGetNumber(vm, 1)));
+    return true;
+}
+
+JSR_NATIVE(jsr_Channel_send) {
+    SharedChannel* ch = getChannel(vm);
+    if(ch == NULL) return false;
+
+    Message* msg = newMessage();
+    if(!encodeValue(vm, msg, vm->apiStack[1], 0)) {
+        freeMessage(msg);
+        return false;
+    }
+
+    lockMutex(&ch->lock);
+    while(!ch->closed && ch->capacity && ch->count >= ch->capacity) {
+        waitCond(&ch->writable, &ch->lock);
+    }
+
+    if(ch->closed) {
+        unlockMutex(&ch->lock);
+        freeMessage(msg);
+        JSR_RAISE(vm, "ThreadException", "Channel is closed");
+    }
+
+    if(ch->tail) {
+        ch->tail->next = msg;
+    } else {
+        ch->head = msg;
+    }
+    ch->tail = msg;
+    ch->count++;
+    signalCond(&ch->readable);
+    unlockMutex(&ch->lock);
+
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_Channel_receive) {
+    SharedChannel* ch = getChannel(vm);
+    if(ch == NULL) return false;
+
+    Message* msg = receiveMessage(ch);
+    if(msg == NULL) {
+        JSR_RAISE(vm, "ThreadException", "Channel is closed");
+    }
+    return pushMessage(vm, msg);
+}
+
+JSR_NATIVE(jsr_Channel_close) {
+    SharedChannel* ch = getChannel(vm);
+    if(ch == NULL) return false;
+
+    lockMutex(&ch->lock);
+    ch->closed = true;
+    broadcastCond(&ch->readable);
+    broadcastCond(&ch->writable);
+    unlockMutex(&ch->lock);
+
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_Channel_isClosed) {
+    SharedChannel* ch = getChannel(vm);
+    if(ch == NULL) return false;
+
+    lockMutex(&ch->lock);
+    bool closed = ch->closed;
+    unlockMutex(&ch->lock);
+
+    jsrPushBoolean(vm, closed);
+    return true;
+}
+
+// Iteration receives messages until the channel is closed. The iterator is a Tuple holding the
+// received value, so that null and false messages don't stop it
+JSR_NATIVE(jsr_Channel_iter) {
+    SharedChannel* ch = getChannel(vm);
+    if(ch == NULL) return false;
+
+    Message* msg = receiveMessage(ch);
+    if(msg == NULL) {
+        jsrPushBoolean(vm, false);
+        return true;
+    }
+
+    if(!pushMessage(vm, msg)) return false;
+    jsrPushTuple(vm, 1);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// THREAD
+// -----------------------------------------------------------------------------
+
+// The state of a thread, shared by the Thread object and the running thread
+typedef struct ThreadState {
+    Mutex lock;
+    int refs;
+    bool done;
+    bool joined;  // Only accessed by the VM owning the Thread object
+    Thread thread;
+    JStarConf conf;
+    char* mainPath;
+    char* bytecodeCacheDir;
+    char** importPaths;
+    size_t importPathCount;
+    Message* task;    // Copy of the main module globals, the function and its arguments
+    Message* result;  // The return value of the function, NULL if it raised an exception
+    char* error;      // The stacktrace of the exception raised by the function, if any
+} ThreadState;
+
+static char* copyCString(const char* str, size_t length) {
+    char* copy = malloc(length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void releaseThread(ThreadState* t) {
+    lockMutex(&t->lock);
+    int refs = --t->refs;
+    unlockMutex(&t->lock);
+
+    if(refs == 0) {
+        for(size_t i = 0; i < t->importPathCount; i++) {
+            free(t->importPaths[i]);
+        }
+        free(t->importPaths);
+        free(t->mainPath);
+        free(t->bytecodeCacheDir);
+        if(t->task) freeMessage(t->task);
+        if(t->result) freeMessage(t->result);
+        free(t->error);
+        freeMutex(&t->lock);
+        free(t);
+    }
+}
+
+static void finalizeThread(void* data) {
+    ThreadState* t = *(ThreadState**)data;
+    if(!t->joined) {
+        detachThread(&t->thread);
+    }
+    releaseThread(t);
+}
+
+// Runs the task of the thread, leaving its result or the raised exception on top of the stack
+static bool runTask(JStarVM* vm, ThreadState* t) {
+    jsrEnsureStack(vm, 1);
+    ObjString* mainName = copyString(vm, JSR_MAIN_MODULE, strlen(JSR_MAIN_MODULE));
+    push(vm, OBJ_VAL(mainName));
+    ObjModule* main = newModule(vm, t->mainPath, mainName);
+    setModule(vm, mainName, main);
+    pop(vm);
+
+    // Exceptions raised while decoding are looked up in the main module
+    vm->module = main;
+
+    Reader r = {t->task, 0};
+    if(!decodeMainGlobals(vm, main, &r)) return false;
+    if(!decodeValue(vm, &r)) return false;
+    if(!decodeValue(vm, &r)) return false;
+
+    // Call a copy of the function, keeping the argument Tuple alive below it
+    size_t argc = jsrTupleGetLength(vm, -1);
+    jsrEnsureStack(vm, argc + 1);
+    jsrPushValue(vm, -2);
+    for(size_t i = 0; i < argc; i++) {
+        jsrTupleGet(vm, i, -2 - i);
+    }
+    return jsrCall(vm, argc) == JSR_SUCCESS;
+}
+
+static void runThread(void* arg) {
+    ThreadState* t = arg;
+    JStarVM* vm = jsrNewVM(&t->conf);
+
+    for(size_t i = 0; i < t->importPathCount; i++) {
+        jsrAddImportPath(vm, t->importPaths[i]);
+    }
+
+    bool ok = runTask(vm, t);
+    if(ok) {
+        Message* result = newMessage();
+        ok = encodeValue(vm, result, peek(vm), 0);
+        if(ok) {
+            t->result = result;
+        } else {
+            freeMessage(result);
+        }
+    }
+
+    if(!ok) {
+        jsrGetStacktrace(vm, -1);
+        t->error = copyCString(jsrGetString(vm, -1), jsrGetStringSz(vm, -1));
+    }
+
+    jsrFreeVM(vm);
+
+    lockMutex(&t->lock);
+    t->done = true;
+    unlockMutex(&t->lock);
+    releaseThread(t);
+}
+
+static ThreadState* newThreadState(JStarVM* vm, Message* task) {
+    ThreadState* t = calloc(1, sizeof(*t));
+    initMutex(&t->lock);
+    t->refs = 2;
+    t->task = task;
+
+    t->conf = jsrGetConf();
+    t->conf.heapGrowRate = vm->heapGrowRate;
+    t->conf.generationalGC = vm->generationalGC;
+    t->conf.nurserySize = vm->nurserySize;
+    t->conf.maxInternedLength = vm->maxInternedLength;
+    t->conf.errorCallback = vm->errorCallback;
+    t->conf.codeCache = vm->codeCache;
+    t->conf.evalCacheSize = vm->evalCache.capacity;
+    t->conf.streamCompileSize = vm->streamCompileSize;
+    t->conf.lazyImports = vm->lazyImports;
+    t->conf.traceImports = vm->traceImports;
+    t->conf.bytecodeCache = vm->bytecodeCache;
+    if(vm->bytecodeCacheDir) {
+        t->bytecodeCacheDir = copyCString(vm->bytecodeCacheDir, strlen(vm->bytecodeCacheDir));
+        t->conf.bytecodeCacheDir = t->bytecodeCacheDir;
+    }
+
+    ObjModule* main = getModule(vm, copyString(vm, JSR_MAIN_MODULE, strlen(JSR_MAIN_MODULE)));
+    const char* mainPath = main ? main->path->data : "<thread>";
+    t->mainPath = copyCString(mainPath, strlen(mainPath));
+
+    ObjList* paths = vm->importPaths;
+    t->importPaths = malloc(sizeof(char*) * (paths->size ? paths->size : 1));
+    for(size_t i = 0; i < paths->size; i++) {
+        ObjString* path = AS_STRING(paths->arr[i]);
+        t->importPaths[t->importPathCount++] = copyCString(path->data, path->length);
+    }
+
+    return t;
+}
+
+static ThreadState* getThread(JStarVM* vm) {
+    if(!jsrGetField(vm, 0, M_THREAD_STATE)) return NULL;
+    if(!jsrCheckUserdata(vm, -1, M_THREAD_STATE)) return NULL;
+    ThreadState* t = *(ThreadState**)jsrGetUserdata(vm, -1);
+    jsrPop(vm);
+    return t;
+}
+
+JSR_NATIVE(jsr_Thread_new) {
+    Message* task = newMessage();
+    if(!encodeMainGlobals(vm, task) || !encodeValue(vm, task, vm->apiStack[1], 0) ||
+       !encodeValue(vm, task, vm->apiStack[2], 0)) {
+        freeMessage(task);
+        return false;
+    }
+
+    ThreadState* t = newThreadState(vm, task);
+    if(!startThread(&t->thread, &runThread, t)) {
+        t->refs = 1;
+        t->joined = true;
+        releaseThread(t);
+        JSR_RAISE(vm, "ThreadException", "Cannot start thread");
+    }
+
+    ThreadState** data = jsrPushUserdata(vm, sizeof(ThreadState*), &finalizeThread);
+    *data = t;
+    jsrSetField(vm, 0, M_THREAD_STATE);
+    jsrPop(vm);
+
+    jsrPushValue(vm, 0);
+    return true;
+}
+
+JSR_NATIVE(jsr_Thread_join) {
+    ThreadState* t = getThread(vm);
+    if(t == NULL) return false;
+
+    if(!t->joined) {
+        joinThread(&t->thread);
+        t->joined = true;
+    }
+
+    if(t->error) {
+        JSR_RAISE(vm, "ThreadException", "%s", t->error);
+    }
+
+    // The result is decoded again on every call, so that each one returns a new copy
+    Reader r = {t->result, 0};
+    return decodeValue(vm, &r);
+}
+
+JSR_NATIVE(jsr_Thread_isAlive) {
+    ThreadState* t = getThread(vm);
+    if(t == NULL) return false;
+
+    lockMutex(&t->lock);
+    bool done = t->done;
+    unlockMutex(&t->lock);
+
+    jsrPushBoolean(vm, !done);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// FUNCTIONS
+// -----------------------------------------------------------------------------
+
+JSR_NATIVE(jsr_thread_cpuCount) {
+    jsrPushNumber(vm, cpuCount());
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "jstar.h"
+
+JSR_NATIVE(jsr_thread_cpuCount);
+
+// class Thread
+JSR_NATIVE(jsr_Thread_new);
+JSR_NATIVE(jsr_Thread_join);
+JSR_NATIVE(jsr_Thread_isAlive);
+// end Thread
+
+// class Channel
+JSR_NATIVE(jsr_Channel_new);
+JSR_NATIVE(jsr_Channel_send);
+JSR_NATIVE(jsr_Channel_receive);
+JSR_NATIVE(jsr_Channel_close);
+JSR_NATIVE(jsr_Channel_isClosed);
+JSR_NATIVE(jsr_Channel_iter);
+// end Channel
+
+#endif
@@ -0,0 +1,250 @@
+#include "bundle.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "endianness.h"
+#include "profiler.h"
+#include "serialize.h"
+#include "util.h"
+#include "vm.h"
+
+// Modules are aligned in the file, so that borrowed bytecode starts on a word boundary
+#define BUNDLE_ALIGN 8
+
+static int compareNames(const char* n1, size_t l1, const char* n2, size_t l2) {
+    int cmp = memcmp(n1, n2, l1 < l2 ? l1 : l2);
+    if(cmp != 0) return cmp;
+    return (l1 > l2) - (l1 < l2);
+}
+
+// -----------------------------------------------------------------------------
+// BUNDLE WRITING
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    const char* name;
+    const JStarBuffer* code;
+} Module;
+
+static int compareModules(const void* m1, const void* m2) {
+    const Module *a = m1, *b = m2;
+    return compareNames(a->name, strlen(a->name), b->name, strlen(b->name));
+}
+
+static void writeShort(JStarBuffer* buf, uint16_t num) {
+    uint16_t bigendian = htobe16(num);
+    jsrBufferAppend(buf, (const char*)&bigendian, sizeof(uint16_t));
+}
+
+static void writeUint64(JStarBuffer* buf, uint64_t num) {
+    uint64_t bigendian = htobe64(num);
+    jsrBufferAppend(buf, (const char*)&bigendian, sizeof(uint64_t));
+}
+
+static size_t alignOffset(size_t offset) {
+    return (offset + BUNDLE_ALIGN - 1) & ~(size_t)(BUNDLE_ALIGN - 1);
+}
+
+bool writeBundle(JStarVM* vm, const char** names, const JStarBuffer* codes, int count,
+                 JStarBuffer* out) {
+    PROFILE_FUNC()
+
+    Module* modules = malloc(sizeof(Module) * (count > 0 ? count : 1));
+    for(int i = 0; i < count; i++) {
+        modules[i] = (Module){names[i], &codes[i]};
+    }
+    qsort(modules, count, sizeof(Module), &compareModules);
+
+    size_t indexSize = BUNDLE_HEADER_SZ + 1 + sizeof(uint64_t);
+    for(int i = 0; i < count; i++) {
+        size_t nameLen = strlen(modules[i].name);
+        bool duplicate = i > 0 && strcmp(modules[i - 1].name, modules[i].name) == 0;
+        if(nameLen == 0 || nameLen > UINT16_MAX || duplicate || !isCompiledCode(modules[i].code)) {
+            free(modules);
+            return false;
+        }
+        indexSize += sizeof(uint16_t) + nameLen + 2 * sizeof(uint64_t);
+    }
+
+    jsrBufferInit(vm, out);
+    jsrBufferAppend(out, BUNDLE_HEADER, BUNDLE_HEADER_SZ);
+    jsrBufferAppendChar(out, BUNDLE_FORMAT_VERSION);
+    writeUint64(out, count);
+
+    size_t offset = alignOffset(indexSize);
+    for(int i = 0; i < count; i++) {
+        size_t nameLen = strlen(modules[i].name);
+        writeShort(out, nameLen);
+        jsrBufferAppend(out, modules[i].name, nameLen);
+        writeUint64(out, offset);
+        writeUint64(out, modules[i].code->size);
+        offset = alignOffset(offset + modules[i].code->size);
+    }
+
+    for(int i = 0; i < count; i++) {
+        while(out->size != alignOffset(out->size)) {
+            jsrBufferAppendChar(out, '\0');
+        }
+        jsrBufferAppend(out, modules[i].code->data, modules[i].code->size);
+    }
+
+    free(modules);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// BUNDLE READING
+// -----------------------------------------------------------------------------
+
+bool isBundlePath(const char* path) {
+    size_t len = strlen(path), extLen = strlen(BUNDLE_EXT);
+    return len > extLen && strcmp(path + len - extLen, BUNDLE_EXT) == 0;
+}
+
+typedef struct {
+    const char* data;
+    size_t size, pos;
+} Reader;
+
+static bool readBytes(Reader* r, const char** out, size_t size) {
+    if(r->size - r->pos < size) return false;
+    *out = r->data + r->pos;
+    r->pos += size;
+    return true;
+}
+
+static bool readShort(Reader* r, uint16_t* out) {
+    const char* bytes;
+    if(!readBytes(r, &bytes, sizeof(uint16_t))) return false;
+    uint16_t bigendian;
+    memcpy(&bigendian, bytes, sizeof(uint16_t));
+    *out = be16toh(bigendian);
+    return true;
+}
+
+static bool readUint64(Reader* r, uint64_t* out) {
+    const char* bytes;
+    if(!readBytes(r, &bytes, sizeof(uint64_t))) return false;
+    uint64_t bigendian;
+    memcpy(&bigendian, bytes, sizeof(uint64_t));
+    *out = be64toh(bigendian);
+    return true;
+}
+
+// Reads and validates the index of the bundle. Entries must be sorted by name and must fall
+// entirely inside the file
+static bool readIndex(Bundle* b, const char* data, size_t size) {
+    Reader r = {data, size, 0};
+
+    const char *header, *version;
+    if(!readBytes(&r, &header, BUNDLE_HEADER_SZ)) return false;
+    if(memcmp(header, BUNDLE_HEADER, BUNDLE_HEADER_SZ) != 0) return false;
+    if(!readBytes(&r, &version, 1) || *version != BUNDLE_FORMAT_VERSION) return false;
+
+    uint64_t count;
+    if(!readUint64(&r, &count)) return false;
+    if(count > size / (sizeof(uint16_t) + 2 * sizeof(uint64_t))) return false;
+
+    b->entries = malloc(sizeof(BundleEntry) * (count > 0 ? count : 1));
+    b->count = 0;
+
+    for(uint64_t i = 0; i < count; i++) {
+        uint16_t nameLen;
+        uint64_t offset, codeSize;
+        const char* name;
+
+        if(!readShort(&r, &nameLen)) return false;
+        if(!readBytes(&r, &name, nameLen)) return false;
+        if(!readUint64(&r, &offset)) return false;
+        if(!readUint64(&r, &codeSize)) return false;
+
+        if(offset > size || codeSize > size - offset) return false;
+
+        BundleEntry* prev = i > 0 ? &b->entries[i - 1] : NULL;
+        if(prev && compareNames(prev->name, prev->nameLength, name, nameLen) >= 0) return false;
+
+        b->entries[b->count++] = (BundleEntry){name, nameLen, offset, codeSize};
+    }
+
+    return true;
+}
+
+static void closeBundle(Bundle* b) {
+    if(b->file.data) {
+        unmapFile(&b->file);
+    } else if(b->contents.data) {
+        jsrBufferFree(&b->contents);
+    }
+    free(b->entries);
+    free(b->path);
+    free(b);
+}
+
+Bundle* openBundle(JStarVM* vm, const char* path) {
+    PROFILE_FUNC()
+
+    for(Bundle* b = vm->bundles; b != NULL; b = b->next) {
+        if(strcmp(b->path, path) == 0) return b;
+    }
+
+    Bundle* b = calloc(1, sizeof(*b));
+
+    const char* data;
+    size_t size;
+    if(mapFile(path, &b->file)) {
+        data = b->file.data;
+        size = b->file.size;
+    } else if(jsrReadFile(vm, path, &b->contents)) {
+        data = b->contents.data;
+        size = b->contents.size;
+    } else {
+        free(b);
+        return NULL;
+    }
+
+    size_t pathLen = strlen(path);
+    b->path = malloc(pathLen + 1);
+    memcpy(b->path, path, pathLen + 1);
+
+    if(!readIndex(b, data, size)) {
+        vm->errorCallback(vm, JSR_DESERIALIZE_ERR, path, -1, "Malformed bundle file");
+        closeBundle(b);
+        return NULL;
+    }
+
+    b->next = vm->bundles;
+    vm->bundles = b;
+    return b;
+}
+
+bool bundleFind(JStarVM* vm, const Bundle* b, const char* name, size_t length, JStarBuffer* code) {
+    size_t lo = 0, hi = b->count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const BundleEntry* e = &b->entries[mid];
+        int cmp = compareNames(e->name, e->nameLength, name, length);
+        if(cmp == 0) {
+            const char* data = b->file.data ? b->file.data : b->contents.data;
+            *code = jsrBufferWrap(vm, data + e->offset, e->size);
+            return true;
+        }
+        if(cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+void freeBundles(JStarVM* vm) {
+    Bundle* b = vm->bundles;
+    while(b != NULL) {
+        Bundle* next = b->next;
+        closeBundle(b);
+        b = next;
+    }
+    vm->bundles = NULL;
+}
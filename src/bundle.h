@@ -0,0 +1,52 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "jstar.h"
+#include "mapfile.h"
+
+// A bundle packs the compiled modules of a whole application in a single file, so that they can
+// all be imported with just one open and mapping of the file.
+// The file starts with BUNDLE_HEADER, a format version byte and the number of modules, followed by
+// an index sorted by module name and by the compiled code of the modules, stored back to back.
+#define BUNDLE_HEADER    "\xb5JsrB"
+#define BUNDLE_HEADER_SZ (sizeof(BUNDLE_HEADER) - 1)
+#define BUNDLE_EXT       ".jsb"
+
+#define BUNDLE_FORMAT_VERSION 1
+
+typedef struct BundleEntry {
+    const char* name;
+    size_t nameLength;
+    size_t offset, size;
+} BundleEntry;
+
+// A bundle opened during import. Bundles are kept open by the VM until it's freed, since the
+// modules imported from them borrow their bytecode directly from the file contents
+typedef struct Bundle {
+    struct Bundle* next;
+    char* path;
+    MappedFile file;      // Mapping of the bundle file, if supported by the platform
+    JStarBuffer contents; // Otherwise, a copy of the file read in memory
+    size_t count;
+    BundleEntry* entries;
+} Bundle;
+
+// Writes a bundle containing the compiled modules in `codes`, named as in `names`
+bool writeBundle(JStarVM* vm, const char** names, const JStarBuffer* codes, int count,
+                 JStarBuffer* out);
+
+// Returns true if the import path `path` refers to a bundle instead of a directory
+bool isBundlePath(const char* path);
+// Returns the bundle at `path`, opening it if it hasn't been already. Returns NULL if the file
+// cannot be read or if it doesn't contain a valid bundle
+Bundle* openBundle(JStarVM* vm, const char* path);
+// Looks up the module `name` in the bundle, setting `code` to its compiled code if found.
+// The code can be borrowed by the imported module, and it's writable as required by quickening
+bool bundleFind(JStarVM* vm, const Bundle* b, const char* name, size_t length, JStarBuffer* code);
+// Closes all the bundles opened by the VM
+void freeBundles(JStarVM* vm);
+
+#endif
@@ -0,0 +1,183 @@
+#include "bytecache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "object.h"
+#include "serialize.h"
+#include "util.h"
+
+#if defined(JSTAR_POSIX)
+    #include <sys/stat.h>
+    #define makeDirectory(path) mkdir(path, 0777)
+#elif defined(JSTAR_WINDOWS)
+    #include <direct.h>
+    #define makeDirectory(path) _mkdir(path)
+#else
+    #define makeDirectory(path) ((void)(path), -1)
+#endif
+
+#ifdef JSTAR_WINDOWS
+    #define PATH_SEP_CHAR '\\'
+    #define PATH_SEP_STR  "\\"
+#else
+    #define PATH_SEP_CHAR '/'
+    #define PATH_SEP_STR  "/"
+#endif
+
+#define CACHE_DIR    "__jscache__"
+#define CACHE_EXT    ".jsc"
+#define CACHE_MAGIC  "\xb5JsrK"
+#define MAGIC_SZ     (sizeof(CACHE_MAGIC) - 1)
+// Magic, source file stamp, source hash and length of the source path
+#define HEADER_SZ    (MAGIC_SZ + 8 + 8 + 4 + 4)
+// Serialized header followed by the J* version and the format version (see serialize.c)
+#define VERSION_SZ   (SERIALIZED_HEADER_SZ + 3)
+
+static bool isSeparator(char c) {
+#ifdef JSTAR_WINDOWS
+    if(c == '\\') return true;
+#endif
+    return c == '/';
+}
+
+static size_t baseNameStart(const char* path) {
+    size_t start = 0;
+    for(size_t i = 0; path[i] != '\0'; i++) {
+        if(isSeparator(path[i])) start = i + 1;
+    }
+    return start;
+}
+
+void cachedCodePath(const char* dir, const char* srcPath, JStarBuffer* out) {
+    size_t base = baseNameStart(srcPath);
+    const char* baseName = srcPath + base;
+    const char* ext = strrchr(baseName, '.');
+    size_t nameLength = ext ? (size_t)(ext - baseName) : strlen(baseName);
+
+    if(dir == NULL) {
+        jsrBufferAppend(out, srcPath, base);
+        jsrBufferAppendStr(out, CACHE_DIR PATH_SEP_STR);
+    } else {
+        // A single directory holds the code of all the modules, so the hash of the full
+        // path tells apart modules with the same name. Collisions are detected on read, as the
+        // cache file also stores the path of its source
+        jsrBufferAppendStr(out, dir);
+        if(out->size > 0 && !isSeparator(out->data[out->size - 1])) {
+            jsrBufferAppendChar(out, PATH_SEP_CHAR);
+        }
+        jsrBufferAppendf(out, "%08x-", (unsigned)hashBytes(srcPath, strlen(srcPath)));
+    }
+
+    jsrBufferAppend(out, baseName, nameLength);
+    jsrBufferAppendStr(out, CACHE_EXT);
+}
+
+static void writeUint(char* out, uint64_t num, int bytes) {
+    for(int i = 0; i < bytes; i++) {
+        out[i] = (char)((num >> (i * 8)) & 0xff);
+    }
+}
+
+static uint64_t readUint(const char* in, int bytes) {
+    uint64_t num = 0;
+    for(int i = 0; i < bytes; i++) {
+        num |= (uint64_t)(unsigned char)in[i] << (i * 8);
+    }
+    return num;
+}
+
+static bool isCompatibleCode(const char* code, size_t size) {
+    if(size < VERSION_SZ) return false;
+    if(memcmp(code, SERIALIZED_HEADER, SERIALIZED_HEADER_SZ) != 0) return false;
+    const unsigned char* version = (const unsigned char*)code + SERIALIZED_HEADER_SZ;
+    return version[0] == JSTAR_VERSION_MAJOR && version[1] == JSTAR_VERSION_MINOR &&
+           version[2] == SERIALIZED_FORMAT_VERSION;
+}
+
+bool readCachedCode(JStarVM* vm, const char* cachePath, const char* srcPath, CachedCode* out) {
+    if(!jsrReadFile(vm, cachePath, &out->file)) {
+        return false;
+    }
+
+    const char* data = out->file.data;
+    size_t size = out->file.size;
+    size_t pathLength = strlen(srcPath);
+
+    if(size < HEADER_SZ || memcmp(data, CACHE_MAGIC, MAGIC_SZ) != 0) goto invalid;
+
+    const char* header = data + MAGIC_SZ;
+    out->stamp.mtime = (int64_t)readUint(header, 8);
+    out->stamp.size = (int64_t)readUint(header + 8, 8);
+    out->srcHash = (uint32_t)readUint(header + 16, 4);
+
+    if(readUint(header + 20, 4) != pathLength || size - HEADER_SZ < pathLength) goto invalid;
+    if(memcmp(data + HEADER_SZ, srcPath, pathLength) != 0) goto invalid;
+
+    const char* code = data + HEADER_SZ + pathLength;
+    size_t codeSize = size - HEADER_SZ - pathLength;
+    if(!isCompatibleCode(code, codeSize)) goto invalid;
+
+    out->code = jsrBufferWrap(vm, code, codeSize);
+    return true;
+
+invalid:
+    jsrBufferFree(&out->file);
+    return false;
+}
+
+static FILE* createFile(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if(f != NULL) return f;
+
+    // The cache directory may not exist yet
+    size_t dirEnd = baseNameStart(path);
+    if(dirEnd <= 1) return NULL;
+
+    char* dir = malloc(dirEnd);
+    memcpy(dir, path, dirEnd - 1);
+    dir[dirEnd - 1] = '\0';
+    int res = makeDirectory(dir);
+    free(dir);
+
+    return res == 0 ? fopen(path, "wb") : NULL;
+}
+
+bool writeCachedCode(const char* cachePath, const char* srcPath, const FileStamp* stamp,
+                     uint32_t srcHash, const JStarBuffer* code) {
+    size_t pathLength = strlen(srcPath);
+
+    char header[HEADER_SZ];
+    memcpy(header, CACHE_MAGIC, MAGIC_SZ);
+    writeUint(header + MAGIC_SZ, (uint64_t)stamp->mtime, 8);
+    writeUint(header + MAGIC_SZ + 8, (uint64_t)stamp->size, 8);
+    writeUint(header + MAGIC_SZ + 16, srcHash, 4);
+    writeUint(header + MAGIC_SZ + 20, pathLength, 4);
+
+    size_t cachePathLength = strlen(cachePath);
+    char* tmpPath = malloc(cachePathLength + sizeof(".tmp"));
+    memcpy(tmpPath, cachePath, cachePathLength);
+    memcpy(tmpPath + cachePathLength, ".tmp", sizeof(".tmp"));
+
+    FILE* f = createFile(tmpPath);
+    if(f == NULL) {
+        free(tmpPath);
+        return false;
+    }
+
+    bool ok = fwrite(header, 1, HEADER_SZ, f) == HEADER_SZ &&
+              fwrite(srcPath, 1, pathLength, f) == pathLength &&
+              fwrite(code->data, 1, code->size, f) == code->size;
+    ok = (fclose(f) == 0) && ok;
+
+#ifdef JSTAR_WINDOWS
+    // `rename` doesn't replace existing files on Windows
+    if(ok) remove(cachePath);
+#endif
+
+    ok = ok && rename(tmpPath, cachePath) == 0;
+    if(!ok) remove(tmpPath);
+
+    free(tmpPath);
+    return ok;
+}
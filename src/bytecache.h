@@ -0,0 +1,37 @@
+#ifndef BYTECACHE_H
+#define BYTECACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codecache.h"
+#include "jstar.h"
+
+// Compiled code of a source module, cached on disk by the import system when the VM is configured
+// with `bytecodeCache` (see jstar.h).
+// Cached code is used as long as its source file has the same stamp it had when it was compiled.
+// If the stamp changed, the code is still valid if the contents of the source are the same
+typedef struct CachedCode {
+    FileStamp stamp;   // Stamp of the source file the code was compiled from
+    uint32_t srcHash;  // Hash of the contents of the source file
+    JStarBuffer file;  // Contents of the cache file
+    JStarBuffer code;  // The compiled code, pointing into `file`
+} CachedCode;
+
+// Builds in `out` the path of the file caching the code of the source module at `srcPath`: a file
+// in a `__jscache__` directory next to the source if `dir` is NULL, or a file inside `dir`
+void cachedCodePath(const char* dir, const char* srcPath, JStarBuffer* out);
+
+// Reads the code cached at `cachePath` for the source file at `srcPath`. Returns false if the
+// cache doesn't exist, is malformed, or if the code was compiled from another file or by an
+// incompatible version of J*. On success `out->file` must be freed by the caller
+bool readCachedCode(JStarVM* vm, const char* cachePath, const char* srcPath, CachedCode* out);
+
+// Stores the code compiled from the source file at `srcPath` in the cache at `cachePath`,
+// creating its directory if needed. The cache file is replaced atomically, so that other
+// processes never read a partially written one. Returns false if it couldn't be written
+bool writeCachedCode(const char* cachePath, const char* srcPath, const FileStamp* stamp,
+                     uint32_t srcHash, const JStarBuffer* code);
+
+#endif
@@ -13,8 +13,10 @@ void initCode(Code* c) {
 }
 
 void freeCode(Code* c) {
-    free(c->bytecode);
+    if(!c->borrowed) free(c->bytecode);
     free(c->lines);
+    free(c->handlers);
+    free(c->caches);
     freeValueArray(&c->consts);
 }
 
@@ -23,33 +25,71 @@ static void growCode(Code* c) {
     c->bytecode = realloc(c->bytecode, c->capacity * sizeof(uint8_t));
 }
 
-static void growLines(Code* c) {
-    c->lineCapacity = c->lineCapacity ? c->lineCapacity * CODE_GROW_FACT : CODE_DEF_SIZE;
-    c->lines = realloc(c->lines, c->lineCapacity * sizeof(int));
-}
-
 static bool shouldGrow(const Code* c) {
     return c->size + 1 > c->capacity;
 }
 
-static void ensureCapacity(Code* c) {
-    if(shouldGrow(c)) {
-        growCode(c);
-        growLines(c);
+void addLineRun(Code* c, uint32_t offset, int line) {
+    if(c->lineCount + 1 > c->lineCapacity) {
+        c->lineCapacity = c->lineCapacity ? c->lineCapacity * CODE_GROW_FACT : CODE_DEF_SIZE;
+        c->lines = realloc(c->lines, c->lineCapacity * sizeof(LineRun));
     }
+    c->lines[c->lineCount++] = (LineRun){offset, line};
 }
 
 size_t writeByte(Code* c, uint8_t b, int line) {
-    ensureCapacity(c);
+    if(shouldGrow(c)) {
+        growCode(c);
+    }
+
+    if(c->lineCount == 0 || c->lines[c->lineCount - 1].line != line) {
+        addLineRun(c, c->size, line);
+    }
+
     c->bytecode[c->size] = b;
-    c->lines[c->lineSize++] = line;
     return c->size++;
 }
 
-int getBytecodeSrcLine(Code* c, size_t index) {
-    if(c->lines == NULL) return -1;
-    ASSERT(index < c->lineSize, "Line buffer overflow");
-    return c->lines[index];
+int getBytecodeSrcLine(const Code* c, size_t index) {
+    if(c->lineCount == 0) return -1;
+    ASSERT(index < c->size, "Line buffer overflow");
+
+    // Find the last run starting at or before `index`
+    size_t lo = 0, hi = c->lineCount;
+    while(hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(c->lines[mid].offset <= index) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return c->lines[lo].line;
+}
+
+int getLastSrcLine(const Code* c) {
+    return c->lineCount > 0 ? c->lines[c->lineCount - 1].line : 0;
+}
+
+void addHandler(Code* c, Handler handler) {
+    if(c->handlerCount + 1 > c->handlerCapacity) {
+        c->handlerCapacity = c->handlerCapacity ? c->handlerCapacity * CODE_GROW_FACT : 1;
+        c->handlers = realloc(c->handlers, c->handlerCapacity * sizeof(Handler));
+    }
+    c->handlers[c->handlerCount++] = handler;
+}
+
+const Handler* findHandler(const Code* c, size_t index, bool ensureOnly) {
+    // Handlers are few and only looked up when unwinding, so a linear scan is enough. The first
+    // match is the innermost one, as nested handlers precede the ones enclosing them
+    for(size_t i = 0; i < c->handlerCount; i++) {
+        const Handler* h = &c->handlers[i];
+        if(index >= h->start && index < h->end && (!ensureOnly || h->type == HANDLER_ENSURE)) {
+            return h;
+        }
+    }
+    return NULL;
 }
 
 int addConstant(Code* c, Value constant) {
@@ -64,3 +104,16 @@ int addConstant(Code* c, Value constant) {
 
     return valueArrayAppend(&c->consts, constant);
 }
+
+int addInlineCache(Code* c) {
+    if(c->cacheCount == UINT16_MAX) return -1;
+
+    if(c->cacheCount + 1 > c->cacheCapacity) {
+        c->cacheCapacity = c->cacheCapacity ? c->cacheCapacity * CODE_GROW_FACT : CODE_DEF_SIZE;
+        c->caches = realloc(c->caches, c->cacheCapacity * sizeof(InlineCache));
+    }
+
+    c->caches[c->cacheCount] = (InlineCache){0};
+
+    return c->cacheCount++;
+}
@@ -1,17 +1,75 @@
 #ifndef CHUNK_H
 #define CHUNK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #include "value.h"
 
+// Number of receiver classes remembered by an inline cache before it starts evicting entries
+#define IC_ENTRIES 4
+
+struct ObjClass;
+struct Shape;
+
+typedef enum InlineCacheKind {
+    IC_METHOD,
+    IC_FIELD,
+} InlineCacheKind;
+
+// A per-call-site inline cache used by field access, method invocation and super calls.
+// Each entry remembers the result of the lookup performed the last time a receiver was seen:
+// the method found on its class, or the slot of the field in instances of a given shape.
+typedef struct InlineCache {
+    struct {
+        struct ObjClass* cls;  // The class of the receiver, NULL if the entry is empty
+        union {
+            Value method;
+            struct {
+                struct Shape* shape;       // The shape of the receiver
+                struct Shape* transition;  // The shape after adding the field (SET_FIELD only)
+                size_t slot;               // The slot of the field in the receiver
+            } field;
+        } as;
+    } entries[IC_ENTRIES];
+    InlineCacheKind kind;
+    uint8_t nextEntry;
+    uint64_t hits, misses;
+} InlineCache;
+
+// A run of consecutive bytecode generated from the same source line, starting at `offset`
+typedef struct LineRun {
+    uint32_t offset;
+    int32_t line;
+} LineRun;
+
+typedef enum HandlerType {
+    HANDLER_ENSURE,
+    HANDLER_EXCEPT,
+} HandlerType;
+
+// An entry of the exception table of a function. The handler protects the bytecode in the range
+// [start, end): when an exception is raised or a return is executed inside of it, the stack is
+// truncated to `stackDepth` slots above the frame base and execution resumes at `address`
+typedef struct Handler {
+    HandlerType type;
+    uint32_t start, end;
+    uint32_t address;
+    uint32_t stackDepth;
+} Handler;
+
 typedef struct Code {
     size_t capacity, size;
     uint8_t* bytecode;
-    size_t lineCapacity, lineSize;
-    int* lines;
+    bool borrowed;  // Whether `bytecode` points into memory owned by someone else (a mapped file)
+    size_t lineCapacity, lineCount;
+    LineRun* lines;  // Runs sorted by offset, a new one starts every time the line changes
+    size_t handlerCapacity, handlerCount;
+    Handler* handlers;  // Exception table, a handler always comes before the ones enclosing it
     ValueArray consts;
+    size_t cacheCapacity, cacheCount;
+    InlineCache* caches;
 } Code;
 
 void initCode(Code* c);
@@ -19,6 +77,17 @@ void freeCode(Code* c);
 
 size_t writeByte(Code* c, uint8_t b, int line);
 int addConstant(Code* c, Value constant);
-int getBytecodeSrcLine(Code* c, size_t index);
+int addInlineCache(Code* c);
+// Appends a line run to the line table, used when loading the table from compiled code
+void addLineRun(Code* c, uint32_t offset, int line);
+// Returns the source line of the instruction at `index`, or -1 if there's no line information
+int getBytecodeSrcLine(const Code* c, size_t index);
+// Returns the line of the last bytecode written, or 0 if there's none
+int getLastSrcLine(const Code* c);
+// Appends an entry to the exception table
+void addHandler(Code* c, Handler handler);
+// Returns the innermost handler protecting the instruction at `index`, or NULL if there's none.
+// If `ensureOnly` is true, except handlers are skipped
+const Handler* findHandler(const Code* c, size_t index, bool ensureOnly);
 
 #endif
@@ -0,0 +1,179 @@
+#include "codecache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "sync.h"
+#include "util.h"
+
+#define CACHE_INIT_BUCKETS 16
+
+typedef struct CodeEntry {
+    struct CodeEntry* next;
+    uint32_t hash;
+    size_t length;
+    FileStamp stamp;
+    void* data;
+    size_t size;
+    char key[];
+} CodeEntry;
+
+// Code replaced by a newer version of its file. It can't be freed before the cache, since the
+// lazily deserialized functions of the VMs that loaded it still point into it
+typedef struct RetiredCode {
+    struct RetiredCode* next;
+    void* data;
+} RetiredCode;
+
+struct JStarCodeCache {
+    Mutex lock;
+    CodeEntry** buckets;
+    size_t bucketCount, count;
+    RetiredCode* retired;
+};
+
+JStarCodeCache* jsrNewCodeCache(void) {
+    JStarCodeCache* c = calloc(1, sizeof(*c));
+    initMutex(&c->lock);
+    return c;
+}
+
+void jsrFreeCodeCache(JStarCodeCache* c) {
+    for(size_t i = 0; i < c->bucketCount; i++) {
+        CodeEntry* e = c->buckets[i];
+        while(e != NULL) {
+            CodeEntry* next = e->next;
+            free(e->data);
+            free(e);
+            e = next;
+        }
+    }
+
+    RetiredCode* r = c->retired;
+    while(r != NULL) {
+        RetiredCode* next = r->next;
+        free(r->data);
+        free(r);
+        r = next;
+    }
+
+    free(c->buckets);
+    freeMutex(&c->lock);
+    free(c);
+}
+
+bool getFileStamp(const char* path, FileStamp* stamp) {
+    struct stat st;
+    if(stat(path, &st) != 0) {
+        return false;
+    }
+    *stamp = (FileStamp){(int64_t)st.st_mtime, (int64_t)st.st_size};
+    return true;
+}
+
+bool stampEquals(const FileStamp* s1, const FileStamp* s2) {
+    return s1->mtime == s2->mtime && s1->size == s2->size;
+}
+
+static CodeEntry* findEntry(JStarCodeCache* c, const char* key, size_t length, uint32_t hash) {
+    if(c->bucketCount == 0) return NULL;
+    for(CodeEntry* e = c->buckets[hash & (c->bucketCount - 1)]; e != NULL; e = e->next) {
+        if(e->hash == hash && e->length == length && memcmp(e->key, key, length) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void growCache(JStarCodeCache* c) {
+    size_t newCount = c->bucketCount ? c->bucketCount * 2 : CACHE_INIT_BUCKETS;
+    CodeEntry** buckets = calloc(newCount, sizeof(CodeEntry*));
+
+    for(size_t i = 0; i < c->bucketCount; i++) {
+        CodeEntry* e = c->buckets[i];
+        while(e != NULL) {
+            CodeEntry* next = e->next;
+            size_t idx = e->hash & (newCount - 1);
+            e->next = buckets[idx];
+            buckets[idx] = e;
+            e = next;
+        }
+    }
+
+    free(c->buckets);
+    c->buckets = buckets;
+    c->bucketCount = newCount;
+}
+
+bool codeCacheGet(JStarCodeCache* c, const char* path, FileStamp* stamp, const void** data,
+                  size_t* size) {
+    if(!getFileStamp(path, stamp)) {
+        *stamp = (FileStamp){-1, -1};
+        return false;
+    }
+
+    size_t length = strlen(path);
+    uint32_t hash = hashBytes(path, length);
+
+    lockMutex(&c->lock);
+    CodeEntry* e = findEntry(c, path, length, hash);
+    bool found = e != NULL && stampEquals(&e->stamp, stamp);
+    if(found) {
+        *data = e->data;
+        *size = e->size;
+    }
+    unlockMutex(&c->lock);
+
+    return found;
+}
+
+void codeCachePut(JStarCodeCache* c, const char* path, const FileStamp* stamp, const void* data,
+                  size_t size) {
+    // The file couldn't be examined before loading it
+    if(stamp->size == -1) return;
+
+    size_t length = strlen(path);
+    uint32_t hash = hashBytes(path, length);
+
+    void* copy = malloc(size);
+    memcpy(copy, data, size);
+
+    lockMutex(&c->lock);
+
+    CodeEntry* e = findEntry(c, path, length, hash);
+    if(e != NULL && stampEquals(&e->stamp, stamp)) {
+        // Another VM loaded the same version of the file concurrently
+        unlockMutex(&c->lock);
+        free(copy);
+        return;
+    }
+
+    if(e == NULL) {
+        if(c->count + 1 > c->bucketCount) {
+            growCache(c);
+        }
+
+        e = malloc(sizeof(*e) + length + 1);
+        e->hash = hash;
+        e->length = length;
+        memcpy(e->key, path, length);
+        e->key[length] = '\0';
+
+        size_t idx = hash & (c->bucketCount - 1);
+        e->next = c->buckets[idx];
+        c->buckets[idx] = e;
+        c->count++;
+    } else {
+        RetiredCode* r = malloc(sizeof(*r));
+        r->data = e->data;
+        r->next = c->retired;
+        c->retired = r;
+    }
+
+    e->stamp = *stamp;
+    e->data = copy;
+    e->size = size;
+
+    unlockMutex(&c->lock);
+}
@@ -0,0 +1,33 @@
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jstar.h"
+
+// Identifies a version of a module file. Code stored in the cache is valid as long as the stamp
+// of its file doesn't change
+typedef struct FileStamp {
+    int64_t mtime;
+    int64_t size;
+} FileStamp;
+
+// Fills `stamp` with the current stamp of the file at `path`. Returns false if it doesn't exist
+bool getFileStamp(const char* path, FileStamp* stamp);
+bool stampEquals(const FileStamp* s1, const FileStamp* s2);
+
+// Looks up the compiled code of the module file at `path`, filling `stamp` with the current stamp
+// of the file. Returns false if the code isn't cached or if the file was modified since it was
+// stored. The returned code is immutable, and lives as long as the cache.
+// Safe to call concurrently from VMs running on different threads
+bool codeCacheGet(JStarCodeCache* c, const char* path, FileStamp* stamp, const void** data,
+                  size_t* size);
+
+// Stores a copy of the compiled code of the module file at `path`, loaded when its file had the
+// stamp `stamp`. Safe to call concurrently from VMs running on different threads
+void codeCachePut(JStarCodeCache* c, const char* path, const FileStamp* stamp, const void* data,
+                  size_t size);
+
+#endif
@@ -1,5 +1,6 @@
 #include "compiler.h"
 
+#include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -11,7 +12,9 @@
 #include "jstar.h"
 #include "jstar_limits.h"
 #include "opcode.h"
+#include "optimizer.h"
 #include "parse/lex.h"
+#include "parse/parser.h"
 #include "parse/vector.h"
 #include "profiler.h"
 #include "util.h"
@@ -69,6 +72,7 @@ typedef struct Loop {
 
 typedef struct TryExcept {
     int depth;
+    int stackDepth;
     int numHandlers;
     struct TryExcept* next;
 } TryExcept;
@@ -152,8 +156,8 @@ static void error(Compiler* c, int line, const char* format, ...) {
 }
 
 static size_t emitBytecode(Compiler* c, uint8_t b, int line) {
-    if(line == 0 && c->func->code.lineSize > 0) {
-        line = c->func->code.lines[c->func->code.lineSize - 1];
+    if(line == 0) {
+        line = getLastSrcLine(&c->func->code);
     }
     return writeByte(&c->func->code, b, line);
 }
@@ -172,6 +176,18 @@ static bool inGlobalScope(Compiler* c) {
     return c->depth == 0;
 }
 
+// Whether the function being compiled contains a `yield`. The module body never is a generator
+static bool isGenerator(Compiler* c) {
+    return c->prev != NULL && c->type != TYPE_CTOR && c->ast->as.funcDecl.isGenerator;
+}
+
+// A generator function suspends itself as soon as it's called, returning the new generator.
+// The value sent by the first resume is discarded
+static void emitGeneratorPrologue(Compiler* c, int line) {
+    emitBytecode(c, OP_GENERATOR, line);
+    emitBytecode(c, OP_POP, line);
+}
+
 static void discardLocal(Compiler* c, Local* local) {
     if(local->isUpvalue) {
         emitBytecode(c, OP_CLOSE_UPVALUE, 0);
@@ -223,6 +239,15 @@ static uint16_t createConst(Compiler* c, Value constant, int line) {
     return (uint16_t)index;
 }
 
+static uint16_t createInlineCache(Compiler* c, int line) {
+    int index = addInlineCache(&c->func->code);
+    if(index == -1) {
+        error(c, line, "Too many call sites in function %s", c->func->proto.name->data);
+        return 0;
+    }
+    return (uint16_t)index;
+}
+
 static JStarIdentifier createIdentifier(const char* name) {
     return (JStarIdentifier){strlen(name), name};
 }
@@ -264,6 +289,19 @@ static int resolveVariable(Compiler* c, JStarIdentifier* id, int line) {
     return -1;
 }
 
+// Returns the slot of `e` if it is an already initialized local variable, -1 otherwise.
+// Used when selecting superinstructions, all other cases go through resolveVariable
+static int findLocal(Compiler* c, JStarExpr* e) {
+    if(e->type != JSR_VAR) return -1;
+    for(int i = c->localsCount - 1; i >= 0; i--) {
+        Local* local = &c->locals[i];
+        if(jsrIdentifierEq(&local->id, &e->as.var.id)) {
+            return local->depth == -1 ? -1 : i;
+        }
+    }
+    return -1;
+}
+
 static int addUpvalue(Compiler* c, uint8_t index, bool local, int line) {
     uint8_t upvalueCount = c->func->upvalueCount;
     for(uint8_t i = 0; i < upvalueCount; i++) {
@@ -354,8 +392,7 @@ static void defineVar(Compiler* c, Variable* var, int line) {
 }
 
 static void assertJumpOpcode(Opcode op) {
-    ASSERT((op == OP_JUMP || op == OP_JUMPT || op == OP_JUMPF || op == OP_FOR_NEXT ||
-            op == OP_SETUP_EXCEPT || op == OP_SETUP_ENSURE),
+    ASSERT((op == OP_JUMP || op == OP_JUMPT || op == OP_JUMPF || op == OP_FOR_NEXT),
            "Not a jump opcode");
 }
 
@@ -421,19 +458,30 @@ static void emitMethodCall(Compiler* c, const char* name, int args) {
     JStarIdentifier meth = createIdentifier(name);
     emitBytecode(c, OP_INVOKE_0 + args, 0);
     emitShort(c, identifierConst(c, &meth, 0), 0);
+    emitShort(c, createInlineCache(c, 0), 0);
 }
 
-static void enterTryBlock(Compiler* c, TryExcept* exc, int numHandlers, int line) {
+static void enterTryBlock(Compiler* c, TryExcept* exc, int numHandlers) {
     exc->depth = c->depth;
+    exc->stackDepth = c->localsCount;
     exc->numHandlers = numHandlers;
     exc->next = c->tryBlocks;
     c->tryBlocks = exc;
     c->tryDepth += numHandlers;
+}
 
-    if(c->tryDepth > MAX_HANDLERS) {
-        error(c, line, "Exceeded max number of nested exception handlers: max %d, got %d",
-              MAX_HANDLERS, c->tryDepth);
-    }
+// Adds an entry to the exception table of the function, with the handler code starting at the
+// current address. Try blocks are statements, so when entering them the stack contains only the
+// locals of the function and the handler can restore its depth from `localsCount`
+static void addTryHandler(Compiler* c, TryExcept* exc, HandlerType type, size_t start, size_t end) {
+    Handler handler = {
+        .type = type,
+        .start = start,
+        .end = end,
+        .address = getCurrentAddr(c),
+        .stackDepth = exc->stackDepth,
+    };
+    addHandler(&c->func->code, handler);
 }
 
 static void exitTryBlock(Compiler* c) {
@@ -441,9 +489,20 @@ static void exitTryBlock(Compiler* c) {
     c->tryBlocks = c->tryBlocks->next;
 }
 
-static ObjString* readString(Compiler* c, JStarExpr* e) {
-    JStarBuffer* sb = &c->stringBuf;
-    jsrBufferClear(sb);
+// Concatenations of string literals are folded here rather than in the optimizer, as string
+// nodes reference the unescaped source text and don't own any memory
+static bool isStringConcat(JStarExpr* e) {
+    if(e->type == JSR_STRING) return true;
+    return e->type == JSR_BINARY && e->as.binary.op == TOK_PLUS &&
+           isStringConcat(e->as.binary.left) && isStringConcat(e->as.binary.right);
+}
+
+static void appendString(Compiler* c, JStarExpr* e, JStarBuffer* sb) {
+    if(e->type == JSR_BINARY) {
+        appendString(c, e->as.binary.left, sb);
+        appendString(c, e->as.binary.right, sb);
+        return;
+    }
 
     const char* str = e->as.string.str;
     size_t length = e->as.string.length;
@@ -469,31 +528,40 @@ static ObjString* readString(Compiler* c, JStarExpr* e) {
             jsrBufferAppendChar(sb, str[i]);
         }
     }
+}
 
+static ObjString* readString(Compiler* c, JStarExpr* e) {
+    JStarBuffer* sb = &c->stringBuf;
+    jsrBufferClear(sb);
+    appendString(c, e, sb);
     return copyString(c->vm, sb->data, sb->size);
 }
 
+static bool isLiteral(JStarExpr* e) {
+    return e->type == JSR_NUMBER || e->type == JSR_BOOL || e->type == JSR_STRING ||
+           e->type == JSR_NULL;
+}
+
+static Value literalValue(Compiler* c, JStarExpr* e) {
+    switch(e->type) {
+    case JSR_NUMBER:
+        return NUM_VAL(e->as.num);
+    case JSR_BOOL:
+        return BOOL_VAL(e->as.boolean);
+    case JSR_STRING:
+        return OBJ_VAL(readString(c, e));
+    case JSR_NULL:
+        return NULL_VAL;
+    default:
+        UNREACHABLE();
+        return NULL_VAL;
+    }
+}
+
 static void addFunctionDefaults(Compiler* c, Prototype* proto, Vector* defaultArgs) {
     int i = 0;
     vecForeach(JStarExpr** it, *defaultArgs) {
-        JStarExpr* e = *it;
-        switch(e->type) {
-        case JSR_NUMBER:
-            proto->defaults[i++] = NUM_VAL(e->as.num);
-            break;
-        case JSR_BOOL:
-            proto->defaults[i++] = BOOL_VAL(e->as.boolean);
-            break;
-        case JSR_STRING:
-            proto->defaults[i++] = OBJ_VAL(readString(c, e));
-            break;
-        case JSR_NULL:
-            proto->defaults[i++] = NULL_VAL;
-            break;
-        default:
-            UNREACHABLE();
-            break;
-        }
+        proto->defaults[i++] = literalValue(c, *it);
     }
 }
 
@@ -503,7 +571,64 @@ static void addFunctionDefaults(Compiler* c, Prototype* proto, Vector* defaultAr
 
 static void compileExpr(Compiler* c, JStarExpr* e);
 
+static void emitValueConst(Compiler* c, Value val, int line) {
+    emitBytecode(c, OP_GET_CONST, line);
+    emitShort(c, createConst(c, val, line), line);
+}
+
+// Emit a superinstruction for arithmetic and comparisons between a local and a number
+// literal or between two locals, merging the loads of the operands with the operation
+static bool compileFusedBinary(Compiler* c, JStarExpr* e) {
+    JStarExpr* right = e->as.binary.right;
+    int leftSlot = findLocal(c, e->as.binary.left);
+    if(leftSlot == -1) return false;
+
+    bool isConst = right->type == JSR_NUMBER;
+    int rightSlot = isConst ? -1 : findLocal(c, right);
+    if(!isConst && rightSlot == -1) return false;
+
+    Opcode fused;
+    switch(e->as.binary.op) {
+    case TOK_PLUS:
+        fused = isConst ? OP_ADD_LOCAL_CONST : OP_ADD_LOCALS;
+        break;
+    case TOK_MINUS:
+        fused = isConst ? OP_SUB_LOCAL_CONST : OP_SUB_LOCALS;
+        break;
+    case TOK_LT:
+        fused = isConst ? OP_LT_LOCAL_CONST : OP_LT_LOCALS;
+        break;
+    case TOK_LE:
+        fused = isConst ? OP_LE_LOCAL_CONST : OP_LE_LOCALS;
+        break;
+    case TOK_GT:
+        fused = isConst ? OP_GT_LOCAL_CONST : OP_GT_LOCALS;
+        break;
+    case TOK_GE:
+        fused = isConst ? OP_GE_LOCAL_CONST : OP_GE_LOCALS;
+        break;
+    default:
+        return false;
+    }
+
+    emitBytecode(c, fused, e->line);
+    emitBytecode(c, leftSlot, e->line);
+    if(isConst) {
+        emitShort(c, createConst(c, NUM_VAL(right->as.num), e->line), e->line);
+    } else {
+        emitBytecode(c, rightSlot, e->line);
+    }
+    return true;
+}
+
 static void compileBinaryExpr(Compiler* c, JStarExpr* e) {
+    if(isStringConcat(e)) {
+        emitValueConst(c, OBJ_VAL(readString(c, e)), e->line);
+        return;
+    }
+
+    if(compileFusedBinary(c, e)) return;
+
     compileExpr(c, e->as.binary.left);
     compileExpr(c, e->as.binary.right);
     switch(e->as.binary.op) {
@@ -661,6 +786,23 @@ static void compileFunLiteral(Compiler* c, JStarExpr* e, JStarIdentifier* name)
     }
 }
 
+static void compileYieldExpr(Compiler* c, JStarExpr* e) {
+    if(c->prev == NULL) {
+        error(c, e->line, "Cannot use yield outside a function");
+    }
+    if(c->type == TYPE_CTOR) {
+        error(c, e->line, "Cannot use yield in constructor");
+    }
+
+    if(e->as.yield.expr != NULL) {
+        compileExpr(c, e->as.yield.expr);
+    } else {
+        emitBytecode(c, OP_NULL, e->line);
+    }
+
+    emitBytecode(c, OP_YIELD, e->line);
+}
+
 static void compileLval(Compiler* c, JStarExpr* e) {
     switch(e->type) {
     case JSR_VAR:
@@ -670,6 +812,7 @@ static void compileLval(Compiler* c, JStarExpr* e) {
         compileExpr(c, e->as.access.left);
         emitBytecode(c, OP_SET_FIELD, e->line);
         emitShort(c, identifierConst(c, &e->as.access.id, e->line), e->line);
+        emitShort(c, createInlineCache(c, e->line), e->line);
         break;
     }
     case JSR_ARR_ACCESS: {
@@ -805,10 +948,11 @@ static void finishCall(Compiler* c, Opcode callCode, Opcode callInline, Opcode c
               (int)UINT8_MAX, c->func->proto.name->data);
     }
 
+    // Tail calls don't have variants with inline arguments, and pass `callCode` as `callInline`
     if(isUnpack) {
         emitBytecode(c, callUnpack, args->line);
         emitBytecode(c, argsCount, args->line);
-    } else if(argsCount <= MAX_INLINE_ARGS) {
+    } else if(callInline != callCode && argsCount <= MAX_INLINE_ARGS) {
         emitBytecode(c, callInline + argsCount, args->line);
     } else {
         emitBytecode(c, callCode, args->line);
@@ -816,18 +960,18 @@ static void finishCall(Compiler* c, Opcode callCode, Opcode callInline, Opcode c
     }
 }
 
-static void compileCallExpr(Compiler* c, JStarExpr* e) {
-    Opcode callCode = OP_CALL;
-    Opcode callInline = OP_CALL_0;
-    Opcode callUnpack = OP_CALL_UNPACK;
+static void compileCallExpr(Compiler* c, JStarExpr* e, bool tail) {
+    Opcode callCode = tail ? OP_TAIL_CALL : OP_CALL;
+    Opcode callInline = tail ? OP_TAIL_CALL : OP_CALL_0;
+    Opcode callUnpack = tail ? OP_TAIL_CALL_UNPACK : OP_CALL_UNPACK;
 
     JStarExpr* callee = e->as.call.callee;
     bool isMethod = callee->type == JSR_ACCESS;
 
     if(isMethod) {
-        callCode = OP_INVOKE;
-        callInline = OP_INVOKE_0;
-        callUnpack = OP_INVOKE_UNPACK;
+        callCode = tail ? OP_TAIL_INVOKE : OP_INVOKE;
+        callInline = tail ? OP_TAIL_INVOKE : OP_INVOKE_0;
+        callUnpack = tail ? OP_TAIL_INVOKE_UNPACK : OP_INVOKE_UNPACK;
         compileExpr(c, callee->as.access.left);
     } else {
         compileExpr(c, callee);
@@ -837,10 +981,11 @@ static void compileCallExpr(Compiler* c, JStarExpr* e) {
 
     if(isMethod) {
         emitShort(c, identifierConst(c, &callee->as.access.id, e->line), e->line);
+        emitShort(c, createInlineCache(c, e->line), e->line);
     }
 }
 
-static void compileSuper(Compiler* c, JStarExpr* e) {
+static void compileSuper(Compiler* c, JStarExpr* e, bool tail) {
     if(c->type != TYPE_METHOD && c->type != TYPE_CTOR) {
         error(c, e->line, "Can only use `super` in method call");
         return;
@@ -857,18 +1002,32 @@ static void compileSuper(Compiler* c, JStarExpr* e) {
     }
 
     if(e->as.sup.args != NULL) {
-        finishCall(c, OP_SUPER, OP_SUPER_0, OP_SUPER_UNPACK, e->as.sup.args, e->as.sup.unpackArg);
+        if(tail) {
+            finishCall(c, OP_TAIL_SUPER, OP_TAIL_SUPER, OP_TAIL_SUPER_UNPACK, e->as.sup.args,
+                       e->as.sup.unpackArg);
+        } else {
+            finishCall(c, OP_SUPER, OP_SUPER_0, OP_SUPER_UNPACK, e->as.sup.args,
+                       e->as.sup.unpackArg);
+        }
         emitShort(c, nameConst, e->line);
     } else {
         emitBytecode(c, OP_SUPER_BIND, e->line);
         emitShort(c, nameConst, e->line);
     }
+    emitShort(c, createInlineCache(c, e->line), e->line);
 }
 
 static void compileAccessExpression(Compiler* c, JStarExpr* e) {
-    compileExpr(c, e->as.access.left);
-    emitBytecode(c, OP_GET_FIELD, e->line);
+    int slot = findLocal(c, e->as.access.left);
+    if(slot != -1) {
+        emitBytecode(c, OP_GET_LOCAL_FIELD, e->line);
+        emitBytecode(c, slot, e->line);
+    } else {
+        compileExpr(c, e->as.access.left);
+        emitBytecode(c, OP_GET_FIELD, e->line);
+    }
     emitShort(c, identifierConst(c, &e->as.access.id, e->line), e->line);
+    emitShort(c, createInlineCache(c, e->line), e->line);
 }
 
 static void compileArraryAccExpression(Compiler* c, JStarExpr* e) {
@@ -883,8 +1042,51 @@ static void compilePowExpr(Compiler* c, JStarExpr* e) {
     emitBytecode(c, OP_POW, e->line);
 }
 
+// Element counts of List and Table literals are passed to the VM as a capacity hint, so that the
+// container is allocated once instead of being grown as the elements are inserted
+static uint16_t capacityHint(size_t count) {
+    return count > UINT16_MAX ? UINT16_MAX : (uint16_t)count;
+}
+
+// List and Table literals with at least this many elements, all of them literals, are stored as a
+// single Tuple constant and built in one instruction instead of one instruction per element
+#define CONST_LITERAL_MIN 8
+
+static bool isConstLiteral(Vector* exprs, bool keyVals) {
+    if(vecSize(exprs) < CONST_LITERAL_MIN) return false;
+    size_t i = 0;
+    vecForeach(JStarExpr** it, *exprs) {
+        JStarExpr* e = *it;
+        // Null keys are an error that must be raised at runtime
+        bool isKey = keyVals && i++ % 2 == 0;
+        if(!isLiteral(e) || (isKey && e->type == JSR_NULL)) return false;
+    }
+    return true;
+}
+
+static void emitConstLiteral(Compiler* c, Opcode op, Vector* exprs, int line) {
+    ObjTuple* tup = newTuple(c->vm, vecSize(exprs));
+    uint16_t idx = createConst(c, OBJ_VAL(tup), line);
+
+    size_t i = 0;
+    vecForeach(JStarExpr** it, *exprs) {
+        tup->arr[i++] = literalValue(c, *it);
+        GC_WRITE_BARRIER(c->vm, tup);
+    }
+
+    emitBytecode(c, op, line);
+    emitShort(c, idx, line);
+}
+
 static void CompileListLit(Compiler* c, JStarExpr* e) {
+    Vector* exprs = &e->as.array.exprs->as.list;
+    if(isConstLiteral(exprs, false)) {
+        emitConstLiteral(c, OP_NEW_CONST_LIST, exprs, e->line);
+        return;
+    }
+
     emitBytecode(c, OP_NEW_LIST, e->line);
+    emitShort(c, capacityHint(vecSize(&e->as.array.exprs->as.list)), e->line);
     vecForeach(JStarExpr** it, e->as.array.exprs->as.list) {
         compileExpr(c, *it);
         emitBytecode(c, OP_APPEND_LIST, e->line);
@@ -903,9 +1105,15 @@ static void compileTupleLit(Compiler* c, JStarExpr* e) {
 }
 
 static void compileTableLit(Compiler* c, JStarExpr* e) {
+    JStarExpr* keyVals = e->as.table.keyVals;
+    if(isConstLiteral(&keyVals->as.list, true)) {
+        emitConstLiteral(c, OP_NEW_CONST_TABLE, &keyVals->as.list, e->line);
+        return;
+    }
+
     emitBytecode(c, OP_NEW_TABLE, e->line);
+    emitShort(c, capacityHint(vecSize(&keyVals->as.list) / 2), e->line);
 
-    JStarExpr* keyVals = e->as.table.keyVals;
     for(JStarExpr** it = vecBegin(&keyVals->as.list); it != vecEnd(&keyVals->as.list); it += 2) {
         JStarExpr* key = *it;
         JStarExpr* val = *(it + 1);
@@ -919,9 +1127,15 @@ static void compileTableLit(Compiler* c, JStarExpr* e) {
     }
 }
 
-static void emitValueConst(Compiler* c, Value val, int line) {
-    emitBytecode(c, OP_GET_CONST, line);
-    emitShort(c, createConst(c, val, line), line);
+static void compileNumber(Compiler* c, double num, int line) {
+    // Small integers are encoded in the instruction, without using a constant slot
+    if(num >= INT8_MIN && num <= INT8_MAX && num == (int8_t)num &&
+       (num != 0 || !signbit(num))) {
+        emitBytecode(c, OP_GET_SMALL_INT, line);
+        emitBytecode(c, (uint8_t)(int8_t)num, line);
+    } else {
+        emitValueConst(c, NUM_VAL(num), line);
+    }
 }
 
 static void compileExpr(Compiler* c, JStarExpr* e) {
@@ -946,7 +1160,7 @@ static void compileExpr(Compiler* c, JStarExpr* e) {
         compileTernaryExpr(c, e);
         break;
     case JSR_CALL:
-        compileCallExpr(c, e);
+        compileCallExpr(c, e, false);
         break;
     case JSR_ACCESS:
         compileAccessExpression(c, e);
@@ -958,7 +1172,7 @@ static void compileExpr(Compiler* c, JStarExpr* e) {
         compilePowExpr(c, e);
         break;
     case JSR_NUMBER:
-        emitValueConst(c, NUM_VAL(e->as.num), e->line);
+        compileNumber(c, e->as.num, e->line);
         break;
     case JSR_BOOL:
         emitValueConst(c, BOOL_VAL(e->as.boolean), e->line);
@@ -982,11 +1196,14 @@ static void compileExpr(Compiler* c, JStarExpr* e) {
         compileTableLit(c, e);
         break;
     case JSR_SUPER:
-        compileSuper(c, e);
+        compileSuper(c, e, false);
         break;
     case JSR_FUNC_LIT:
         compileFunLiteral(c, e, NULL);
         break;
+    case JSR_YIELD:
+        compileYieldExpr(c, e);
+        break;
     case JSR_EXPR_LST:
         vecForeach(JStarExpr** it, e->as.list) {
             compileExpr(c, *it);
@@ -1015,8 +1232,20 @@ static void compileReturnStatement(Compiler* c, JStarStmt* s) {
         error(c, s->line, "Cannot use return in constructor");
     }
 
-    if(s->as.returnStmt.e != NULL) {
-        compileExpr(c, s->as.returnStmt.e);
+    JStarExpr* e = s->as.returnStmt.e;
+
+    // A call in tail position reuses the frame of the current function. This isn't possible inside
+    // try blocks, as their handlers must still be able to run once the call returns, nor inside
+    // generators, whose frame is bound to the generator object.
+    // The OP_RETURN that follows is executed only when the callee can't replace the frame (for
+    // example when it is a native or a class) and it's called normally instead
+    bool tail = c->tryDepth == 0 && !isGenerator(c);
+    if(e != NULL && tail && e->type == JSR_CALL) {
+        compileCallExpr(c, e, true);
+    } else if(e != NULL && tail && e->type == JSR_SUPER && e->as.sup.args != NULL) {
+        compileSuper(c, e, true);
+    } else if(e != NULL) {
+        compileExpr(c, e);
     } else {
         emitBytecode(c, OP_NULL, s->line);
     }
@@ -1046,6 +1275,33 @@ static void compileIfStatement(Compiler* c, JStarStmt* s) {
     }
 }
 
+static void compileExprStmt(Compiler* c, JStarExpr* e) {
+    // An assignment to a local whose result is discarded stores the value and pops it at once
+    if(e->type == JSR_ASSIGN && e->as.assign.lval->type == JSR_VAR) {
+        int slot = findLocal(c, e->as.assign.lval);
+        if(slot != -1) {
+            compileRval(c, e->as.assign.rval, &e->as.assign.lval->as.var.id);
+            emitBytecode(c, OP_STORE_LOCAL, e->line);
+            emitBytecode(c, slot, e->line);
+            return;
+        }
+    } else if(e->type == JSR_COMPUND_ASS && e->as.compound.lval->type == JSR_VAR) {
+        int slot = findLocal(c, e->as.compound.lval);
+        if(slot != -1) {
+            JStarExpr* l = e->as.compound.lval;
+            JStarExpr* r = e->as.compound.rval;
+            JStarExpr binary = {e->line, JSR_BINARY, .as = {.binary = {e->as.compound.op, l, r}}};
+            compileExpr(c, &binary);
+            emitBytecode(c, OP_STORE_LOCAL, e->line);
+            emitBytecode(c, slot, e->line);
+            return;
+        }
+    }
+
+    compileExpr(c, e);
+    emitBytecode(c, OP_POP, 0);
+}
+
 static void compileForStatement(Compiler* c, JStarStmt* s) {
     enterScope(c);
 
@@ -1063,8 +1319,7 @@ static void compileForStatement(Compiler* c, JStarStmt* s) {
     startLoop(c, &l);
 
     if(s->as.forStmt.act != NULL) {
-        compileExpr(c, s->as.forStmt.act);
-        emitBytecode(c, OP_POP, 0);
+        compileExprStmt(c, s->as.forStmt.act);
         setJumpTo(c, firstJmp, getCurrentAddr(c), 0);
     }
 
@@ -1276,28 +1531,15 @@ static void compileTryExcept(Compiler* c, JStarStmt* s) {
     int numHandlers = (hasExcepts ? 1 : 0) + (hasEnsure ? 1 : 0);
 
     TryExcept tryBlock;
-    enterTryBlock(c, &tryBlock, numHandlers, s->line);
-
-    size_t ensSetup = 0, excSetup = 0;
-
-    if(hasEnsure) {
-        ensSetup = emitBytecode(c, OP_SETUP_ENSURE, s->line);
-        emitShort(c, 0, 0);
-    }
-
-    if(hasExcepts) {
-        excSetup = emitBytecode(c, OP_SETUP_EXCEPT, s->line);
-        emitShort(c, 0, 0);
-    }
+    enterTryBlock(c, &tryBlock, numHandlers);
 
+    // No code is emitted to enter the try block, the handlers are recorded in the exception table
+    // of the function once their code is compiled
+    size_t tryStart = getCurrentAddr(c);
     compileStatement(c, s->as.tryStmt.block);
-
-    if(hasExcepts) {
-        emitBytecode(c, OP_POP_HANDLER, s->line);
-    }
+    size_t tryEnd = getCurrentAddr(c);
 
     if(hasEnsure) {
-        emitBytecode(c, OP_POP_HANDLER, s->line);
         // Reached end of try block during normal execution flow, set exception and unwind
         // cause to null to signal the ensure handler that no exception was raised
         emitBytecode(c, OP_NULL, s->line);
@@ -1314,16 +1556,19 @@ static void compileTryExcept(Compiler* c, JStarStmt* s) {
     Variable causeVar = declareVar(c, &cause, false, 0);
     defineVar(c, &causeVar, 0);
 
+    size_t excStart = 0, excEnd = 0;
+
     if(hasExcepts) {
         size_t excJmp = emitBytecode(c, OP_JUMP, 0);
         emitShort(c, 0, 0);
 
-        setJumpTo(c, excSetup, getCurrentAddr(c), s->line);
+        addTryHandler(c, &tryBlock, HANDLER_EXCEPT, tryStart, tryEnd);
+
+        excStart = getCurrentAddr(c);
         compileExcepts(c, &s->as.tryStmt.excs, 0);
+        excEnd = getCurrentAddr(c);
 
-        if(hasEnsure) {
-            emitBytecode(c, OP_POP_HANDLER, 0);
-        } else {
+        if(!hasEnsure) {
             emitBytecode(c, OP_END_HANDLER, 0);
             exitScope(c);
         }
@@ -1332,7 +1577,11 @@ static void compileTryExcept(Compiler* c, JStarStmt* s) {
     }
 
     if(hasEnsure) {
-        setJumpTo(c, ensSetup, getCurrentAddr(c), s->line);
+        // The ensure handler also protects the except clauses, but not the code that jumps over
+        // them, since at that point the try block has been exited normally
+        addTryHandler(c, &tryBlock, HANDLER_ENSURE, tryStart, tryEnd);
+        if(hasExcepts) addTryHandler(c, &tryBlock, HANDLER_ENSURE, excStart, excEnd);
+
         compileStatement(c, s->as.tryStmt.ensure);
         emitBytecode(c, OP_END_HANDLER, 0);
         exitScope(c);
@@ -1371,10 +1620,8 @@ static void compileWithStatement(Compiler* c, JStarStmt* s) {
 
     // try
     TryExcept tryBlock;
-    enterTryBlock(c, &tryBlock, 1, s->line);
-
-    size_t ensSetup = emitBytecode(c, OP_SETUP_ENSURE, s->line);
-    emitShort(c, 0, 0);
+    enterTryBlock(c, &tryBlock, 1);
+    size_t tryStart = getCurrentAddr(c);
 
     // x = closable
     JStarExpr lval = {.line = s->line, .type = JSR_VAR, .as = {.var = {s->as.withStmt.var}}};
@@ -1386,8 +1633,8 @@ static void compileWithStatement(Compiler* c, JStarStmt* s) {
 
     // code
     compileStatement(c, s->as.withStmt.block);
+    size_t tryEnd = getCurrentAddr(c);
 
-    emitBytecode(c, OP_POP_HANDLER, s->line);
     emitBytecode(c, OP_NULL, s->line);
     emitBytecode(c, OP_NULL, s->line);
 
@@ -1402,7 +1649,7 @@ static void compileWithStatement(Compiler* c, JStarStmt* s) {
     Variable causeVar = declareVar(c, &cause, false, 0);
     defineVar(c, &causeVar, 0);
 
-    setJumpTo(c, ensSetup, getCurrentAddr(c), s->line);
+    addTryHandler(c, &tryBlock, HANDLER_ENSURE, tryStart, tryEnd);
 
     // if x then x.close() end
     compileVariable(c, &s->as.withStmt.var, false, s->line);
@@ -1443,7 +1690,8 @@ static void compileLoopExitStmt(Compiler* c, JStarStmt* s) {
     emitBytecode(c, 0, s->line);
 }
 
-static ObjFunction* function(Compiler* c, ObjModule* module, JStarStmt* s) {
+// Creates the function compiled by `c` and declares its arguments
+static void functionPrologue(Compiler* c, ObjModule* module, JStarStmt* s) {
     JStarIdentifier* name = &s->as.funcDecl.id;
     size_t defaults = vecSize(&s->as.funcDecl.defArgs);
     size_t arity = vecSize(&s->as.funcDecl.formalArgs);
@@ -1474,6 +1722,14 @@ static ObjFunction* function(Compiler* c, ObjModule* module, JStarStmt* s) {
         defineVar(c, &vararg, s->line);
     }
 
+    if(isGenerator(c)) {
+        emitGeneratorPrologue(c, s->line);
+    }
+}
+
+static ObjFunction* function(Compiler* c, ObjModule* module, JStarStmt* s) {
+    functionPrologue(c, module, s);
+
     JStarStmt* body = s->as.funcDecl.body;
     compileStatements(c, &body->as.blockStmt.stmts);
 
@@ -1531,6 +1787,10 @@ static ObjFunction* method(Compiler* c, ObjModule* mod, JStarIdentifier* clsName
         defineVar(c, &vararg, s->line);
     }
 
+    if(isGenerator(c)) {
+        emitGeneratorPrologue(c, s->line);
+    }
+
     JStarStmt* body = s->as.funcDecl.body;
     compileStatements(c, &body->as.blockStmt.stmts);
 
@@ -1750,8 +2010,7 @@ static void compileStatement(Compiler* c, JStarStmt* s) {
         compileLoopExitStmt(c, s);
         break;
     case JSR_EXPR_STMT:
-        compileExpr(c, s->as.exprStmt);
-        emitBytecode(c, OP_POP, 0);
+        compileExprStmt(c, s->as.exprStmt);
         break;
     case JSR_VARDECL:
         compileVarDecl(c, s);
@@ -1779,6 +2038,8 @@ static void compileStatement(Compiler* c, JStarStmt* s) {
 ObjFunction* compile(JStarVM* vm, const char* filename, ObjModule* module, JStarStmt* ast) {
     PROFILE_FUNC()
 
+    optimize(ast);
+
     Compiler c;
     initCompiler(&c, vm, filename, NULL, TYPE_FUNC, ast);
     ObjFunction* func = function(&c, module, ast);
@@ -1787,6 +2048,51 @@ ObjFunction* compile(JStarVM* vm, const char* filename, ObjModule* module, JStar
     return c.hadError ? NULL : func;
 }
 
+static void streamParseError(const char* file, int line, const char* error, void* udata) {
+    Compiler* c = udata;
+    if(c->vm->errorCallback) {
+        c->vm->errorCallback(c->vm, JSR_SYNTAX_ERR, file, line, error);
+    }
+}
+
+static void compileStreamedStmt(JStarStmt* s, void* udata) {
+    Compiler* c = udata;
+    optimize(s);
+    compileStatement(c, s);
+}
+
+ObjFunction* compileStreaming(JStarVM* vm, const char* filename, ObjModule* module,
+                              const char* src, JStarResult* err) {
+    PROFILE_FUNC()
+
+    // The module body is compiled as the function of an empty declaration, that is then fed the
+    // top level statements as they get parsed
+    JStarStmt program = {0};
+    program.type = JSR_FUNCDECL;
+
+    Compiler c;
+    initCompiler(&c, vm, filename, NULL, TYPE_FUNC, &program);
+    functionPrologue(&c, module, &program);
+
+    JStarASTArena* arena = jsrNewASTArena();
+    bool parsed = jsrParseStream(filename, src, arena, &compileStreamedStmt, &streamParseError, &c);
+    jsrFreeASTArena(arena);
+
+    emitBytecode(&c, OP_NULL, 0);
+    emitBytecode(&c, OP_RETURN, 0);
+    endCompiler(&c);
+
+    if(!parsed) {
+        *err = JSR_SYNTAX_ERR;
+        return NULL;
+    }
+    if(c.hadError) {
+        *err = JSR_COMPILE_ERR;
+        return NULL;
+    }
+    return c.func;
+}
+
 void reachCompilerRoots(JStarVM* vm, Compiler* c) {
     PROFILE_FUNC()
 
@@ -14,6 +14,11 @@
 typedef struct Compiler Compiler;
 
 ObjFunction* compile(JStarVM* vm, const char* filename, ObjModule* module, JStarStmt* s);
+// Compiles `src` while parsing it, one top level statement at a time, so that only the tree of the
+// statement being compiled is in memory. On errors returns NULL and sets `err` to either
+// JSR_SYNTAX_ERR or JSR_COMPILE_ERR
+ObjFunction* compileStreaming(JStarVM* vm, const char* filename, ObjModule* module,
+                              const char* src, JStarResult* err);
 void reachCompilerRoots(JStarVM* vm, Compiler* c);
 
 #endif
@@ -0,0 +1,103 @@
+#ifndef CTRLGROUP_H
+#define CTRLGROUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Control bytes shared by the open addressing hash tables (`HashTable` and `Table`).
+// Every slot of a table has an associated control byte that either marks it as empty or deleted,
+// or stores the low 7 bits of the hash of the key it contains. Lookups load the control bytes of
+// GROUP_WIDTH consecutive slots at once and match them in parallel using plain 64-bit arithmetic,
+// so that keys are compared only in slots whose hash bits agree with the searched one.
+
+#define GROUP_WIDTH 8
+
+#define CTRL_EMPTY   ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xfe)
+
+// Bits of the hash used to select the first probed group, and bits stored in the control byte
+#define HASH_H1(hash) ((size_t)(hash) >> 7)
+#define HASH_H2(hash) ((uint8_t)((hash)&0x7f))
+
+#define GROUP_LSB ((uint64_t)0x0101010101010101)
+#define GROUP_MSB ((uint64_t)0x8080808080808080)
+
+typedef uint64_t Group;
+// Has the high bit set in the byte of every matching slot of a group
+typedef uint64_t GroupMask;
+
+static inline Group groupLoad(const uint8_t* ctrl) {
+    // Groups are always in little endian order, so that the lowest byte of a mask corresponds
+    // to the first slot of the group
+    Group g;
+    memcpy(&g, ctrl, sizeof(g));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    g = __builtin_bswap64(g);
+#endif
+    return g;
+}
+
+// Matches the full slots whose control byte is equal to `h2`. It can report false positives, but
+// only on full slots, so they are discarded when comparing the keys
+static inline GroupMask groupMatch(Group g, uint8_t h2) {
+    Group x = g ^ (GROUP_LSB * h2);
+    return (x - GROUP_LSB) & ~x & GROUP_MSB;
+}
+
+static inline GroupMask groupMatchEmpty(Group g) {
+    return g & ~(g << 6) & GROUP_MSB;
+}
+
+static inline GroupMask groupMatchEmptyOrDeleted(Group g) {
+    return g & ~(g << 7) & GROUP_MSB;
+}
+
+// Returns the index in the group of the first matching slot. `m` must not be zero
+static inline size_t groupMaskFirst(GroupMask m) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctzll(m) >> 3;
+#else
+    size_t i = 0;
+    while(!(m & 0x80)) {
+        m >>= 8;
+        i++;
+    }
+    return i;
+#endif
+}
+
+// Removes the first matching slot from the mask
+static inline GroupMask groupMaskNext(GroupMask m) {
+    return m & (m - 1);
+}
+
+// Tables are probed one group at a time using triangular steps. Since the number of groups is a
+// power of two this sequence is guaranteed to visit all of them
+static inline size_t probeStart(uint32_t hash, size_t sizeMask) {
+    return HASH_H1(hash) & sizeMask & ~(size_t)(GROUP_WIDTH - 1);
+}
+
+static inline size_t probeNext(size_t pos, size_t* stride, size_t sizeMask) {
+    *stride += GROUP_WIDTH;
+    return (pos + *stride) & sizeMask;
+}
+
+// Returns the first empty or deleted slot in the probe sequence of `hash`
+static inline size_t probeFreeSlot(const uint8_t* ctrl, size_t sizeMask, uint32_t hash) {
+    size_t pos = probeStart(hash, sizeMask), stride = 0;
+    for(;;) {
+        GroupMask m = groupMatchEmptyOrDeleted(groupLoad(ctrl + pos));
+        if(m) return pos + groupMaskFirst(m);
+        pos = probeNext(pos, &stride, sizeMask);
+    }
+}
+
+// Returns true if the group containing slot `i` has an empty slot. A deleted slot in such a group
+// can be marked as empty, since every probe sequence that reaches it would stop there anyway
+static inline bool groupHasEmpty(const uint8_t* ctrl, size_t i) {
+    return groupMatchEmpty(groupLoad(ctrl + (i & ~(size_t)(GROUP_WIDTH - 1)))) != 0;
+}
+
+#endif
@@ -39,6 +39,15 @@ static void disassembleCode(Code* c, int indent) {
     }
 }
 
+static void disassembleHandlers(Code* c, int indent) {
+    for(size_t i = 0; i < c->handlerCount; i++) {
+        Handler* h = &c->handlers[i];
+        printf("%*s%s %.4u-%.4u to %.4u, stack %u\n", indent, "",
+               h->type == HANDLER_EXCEPT ? "except" : "ensure", h->start, h->end, h->address,
+               h->stackDepth);
+    }
+}
+
 static void disassemblePrototype(Prototype* proto, int upvals) {
     printf("arguments %d, defaults %d, upvalues %d", (int)proto->argsCount, (int)proto->defCount,
            upvals);
@@ -57,10 +66,17 @@ void disassembleFunction(ObjFunction* fn) {
     } else {
         printf("%s", name->data);
     }
+
+    if(fn->lazy.data) {
+        printf(" (not yet loaded at %p)\n", (void*)fn);
+        return;
+    }
+
     printf(" (%zu instructions at %p)\n", instr, (void*)fn);
     
     disassemblePrototype(&fn->proto, fn->upvalueCount);
     disassembleCode(&fn->code, INDENT);
+    disassembleHandlers(&fn->code, INDENT);
 
     for(int i = 0; i < fn->code.consts.size; i++) {
         Value c = fn->code.consts.arr[i];
@@ -109,18 +125,56 @@ static void const2Instruction(Code* c, size_t i) {
     printf(")");
 }
 
+static void cachedConstInstruction(Code* c, size_t i) {
+    int op = readShortAt(c->bytecode, i + 1);
+    int cache = readShortAt(c->bytecode, i + 3);
+    printf("%d (", op);
+    printValue(c->consts.arr[op]);
+    printf(") [cache %d]", cache);
+}
+
 static void invokeInstruction(Code* c, size_t i) {
     int argc = c->bytecode[i + 1];
     int name = readShortAt(c->bytecode, i + 2);
+    int cache = readShortAt(c->bytecode, i + 4);
     printf("%d %d (", argc, name);
     printValue(c->consts.arr[name]);
+    printf(") [cache %d]", cache);
+}
+
+static void localConstInstruction(Code* c, size_t i) {
+    int local = c->bytecode[i + 1];
+    int op = readShortAt(c->bytecode, i + 2);
+    printf("%d %d (", local, op);
+    printValue(c->consts.arr[op]);
     printf(")");
 }
 
+static void localCachedConstInstruction(Code* c, size_t i) {
+    int local = c->bytecode[i + 1];
+    int op = readShortAt(c->bytecode, i + 2);
+    int cache = readShortAt(c->bytecode, i + 4);
+    printf("%d %d (", local, op);
+    printValue(c->consts.arr[op]);
+    printf(") [cache %d]", cache);
+}
+
+static void unsignedShortInstruction(Code* c, size_t i) {
+    printf("%d", readShortAt(c->bytecode, i + 1));
+}
+
 static void unsignedByteInstruction(Code* c, size_t i) {
     printf("%d", c->bytecode[i + 1]);
 }
 
+static void signedByteInstruction(Code* c, size_t i) {
+    printf("%d", (int8_t)c->bytecode[i + 1]);
+}
+
+static void twoBytesInstruction(Code* c, size_t i) {
+    printf("%d %d", c->bytecode[i + 1], c->bytecode[i + 2]);
+}
+
 static void closureInstruction(Code* c, int indent, size_t i) {
     int op = readShortAt(c->bytecode, i + 1);
 
@@ -153,11 +207,19 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
     case OP_NATIVE:
     case OP_IMPORT:
     case OP_IMPORT_FROM:
-    case OP_GET_FIELD:
-    case OP_SET_FIELD:
     case OP_NEW_CLASS:
     case OP_NEW_SUBCLASS:
     case OP_DEF_METHOD:
+    case OP_GET_CONST:
+    case OP_NEW_CONST_LIST:
+    case OP_NEW_CONST_TABLE:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+        constInstruction(c, instr);
+        break;
+    case OP_GET_FIELD:
+    case OP_SET_FIELD:
     case OP_INVOKE_0:
     case OP_INVOKE_1:
     case OP_INVOKE_2:
@@ -169,7 +231,6 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
     case OP_INVOKE_8:
     case OP_INVOKE_9:
     case OP_INVOKE_10:
-    case OP_INVOKE_UNPACK:
     case OP_SUPER_0:
     case OP_SUPER_1:
     case OP_SUPER_2:
@@ -182,40 +243,70 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
     case OP_SUPER_9:
     case OP_SUPER_10:
     case OP_SUPER_BIND:
-    case OP_SUPER_UNPACK:
-    case OP_GET_CONST:
-    case OP_GET_GLOBAL:
-    case OP_SET_GLOBAL:
-    case OP_DEFINE_GLOBAL:
-        constInstruction(c, instr);
+        cachedConstInstruction(c, instr);
         break;
     case OP_JUMP:
     case OP_JUMPT:
     case OP_JUMPF:
     case OP_FOR_NEXT:
-    case OP_SETUP_EXCEPT:
-    case OP_SETUP_ENSURE:
         signedOffsetInstruction(c, instr);
         break;
     case OP_NAT_METHOD:
     case OP_IMPORT_NAME:
         const2Instruction(c, instr);
         break;
+    case OP_ADD_LOCAL_CONST:
+    case OP_SUB_LOCAL_CONST:
+    case OP_LT_LOCAL_CONST:
+    case OP_LE_LOCAL_CONST:
+    case OP_GT_LOCAL_CONST:
+    case OP_GE_LOCAL_CONST:
+        localConstInstruction(c, instr);
+        break;
+    case OP_GET_LOCAL_FIELD:
+        localCachedConstInstruction(c, instr);
+        break;
+    case OP_ADD_LOCALS:
+    case OP_SUB_LOCALS:
+    case OP_LT_LOCALS:
+    case OP_LE_LOCALS:
+    case OP_GT_LOCALS:
+    case OP_GE_LOCALS:
+        twoBytesInstruction(c, instr);
+        break;
+    case OP_GET_SMALL_INT:
+        signedByteInstruction(c, instr);
+        break;
     case OP_INVOKE:
+    case OP_INVOKE_UNPACK:
     case OP_SUPER:
+    case OP_SUPER_UNPACK:
+    case OP_TAIL_INVOKE:
+    case OP_TAIL_INVOKE_UNPACK:
+    case OP_TAIL_SUPER:
+    case OP_TAIL_SUPER_UNPACK:
         invokeInstruction(c, instr);
         break;
     case OP_POPN:
     case OP_CALL:
     case OP_CALL_UNPACK:
+    case OP_TAIL_CALL:
+    case OP_TAIL_CALL_UNPACK:
     case OP_UNPACK:
     case OP_NEW_TUPLE:
     case OP_GET_LOCAL:
     case OP_SET_LOCAL:
+    case OP_STORE_LOCAL:
     case OP_GET_UPVALUE:
     case OP_SET_UPVALUE:
         unsignedByteInstruction(c, instr);
         break;
+    case OP_GET_GLOBAL_SLOT:
+    case OP_SET_GLOBAL_SLOT:
+    case OP_NEW_LIST:
+    case OP_NEW_TABLE:
+        unsignedShortInstruction(c, instr);
+        break;
     case OP_CLOSURE:
         closureInstruction(c, indent, instr);
         break;
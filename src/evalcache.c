@@ -0,0 +1,136 @@
+#include "evalcache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gc.h"
+#include "util.h"
+
+#define CACHE_INIT_BUCKETS 16
+
+struct EvalEntry {
+    EvalEntry* next;           // Next entry of the bucket
+    EvalEntry *newer, *older;  // Neighbours in the LRU list
+    uint32_t hash;
+    ObjModule* module;
+    ObjFunction* fn;
+    size_t length;
+    char src[];
+};
+
+void initEvalCache(EvalCache* c, size_t capacity) {
+    *c = (EvalCache){0};
+    c->capacity = capacity;
+}
+
+void freeEvalCache(EvalCache* c) {
+    clearEvalCache(c);
+}
+
+void clearEvalCache(EvalCache* c) {
+    EvalEntry* e = c->newest;
+    while(e != NULL) {
+        EvalEntry* older = e->older;
+        free(e);
+        e = older;
+    }
+    free(c->buckets);
+    c->buckets = NULL;
+    c->bucketCount = c->count = 0;
+    c->newest = c->oldest = NULL;
+}
+
+static void unlinkEntry(EvalCache* c, EvalEntry* e) {
+    if(e->newer) e->newer->older = e->older;
+    else c->newest = e->older;
+    if(e->older) e->older->newer = e->newer;
+    else c->oldest = e->newer;
+}
+
+static void linkNewest(EvalCache* c, EvalEntry* e) {
+    e->newer = NULL;
+    e->older = c->newest;
+    if(c->newest) c->newest->newer = e;
+    else c->oldest = e;
+    c->newest = e;
+}
+
+ObjFunction* evalCacheGet(EvalCache* c, ObjModule* module, const char* src, size_t length) {
+    if(c->capacity == 0) return NULL;
+
+    if(c->bucketCount > 0) {
+        uint32_t hash = hashBytes(src, length);
+        EvalEntry* e = c->buckets[hash & (c->bucketCount - 1)];
+        for(; e != NULL; e = e->next) {
+            if(e->hash == hash && e->module == module && e->length == length &&
+               memcmp(e->src, src, length) == 0) {
+                unlinkEntry(c, e);
+                linkNewest(c, e);
+                c->hits++;
+                return e->fn;
+            }
+        }
+    }
+
+    c->misses++;
+    return NULL;
+}
+
+static void growBuckets(EvalCache* c) {
+    size_t newCount = c->bucketCount ? c->bucketCount * 2 : CACHE_INIT_BUCKETS;
+    EvalEntry** buckets = calloc(newCount, sizeof(EvalEntry*));
+
+    for(EvalEntry* e = c->newest; e != NULL; e = e->older) {
+        size_t idx = e->hash & (newCount - 1);
+        e->next = buckets[idx];
+        buckets[idx] = e;
+    }
+
+    free(c->buckets);
+    c->buckets = buckets;
+    c->bucketCount = newCount;
+}
+
+static void evictOldest(EvalCache* c) {
+    EvalEntry* e = c->oldest;
+    EvalEntry** link = &c->buckets[e->hash & (c->bucketCount - 1)];
+    while(*link != e) {
+        link = &(*link)->next;
+    }
+    *link = e->next;
+
+    unlinkEntry(c, e);
+    c->count--;
+    free(e);
+}
+
+void evalCachePut(EvalCache* c, ObjModule* module, const char* src, size_t length,
+                  ObjFunction* fn) {
+    if(c->capacity == 0) return;
+
+    if(c->count == c->capacity) {
+        evictOldest(c);
+    } else if(c->count + 1 > c->bucketCount) {
+        growBuckets(c);
+    }
+
+    EvalEntry* e = malloc(sizeof(*e) + length);
+    e->hash = hashBytes(src, length);
+    e->module = module;
+    e->fn = fn;
+    e->length = length;
+    memcpy(e->src, src, length);
+
+    size_t idx = e->hash & (c->bucketCount - 1);
+    e->next = c->buckets[idx];
+    c->buckets[idx] = e;
+    linkNewest(c, e);
+    c->count++;
+}
+
+void reachEvalCache(JStarVM* vm, EvalCache* c) {
+    for(EvalEntry* e = c->newest; e != NULL; e = e->older) {
+        reachObject(vm, (Obj*)e->module);
+        reachObject(vm, (Obj*)e->fn);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef EVALCACHE_H
+#define EVALCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jstar.h"
+#include "object.h"
+
+typedef struct EvalEntry EvalEntry;
+
+// Per-VM cache of the functions compiled by `eval` and the `jsrEvalString` family of functions,
+// keyed by module and source code. Evaluating again the same source in the same module runs the
+// cached function, skipping parsing and compilation entirely.
+// The cache holds at most `capacity` functions, evicting the least recently used one when full.
+// Cached functions are kept alive by the cache, along with their module, until they are evicted
+// or the cache is cleared (e.g. by `jsrResetVM`).
+typedef struct EvalCache {
+    EvalEntry** buckets;
+    size_t bucketCount, count;
+    size_t capacity;             // Maximum number of entries (0 disables the cache)
+    EvalEntry *newest, *oldest;  // Entries in order of last use
+    // Counters, preserved across clears
+    uint64_t hits;
+    uint64_t misses;
+} EvalCache;
+
+void initEvalCache(EvalCache* c, size_t capacity);
+void freeEvalCache(EvalCache* c);
+// Drops all the cached functions
+void clearEvalCache(EvalCache* c);
+
+// Returns the function compiled from `src` in `module`, or NULL if it isn't cached
+ObjFunction* evalCacheGet(EvalCache* c, ObjModule* module, const char* src, size_t length);
+// Stores `fn`, compiled from `src` in `module`. The source must not be already cached
+void evalCachePut(EvalCache* c, ObjModule* module, const char* src, size_t length,
+                  ObjFunction* fn);
+
+// Marks the cached functions and their modules as reachable
+void reachEvalCache(JStarVM* vm, EvalCache* c);
+
+#endif
@@ -3,28 +3,77 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "code.h"
 #include "compiler.h"
+#include "ctrlgroup.h"
 #include "hashtable.h"
 #include "object.h"
 #include "profiler.h"
+#include "sync.h"
 #include "vm.h"
 
 #define REACHED_DEFAULT_SZ 16
 #define REACHED_GROW_RATE  2
 
-void* gcAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size) {
+#define REMEMBERED_DEFAULT_SZ 16
+#define REMEMBERED_GROW_RATE  2
+
+#define WEAK_DEFAULT_SZ 8
+#define WEAK_GROW_RATE  2
+
+// Number of objects swept on each allocation while a lazy sweep is pending
+#define SWEEP_STEP 32
+
+static void collect(JStarVM* vm, bool minor, bool lazy);
+static void sweepStep(JStarVM* vm, size_t count);
+
+// Called when the heap grows past the memory limit. If a full collection cannot bring it back
+// under the limit, the evaluation is broken to raise a MemoryException. No other collection is
+// attempted until the exception is raised, so that the allocations in between don't thrash.
+// Outside of the execution of code there's nothing to interrupt, and the limit is not enforced
+static void checkMemoryLimit(JStarVM* vm) {
+    if(vm->memoryExceeded || vm->unwinding || vm->frameCount == 0) return;
+    collect(vm, false, false);
+    if(vm->allocated > vm->memoryLimit) {
+        vm->memoryExceeded = true;
+        vm->evalBreak = 1;
+    }
+}
+
+static void accountAlloc(JStarVM* vm, size_t oldsize, size_t size) {
     vm->allocated += size - oldsize;
     if(size > oldsize) {
+        if(vm->unswept != NULL) {
+            sweepStep(vm, SWEEP_STEP);
+        }
+
 #ifdef JSTAR_DBG_STRESS_GC
-        garbageCollect(vm);
+        // In generational mode alternate minor and full collections, so that both run against
+        // the remembered set and the marks left by the other
+        size_t collections = vm->gcStats.minorCollections + vm->gcStats.fullCollections;
+        if(vm->generationalGC && collections % 2 == 0) {
+            minorCollect(vm);
+        } else {
+            garbageCollect(vm);
+        }
 #else
         if(vm->allocated > vm->nextGC) {
-            garbageCollect(vm);
+            collect(vm, false, true);
+        } else if(vm->generationalGC && vm->allocated > vm->nextMinorGC) {
+            minorCollect(vm);
         }
 #endif
+
+        if(vm->memoryLimit && vm->allocated > vm->memoryLimit) {
+            checkMemoryLimit(vm);
+        }
     }
+}
+
+void* gcAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size) {
+    accountAlloc(vm, oldsize, size);
 
     if(size == 0) {
         free(ptr);
@@ -40,26 +89,155 @@ void* gcAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size) {
     return mem;
 }
 
-void sweepObjects(JStarVM* vm) {
-    PROFILE_FUNC()
+// Sanitized builds bypass the slab allocator, so that use-after-free of objects is still detected
+#if defined(__SANITIZE_ADDRESS__)
+    #define USE_SLAB 0
+#elif defined(__has_feature)
+    #if __has_feature(address_sanitizer)
+        #define USE_SLAB 0
+    #endif
+#endif
 
-    Obj** head = &vm->objects;
+#ifndef USE_SLAB
+    #define USE_SLAB 1
+#endif
+
+void* gcAllocObject(JStarVM* vm, size_t size) {
+    if(!USE_SLAB || size > SLAB_MAX_SIZE) {
+        return gcAlloc(vm, NULL, 0, size);
+    }
+    accountAlloc(vm, 0, size);
+    return slabAlloc(&vm->slab, size);
+}
+
+void gcFreeObject(JStarVM* vm, void* obj, size_t size) {
+    if(!USE_SLAB || size > SLAB_MAX_SIZE) {
+        gcAlloc(vm, obj, size, 0);
+        return;
+    }
+    vm->allocated -= size;
+    slabFree(&vm->slab, obj, size);
+}
+
+// Returns true for objects whose stores do not go through the write barrier. When old, these
+// get rescanned at every minor collection
+static bool isUntracked(Obj* o) {
+    switch(o->type) {
+    case OBJ_MODULE:
+    case OBJ_CLASS:
+    case OBJ_FUNCTION:
+    case OBJ_NATIVE:
+    case OBJ_CLOSURE:
+    case OBJ_UPVALUE:
+    case OBJ_STACK_TRACE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Free all the unreached objects of a list. If `promote` is true survivors are moved to the
+// old generation and keep their mark, otherwise it is cleared for the next collection
+static void sweepList(JStarVM* vm, Obj** head, bool promote) {
     while(*head != NULL) {
-        if(!(*head)->reached) {
-            Obj* u = *head;
-            *head = u->next;
+        Obj* o = *head;
+        if(!o->reached) {
+            *head = o->next;
 
 #ifdef JSTAR_DBG_PRINT_GC
-            printf("GC_FREE: unreached object %p type: %s\n", (void*)u, ObjTypeNames[u->type]);
+            printf("GC_FREE: unreached object %p type: %s\n", (void*)o, ObjTypeNames[o->type]);
 #endif
-            freeObject(vm, u);
+            freeObject(vm, o);
+        } else if(promote) {
+            *head = o->next;
+            Obj** old = isUntracked(o) ? &vm->oldRoots : &vm->oldObjects;
+            o->next = *old;
+            *old = o;
         } else {
-            (*head)->reached = false;
-            head = &(*head)->next;
+            if(!vm->generationalGC) o->reached = false;
+            head = &o->next;
         }
     }
 }
 
+static void sweepObjects(JStarVM* vm, bool minor) {
+    PROFILE_FUNC()
+
+    sweepList(vm, &vm->objects, vm->generationalGC);
+    if(!minor) {
+        sweepList(vm, &vm->oldObjects, false);
+        sweepList(vm, &vm->oldRoots, false);
+    }
+}
+
+// Sweep up to `count` objects left unswept by the last collection. Survivors are moved back to
+// the objects list, that in the meantime only received newly allocated objects
+static void sweepStep(JStarVM* vm, size_t count) {
+    PROFILE_FUNC()
+
+    size_t prevAlloc = vm->allocated;
+    while(vm->unswept != NULL && count-- > 0) {
+        Obj* o = vm->unswept;
+        vm->unswept = o->next;
+
+        if(!o->reached) {
+#ifdef JSTAR_DBG_PRINT_GC
+            printf("GC_FREE: unreached object %p type: %s\n", (void*)o, ObjTypeNames[o->type]);
+#endif
+            freeObject(vm, o);
+        } else {
+            o->reached = false;
+            o->next = vm->objects;
+            vm->objects = o;
+        }
+    }
+
+    vm->gcStats.bytesFreed += prevAlloc - vm->allocated;
+
+    // Only now the size of the live heap is known
+    if(vm->unswept == NULL) {
+        vm->nextGC = vm->allocated * vm->heapGrowRate;
+    }
+}
+
+void gcCompleteSweep(JStarVM* vm) {
+    if(vm->unswept != NULL) {
+        sweepStep(vm, SIZE_MAX);
+    }
+}
+
+static void freeList(JStarVM* vm, Obj* head) {
+    while(head != NULL) {
+        Obj* next = head->next;
+        freeObject(vm, head);
+        head = next;
+    }
+}
+
+void freeObjects(JStarVM* vm) {
+    PROFILE_FUNC()
+
+    freeList(vm, vm->objects);
+    freeList(vm, vm->unswept);
+    freeList(vm, vm->oldObjects);
+    freeList(vm, vm->oldRoots);
+    vm->objects = vm->unswept = vm->oldObjects = vm->oldRoots = NULL;
+
+    free(vm->remembered);
+    vm->remembered = NULL;
+    vm->rememberedCapacity = vm->rememberedCount = 0;
+}
+
+void gcRememberObject(JStarVM* vm, Obj* o) {
+    if(vm->rememberedCount + 1 > vm->rememberedCapacity) {
+        vm->rememberedCapacity = vm->rememberedCapacity ? vm->rememberedCapacity * REMEMBERED_GROW_RATE
+                                                        : REMEMBERED_DEFAULT_SZ;
+        vm->remembered = realloc(vm->remembered, sizeof(Obj*) * vm->rememberedCapacity);
+    }
+    o->remembered = true;
+    vm->remembered[vm->rememberedCount++] = o;
+}
+
 static void growReached(JStarVM* vm) {
     PROFILE_FUNC()
     vm->reachedCapacity *= REACHED_GROW_RATE;
@@ -73,6 +251,14 @@ static void addReachedObject(JStarVM* vm, Obj* o) {
     vm->reachedStack[vm->reachedCount++] = o;
 }
 
+static void addWeakObject(JStarVM* vm, Obj* o) {
+    if(vm->weakCount + 1 > vm->weakCapacity) {
+        vm->weakCapacity *= WEAK_GROW_RATE;
+        vm->weakObjects = realloc(vm->weakObjects, sizeof(Obj*) * vm->weakCapacity);
+    }
+    vm->weakObjects[vm->weakCount++] = o;
+}
+
 void reachObject(JStarVM* vm, Obj* o) {
     if(o == NULL || o->reached) return;
 
@@ -96,6 +282,32 @@ static void reachValueArray(JStarVM* vm, ValueArray* a) {
     }
 }
 
+static void reachInlineCache(JStarVM* vm, InlineCache* ic) {
+    for(int i = 0; i < IC_ENTRIES; i++) {
+        if(ic->entries[i].cls == NULL) continue;
+        // Reaching the class also keeps alive the shapes referenced by field entries
+        reachObject(vm, (Obj*)ic->entries[i].cls);
+        if(ic->kind == IC_METHOD) reachValue(vm, ic->entries[i].as.method);
+    }
+}
+
+static void reachInlineCaches(JStarVM* vm, Code* c) {
+    for(size_t i = 0; i < c->cacheCount; i++) {
+        reachInlineCache(vm, &c->caches[i]);
+    }
+}
+
+static void reachShape(JStarVM* vm, Shape* s) {
+    // Transitions are keyed by the same names of the slots of the shapes they lead to
+    reachHashTable(vm, &s->slots);
+    if(s->transitions.entries != NULL) {
+        for(size_t i = 0; i <= s->transitions.sizeMask; i++) {
+            Entry* e = &s->transitions.entries[i];
+            if(e->key != NULL) reachShape(vm, AS_HANDLE(e->value));
+        }
+    }
+}
+
 static void recursevelyReach(JStarVM* vm, Obj* o) {
 #ifdef JSTAR_DBG_PRINT_GC
     printf("Recursevely exploring object %p...\n", (void*)o);
@@ -117,7 +329,9 @@ static void recursevelyReach(JStarVM* vm, Obj* o) {
         ObjFunction* func = (ObjFunction*)o;
         reachObject(vm, (Obj*)func->proto.name);
         reachObject(vm, (Obj*)func->proto.module);
+        reachObject(vm, (Obj*)func->closure);
         reachValueArray(vm, &func->code.consts);
+        reachInlineCaches(vm, &func->code);
         for(uint8_t i = 0; i < func->proto.defCount; i++) {
             reachValue(vm, func->proto.defaults[i]);
         }
@@ -128,18 +342,28 @@ static void recursevelyReach(JStarVM* vm, Obj* o) {
         reachObject(vm, (Obj*)cls->name);
         reachObject(vm, (Obj*)cls->superCls);
         reachHashTable(vm, &cls->methods);
+        reachShape(vm, cls->shape);
         break;
     }
     case OBJ_INST: {
         ObjInstance* i = (ObjInstance*)o;
-        reachHashTable(vm, &i->fields);
+        if(i->shape != NULL) {
+            for(size_t j = 0; j < i->shape->fieldCount; j++) {
+                reachValue(vm, i->fields[j]);
+            }
+        } else {
+            reachHashTable(vm, i->dict);
+        }
         break;
     }
     case OBJ_MODULE: {
         ObjModule* m = (ObjModule*)o;
         reachObject(vm, (Obj*)m->name);
         reachObject(vm, (Obj*)m->path);
-        reachHashTable(vm, &m->globals);
+        reachHashTable(vm, &m->globalNames);
+        for(int i = 0; i < m->globals.size; i++) {
+            reachValue(vm, m->globals.arr[i]);
+        }
         break;
     }
     case OBJ_LIST: {
@@ -158,8 +382,12 @@ static void recursevelyReach(JStarVM* vm, Obj* o) {
     }
     case OBJ_TABLE: {
         ObjTable* t = (ObjTable*)o;
+        bool weak = t->weak && vm->weakObjects != NULL;
+        if(weak) addWeakObject(vm, o);
         if(t->entries != NULL) {
-            for(size_t i = 0; i < t->capacityMask + 1; i++) {
+            for(size_t i = 0; i < t->numEntries; i++) {
+                // Entries with weak keys are reached by `reachEphemerons` once their key is
+                if(weak && IS_WEAK_REFERENT(t->entries[i].key)) continue;
                 reachValue(vm, t->entries[i].key);
                 reachValue(vm, t->entries[i].val);
             }
@@ -188,8 +416,33 @@ static void recursevelyReach(JStarVM* vm, Obj* o) {
     case OBJ_STACK_TRACE: {
         ObjStackTrace* stackTrace = (ObjStackTrace*)o;
         for(int i = 0; i < stackTrace->recordSize; i++) {
-            reachObject(vm, (Obj*)stackTrace->records[i].funcName);
-            reachObject(vm, (Obj*)stackTrace->records[i].moduleName);
+            reachObject(vm, stackTrace->records[i].fn);
+        }
+        break;
+    }
+    case OBJ_ARRAY: {
+        ObjArray* arr = (ObjArray*)o;
+        reachObject(vm, (Obj*)arr->owner);
+        break;
+    }
+    case OBJ_GENERATOR: {
+        ObjGenerator* gen = (ObjGenerator*)o;
+        reachObject(vm, (Obj*)gen->closure);
+        reachValue(vm, gen->lastYield);
+        for(size_t i = 0; i < gen->stackSize; i++) {
+            reachValue(vm, gen->stack[i]);
+        }
+        for(size_t i = 0; i < gen->upvalueCount; i++) {
+            reachObject(vm, (Obj*)gen->upvalues[i].upvalue);
+        }
+        break;
+    }
+    case OBJ_WEAKREF: {
+        ObjWeakRef* ref = (ObjWeakRef*)o;
+        if(vm->weakObjects != NULL && IS_WEAK_REFERENT(ref->referent)) {
+            addWeakObject(vm, o);
+        } else {
+            reachValue(vm, ref->referent);
         }
         break;
     }
@@ -199,84 +452,257 @@ static void recursevelyReach(JStarVM* vm, Obj* o) {
     }
 }
 
-void garbageCollect(JStarVM* vm) {
-    PROFILE_FUNC()
+static void reachAll(JStarVM* vm) {
+    while(vm->reachedCount != 0) {
+        recursevelyReach(vm, vm->reachedStack[--vm->reachedCount]);
+    }
+}
 
-#ifdef JSTAR_DBG_PRINT_GC
-    size_t prevAlloc = vm->allocated;
-    puts("*--- Starting GC ---*");
-#endif
+// The value of a WeakTable entry is reachable only if its key is. Since reaching a value can make
+// other keys reachable (possibly in other WeakTables), iterate until no new value is reached
+static void reachEphemerons(JStarVM* vm) {
+    bool reached;
+    do {
+        reached = false;
+        for(size_t i = 0; i < vm->weakCount; i++) {
+            Obj* o = vm->weakObjects[i];
+            if(o->type != OBJ_TABLE) continue;
+
+            ObjTable* t = (ObjTable*)o;
+            for(size_t j = 0; j < t->numEntries; j++) {
+                TableEntry* e = &t->entries[j];
+                if(IS_WEAK_REFERENT(e->key) && AS_OBJ(e->key)->reached) {
+                    if(IS_OBJ(e->val) && !AS_OBJ(e->val)->reached) {
+                        reachObject(vm, AS_OBJ(e->val));
+                        reached = true;
+                    }
+                }
+            }
+        }
+        reachAll(vm);
+    } while(reached);
+}
 
-    // init reached object stack
-    vm->reachedStack = malloc(sizeof(Obj*) * REACHED_DEFAULT_SZ);
-    vm->reachedCapacity = REACHED_DEFAULT_SZ;
+static void clearWeakTable(ObjTable* t) {
+    if(t->entries == NULL) return;
+    for(size_t i = 0; i <= t->capacityMask; i++) {
+        if(t->ctrl[i] & CTRL_EMPTY) continue;
 
-    {
-        PROFILE("{reach-objects}::garbageCollect")
+        TableEntry* e = &t->entries[t->index[i]];
+        if(IS_WEAK_REFERENT(e->key) && !AS_OBJ(e->key)->reached) {
+            t->ctrl[i] = groupHasEmpty(t->ctrl, i) ? CTRL_EMPTY : CTRL_DELETED;
+            *e = (TableEntry){NULL_VAL, NULL_VAL};
+            t->size--;
+        }
+    }
+}
 
-        // reach import paths list
-        reachObject(vm, (Obj*)vm->importPaths);
-
-        // reach builtin classes
-        reachObject(vm, (Obj*)vm->clsClass);
-        reachObject(vm, (Obj*)vm->objClass);
-        reachObject(vm, (Obj*)vm->strClass);
-        reachObject(vm, (Obj*)vm->boolClass);
-        reachObject(vm, (Obj*)vm->lstClass);
-        reachObject(vm, (Obj*)vm->numClass);
-        reachObject(vm, (Obj*)vm->funClass);
-        reachObject(vm, (Obj*)vm->modClass);
-        reachObject(vm, (Obj*)vm->nullClass);
-        reachObject(vm, (Obj*)vm->stClass);
-        reachObject(vm, (Obj*)vm->tupClass);
-        reachObject(vm, (Obj*)vm->excClass);
-        reachObject(vm, (Obj*)vm->tableClass);
-        reachObject(vm, (Obj*)vm->udataClass);
-
-        // reach script argument llist
-        reachObject(vm, (Obj*)vm->argv);
-
-        for(int i = 0; i < SYM_END; i++) {
-            reachObject(vm, (Obj*)vm->methodSyms[i]);
+// Remove the entries of WeakTables and clear the WeakRefs whose referent is going to be swept
+static void clearWeakReferences(JStarVM* vm) {
+    for(size_t i = 0; i < vm->weakCount; i++) {
+        Obj* o = vm->weakObjects[i];
+        if(o->type == OBJ_TABLE) {
+            clearWeakTable((ObjTable*)o);
+        } else {
+            ObjWeakRef* ref = (ObjWeakRef*)o;
+            if(!AS_OBJ(ref->referent)->reached) ref->referent = NULL_VAL;
         }
+    }
+}
 
-        // reach empty Tuple singleton
-        reachObject(vm, (Obj*)vm->emptyTup);
+static void reachRoots(JStarVM* vm) {
+    // reach import paths list
+    reachObject(vm, (Obj*)vm->importPaths);
+
+    // reach builtin classes
+    reachObject(vm, (Obj*)vm->clsClass);
+    reachObject(vm, (Obj*)vm->objClass);
+    reachObject(vm, (Obj*)vm->strClass);
+    reachObject(vm, (Obj*)vm->boolClass);
+    reachObject(vm, (Obj*)vm->lstClass);
+    reachObject(vm, (Obj*)vm->numClass);
+    reachObject(vm, (Obj*)vm->funClass);
+    reachObject(vm, (Obj*)vm->modClass);
+    reachObject(vm, (Obj*)vm->nullClass);
+    reachObject(vm, (Obj*)vm->stClass);
+    reachObject(vm, (Obj*)vm->tupClass);
+    reachObject(vm, (Obj*)vm->excClass);
+    reachObject(vm, (Obj*)vm->tableClass);
+    reachObject(vm, (Obj*)vm->udataClass);
+    reachObject(vm, (Obj*)vm->genClass);
+    reachObject(vm, (Obj*)vm->weakRefClass);
+    reachObject(vm, (Obj*)vm->weakTableClass);
+    reachObject(vm, (Obj*)vm->f64ArrClass);
+    reachObject(vm, (Obj*)vm->i32ArrClass);
+    reachObject(vm, (Obj*)vm->u8ArrClass);
+
+    // reach script argument llist
+    reachObject(vm, (Obj*)vm->argv);
+
+    for(int i = 0; i < SYM_END; i++) {
+        reachObject(vm, (Obj*)vm->methodSyms[i]);
+    }
 
-        // reach loaded modules
-        reachHashTable(vm, &vm->modules);
+    // reach empty Tuple singleton
+    reachObject(vm, (Obj*)vm->emptyTup);
 
-        // reach elements on the stack
-        for(Value* v = vm->stack; v < vm->sp; v++) {
-            reachValue(vm, *v);
-        }
+    // reach the API symbols and the results cached by them
+    for(JStarSymbol* s = vm->symbols; s != NULL; s = s->next) {
+        reachObject(vm, (Obj*)s->name);
+        reachObject(vm, (Obj*)s->module);
+        reachInlineCache(vm, &s->methodCache);
+        reachInlineCache(vm, &s->getCache);
+        reachInlineCache(vm, &s->setCache);
+    }
 
-        // reach elements on the frame stack
-        for(int i = 0; i < vm->frameCount; i++) {
-            reachObject(vm, vm->frames[i].fn);
-        }
+    // reach loaded modules
+    reachHashTable(vm, &vm->modules);
+
+    // reach the functions compiled by eval
+    reachEvalCache(vm, &vm->evalCache);
 
-        // reach open upvalues
-        for(ObjUpvalue* upvalue = vm->upvalues; upvalue != NULL; upvalue = upvalue->next) {
-            reachObject(vm, (Obj*)upvalue);
+    // reach the state saved by the last checkpoint
+    reachObject(vm, (Obj*)vm->checkpointPaths);
+    reachObject(vm, (Obj*)vm->checkpointArgv);
+    for(size_t i = 0; i < vm->checkpointCount; i++) {
+        ModuleCheckpoint* cp = &vm->checkpoint[i];
+        reachObject(vm, (Obj*)cp->module);
+        for(size_t j = 0; j < cp->globalCount; j++) {
+            reachValue(vm, cp->globals[j]);
         }
+    }
+
+    // reach elements on the stack
+    for(Value* v = vm->stack; v < vm->sp; v++) {
+        reachValue(vm, *v);
+    }
+
+    // reach elements on the frame stack
+    for(int i = 0; i < vm->frameCount; i++) {
+        reachObject(vm, vm->frames[i].fn);
+        reachObject(vm, (Obj*)vm->frames[i].gen);
+    }
 
-        // reach the compiler objects
-        reachCompilerRoots(vm, vm->currCompiler);
+    // reach open upvalues
+    for(ObjUpvalue* upvalue = vm->upvalues; upvalue != NULL; upvalue = upvalue->next) {
+        reachObject(vm, (Obj*)upvalue);
+    }
+
+    // reach the compiler objects
+    reachCompilerRoots(vm, vm->currCompiler);
+
+#ifdef JSTAR_OPCODE_STATS
+    // reach the function whose self time is being measured
+    reachObject(vm, (Obj*)vm->opStats.current);
+#endif
+}
+
+// Reach the old objects that may hold references to young ones. Called only on minor collections
+static void reachOldGeneration(JStarVM* vm) {
+    for(size_t i = 0; i < vm->rememberedCount; i++) {
+        recursevelyReach(vm, vm->remembered[i]);
+    }
+
+    for(Obj* o = vm->oldRoots; o != NULL; o = o->next) {
+        recursevelyReach(vm, o);
+    }
+}
+
+static void clearRememberedSet(JStarVM* vm) {
+    for(size_t i = 0; i < vm->rememberedCount; i++) {
+        vm->remembered[i]->remembered = false;
+    }
+    vm->rememberedCount = 0;
+}
+
+// Clear the sticky marks of the old generation before a full collection
+static void unmarkList(Obj* head) {
+    for(Obj* o = head; o != NULL; o = o->next) {
+        o->reached = false;
+    }
+}
+
+static void recordPause(JStarVM* vm, double pause) {
+    vm->gcStats.totalPause += pause;
+    if(pause > vm->gcStats.maxPause) vm->gcStats.maxPause = pause;
+
+    int bucket = 0;
+    for(double limit = 1e-5; pause >= limit && bucket < JSR_GC_PAUSE_BUCKETS - 1; limit *= 10) {
+        bucket++;
+    }
+    vm->gcStats.pauses[bucket]++;
+}
+
+static void collect(JStarVM* vm, bool minor, bool lazy) {
+#ifdef JSTAR_DBG_PRINT_GC
+    printf("*--- Starting %s GC ---*\n", minor ? "minor" : "full");
+#endif
+
+    double start = monotonicTime();
+
+    if(TRACING(vm, JSR_TRACE_GC_START)) {
+        traceGC(vm, JSR_TRACE_GC_START, vm->allocated, minor);
+    }
+
+    // The marks of objects left unswept by the previous collection are still set
+    gcCompleteSweep(vm);
+    size_t prevAlloc = vm->allocated;
+
+    // init reached object stack
+    vm->reachedStack = malloc(sizeof(Obj*) * REACHED_DEFAULT_SZ);
+    vm->reachedCapacity = REACHED_DEFAULT_SZ;
+
+    // weak references are honored only by full collections
+    if(!minor) {
+        vm->weakObjects = malloc(sizeof(Obj*) * WEAK_DEFAULT_SZ);
+        vm->weakCapacity = WEAK_DEFAULT_SZ;
+    }
+
+    // Bound methods are cached weakly, drop them before they can be swept
+    memset(vm->boundMethods, 0, sizeof(vm->boundMethods));
+
+    if(!minor) {
+        unmarkList(vm->oldObjects);
+        unmarkList(vm->oldRoots);
+    }
+
+    {
+        PROFILE("{reach-objects}::garbageCollect")
+
+        reachRoots(vm);
+        if(minor) reachOldGeneration(vm);
+        clearRememberedSet(vm);
     }
 
     {
         PROFILE("{recursively-reach}::garbageCollect")
 
         // recursevely reach objects held by other reached objects
-        while(vm->reachedCount != 0) {
-            recursevelyReach(vm, vm->reachedStack[--vm->reachedCount]);
-        }
+        reachAll(vm);
+    }
+
+    if(!minor) {
+        PROFILE("{weak-references}::garbageCollect")
+
+        reachEphemerons(vm);
+        clearWeakReferences(vm);
+
+        free(vm->weakObjects);
+        vm->weakObjects = NULL;
+        vm->weakCapacity = 0;
+        vm->weakCount = 0;
     }
 
-    // free unreached objects
+    // free unreached objects. Interned strings are always swept eagerly, so that a dead
+    // string cannot be returned by the string pool while waiting to be freed
     sweepStrings(&vm->stringPool);
-    sweepObjects(vm);
+    if(lazy && !vm->generationalGC) {
+        vm->unswept = vm->objects;
+        vm->objects = NULL;
+    } else {
+        sweepObjects(vm, minor);
+    }
+    vm->gcStats.bytesFreed += prevAlloc - vm->allocated;
 
     // free the reached objects stack
     free(vm->reachedStack);
@@ -284,7 +710,19 @@ void garbageCollect(JStarVM* vm) {
     vm->reachedCapacity = 0;
     vm->reachedCount = 0;
 
-    vm->nextGC = vm->allocated * vm->heapGrowRate;
+    if(!minor) vm->nextGC = vm->allocated * vm->heapGrowRate;
+    vm->nextMinorGC = vm->allocated + vm->nurserySize;
+
+    if(minor) {
+        vm->gcStats.minorCollections++;
+    } else {
+        vm->gcStats.fullCollections++;
+    }
+    recordPause(vm, monotonicTime() - start);
+
+    if(TRACING(vm, JSR_TRACE_GC_END)) {
+        traceGC(vm, JSR_TRACE_GC_END, vm->allocated, prevAlloc - vm->allocated);
+    }
 
 #ifdef JSTAR_DBG_PRINT_GC
     size_t curr = prevAlloc - vm->allocated;
@@ -294,4 +732,35 @@ void garbageCollect(JStarVM* vm) {
         prevAlloc, vm->allocated, curr, vm->nextGC);
     printf("*--- End  of  GC ---*\n");
 #endif
-}
\ No newline at end of file
+}
+
+void garbageCollect(JStarVM* vm) {
+    PROFILE_FUNC()
+    collect(vm, false, false);
+}
+
+void minorCollect(JStarVM* vm) {
+    PROFILE_FUNC()
+    collect(vm, true, false);
+}
+
+void jsrGetGCStats(JStarVM* vm, JStarGCStats* stats) {
+    stats->allocated = vm->allocated;
+    stats->nextGC = vm->nextGC;
+    stats->memoryLimit = vm->memoryLimit;
+    stats->fullCollections = vm->gcStats.fullCollections;
+    stats->minorCollections = vm->gcStats.minorCollections;
+    stats->bytesFreed = vm->gcStats.bytesFreed;
+    stats->totalPause = vm->gcStats.totalPause;
+    stats->maxPause = vm->gcStats.maxPause;
+    memcpy(stats->pauses, vm->gcStats.pauses, sizeof(stats->pauses));
+
+    stats->objTypeCount = OBJ_TYPE_COUNT;
+    for(int i = 0; i < OBJ_TYPE_COUNT; i++) {
+        JStarObjStats* obj = &stats->objects[i];
+        obj->type = ObjTypeNames[i] + strlen("OBJ_");
+        obj->allocations = vm->gcStats.allocations[i];
+        obj->bytes = vm->gcStats.bytes[i];
+        obj->live = vm->gcStats.live[i];
+    }
+}
@@ -12,21 +12,59 @@
 #define GC_FREE_ARRAY(vm, t, obj, count)    gcAlloc(vm, obj, sizeof(t) * (count), 0)
 #define GC_FREE_VAR(vm, t, var, count, obj) gcAlloc(vm, obj, sizeof(t) + sizeof(var) * (count), 0)
 
+// Macros to free memory obtained through gcAllocObject
+#define GC_FREE_OBJ(vm, t, obj) gcFreeObject(vm, obj, sizeof(t))
+#define GC_FREE_VAR_OBJ(vm, t, var, count, obj) \
+    gcFreeObject(vm, obj, sizeof(t) + sizeof(var) * (count))
+
+// Write barrier of the generational collector. Must be used right after storing a Value inside
+// an instance, List, Tuple or Table, since the object may have already been promoted to the old
+// generation. Objects survived a previous collection keep their `reached` flag set between
+// collections. In non-generational mode this flag is always false outside of a GC, so the
+// barrier reduces to a single test.
+#define GC_WRITE_BARRIER(vm, o)                                        \
+    do {                                                               \
+        Obj* _o = (Obj*)(o);                                           \
+        if(_o->reached && !_o->remembered && (vm)->generationalGC) {   \
+            gcRememberObject(vm, _o);                                  \
+        }                                                              \
+    } while(0)
+
 // Allocate (or reallocate) some memory using the J* garbage collector.
 // This memory is owned by the GC, but can't be collected until is is exposed as a Value in the
 // runtime (for example as an Obj*, or as a part of one).
 void* gcAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size);
 
+// Allocate memory for an object. Small sizes are served by the VM's slab allocator.
+// The memory must be released with gcFreeObject passing the same size.
+void* gcAllocObject(JStarVM* vm, size_t size);
+void gcFreeObject(JStarVM* vm, void* obj, size_t size);
+
 // Launch a garbage collection. It scans all roots (VM stack, global Strings, etc...)
 // marking all the reachable objects (recursively, if needed) and then calls sweepObjects
 // to free all unreached ones.
+// Collections triggered by allocation instead leave the objects list to be swept lazily, a
+// few objects at every subsequent allocation, so that freeing doesn't add to the pause.
 void garbageCollect(JStarVM* vm);
 
+// Finish the lazy sweep started by the last collection, if any
+void gcCompleteSweep(JStarVM* vm);
+
+// Launch a minor collection, only available in generational mode. Only young objects (i.e.
+// allocated after the last collection) are traced and swept, considering as additional roots
+// the old objects recorded by the write barrier and the ones not tracked by it (modules,
+// classes, functions, closures, upvalues and stack traces). Survivors are promoted to the old
+// generation.
+void minorCollect(JStarVM* vm);
+
+// Add an old object to the remembered set. Use GC_WRITE_BARRIER instead of calling this directly.
+void gcRememberObject(JStarVM* vm, Obj* o);
+
 // Mark an Object/Value as reached
 void reachObject(JStarVM* vm, Obj* o);
 void reachValue(JStarVM* vm, Value v);
 
-// Free all unmarked objects
-void sweepObjects(JStarVM* vm);
+// Free all objects, regardless of their reachability
+void freeObjects(JStarVM* vm);
 
 #endif
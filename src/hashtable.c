@@ -3,13 +3,13 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "ctrlgroup.h"
 #include "gc.h"
 #include "object.h"
 #include "profiler.h"
 
-#define TOMB_MARKER      TRUE_VAL
 #define GROW_FACTOR      2
-#define INITIAL_CAPACITY 8
+#define INITIAL_CAPACITY GROUP_WIDTH
 #define MAX_ENTRY_LOAD(size) \
     (((size) >> 1) + ((size) >> 2))  // Read as: 3 / 4 * size i.e. a load factor of 75%
 
@@ -19,87 +19,116 @@ void initHashTable(HashTable* t) {
 
 void freeHashTable(HashTable* t) {
     free(t->entries);
+    free(t->ctrl);
 }
 
-static Entry* findEntry(Entry* entries, size_t sizeMask, ObjString* key) {
-    size_t i = stringGetHash(key) & sizeMask;
-    Entry* tomb = NULL;
+static Entry* findEntry(const HashTable* t, ObjString* key) {
+    uint32_t hash = stringGetHash(key);
+    uint8_t h2 = HASH_H2(hash);
+    size_t pos = probeStart(hash, t->sizeMask), stride = 0;
 
     for(;;) {
-        Entry* e = &entries[i];
-        if(!e->key) {
-            if(IS_NULL(e->value)) {
-                return tomb ? tomb : e;
-            } else if(!tomb) {
-                tomb = e;
-            }
-        } else if(stringEquals(e->key, key)) {
-            return e;
+        Group g = groupLoad(t->ctrl + pos);
+        for(GroupMask m = groupMatch(g, h2); m; m = groupMaskNext(m)) {
+            Entry* e = &t->entries[pos + groupMaskFirst(m)];
+            if(stringEquals(e->key, key)) return e;
         }
-        i = (i + 1) & sizeMask;
+        if(groupMatchEmpty(g)) return NULL;
+        pos = probeNext(pos, &stride, t->sizeMask);
     }
 }
 
 static void growEntries(HashTable* t) {
-    size_t newSize = t->sizeMask ? (t->sizeMask + 1) * GROW_FACTOR : INITIAL_CAPACITY;
+    size_t oldSize = t->entries ? t->sizeMask + 1 : 0;
+
+    size_t liveEntries = 0;
+    for(size_t i = 0; i < oldSize; i++) {
+        if(t->entries[i].key) liveEntries++;
+    }
+
+    // If most of the entries are tombstones rehash at the same size to get rid of them
+    size_t newSize = oldSize ? oldSize : INITIAL_CAPACITY;
+    if(liveEntries + 1 > MAX_ENTRY_LOAD(oldSize) / 2) {
+        newSize = oldSize ? oldSize * GROW_FACTOR : INITIAL_CAPACITY;
+    }
+
     Entry* newEntries = malloc(sizeof(Entry) * newSize);
+    uint8_t* newCtrl = malloc(newSize);
 
     for(size_t i = 0; i < newSize; i++) {
         newEntries[i] = (Entry){NULL, NULL_VAL};
     }
+    memset(newCtrl, CTRL_EMPTY, newSize);
 
-    t->numEntries = 0;
-    if(t->sizeMask != 0) {
-        for(size_t i = 0; i <= t->sizeMask; i++) {
-            Entry* e = &t->entries[i];
-            if(!e->key) continue;
+    for(size_t i = 0; i < oldSize; i++) {
+        Entry* e = &t->entries[i];
+        if(!e->key) continue;
 
-            Entry* dest = findEntry(newEntries, newSize - 1, e->key);
-            *dest = (Entry){e->key, e->value};
-            t->numEntries++;
-        }
+        uint32_t hash = stringGetHash(e->key);
+        size_t dest = probeFreeSlot(newCtrl, newSize - 1, hash);
+        newCtrl[dest] = HASH_H2(hash);
+        newEntries[dest] = *e;
     }
 
     free(t->entries);
+    free(t->ctrl);
     t->entries = newEntries;
+    t->ctrl = newCtrl;
     t->sizeMask = newSize - 1;
+    t->numEntries = liveEntries;
 }
 
 bool hashTablePut(HashTable* t, ObjString* key, Value val) {
+    Entry* e = t->entries ? findEntry(t, key) : NULL;
+    if(e) {
+        e->value = val;
+        return false;
+    }
+
     if(t->numEntries + 1 > MAX_ENTRY_LOAD(t->sizeMask + 1)) {
         growEntries(t);
     }
 
-    Entry* e = findEntry(t->entries, t->sizeMask, key);
+    uint32_t hash = stringGetHash(key);
+    size_t i = probeFreeSlot(t->ctrl, t->sizeMask, hash);
 
-    // is it a true empty entry or a tombstone?
-    bool newEntry = !e->key;
-    if(newEntry && IS_NULL(e->value)) {
+    // Only count the entry if it is a true empty slot and not a tombstone
+    if(t->ctrl[i] == CTRL_EMPTY) {
         t->numEntries++;
     }
 
-    *e = (Entry){key, val};
-    return newEntry;
+    t->ctrl[i] = HASH_H2(hash);
+    t->entries[i] = (Entry){key, val};
+    return true;
 }
 
 bool hashTableGet(HashTable* t, ObjString* key, Value* res) {
     if(t->entries == NULL) return false;
-    Entry* e = findEntry(t->entries, t->sizeMask, key);
-    if(!e->key) return false;
+    Entry* e = findEntry(t, key);
+    if(!e) return false;
     *res = e->value;
     return true;
 }
 
 bool hashTableContainsKey(HashTable* t, ObjString* key) {
     if(t->entries == NULL) return false;
-    return findEntry(t->entries, t->sizeMask, key)->key != NULL;
+    return findEntry(t, key) != NULL;
 }
 
 bool hashTableDel(HashTable* t, ObjString* key) {
     if(t->numEntries == 0) return false;
-    Entry* e = findEntry(t->entries, t->sizeMask, key);
-    if(!e->key) return false;
-    *e = (Entry){NULL, TOMB_MARKER};
+    Entry* e = findEntry(t, key);
+    if(!e) return false;
+
+    size_t i = e - t->entries;
+    if(groupHasEmpty(t->ctrl, i)) {
+        t->ctrl[i] = CTRL_EMPTY;
+        t->numEntries--;
+    } else {
+        t->ctrl[i] = CTRL_DELETED;
+    }
+
+    *e = (Entry){NULL, NULL_VAL};
     return true;
 }
 
@@ -115,16 +144,21 @@ void hashTableMerge(HashTable* t, HashTable* o) {
 
 ObjString* hashTableGetString(HashTable* t, const char* str, size_t length, uint32_t hash) {
     if(t->entries == NULL) return NULL;
-    size_t i = hash & t->sizeMask;
+
+    uint8_t h2 = HASH_H2(hash);
+    size_t pos = probeStart(hash, t->sizeMask), stride = 0;
+
     for(;;) {
-        Entry* e = &t->entries[i];
-        if(!e->key) {
-            if(IS_NULL(e->value)) return NULL;
-        } else if(stringGetHash(e->key) == hash && e->key->length == length &&
-                  memcmp(e->key->data, str, length) == 0) {
-            return e->key;
+        Group g = groupLoad(t->ctrl + pos);
+        for(GroupMask m = groupMatch(g, h2); m; m = groupMaskNext(m)) {
+            ObjString* key = t->entries[pos + groupMaskFirst(m)].key;
+            if(stringGetHash(key) == hash && key->length == length &&
+               memcmp(key->data, str, length) == 0) {
+                return key;
+            }
         }
-        i = (i + 1) & t->sizeMask;
+        if(groupMatchEmpty(g)) return NULL;
+        pos = probeNext(pos, &stride, t->sizeMask);
     }
 }
 
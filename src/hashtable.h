@@ -13,9 +13,13 @@ typedef struct Entry {
     Value value;
 } Entry;
 
+// Open addressing hash table with string keys.
+// Slots are probed in groups using the control bytes defined in "ctrlgroup.h". Free slots have a
+// NULL key, so `entries` can be iterated directly by skipping them.
 typedef struct HashTable {
     size_t sizeMask, numEntries;
     Entry* entries;
+    uint8_t* ctrl;
 } HashTable;
 
 // Initialize the hashtable
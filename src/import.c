@@ -1,20 +1,28 @@
 #include "import.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "builtins/builtins.h"
+#include "bundle.h"
+#include "bytecache.h"
+#include "codecache.h"
 #include "compiler.h"
 #include "dynload.h"
 #include "hashtable.h"
+#include "importcache.h"
 #include "jstar.h"
 #include "parse/parser.h"
 #include "profiler.h"
 #include "serialize.h"
+#include "sync.h"
 #include "util.h"
 #include "value.h"
 #include "vm.h"
 
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
 #define PACKAGE_FILE "__package__"
 #define JSR_EXT      ".jsr"
 #define JSC_EXT      ".jsc"
@@ -50,21 +58,95 @@ static ObjModule* getOrCreateModule(JStarVM* vm, const char* path, ObjString* na
         module = newModule(vm, path, name);
         setModule(vm, name, module);
         pop(vm);
+    } else if(module->lazy) {
+        // The placeholder of a lazy import is being loaded, it now gets the path of its file
+        module->lazy = false;
+        moduleSetPath(vm, module, path);
     }
     return module;
 }
 
-ObjFunction* compileModule(JStarVM* vm, const char* path, ObjString* name, JStarStmt* program) {
+static void parseError(const char* file, int line, const char* error, void* udata) {
+    JStarVM* vm = udata;
+    vm->errorCallback(vm, JSR_SYNTAX_ERR, file, line, error);
+}
+
+static void releaseSourceTree(JStarVM* vm) {
+    ASSERT(vm->astArenaUsers > 0, "Unbalanced release of source tree");
+    if(--vm->astArenaUsers == 0) {
+        jsrResetASTArena(vm->astArena);
+    }
+}
+
+// Parses `src` in the AST arena of the VM. The returned tree must be given back with
+// `releaseSourceTree` once compiled. On syntax errors returns NULL, with nothing to release
+static JStarStmt* parseSource(JStarVM* vm, const char* path, const char* src) {
+    if(vm->astArena == NULL) {
+        vm->astArena = jsrNewASTArena();
+    }
+
+    // The arena is shared by nested parses (e.g. an error callback evaluating code), and it's only
+    // reset once all of their trees have been released
+    vm->astArenaUsers++;
+    JStarStmt* program = jsrParseArena(path, src, vm->astArena, parseError, vm);
+    if(program == NULL) {
+        releaseSourceTree(vm);
+    }
+
+    return program;
+}
+
+ObjFunction* compileSource(JStarVM* vm, const char* path, ObjString* name, const char* src,
+                           JStarResult* err) {
     PROFILE_FUNC()
-    ObjModule* module = getOrCreateModule(vm, path, name);
+
+    if(vm->streamCompileSize != 0 && strlen(src) >= vm->streamCompileSize) {
+        ObjModule* module = name ? getOrCreateModule(vm, path, name) : NULL;
+        return compileStreaming(vm, path, module, src, err);
+    }
+
+    JStarStmt* program = parseSource(vm, path, src);
+    if(program == NULL) {
+        *err = JSR_SYNTAX_ERR;
+        return NULL;
+    }
+
+    ObjModule* module = name ? getOrCreateModule(vm, path, name) : NULL;
     ObjFunction* fn = compile(vm, path, module, program);
+    releaseSourceTree(vm);
+
+    if(fn == NULL) {
+        *err = JSR_COMPILE_ERR;
+    }
+
+    return fn;
+}
+
+ObjFunction* compileModuleSource(JStarVM* vm, const char* path, ObjString* name, const char* src,
+                                 JStarResult* err) {
+    PROFILE_FUNC()
+
+    size_t length = strlen(src);
+    ObjModule* module = getModule(vm, name);
+    if(module != NULL) {
+        ObjFunction* fn = evalCacheGet(&vm->evalCache, module, src, length);
+        if(fn != NULL) return fn;
+    }
+
+    ObjFunction* fn = compileSource(vm, path, name, src, err);
+    if(fn == NULL) {
+        return NULL;
+    }
+
+    evalCachePut(&vm->evalCache, fn->proto.module, src, length, fn);
     return fn;
 }
 
 ObjFunction* deserializeModule(JStarVM* vm, const char* path, ObjString* name,
-                               const JStarBuffer* code, JStarResult* err) {
+                               const JStarBuffer* code, DeserializeMode mode, JStarResult* err) {
     PROFILE_FUNC()
-    ObjFunction* fn = deserialize(vm, getOrCreateModule(vm, path, name), code, err);
+    ObjModule* module = getOrCreateModule(vm, path, name);
+    ObjFunction* fn = deserialize(vm, module, code, mode, err);
     if(*err == JSR_VERSION_ERR) {
         vm->errorCallback(vm, *err, path, -1, "Incompatible binary file version");
     }
@@ -85,7 +167,7 @@ static void registerInParent(JStarVM* vm, ObjModule* module) {
     ObjModule* parent = getModule(vm, copyString(vm, name->data, simpleName - name->data - 1));
     ASSERT(parent, "Submodule parent could not be found.");
 
-    hashTablePut(&parent->globals, copyString(vm, simpleName, strlen(simpleName)), OBJ_VAL(module));
+    moduleSetGlobal(parent, copyString(vm, simpleName, strlen(simpleName)), OBJ_VAL(module));
 }
 
 void setModule(JStarVM* vm, ObjString* name, ObjModule* module) {
@@ -128,22 +210,11 @@ static void loadNativeExtension(JStarVM* vm, JStarBuffer* modulePath, ObjString*
     }
 }
 
-static void parseError(const char* file, int line, const char* error, void* udata) {
-    JStarVM* vm = udata;
-    vm->errorCallback(vm, JSR_SYNTAX_ERR, file, line, error);
-}
-
 static ObjModule* importSource(JStarVM* vm, const char* path, ObjString* name, const char* src) {
     PROFILE_FUNC()
 
-    JStarStmt* program = jsrParse(path, src, parseError, vm);
-    if(program == NULL) {
-        return NULL;
-    }
-
-    ObjFunction* fn = compileModule(vm, path, name, program);
-    jsrStmtFree(program);
-
+    JStarResult err;
+    ObjFunction* fn = compileSource(vm, path, name, src, &err);
     if(fn == NULL) {
         return NULL;
     }
@@ -155,11 +226,11 @@ static ObjModule* importSource(JStarVM* vm, const char* path, ObjString* name, c
 }
 
 static ObjModule* importBinary(JStarVM* vm, const char* path, ObjString* name,
-                               const JStarBuffer* code) {
+                               const JStarBuffer* code, DeserializeMode mode) {
     PROFILE_FUNC()
 
     JStarResult res;
-    ObjFunction* fn = deserializeModule(vm, path, name, code, &res);
+    ObjFunction* fn = deserializeModule(vm, path, name, code, mode, &res);
     if(res != JSR_SUCCESS) {
         return NULL;
     }
@@ -170,6 +241,30 @@ static ObjModule* importBinary(JStarVM* vm, const char* path, ObjString* name,
     return fn->proto.module;
 }
 
+// Imports a compiled module straight from a mapping of its file, without copying its bytecode.
+// The module takes ownership of the mapping, that is released along with it. A module can only
+// own one mapping, so code loaded again in the same module is copied as usual
+static ObjModule* importMapped(JStarVM* vm, const char* path, ObjString* name, MappedFile* file) {
+    PROFILE_FUNC()
+
+    JStarBuffer code = jsrBufferWrap(vm, file->data, file->size);
+    ObjModule* module = getOrCreateModule(vm, path, name);
+
+    if(module->mapping.data != NULL) {
+        ObjModule* res = importBinary(vm, path, name, &code, DESERIALIZE_COPY);
+        unmapFile(file);
+        return res;
+    }
+
+    module->mapping = *file;
+    return importBinary(vm, path, name, &code, DESERIALIZE_BORROW);
+}
+
+static bool isBinaryPath(const JStarBuffer* path) {
+    size_t extLen = strlen(JSC_EXT);
+    return path->size >= extLen && strcmp(path->data + path->size - extLen, JSC_EXT) == 0;
+}
+
 typedef struct {
     enum {
         IMPORT_OK,
@@ -179,23 +274,165 @@ typedef struct {
     ObjModule *module;
 } ImportRes;
 
+// Imports a module from the bundle at `path`. The module borrows its bytecode from the bundle,
+// that stays open until the VM is freed
+static ImportRes importFromBundle(JStarVM* vm, const char* path, ObjString* name) {
+    PROFILE_FUNC()
+
+    Bundle* bundle = openBundle(vm, path);
+    if(bundle == NULL) {
+        return (ImportRes){IMPORT_NOT_FOUND, NULL};
+    }
+
+    JStarBuffer code;
+    if(!bundleFind(vm, bundle, name->data, name->length, &code)) {
+        return (ImportRes){IMPORT_NOT_FOUND, NULL};
+    }
+
+    // Give the module a path as if it was a file inside the bundle
+    JStarBuffer modulePath;
+    jsrBufferInit(vm, &modulePath);
+    jsrBufferAppendf(&modulePath, "%s" PATH_SEP_STR "%s", bundle->path, name->data);
+    jsrBufferReplaceChar(&modulePath, strlen(bundle->path) + 1, '.', PATH_SEP_CHAR);
+    jsrBufferAppendStr(&modulePath, JSC_EXT);
+
+    ObjModule* module = importBinary(vm, modulePath.data, name, &code, DESERIALIZE_BORROW);
+    jsrBufferFree(&modulePath);
+
+    if(module == NULL) {
+        return (ImportRes){IMPORT_ERR, NULL};
+    }
+
+    return (ImportRes){IMPORT_OK, module};
+}
+
+// Stores the module just compiled from source, whose closure is on top of the stack, in the code
+// cache shared with other VMs
+static void cacheCompiledModule(JStarVM* vm, const char* path, const FileStamp* stamp) {
+    PROFILE_FUNC()
+
+    ObjFunction* fn = AS_CLOSURE(peek(vm))->fn;
+    JStarBuffer code = serialize(vm, fn);
+    codeCachePut(vm->codeCache, path, stamp, code.data, code.size);
+    jsrBufferFree(&code);
+}
+
+// Imports the source module at `path` from the code cached on disk, if the cache is still valid.
+// Otherwise the module is compiled from source, and its code is written to the cache
+static ImportRes importWithBytecodeCache(JStarVM* vm, const char* path, ObjString* name) {
+    PROFILE_FUNC()
+
+    FileStamp stamp;
+    if(!getFileStamp(path, &stamp)) {
+        return (ImportRes){IMPORT_NOT_FOUND, NULL};
+    }
+
+    JStarBuffer cachePath;
+    jsrBufferInit(vm, &cachePath);
+    cachedCodePath(vm->bytecodeCacheDir, path, &cachePath);
+
+    CachedCode cached;
+    bool hasCache = readCachedCode(vm, cachePath.data, path, &cached);
+
+    ImportRes res = {IMPORT_OK, NULL};
+    if(hasCache && stampEquals(&cached.stamp, &stamp)) {
+        res.module = importBinary(vm, path, name, &cached.code, DESERIALIZE_COPY);
+        goto done;
+    }
+
+    JStarBuffer src;
+    if(!jsrReadFile(vm, path, &src)) {
+        res.status = IMPORT_NOT_FOUND;
+        goto done;
+    }
+
+    uint32_t srcHash = hashBytes(src.data, src.size);
+
+    if(isCompiledCode(&src)) {
+        res.module = importBinary(vm, path, name, &src, DESERIALIZE_COPY);
+    } else if(hasCache && cached.stamp.size == stamp.size && cached.srcHash == srcHash) {
+        // The file has been touched without changing its contents, only the stamp is updated
+        res.module = importBinary(vm, path, name, &cached.code, DESERIALIZE_COPY);
+        if(res.module != NULL) {
+            writeCachedCode(cachePath.data, path, &stamp, srcHash, &cached.code);
+        }
+    } else {
+        res.module = importSource(vm, path, name, src.data);
+        if(res.module != NULL) {
+            JStarBuffer code = serialize(vm, AS_CLOSURE(peek(vm))->fn);
+            writeCachedCode(cachePath.data, path, &stamp, srcHash, &code);
+            jsrBufferFree(&code);
+        }
+    }
+
+    jsrBufferFree(&src);
+
+done:
+    if(hasCache) jsrBufferFree(&cached.file);
+    jsrBufferFree(&cachePath);
+
+    if(res.status == IMPORT_OK && res.module == NULL) {
+        res.status = IMPORT_ERR;
+    }
+    return res;
+}
+
 static ImportRes importFromPath(JStarVM* vm, JStarBuffer* path, ObjString* name) {
     PROFILE_FUNC()
 
+    ImportRes res;
+    MappedFile mapped;
+
+    // Modules already loaded by another VM are deserialized lazily from the shared code, that is
+    // never written to. Otherwise the file is read instead of being mapped, so that its code can
+    // be stored in the cache
+    FileStamp stamp;
+    if(vm->codeCache) {
+        const void* cached;
+        size_t size;
+        if(codeCacheGet(vm->codeCache, path->data, &stamp, &cached, &size)) {
+            JStarBuffer code = jsrBufferWrap(vm, cached, size);
+            res.module = importBinary(vm, path->data, name, &code, DESERIALIZE_LAZY);
+            goto loaded;
+        }
+    } else if(isBinaryPath(path) && mapFile(path->data, &mapped)) {
+        JStarBuffer code = jsrBufferWrap(vm, mapped.data, mapped.size);
+        if(isCompiledCode(&code)) {
+            res.module = importMapped(vm, path->data, name, &mapped);
+            goto loaded;
+        }
+        unmapFile(&mapped);
+    }
+
+    if(vm->bytecodeCache && !isBinaryPath(path)) {
+        res = importWithBytecodeCache(vm, path->data, name);
+        if(res.status == IMPORT_NOT_FOUND) return res;
+        if(res.module != NULL && vm->codeCache) {
+            cacheCompiledModule(vm, path->data, &stamp);
+        }
+        goto loaded;
+    }
+
     JStarBuffer src;
     if(!jsrReadFile(vm, path->data, &src)) {
         return (ImportRes){IMPORT_NOT_FOUND, NULL};
     }
 
-    ImportRes res;
     if(isCompiledCode(&src)) {
-        res.module = importBinary(vm, path->data, name, &src);
+        if(vm->codeCache) {
+            codeCachePut(vm->codeCache, path->data, &stamp, src.data, src.size);
+        }
+        res.module = importBinary(vm, path->data, name, &src, DESERIALIZE_COPY);
     } else {
         res.module = importSource(vm, path->data, name, src.data);
+        if(res.module != NULL && vm->codeCache) {
+            cacheCompiledModule(vm, path->data, &stamp);
+        }
     }
 
     jsrBufferFree(&src);
 
+loaded:
     if(res.module == NULL) {
         return (ImportRes){IMPORT_ERR, NULL};
     }
@@ -206,10 +443,27 @@ static ImportRes importFromPath(JStarVM* vm, JStarBuffer* path, ObjString* name)
     return res;
 }
 
+// Files tried in every import path, in order of preference: binary and source packages
+// (__package__ files in a directory), then binary and source modules
+static const char* const candidateFiles[] = {
+    PATH_SEP_STR PACKAGE_FILE JSC_EXT,
+    PATH_SEP_STR PACKAGE_FILE JSR_EXT,
+    JSC_EXT,
+    JSR_EXT,
+};
+
 static ObjModule* importModuleOrPackage(JStarVM* vm, ObjString* name) {
     PROFILE_FUNC()
 
     ObjList* paths = vm->importPaths;
+    ImportCache* cache = &vm->importCache;
+
+    syncImportCache(vm, cache, paths);
+    cache->imports++;
+
+    if(importCacheIsMissing(cache, name->data, name->length)) {
+        return NULL;
+    }
 
     JStarBuffer fullPath;
     jsrBufferInit(vm, &fullPath);
@@ -217,7 +471,18 @@ static ObjModule* importModuleOrPackage(JStarVM* vm, ObjString* name) {
     for(size_t i = 0; i < paths->size + 1; i++) {
         if(i < paths->size) {
             if(!IS_STRING(paths->arr[i])) continue;
-            jsrBufferAppendStr(&fullPath, AS_STRING(paths->arr[i])->data);
+
+            const char* importPath = stringCString(vm, AS_STRING(paths->arr[i]));
+            if(isBundlePath(importPath)) {
+                ImportRes res = importFromBundle(vm, importPath, name);
+                if(res.status != IMPORT_NOT_FOUND) {
+                    jsrBufferFree(&fullPath);
+                    return res.module;
+                }
+                continue;
+            }
+
+            jsrBufferAppendStr(&fullPath, importPath);
             if(fullPath.size > 0 && fullPath.data[fullPath.size - 1] != PATH_SEP_CHAR) {
                 jsrBufferAppendChar(&fullPath, PATH_SEP_CHAR);
             }
@@ -228,50 +493,25 @@ static ObjModule* importModuleOrPackage(JStarVM* vm, ObjString* name) {
         jsrBufferAppendStr(&fullPath, name->data);
         jsrBufferReplaceChar(&fullPath, moduleStart, '.', PATH_SEP_CHAR);
 
-        ImportRes res;
-
-        // Try to load a binary package (__package__.jsc file in a directory)
-        jsrBufferAppendStr(&fullPath, PATH_SEP_STR PACKAGE_FILE JSC_EXT);
-        res = importFromPath(vm, &fullPath, name);
-
-        if(res.status != IMPORT_NOT_FOUND) {
-            jsrBufferFree(&fullPath);
-            return res.module;
-        }
-
-        // Try to load a source package (__package__.jsr file in a directory)
-        jsrBufferTrunc(&fullPath, moduleEnd);
-        jsrBufferAppendStr(&fullPath, PATH_SEP_STR PACKAGE_FILE JSR_EXT);
-        res = importFromPath(vm, &fullPath, name);
-
-        if(res.status != IMPORT_NOT_FOUND) {
-            jsrBufferFree(&fullPath);
-            return res.module;
-        }
-
-        // If there is no package try to load compiled module (i.e. `.jsc` file)
-        jsrBufferTrunc(&fullPath, moduleEnd);
-        jsrBufferAppendStr(&fullPath, JSC_EXT);
-        res = importFromPath(vm, &fullPath, name);
-
-        if(res.status != IMPORT_NOT_FOUND) {
-            jsrBufferFree(&fullPath);
-            return res.module;
-        }
+        for(size_t j = 0; j < ARRAY_SIZE(candidateFiles); j++) {
+            jsrBufferTrunc(&fullPath, moduleEnd);
+            jsrBufferAppendStr(&fullPath, candidateFiles[j]);
 
-        // No binary module found, finally try with source module (i.e. `.jsr` file)
-        jsrBufferTrunc(&fullPath, moduleEnd);
-        jsrBufferAppendStr(&fullPath, JSR_EXT);
-        res = importFromPath(vm, &fullPath, name);
+            if(!importCacheMayExist(cache, fullPath.data)) continue;
+            cache->probes++;
 
-        if(res.status != IMPORT_NOT_FOUND) {
-            jsrBufferFree(&fullPath);
-            return res.module;
+            ImportRes res = importFromPath(vm, &fullPath, name);
+            if(res.status != IMPORT_NOT_FOUND) {
+                jsrBufferFree(&fullPath);
+                return res.module;
+            }
         }
 
         jsrBufferClear(&fullPath);
     }
 
+    importCacheSetMissing(cache, name->data, name->length);
+
     jsrBufferFree(&fullPath);
     return NULL;
 }
@@ -279,17 +519,138 @@ static ObjModule* importModuleOrPackage(JStarVM* vm, ObjString* name) {
 ObjModule* importModule(JStarVM* vm, ObjString* name) {
     PROFILE_FUNC()
 
-    if(hashTableContainsKey(&vm->modules, name)) {
+    ObjModule* module = getModule(vm, name);
+    if(module != NULL && !module->lazy) {
         push(vm, NULL_VAL);
-        return getModule(vm, name);
+        return module;
     }
 
     size_t len;
     const char* builtinBytecode = readBuiltInModule(name->data, &len);
     if(builtinBytecode != NULL) {
         JStarBuffer code = jsrBufferWrap(vm, builtinBytecode, len);
-        return importBinary(vm, name->data, name, &code);
+        return importBinary(vm, name->data, name, &code, DESERIALIZE_LAZY);
     }
 
     return importModuleOrPackage(vm, name);
+}
+
+ObjModule* importModuleLazy(JStarVM* vm, ObjString* name) {
+    ObjModule* module = getModule(vm, name);
+    if(module == NULL) {
+        module = getOrCreateModule(vm, name->data, name);
+        module->lazy = true;
+    }
+    return module;
+}
+
+ObjModule* importModuleSync(JStarVM* vm, ObjString* name) {
+    PROFILE_FUNC()
+
+    double start = vm->traceImports ? monotonicTime() : 0;
+    double outerChildTime = vm->importChildTime;
+    vm->importChildTime = 0;
+
+    if(TRACING(vm, JSR_TRACE_IMPORT_BEGIN)) {
+        traceNamed(vm, JSR_TRACE_IMPORT_BEGIN, name->data, 0);
+    }
+
+    ObjModule* module = importModule(vm, name);
+    if(module == NULL) {
+        vm->importChildTime = outerChildTime;
+        jsrRaise(vm, "ImportException", "Cannot load module `%s`.", name->data);
+        if(TRACING(vm, JSR_TRACE_IMPORT_END)) {
+            traceNamed(vm, JSR_TRACE_IMPORT_END, name->data, false);
+        }
+        return NULL;
+    }
+
+    // Null if the module was already imported
+    bool execute = !IS_NULL(peek(vm));
+
+    if(execute) {
+        ObjModule* caller = vm->module;
+        JStarResult res = jsrCall(vm, 0);
+        vm->module = caller;
+
+        if(res != JSR_SUCCESS) {
+            vm->importChildTime = outerChildTime;
+            if(TRACING(vm, JSR_TRACE_IMPORT_END)) {
+                traceNamed(vm, JSR_TRACE_IMPORT_END, name->data, false);
+            }
+            return NULL;
+        }
+    }
+    pop(vm);
+
+    if(TRACING(vm, JSR_TRACE_IMPORT_END)) {
+        traceNamed(vm, JSR_TRACE_IMPORT_END, name->data, true);
+    }
+
+    if(vm->traceImports && execute) {
+        module->importTime = monotonicTime() - start;
+        module->importSelfTime = module->importTime - vm->importChildTime;
+        outerChildTime += module->importTime;
+    }
+
+    vm->importChildTime = outerChildTime;
+    return module;
+}
+
+bool resolveLazyModule(JStarVM* vm, ObjModule* module) {
+    ASSERT(module->lazy, "Module is not lazy");
+
+    // Parent packages are executed before their submodules, as in eager imports
+    ObjString* name = module->name;
+    const char* lastDot = strrchr(name->data, '.');
+    if(lastDot != NULL) {
+        ObjModule* parent = getModule(vm, copyString(vm, name->data, lastDot - name->data));
+        if(parent != NULL && parent->lazy && !resolveLazyModule(vm, parent)) {
+            return false;
+        }
+    }
+
+    return importModuleSync(vm, name) != NULL;
+}
+
+static int compareImportTime(const void* a, const void* b) {
+    double ta = (*(ObjModule* const*)a)->importTime;
+    double tb = (*(ObjModule* const*)b)->importTime;
+    return (ta < tb) - (ta > tb);
+}
+
+bool jsrGetImportTimes(JStarVM* vm, JStarBuffer* out) {
+    if(!vm->traceImports) return false;
+
+    const HashTable* modules = &vm->modules;
+    ObjModule** timed = malloc(sizeof(ObjModule*) * (modules->sizeMask + 1));
+    size_t count = 0, unused = 0;
+
+    for(const Entry* e = modules->entries; e < modules->entries + modules->sizeMask + 1; e++) {
+        if(e->key) {
+            ObjModule* module = AS_MODULE(e->value);
+            if(module->lazy) unused++;
+            else if(module->importTime > 0) timed[count++] = module;
+        }
+    }
+    qsort(timed, count, sizeof(ObjModule*), &compareImportTime);
+
+    jsrBufferAppendf(out, "Imports (%zu timed):\n", count);
+    jsrBufferAppendf(out, "%12s %12s  %s\n", "self (s)", "total (s)", "module");
+    for(size_t i = 0; i < count; i++) {
+        jsrBufferAppendf(out, "%12.6f %12.6f  %s\n", timed[i]->importSelfTime,
+                         timed[i]->importTime, timed[i]->name->data);
+    }
+
+    if(unused > 0) {
+        jsrBufferAppendf(out, "\nLazy imports not loaded (%zu):\n", unused);
+        for(const Entry* e = modules->entries; e < modules->entries + modules->sizeMask + 1; e++) {
+            if(e->key && AS_MODULE(e->value)->lazy) {
+                jsrBufferAppendf(out, "%26s  %s\n", "", e->key->data);
+            }
+        }
+    }
+
+    free(timed);
+    return true;
 }
\ No newline at end of file
@@ -4,14 +4,38 @@
 #include "jstar.h"
 #include "object.h"
 #include "parse/ast.h"
+#include "serialize.h"
 #include "value.h"
 
-ObjFunction* compileModule(JStarVM* vm, const char* path, ObjString* name, JStarStmt* program);
+// Parses and compiles `src` in the module `name`, or without a module if NULL. Sources at least
+// `streamCompileSize` long are compiled while being parsed (see `compileStreaming`). On errors
+// returns NULL and sets `err` to either JSR_SYNTAX_ERR or JSR_COMPILE_ERR
+ObjFunction* compileSource(JStarVM* vm, const char* path, ObjString* name, const char* src,
+                           JStarResult* err);
+// Parses and compiles `src` in the module `name`, reusing the function cached in the eval cache of
+// the VM if the same source was already compiled in the module. On errors returns NULL and sets
+// `err` to either JSR_SYNTAX_ERR or JSR_COMPILE_ERR
+ObjFunction* compileModuleSource(JStarVM* vm, const char* path, ObjString* name, const char* src,
+                                 JStarResult* err);
 ObjFunction* deserializeModule(JStarVM* vm, const char* path, ObjString* name,
-                               const JStarBuffer* code, JStarResult* err);
+                               const JStarBuffer* code, DeserializeMode mode, JStarResult* err);
 
 void setModule(JStarVM* vm, ObjString* name, ObjModule* module);
 ObjModule* getModule(JStarVM* vm, ObjString* name);
+// Imports the module `name`, returning NULL if it cannot be found. Pushes on the stack the
+// closure of the module's body if it has to be executed, null if it was already imported
 ObjModule* importModule(JStarVM* vm, ObjString* name);
 
+// Lazy imports bind a placeholder module, created by `importModuleLazy`, that is loaded and
+// executed the first time one of its names is accessed. The VM resolves it before getting or setting
+// a field of a module, invoking a method on it or importing names from it, and the API does the
+// same before looking up its globals
+ObjModule* importModuleLazy(JStarVM* vm, ObjString* name);
+// Imports the module `name` and executes its body before returning. The time taken is recorded in
+// the module if imports are traced. Returns NULL, leaving an exception on the stack, on errors
+ObjModule* importModuleSync(JStarVM* vm, ObjString* name);
+// Loads and executes a placeholder module. Returns false, leaving an exception on the stack, on
+// errors. A module that cannot be found stays a placeholder, so that every use reports the error
+bool resolveLazyModule(JStarVM* vm, ObjModule* module);
+
 #endif
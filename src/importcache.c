@@ -0,0 +1,284 @@
+#include "importcache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "conf.h"
+#include "profiler.h"
+#include "util.h"
+
+#if defined(JSTAR_POSIX)
+    #include <dirent.h>
+    #include <errno.h>
+    #define HAS_DIR_LISTING
+#endif
+
+#define MAP_INIT_BUCKETS 16
+
+struct CacheEntry {
+    CacheEntry* next;
+    uint32_t hash;
+    size_t length;
+    // Sorted entries of the directory (dirs map only). If the directory couldn't be listed
+    // `listed` is false, and all of its files are assumed to exist
+    char** names;
+    size_t nameCount;
+    bool listed;
+    char key[];
+};
+
+// -----------------------------------------------------------------------------
+// STRING MAP
+// -----------------------------------------------------------------------------
+
+static void freeEntry(CacheEntry* e) {
+    for(size_t i = 0; i < e->nameCount; i++) {
+        free(e->names[i]);
+    }
+    free(e->names);
+    free(e);
+}
+
+static void clearMap(CacheMap* m) {
+    for(size_t i = 0; i < m->bucketCount; i++) {
+        CacheEntry* e = m->buckets[i];
+        while(e != NULL) {
+            CacheEntry* next = e->next;
+            freeEntry(e);
+            e = next;
+        }
+    }
+    free(m->buckets);
+    *m = (CacheMap){0};
+}
+
+static CacheEntry* mapGet(const CacheMap* m, const char* key, size_t length) {
+    if(m->bucketCount == 0) return NULL;
+    uint32_t hash = hashBytes(key, length);
+    for(CacheEntry* e = m->buckets[hash & (m->bucketCount - 1)]; e != NULL; e = e->next) {
+        if(e->hash == hash && e->length == length && memcmp(e->key, key, length) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void growMap(CacheMap* m) {
+    size_t newCount = m->bucketCount ? m->bucketCount * 2 : MAP_INIT_BUCKETS;
+    CacheEntry** buckets = calloc(newCount, sizeof(CacheEntry*));
+
+    for(size_t i = 0; i < m->bucketCount; i++) {
+        CacheEntry* e = m->buckets[i];
+        while(e != NULL) {
+            CacheEntry* next = e->next;
+            size_t idx = e->hash & (newCount - 1);
+            e->next = buckets[idx];
+            buckets[idx] = e;
+            e = next;
+        }
+    }
+
+    free(m->buckets);
+    m->buckets = buckets;
+    m->bucketCount = newCount;
+}
+
+// The key must not be already present in the map
+static CacheEntry* mapAdd(CacheMap* m, const char* key, size_t length) {
+    if(m->count + 1 > m->bucketCount) {
+        growMap(m);
+    }
+
+    CacheEntry* e = malloc(sizeof(*e) + length + 1);
+    e->hash = hashBytes(key, length);
+    e->length = length;
+    e->names = NULL;
+    e->nameCount = 0;
+    e->listed = false;
+    memcpy(e->key, key, length);
+    e->key[length] = '\0';
+
+    size_t idx = e->hash & (m->bucketCount - 1);
+    e->next = m->buckets[idx];
+    m->buckets[idx] = e;
+    m->count++;
+
+    return e;
+}
+
+// -----------------------------------------------------------------------------
+// IMPORT CACHE
+// -----------------------------------------------------------------------------
+
+void initImportCache(ImportCache* c) {
+    *c = (ImportCache){0};
+}
+
+static void freePaths(ImportCache* c) {
+    for(size_t i = 0; i < c->pathCount; i++) {
+        free(c->paths[i]);
+    }
+    free(c->paths);
+    c->paths = NULL;
+    c->pathCount = 0;
+}
+
+void freeImportCache(ImportCache* c) {
+    clearImportCache(c);
+}
+
+void clearImportCache(ImportCache* c) {
+    freePaths(c);
+    clearMap(&c->dirs);
+    clearMap(&c->missing);
+}
+
+static char* copyCString(const char* str, size_t length) {
+    char* copy = malloc(length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static bool samePaths(JStarVM* vm, const ImportCache* c, ObjList* paths) {
+    if(c->pathCount != paths->size) return false;
+    for(size_t i = 0; i < paths->size; i++) {
+        Value p = paths->arr[i];
+        if(!IS_STRING(p)) {
+            if(c->paths[i] != NULL) return false;
+            continue;
+        }
+        if(c->paths[i] == NULL || strcmp(c->paths[i], stringCString(vm, AS_STRING(p))) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void syncImportCache(JStarVM* vm, ImportCache* c, ObjList* paths) {
+    if(c->paths != NULL && samePaths(vm, c, paths)) return;
+
+    clearImportCache(c);
+
+    c->pathCount = paths->size;
+    c->paths = malloc(sizeof(char*) * (paths->size > 0 ? paths->size : 1));
+    for(size_t i = 0; i < paths->size; i++) {
+        Value p = paths->arr[i];
+        c->paths[i] = NULL;
+        if(IS_STRING(p)) {
+            ObjString* str = AS_STRING(p);
+            c->paths[i] = copyCString(stringCString(vm, str), str->length);
+        }
+    }
+}
+
+bool importCacheIsMissing(ImportCache* c, const char* name, size_t length) {
+    if(mapGet(&c->missing, name, length) != NULL) {
+        c->skipped++;
+        return true;
+    }
+    return false;
+}
+
+void importCacheSetMissing(ImportCache* c, const char* name, size_t length) {
+    if(mapGet(&c->missing, name, length) == NULL) {
+        mapAdd(&c->missing, name, length);
+    }
+}
+
+#ifdef HAS_DIR_LISTING
+
+static int compareNames(const void* n1, const void* n2) {
+    return strcmp(*(const char**)n1, *(const char**)n2);
+}
+
+static bool hasName(const CacheEntry* dir, const char* name) {
+    if(dir->nameCount == 0) return false;
+    return bsearch(&name, dir->names, dir->nameCount, sizeof(char*), &compareNames) != NULL;
+}
+
+// Lists the directory in `e`. A directory that doesn't exist is listed as an empty one, while if
+// it cannot be read for other reasons it's left unlisted, so that its files are always probed
+static void listDirectory(CacheEntry* e) {
+    PROFILE_FUNC()
+
+    DIR* dir = opendir(e->key);
+    if(dir == NULL) {
+        e->listed = errno == ENOENT || errno == ENOTDIR;
+        return;
+    }
+
+    size_t capacity = 0;
+    struct dirent* file;
+    while((file = readdir(dir)) != NULL) {
+        if(strcmp(file->d_name, ".") == 0 || strcmp(file->d_name, "..") == 0) continue;
+        if(e->nameCount == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            e->names = realloc(e->names, sizeof(char*) * capacity);
+        }
+        e->names[e->nameCount++] = copyCString(file->d_name, strlen(file->d_name));
+    }
+
+    closedir(dir);
+    qsort(e->names, e->nameCount, sizeof(char*), &compareNames);
+    e->listed = true;
+}
+
+static const char* lastSeparator(const char* path, size_t length) {
+    for(size_t i = length; i > 0; i--) {
+        if(path[i - 1] == '/') return path + i - 1;
+    }
+    return NULL;
+}
+
+static CacheEntry* getDirectory(ImportCache* c, const char* path, size_t length) {
+    CacheEntry* dir = mapGet(&c->dirs, path, length);
+    if(dir != NULL) return dir;
+
+    dir = mapAdd(&c->dirs, path, length);
+
+    // A directory that is missing from the listing of its parent doesn't exist, so there's no
+    // need to open it. This avoids a failing `opendir` for every package candidate
+    const char* sep = lastSeparator(dir->key, length);
+    if(sep != NULL && sep != dir->key) {
+        CacheEntry* parent = getDirectory(c, dir->key, sep - dir->key);
+        if(parent->listed && !hasName(parent, sep + 1)) {
+            dir->listed = true;
+            c->skipped++;
+            return dir;
+        }
+    }
+
+    listDirectory(dir);
+    c->probes++;
+    return dir;
+}
+
+bool importCacheMayExist(ImportCache* c, const char* path) {
+    const char* sep = lastSeparator(path, strlen(path));
+
+    CacheEntry* dir;
+    if(sep == NULL) {
+        dir = getDirectory(c, ".", 1);
+    } else if(sep == path) {
+        dir = getDirectory(c, "/", 1);
+    } else {
+        dir = getDirectory(c, path, sep - path);
+    }
+
+    const char* fileName = sep ? sep + 1 : path;
+    if(dir->listed && !hasName(dir, fileName)) {
+        c->skipped++;
+        return false;
+    }
+
+    return true;
+}
+
+#else
+
+bool importCacheMayExist(ImportCache* c, const char* path) {
+    return true;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef IMPORTCACHE_H
+#define IMPORTCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jstar.h"
+#include "object.h"
+
+typedef struct CacheEntry CacheEntry;
+
+typedef struct CacheMap {
+    CacheEntry** buckets;
+    size_t bucketCount, count;
+} CacheMap;
+
+// Per-VM cache of the results of import path resolution.
+// It remembers the listing of every directory searched during import, so that candidate files
+// that don't exist are discarded without touching the filesystem, and the names of the modules
+// that couldn't be found in any of the import paths.
+// The cache is built for a given list of import paths and is dropped as soon as they change.
+// Files created in an import directory after it has been listed are found only after the cache is
+// cleared, either by `jsrAddImportPath` or by modifying the import paths.
+typedef struct ImportCache {
+    char** paths;  // Import paths the cache was built for
+    size_t pathCount;
+    CacheMap dirs;     // Directory path -> sorted list of its entries
+    CacheMap missing;  // Names of the modules not found
+    // Counters, preserved across clears
+    uint64_t imports;  // Module imports that searched the import paths
+    uint64_t probes;   // Filesystem accesses made while searching
+    uint64_t skipped;  // Accesses avoided thanks to the cache
+} ImportCache;
+
+void initImportCache(ImportCache* c);
+void freeImportCache(ImportCache* c);
+// Drops all cached directory listings and missing modules
+void clearImportCache(ImportCache* c);
+// Clears the cache if `paths` differs from the import paths the cache was built for
+void syncImportCache(JStarVM* vm, ImportCache* c, ObjList* paths);
+
+// Returns true if the module `name` was already searched for and not found
+bool importCacheIsMissing(ImportCache* c, const char* name, size_t length);
+void importCacheSetMissing(ImportCache* c, const char* name, size_t length);
+
+// Returns false if the file at `path` certainly doesn't exist, listing its parent directory if it
+// hasn't been already. On platforms that cannot list directories it always returns true
+bool importCacheMayExist(ImportCache* c, const char* path);
+
+#endif
@@ -6,14 +6,14 @@
 #include <string.h>
 
 #include "builtins/core.h"
+#include "bundle.h"
 #include "compiler.h"
 #include "disassemble.h"
+#include "gc.h"
 #include "hashtable.h"
 #include "import.h"
 #include "jstar_limits.h"
 #include "object.h"
-#include "parse/ast.h"
-#include "parse/parser.h"
 #include "profiler.h"
 #include "serialize.h"
 #include "util.h"
@@ -48,18 +48,25 @@ void jsrPrintErrorCB(JStarVM* vm, JStarResult err, const char* file, int line, c
     fprintf(stderr, "%s\n", error);
 }
 
-static void parseError(const char* file, int line, const char* error, void* udata) {
-    JStarVM* vm = udata;
-    vm->errorCallback(vm, JSR_SYNTAX_ERR, file, line, error);
-}
-
 JStarConf jsrGetConf(void) {
     // Default configuration
     JStarConf conf;
     conf.startingStackSize = 100;
     conf.firstGCCollectionPoint = 1024 * 1024 * 20; // 20 MiB
     conf.heapGrowRate = 2;
+    conf.generationalGC = false;
+    conf.nurserySize = 1024 * 1024 * 2; // 2 MiB
+    conf.memoryLimit = 0;
+    conf.maxInternedLength = 64;
     conf.errorCallback = &jsrPrintErrorCB;
+    conf.pageAllocator = NULL;
+    conf.codeCache = NULL;
+    conf.evalCacheSize = 0;
+    conf.bytecodeCache = false;
+    conf.bytecodeCacheDir = NULL;
+    conf.streamCompileSize = 1024 * 1024; // 1 MiB
+    conf.lazyImports = false;
+    conf.traceImports = false;
     conf.customData = NULL;
     return conf;
 }
@@ -77,17 +84,12 @@ JStarResult jsrEvalModuleString(JStarVM* vm, const char* path, const char* modul
                                 const char* src) {
     PROFILE_FUNC()
 
-    JStarStmt* program = jsrParse(path, src, parseError, vm);
-    if(program == NULL) {
-        return JSR_SYNTAX_ERR;
-    }
-
+    JStarResult err;
     ObjString* name = copyString(vm, module, strlen(module));
-    ObjFunction* fn = compileModule(vm, path, name, program);
-    jsrStmtFree(program);
+    ObjFunction* fn = compileModuleSource(vm, path, name, src, &err);
 
     if(fn == NULL) {
-        return JSR_COMPILE_ERR;
+        return err;
     }
 
     push(vm, OBJ_VAL(fn));
@@ -119,7 +121,7 @@ JStarResult jsrEvalModule(JStarVM* vm, const char* path, const char* module,
 
     JStarResult err;
     ObjString* name = copyString(vm, module, strlen(module));
-    ObjFunction* fn = deserializeModule(vm, path, name, code, &err);
+    ObjFunction* fn = deserializeModule(vm, path, name, code, DESERIALIZE_COPY, &err);
 
     if(fn == NULL) {
         return err;
@@ -142,23 +144,26 @@ JStarResult jsrEvalModule(JStarVM* vm, const char* path, const char* module,
 JStarResult jsrCompileCode(JStarVM* vm, const char* path, const char* src, JStarBuffer* out) {
     PROFILE_FUNC()
 
-    JStarStmt* program = jsrParse(path, src, parseError, vm);
-    if(program == NULL) {
-        return JSR_SYNTAX_ERR;
-    }
-
     // The function won't be executed, only compiled, so pass null module
-    ObjFunction* fn = compile(vm, path, NULL, program);
-    jsrStmtFree(program);
-
+    JStarResult err;
+    ObjFunction* fn = compileSource(vm, path, NULL, src, &err);
     if(fn == NULL) {
-        return JSR_COMPILE_ERR;
+        return err;
     }
 
     *out = serialize(vm, fn);
     return JSR_SUCCESS;
 }
 
+JStarResult jsrBundleCode(JStarVM* vm, const char** names, const JStarBuffer* codes, int count,
+                          JStarBuffer* out) {
+    PROFILE_FUNC()
+    if(!writeBundle(vm, names, codes, count, out)) {
+        return JSR_DESERIALIZE_ERR;
+    }
+    return JSR_SUCCESS;
+}
+
 JStarResult jsrDisassembleCode(JStarVM* vm, const char* path, const JStarBuffer* code) {
     PROFILE_FUNC()
 
@@ -168,7 +173,7 @@ JStarResult jsrDisassembleCode(JStarVM* vm, const char* path, const JStarBuffer*
 
     JStarResult ret;
     ObjString* dummy = copyString(vm, "", 0);  // Use dummy module since the code won't be executed
-    ObjFunction* fn = deserializeModule(vm, path, dummy, code, &ret);
+    ObjFunction* fn = deserializeModule(vm, path, dummy, code, DESERIALIZE_COPY, &ret);
 
     if(ret == JSR_SUCCESS) {
         disassembleFunction(fn);
@@ -232,7 +237,8 @@ JStarResult jsrCall(JStarVM* vm, uint8_t argc) {
     return JSR_SUCCESS;
 }
 
-JStarResult jsrCallMethod(JStarVM* vm, const char* name, uint8_t argc) {
+// Call the method `name` using the inline cache `ic`, if not NULL
+static JStarResult callMethod(JStarVM* vm, ObjString* name, InlineCache* ic, uint8_t argc) {
     int evalDepth = vm->frameCount;
     size_t base = vm->sp - vm->stack - argc - 1;
 
@@ -244,7 +250,8 @@ JStarResult jsrCallMethod(JStarVM* vm, const char* name, uint8_t argc) {
 
     vm->reentrantCalls++;
 
-    if(!invokeValue(vm, copyString(vm, name, strlen(name)), argc)) {
+    bool ok = ic ? invokeValueCached(vm, name, argc, ic, false) : invokeValue(vm, name, argc);
+    if(!ok) {
         vm->reentrantCalls--;
         finishUnwind(vm, evalDepth, base);
         return JSR_RUNTIME_ERR;
@@ -259,8 +266,15 @@ JStarResult jsrCallMethod(JStarVM* vm, const char* name, uint8_t argc) {
     return JSR_SUCCESS;
 }
 
+JStarResult jsrCallMethod(JStarVM* vm, const char* name, uint8_t argc) {
+    return callMethod(vm, copyString(vm, name, strlen(name)), NULL, argc);
+}
+
 void jsrEvalBreak(JStarVM* vm) {
-    if(vm->frameCount) vm->evalBreak = 1;
+    if(vm->frameCount) {
+        vm->interrupt = 1;
+        vm->evalBreak = 1;
+    }
 }
 
 void jsrPrintStacktrace(JStarVM* vm, int slot) {
@@ -306,17 +320,23 @@ void jsrRaiseException(JStarVM* vm, int slot) {
     push(vm, OBJ_VAL(stField));
 
     Value value = NULL_VAL;
-    hashTableGet(&exception->fields, stField, &value);
+    instanceGetField(exception, stField, &value);
     ObjStackTrace* st = IS_STACK_TRACE(value) ? (ObjStackTrace*)AS_OBJ(value) : newStackTrace(vm);
+    st->capture = classCapturesStacktrace(exception->base.cls);
     st->lastTracedFrame = -1;
 
-    hashTablePut(&exception->fields, stField, OBJ_VAL(st));
+    instanceSetField(exception, stField, OBJ_VAL(st));
+    GC_WRITE_BARRIER(vm, exception);
     pop(vm);
 
     // Place the exception on top of the stack if not already
     if(!valueEquals(excVal, vm->sp[-1])) {
         push(vm, excVal);
     }
+
+    if(TRACING(vm, JSR_TRACE_EXCEPTION)) {
+        traceNamed(vm, JSR_TRACE_EXCEPTION, exception->base.cls->name->data, 0);
+    }
 }
 
 void jsrRaise(JStarVM* vm, const char* cls, const char* err, ...) {
@@ -332,8 +352,13 @@ void jsrRaise(JStarVM* vm, const char* cls, const char* err, ...) {
     push(vm, OBJ_VAL(exception));
 
     ObjStackTrace* st = newStackTrace(vm);
+    st->capture = classCapturesStacktrace(exception->base.cls);
     push(vm, OBJ_VAL(st));
-    hashTablePut(&exception->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), OBJ_VAL(st));
+    ObjString* traceField = copyString(vm, EXC_TRACE, strlen(EXC_TRACE));
+    push(vm, OBJ_VAL(traceField));
+    instanceSetField(exception, traceField, OBJ_VAL(st));
+    GC_WRITE_BARRIER(vm, exception);
+    pop(vm);
     pop(vm);
 
     if(err != NULL) {
@@ -346,8 +371,17 @@ void jsrRaise(JStarVM* vm, const char* cls, const char* err, ...) {
         va_end(args);
 
         ObjString* errorField = copyString(vm, EXC_ERR, strlen(EXC_ERR));
+        push(vm, OBJ_VAL(errorField));
         ObjString* errorString = jsrBufferToString(&error);
-        hashTablePut(&exception->fields, errorField, OBJ_VAL(errorString));
+        push(vm, OBJ_VAL(errorString));
+        instanceSetField(exception, errorField, OBJ_VAL(errorString));
+        GC_WRITE_BARRIER(vm, exception);
+        pop(vm);
+        pop(vm);
+    }
+
+    if(TRACING(vm, JSR_TRACE_EXCEPTION)) {
+        traceNamed(vm, JSR_TRACE_EXCEPTION, exception->base.cls->name->data, 0);
     }
 }
 
@@ -362,6 +396,7 @@ void jsrInitCommandLineArgs(JStarVM* vm, int argc, const char** argv) {
 
 void jsrAddImportPath(JStarVM* vm, const char* path) {
     listAppend(vm, vm->importPaths, OBJ_VAL(copyString(vm, path, strlen(path))));
+    clearImportCache(&vm->importCache);
 }
 
 void jsrEnsureStack(JStarVM* vm, size_t needed) {
@@ -437,7 +472,7 @@ bool jsrEquals(JStarVM* vm, int slot1, int slot2) {
     if(hashTableGet(&cls->methods, vm->methodSyms[SYM_EQ], &eqOverload)) {
         push(vm, v1);
         push(vm, v2);
-        JStarResult res = jsrCallMethod(vm, "__eq__", 1);
+        JStarResult res = callMethod(vm, vm->methodSyms[SYM_EQ], NULL, 1);
         if(res == JSR_SUCCESS)
             return valueToBool(pop(vm));
         else
@@ -502,7 +537,17 @@ void jsrPushTuple(JStarVM* vm, size_t size) {
 
 void jsrPushTable(JStarVM* vm) {
     validateStack(vm);
-    push(vm, OBJ_VAL(newTable(vm)));
+    push(vm, OBJ_VAL(newTable(vm, 0)));
+}
+
+void jsrPushListCapacity(JStarVM* vm, size_t capacity) {
+    validateStack(vm);
+    push(vm, OBJ_VAL(newList(vm, capacity)));
+}
+
+void jsrPushTableCapacity(JStarVM* vm, size_t capacity) {
+    validateStack(vm);
+    push(vm, OBJ_VAL(newTable(vm, capacity)));
 }
 
 void jsrPushValue(JStarVM* vm, int slot) {
@@ -545,7 +590,7 @@ int jsrTop(JStarVM* vm) {
 void jsrSetGlobal(JStarVM* vm, const char* module, const char* name) {
     ObjModule* mod = module ? getModule(vm, copyString(vm, module, strlen(module))) : vm->module;
     ASSERT(mod, "Module doesn't exist");
-    hashTablePut(&mod->globals, copyString(vm, name, strlen(name)), peek(vm));
+    moduleSetGlobal(mod, copyString(vm, name, strlen(name)), peek(vm));
 }
 
 bool jsrIter(JStarVM* vm, int iterable, int res, bool* err) {
@@ -553,7 +598,7 @@ bool jsrIter(JStarVM* vm, int iterable, int res, bool* err) {
     jsrPushValue(vm, iterable);
     jsrPushValue(vm, res < 0 ? res - 1 : res);
 
-    if(jsrCallMethod(vm, "__iter__", 1) != JSR_SUCCESS) {
+    if(callMethod(vm, vm->methodSyms[SYM_ITER], NULL, 1) != JSR_SUCCESS) {
         return *err = true;
     }
     if(jsrIsNull(vm, -1) || (jsrIsBoolean(vm, -1) && !jsrGetBoolean(vm, -1))) {
@@ -571,7 +616,7 @@ bool jsrIter(JStarVM* vm, int iterable, int res, bool* err) {
 bool jsrNext(JStarVM* vm, int iterable, int res) {
     jsrPushValue(vm, iterable);
     jsrPushValue(vm, res < 0 ? res - 1 : res);
-    if(jsrCallMethod(vm, "__next__", 1) != JSR_SUCCESS) return false;
+    if(callMethod(vm, vm->methodSyms[SYM_NEXT], NULL, 1) != JSR_SUCCESS) return false;
     return true;
 }
 
@@ -581,6 +626,35 @@ void jsrListAppend(JStarVM* vm, int slot) {
     listAppend(vm, AS_LIST(lst), peek(vm));
 }
 
+void jsrListReserve(JStarVM* vm, size_t capacity, int slot) {
+    Value lst = apiStackSlot(vm, slot);
+    ASSERT(IS_LIST(lst), "Not a list");
+    listReserve(vm, AS_LIST(lst), capacity);
+}
+
+void jsrListAppendN(JStarVM* vm, size_t n, int slot) {
+    Value lst = apiStackSlot(vm, slot);
+    ASSERT(IS_LIST(lst), "Not a list");
+    ASSERT((size_t)(vm->sp - vm->apiStack) >= n, "Not enough values on the stack");
+    // The values are kept on the stack while appending, so they stay reachable if the List grows
+    listAppendValues(vm, AS_LIST(lst), vm->sp - n, n);
+    vm->sp -= n;
+}
+
+void jsrListAppendNumbers(JStarVM* vm, const double* nums, size_t count, int slot) {
+    Value lstVal = apiStackSlot(vm, slot);
+    ASSERT(IS_LIST(lstVal), "Not a list");
+    ObjList* lst = AS_LIST(lstVal);
+    // Grow geometrically, so that repeated appends of small buffers stay amortized O(1)
+    if(lst->size + count > lst->capacity) {
+        size_t newCap = lst->capacity * 2;
+        listReserve(vm, lst, newCap > lst->size + count ? newCap : lst->size + count);
+    }
+    for(size_t i = 0; i < count; i++) {
+        lst->arr[lst->size++] = NUM_VAL(nums[i]);
+    }
+}
+
 void jsrListInsert(JStarVM* vm, size_t i, int slot) {
     Value lstVal = apiStackSlot(vm, slot);
     ASSERT(IS_LIST(lstVal), "Not a list");
@@ -664,9 +738,13 @@ bool jsrGetGlobal(JStarVM* vm, const char* module, const char* name) {
     ObjModule* mod = module ? getModule(vm, copyString(vm, module, strlen(module))) : vm->module;
     ASSERT(mod, "Module doesn't exist");
 
+    if(mod->lazy && !resolveLazyModule(vm, mod)) {
+        return false;
+    }
+
     Value res;
     ObjString* nameStr = copyString(vm, name, strlen(name));
-    if(!hashTableGet(&mod->globals, nameStr, &res)) {
+    if(!moduleGetGlobal(mod, nameStr, &res)) {
         jsrRaise(vm, "NameException", "Name %s not definied in module %s.", name, module);
         return false;
     }
@@ -675,6 +753,63 @@ bool jsrGetGlobal(JStarVM* vm, const char* module, const char* name) {
     return true;
 }
 
+JStarSymbol* jsrInternSymbol(JStarVM* vm, const char* name) {
+    ObjString* nameStr = copyString(vm, name, strlen(name));
+
+    JStarSymbol* sym = calloc(1, sizeof(*sym));
+    sym->name = nameStr;
+    sym->next = vm->symbols;
+    if(vm->symbols) vm->symbols->prev = sym;
+    vm->symbols = sym;
+
+    return sym;
+}
+
+void jsrFreeSymbol(JStarVM* vm, JStarSymbol* sym) {
+    if(sym->prev) sym->prev->next = sym->next;
+    else vm->symbols = sym->next;
+    if(sym->next) sym->next->prev = sym->prev;
+    free(sym);
+}
+
+JStarResult jsrCallMethodSym(JStarVM* vm, JStarSymbol* sym, uint8_t argc) {
+    return callMethod(vm, sym->name, &sym->methodCache, argc);
+}
+
+bool jsrSetFieldSym(JStarVM* vm, int slot, JStarSymbol* sym) {
+    push(vm, apiStackSlot(vm, slot));
+    return setFieldCached(vm, sym->name, &sym->setCache);
+}
+
+bool jsrGetFieldSym(JStarVM* vm, int slot, JStarSymbol* sym) {
+    push(vm, apiStackSlot(vm, slot));
+    return getFieldCached(vm, sym->name, &sym->getCache);
+}
+
+bool jsrGetGlobalSym(JStarVM* vm, const char* module, JStarSymbol* sym) {
+    // Globals never change slot, so only the module has to be checked
+    ObjModule* mod = sym->module;
+    if(mod == NULL || (module ? strcmp(mod->name->data, module) != 0 : mod != vm->module)) {
+        mod = module ? getModule(vm, copyString(vm, module, strlen(module))) : vm->module;
+        ASSERT(mod, "Module doesn't exist");
+
+        if(mod->lazy && !resolveLazyModule(vm, mod)) {
+            return false;
+        }
+
+        if(!moduleGetSlot(mod, sym->name, &sym->globalSlot)) {
+            sym->module = NULL;
+            jsrRaise(vm, "NameException", "Name %s not definied in module %s.", sym->name->data,
+                     mod->name->data);
+            return false;
+        }
+        sym->module = mod;
+    }
+
+    push(vm, mod->globals.arr[sym->globalSlot]);
+    return true;
+}
+
 void jsrBindNative(JStarVM* vm, int clsSlot, int natSlot) {
     Value cls = apiStackSlot(vm, clsSlot);
     Value nat = apiStackSlot(vm, natSlot);
@@ -688,6 +823,14 @@ void* jsrGetUserdata(JStarVM* vm, int slot) {
     return (void*)AS_USERDATA(apiStackSlot(vm, slot))->data;
 }
 
+void* jsrGetArray(JStarVM* vm, int slot, JStarArrayType* type, size_t* length) {
+    ASSERT(IS_ARRAY(apiStackSlot(vm, slot)), "slot is not a numeric array");
+    ObjArray* arr = AS_ARRAY(apiStackSlot(vm, slot));
+    if(type) *type = arr->type;
+    if(length) *length = arr->length;
+    return arr->data;
+}
+
 double jsrGetNumber(JStarVM* vm, int slot) {
     ASSERT(IS_NUM(apiStackSlot(vm, slot)), "slot is not a Number");
     return AS_NUM(apiStackSlot(vm, slot));
@@ -695,7 +838,7 @@ double jsrGetNumber(JStarVM* vm, int slot) {
 
 const char* jsrGetString(JStarVM* vm, int slot) {
     ASSERT(IS_STRING(apiStackSlot(vm, slot)), "slot is not a String");
-    return AS_STRING(apiStackSlot(vm, slot))->data;
+    return stringCString(vm, AS_STRING(apiStackSlot(vm, slot)));
 }
 
 size_t jsrGetStringSz(JStarVM* vm, int slot) {
@@ -763,6 +906,11 @@ bool jsrIsUserdata(JStarVM* vm, int slot) {
     return IS_USERDATA(val);
 }
 
+bool jsrIsArray(JStarVM* vm, int slot) {
+    Value val = apiStackSlot(vm, slot);
+    return IS_ARRAY(val);
+}
+
 bool jsrCheckNumber(JStarVM* vm, int slot, const char* name) {
     if(!jsrIsNumber(vm, slot)) JSR_RAISE(vm, "TypeException", "%s must be a number.", name);
     return true;
@@ -818,6 +966,11 @@ bool jsrCheckUserdata(JStarVM* vm, int slot, const char* name) {
     return true;
 }
 
+bool jsrCheckArray(JStarVM* vm, int slot, const char* name) {
+    if(!jsrIsArray(vm, slot)) JSR_RAISE(vm, "TypeException", "%s must be a numeric array.", name);
+    return true;
+}
+
 size_t jsrCheckIndexNum(JStarVM* vm, double i, size_t max) {
     if(i >= 0 && i < max) return (size_t)i;
     jsrRaise(vm, "IndexOutOfBoundException", "%g.", i);
@@ -16,9 +16,14 @@
 // has enough stack space for it.
 #define MAX_REENTRANT 1000
 
-// Maximum number of nested try-excepts allowed.
-// Increasing this value will enable nesting more try-excepts, but the memory consuption will be
-// increased for each stack frame, leading to an overall increase in memory usage by the VM.
-#define MAX_HANDLERS 6
+// Maximum number of fields an instance can have while sharing the layout of its class.
+// Instances going over this limit switch to a dictionary representation of their fields, which is
+// slower to access but doesn't have to be described by a shape of the class.
+#define MAX_SHAPE_FIELDS 64
+
+// Maximum number of shapes a class can have.
+// Classes whose instances have very irregular field patterns generate a lot of shapes. Once this
+// limit is reached, instances that would require a new shape switch to dictionary mode instead.
+#define MAX_CLASS_SHAPES 256
 
 #endif
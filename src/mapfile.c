@@ -0,0 +1,81 @@
+#include "mapfile.h"
+
+#include "conf.h"
+
+#if defined(JSTAR_POSIX)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#elif defined(JSTAR_WINDOWS)
+    #include <Windows.h>
+#endif
+
+#if defined(JSTAR_POSIX)
+
+bool mapFile(const char* path, MappedFile* out) {
+    int fd = open(path, O_RDONLY);
+    if(fd == -1) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) return false;
+
+    *out = (MappedFile){data, st.st_size};
+    return true;
+}
+
+void unmapFile(MappedFile* file) {
+    munmap(file->data, file->size);
+    *file = (MappedFile){0};
+}
+
+#elif defined(JSTAR_WINDOWS)
+
+bool mapFile(const char* path, MappedFile* out) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping == NULL) return false;
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if(data == NULL) return false;
+
+    *out = (MappedFile){data, (size_t)size.QuadPart};
+    return true;
+}
+
+void unmapFile(MappedFile* file) {
+    UnmapViewOfFile(file->data);
+    *file = (MappedFile){0};
+}
+
+#else
+
+bool mapFile(const char* path, MappedFile* out) {
+    (void)path, (void)out;
+    return false;
+}
+
+void unmapFile(MappedFile* file) {
+    *file = (MappedFile){0};
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A whole file mapped in memory.
+// Pages are private to the process: they are shared with other processes mapping the same file
+// until written, and writes are never carried through to the file.
+typedef struct MappedFile {
+    void* data;
+    size_t size;
+} MappedFile;
+
+// Maps the file at `path`. Returns false if the file cannot be opened or mapped, or if the
+// platform doesn't support memory mapped files, in which case it should be read instead
+bool mapFile(const char* path, MappedFile* out);
+void unmapFile(MappedFile* file);
+
+#endif
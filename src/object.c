@@ -1,10 +1,13 @@
 #include "object.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "ctrlgroup.h"
 #include "dynload.h"
 #include "gc.h"
+#include "jstar_limits.h"
 #include "util.h"
 #include "vm.h"
 
@@ -15,17 +18,27 @@
 #define LIST_DEFAULT_CAPACITY 8
 #define LIST_GROW_RATE        2
 
+#define FIELDS_DEFAULT_CAPACITY 4
+#define FIELDS_GROW_RATE        2
+
+#define CHUNK_MIN_LENGTH 64
+#define CHUNK_GROW_RATE  2
+
 // -----------------------------------------------------------------------------
 // OBJECT ALLOCATION FUNCTIONS
 // -----------------------------------------------------------------------------
 
 static Obj* newObj(JStarVM* vm, size_t size, ObjClass* cls, ObjType type) {
-    Obj* o = GC_ALLOC(vm, size);
+    Obj* o = gcAllocObject(vm, size);
     o->cls = cls;
     o->type = type;
     o->reached = false;
+    o->remembered = false;
     o->next = vm->objects;
     vm->objects = o;
+    vm->gcStats.allocations[type]++;
+    vm->gcStats.bytes[type] += size;
+    vm->gcStats.live[type]++;
     return o;
 }
 
@@ -42,6 +55,10 @@ static void initProto(Prototype* proto, ObjModule* m, uint8_t args, Value* defau
     proto->defaults = defaults;
     proto->defCount = defCount;
     proto->vararg = varg;
+#ifdef JSTAR_OPCODE_STATS
+    proto->calls = 0;
+    proto->selfTime = 0;
+#endif
 }
 
 static void zeroValueArray(Value* arr, size_t count) {
@@ -62,6 +79,8 @@ ObjFunction* newFunction(JStarVM* vm, ObjModule* m, uint8_t args, uint8_t defCou
     ObjFunction* fun = (ObjFunction*)newObj(vm, sizeof(*fun), vm->funClass, OBJ_FUNCTION);
     initProto(&fun->proto, m, args, defaults, defCount, varg);
     fun->upvalueCount = 0;
+    fun->lazy = (LazyBody){0};
+    fun->closure = NULL;
     initCode(&fun->code);
     return fun;
 }
@@ -70,13 +89,39 @@ ObjNative* newNative(JStarVM* vm, ObjModule* m, uint8_t args, uint8_t defCount,
     Value* defaults = allocateDefaultArray(vm, defCount);
     ObjNative* native = (ObjNative*)newObj(vm, sizeof(*native), vm->funClass, OBJ_NATIVE);
     initProto(&native->proto, m, args, defaults, defCount, varg);
+    native->fn = NULL;
+    native->leaf = false;
     return native;
 }
 
+static Shape* newShape(size_t fieldCount) {
+    Shape* s = malloc(sizeof(*s));
+    s->fieldCount = fieldCount;
+    initHashTable(&s->slots);
+    initHashTable(&s->transitions);
+    return s;
+}
+
+static void freeShape(Shape* s) {
+    if(s->transitions.entries != NULL) {
+        for(size_t i = 0; i <= s->transitions.sizeMask; i++) {
+            Entry* e = &s->transitions.entries[i];
+            if(e->key != NULL) freeShape(AS_HANDLE(e->value));
+        }
+    }
+    freeHashTable(&s->slots);
+    freeHashTable(&s->transitions);
+    free(s);
+}
+
 ObjClass* newClass(JStarVM* vm, ObjString* name, ObjClass* superCls) {
     ObjClass* cls = (ObjClass*)newObj(vm, sizeof(*cls), vm->clsClass, OBJ_CLASS);
     cls->name = name;
     cls->superCls = superCls;
+    cls->shape = newShape(0);
+    cls->shapeCount = 1;
+    cls->fieldsHint = 0;
+    cls->noStacktrace = false;
     initHashTable(&cls->methods);
     return cls;
 }
@@ -89,26 +134,36 @@ ObjModule* newModule(JStarVM* vm, const char* path, ObjString* name) {
     mod->path = NULL;
     mod->natives.dynlib = NULL;
     mod->natives.registry = NULL;
-    initHashTable(&mod->globals);
+    mod->mapping = (MappedFile){0};
+    mod->lazy = false;
+    mod->importTime = 0;
+    mod->importSelfTime = 0;
+    initHashTable(&mod->globalNames);
+    initValueArray(&mod->globals);
     
     // Implicitly import core
     if(vm->core) {
-        hashTableMerge(&mod->globals, &vm->core->globals);
+        moduleMergeGlobals(mod, vm->core);
     }
 
     // Set builtin names for the module object
-    mod->path = copyString(vm, path, strlen(path));
-    hashTablePut(&mod->globals, copyString(vm, MOD_PATH, strlen(MOD_PATH)), OBJ_VAL(mod->path));
-    hashTablePut(&mod->globals, copyString(vm, MOD_NAME, strlen(MOD_NAME)), OBJ_VAL(mod->name));
-    hashTablePut(&mod->globals, copyString(vm, MOD_THIS, strlen(MOD_THIS)), OBJ_VAL(mod));
+    moduleSetPath(vm, mod, path);
+    moduleSetGlobal(mod, copyString(vm, MOD_NAME, strlen(MOD_NAME)), OBJ_VAL(mod->name));
+    moduleSetGlobal(mod, copyString(vm, MOD_THIS, strlen(MOD_THIS)), OBJ_VAL(mod));
     pop(vm);
 
     return mod;
 }
 
 ObjInstance* newInstance(JStarVM* vm, ObjClass* cls) {
-    ObjInstance* inst = (ObjInstance*)newObj(vm, sizeof(*inst), cls, OBJ_INST);
-    initHashTable(&inst->fields);
+    size_t inlineCapacity = cls->fieldsHint;
+    ObjInstance* inst = (ObjInstance*)newVarObj(vm, sizeof(*inst), sizeof(Value), inlineCapacity,
+                                                cls, OBJ_INST);
+    inst->shape = cls->shape;
+    inst->capacity = inlineCapacity;
+    inst->fields = inst->inlineFields;
+    inst->dict = NULL;
+    inst->inlineCapacity = inlineCapacity;
     return inst;
 }
 
@@ -129,6 +184,19 @@ ObjUpvalue* newUpvalue(JStarVM* vm, Value* addr) {
     return upvalue;
 }
 
+ObjGenerator* newGenerator(JStarVM* vm, ObjClosure* closure) {
+    ObjGenerator* gen = (ObjGenerator*)newObj(vm, sizeof(*gen), vm->genClass, OBJ_GENERATOR);
+    gen->closure = closure;
+    gen->state = GEN_SUSPENDED;
+    gen->ip = NULL;
+    gen->lastYield = NULL_VAL;
+    gen->stack = NULL;
+    gen->stackSize = gen->stackCapacity = 0;
+    gen->upvalues = NULL;
+    gen->upvalueCount = gen->upvalueCapacity = 0;
+    return gen;
+}
+
 ObjBoundMethod* newBoundMethod(JStarVM* vm, Value bound, Obj* method) {
     ObjBoundMethod* bm = (ObjBoundMethod*)newObj(vm, sizeof(*bm), vm->funClass, OBJ_BOUND_METHOD);
     bm->bound = bound;
@@ -142,6 +210,7 @@ ObjTuple* newTuple(JStarVM* vm, size_t size) {
                                            OBJ_TUPLE);
     zeroValueArray(tuple->arr, size);
     tuple->size = size;
+    tuple->hash = 0;
     return tuple;
 }
 
@@ -155,6 +224,7 @@ ObjUserdata* newUserData(JStarVM* vm, size_t size, void (*finalize)(void*)) {
 
 ObjStackTrace* newStackTrace(JStarVM* vm) {
     ObjStackTrace* st = (ObjStackTrace*)newObj(vm, sizeof(*st), vm->stClass, OBJ_STACK_TRACE);
+    st->capture = true;
     st->lastTracedFrame = -1;
     st->recordCapacity = 0;
     st->recordSize = 0;
@@ -162,6 +232,12 @@ ObjStackTrace* newStackTrace(JStarVM* vm) {
     return st;
 }
 
+ObjWeakRef* newWeakRef(JStarVM* vm, Value referent) {
+    ObjWeakRef* ref = (ObjWeakRef*)newObj(vm, sizeof(*ref), vm->weakRefClass, OBJ_WEAKREF);
+    ref->referent = referent;
+    return ref;
+}
+
 ObjList* newList(JStarVM* vm, size_t capacity) {
     Value* arr = NULL;
     if(capacity > 0) arr = GC_ALLOC(vm, sizeof(Value) * capacity);
@@ -172,28 +248,83 @@ ObjList* newList(JStarVM* vm, size_t capacity) {
     return lst;
 }
 
-ObjTable* newTable(JStarVM* vm) {
+ObjArray* newArray(JStarVM* vm, ObjClass* cls, JStarArrayType type, size_t length) {
+    size_t size = arrayElemSize(type) * length;
+    ObjArray* arr = (ObjArray*)newVarObj(vm, sizeof(*arr), sizeof(uint8_t), size, cls, OBJ_ARRAY);
+    memset(arr->storage, 0, size);
+    arr->type = type;
+    arr->length = length;
+    arr->data = arr->storage;
+    arr->owner = NULL;
+    arr->size = size;
+    return arr;
+}
+
+ObjArray* newArrayView(JStarVM* vm, ObjArray* arr, size_t start, size_t length) {
+    ObjArray* view = (ObjArray*)newObj(vm, sizeof(*view), arr->base.cls, OBJ_ARRAY);
+    view->type = arr->type;
+    view->length = length;
+    view->data = (uint8_t*)arr->data + arrayElemSize(arr->type) * start;
+    view->owner = arr->owner ? arr->owner : arr;
+    view->size = 0;
+    return view;
+}
+
+ObjTable* newTable(JStarVM* vm, size_t capacity) {
+    TableEntry* entries = NULL;
+    uint8_t* ctrl = NULL;
+    size_t tableCap = 0;
+
+    if(capacity > 0) {
+        // Smallest power of two number of slots that holds `capacity` entries without exceeding
+        // the 75% maximum load factor of Tables
+        tableCap = GROUP_WIDTH;
+        while((tableCap >> 1) + (tableCap >> 2) < capacity) {
+            tableCap *= 2;
+        }
+
+        entries = GC_ALLOC(vm, sizeof(TableEntry) * capacity);
+        ctrl = GC_ALLOC(vm, TABLE_INDEX_SIZE(tableCap));
+        memset(ctrl, CTRL_EMPTY, tableCap);
+    }
+
     ObjTable* table = (ObjTable*)newObj(vm, sizeof(*table), vm->tableClass, OBJ_TABLE);
-    table->capacityMask = 0;
+    table->weak = false;
+    table->capacityMask = tableCap ? tableCap - 1 : 0;
+    table->entryCapacity = capacity;
     table->numEntries = 0;
     table->size = 0;
-    table->entries = NULL;
+    table->entries = entries;
+    table->ctrl = ctrl;
+    table->index = ctrl ? (uint32_t*)(ctrl + tableCap) : NULL;
     return table;
 }
 
 ObjString* allocateString(JStarVM* vm, size_t length) {
-    char* data = GC_ALLOC(vm, length + 1);
-    ObjString* str = (ObjString*)newObj(vm, sizeof(*str), vm->strClass, OBJ_STRING);
+    ObjString* str = (ObjString*)newVarObj(vm, sizeof(*str), sizeof(char), length + 1,
+                                           vm->strClass, OBJ_STRING);
     str->length = length;
     str->hash = 0;
     str->interned = false;
-    str->data = data;
+    str->data = str->inlineData;
+    str->chunk = NULL;
     str->data[str->length] = '\0';
     return str;
 }
 
-ObjString* copyString(JStarVM* vm, const char* str, size_t length) {
+static uint32_t hashString(const char* str, size_t length) {
     uint32_t hash = hashBytes(str, length);
+    return hash ? hash : hash + 1;  // Reserve hash value `0`
+}
+
+ObjString* copyString(JStarVM* vm, const char* str, size_t length) {
+    if(length > vm->maxInternedLength) {
+        ObjString* s = allocateString(vm, length);
+        memcpy(s->data, str, length);
+        return s;
+    }
+
+    uint32_t hash = hashString(str, length);
     ObjString* interned = hashTableGetString(&vm->stringPool, str, length, hash);
     if(interned == NULL) {
         interned = allocateString(vm, length);
@@ -206,67 +337,86 @@ ObjString* copyString(JStarVM* vm, const char* str, size_t length) {
 }
 
 void freeObject(JStarVM* vm, Obj* o) {
+    vm->gcStats.live[o->type]--;
     switch(o->type) {
     case OBJ_STRING: {
         ObjString* s = (ObjString*)o;
-        GC_FREE_ARRAY(vm, char, s->data, s->length + 1);
-        GC_FREE(vm, ObjString, s);
+        if(STRING_IS_INLINE(s)) {
+            GC_FREE_VAR_OBJ(vm, ObjString, char, s->length + 1, s);
+            break;
+        }
+        if(s->chunk == NULL) {
+            GC_FREE_ARRAY(vm, char, s->data, s->length + 1);
+        } else if(--s->chunk->refs == 0) {
+            GC_FREE_VAR(vm, StringChunk, char, s->chunk->capacity, s->chunk);
+        }
+        GC_FREE_OBJ(vm, ObjString, s);
         break;
     }
     case OBJ_NATIVE: {
         ObjNative* n = (ObjNative*)o;
         GC_FREE_ARRAY(vm, Value, n->proto.defaults, n->proto.defCount);
-        GC_FREE(vm, ObjNative, n);
+        GC_FREE_OBJ(vm, ObjNative, n);
         break;
     }
     case OBJ_FUNCTION: {
         ObjFunction* f = (ObjFunction*)o;
         freeCode(&f->code);
         GC_FREE_ARRAY(vm, Value, f->proto.defaults, f->proto.defCount);
-        GC_FREE(vm, ObjFunction, f);
+        GC_FREE_OBJ(vm, ObjFunction, f);
         break;
     }
     case OBJ_CLASS: {
         ObjClass* cls = (ObjClass*)o;
         freeHashTable(&cls->methods);
-        GC_FREE(vm, ObjClass, cls);
+        freeShape(cls->shape);
+        GC_FREE_OBJ(vm, ObjClass, cls);
         break;
     }
     case OBJ_INST: {
         ObjInstance* i = (ObjInstance*)o;
-        freeHashTable(&i->fields);
-        GC_FREE(vm, ObjInstance, i);
+        if(i->fields != i->inlineFields) {
+            free(i->fields);
+        }
+        if(i->dict != NULL) {
+            freeHashTable(i->dict);
+            free(i->dict);
+        }
+        GC_FREE_VAR_OBJ(vm, ObjInstance, Value, i->inlineCapacity, i);
         break;
     }
     case OBJ_MODULE: {
         ObjModule* m = (ObjModule*)o;
-        freeHashTable(&m->globals);
+        freeHashTable(&m->globalNames);
+        freeValueArray(&m->globals);
         if(m->natives.dynlib) dynfree(m->natives.dynlib);
-        GC_FREE(vm, ObjModule, m);
+        if(m->mapping.data) unmapFile(&m->mapping);
+        GC_FREE_OBJ(vm, ObjModule, m);
         break;
     }
     case OBJ_BOUND_METHOD: {
         ObjBoundMethod* b = (ObjBoundMethod*)o;
-        GC_FREE(vm, ObjBoundMethod, b);
+        GC_FREE_OBJ(vm, ObjBoundMethod, b);
         break;
     }
     case OBJ_LIST: {
         ObjList* l = (ObjList*)o;
         GC_FREE_ARRAY(vm, Value, l->arr, l->capacity);
-        GC_FREE(vm, ObjList, l);
+        GC_FREE_OBJ(vm, ObjList, l);
         break;
     }
     case OBJ_TUPLE: {
         ObjTuple* t = (ObjTuple*)o;
-        GC_FREE_VAR(vm, ObjTuple, Value, t->size, t);
+        GC_FREE_VAR_OBJ(vm, ObjTuple, Value, t->size, t);
         break;
     }
     case OBJ_TABLE: {
         ObjTable* t = (ObjTable*)o;
         if(t->entries != NULL) {
-            GC_FREE_ARRAY(vm, TableEntry, t->entries, t->capacityMask + 1);
+            GC_FREE_ARRAY(vm, TableEntry, t->entries, t->entryCapacity);
+            GC_FREE_ARRAY(vm, uint8_t, t->ctrl, TABLE_INDEX_SIZE(t->capacityMask + 1));
         }
-        GC_FREE(vm, ObjTable, t);
+        GC_FREE_OBJ(vm, ObjTable, t);
         break;
     }
     case OBJ_STACK_TRACE: {
@@ -274,23 +424,40 @@ void freeObject(JStarVM* vm, Obj* o) {
         if(st->records != NULL) {
             GC_FREE_ARRAY(vm, FrameRecord, st->records, st->recordCapacity);
         }
-        GC_FREE(vm, ObjStackTrace, st);
+        GC_FREE_OBJ(vm, ObjStackTrace, st);
         break;
     }
     case OBJ_CLOSURE: {
         ObjClosure* closure = (ObjClosure*)o;
-        GC_FREE_VAR(vm, ObjClosure, ObjUpvalue*, closure->upvalueCount, o);
+        GC_FREE_VAR_OBJ(vm, ObjClosure, ObjUpvalue*, closure->upvalueCount, o);
         break;
     }
     case OBJ_UPVALUE: {
         ObjUpvalue* upvalue = (ObjUpvalue*)o;
-        GC_FREE(vm, ObjUpvalue, upvalue);
+        GC_FREE_OBJ(vm, ObjUpvalue, upvalue);
         break;
     }
     case OBJ_USERDATA: {
         ObjUserdata* udata = (ObjUserdata*)o;
         if(udata->finalize) udata->finalize((void*)udata->data);
-        GC_FREE_VAR(vm, ObjUserdata, uint8_t, udata->size, udata);
+        GC_FREE_VAR_OBJ(vm, ObjUserdata, uint8_t, udata->size, udata);
+        break;
+    }
+    case OBJ_ARRAY: {
+        ObjArray* arr = (ObjArray*)o;
+        GC_FREE_VAR_OBJ(vm, ObjArray, uint8_t, arr->size, arr);
+        break;
+    }
+    case OBJ_GENERATOR: {
+        ObjGenerator* gen = (ObjGenerator*)o;
+        GC_FREE_ARRAY(vm, Value, gen->stack, gen->stackCapacity);
+        GC_FREE_ARRAY(vm, SavedUpvalue, gen->upvalues, gen->upvalueCapacity);
+        GC_FREE_OBJ(vm, ObjGenerator, gen);
+        break;
+    }
+    case OBJ_WEAKREF: {
+        ObjWeakRef* ref = (ObjWeakRef*)o;
+        GC_FREE_OBJ(vm, ObjWeakRef, ref);
         break;
     }
     }
@@ -306,6 +473,23 @@ static void growList(JStarVM* vm, ObjList* lst) {
     lst->capacity = newCap;
 }
 
+void listReserve(JStarVM* vm, ObjList* lst, size_t capacity) {
+    if(capacity <= lst->capacity) return;
+    lst->arr = gcAlloc(vm, lst->arr, sizeof(Value) * lst->capacity, sizeof(Value) * capacity);
+    lst->capacity = capacity;
+}
+
+void listAppendValues(JStarVM* vm, ObjList* lst, const Value* vals, size_t count) {
+    if(count == 0) return;
+    if(lst->size + count > lst->capacity) {
+        size_t newCap = lst->capacity * LIST_GROW_RATE;
+        listReserve(vm, lst, newCap > lst->size + count ? newCap : lst->size + count);
+    }
+    memcpy(lst->arr + lst->size, vals, sizeof(Value) * count);
+    lst->size += count;
+    GC_WRITE_BARRIER(vm, lst);
+}
+
 void listAppend(JStarVM* vm, ObjList* lst, Value val) {
     // if the list get resized a GC may kick in, so push val as root
     if(lst->size + 1 > lst->capacity) {
@@ -314,6 +498,7 @@ void listAppend(JStarVM* vm, ObjList* lst, Value val) {
         pop(vm);
     }
     lst->arr[lst->size++] = val;
+    GC_WRITE_BARRIER(vm, lst);
 }
 
 void listInsert(JStarVM* vm, ObjList* lst, size_t index, Value val) {
@@ -331,6 +516,7 @@ void listInsert(JStarVM* vm, ObjList* lst, size_t index, Value val) {
 
     arr[index] = val;
     lst->size++;
+    GC_WRITE_BARRIER(vm, lst);
 }
 
 void listRemove(JStarVM* vm, ObjList* lst, size_t index) {
@@ -341,10 +527,234 @@ void listRemove(JStarVM* vm, ObjList* lst, size_t index) {
     lst->size--;
 }
 
+size_t arrayElemSize(JStarArrayType type) {
+    switch(type) {
+    case JSR_ARRAY_FLOAT64:
+        return sizeof(double);
+    case JSR_ARRAY_INT32:
+        return sizeof(int32_t);
+    case JSR_ARRAY_UINT8:
+        return sizeof(uint8_t);
+    }
+    UNREACHABLE();
+    return 0;
+}
+
+double arrayGet(const ObjArray* arr, size_t index) {
+    switch(arr->type) {
+    case JSR_ARRAY_FLOAT64:
+        return ((double*)arr->data)[index];
+    case JSR_ARRAY_INT32:
+        return ((int32_t*)arr->data)[index];
+    case JSR_ARRAY_UINT8:
+        return ((uint8_t*)arr->data)[index];
+    }
+    UNREACHABLE();
+    return 0;
+}
+
+static int32_t toInt32(double num) {
+    // NaN fails both comparisons
+    if(num >= INT32_MIN && num <= INT32_MAX) return (int32_t)num;
+    if(isinf(num)) return 0;
+    double wrapped = fmod(trunc(num), 4294967296.0);
+    if(wrapped < 0) wrapped += 4294967296.0;
+    return (int32_t)(uint32_t)wrapped;
+}
+
+double arrayConvert(JStarArrayType type, double num) {
+    switch(type) {
+    case JSR_ARRAY_FLOAT64:
+        return num;
+    case JSR_ARRAY_INT32:
+        return toInt32(num);
+    case JSR_ARRAY_UINT8:
+        return (uint8_t)toInt32(num);
+    }
+    UNREACHABLE();
+    return 0;
+}
+
+void arraySet(ObjArray* arr, size_t index, double num) {
+    switch(arr->type) {
+    case JSR_ARRAY_FLOAT64:
+        ((double*)arr->data)[index] = num;
+        break;
+    case JSR_ARRAY_INT32:
+        ((int32_t*)arr->data)[index] = toInt32(num);
+        break;
+    case JSR_ARRAY_UINT8:
+        ((uint8_t*)arr->data)[index] = (uint8_t)toInt32(num);
+        break;
+    }
+}
+
+bool shapeGetSlot(Shape* s, ObjString* name, size_t* slot) {
+    Value v;
+    if(!hashTableGet(&s->slots, name, &v)) {
+        return false;
+    }
+    *slot = (size_t)AS_NUM(v);
+    return true;
+}
+
+static Shape* shapeTransition(ObjClass* cls, Shape* s, ObjString* name) {
+    Value next;
+    if(hashTableGet(&s->transitions, name, &next)) {
+        return AS_HANDLE(next);
+    }
+
+    if(s->fieldCount == MAX_SHAPE_FIELDS || cls->shapeCount == MAX_CLASS_SHAPES) {
+        return NULL;
+    }
+
+    Shape* n = newShape(s->fieldCount + 1);
+    hashTableMerge(&n->slots, &s->slots);
+    hashTablePut(&n->slots, name, NUM_VAL(s->fieldCount));
+    hashTablePut(&s->transitions, name, HANDLE_VAL(n));
+    cls->shapeCount++;
+
+    return n;
+}
+
+static void instanceToDictMode(ObjInstance* inst) {
+    Shape* s = inst->shape;
+    HashTable* dict = malloc(sizeof(*dict));
+    initHashTable(dict);
+
+    if(s->slots.entries != NULL) {
+        for(size_t i = 0; i <= s->slots.sizeMask; i++) {
+            Entry* e = &s->slots.entries[i];
+            if(e->key != NULL) {
+                hashTablePut(dict, e->key, inst->fields[(size_t)AS_NUM(e->value)]);
+            }
+        }
+    }
+
+    if(inst->fields != inst->inlineFields) {
+        free(inst->fields);
+    }
+
+    inst->shape = NULL;
+    inst->fields = inst->inlineFields;
+    inst->capacity = inst->inlineCapacity;
+    inst->dict = dict;
+}
+
+void instanceAddField(ObjInstance* inst, Shape* next, Value val) {
+    size_t slot = inst->shape->fieldCount;
+
+    if(next->fieldCount > inst->capacity) {
+        size_t newCap = inst->capacity ? inst->capacity * FIELDS_GROW_RATE : FIELDS_DEFAULT_CAPACITY;
+        if(newCap > MAX_SHAPE_FIELDS) newCap = MAX_SHAPE_FIELDS;
+
+        if(inst->fields == inst->inlineFields) {
+            inst->fields = malloc(sizeof(Value) * newCap);
+            memcpy(inst->fields, inst->inlineFields, sizeof(Value) * slot);
+        } else {
+            inst->fields = realloc(inst->fields, sizeof(Value) * newCap);
+        }
+        inst->capacity = newCap;
+    }
+
+    inst->fields[slot] = val;
+    inst->shape = next;
+
+    // Size the inline storage of new instances after the biggest one seen so far
+    ObjClass* cls = inst->base.cls;
+    if(next->fieldCount > cls->fieldsHint) {
+        cls->fieldsHint = next->fieldCount;
+    }
+}
+
+bool moduleGetSlot(ObjModule* mod, ObjString* name, size_t* slot) {
+    Value idx;
+    if(!hashTableGet(&mod->globalNames, name, &idx)) {
+        return false;
+    }
+    *slot = (size_t)AS_NUM(idx);
+    return true;
+}
+
+bool moduleGetGlobal(ObjModule* mod, ObjString* name, Value* out) {
+    size_t slot;
+    if(!moduleGetSlot(mod, name, &slot)) {
+        return false;
+    }
+    *out = mod->globals.arr[slot];
+    return true;
+}
+
+bool moduleSetGlobal(ObjModule* mod, ObjString* name, Value val) {
+    size_t slot;
+    if(moduleGetSlot(mod, name, &slot)) {
+        mod->globals.arr[slot] = val;
+        return false;
+    }
+
+    int newSlot = valueArrayAppend(&mod->globals, val);
+    hashTablePut(&mod->globalNames, name, NUM_VAL(newSlot));
+    return true;
+}
+
+void moduleMergeGlobals(ObjModule* mod, ObjModule* o) {
+    const HashTable* names = &o->globalNames;
+    for(const Entry* e = names->entries; e < names->entries + names->sizeMask + 1; e++) {
+        if(e->key) {
+            moduleSetGlobal(mod, e->key, o->globals.arr[(size_t)AS_NUM(e->value)]);
+        }
+    }
+}
+
+void moduleSetPath(JStarVM* vm, ObjModule* mod, const char* path) {
+    mod->path = copyString(vm, path, strlen(path));
+    moduleSetGlobal(mod, copyString(vm, MOD_PATH, strlen(MOD_PATH)), OBJ_VAL(mod->path));
+}
+
+bool instanceGetField(ObjInstance* inst, ObjString* name, Value* out) {
+    if(inst->shape == NULL) {
+        return hashTableGet(inst->dict, name, out);
+    }
+
+    size_t slot;
+    if(!shapeGetSlot(inst->shape, name, &slot)) {
+        return false;
+    }
+
+    *out = inst->fields[slot];
+    return true;
+}
+
+void instanceSetField(ObjInstance* inst, ObjString* name, Value val) {
+    if(inst->shape != NULL) {
+        size_t slot;
+        if(shapeGetSlot(inst->shape, name, &slot)) {
+            inst->fields[slot] = val;
+            return;
+        }
+
+        Shape* next = shapeTransition(inst->base.cls, inst->shape, name);
+        if(next != NULL) {
+            instanceAddField(inst, next, val);
+            return;
+        }
+
+        instanceToDictMode(inst);
+    }
+
+    hashTablePut(inst->dict, name, val);
+}
+
+bool instanceHasField(ObjInstance* inst, ObjString* name) {
+    if(inst->shape == NULL) {
+        return hashTableContainsKey(inst->dict, name);
+    }
+    return hashTableContainsKey(&inst->shape->slots, name);
+}
+
 uint32_t stringGetHash(ObjString* str) {
     if(str->hash == 0) {
-        uint32_t hash = hashBytes(str->data, str->length);
-        str->hash = hash ? hash : hash + 1;  // Reserve hash value `0`
+        str->hash = hashString(str->data, str->length);
     }
     return str->hash;
 }
@@ -354,8 +764,64 @@ bool stringEquals(ObjString* s1, ObjString* s2) {
     return s1->length == s2->length && memcmp(s1->data, s2->data, s1->length) == 0;
 }
 
+ObjString* stringConcat(JStarVM* vm, ObjString* s1, ObjString* s2) {
+    size_t length = s1->length + s2->length;
+    StringChunk* chunk = s1->chunk;
+
+    if(chunk && !chunk->pinned && chunk->length == s1->length && length < chunk->capacity) {
+        // `s1` is the longest String in its chunk, so the bytes past its end are free
+        memcpy(chunk->data + s1->length, s2->data, s2->length);
+    } else if(length >= CHUNK_MIN_LENGTH) {
+        size_t capacity = length * CHUNK_GROW_RATE;
+        chunk = GC_ALLOC(vm, sizeof(StringChunk) + capacity);
+        chunk->refs = 0;
+        chunk->capacity = capacity;
+        chunk->pinned = false;
+        memcpy(chunk->data, s1->data, s1->length);
+        memcpy(chunk->data + s1->length, s2->data, s2->length);
+    } else {
+        ObjString* conc = allocateString(vm, length);
+        memcpy(conc->data, s1->data, s1->length);
+        memcpy(conc->data + s1->length, s2->data, s2->length);
+        return conc;
+    }
+
+    chunk->length = length;
+    chunk->data[length] = '\0';
+
+    ObjString* conc = (ObjString*)newObj(vm, sizeof(*conc), vm->strClass, OBJ_STRING);
+    conc->length = length;
+    conc->hash = 0;
+    conc->interned = false;
+    conc->data = chunk->data;
+    conc->chunk = chunk;
+    chunk->refs++;
+    return conc;
+}
+
+const char* stringCString(JStarVM* vm, ObjString* str) {
+    if(str->data[str->length] == '\0') {
+        // Only the longest String of a chunk ends at its terminator
+        if(str->chunk && str->chunk->length == str->length) str->chunk->pinned = true;
+        return str->data;
+    }
+
+    char* data = GC_ALLOC(vm, str->length + 1);
+    memcpy(data, str->data, str->length);
+    data[str->length] = '\0';
+
+    StringChunk* chunk = str->chunk;
+    if(--chunk->refs == 0) {
+        GC_FREE_VAR(vm, StringChunk, char, chunk->capacity, chunk);
+    }
+
+    str->data = data;
+    str->chunk = NULL;
+    return str->data;
+}
+
 void stacktraceDump(JStarVM* vm, ObjStackTrace* st, Frame* f, int depth) {
-    if(st->lastTracedFrame == depth) return;
+    if(!st->capture || st->lastTracedFrame == depth) return;
     st->lastTracedFrame = depth;
 
     if(st->recordSize + 1 >= st->recordCapacity) {
@@ -365,8 +831,7 @@ void stacktraceDump(JStarVM* vm, ObjStackTrace* st, Frame* f, int depth) {
     }
 
     FrameRecord* record = &st->records[st->recordSize++];
-    record->funcName = NULL;
-    record->moduleName = NULL;
+    record->tailCalls = f->tailCalls;
 
     switch(f->fn->type) {
     case OBJ_CLOSURE: {
@@ -378,26 +843,50 @@ void stacktraceDump(JStarVM* vm, ObjStackTrace* st, Frame* f, int depth) {
             op = code->size - 1;
         }
 
-        record->line = getBytecodeSrcLine(code, op);
-        record->moduleName = fn->proto.module->name;
-        record->funcName = fn->proto.name;
+        record->fn = (Obj*)fn;
+        record->op = op;
         break;
     }
-    case OBJ_NATIVE: {
-        ObjNative* nat = (ObjNative*)f->fn;
-        record->line = -1;
-        record->moduleName = nat->proto.module->name;
-        record->funcName = nat->proto.name;
+    case OBJ_NATIVE:
+        record->fn = f->fn;
+        record->op = 0;
         break;
-    }
     default:
         UNREACHABLE();
         break;
     }
 
-    if(!record->funcName) {
-        record->funcName = copyString(vm, "<main>", 6);
+    GC_WRITE_BARRIER(vm, st);
+}
+
+FrameInfo stacktraceFrameInfo(const FrameRecord* record) {
+    Prototype* proto;
+    int line = -1;
+
+    switch(record->fn->type) {
+    case OBJ_FUNCTION: {
+        ObjFunction* fn = (ObjFunction*)record->fn;
+        line = getBytecodeSrcLine(&fn->code, record->op);
+        proto = &fn->proto;
+        break;
+    }
+    case OBJ_NATIVE:
+        proto = &((ObjNative*)record->fn)->proto;
+        break;
+    default:
+        UNREACHABLE();
+        return (FrameInfo){0};
+    }
+
+    const char* funcName = proto->name ? proto->name->data : "<main>";
+    return (FrameInfo){line, proto->module->name->data, funcName, record->tailCalls};
+}
+
+bool classCapturesStacktrace(ObjClass* cls) {
+    for(; cls != NULL; cls = cls->superCls) {
+        if(cls->noStacktrace) return false;
     }
+    return true;
 }
 
 Value* getValues(Obj* obj, size_t* size) {
@@ -425,6 +914,7 @@ ObjString* jsrBufferToString(JStarBuffer* b) {
     s->interned = false;
     s->length = b->size;
     s->data = data;
+    s->chunk = NULL;
     s->hash = 0;
     s->data[s->length] = '\0';
     memset(b, 0, sizeof(JStarBuffer));
@@ -439,13 +929,11 @@ JStarBuffer jsrBufferWrap(JStarVM* vm, const void* data, size_t len) {
 // DEBUG FUNCTIONS
 // -----------------------------------------------------------------------------
 
-#ifdef JSTAR_DBG_PRINT_GC
 const char* ObjTypeNames[] = {
     #define ENUM_STRING(elem) #elem,
     OBJTYPE(ENUM_STRING)
     #undef ENUM_STRING
 };
-#endif
 
 static void printEscaped(ObjString* s) {
     const char* escaped = "\0\a\b\f\n\r\t\v\\\"";
@@ -526,7 +1014,7 @@ void printObj(Obj* o) {
         ObjTable* t = (ObjTable*)o;
         printf("{");
         if(t->entries != NULL) {
-            for(size_t i = 0; i < t->capacityMask + 1; i++) {
+            for(size_t i = 0; i < t->numEntries; i++) {
                 if(!IS_NULL(t->entries[i].key)) {
                     printValue(t->entries[i].key);
                     printf(" : ");
@@ -565,5 +1053,14 @@ void printObj(Obj* o) {
     case OBJ_USERDATA:
         printf("<userdata %p", (void*)o);
         break;
+    case OBJ_ARRAY:
+        printf("<array %p>", (void*)o);
+        break;
+    case OBJ_GENERATOR:
+        printf("<generator %p>", (void*)o);
+        break;
+    case OBJ_WEAKREF:
+        printf("<weakref %p>", (void*)o);
+        break;
     }
 }
\ No newline at end of file
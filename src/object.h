@@ -8,13 +8,12 @@
 #include "code.h"
 #include "hashtable.h"
 #include "jstar.h"
+#include "mapfile.h"
 #include "value.h"
 
 struct Frame;
 
-#ifdef JSTAR_DBG_PRINT_GC
 extern const char* ObjTypeNames[];
-#endif
 
 /**
  * Object system of the J* language.
@@ -45,6 +44,9 @@ extern const char* ObjTypeNames[];
 #define IS_STACK_TRACE(o)  (IS_OBJ(o) && AS_OBJ(o)->type == OBJ_STACK_TRACE)
 #define IS_TABLE(o)        (IS_OBJ(o) && AS_OBJ(o)->type == OBJ_TABLE)
 #define IS_USERDATA(o)     (IS_OBJ(o) && AS_OBJ(o)->type == OBJ_USERDATA)
+#define IS_ARRAY(o)        (IS_OBJ(o) && AS_OBJ(o)->type == OBJ_ARRAY)
+#define IS_GENERATOR(o)    (IS_OBJ(o) && AS_OBJ(o)->type == OBJ_GENERATOR)
+#define IS_WEAKREF(o)      (IS_OBJ(o) && AS_OBJ(o)->type == OBJ_WEAKREF)
 
 #define AS_BOUND_METHOD(o) ((ObjBoundMethod*)AS_OBJ(o))
 #define AS_LIST(o)         ((ObjList*)AS_OBJ(o))
@@ -59,6 +61,13 @@ extern const char* ObjTypeNames[];
 #define AS_STACK_TRACE(o)  ((ObjStackTrace*)AS_OBJ(o))
 #define AS_TABLE(o)        ((ObjTable*)AS_OBJ(o))
 #define AS_USERDATA(o)     ((ObjUserdata*)AS_OBJ(o))
+#define AS_ARRAY(o)        ((ObjArray*)AS_OBJ(o))
+#define AS_GENERATOR(o)    ((ObjGenerator*)AS_OBJ(o))
+#define AS_WEAKREF(o)      ((ObjWeakRef*)AS_OBJ(o))
+
+// Whether `v` is referenced weakly when stored in a WeakRef or used as a key of a WeakTable.
+// Only Objects other than Strings are, all the other values are always held strongly
+#define IS_WEAK_REFERENT(v) (IS_OBJ(v) && !IS_STRING(v))
 
 // -----------------------------------------------------------------------------
 // OBJECT DEFINITONS
@@ -83,7 +92,10 @@ extern const char* ObjTypeNames[];
     X(OBJ_UPVALUE)      \
     X(OBJ_TUPLE)        \
     X(OBJ_TABLE)        \
-    X(OBJ_USERDATA)
+    X(OBJ_USERDATA)     \
+    X(OBJ_ARRAY)        \
+    X(OBJ_GENERATOR)    \
+    X(OBJ_WEAKREF)
 
 typedef enum ObjType {
 #define ENUM_ELEM(elem) elem,
@@ -91,6 +103,10 @@ typedef enum ObjType {
 #undef ENUM_ELEM
 } ObjType;
 
+#define COUNT_ELEM(elem) +1
+enum { OBJ_TYPE_COUNT = 0 OBJTYPE(COUNT_ELEM) };
+#undef COUNT_ELEM
+
 // Base class of all the Objects.
 // Defines shared properties of all objects, such as the type and the class
 // field, as well as fields used for garbage collection, such as the reached
@@ -100,22 +116,42 @@ typedef enum ObjType {
 struct Obj {
     ObjType type;          // The type of the object
     bool reached;          // Flag used to signal that an object is reachable during a GC
+    bool remembered;       // Whether the object is in the remembered set of the generational GC
     struct ObjClass* cls;  // The class of the Object
     struct Obj* next;      // Next object in the linked list of all allocated objects
 };
 
+// Storage shared by the Strings produced by repeated concatenation.
+// All the Strings using a chunk are prefixes of its data, and the longest one can be extended in
+// place by a subsequent concatenation without copying its contents.
+// Once the data of the longest String has been handed out as a C string the chunk is pinned and
+// never extended again, as that would overwrite the terminator the C string relies on.
+typedef struct StringChunk {
+    size_t refs;      // Number of Strings using the chunk
+    size_t length;    // Number of bytes in use, i.e. the length of the longest String
+    size_t capacity;  // Size of the data
+    bool pinned;      // Whether the terminator at `length` must be preserved
+    char data[];      // The contents of the Strings (flexible array)
+} StringChunk;
+
 // A J* String. In J* Strings are immutable and can contain arbitrary
 // bytes since we explicitly store the string's length instead of relying on
 // NUL termination. Nevertheless, a NUL byte is appended for ease of use in
 // the C api.
+// The data of Strings created by `allocateString` is stored inline, right after the object.
+// Strings adopting the memory of a JStarBuffer or living in a chunk point to it instead.
 struct ObjString {
     Obj base;
-    size_t length;  // Length of the string
-    uint32_t hash;  // The string's hash (gets calculated once at allocation)
-    bool interned;  // Whether the string is interned or not
-    char* data;     // The actual data of the string (NUL terminated)
+    size_t length;       // Length of the string
+    uint32_t hash;       // The string's hash (gets calculated once at allocation)
+    bool interned;       // Whether the string is interned or not
+    char* data;          // The actual data of the string (NUL terminated, see `stringCString`)
+    StringChunk* chunk;  // The chunk `data` points into, or NULL if the String owns its data
+    char inlineData[];   // Storage of inline Strings (flexible array)
 };
 
+#define STRING_IS_INLINE(s) ((s)->data == (s)->inlineData)
+
 // Native C extension. It contains the handle to the dynamic library and resolved
 // symbol to a native registry.
 typedef struct {
@@ -125,10 +161,15 @@ typedef struct {
 
 typedef struct ObjModule {
     Obj base;
-    ObjString* name;    // Name of the module
-    ObjString* path;    // The path to the module file
-    HashTable globals;  // HashTable containing the global variables of the module
-    NativeExt natives;  // Natives registered in this module
+    ObjString* name;        // Name of the module
+    ObjString* path;        // The path to the module file
+    HashTable globalNames;  // Maps the name of each global variable to its slot in `globals`
+    ValueArray globals;     // The values of the global variables of the module
+    NativeExt natives;      // Natives registered in this module
+    MappedFile mapping;     // Compiled file the bytecode of the module points into (if any)
+    bool lazy;              // Placeholder of a lazy import, not loaded yet (see import.h)
+    double importTime;      // Seconds taken to load and execute the module, if traced
+    double importSelfTime;  // Same as above, excluding the modules it imported
 } ObjModule;
 
 // Fields shared by all function objects (ObjFunction/ObjNative)
@@ -140,33 +181,68 @@ typedef struct {
     Value* defaults;    // Array of default arguments (NULL if no defaults)
     ObjModule* module;  // The module of the function
     ObjString* name;    // The name of the function
+#ifdef JSTAR_OPCODE_STATS
+    uint64_t calls;   // Number of times the function has been called
+    double selfTime;  // Seconds spent executing the function, excluding its callees
+#endif
 } Prototype;
 
 // A compiled J* function
+// Location of the serialized body of a function whose deserialization has been deferred to its
+// first call (see "serialize.h")
+typedef struct LazyBody {
+    const char* data;  // NULL once the body has been loaded
+    size_t size;
+    bool borrowCode;
+} LazyBody;
+
 typedef struct ObjFunction {
     Prototype proto;
-    Code code;             // The actual code chunk containing bytecodes
-    uint8_t upvalueCount;  // The number of upvalues the function closes over
+    Code code;                   // The actual code chunk containing bytecodes
+    uint8_t upvalueCount;        // The number of upvalues the function closes over
+    LazyBody lazy;               // Body still to be deserialized, if any
+    struct ObjClosure* closure;  // Closure shared by all evaluations when there are no upvalues
 } ObjFunction;
 
 // A C function callable from J*
 typedef struct ObjNative {
     Prototype proto;
     JStarNative fn;  // The C function that gets called
+    bool leaf;       // Whether `fn` can be called without a frame (see JStarNativeReg)
 } ObjNative;
 
+// The layout of the fields of an instance. It maps field names to slot indices in the field array
+// of the instance. Instances of a class that get their fields assigned in the same order end up
+// sharing the same Shape. Shapes form a tree rooted in their class, where the children of a node
+// are the shapes obtained by adding a new field to it.
+// Shapes are owned by their class and are not garbage collected objects on their own.
+typedef struct Shape {
+    size_t fieldCount;      // The number of fields described by this shape
+    HashTable slots;        // Maps field names to slot indices
+    HashTable transitions;  // Maps field names to the shape obtained by adding them (as handles)
+} Shape;
+
 // A user defined class
 typedef struct ObjClass {
     Obj base;
     ObjString* name;            // The name of the class
     struct ObjClass* superCls;  // Pointer to the parent class (or NULL)
     HashTable methods;          // HashTable containing methods (ObjFunction/ObjNative)
+    Shape* shape;               // The root shape of the instances of this class
+    size_t shapeCount;          // Number of shapes in the shape tree
+    size_t fieldsHint;          // Number of inline field slots to allocate for new instances
+    bool noStacktrace;          // Whether raising an instance of the class skips trace capture
 } ObjClass;
 
 // An instance of a user defined Class
 typedef struct ObjInstance {
     Obj base;
-    HashTable fields;  // HashTable containing the fields of the instance
+    Shape* shape;           // The shape of the instance, NULL when in dictionary mode
+    size_t capacity;        // The capacity of the `fields` array
+    Value* fields;          // The field values. Points to `inlineFields` until they are outgrown
+    HashTable* dict;        // HashTable containing the fields of the instance in dictionary mode
+    size_t inlineCapacity;  // The number of inline field slots
+    Value inlineFields[];   // Field slots allocated along with the instance (flexible array)
 } ObjInstance;
 
 typedef struct ObjList {
@@ -178,8 +254,9 @@ typedef struct ObjList {
 
 typedef struct ObjTuple {
     Obj base;
-    size_t size;  // Number of elements of the tuple
-    Value arr[];  // Tuple elements (flexible array)
+    size_t size;    // Number of elements of the tuple
+    uint32_t hash;  // Cached hash of a Tuple of Numbers, Strings and Booleans, 0 if not computed
+    Value arr[];    // Tuple elements (flexible array)
 } ObjTuple;
 
 typedef struct {
@@ -187,14 +264,26 @@ typedef struct {
     Value val;  // The actual value
 } TableEntry;
 
+// A Table keeps its entries in a dense array in insertion order, and a separate open addressing
+// index mapping the hash of a key to the position of its entry. Deleted entries are left in the
+// array with a null key and are compacted away when the index is rebuilt.
+// The entries of a weak Table (a WeakTable) are removed by the GC once their key is unreachable;
+// their value is kept alive only as long as the key is (ephemeron semantics, see gc.c).
 typedef struct ObjTable {
     Obj base;
-    size_t capacityMask;  // The size of the entries array
-    size_t numEntries;    // The number of entries in the Table (including tombstones)
-    size_t size;          // The number of actual entries in the Table (i.e. excluding tombstones)
-    TableEntry* entries;  // The actual array of entries
+    bool weak;             // Whether the Table is a WeakTable
+    size_t capacityMask;   // The number of slots of the index minus one
+    size_t entryCapacity;  // The size of the entries array
+    size_t numEntries;     // The number of used entries (including deleted ones)
+    size_t size;           // The number of actual entries in the Table (i.e. excluding deleted ones)
+    TableEntry* entries;   // The entries, in insertion order
+    uint8_t* ctrl;         // Control bytes of the index slots, see "ctrlgroup.h"
+    uint32_t* index;       // Position in `entries` of the key of each slot, allocated with `ctrl`
 } ObjTable;
 
+// Size of the allocation holding both the control bytes and the index of a Table
+#define TABLE_INDEX_SIZE(capacity) ((capacity) * (sizeof(uint8_t) + sizeof(uint32_t)))
+
 // A bound method. It contains a method with an associated target.
 typedef struct ObjBoundMethod {
     Obj base;
@@ -226,16 +315,62 @@ typedef struct ObjClosure {
     ObjUpvalue* upvalues[];  // the actual Upvalues
 } ObjClosure;
 
+typedef enum GeneratorState {
+    GEN_SUSPENDED,  // Not started yet, or stopped at a `yield`
+    GEN_RUNNING,    // Executing in a frame of the VM
+    GEN_DONE,       // Returned or raised an exception
+} GeneratorState;
+
+// An upvalue of a suspended generator. It's closed while the generator is suspended, and reopened
+// on the stack slot `slot` of the generator's frame when it's resumed
+typedef struct SavedUpvalue {
+    ObjUpvalue* upvalue;
+    size_t slot;
+} SavedUpvalue;
+
+// The result of calling a generator function.
+// Generators are stackless: a suspended generator stores a copy of the stack of its frame, which
+// is copied back on top of the VM stack when the generator is resumed. This way the VM can switch
+// between generators in `runEval` without recursing in C.
+typedef struct ObjGenerator {
+    Obj base;
+    ObjClosure* closure;        // The generator function
+    GeneratorState state;       // The state of the generator
+    uint8_t* ip;                // Instruction pointer at which the generator will resume
+    Value lastYield;            // Last yielded value (used by the Generator class methods)
+    Value* stack;               // The saved frame stack
+    size_t stackSize, stackCapacity;
+    SavedUpvalue* upvalues;     // The upvalues of the frame that were open when suspended
+    size_t upvalueCount, upvalueCapacity;
+} ObjGenerator;
+
+// A weak reference to a value. The GC sets the referent to null once it becomes unreachable
+typedef struct ObjWeakRef {
+    Obj base;
+    Value referent;  // The referenced value, null if it has been collected
+} ObjWeakRef;
+
+// A frame traversed by an exception. Only the raw position is recorded during unwinding,
+// the line and names are computed when the trace is actually printed
 typedef struct {
-    int line;
-    ObjString* moduleName;
-    ObjString* funcName;
+    Obj* fn;        // The function executing in the frame (ObjFunction or ObjNative)
+    size_t op;      // The offset of the instruction being executed, unused for natives
+    int tailCalls;  // The number of frames replaced by tail calls before reaching `fn`
 } FrameRecord;
 
+// A FrameRecord resolved to its source position
+typedef struct {
+    int line;
+    const char* moduleName;
+    const char* funcName;
+    int tailCalls;
+} FrameInfo;
+
 // Object that contains the dump of the stack's frames.
 // Used for storing the trace of an unhandled exception
 typedef struct ObjStackTrace {
     Obj base;
+    bool capture;  // Whether frames are recorded at all
     int lastTracedFrame;
     int recordCapacity;
     int recordSize;
@@ -250,6 +385,19 @@ typedef struct ObjUserdata {
     uint8_t data[];           // The data
 } ObjUserdata;
 
+// Fixed size array of numbers stored contiguously in native format (see the math module).
+// An array either owns the storage of its elements or is a view of a part of the storage of
+// another array, in which case it keeps that array alive
+typedef struct ObjArray {
+    Obj base;
+    JStarArrayType type;
+    size_t length;
+    void* data;              // The first element, in `storage` or in the storage of `owner`
+    struct ObjArray* owner;  // The array owning the storage if this is a view, NULL otherwise
+    size_t size;             // Size in bytes of `storage`
+    double storage[];        // The elements owned by the array (double is used for alignment)
+} ObjArray;
+
 // -----------------------------------------------------------------------------
 // OBJECT ALLOCATION FUNCTIONS
 // -----------------------------------------------------------------------------
@@ -266,15 +414,23 @@ ObjBoundMethod* newBoundMethod(JStarVM* vm, Value b, Obj* method);
 ObjInstance* newInstance(JStarVM* vm, ObjClass* cls);
 ObjClosure* newClosure(JStarVM* vm, ObjFunction* fn);
 ObjUpvalue* newUpvalue(JStarVM* vm, Value* addr);
+ObjGenerator* newGenerator(JStarVM* vm, ObjClosure* closure);
 ObjList* newList(JStarVM* vm, size_t capacity);
 ObjTuple* newTuple(JStarVM* vm, size_t size);
 ObjStackTrace* newStackTrace(JStarVM* vm);
-ObjTable* newTable(JStarVM* vm);
+ObjWeakRef* newWeakRef(JStarVM* vm, Value referent);
+// Allocates a Table that can hold `capacity` entries without being rehashed
+ObjTable* newTable(JStarVM* vm, size_t capacity);
+// Allocates a zero filled array of class `cls`
+ObjArray* newArray(JStarVM* vm, ObjClass* cls, JStarArrayType type, size_t length);
+// Allocates a view of `length` elements of `arr` starting from `start`
+ObjArray* newArrayView(JStarVM* vm, ObjArray* arr, size_t start, size_t length);
 
 // Allocate an uninitialized string of size `length`
 ObjString* allocateString(JStarVM* vm, size_t length);
 
-// Copy a c-string of size `length`. The string is automatically interned
+// Copy a c-string of size `length`. The string is automatically interned, unless it is longer
+// than the VM's `maxInternedLength`. In that case its hash is only computed when first needed
 ObjString* copyString(JStarVM* vm, const char* str, size_t length);
 
 // Release the object's memory. It uses gcAlloc internally to let the GC know
@@ -286,16 +442,65 @@ void freeObject(JStarVM* vm, Obj* o);
 
 // ObjList functions
 void listAppend(JStarVM* vm, ObjList* lst, Value v);
+// Grows the List so that it can hold at least `capacity` elements without reallocating
+void listReserve(JStarVM* vm, ObjList* lst, size_t capacity);
+// Appends `count` values to the List. The values must be reachable by the GC, and must not be
+// stored in the List itself, since it may get reallocated
+void listAppendValues(JStarVM* vm, ObjList* lst, const Value* vals, size_t count);
 void listInsert(JStarVM* vm, ObjList* lst, size_t index, Value val);
 void listRemove(JStarVM* vm, ObjList* lst, size_t index);
 
+// ObjArray functions
+size_t arrayElemSize(JStarArrayType type);
+double arrayGet(const ObjArray* arr, size_t index);
+// Stores `num` converted to the element type of the array (see arrayConvert)
+void arraySet(ObjArray* arr, size_t index, double num);
+// Returns the value `num` takes when stored in an array of type `type`. Conversion to integer types
+// truncates the number and wraps it around the range of the type, with NaN and infinities becoming 0
+double arrayConvert(JStarArrayType type, double num);
+
+// ObjInstance functions
+bool instanceGetField(ObjInstance* inst, ObjString* name, Value* out);
+void instanceSetField(ObjInstance* inst, ObjString* name, Value val);
+bool instanceHasField(ObjInstance* inst, ObjString* name);
+// Moves `inst` to shape `next`, a transition of its current shape, storing `val` in the new slot
+void instanceAddField(ObjInstance* inst, Shape* next, Value val);
+
+// ObjModule functions
+// Gets the slot of global `name` in the module, returning false if it isn't defined.
+// A global keeps its slot for the whole lifetime of the module
+bool moduleGetSlot(ObjModule* mod, ObjString* name, size_t* slot);
+bool moduleGetGlobal(ObjModule* mod, ObjString* name, Value* out);
+// Sets the global `name`, defining it if needed. Returns true if the global is a new one
+bool moduleSetGlobal(ObjModule* mod, ObjString* name, Value val);
+// Defines in `mod` all the globals of module `o`
+void moduleMergeGlobals(ObjModule* mod, ObjModule* o);
+// Sets the path of the module, along with its `__path__` global
+void moduleSetPath(JStarVM* vm, ObjModule* mod, const char* path);
+
+// Shape functions
+// Gets the slot of field `name` in the shape, returning false if the shape doesn't have it
+bool shapeGetSlot(Shape* s, ObjString* name, size_t* slot);
+
 // ObjString functions
 uint32_t stringGetHash(ObjString* str);
 bool stringEquals(ObjString* s1, ObjString* s2);
+// Concatenates two Strings. Long results are allocated with spare capacity, so that appending to
+// them again only copies the new bytes
+ObjString* stringConcat(JStarVM* vm, ObjString* s1, ObjString* s2);
+// Returns the NUL terminated data of the String, that stays valid as long as the String does.
+// A String sharing its chunk with a longer one doesn't have a terminator, so it is given its own
+// copy of the data first (which can trigger a collection). The longest String of a chunk pins it
+const char* stringCString(JStarVM* vm, ObjString* str);
 
 // ObjStacktrace functions
 // Dumps a frame in a ObjStackTrace
 void stacktraceDump(JStarVM* vm, ObjStackTrace* st, struct Frame* f, int depth);
+// Computes the line and names of a recorded frame
+FrameInfo stacktraceFrameInfo(const FrameRecord* record);
+// Returns true if exceptions of class `cls` should record the frames they traverse, i.e. if
+// trace capture isn't disabled for `cls` or any of its superclasses
+bool classCapturesStacktrace(ObjClass* cls);
 
 // Get the value array of a List or a Tuple
 Value* getValues(Obj* obj, size_t* size);
@@ -8,6 +8,12 @@ typedef enum Opcode {
 #include "opcode.def"
 } Opcode;
 
+enum {
+#define OPCODE(opcode, _) +1
+    OPCODE_COUNT = 0
+#include "opcode.def"
+};
+
 int opcodeArgsNumber(Opcode op);
 
 #endif
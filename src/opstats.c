@@ -0,0 +1,158 @@
+#include "opstats.h"
+
+#include "jstar.h"
+
+#ifdef JSTAR_OPCODE_STATS
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gc.h"
+#include "sync.h"
+#include "vm.h"
+
+// Number of opcode pairs and functions included in the report
+#define REPORT_PAIRS     30
+#define REPORT_FUNCTIONS 30
+
+void initOpcodeStats(OpcodeStats* s) {
+    memset(s, 0, sizeof(*s));
+    // Pairs starting with OP_END are never reported, as the opcode is never executed
+    s->lastOp = OP_END;
+}
+
+void switchFunction(OpcodeStats* s, Prototype* proto) {
+    double now = monotonicTime();
+    if(s->current) {
+        s->current->selfTime += now - s->switchTime;
+    }
+    s->current = proto;
+    s->switchTime = now;
+}
+
+static void addFunctions(Obj* list, Prototype*** arr, size_t* count, size_t* capacity) {
+    for(Obj* o = list; o != NULL; o = o->next) {
+        if(o->type != OBJ_FUNCTION && o->type != OBJ_NATIVE) continue;
+
+        Prototype* proto = (Prototype*)o;
+        if(proto->calls == 0 && proto->selfTime == 0) continue;
+
+        if(*count + 1 > *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *arr = realloc(*arr, sizeof(Prototype*) * *capacity);
+        }
+        (*arr)[(*count)++] = proto;
+    }
+}
+
+static int compareSelfTime(const void* a, const void* b) {
+    double ta = (*(Prototype* const*)a)->selfTime;
+    double tb = (*(Prototype* const*)b)->selfTime;
+    return (ta < tb) - (ta > tb);
+}
+
+Prototype** collectFunctionStats(JStarVM* vm, size_t* count) {
+    Prototype** arr = NULL;
+    size_t capacity = 0;
+    *count = 0;
+
+    garbageCollect(vm);
+    addFunctions(vm->objects, &arr, count, &capacity);
+    addFunctions(vm->unswept, &arr, count, &capacity);
+    addFunctions(vm->oldObjects, &arr, count, &capacity);
+    addFunctions(vm->oldRoots, &arr, count, &capacity);
+
+    if(*count > 0) {
+        qsort(arr, *count, sizeof(Prototype*), &compareSelfTime);
+    }
+    return arr;
+}
+
+typedef struct OpcodePair {
+    uint64_t count;
+    uint8_t first, second;
+} OpcodePair;
+
+static int comparePairs(const void* a, const void* b) {
+    uint64_t ca = ((const OpcodePair*)a)->count, cb = ((const OpcodePair*)b)->count;
+    return (ca < cb) - (ca > cb);
+}
+
+static void reportOpcodes(const OpcodeStats* s, JStarBuffer* out) {
+    OpcodePair ops[OPCODE_COUNT];
+    size_t count = 0;
+    uint64_t total = 0;
+
+    for(int i = 0; i < OPCODE_COUNT; i++) {
+        if(s->counts[i]) {
+            ops[count++] = (OpcodePair){s->counts[i], i, 0};
+            total += s->counts[i];
+        }
+    }
+    qsort(ops, count, sizeof(OpcodePair), &comparePairs);
+
+    jsrBufferAppendf(out, "Opcodes (%llu executed):\n", (unsigned long long)total);
+    for(size_t i = 0; i < count; i++) {
+        jsrBufferAppendf(out, "%16llu %6.2f%%  %s\n", (unsigned long long)ops[i].count,
+                         ops[i].count * 100.0 / total, OpcodeNames[ops[i].first]);
+    }
+}
+
+static void reportPairs(const OpcodeStats* s, JStarBuffer* out) {
+    OpcodePair* pairs = malloc(sizeof(OpcodePair) * OPCODE_COUNT * OPCODE_COUNT);
+    size_t count = 0;
+
+    for(int i = 0; i < OPCODE_COUNT; i++) {
+        if(i == OP_END) continue;
+        for(int j = 0; j < OPCODE_COUNT; j++) {
+            if(s->pairs[i][j]) {
+                pairs[count++] = (OpcodePair){s->pairs[i][j], i, j};
+            }
+        }
+    }
+    qsort(pairs, count, sizeof(OpcodePair), &comparePairs);
+
+    jsrBufferAppendf(out, "\nOpcode pairs (top %d):\n", REPORT_PAIRS);
+    for(size_t i = 0; i < count && i < REPORT_PAIRS; i++) {
+        jsrBufferAppendf(out, "%16llu  %s %s\n", (unsigned long long)pairs[i].count,
+                         OpcodeNames[pairs[i].first], OpcodeNames[pairs[i].second]);
+    }
+
+    free(pairs);
+}
+
+static void reportFunctions(JStarVM* vm, JStarBuffer* out) {
+    size_t count;
+    Prototype** fns = collectFunctionStats(vm, &count);
+
+    jsrBufferAppendf(out, "\nFunctions (top %d by self time):\n", REPORT_FUNCTIONS);
+    jsrBufferAppendf(out, "%16s %12s  %s\n", "calls", "self (s)", "function");
+    for(size_t i = 0; i < count && i < REPORT_FUNCTIONS; i++) {
+        Prototype* proto = fns[i];
+        jsrBufferAppendf(out, "%16llu %12.6f  %s.%s\n", (unsigned long long)proto->calls,
+                         proto->selfTime, proto->module->name->data,
+                         proto->name ? proto->name->data : "<main>");
+    }
+
+    free(fns);
+}
+
+bool jsrGetOpcodeStats(JStarVM* vm, JStarBuffer* out) {
+    // Account the time spent by the function executing right now
+    switchFunction(&vm->opStats, vm->opStats.current);
+
+    reportOpcodes(&vm->opStats, out);
+    reportPairs(&vm->opStats, out);
+    reportFunctions(vm, out);
+    return true;
+}
+
+#else
+
+bool jsrGetOpcodeStats(JStarVM* vm, JStarBuffer* out) {
+    (void)vm;
+    (void)out;
+    return false;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef OPSTATS_H
+#define OPSTATS_H
+
+#include "conf.h"
+
+#ifdef JSTAR_OPCODE_STATS
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jstar.h"
+#include "object.h"
+#include "opcode.h"
+
+// Counters of the eval loop, collected only when building with JSTAR_OPCODE_STATS.
+// Every executed instruction is counted along with the one executed right before it, so that the
+// most frequent pairs can guide the choice of superinstructions.
+// The self time of a function is the time elapsed between the execution of its instructions and
+// the switch to another function, including the time spent in the natives it calls that don't call
+// back into J* code. Call counts are kept in the Prototype of functions.
+typedef struct OpcodeStats {
+    uint64_t counts[OPCODE_COUNT];
+    uint64_t pairs[OPCODE_COUNT][OPCODE_COUNT];  // pairs[a][b]: executions of `b` right after `a`
+    uint8_t lastOp;
+    Prototype* current;  // Function whose self time is being measured (reached by the GC)
+    double switchTime;   // Time at which `current` started executing
+} OpcodeStats;
+
+void initOpcodeStats(OpcodeStats* s);
+
+// Make `proto` the function being executed, adding the elapsed time to the previous one
+void switchFunction(OpcodeStats* s, Prototype* proto);
+
+// Count the execution of `op` by the function `proto`. Returns the opcode itself, so that the
+// call can wrap its decoding in the eval loop
+static inline uint8_t countOpcode(OpcodeStats* s, Prototype* proto, uint8_t op) {
+    if(proto != s->current) switchFunction(s, proto);
+    s->counts[op]++;
+    s->pairs[s->lastOp][op]++;
+    s->lastOp = op;
+    return op;
+}
+
+// Returns a malloc'd array with the functions alive in the VM that have been called, sorted by
+// decreasing self time. A full collection is run first, so that the functions stay alive while
+// the caller allocates
+Prototype** collectFunctionStats(JStarVM* vm, size_t* count);
+
+#endif
+
+#endif
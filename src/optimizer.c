@@ -0,0 +1,452 @@
+#include "optimizer.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "parse/lex.h"
+#include "parse/vector.h"
+#include "profiler.h"
+
+static void optimizeExpr(JStarExpr* e);
+static void optimizeStmt(JStarStmt* s);
+
+// -----------------------------------------------------------------------------
+// NODE REWRITING
+// -----------------------------------------------------------------------------
+
+// Replaces `dest` with the node `src`, taking ownership of its children
+static void moveExpr(JStarExpr* dest, JStarExpr* src) {
+    *dest = *src;
+    if(!src->inArena) free(src);
+}
+
+static void moveStmt(JStarStmt* dest, JStarStmt* src) {
+    *dest = *src;
+    if(!src->inArena) free(src);
+}
+
+static void freeOperands(JStarExpr* e) {
+    switch(e->type) {
+    case JSR_BINARY:
+        jsrExprFree(e->as.binary.left);
+        jsrExprFree(e->as.binary.right);
+        break;
+    case JSR_UNARY:
+        jsrExprFree(e->as.unary.operand);
+        break;
+    case JSR_POWER:
+        jsrExprFree(e->as.pow.base);
+        jsrExprFree(e->as.pow.exp);
+        break;
+    default:
+        break;
+    }
+}
+
+static void foldToNumber(JStarExpr* e, double num) {
+    freeOperands(e);
+    e->type = JSR_NUMBER;
+    e->as.num = num;
+}
+
+static void foldToBool(JStarExpr* e, bool boolean) {
+    freeOperands(e);
+    e->type = JSR_BOOL;
+    e->as.boolean = boolean;
+}
+
+static void makeEmptyBlock(JStarStmt* s) {
+    s->type = JSR_BLOCK;
+    s->as.blockStmt.stmts = vecNew();
+}
+
+// -----------------------------------------------------------------------------
+// CONSTANTS
+// -----------------------------------------------------------------------------
+
+static bool isConstant(const JStarExpr* e) {
+    return e->type == JSR_NUMBER || e->type == JSR_BOOL || e->type == JSR_NULL ||
+           e->type == JSR_STRING;
+}
+
+// Constants for which `==` doesn't dispatch to an `__eq__` overload at runtime
+static bool isPrimitive(const JStarExpr* e) {
+    return e->type == JSR_NUMBER || e->type == JSR_BOOL || e->type == JSR_NULL;
+}
+
+// Same as `valueToBool`, but on a constant expression
+static bool constantToBool(const JStarExpr* e) {
+    switch(e->type) {
+    case JSR_BOOL:
+        return e->as.boolean;
+    case JSR_NULL:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static bool primitiveEquals(const JStarExpr* a, const JStarExpr* b) {
+    if(a->type != b->type) return false;
+
+    switch(a->type) {
+    case JSR_NUMBER:
+        return a->as.num == b->as.num;
+    case JSR_BOOL:
+        return a->as.boolean == b->as.boolean;
+    default:
+        return true;
+    }
+}
+
+// Bitwise operators convert their operands to uint32_t, only fold where that's well defined
+static bool isUint32(double num) {
+    return num >= 0 && num <= UINT32_MAX;
+}
+
+// -----------------------------------------------------------------------------
+// EXPRESSIONS
+// -----------------------------------------------------------------------------
+
+static void foldLogicExpr(JStarExpr* e) {
+    JStarExpr* left = e->as.binary.left;
+    JStarExpr* right = e->as.binary.right;
+    if(!isConstant(left)) return;
+
+    // `and` yields its left operand when falsy, `or` when truthy
+    bool yieldsLeft = constantToBool(left) == (e->as.binary.op == TOK_OR);
+    jsrExprFree(yieldsLeft ? right : left);
+    moveExpr(e, yieldsLeft ? left : right);
+}
+
+static void foldBinaryExpr(JStarExpr* e) {
+    JStarTokType op = e->as.binary.op;
+    JStarExpr* left = e->as.binary.left;
+    JStarExpr* right = e->as.binary.right;
+
+    if(op == TOK_AND || op == TOK_OR) {
+        foldLogicExpr(e);
+        return;
+    }
+
+    if(op == TOK_EQUAL_EQUAL || op == TOK_BANG_EQ) {
+        if(isPrimitive(left) && isPrimitive(right)) {
+            bool eq = primitiveEquals(left, right);
+            foldToBool(e, op == TOK_EQUAL_EQUAL ? eq : !eq);
+        }
+        return;
+    }
+
+    if(left->type != JSR_NUMBER || right->type != JSR_NUMBER) return;
+    double a = left->as.num, b = right->as.num;
+
+    switch(op) {
+    case TOK_PLUS:
+        foldToNumber(e, a + b);
+        break;
+    case TOK_MINUS:
+        foldToNumber(e, a - b);
+        break;
+    case TOK_MULT:
+        foldToNumber(e, a * b);
+        break;
+    case TOK_DIV:
+        foldToNumber(e, a / b);
+        break;
+    case TOK_MOD:
+        foldToNumber(e, fmod(a, b));
+        break;
+    case TOK_GT:
+        foldToBool(e, a > b);
+        break;
+    case TOK_GE:
+        foldToBool(e, a >= b);
+        break;
+    case TOK_LT:
+        foldToBool(e, a < b);
+        break;
+    case TOK_LE:
+        foldToBool(e, a <= b);
+        break;
+    case TOK_AMPER:
+    case TOK_PIPE:
+    case TOK_TILDE:
+    case TOK_LSHIFT:
+    case TOK_RSHIFT: {
+        if(!isUint32(a) || !isUint32(b)) break;
+        uint32_t x = (uint32_t)a, y = (uint32_t)b;
+        switch(op) {
+        case TOK_AMPER:
+            foldToNumber(e, x & y);
+            break;
+        case TOK_PIPE:
+            foldToNumber(e, x | y);
+            break;
+        case TOK_TILDE:
+            foldToNumber(e, x ^ y);
+            break;
+        case TOK_LSHIFT:
+            if(y < 32) foldToNumber(e, x << y);
+            break;
+        default:
+            if(y < 32) foldToNumber(e, x >> y);
+            break;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void foldUnaryExpr(JStarExpr* e) {
+    JStarExpr* operand = e->as.unary.operand;
+    if(!isConstant(operand)) return;
+
+    switch(e->as.unary.op) {
+    case TOK_BANG:
+        foldToBool(e, !constantToBool(operand));
+        break;
+    case TOK_MINUS:
+        if(operand->type == JSR_NUMBER) foldToNumber(e, -operand->as.num);
+        break;
+    case TOK_TILDE:
+        if(operand->type == JSR_NUMBER && isUint32(operand->as.num)) {
+            foldToNumber(e, ~(uint32_t)operand->as.num);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void foldPowExpr(JStarExpr* e) {
+    JStarExpr* base = e->as.pow.base;
+    JStarExpr* exp = e->as.pow.exp;
+    if(base->type == JSR_NUMBER && exp->type == JSR_NUMBER) {
+        foldToNumber(e, pow(base->as.num, exp->as.num));
+    }
+}
+
+static void foldTernaryExpr(JStarExpr* e) {
+    JStarExpr* cond = e->as.ternary.cond;
+    if(!isConstant(cond)) return;
+
+    bool truthy = constantToBool(cond);
+    JStarExpr* taken = truthy ? e->as.ternary.thenExpr : e->as.ternary.elseExpr;
+    jsrExprFree(truthy ? e->as.ternary.elseExpr : e->as.ternary.thenExpr);
+    jsrExprFree(cond);
+    moveExpr(e, taken);
+}
+
+static void optimizeExpr(JStarExpr* e) {
+    if(e == NULL) return;
+
+    switch(e->type) {
+    case JSR_BINARY:
+        optimizeExpr(e->as.binary.left);
+        optimizeExpr(e->as.binary.right);
+        foldBinaryExpr(e);
+        break;
+    case JSR_UNARY:
+        optimizeExpr(e->as.unary.operand);
+        foldUnaryExpr(e);
+        break;
+    case JSR_POWER:
+        optimizeExpr(e->as.pow.base);
+        optimizeExpr(e->as.pow.exp);
+        foldPowExpr(e);
+        break;
+    case JSR_TERNARY:
+        optimizeExpr(e->as.ternary.cond);
+        optimizeExpr(e->as.ternary.thenExpr);
+        optimizeExpr(e->as.ternary.elseExpr);
+        foldTernaryExpr(e);
+        break;
+    case JSR_ASSIGN:
+        optimizeExpr(e->as.assign.lval);
+        optimizeExpr(e->as.assign.rval);
+        break;
+    case JSR_COMPUND_ASS:
+        optimizeExpr(e->as.compound.lval);
+        optimizeExpr(e->as.compound.rval);
+        break;
+    case JSR_ARRAY:
+        optimizeExpr(e->as.array.exprs);
+        break;
+    case JSR_TUPLE:
+        optimizeExpr(e->as.tuple.exprs);
+        break;
+    case JSR_TABLE:
+        optimizeExpr(e->as.table.keyVals);
+        break;
+    case JSR_EXPR_LST:
+        vecForeach(JStarExpr** it, e->as.list) {
+            optimizeExpr(*it);
+        }
+        break;
+    case JSR_CALL:
+        optimizeExpr(e->as.call.callee);
+        optimizeExpr(e->as.call.args);
+        break;
+    case JSR_ACCESS:
+        optimizeExpr(e->as.access.left);
+        break;
+    case JSR_ARR_ACCESS:
+        optimizeExpr(e->as.arrayAccess.left);
+        optimizeExpr(e->as.arrayAccess.index);
+        break;
+    case JSR_SUPER:
+        optimizeExpr(e->as.sup.args);
+        break;
+    case JSR_FUNC_LIT:
+        optimizeStmt(e->as.funLit.func);
+        break;
+    case JSR_YIELD:
+        optimizeExpr(e->as.yield.expr);
+        break;
+    case JSR_NUMBER:
+    case JSR_BOOL:
+    case JSR_STRING:
+    case JSR_VAR:
+    case JSR_NULL:
+        break;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// STATEMENTS
+// -----------------------------------------------------------------------------
+
+static void foldIfStmt(JStarStmt* s) {
+    JStarExpr* cond = s->as.ifStmt.cond;
+    if(!isConstant(cond)) return;
+
+    bool truthy = constantToBool(cond);
+    JStarStmt* taken = truthy ? s->as.ifStmt.thenStmt : s->as.ifStmt.elseStmt;
+    jsrStmtFree(truthy ? s->as.ifStmt.elseStmt : s->as.ifStmt.thenStmt);
+    jsrExprFree(cond);
+
+    // Branches are blocks (or nested `elif`s), so inlining them preserves scoping
+    if(taken) {
+        moveStmt(s, taken);
+    } else {
+        makeEmptyBlock(s);
+    }
+}
+
+static void foldWhileStmt(JStarStmt* s) {
+    JStarExpr* cond = s->as.whileStmt.cond;
+    if(!isConstant(cond)) return;
+
+    bool truthy = constantToBool(cond);
+    JStarStmt* body = s->as.whileStmt.body;
+    jsrExprFree(cond);
+
+    if(truthy) {
+        // An always true loop doesn't need to test its condition on every iteration
+        s->type = JSR_FOR;
+        s->as.forStmt.init = NULL;
+        s->as.forStmt.cond = NULL;
+        s->as.forStmt.act = NULL;
+        s->as.forStmt.body = body;
+    } else {
+        jsrStmtFree(body);
+        makeEmptyBlock(s);
+    }
+}
+
+static void foldForStmt(JStarStmt* s) {
+    JStarExpr* cond = s->as.forStmt.cond;
+    if(cond != NULL && isConstant(cond) && constantToBool(cond)) {
+        jsrExprFree(cond);
+        s->as.forStmt.cond = NULL;
+    }
+}
+
+static void optimizeStmtList(Vector* stmts) {
+    vecForeach(JStarStmt** it, *stmts) {
+        optimizeStmt(*it);
+    }
+}
+
+static void optimizeStmt(JStarStmt* s) {
+    if(s == NULL) return;
+
+    switch(s->type) {
+    case JSR_IF:
+        optimizeExpr(s->as.ifStmt.cond);
+        optimizeStmt(s->as.ifStmt.thenStmt);
+        optimizeStmt(s->as.ifStmt.elseStmt);
+        foldIfStmt(s);
+        break;
+    case JSR_WHILE:
+        optimizeExpr(s->as.whileStmt.cond);
+        optimizeStmt(s->as.whileStmt.body);
+        foldWhileStmt(s);
+        break;
+    case JSR_FOR:
+        optimizeStmt(s->as.forStmt.init);
+        optimizeExpr(s->as.forStmt.cond);
+        optimizeExpr(s->as.forStmt.act);
+        optimizeStmt(s->as.forStmt.body);
+        foldForStmt(s);
+        break;
+    case JSR_FOREACH:
+        optimizeStmt(s->as.forEach.var);
+        optimizeExpr(s->as.forEach.iterable);
+        optimizeStmt(s->as.forEach.body);
+        break;
+    case JSR_BLOCK:
+        optimizeStmtList(&s->as.blockStmt.stmts);
+        break;
+    case JSR_RETURN:
+        optimizeExpr(s->as.returnStmt.e);
+        break;
+    case JSR_EXPR_STMT:
+        optimizeExpr(s->as.exprStmt);
+        break;
+    case JSR_VARDECL:
+        optimizeExpr(s->as.varDecl.init);
+        break;
+    case JSR_FUNCDECL:
+        optimizeStmt(s->as.funcDecl.body);
+        break;
+    case JSR_CLASSDECL:
+        optimizeExpr(s->as.classDecl.sup);
+        optimizeStmtList(&s->as.classDecl.methods);
+        break;
+    case JSR_TRY:
+        optimizeStmt(s->as.tryStmt.block);
+        optimizeStmtList(&s->as.tryStmt.excs);
+        optimizeStmt(s->as.tryStmt.ensure);
+        break;
+    case JSR_EXCEPT:
+        optimizeExpr(s->as.excStmt.cls);
+        optimizeStmt(s->as.excStmt.block);
+        break;
+    case JSR_RAISE:
+        optimizeExpr(s->as.raiseStmt.exc);
+        break;
+    case JSR_WITH:
+        optimizeExpr(s->as.withStmt.e);
+        optimizeStmt(s->as.withStmt.block);
+        break;
+    case JSR_NATIVEDECL:
+    case JSR_IMPORT:
+    case JSR_CONTINUE:
+    case JSR_BREAK:
+        break;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// API
+// -----------------------------------------------------------------------------
+
+void optimize(JStarStmt* s) {
+    PROFILE_FUNC()
+    optimizeStmt(s);
+}
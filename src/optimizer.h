@@ -0,0 +1,11 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "parse/ast.h"
+
+// Simplifies the AST in place before it is handed to the compiler.
+// Constant numeric and boolean expressions are folded into literals, and branches guarded by
+// constant conditions are either inlined or removed altogether.
+void optimize(JStarStmt* s);
+
+#endif
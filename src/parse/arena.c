@@ -0,0 +1,122 @@
+#include "parse/arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define ARENA_CHUNK_SIZE (32 * 1024)
+// Allocations bigger than this get a chunk of their own, so that they don't waste the space left
+// in the current one
+#define ARENA_BIG_ALLOC (ARENA_CHUNK_SIZE / 4)
+
+typedef union {
+    void* ptr;
+    double num;
+    int64_t integer;
+} MaxAlign;
+
+#define ALIGN(size) (((size) + sizeof(MaxAlign) - 1) & ~(sizeof(MaxAlign) - 1))
+
+typedef struct Chunk {
+    struct Chunk* next;
+    size_t size, used;
+    MaxAlign data[];
+} Chunk;
+
+struct JStarASTArena {
+    Chunk* chunks;  // The chunk being allocated from is the head of the list
+    void* last;     // Last allocation made in the head chunk, can be grown in place
+};
+
+static Chunk* newChunk(size_t size) {
+    Chunk* c = malloc(sizeof(*c) + size);
+    ASSERT(c, "malloc failed");
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+static void freeChunks(Chunk* c) {
+    while(c) {
+        Chunk* next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+JStarASTArena* jsrNewASTArena(void) {
+    JStarASTArena* a = malloc(sizeof(*a));
+    ASSERT(a, "malloc failed");
+    a->chunks = NULL;
+    a->last = NULL;
+    return a;
+}
+
+void jsrFreeASTArena(JStarASTArena* a) {
+    if(a == NULL) return;
+    freeChunks(a->chunks);
+    free(a);
+}
+
+void jsrResetASTArena(JStarASTArena* a) {
+    // Keep only the oldest chunk, so that one big parse doesn't pin its memory forever
+    Chunk** it = &a->chunks;
+    while(*it && (*it)->next) {
+        Chunk* c = *it;
+        *it = c->next;
+        free(c);
+    }
+
+    if(a->chunks) a->chunks->used = 0;
+    a->last = NULL;
+}
+
+void* jsrASTArenaAlloc(JStarASTArena* a, size_t size) {
+    size = ALIGN(size);
+
+    if(size > ARENA_BIG_ALLOC) {
+        Chunk* c = newChunk(size);
+        c->used = size;
+        if(a->chunks) {
+            c->next = a->chunks->next;
+            a->chunks->next = c;
+        } else {
+            a->chunks = c;
+        }
+        return c->data;
+    }
+
+    Chunk* c = a->chunks;
+    if(c == NULL || c->size - c->used < size) {
+        c = newChunk(ARENA_CHUNK_SIZE);
+        c->next = a->chunks;
+        a->chunks = c;
+    }
+
+    void* ptr = (char*)c->data + c->used;
+    c->used += size;
+    a->last = ptr;
+    return ptr;
+}
+
+void* jsrASTArenaRealloc(JStarASTArena* a, void* ptr, size_t oldSize, size_t newSize) {
+    if(ptr == NULL) return jsrASTArenaAlloc(a, newSize);
+
+    if(ptr == a->last) {
+        Chunk* c = a->chunks;
+        size_t start = (char*)ptr - (char*)c->data;
+        if(start + ALIGN(newSize) <= c->size) {
+            c->used = start + ALIGN(newSize);
+            return ptr;
+        }
+    }
+
+    if(newSize <= oldSize) return ptr;
+
+    void* newPtr = jsrASTArenaAlloc(a, newSize);
+    memcpy(newPtr, ptr, oldSize);
+    return newPtr;
+}
@@ -5,8 +5,13 @@
 #include "parse/lex.h"
 #include "parse/vector.h"
 
-JStarIdentifier* jsrNewIdentifier(size_t length, const char* name) {
-    JStarIdentifier* id = malloc(sizeof(*id));
+// Nodes are allocated in the arena `a` when one is provided, otherwise on the heap
+static void* allocNode(JStarASTArena* a, size_t size) {
+    return a ? jsrASTArenaAlloc(a, size) : malloc(size);
+}
+
+JStarIdentifier* jsrNewIdentifier(JStarASTArena* a, size_t length, const char* name) {
+    JStarIdentifier* id = allocNode(a, sizeof(*id));
     id->length = length;
     id->name = name;
     return id;
@@ -20,145 +25,158 @@ bool jsrIdentifierEq(JStarIdentifier* id1, JStarIdentifier* id2) {
 // EXPRESSION NODES
 // -----------------------------------------------------------------------------
 
-static JStarExpr* newExpr(int line, JStarExprType type) {
-    JStarExpr* e = malloc(sizeof(*e));
+static JStarExpr* newExpr(JStarASTArena* a, int line, JStarExprType type) {
+    JStarExpr* e = allocNode(a, sizeof(*e));
     e->line = line;
     e->type = type;
+    e->inArena = a != NULL;
     return e;
 }
 
-JStarExpr* jsrBinaryExpr(int line, JStarTokType op, JStarExpr* l, JStarExpr* r) {
-    JStarExpr* e = newExpr(line, JSR_BINARY);
+JStarExpr* jsrBinaryExpr(JStarASTArena* a, int line, JStarTokType op, JStarExpr* l, JStarExpr* r) {
+    JStarExpr* e = newExpr(a, line, JSR_BINARY);
     e->as.binary.op = op;
     e->as.binary.left = l;
     e->as.binary.right = r;
     return e;
 }
 
-JStarExpr* jsrAssignExpr(int line, JStarExpr* lval, JStarExpr* rval) {
-    JStarExpr* e = newExpr(line, JSR_ASSIGN);
+JStarExpr* jsrAssignExpr(JStarASTArena* a, int line, JStarExpr* lval, JStarExpr* rval) {
+    JStarExpr* e = newExpr(a, line, JSR_ASSIGN);
     e->as.assign.lval = lval;
     e->as.assign.rval = rval;
     return e;
 }
 
-JStarExpr* jsrUnaryExpr(int line, JStarTokType op, JStarExpr* operand) {
-    JStarExpr* e = newExpr(line, JSR_UNARY);
+JStarExpr* jsrUnaryExpr(JStarASTArena* a, int line, JStarTokType op, JStarExpr* operand) {
+    JStarExpr* e = newExpr(a, line, JSR_UNARY);
     e->as.unary.op = op;
     e->as.unary.operand = operand;
     return e;
 }
 
-JStarExpr* jsrNullLiteral(int line) {
-    JStarExpr* e = newExpr(line, JSR_NULL);
+JStarExpr* jsrNullLiteral(JStarASTArena* a, int line) {
+    JStarExpr* e = newExpr(a, line, JSR_NULL);
     return e;
 }
 
-JStarExpr* jsrNumLiteral(int line, double num) {
-    JStarExpr* e = newExpr(line, JSR_NUMBER);
+JStarExpr* jsrNumLiteral(JStarASTArena* a, int line, double num) {
+    JStarExpr* e = newExpr(a, line, JSR_NUMBER);
     e->as.num = num;
     return e;
 }
 
-JStarExpr* jsrBoolLiteral(int line, bool boolean) {
-    JStarExpr* e = newExpr(line, JSR_BOOL);
+JStarExpr* jsrBoolLiteral(JStarASTArena* a, int line, bool boolean) {
+    JStarExpr* e = newExpr(a, line, JSR_BOOL);
     e->as.boolean = boolean;
     return e;
 }
 
-JStarExpr* jsrStrLiteral(int line, const char* str, size_t len) {
-    JStarExpr* e = newExpr(line, JSR_STRING);
+JStarExpr* jsrStrLiteral(JStarASTArena* a, int line, const char* str, size_t len) {
+    JStarExpr* e = newExpr(a, line, JSR_STRING);
     e->as.string.str = str;
     e->as.string.length = len;
     return e;
 }
 
-JStarExpr* jsrVarLiteral(int line, const char* var, size_t len) {
-    JStarExpr* e = newExpr(line, JSR_VAR);
+JStarExpr* jsrVarLiteral(JStarASTArena* a, int line, const char* var, size_t len) {
+    JStarExpr* e = newExpr(a, line, JSR_VAR);
     e->as.var.id.name = var;
     e->as.var.id.length = len;
     return e;
 }
 
-JStarExpr* jsrArrLiteral(int line, JStarExpr* exprs) {
-    JStarExpr* a = newExpr(line, JSR_ARRAY);
-    a->as.array.exprs = exprs;
-    return a;
+JStarExpr* jsrArrLiteral(JStarASTArena* a, int line, JStarExpr* exprs) {
+    JStarExpr* e = newExpr(a, line, JSR_ARRAY);
+    e->as.array.exprs = exprs;
+    return e;
 }
 
-JStarExpr* jsrTupleLiteral(int line, JStarExpr* exprs) {
-    JStarExpr* a = newExpr(line, JSR_TUPLE);
-    a->as.tuple.exprs = exprs;
-    return a;
+JStarExpr* jsrTupleLiteral(JStarASTArena* a, int line, JStarExpr* exprs) {
+    JStarExpr* e = newExpr(a, line, JSR_TUPLE);
+    e->as.tuple.exprs = exprs;
+    return e;
 }
 
-JStarExpr* jsrTableLiteral(int line, JStarExpr* keyVals) {
-    JStarExpr* t = newExpr(line, JSR_TABLE);
+JStarExpr* jsrTableLiteral(JStarASTArena* a, int line, JStarExpr* keyVals) {
+    JStarExpr* t = newExpr(a, line, JSR_TABLE);
     t->as.table.keyVals = keyVals;
     return t;
 }
 
-JStarExpr* jsrExprList(int line, Vector* exprs) {
-    JStarExpr* e = newExpr(line, JSR_EXPR_LST);
+JStarExpr* jsrExprList(JStarASTArena* a, int line, Vector* exprs) {
+    JStarExpr* e = newExpr(a, line, JSR_EXPR_LST);
     e->as.list = vecMove(exprs);
     return e;
 }
 
-JStarExpr* jsrCallExpr(int line, JStarExpr* callee, JStarExpr* args, bool unpackArg) {
-    JStarExpr* e = newExpr(line, JSR_CALL);
+JStarExpr* jsrCallExpr(JStarASTArena* a, int line, JStarExpr* callee, JStarExpr* args,
+                       bool unpackArg) {
+    JStarExpr* e = newExpr(a, line, JSR_CALL);
     e->as.call.unpackArg = unpackArg;
     e->as.call.callee = callee;
     e->as.call.args = args;
     return e;
 }
 
-JStarExpr* jsrPowExpr(int line, JStarExpr* base, JStarExpr* exp) {
-    JStarExpr* e = newExpr(line, JSR_POWER);
+JStarExpr* jsrPowExpr(JStarASTArena* a, int line, JStarExpr* base, JStarExpr* exp) {
+    JStarExpr* e = newExpr(a, line, JSR_POWER);
     e->as.pow.base = base;
     e->as.pow.exp = exp;
     return e;
 }
 
-JStarExpr* jsrAccessExpr(int line, JStarExpr* left, const char* name, size_t length) {
-    JStarExpr* e = newExpr(line, JSR_ACCESS);
+JStarExpr* jsrAccessExpr(JStarASTArena* a, int line, JStarExpr* left, const char* name,
+                         size_t length) {
+    JStarExpr* e = newExpr(a, line, JSR_ACCESS);
     e->as.access.left = left;
     e->as.access.id.name = name;
     e->as.access.id.length = length;
     return e;
 }
 
-JStarExpr* jsrArrayAccExpr(int line, JStarExpr* left, JStarExpr* index) {
-    JStarExpr* e = newExpr(line, JSR_ARR_ACCESS);
+JStarExpr* jsrArrayAccExpr(JStarASTArena* a, int line, JStarExpr* left, JStarExpr* index) {
+    JStarExpr* e = newExpr(a, line, JSR_ARR_ACCESS);
     e->as.arrayAccess.left = left;
     e->as.arrayAccess.index = index;
     return e;
 }
 
-JStarExpr* jsrTernaryExpr(int line, JStarExpr* cond, JStarExpr* thenExpr, JStarExpr* elseExpr) {
-    JStarExpr* e = newExpr(line, JSR_TERNARY);
+JStarExpr* jsrTernaryExpr(JStarASTArena* a, int line, JStarExpr* cond, JStarExpr* thenExpr,
+                          JStarExpr* elseExpr) {
+    JStarExpr* e = newExpr(a, line, JSR_TERNARY);
     e->as.ternary.cond = cond;
     e->as.ternary.thenExpr = thenExpr;
     e->as.ternary.elseExpr = elseExpr;
     return e;
 }
 
-JStarExpr* jsrCompundAssExpr(int line, JStarTokType op, JStarExpr* lval, JStarExpr* rval) {
-    JStarExpr* e = newExpr(line, JSR_COMPUND_ASS);
+JStarExpr* jsrCompundAssExpr(JStarASTArena* a, int line, JStarTokType op, JStarExpr* lval,
+                             JStarExpr* rval) {
+    JStarExpr* e = newExpr(a, line, JSR_COMPUND_ASS);
     e->as.compound.op = op;
     e->as.compound.lval = lval;
     e->as.compound.rval = rval;
     return e;
 }
 
-JStarExpr* jsrFuncLiteral(int line, Vector* args, Vector* defArgs, bool vararg, JStarStmt* body) {
-    JStarExpr* e = newExpr(line, JSR_FUNC_LIT);
+JStarExpr* jsrFuncLiteral(JStarASTArena* a, int line, Vector* args, Vector* defArgs, bool vararg,
+                          JStarStmt* body) {
+    JStarExpr* e = newExpr(a, line, JSR_FUNC_LIT);
     JStarTok name = {0};  // Empty name
-    e->as.funLit.func = jsrFuncDecl(line, &name, args, defArgs, vararg, body);
+    e->as.funLit.func = jsrFuncDecl(a, line, &name, args, defArgs, vararg, body);
     return e;
 }
 
-JStarExpr* jsrSuperLiteral(int line, JStarTok* name, JStarExpr* args, bool unpackArg) {
-    JStarExpr* e = newExpr(line, JSR_SUPER);
+JStarExpr* jsrYieldExpr(JStarASTArena* a, int line, JStarExpr* expr) {
+    JStarExpr* e = newExpr(a, line, JSR_YIELD);
+    e->as.yield.expr = expr;
+    return e;
+}
+
+JStarExpr* jsrSuperLiteral(JStarASTArena* a, int line, JStarTok* name, JStarExpr* args,
+                           bool unpackArg) {
+    JStarExpr* e = newExpr(a, line, JSR_SUPER);
     e->as.sup.name.name = name->lexeme;
     e->as.sup.name.length = name->length;
     e->as.sup.unpackArg = unpackArg;
@@ -167,7 +185,7 @@ JStarExpr* jsrSuperLiteral(int line, JStarTok* name, JStarExpr* args, bool unpac
 }
 
 void jsrExprFree(JStarExpr* e) {
-    if(e == NULL) return;
+    if(e == NULL || e->inArena) return;
 
     switch(e->type) {
     case JSR_BINARY:
@@ -220,6 +238,9 @@ void jsrExprFree(JStarExpr* e) {
     case JSR_FUNC_LIT:
         jsrStmtFree(e->as.funLit.func);
         break;
+    case JSR_YIELD:
+        jsrExprFree(e->as.yield.expr);
+        break;
     case JSR_POWER:
         jsrExprFree(e->as.pow.base);
         jsrExprFree(e->as.pow.exp);
@@ -238,28 +259,31 @@ void jsrExprFree(JStarExpr* e) {
 // STATEMENT NODES
 // -----------------------------------------------------------------------------
 
-static JStarStmt* newStmt(int line, JStarStmtType type) {
-    JStarStmt* s = malloc(sizeof(*s));
+static JStarStmt* newStmt(JStarASTArena* a, int line, JStarStmtType type) {
+    JStarStmt* s = allocNode(a, sizeof(*s));
     s->line = line;
     s->type = type;
+    s->inArena = a != NULL;
     return s;
 }
 
-JStarStmt* jsrFuncDecl(int line, JStarTok* name, Vector* args, Vector* defArgs, bool vararg,
-                       JStarStmt* body) {
-    JStarStmt* f = newStmt(line, JSR_FUNCDECL);
+JStarStmt* jsrFuncDecl(JStarASTArena* a, int line, JStarTok* name, Vector* args, Vector* defArgs,
+                       bool vararg, JStarStmt* body) {
+    JStarStmt* f = newStmt(a, line, JSR_FUNCDECL);
     f->as.funcDecl.id.name = name->lexeme;
     f->as.funcDecl.id.length = name->length;
     f->as.funcDecl.formalArgs = vecMove(args);
     f->as.funcDecl.defArgs = vecMove(defArgs);
     f->as.funcDecl.isVararg = vararg;
     f->as.funcDecl.isStatic = false;
+    f->as.funcDecl.isGenerator = false;
     f->as.funcDecl.body = body;
     return f;
 }
 
-JStarStmt* jsrNativeDecl(int line, JStarTok* name, Vector* args, Vector* defArgs, bool vararg) {
-    JStarStmt* n = newStmt(line, JSR_NATIVEDECL);
+JStarStmt* jsrNativeDecl(JStarASTArena* a, int line, JStarTok* name, Vector* args, Vector* defArgs,
+                         bool vararg) {
+    JStarStmt* n = newStmt(a, line, JSR_NATIVEDECL);
     n->as.nativeDecl.id.name = name->lexeme;
     n->as.nativeDecl.id.length = name->length;
     n->as.nativeDecl.formalArgs = vecMove(args);
@@ -269,8 +293,9 @@ JStarStmt* jsrNativeDecl(int line, JStarTok* name, Vector* args, Vector* defArgs
     return n;
 }
 
-JStarStmt* jsrClassDecl(int line, JStarTok* clsName, JStarExpr* sup, Vector* methods) {
-    JStarStmt* c = newStmt(line, JSR_CLASSDECL);
+JStarStmt* jsrClassDecl(JStarASTArena* a, int line, JStarTok* clsName, JStarExpr* sup,
+                        Vector* methods) {
+    JStarStmt* c = newStmt(a, line, JSR_CLASSDECL);
     c->as.classDecl.sup = sup;
     c->as.classDecl.isStatic = false;
     c->as.classDecl.id.name = clsName->lexeme;
@@ -279,8 +304,8 @@ JStarStmt* jsrClassDecl(int line, JStarTok* clsName, JStarExpr* sup, Vector* met
     return c;
 }
 
-JStarStmt* jsrVarDecl(int line, bool isUnpack, Vector* ids, JStarExpr* init) {
-    JStarStmt* s = newStmt(line, JSR_VARDECL);
+JStarStmt* jsrVarDecl(JStarASTArena* a, int line, bool isUnpack, Vector* ids, JStarExpr* init) {
+    JStarStmt* s = newStmt(a, line, JSR_VARDECL);
     s->as.varDecl.ids = vecMove(ids);
     s->as.varDecl.isUnpack = isUnpack;
     s->as.varDecl.isStatic = false;
@@ -288,8 +313,9 @@ JStarStmt* jsrVarDecl(int line, bool isUnpack, Vector* ids, JStarExpr* init) {
     return s;
 }
 
-JStarStmt* jsrWithStmt(int line, JStarExpr* e, JStarTok* varName, JStarStmt* block) {
-    JStarStmt* w = newStmt(line, JSR_WITH);
+JStarStmt* jsrWithStmt(JStarASTArena* a, int line, JStarExpr* e, JStarTok* varName,
+                       JStarStmt* block) {
+    JStarStmt* w = newStmt(a, line, JSR_WITH);
     w->as.withStmt.e = e;
     w->as.withStmt.var.name = varName->lexeme;
     w->as.withStmt.var.length = varName->length;
@@ -297,8 +323,9 @@ JStarStmt* jsrWithStmt(int line, JStarExpr* e, JStarTok* varName, JStarStmt* blo
     return w;
 }
 
-JStarStmt* jsrForStmt(int line, JStarStmt* init, JStarExpr* cond, JStarExpr* act, JStarStmt* body) {
-    JStarStmt* s = newStmt(line, JSR_FOR);
+JStarStmt* jsrForStmt(JStarASTArena* a, int line, JStarStmt* init, JStarExpr* cond, JStarExpr* act,
+                      JStarStmt* body) {
+    JStarStmt* s = newStmt(a, line, JSR_FOR);
     s->as.forStmt.init = init;
     s->as.forStmt.cond = cond;
     s->as.forStmt.act = act;
@@ -306,43 +333,46 @@ JStarStmt* jsrForStmt(int line, JStarStmt* init, JStarExpr* cond, JStarExpr* act
     return s;
 }
 
-JStarStmt* jsrForEachStmt(int line, JStarStmt* var, JStarExpr* iter, JStarStmt* body) {
-    JStarStmt* s = newStmt(line, JSR_FOREACH);
+JStarStmt* jsrForEachStmt(JStarASTArena* a, int line, JStarStmt* var, JStarExpr* iter,
+                          JStarStmt* body) {
+    JStarStmt* s = newStmt(a, line, JSR_FOREACH);
     s->as.forEach.var = var;
     s->as.forEach.iterable = iter;
     s->as.forEach.body = body;
     return s;
 }
 
-JStarStmt* jsrWhileStmt(int line, JStarExpr* cond, JStarStmt* body) {
-    JStarStmt* s = newStmt(line, JSR_WHILE);
+JStarStmt* jsrWhileStmt(JStarASTArena* a, int line, JStarExpr* cond, JStarStmt* body) {
+    JStarStmt* s = newStmt(a, line, JSR_WHILE);
     s->as.whileStmt.cond = cond;
     s->as.whileStmt.body = body;
     return s;
 }
 
-JStarStmt* jsrReturnStmt(int line, JStarExpr* e) {
-    JStarStmt* s = newStmt(line, JSR_RETURN);
+JStarStmt* jsrReturnStmt(JStarASTArena* a, int line, JStarExpr* e) {
+    JStarStmt* s = newStmt(a, line, JSR_RETURN);
     s->as.returnStmt.e = e;
     return s;
 }
 
-JStarStmt* jsrIfStmt(int line, JStarExpr* cond, JStarStmt* thenStmt, JStarStmt* elseStmt) {
-    JStarStmt* s = newStmt(line, JSR_IF);
+JStarStmt* jsrIfStmt(JStarASTArena* a, int line, JStarExpr* cond, JStarStmt* thenStmt,
+                     JStarStmt* elseStmt) {
+    JStarStmt* s = newStmt(a, line, JSR_IF);
     s->as.ifStmt.cond = cond;
     s->as.ifStmt.thenStmt = thenStmt;
     s->as.ifStmt.elseStmt = elseStmt;
     return s;
 }
 
-JStarStmt* jsrBlockStmt(int line, Vector* list) {
-    JStarStmt* s = newStmt(line, JSR_BLOCK);
+JStarStmt* jsrBlockStmt(JStarASTArena* a, int line, Vector* list) {
+    JStarStmt* s = newStmt(a, line, JSR_BLOCK);
     s->as.blockStmt.stmts = vecMove(list);
     return s;
 }
 
-JStarStmt* jsrImportStmt(int line, Vector* modules, Vector* impNames, JStarTok* as) {
-    JStarStmt* s = newStmt(line, JSR_IMPORT);
+JStarStmt* jsrImportStmt(JStarASTArena* a, int line, Vector* modules, Vector* impNames,
+                         JStarTok* as) {
+    JStarStmt* s = newStmt(a, line, JSR_IMPORT);
     s->as.importStmt.modules = vecMove(modules);
     s->as.importStmt.impNames = vecMove(impNames);
     s->as.importStmt.as.name = as->lexeme;
@@ -350,22 +380,24 @@ JStarStmt* jsrImportStmt(int line, Vector* modules, Vector* impNames, JStarTok*
     return s;
 }
 
-JStarStmt* jsrExprStmt(int line, JStarExpr* e) {
-    JStarStmt* s = newStmt(line, JSR_EXPR_STMT);
+JStarStmt* jsrExprStmt(JStarASTArena* a, int line, JStarExpr* e) {
+    JStarStmt* s = newStmt(a, line, JSR_EXPR_STMT);
     s->as.exprStmt = e;
     return s;
 }
 
-JStarStmt* jsrTryStmt(int line, JStarStmt* blck, Vector* excs, JStarStmt* ensure) {
-    JStarStmt* s = newStmt(line, JSR_TRY);
+JStarStmt* jsrTryStmt(JStarASTArena* a, int line, JStarStmt* blck, Vector* excs,
+                      JStarStmt* ensure) {
+    JStarStmt* s = newStmt(a, line, JSR_TRY);
     s->as.tryStmt.block = blck;
     s->as.tryStmt.excs = vecMove(excs);
     s->as.tryStmt.ensure = ensure;
     return s;
 }
 
-JStarStmt* jsrExceptStmt(int line, JStarExpr* cls, JStarTok* varName, JStarStmt* block) {
-    JStarStmt* s = newStmt(line, JSR_EXCEPT);
+JStarStmt* jsrExceptStmt(JStarASTArena* a, int line, JStarExpr* cls, JStarTok* varName,
+                         JStarStmt* block) {
+    JStarStmt* s = newStmt(a, line, JSR_EXCEPT);
     s->as.excStmt.block = block;
     s->as.excStmt.cls = cls;
     s->as.excStmt.var.length = varName->length;
@@ -373,26 +405,26 @@ JStarStmt* jsrExceptStmt(int line, JStarExpr* cls, JStarTok* varName, JStarStmt*
     return s;
 }
 
-JStarStmt* jsrRaiseStmt(int line, JStarExpr* e) {
-    JStarStmt* s = newStmt(line, JSR_RAISE);
+JStarStmt* jsrRaiseStmt(JStarASTArena* a, int line, JStarExpr* e) {
+    JStarStmt* s = newStmt(a, line, JSR_RAISE);
     s->as.raiseStmt.exc = e;
     return s;
 }
 
-JStarStmt* jsrContinueStmt(int line) {
-    JStarStmt* s = newStmt(line, JSR_CONTINUE);
+JStarStmt* jsrContinueStmt(JStarASTArena* a, int line) {
+    JStarStmt* s = newStmt(a, line, JSR_CONTINUE);
     s->as.exprStmt = NULL;
     return s;
 }
 
-JStarStmt* jsrBreakStmt(int line) {
-    JStarStmt* s = newStmt(line, JSR_BREAK);
+JStarStmt* jsrBreakStmt(JStarASTArena* a, int line) {
+    JStarStmt* s = newStmt(a, line, JSR_BREAK);
     s->as.exprStmt = NULL;
     return s;
 }
 
 void jsrStmtFree(JStarStmt* s) {
-    if(s == NULL) return;
+    if(s == NULL || s->inArena) return;
 
     switch(s->type) {
     case JSR_IF:
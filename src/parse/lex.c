@@ -1,6 +1,7 @@
 #include "parse/lex.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -9,50 +10,200 @@ const char* JStarTokName[] = {
 #include "parse/token.def"
 };
 
-typedef struct Keyword {
-    const char* name;
-    size_t length;
-    JStarTokType type;
-} Keyword;
-
-// clang-format off
-
-static Keyword keywords[] = {
-    {"and",      3, TOK_AND},
-    {"or",       2, TOK_OR},
-    {"class",    5, TOK_CLASS},
-    {"else",     4, TOK_ELSE},
-    {"false",    5, TOK_FALSE},
-    {"for",      3, TOK_FOR},
-    {"fun",      3, TOK_FUN},
-    {"native",   6, TOK_NAT},
-    {"if",       2, TOK_IF},
-    {"elif",     4, TOK_ELIF},
-    {"null",     4, TOK_NULL},
-    {"return",   6, TOK_RETURN},
-    {"super",    5, TOK_SUPER},
-    {"true",     4, TOK_TRUE},
-    {"var",      3, TOK_VAR},
-    {"while",    5, TOK_WHILE},
-    {"import",   6, TOK_IMPORT},
-    {"in",       2, TOK_IN},
-    {"begin",    5, TOK_BEGIN},
-    {"end",      3, TOK_END},
-    {"as",       2, TOK_AS},
-    {"is",       2, TOK_IS},
-    {"try",      3, TOK_TRY},
-    {"ensure",   6, TOK_ENSURE},
-    {"except",   6, TOK_EXCEPT},
-    {"raise",    5, TOK_RAISE},
-    {"with",     4, TOK_WITH},
-    {"continue", 8, TOK_CONTINUE},
-    {"break",    5, TOK_BREAK},
-    {"static",   6, TOK_STATIC},
-    // sentinel
-    {NULL,       0, TOK_EOF}
+// -----------------------------------------------------------------------------
+// CHARACTER CLASSES
+// -----------------------------------------------------------------------------
+
+#define CHAR_ALPHA 0x01
+#define CHAR_NUM   0x02
+#define CHAR_HEX   0x04
+
+#define CHAR_CLASS(c)                                                                     \
+    (uint8_t)(((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || (c) == '_'      \
+                  ? CHAR_ALPHA | ((c) >= 'a' && (c) <= 'f' ? CHAR_HEX : 0)                \
+                  : ((c) >= '0' && (c) <= '9' ? CHAR_NUM | CHAR_HEX : 0))
+
+#define CHAR_ROW(c)                                                                        \
+    CHAR_CLASS(c), CHAR_CLASS(c + 1), CHAR_CLASS(c + 2), CHAR_CLASS(c + 3), CHAR_CLASS(c + 4), \
+        CHAR_CLASS(c + 5), CHAR_CLASS(c + 6), CHAR_CLASS(c + 7), CHAR_CLASS(c + 8),            \
+        CHAR_CLASS(c + 9), CHAR_CLASS(c + 10), CHAR_CLASS(c + 11), CHAR_CLASS(c + 12),         \
+        CHAR_CLASS(c + 13), CHAR_CLASS(c + 14), CHAR_CLASS(c + 15)
+
+// Class of every byte, so that scanning numbers and identifiers takes one lookup per character
+static const uint8_t charClasses[256] = {
+    CHAR_ROW(0x00), CHAR_ROW(0x10), CHAR_ROW(0x20), CHAR_ROW(0x30),
+    CHAR_ROW(0x40), CHAR_ROW(0x50), CHAR_ROW(0x60), CHAR_ROW(0x70),
 };
 
-// clang-format on
+static bool isAlpha(char c) {
+    return charClasses[(uint8_t)c] & CHAR_ALPHA;
+}
+
+static bool isNum(char c) {
+    return charClasses[(uint8_t)c] & CHAR_NUM;
+}
+
+static bool isHex(char c) {
+    return charClasses[(uint8_t)c] & CHAR_HEX;
+}
+
+static bool isAlphaNum(char c) {
+    return charClasses[(uint8_t)c] & (CHAR_ALPHA | CHAR_NUM);
+}
+
+// -----------------------------------------------------------------------------
+// WORD SCANNING
+// -----------------------------------------------------------------------------
+
+// Long runs of spaces, comments and string bodies are scanned a word at a time, matching all of
+// its bytes in parallel with plain 64-bit arithmetic (see also ctrlgroup.h). Words are only
+// loaded when they lie entirely before the end of the source.
+
+#define WORD_SIZE 8
+#define WORD_LSB  ((uint64_t)0x0101010101010101)
+#define WORD_MSB  ((uint64_t)0x8080808080808080)
+
+static uint64_t loadWord(const char* p) {
+    // Always use little endian order, so that the lowest byte of a word is the first character
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+// Sets the high bit of the bytes equal to `c`. False positives are only possible in the bytes
+// following a real match, so the lowest set byte is always exact
+static uint64_t matchByte(uint64_t w, char c) {
+    uint64_t x = w ^ (WORD_LSB * (uint8_t)c);
+    return (x - WORD_LSB) & ~x & WORD_MSB;
+}
+
+// Returns the index of the first non zero byte in `w`, that must not be zero
+static size_t firstByte(uint64_t w) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctzll(w) >> 3;
+#else
+    size_t i = 0;
+    while(!(w & 0xff)) {
+        w >>= 8;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static bool hasWord(JStarLex* lex) {
+    return lex->end - lex->current >= WORD_SIZE;
+}
+
+static void skipSpaces(JStarLex* lex) {
+    while(hasWord(lex)) {
+        uint64_t nonSpaces = loadWord(lex->current) ^ (WORD_LSB * ' ');
+        if(nonSpaces) {
+            lex->current += firstByte(nonSpaces);
+            return;
+        }
+        lex->current += WORD_SIZE;
+    }
+
+    while(*lex->current == ' ') lex->current++;
+}
+
+// Skips characters that cannot end or alter the string being scanned
+static void skipStringChars(JStarLex* lex, char end) {
+    while(hasWord(lex)) {
+        uint64_t w = loadWord(lex->current);
+        uint64_t special = matchByte(w, end) | matchByte(w, '\\') | matchByte(w, '\n');
+        if(special) {
+            lex->current += firstByte(special);
+            return;
+        }
+        lex->current += WORD_SIZE;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// KEYWORDS
+// -----------------------------------------------------------------------------
+
+#define MATCH_KEYWORD(kw, tok) \
+    if(length == sizeof(kw) - 1 && memcmp(start, kw, sizeof(kw) - 1) == 0) return tok
+
+// Keywords are first dispatched on their initial character, leaving at most five to compare
+static JStarTokType identifierType(const char* start, size_t length) {
+    switch(*start) {
+    case 'a':
+        MATCH_KEYWORD("and", TOK_AND);
+        MATCH_KEYWORD("as", TOK_AS);
+        break;
+    case 'b':
+        MATCH_KEYWORD("begin", TOK_BEGIN);
+        MATCH_KEYWORD("break", TOK_BREAK);
+        break;
+    case 'c':
+        MATCH_KEYWORD("class", TOK_CLASS);
+        MATCH_KEYWORD("continue", TOK_CONTINUE);
+        break;
+    case 'e':
+        MATCH_KEYWORD("end", TOK_END);
+        MATCH_KEYWORD("else", TOK_ELSE);
+        MATCH_KEYWORD("elif", TOK_ELIF);
+        MATCH_KEYWORD("ensure", TOK_ENSURE);
+        MATCH_KEYWORD("except", TOK_EXCEPT);
+        break;
+    case 'f':
+        MATCH_KEYWORD("fun", TOK_FUN);
+        MATCH_KEYWORD("for", TOK_FOR);
+        MATCH_KEYWORD("false", TOK_FALSE);
+        break;
+    case 'i':
+        MATCH_KEYWORD("if", TOK_IF);
+        MATCH_KEYWORD("in", TOK_IN);
+        MATCH_KEYWORD("is", TOK_IS);
+        MATCH_KEYWORD("import", TOK_IMPORT);
+        break;
+    case 'n':
+        MATCH_KEYWORD("null", TOK_NULL);
+        MATCH_KEYWORD("native", TOK_NAT);
+        break;
+    case 'o':
+        MATCH_KEYWORD("or", TOK_OR);
+        break;
+    case 'r':
+        MATCH_KEYWORD("return", TOK_RETURN);
+        MATCH_KEYWORD("raise", TOK_RAISE);
+        break;
+    case 's':
+        MATCH_KEYWORD("super", TOK_SUPER);
+        MATCH_KEYWORD("static", TOK_STATIC);
+        break;
+    case 't':
+        MATCH_KEYWORD("true", TOK_TRUE);
+        MATCH_KEYWORD("try", TOK_TRY);
+        break;
+    case 'v':
+        MATCH_KEYWORD("var", TOK_VAR);
+        break;
+    case 'w':
+        MATCH_KEYWORD("while", TOK_WHILE);
+        MATCH_KEYWORD("with", TOK_WITH);
+        break;
+    case 'y':
+        MATCH_KEYWORD("yield", TOK_YIELD);
+        break;
+    default:
+        break;
+    }
+    return TOK_IDENTIFIER;
+}
+
+#undef MATCH_KEYWORD
+
+// -----------------------------------------------------------------------------
+// LEXER
+// -----------------------------------------------------------------------------
 
 static char advance(JStarLex* lex) {
     lex->current++;
@@ -85,6 +236,7 @@ void jsrInitLexer(JStarLex* lex, const char* src) {
     lex->source = src;
     lex->tokenStart = src;
     lex->current = src;
+    lex->end = src + strlen(src);
     lex->currLine = 1;
 
     // skip shabang if present
@@ -108,14 +260,17 @@ static void skipSpacesAndComments(JStarLex* lex) {
                 return;
             }
             break;
+        case ' ':
+            skipSpaces(lex);
+            break;
         case '\r':
         case '\t':
-        case ' ':
             advance(lex);
             break;
         case '/':
             if(peekChar2(lex) == '/') {
-                while(peekChar(lex) != '\n' && !isAtEnd(lex)) advance(lex);
+                const char* newline = memchr(lex->current, '\n', lex->end - lex->current);
+                lex->current = newline ? newline : lex->end;
             } else {
                 return;
             }
@@ -126,22 +281,6 @@ static void skipSpacesAndComments(JStarLex* lex) {
     }
 }
 
-static bool isAlpha(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
-}
-
-static bool isNum(char c) {
-    return c >= '0' && c <= '9';
-}
-
-static bool isHex(char c) {
-    return isNum(c) || (c >= 'a' && c <= 'f');
-}
-
-static bool isAlphaNum(char c) {
-    return isAlpha(c) || isNum(c);
-}
-
 static void makeToken(JStarLex* lex, JStarTok* tok, JStarTokType type) {
     tok->type = type;
     tok->lexeme = lex->tokenStart;
@@ -190,7 +329,9 @@ static void hexNumber(JStarLex* lex, JStarTok* tok) {
 }
 
 static bool stringBody(JStarLex* lex, char end) {
-    while(peekChar(lex) != end && !isAtEnd(lex)) {
+    for(;;) {
+        skipStringChars(lex, end);
+        if(peekChar(lex) == end || isAtEnd(lex)) break;
         if(peekChar(lex) == '\n') lex->currLine++;
         if(peekChar(lex) == '\\' && peekChar2(lex) != '\0') advance(lex);
         advance(lex);
@@ -215,17 +356,7 @@ static void string(JStarLex* lex, char end, JStarTok* tok) {
 
 static void identifier(JStarLex* lex, JStarTok* tok) {
     while(isAlphaNum(peekChar(lex))) advance(lex);
-    JStarTokType type = TOK_IDENTIFIER;
-
-    // See if the identifier is a reserved word.
-    size_t length = lex->current - lex->tokenStart;
-    for(Keyword* keyword = keywords; keyword->name != NULL; keyword++) {
-        if(length == keyword->length && memcmp(lex->tokenStart, keyword->name, length) == 0) {
-            type = keyword->type;
-            break;
-        }
-    }
-
+    JStarTokType type = identifierType(lex->tokenStart, lex->current - lex->tokenStart);
     makeToken(lex, tok, type);
 }
 
@@ -21,16 +21,20 @@ typedef struct Parser {
     const char* path;
     const char* lineStart;
     ParseErrorCB errorCallback;
+    JStarASTArena* arena;  // Arena the nodes are allocated in, NULL for heap allocated trees
     void* userData;
     bool panic, hadError;
+    bool isGenerator;  // Whether the function being parsed contains a `yield`
 } Parser;
 
-static void initParser(Parser* p, const char* path, const char* src, ParseErrorCB errFn,
-                       void* data) {
+static void initParser(Parser* p, const char* path, const char* src, JStarASTArena* arena,
+                       ParseErrorCB errFn, void* data) {
     p->panic = false;
     p->hadError = false;
+    p->isGenerator = false;
     p->path = path;
     p->errorCallback = errFn;
+    p->arena = arena;
     p->userData = data;
     jsrInitLexer(&p->lex, src);
     jsrNextToken(&p->lex, &p->peek);
@@ -259,7 +263,7 @@ static bool isExpressionStart(JStarTok* tok) {
     return t == TOK_NUMBER || t == TOK_TRUE || t == TOK_FALSE || t == TOK_IDENTIFIER ||
            t == TOK_STRING || t == TOK_NULL || t == TOK_SUPER || t == TOK_LPAREN ||
            t == TOK_LSQUARE || t == TOK_BANG || t == TOK_MINUS || t == TOK_FUN || t == TOK_HASH ||
-           t == TOK_HASH_HASH || t == TOK_LCURLY;
+           t == TOK_HASH_HASH || t == TOK_LCURLY || t == TOK_YIELD;
 }
 
 static bool isAssign(JStarTok* tok) {
@@ -324,7 +328,7 @@ typedef struct FormalArgs {
 } FormalArgs;
 
 static FormalArgs formalArgs(Parser* p, JStarTokType open, JStarTokType close) {
-    FormalArgs args = {0};
+    FormalArgs args = {vecNewArena(p->arena), vecNewArena(p->arena), false};
 
     require(p, open);
     skipNewLines(p);
@@ -339,7 +343,7 @@ static FormalArgs formalArgs(Parser* p, JStarTokType open, JStarTokType close) {
             break;
         }
 
-        vecPush(&args.arguments, jsrNewIdentifier(argument.length, argument.lexeme));
+        vecPush(&args.arguments, jsrNewIdentifier(p->arena, argument.length, argument.lexeme));
         skipNewLines(p);
 
         if(!match(p, close)) {
@@ -362,7 +366,7 @@ static FormalArgs formalArgs(Parser* p, JStarTokType open, JStarTokType close) {
             error(p, "Default argument must be a constant");
         }
 
-        vecPush(&args.arguments, jsrNewIdentifier(argument.length, argument.lexeme));
+        vecPush(&args.arguments, jsrNewIdentifier(p->arena, argument.length, argument.lexeme));
         vecPush(&args.defaults, constant);
 
         if(!match(p, close)) {
@@ -387,13 +391,13 @@ static JStarStmt* blockStmt(Parser* p) {
     int line = p->peek.line;
     skipNewLines(p);
 
-    Vector stmts = vecNew();
+    Vector stmts = vecNewArena(p->arena);
     while(!isImplicitEnd(&p->peek)) {
         vecPush(&stmts, parseStmt(p));
         skipNewLines(p);
     }
 
-    return jsrBlockStmt(line, &stmts);
+    return jsrBlockStmt(p->arena, line, &stmts);
 }
 
 static JStarStmt* ifBody(Parser* p, int line) {
@@ -411,7 +415,7 @@ static JStarStmt* ifBody(Parser* p, int line) {
         elseBody = blockStmt(p);
     }
 
-    return jsrIfStmt(line, cond, thenBody, elseBody);
+    return jsrIfStmt(p->arena, line, cond, thenBody, elseBody);
 }
 
 static JStarStmt* ifStmt(Parser* p) {
@@ -434,7 +438,7 @@ static JStarStmt* whileStmt(Parser* p) {
     JStarStmt* body = blockStmt(p);
     require(p, TOK_END);
 
-    return jsrWhileStmt(line, cond, body);
+    return jsrWhileStmt(p->arena, line, cond, body);
 }
 
 static JStarStmt* varDecl(Parser* p) {
@@ -443,11 +447,11 @@ static JStarStmt* varDecl(Parser* p) {
     skipNewLines(p);
 
     bool isUnpack = false;
-    Vector identifiers = vecNew();
+    Vector identifiers = vecNewArena(p->arena);
 
     do {
         JStarTok id = require(p, TOK_IDENTIFIER);
-        vecPush(&identifiers, jsrNewIdentifier(id.length, id.lexeme));
+        vecPush(&identifiers, jsrNewIdentifier(p->arena, id.length, id.lexeme));
 
         if(match(p, TOK_COMMA)) {
             advance(p);
@@ -464,7 +468,7 @@ static JStarStmt* varDecl(Parser* p) {
         init = expression(p, true);
     }
 
-    return jsrVarDecl(line, isUnpack, &identifiers, init);
+    return jsrVarDecl(p->arena, line, isUnpack, &identifiers, init);
 }
 
 static JStarStmt* forEach(Parser* p, JStarStmt* var, int line) {
@@ -479,7 +483,7 @@ static JStarStmt* forEach(Parser* p, JStarStmt* var, int line) {
     JStarStmt* body = blockStmt(p);
     require(p, TOK_END);
 
-    return jsrForEachStmt(line, var, e, body);
+    return jsrForEachStmt(p->arena, line, var, e, body);
 }
 
 static JStarStmt* forStmt(Parser* p) {
@@ -497,7 +501,7 @@ static JStarStmt* forStmt(Parser* p) {
             }
         } else {
             JStarExpr* e = expression(p, true);
-            init = jsrExprStmt(e->line, e);
+            init = jsrExprStmt(p->arena, e->line, e);
         }
     }
 
@@ -513,7 +517,7 @@ static JStarStmt* forStmt(Parser* p) {
     JStarStmt* body = blockStmt(p);
     require(p, TOK_END);
 
-    return jsrForStmt(line, init, cond, act, body);
+    return jsrForStmt(p->arena, line, init, cond, act, body);
 }
 
 static JStarStmt* returnStmt(Parser* p) {
@@ -526,7 +530,7 @@ static JStarStmt* returnStmt(Parser* p) {
     }
 
     requireStmtEnd(p);
-    return jsrReturnStmt(line, e);
+    return jsrReturnStmt(p->arena, line, e);
 }
 
 static JStarStmt* importStmt(Parser* p) {
@@ -534,18 +538,18 @@ static JStarStmt* importStmt(Parser* p) {
     advance(p);
     skipNewLines(p);
 
-    Vector modules = vecNew();
+    Vector modules = vecNewArena(p->arena);
 
     for(;;) {
         JStarTok name = require(p, TOK_IDENTIFIER);
-        vecPush(&modules, jsrNewIdentifier(name.length, name.lexeme));
+        vecPush(&modules, jsrNewIdentifier(p->arena, name.length, name.lexeme));
         if(!match(p, TOK_DOT)) break;
         advance(p);
         skipNewLines(p);
     }
 
     JStarTok asName = {0};
-    Vector importNames = vecNew();
+    Vector importNames = vecNewArena(p->arena);
 
     if(match(p, TOK_FOR)) {
         advance(p);
@@ -553,7 +557,7 @@ static JStarStmt* importStmt(Parser* p) {
 
         for(;;) {
             JStarTok name = require(p, TOK_IDENTIFIER);
-            vecPush(&importNames, jsrNewIdentifier(name.length, name.lexeme));
+            vecPush(&importNames, jsrNewIdentifier(p->arena, name.length, name.lexeme));
             if(!match(p, TOK_COMMA)) break;
             advance(p);
             skipNewLines(p);
@@ -565,7 +569,7 @@ static JStarStmt* importStmt(Parser* p) {
     }
 
     requireStmtEnd(p);
-    return jsrImportStmt(line, &modules, &importNames, &asName);
+    return jsrImportStmt(p->arena, line, &modules, &importNames, &asName);
 }
 
 static JStarStmt* tryStmt(Parser* p) {
@@ -573,7 +577,7 @@ static JStarStmt* tryStmt(Parser* p) {
     advance(p);
 
     JStarStmt* tryBlock = blockStmt(p);
-    Vector excs = vecNew();
+    Vector excs = vecNewArena(p->arena);
     JStarStmt* ensure = NULL;
 
     while(match(p, TOK_EXCEPT)) {
@@ -587,7 +591,7 @@ static JStarStmt* tryStmt(Parser* p) {
         JStarTok var = require(p, TOK_IDENTIFIER);
 
         JStarStmt* block = blockStmt(p);
-        vecPush(&excs, jsrExceptStmt(excLine, cls, &var, block));
+        vecPush(&excs, jsrExceptStmt(p->arena, excLine, cls, &var, block));
     }
 
     if(match(p, TOK_ENSURE)) {
@@ -600,7 +604,7 @@ static JStarStmt* tryStmt(Parser* p) {
     }
 
     require(p, TOK_END);
-    return jsrTryStmt(line, tryBlock, &excs, ensure);
+    return jsrTryStmt(p->arena, line, tryBlock, &excs, ensure);
 }
 
 static JStarStmt* raiseStmt(Parser* p) {
@@ -611,7 +615,7 @@ static JStarStmt* raiseStmt(Parser* p) {
     JStarExpr* exc = expression(p, true);
     requireStmtEnd(p);
 
-    return jsrRaiseStmt(line, exc);
+    return jsrRaiseStmt(p->arena, line, exc);
 }
 
 static JStarStmt* withStmt(Parser* p) {
@@ -626,7 +630,7 @@ static JStarStmt* withStmt(Parser* p) {
     JStarStmt* block = blockStmt(p);
     require(p, TOK_END);
 
-    return jsrWithStmt(line, e, &var, block);
+    return jsrWithStmt(p->arena, line, e, &var, block);
 }
 
 static JStarStmt* funcDecl(Parser* p) {
@@ -638,10 +642,19 @@ static JStarStmt* funcDecl(Parser* p) {
     skipNewLines(p);
 
     FormalArgs args = formalArgs(p, TOK_LPAREN, TOK_RPAREN);
+
+    bool enclosingGenerator = p->isGenerator;
+    p->isGenerator = false;
+
     JStarStmt* body = blockStmt(p);
     require(p, TOK_END);
 
-    return jsrFuncDecl(line, &funcName, &args.arguments, &args.defaults, args.isVararg, body);
+    JStarStmt* decl = jsrFuncDecl(p->arena, line, &funcName, &args.arguments, &args.defaults,
+                                  args.isVararg, body);
+    decl->as.funcDecl.isGenerator = p->isGenerator;
+    p->isGenerator = enclosingGenerator;
+
+    return decl;
 }
 
 static JStarStmt* nativeDecl(Parser* p) {
@@ -655,7 +668,7 @@ static JStarStmt* nativeDecl(Parser* p) {
     FormalArgs args = formalArgs(p, TOK_LPAREN, TOK_RPAREN);
     requireStmtEnd(p);
 
-    return jsrNativeDecl(line, &funcName, &args.arguments, &args.defaults, args.isVararg);
+    return jsrNativeDecl(p->arena, line, &funcName, &args.arguments, &args.defaults, args.isVararg);
 }
 
 static JStarStmt* classDecl(Parser* p) {
@@ -679,7 +692,7 @@ static JStarStmt* classDecl(Parser* p) {
 
     skipNewLines(p);
 
-    Vector methods = vecNew();
+    Vector methods = vecNewArena(p->arena);
     while(!match(p, TOK_END) && !match(p, TOK_EOF)) {
         switch(p->peek.type) {
         case TOK_NAT:
@@ -698,7 +711,7 @@ static JStarStmt* classDecl(Parser* p) {
     }
 
     require(p, TOK_END);
-    return jsrClassDecl(line, &clsName, sup, &methods);
+    return jsrClassDecl(p->arena, line, &clsName, sup, &methods);
 }
 
 static JStarStmt* parseStaticDecl(Parser* p) {
@@ -720,7 +733,7 @@ static JStarExpr* assignmentExpr(Parser* p, JStarExpr* l, bool parseTuple);
 static JStarStmt* exprStmt(Parser* p) {
     JStarExpr* l = tupleLiteral(p);
 
-    if(!isAssign(&p->peek) && !isCallExpression(l)) {
+    if(!isAssign(&p->peek) && !isCallExpression(l) && l->type != JSR_YIELD) {
         error(p, "Invalid syntax");
     }
 
@@ -728,7 +741,7 @@ static JStarStmt* exprStmt(Parser* p) {
         l = assignmentExpr(p, l, true);
     }
 
-    return jsrExprStmt(l->line, l);
+    return jsrExprStmt(p->arena, l->line, l);
 }
 
 static JStarStmt* parseStmt(Parser* p) {
@@ -773,11 +786,11 @@ static JStarStmt* parseStmt(Parser* p) {
     case TOK_CONTINUE:
         advance(p);
         requireStmtEnd(p);
-        return jsrContinueStmt(line);
+        return jsrContinueStmt(p->arena, line);
     case TOK_BREAK:
         advance(p);
         requireStmtEnd(p);
-        return jsrBreakStmt(line);
+        return jsrBreakStmt(p->arena, line);
     default:
         break;
     }
@@ -790,7 +803,7 @@ static JStarStmt* parseStmt(Parser* p) {
 static JStarStmt* parseProgram(Parser* p) {
     skipNewLines(p);
 
-    Vector stmts = vecNew();
+    Vector stmts = vecNewArena(p->arena);
     while(!match(p, TOK_EOF)) {
         vecPush(&stmts, parseStmt(p));
         skipNewLines(p);
@@ -798,8 +811,8 @@ static JStarStmt* parseProgram(Parser* p) {
     }
 
     // Top level function doesn't have name or arguments, so pass them empty
-    return jsrFuncDecl(0, &(JStarTok){0}, &(Vector){0}, &(Vector){0}, false,
-                       jsrBlockStmt(0, &stmts));
+    return jsrFuncDecl(p->arena, 0, &(JStarTok){0}, &(Vector){0}, &(Vector){0}, false,
+                       jsrBlockStmt(p->arena, 0, &stmts));
 }
 
 // -----------------------------------------------------------------------------
@@ -811,7 +824,7 @@ static JStarExpr* expressionLst(Parser* p, JStarTokType open, JStarTokType close
     require(p, open);
     skipNewLines(p);
 
-    Vector exprs = vecNew();
+    Vector exprs = vecNewArena(p->arena);
     while(!match(p, close)) {
         vecPush(&exprs, expression(p, false));
         skipNewLines(p);
@@ -821,7 +834,7 @@ static JStarExpr* expressionLst(Parser* p, JStarTokType open, JStarTokType close
     }
 
     require(p, close);
-    return jsrExprList(line, &exprs);
+    return jsrExprList(p->arena, line, &exprs);
 }
 
 static JStarExpr* parseTableLiteral(Parser* p) {
@@ -829,13 +842,13 @@ static JStarExpr* parseTableLiteral(Parser* p) {
     advance(p);
     skipNewLines(p);
 
-    Vector keyVals = vecNew();
+    Vector keyVals = vecNewArena(p->arena);
     while(!match(p, TOK_RCURLY)) {
         JStarExpr* key;
         if(match(p, TOK_DOT)) {
             advance(p);
             JStarTok id = require(p, TOK_IDENTIFIER);
-            key = jsrStrLiteral(id.line, id.lexeme, id.length);
+            key = jsrStrLiteral(p->arena, id.line, id.lexeme, id.length);
         } else {
             key = expression(p, false);
         }
@@ -859,7 +872,7 @@ static JStarExpr* parseTableLiteral(Parser* p) {
     }
 
     require(p, TOK_RCURLY);
-    return jsrTableLiteral(line, jsrExprList(line, &keyVals));
+    return jsrTableLiteral(p->arena, line, jsrExprList(p->arena, line, &keyVals));
 }
 
 static JStarExpr* parseSuperLiteral(Parser* p) {
@@ -884,12 +897,12 @@ static JStarExpr* parseSuperLiteral(Parser* p) {
             unpackArg = true;
         }
     } else if(match(p, TOK_LCURLY)) {
-        Vector tableCallArgs = vecNew();
+        Vector tableCallArgs = vecNewArena(p->arena);
         vecPush(&tableCallArgs, parseTableLiteral(p));
-        args = jsrExprList(line, &tableCallArgs);
+        args = jsrExprList(p->arena, line, &tableCallArgs);
     }
 
-    return jsrSuperLiteral(line, &name, args, unpackArg);
+    return jsrSuperLiteral(p->arena, line, &name, args, unpackArg);
 }
 
 static JStarExpr* literal(Parser* p) {
@@ -903,31 +916,31 @@ static JStarExpr* literal(Parser* p) {
         return parseTableLiteral(p);
     case TOK_TRUE:
         advance(p);
-        return jsrBoolLiteral(line, true);
+        return jsrBoolLiteral(p->arena, line, true);
     case TOK_FALSE:
         advance(p);
-        return jsrBoolLiteral(line, false);
+        return jsrBoolLiteral(p->arena, line, false);
     case TOK_NULL:
         advance(p);
-        return jsrNullLiteral(line);
+        return jsrNullLiteral(p->arena, line);
     case TOK_NUMBER: {
-        JStarExpr* e = jsrNumLiteral(line, strtod(tok->lexeme, NULL));
+        JStarExpr* e = jsrNumLiteral(p->arena, line, strtod(tok->lexeme, NULL));
         advance(p);
         return e;
     }
     case TOK_IDENTIFIER: {
-        JStarExpr* e = jsrVarLiteral(line, tok->lexeme, tok->length);
+        JStarExpr* e = jsrVarLiteral(p->arena, line, tok->lexeme, tok->length);
         advance(p);
         return e;
     }
     case TOK_STRING: {
-        JStarExpr* e = jsrStrLiteral(line, tok->lexeme + 1, tok->length - 2);
+        JStarExpr* e = jsrStrLiteral(p->arena, line, tok->lexeme + 1, tok->length - 2);
         advance(p);
         return e;
     }
     case TOK_LSQUARE: {
         JStarExpr* exprs = expressionLst(p, TOK_LSQUARE, TOK_RSQUARE);
-        return jsrArrLiteral(line, exprs);
+        return jsrArrLiteral(p->arena, line, exprs);
     }
     case TOK_LPAREN: {
         advance(p);
@@ -935,7 +948,7 @@ static JStarExpr* literal(Parser* p) {
 
         if(match(p, TOK_RPAREN)) {
             advance(p);
-            return jsrTupleLiteral(line, jsrExprList(line, &(Vector){0}));
+            return jsrTupleLiteral(p->arena, line, jsrExprList(p->arena, line, &(Vector){0}));
         }
 
         JStarExpr* e = expression(p, true);
@@ -959,7 +972,7 @@ static JStarExpr* literal(Parser* p) {
     }
 
     // Return dummy expression to avoid NULL
-    return jsrNullLiteral(line);
+    return jsrNullLiteral(p->arena, line);
 }
 
 static JStarExpr* postfixExpr(Parser* p) {
@@ -973,14 +986,14 @@ static JStarExpr* postfixExpr(Parser* p) {
             advance(p);
             skipNewLines(p);
             JStarTok attr = require(p, TOK_IDENTIFIER);
-            lit = jsrAccessExpr(line, lit, attr.lexeme, attr.length);
+            lit = jsrAccessExpr(p->arena, line, lit, attr.lexeme, attr.length);
             break;
         }
         case TOK_LCURLY: {
-            Vector tableCallArgs = vecNew();
+            Vector tableCallArgs = vecNewArena(p->arena);
             vecPush(&tableCallArgs, parseTableLiteral(p));
-            JStarExpr* args = jsrExprList(line, &tableCallArgs);
-            lit = jsrCallExpr(line, lit, args, false);
+            JStarExpr* args = jsrExprList(p->arena, line, &tableCallArgs);
+            lit = jsrCallExpr(p->arena, line, lit, args, false);
             break;
         }
         case TOK_LPAREN: {
@@ -990,13 +1003,13 @@ static JStarExpr* postfixExpr(Parser* p) {
                 advance(p);
                 unpackArg = true;
             }
-            lit = jsrCallExpr(line, lit, args, unpackArg);
+            lit = jsrCallExpr(p->arena, line, lit, args, unpackArg);
             break;
         }
         case TOK_LSQUARE: {
             require(p, TOK_LSQUARE);
             skipNewLines(p);
-            lit = jsrArrayAccExpr(line, lit, expression(p, true));
+            lit = jsrArrayAccExpr(p->arena, line, lit, expression(p, true));
             skipNewLines(p);
             require(p, TOK_RSQUARE);
             break;
@@ -1018,7 +1031,7 @@ static JStarExpr* powExpr(Parser* p) {
         JStarTok powOp = advance(p);
         skipNewLines(p);
         JStarExpr* exp = unaryExpr(p);
-        base = jsrPowExpr(powOp.line, base, exp);
+        base = jsrPowExpr(p->arena, powOp.line, base, exp);
     }
 
     return base;
@@ -1030,7 +1043,7 @@ static JStarExpr* unaryExpr(Parser* p) {
     if(matchAny(p, tokens, ARRAY_SIZE(tokens))) {
         JStarTok op = advance(p);
         skipNewLines(p);
-        return jsrUnaryExpr(op.line, op.type, unaryExpr(p));
+        return jsrUnaryExpr(p->arena, op.line, op.type, unaryExpr(p));
     }
 
     return powExpr(p);
@@ -1044,7 +1057,7 @@ static JStarExpr* parseBinary(Parser* p, JStarTokType* tokens, int count,
         JStarTok op = advance(p);
         skipNewLines(p);
         JStarExpr* r = (*operand)(p);
-        l = jsrBinaryExpr(op.line, op.type, l, r);
+        l = jsrBinaryExpr(p->arena, op.line, op.type, l, r);
     }
 
     return l;
@@ -1109,7 +1122,7 @@ static JStarExpr* ternaryExpr(Parser* p) {
         skipNewLines(p);
 
         JStarExpr* elseExpr = ternaryExpr(p);
-        return jsrTernaryExpr(line, cond, expr, elseExpr);
+        return jsrTernaryExpr(p->arena, line, cond, expr, elseExpr);
     }
 
     return expr;
@@ -1122,10 +1135,19 @@ static JStarExpr* funcLiteral(Parser* p) {
         skipNewLines(p);
 
         FormalArgs args = formalArgs(p, TOK_LPAREN, TOK_RPAREN);
+
+        bool enclosingGenerator = p->isGenerator;
+        p->isGenerator = false;
+
         JStarStmt* body = blockStmt(p);
         require(p, TOK_END);
 
-        return jsrFuncLiteral(line, &args.arguments, &args.defaults, args.isVararg, body);
+        JStarExpr* e = jsrFuncLiteral(p->arena, line, &args.arguments, &args.defaults,
+                                      args.isVararg, body);
+        e->as.funLit.func->as.funcDecl.isGenerator = p->isGenerator;
+        p->isGenerator = enclosingGenerator;
+
+        return e;
     }
     if(match(p, TOK_PIPE)) {
         int line = p->peek.line;
@@ -1135,12 +1157,33 @@ static JStarExpr* funcLiteral(Parser* p) {
         require(p, TOK_ARROW);
         skipNewLines(p);
 
+        bool enclosingGenerator = p->isGenerator;
+        p->isGenerator = false;
+
         JStarExpr* e = expression(p, false);
-        Vector anonFuncStmts = vecNew();
-        vecPush(&anonFuncStmts, jsrReturnStmt(line, e));
-        JStarStmt* body = jsrBlockStmt(line, &anonFuncStmts);
+        Vector anonFuncStmts = vecNewArena(p->arena);
+        vecPush(&anonFuncStmts, jsrReturnStmt(p->arena, line, e));
+        JStarStmt* body = jsrBlockStmt(p->arena, line, &anonFuncStmts);
 
-        return jsrFuncLiteral(line, &args.arguments, &args.defaults, args.isVararg, body);
+        JStarExpr* lit = jsrFuncLiteral(p->arena, line, &args.arguments, &args.defaults,
+                                        args.isVararg, body);
+        lit->as.funLit.func->as.funcDecl.isGenerator = p->isGenerator;
+        p->isGenerator = enclosingGenerator;
+
+        return lit;
+    }
+    if(match(p, TOK_YIELD)) {
+        int line = p->peek.line;
+        advance(p);
+        p->isGenerator = true;
+
+        // The yielded value is optional, as in `var sent = yield`
+        JStarExpr* e = NULL;
+        if(isExpressionStart(&p->peek)) {
+            e = expression(p, false);
+        }
+
+        return jsrYieldExpr(p->arena, line, e);
     }
     return ternaryExpr(p);
 }
@@ -1150,7 +1193,7 @@ static JStarExpr* tupleLiteral(Parser* p) {
     JStarExpr* e = funcLiteral(p);
 
     if(match(p, TOK_COMMA)) {
-        Vector exprs = vecNew();
+        Vector exprs = vecNewArena(p->arena);
         vecPush(&exprs, e);
 
         while(match(p, TOK_COMMA)) {
@@ -1159,7 +1202,7 @@ static JStarExpr* tupleLiteral(Parser* p) {
             vecPush(&exprs, funcLiteral(p));
         }
 
-        e = jsrTupleLiteral(line, jsrExprList(line, &exprs));
+        e = jsrTupleLiteral(p->arena, line, jsrExprList(p->arena, line, &exprs));
     }
 
     return e;
@@ -1172,9 +1215,9 @@ static JStarExpr* assignmentExpr(Parser* p, JStarExpr* l, bool parseTuple) {
 
     if(isCompoundAssign(&assignToken)) {
         JStarTokType op = assignToOperator(assignToken.type);
-        l = jsrCompundAssExpr(assignToken.line, op, l, r);
+        l = jsrCompundAssExpr(p->arena, assignToken.line, op, l, r);
     } else {
-        l = jsrAssignExpr(assignToken.line, l, r);
+        l = jsrAssignExpr(p->arena, assignToken.line, l, r);
     }
 
     return l;
@@ -1195,10 +1238,15 @@ static JStarExpr* expression(Parser* p, bool parseTuple) {
 // -----------------------------------------------------------------------------
 
 JStarStmt* jsrParse(const char* path, const char* src, ParseErrorCB errFn, void* data) {
+    return jsrParseArena(path, src, NULL, errFn, data);
+}
+
+JStarStmt* jsrParseArena(const char* path, const char* src, JStarASTArena* arena,
+                         ParseErrorCB errFn, void* data) {
     PROFILE_FUNC()
 
     Parser p;
-    initParser(&p, path, src, errFn, data);
+    initParser(&p, path, src, arena, errFn, data);
 
     JStarStmt* program = parseProgram(&p);
     skipNewLines(&p);
@@ -1215,11 +1263,43 @@ JStarStmt* jsrParse(const char* path, const char* src, ParseErrorCB errFn, void*
     return program;
 }
 
+bool jsrParseStream(const char* path, const char* src, JStarASTArena* arena, ParseStmtCB stmtFn,
+                    ParseErrorCB errFn, void* data) {
+    PROFILE_FUNC()
+
+    Parser p;
+    initParser(&p, path, src, arena, errFn, data);
+    skipNewLines(&p);
+
+    while(!match(&p, TOK_EOF)) {
+        JStarStmt* stmt = parseStmt(&p);
+        if(!p.hadError) {
+            stmtFn(stmt, data);
+        }
+
+        if(arena) {
+            jsrResetASTArena(arena);
+        } else {
+            jsrStmtFree(stmt);
+        }
+
+        skipNewLines(&p);
+        if(p.panic) synchronize(&p);
+    }
+
+    return !p.hadError;
+}
+
 JStarExpr* jsrParseExpression(const char* path, const char* src, ParseErrorCB errFn, void* data) {
+    return jsrParseExpressionArena(path, src, NULL, errFn, data);
+}
+
+JStarExpr* jsrParseExpressionArena(const char* path, const char* src, JStarASTArena* arena,
+                                   ParseErrorCB errFn, void* data) {
     PROFILE_FUNC()
 
     Parser p;
-    initParser(&p, path, src, errFn, data);
+    initParser(&p, path, src, arena, errFn, data);
 
     JStarExpr* expr = expression(&p, true);
     skipNewLines(&p);
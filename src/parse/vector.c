@@ -12,11 +12,17 @@ static void reset(Vector* vec) {
     vec->size = 0;
     vec->capacity = 0;
     vec->data = NULL;
+    vec->arena = NULL;
 }
 
 static void reallocVector(Vector* vec, size_t capacity) {
+    if(vec->arena) {
+        vec->data = jsrASTArenaRealloc(vec->arena, vec->data, sizeof(void*) * vec->capacity,
+                                       sizeof(void*) * capacity);
+    } else {
+        vec->data = realloc(vec->data, sizeof(void*) * capacity);
+    }
     vec->capacity = capacity;
-    vec->data = realloc(vec->data, sizeof(void*) * capacity);
     ASSERT(vec->data, "realloc failed");
 }
 
@@ -35,6 +41,13 @@ Vector vecNew(void) {
     return vec;
 }
 
+Vector vecNewArena(JStarASTArena* arena) {
+    Vector vec;
+    reset(&vec);
+    vec.arena = arena;
+    return vec;
+}
+
 Vector vecCopy(const Vector* vec) {
     Vector copy;
     reset(&copy);
@@ -45,8 +58,9 @@ Vector vecCopy(const Vector* vec) {
 }
 
 void vecCopyAssign(Vector* dest, const Vector* src) {
-    free(dest->data);
-    reset(dest);
+    JStarASTArena* arena = dest->arena;
+    vecFree(dest);
+    dest->arena = arena;
     vecReserve(dest, src->size);
     memcpy(dest->data, src->data, sizeof(void*) * src->size);
     dest->size = src->size;
@@ -65,7 +79,7 @@ void vecMoveAssign(Vector* dest, Vector* src) {
 }
 
 void vecFree(Vector* vec) {
-    free(vec->data);
+    if(!vec->arena) free(vec->data);
     reset(vec);
 }
 
@@ -0,0 +1,260 @@
+#include "sampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+#include "profiler.h"
+#include "util.h"
+#include "vm.h"
+
+#if defined(JSTAR_POSIX)
+    #include <signal.h>
+    #include <sys/time.h>
+#endif
+
+#define ENTRIES_DEFAULT_SZ 64
+#define ENTRIES_GROW_RATE  2
+#define STACK_DEFAULT_SZ   256
+
+// Samples deeper than this only record their innermost frames
+#define MAX_SAMPLE_DEPTH 128
+
+struct SampleEntry {
+    char* stack;  // NULL for empty slots
+    uint32_t hash;
+    uint64_t count;
+};
+
+void initSampler(Sampler* s) {
+    *s = (Sampler){0};
+}
+
+static void clearSamples(Sampler* s) {
+    for(size_t i = 0; i < s->entryCapacity; i++) {
+        free(s->entries[i].stack);
+    }
+    free(s->entries);
+    s->entries = NULL;
+    s->entryCount = s->entryCapacity = 0;
+    s->samples = 0;
+}
+
+void freeSampler(Sampler* s) {
+    clearSamples(s);
+    free(s->stack);
+    initSampler(s);
+}
+
+static SampleEntry* findEntry(SampleEntry* entries, size_t capacity, const char* stack,
+                              uint32_t hash) {
+    size_t i = hash & (capacity - 1);
+    for(;;) {
+        SampleEntry* e = &entries[i];
+        if(e->stack == NULL || (e->hash == hash && strcmp(e->stack, stack) == 0)) {
+            return e;
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+}
+
+static void growEntries(Sampler* s) {
+    size_t capacity = s->entryCapacity ? s->entryCapacity * ENTRIES_GROW_RATE : ENTRIES_DEFAULT_SZ;
+    SampleEntry* entries = calloc(capacity, sizeof(SampleEntry));
+
+    for(size_t i = 0; i < s->entryCapacity; i++) {
+        SampleEntry* e = &s->entries[i];
+        if(e->stack) {
+            *findEntry(entries, capacity, e->stack, e->hash) = *e;
+        }
+    }
+
+    free(s->entries);
+    s->entries = entries;
+    s->entryCapacity = capacity;
+}
+
+static void appendFrame(Sampler* s, size_t* length, const char* sep, const FrameInfo* info) {
+    for(;;) {
+        char* end = s->stack + *length;
+        size_t avail = s->stackCapacity - *length;
+
+        int n;
+        if(info->line >= 0) {
+            n = snprintf(end, avail, "%s%s.%s:%d", sep, info->moduleName, info->funcName,
+                         info->line);
+        } else {
+            n = snprintf(end, avail, "%s%s.%s", sep, info->moduleName, info->funcName);
+        }
+
+        if((size_t)n < avail) {
+            *length += n;
+            return;
+        }
+
+        s->stackCapacity *= 2;
+        s->stack = realloc(s->stack, s->stackCapacity);
+    }
+}
+
+static FrameRecord frameRecord(const Frame* f) {
+    if(f->fn->type == OBJ_NATIVE) {
+        return (FrameRecord){f->fn, 0, 0};
+    }
+
+    ObjFunction* fn = ((ObjClosure*)f->fn)->fn;
+    const Code* code = &fn->code;
+    size_t op = f->ip > code->bytecode ? (size_t)(f->ip - code->bytecode - 1) : 0;
+    return (FrameRecord){(Obj*)fn, op < code->size ? op : code->size - 1, 0};
+}
+
+void sampleStack(JStarVM* vm) {
+    PROFILE_FUNC()
+
+    Sampler* s = &vm->sampler;
+    if(!s->active || vm->frameCount == 0) return;
+
+    int first = vm->frameCount > MAX_SAMPLE_DEPTH ? vm->frameCount - MAX_SAMPLE_DEPTH : 0;
+    size_t length = 0;
+    if(first > 0) {
+        memcpy(s->stack, "...", 4);
+        length = 3;
+    }
+
+    for(int i = first; i < vm->frameCount; i++) {
+        FrameRecord record = frameRecord(&vm->frames[i]);
+        FrameInfo info = stacktraceFrameInfo(&record);
+        appendFrame(s, &length, length ? ";" : "", &info);
+    }
+
+    if(s->entryCount + 1 > s->entryCapacity * 3 / 4) {
+        growEntries(s);
+    }
+
+    uint32_t hash = hashBytes(s->stack, length);
+    SampleEntry* e = findEntry(s->entries, s->entryCapacity, s->stack, hash);
+    if(e->stack == NULL) {
+        e->stack = malloc(length + 1);
+        memcpy(e->stack, s->stack, length + 1);
+        e->hash = hash;
+        e->count = 0;
+        s->entryCount++;
+    }
+
+    e->count++;
+    s->samples++;
+}
+
+// -----------------------------------------------------------------------------
+// PROFILING TIMER
+// -----------------------------------------------------------------------------
+
+#if defined(JSTAR_POSIX)
+
+static JStarVM* volatile profiledVM;
+static struct sigaction prevAction;
+
+static void onProfileTimer(int sig) {
+    (void)sig;
+    JStarVM* vm = profiledVM;
+    if(vm != NULL) {
+        vm->sampleRequest = 1;
+        vm->evalBreak = 1;
+    }
+}
+
+static bool startTimer(JStarVM* vm, int interval) {
+    if(profiledVM != NULL) return false;
+    profiledVM = vm;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &onProfileTimer;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &prevAction);
+
+    struct timeval period = {interval / 1000000, interval % 1000000};
+    struct itimerval timer = {period, period};
+    if(setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        sigaction(SIGPROF, &prevAction, NULL);
+        profiledVM = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void stopTimer(void) {
+    struct itimerval timer = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &prevAction, NULL);
+    profiledVM = NULL;
+}
+
+#else
+
+static bool startTimer(JStarVM* vm, int interval) {
+    (void)vm;
+    (void)interval;
+    return false;
+}
+
+static void stopTimer(void) {
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// API
+// -----------------------------------------------------------------------------
+
+bool jsrStartProfiler(JStarVM* vm, int interval) {
+    Sampler* s = &vm->sampler;
+    if(s->active || interval <= 0) return false;
+
+    clearSamples(s);
+    if(s->stack == NULL) {
+        s->stack = malloc(STACK_DEFAULT_SZ);
+        s->stackCapacity = STACK_DEFAULT_SZ;
+    }
+
+    s->active = true;
+    if(!startTimer(vm, interval)) {
+        s->active = false;
+        return false;
+    }
+
+    return true;
+}
+
+void jsrStopProfiler(JStarVM* vm) {
+    Sampler* s = &vm->sampler;
+    if(!s->active) return;
+    stopTimer();
+    s->active = false;
+    vm->sampleRequest = 0;
+}
+
+static int compareEntries(const void* a, const void* b) {
+    return strcmp((*(const SampleEntry**)a)->stack, (*(const SampleEntry**)b)->stack);
+}
+
+void jsrGetProfile(JStarVM* vm, JStarBuffer* out) {
+    const Sampler* s = &vm->sampler;
+    if(s->entryCount == 0) return;
+
+    const SampleEntry** sorted = malloc(sizeof(SampleEntry*) * s->entryCount);
+    size_t count = 0;
+    for(size_t i = 0; i < s->entryCapacity; i++) {
+        if(s->entries[i].stack) sorted[count++] = &s->entries[i];
+    }
+    qsort(sorted, count, sizeof(SampleEntry*), &compareEntries);
+
+    for(size_t i = 0; i < count; i++) {
+        jsrBufferAppendf(out, "%s %llu\n", sorted[i]->stack, (unsigned long long)sorted[i]->count);
+    }
+
+    free(sorted);
+}
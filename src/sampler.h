@@ -0,0 +1,33 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jstar.h"
+
+typedef struct SampleEntry SampleEntry;
+
+// Samples of the J* call stack taken by the sampling profiler.
+// A process wide timer signal requests a sample through the eval break flag of the profiled VM,
+// so samples are only taken at the points where the VM checks for interrupts, and cost nothing
+// in between. Every sample is stored as a folded stack (the names and lines of its frames, outermost
+// first, separated by ';') along with the number of times it has been seen.
+// Samples are kept in malloc'd memory, so that profiling doesn't perturb the GC.
+typedef struct Sampler {
+    bool active;
+    SampleEntry* entries;  // Open addressing hash table of folded stacks
+    size_t entryCount, entryCapacity;
+    char* stack;  // Scratch buffer used to format a sample
+    size_t stackCapacity;
+    uint64_t samples;  // Total number of samples taken
+} Sampler;
+
+void initSampler(Sampler* s);
+void freeSampler(Sampler* s);
+
+// Record the current call stack of the VM. Called by the eval loop when a sample is requested
+void sampleStack(JStarVM* vm);
+
+#endif
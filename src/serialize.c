@@ -5,9 +5,11 @@
 #include <string.h>
 
 #include "code.h"
+#include "compiler.h"
 #include "endianness.h"
 #include "gc.h"
 #include "object.h"
+#include "opcode.h"
 #include "profiler.h"
 #include "util.h"
 #include "value.h"
@@ -21,7 +23,8 @@ typedef enum ConstType {
     CONST_NULL = 3,
     CONST_STR = 4,
     CONST_FUN = 5,
-    CONST_NAT = 6
+    CONST_NAT = 6,
+    CONST_TUPLE = 7
 } ConstType;
 
 // -----------------------------------------------------------------------------
@@ -46,6 +49,15 @@ static void serializeByte(JStarBuffer* buf, uint8_t byte) {
     write(buf, &byte, sizeof(uint8_t));
 }
 
+// Variable length encoding of unsigned integers, 7 bits per byte starting from the lowest ones
+static void serializeVarint(JStarBuffer* buf, uint64_t num) {
+    while(num >= 0x80) {
+        serializeByte(buf, (uint8_t)(num | 0x80));
+        num >>= 7;
+    }
+    serializeByte(buf, (uint8_t)num);
+}
+
 static void serializeCString(JStarBuffer* buf, const char* string) {
     write(buf, string, strlen(string));
 }
@@ -77,6 +89,18 @@ static void serializeConstLiteral(JStarBuffer* buf, Value c) {
     } else if(IS_STRING(c)) {
         serializeByte(buf, CONST_STR);
         serializeString(buf, AS_STRING(c));
+    } else if(IS_TUPLE(c)) {
+        // Elements of a constant List or Table literal, always scalar literals
+        ObjTuple* tup = AS_TUPLE(c);
+        serializeByte(buf, CONST_TUPLE);
+        serializeVarint(buf, tup->size);
+        for(size_t i = 0; i < tup->size; i++) {
+            serializeConstLiteral(buf, tup->arr[i]);
+        }
+    } else if(IS_CLASS(c)) {
+        // The superclass stored in a method by its definition. The slot is a null placeholder
+        // in freshly compiled code
+        serializeByte(buf, CONST_NULL);
     } else {
         UNREACHABLE();
     }
@@ -101,7 +125,6 @@ static void serializeNative(JStarBuffer* buf, ObjNative* n) {
 }
 
 static void serializeConstants(JStarBuffer* buf, ValueArray* consts) {
-    serializeShort(buf, consts->size);
     for(int i = 0; i < consts->size; i++) {
         Value c = consts->arr[i];
         if(IS_FUNC(c)) {
@@ -116,22 +139,122 @@ static void serializeConstants(JStarBuffer* buf, ValueArray* consts) {
     }
 }
 
-static void serializeCode(JStarBuffer* buf, Code* c) {
-    // TODO: store (compressed) line information? maybe give option in application
+// The line table is stored as the differences between consecutive runs. Offsets always grow, while
+// lines can also go backwards, so their differences are zigzag encoded
+static void serializeLines(JStarBuffer* buf, Code* c) {
+    serializeVarint(buf, c->lineCount);
+
+    uint32_t offset = 0;
+    int32_t line = 0;
+    for(size_t i = 0; i < c->lineCount; i++) {
+        LineRun* run = &c->lines[i];
+        int64_t lineDelta = (int64_t)run->line - line;
+        serializeVarint(buf, run->offset - offset);
+        serializeVarint(buf, ((uint64_t)lineDelta << 1) ^ (uint64_t)(lineDelta >> 63));
+        offset = run->offset;
+        line = run->line;
+    }
+}
+
+static void serializeHandlers(JStarBuffer* buf, Code* c) {
+    serializeVarint(buf, c->handlerCount);
+    for(size_t i = 0; i < c->handlerCount; i++) {
+        Handler* h = &c->handlers[i];
+        serializeByte(buf, h->type);
+        serializeVarint(buf, h->start);
+        serializeVarint(buf, h->end - h->start);
+        serializeVarint(buf, h->address);
+        serializeVarint(buf, h->stackDepth);
+    }
+}
+
+static uint16_t readShortAt(const uint8_t* code, size_t i) {
+    return ((uint16_t)code[i] << 8) | code[i + 1];
+}
+
+// Finds the constant holding the name of the global at `slot`, i.e. the operand the instruction
+// had before being quickened
+static uint16_t globalNameConst(Code* c, ObjModule* mod, uint16_t slot) {
+    const HashTable* names = &mod->globalNames;
+    for(const Entry* e = names->entries; e < names->entries + names->sizeMask + 1; e++) {
+        if(e->key && (size_t)AS_NUM(e->value) == slot) {
+            for(int i = 0; i < c->consts.size; i++) {
+                Value v = c->consts.arr[i];
+                if(IS_STRING(v) && AS_STRING(v)->length == e->key->length &&
+                   memcmp(AS_STRING(v)->data, e->key->data, e->key->length) == 0) {
+                    return i;
+                }
+            }
+        }
+    }
+    UNREACHABLE();
+    return 0;
+}
 
-    // serialize bytecode
+// Serializes the bytecode, reverting the instructions quickened into module specific forms.
+// Arithmetic and comparisons specialized on their operands are left as they are, since the
+// specialized variants are valid everywhere and revert to the generic ones on their own
+static void serializeBytecode(JStarBuffer* buf, Code* c, ObjModule* mod) {
     serializeUint64(buf, c->size);
-    for(size_t i = 0; i < c->size; i++) {
-        serializeByte(buf, c->bytecode[i]);
+
+    for(size_t i = 0; i < c->size;) {
+        Opcode op = c->bytecode[i];
+        size_t size = opcodeArgsNumber(op) + 1;
+
+        if(op == OP_GET_GLOBAL_SLOT || op == OP_SET_GLOBAL_SLOT) {
+            uint16_t name = globalNameConst(c, mod, readShortAt(c->bytecode, i + 1));
+            serializeByte(buf, op == OP_GET_GLOBAL_SLOT ? OP_GET_GLOBAL : OP_SET_GLOBAL);
+            serializeShort(buf, name);
+        } else {
+            if(op == OP_CLOSURE) {
+                Value func = c->consts.arr[readShortAt(c->bytecode, i + 1)];
+                size += AS_FUNC(func)->upvalueCount * 2;
+            }
+            write(buf, c->bytecode + i, size);
+        }
+
+        i += size;
     }
+}
+
+static void serializeCode(JStarBuffer* buf, Code* c, ObjModule* mod) {
+    serializeBytecode(buf, c, mod);
+
+    serializeLines(buf, c);
+    serializeHandlers(buf, c);
+
+    // Inline caches are filled at runtime, we only need to know how many to allocate
+    serializeShort(buf, c->cacheCount);
 
     serializeConstants(buf, &c->consts);
 }
 
+static void patchUint64(JStarBuffer* buf, size_t offset, uint64_t num) {
+    uint64_t bigendian = htobe64(num);
+    memcpy(buf->data + offset, &bigendian, sizeof(uint64_t));
+}
+
 static void serializeFunction(JStarBuffer* buf, ObjFunction* f) {
     serializePrototype(buf, &f->proto);
     serializeByte(buf, f->upvalueCount);
-    serializeCode(buf, &f->code);
+
+    // The number of constants and the size of the body come first, so that lazy deserialization
+    // can create a stub for the function and skip over its body
+    serializeShort(buf, f->code.consts.size);
+
+    // The body of a stub is still in serialized form
+    if(f->lazy.data) {
+        serializeUint64(buf, f->lazy.size);
+        write(buf, f->lazy.data, f->lazy.size);
+        return;
+    }
+
+    size_t sizeOffset = buf->size;
+    serializeUint64(buf, 0);
+
+    size_t bodyStart = buf->size;
+    serializeCode(buf, &f->code, f->proto.module);
+    patchUint64(buf, sizeOffset, buf->size - bodyStart);
 }
 
 JStarBuffer serialize(JStarVM* vm, ObjFunction* fn) {
@@ -147,6 +270,7 @@ JStarBuffer serialize(JStarVM* vm, ObjFunction* fn) {
     serializeCString(&buf, SERIALIZED_HEADER);
     serializeByte(&buf, JSTAR_VERSION_MAJOR);
     serializeByte(&buf, JSTAR_VERSION_MINOR);
+    serializeByte(&buf, SERIALIZED_FORMAT_VERSION);
     serializeFunction(&buf, fn);
 
     jsrBufferShrinkToFit(&buf);
@@ -163,6 +287,9 @@ typedef struct Deserializer {
     JStarVM* vm;
     const JStarBuffer* buf;
     ObjModule* mod;
+    bool borrowCode;
+    bool lazy;   // Whether nested functions should be left as stubs
+    int depth;   // Nesting level of the function being deserialized
     size_t ptr;
 } Deserializer;
 
@@ -207,6 +334,20 @@ static bool deserializeByte(Deserializer* d, uint8_t* out) {
     return read(d, out, sizeof(uint8_t));
 }
 
+static bool deserializeVarint(Deserializer* d, uint64_t* out) {
+    uint64_t num = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if(!deserializeByte(d, &byte)) return false;
+        num |= (uint64_t)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) {
+            *out = num;
+            return true;
+        }
+    }
+    return false;
+}
+
 static bool deserializeCString(Deserializer* d, char* out, size_t size) {
     return read(d, out, size);
 }
@@ -248,6 +389,33 @@ static bool deserializeDouble(Deserializer* d, double* out) {
     return true;
 }
 
+static bool deserializeConstLiteral(Deserializer* d, ConstType type, Value* out);
+
+static bool deserializeConstTuple(Deserializer* d, Value* out) {
+    uint64_t size;
+    if(!deserializeVarint(d, &size)) return false;
+    // Every element takes at least its type byte
+    if(size > d->buf->size - d->ptr) return false;
+
+    JStarVM* vm = d->vm;
+    ObjTuple* tup = newTuple(vm, size);
+    jsrEnsureStack(vm, 1);
+    push(vm, OBJ_VAL(tup));
+
+    for(size_t i = 0; i < size; i++) {
+        uint8_t type;
+        if(!deserializeByte(d, &type) || type == CONST_TUPLE ||
+           !deserializeConstLiteral(d, type, &tup->arr[i])) {
+            pop(vm);
+            return false;
+        }
+        GC_WRITE_BARRIER(vm, tup);
+    }
+
+    *out = pop(vm);
+    return true;
+}
+
 static bool deserializeConstLiteral(Deserializer* d, ConstType type, Value* out) {
     switch(type) {
     case CONST_NUM: {
@@ -272,6 +440,8 @@ static bool deserializeConstLiteral(Deserializer* d, ConstType type, Value* out)
         *out = OBJ_VAL(str);
         return true;
     }
+    case CONST_TUPLE:
+        return deserializeConstTuple(d, out);
     default:
         return false;
     }
@@ -324,16 +494,9 @@ static bool deserializeNative(Deserializer* d, ObjNative** out) {
     return true;
 }
 
+// Constants are deserialized in the array allocated along with the function
 static bool deserializeConstants(Deserializer* d, ValueArray* consts) {
-    uint16_t constsSize;
-    if(!deserializeShort(d, &constsSize)) return false;
-
-    consts->arr = malloc(sizeof(Value) * constsSize);
-    zeroValueArray(consts->arr, constsSize);
-    consts->capacity = constsSize;
-    consts->size = constsSize;
-
-    for(int i = 0; i < constsSize; i++) {
+    for(int i = 0; i < consts->size; i++) {
         uint8_t constType;
         if(!deserializeByte(d, &constType)) return false;
 
@@ -359,20 +522,103 @@ static bool deserializeConstants(Deserializer* d, ValueArray* consts) {
     return true;
 }
 
+static bool deserializeLines(Deserializer* d, Code* c) {
+    uint64_t count;
+    if(!deserializeVarint(d, &count)) return false;
+    if(count > c->size) return false;
+
+    uint64_t offset = 0;
+    int64_t line = 0;
+    for(uint64_t i = 0; i < count; i++) {
+        uint64_t offsetDelta, lineDelta;
+        if(!deserializeVarint(d, &offsetDelta)) return false;
+        if(!deserializeVarint(d, &lineDelta)) return false;
+
+        offset += offsetDelta;
+        line += (int64_t)(lineDelta >> 1) ^ -(int64_t)(lineDelta & 1);
+        if(offset >= c->size || line < INT32_MIN || line > INT32_MAX) return false;
+
+        addLineRun(c, (uint32_t)offset, (int)line);
+    }
+
+    return true;
+}
+
+static bool deserializeHandlers(Deserializer* d, Code* c) {
+    uint64_t count;
+    if(!deserializeVarint(d, &count)) return false;
+    if(count > c->size) return false;
+
+    for(uint64_t i = 0; i < count; i++) {
+        uint8_t type;
+        uint64_t start, length, address, stackDepth;
+        if(!deserializeByte(d, &type)) return false;
+        if(!deserializeVarint(d, &start)) return false;
+        if(!deserializeVarint(d, &length)) return false;
+        if(!deserializeVarint(d, &address)) return false;
+        if(!deserializeVarint(d, &stackDepth)) return false;
+
+        if(type != HANDLER_ENSURE && type != HANDLER_EXCEPT) return false;
+        if(start > c->size || length > c->size - start || address >= c->size) return false;
+        if(stackDepth > MAX_LOCALS) return false;
+
+        Handler h = {type, (uint32_t)start, (uint32_t)(start + length), (uint32_t)address,
+                     (uint32_t)stackDepth};
+        addHandler(c, h);
+    }
+
+    return true;
+}
+
 static bool deserializeCode(Deserializer* d, Code* c) {
     uint64_t codeSize;
     if(!deserializeUint64(d, &codeSize)) return false;
 
-    c->bytecode = malloc(codeSize);
+    if(d->borrowCode) {
+        if(d->ptr + codeSize > d->buf->capacity) return false;
+        c->bytecode = (uint8_t*)d->buf->data + d->ptr;
+        c->borrowed = true;
+        d->ptr += codeSize;
+    } else {
+        c->bytecode = malloc(codeSize);
+        if(!read(d, c->bytecode, codeSize)) return false;
+    }
+
     c->size = codeSize;
     c->capacity = codeSize;
 
-    if(!read(d, c->bytecode, codeSize)) return false;
+    if(!deserializeLines(d, c)) return false;
+    if(!deserializeHandlers(d, c)) return false;
+
+    uint16_t cacheCount;
+    if(!deserializeShort(d, &cacheCount)) return false;
+    for(uint16_t i = 0; i < cacheCount; i++) {
+        addInlineCache(c);
+    }
+
     if(!deserializeConstants(d, &c->consts)) return false;
 
     return true;
 }
 
+static bool deserializeBody(Deserializer* d, ObjFunction* fn, uint64_t bodySize) {
+    if(bodySize > d->buf->size - d->ptr) return false;
+
+    // Leave the body for later, just remember where to find it
+    if(d->lazy && d->depth > 0) {
+        fn->lazy = (LazyBody){d->buf->data + d->ptr, bodySize, d->borrowCode};
+        d->ptr += bodySize;
+        return true;
+    }
+
+    size_t end = d->ptr + bodySize;
+    d->depth++;
+    bool ok = deserializeCode(d, &fn->code);
+    d->depth--;
+
+    return ok && d->ptr == end;
+}
+
 static bool deserializeFunction(Deserializer* d, ObjFunction** out) {
     JStarVM* vm = d->vm;
     ObjModule* mod = d->mod;
@@ -392,7 +638,22 @@ static bool deserializeFunction(Deserializer* d, ObjFunction** out) {
         return false;
     }
 
-    if(!deserializeCode(d, &fn->code)) {
+    uint16_t constsSize;
+    uint64_t bodySize;
+    if(!deserializeShort(d, &constsSize) || !deserializeUint64(d, &bodySize)) {
+        pop(vm);
+        return false;
+    }
+
+    // The constants array is allocated even for stubs, since a method definition stores the
+    // superclass in it before the method is ever called
+    ValueArray* consts = &fn->code.consts;
+    consts->arr = malloc(sizeof(Value) * constsSize);
+    zeroValueArray(consts->arr, constsSize);
+    consts->capacity = constsSize;
+    consts->size = constsSize;
+
+    if(!deserializeBody(d, fn, bodySize)) {
         pop(vm);
         return false;
     }
@@ -403,11 +664,50 @@ static bool deserializeFunction(Deserializer* d, ObjFunction** out) {
     return true;
 }
 
-ObjFunction* deserialize(JStarVM* vm, ObjModule* mod, const JStarBuffer* buf, JStarResult* res) {
+bool deserializeLazyBody(JStarVM* vm, ObjFunction* fn) {
+    PROFILE_FUNC()
+
+    LazyBody body = fn->lazy;
+    ASSERT(body.data, "Function body already deserialized");
+
+    JStarBuffer buf = jsrBufferWrap(vm, body.data, body.size);
+    Deserializer d = {vm, &buf, fn->proto.module, body.borrowCode, true, 1, 0};
+
+    // Keep the superclass set by the method definition (if any) alive, since its slot is going to
+    // be overwritten while deserializing the constants
+    ValueArray* consts = &fn->code.consts;
+    Value super = consts->size > SUPER_SLOT ? consts->arr[SUPER_SLOT] : NULL_VAL;
+    jsrEnsureStack(vm, 1);
+    push(vm, super);
+
+    bool ok = deserializeCode(&d, &fn->code) && isExausted(&d);
+    pop(vm);
+
+    if(!ok) {
+        freeCode(&fn->code);
+        initCode(&fn->code);
+        jsrRaise(vm, "Exception", "Malformed binary file for function `%s.%s`",
+                 fn->proto.module->name->data, fn->proto.name->data);
+        return false;
+    }
+
+    // Restore the superclass set by the method definition, if any
+    if(!IS_NULL(super)) {
+        consts->arr[SUPER_SLOT] = super;
+    }
+
+    fn->lazy = (LazyBody){0};
+    return true;
+}
+
+ObjFunction* deserialize(JStarVM* vm, ObjModule* mod, const JStarBuffer* buf,
+                         DeserializeMode mode, JStarResult* res) {
     PROFILE_FUNC()
 
     ASSERT(vm == buf->vm, "JStarBuffer isn't owned by provided vm");
-    Deserializer d = {vm, buf, mod, 0};
+    bool borrowCode = mode == DESERIALIZE_BORROW;
+    bool lazy = mode != DESERIALIZE_COPY;
+    Deserializer d = {vm, buf, mod, borrowCode, lazy, 0, 0};
 
     *res = JSR_DESERIALIZE_ERR;
 
@@ -415,11 +715,13 @@ ObjFunction* deserialize(JStarVM* vm, ObjModule* mod, const JStarBuffer* buf, JS
     if(!read(&d, header, SERIALIZED_HEADER_SZ)) return NULL;
     ASSERT(memcmp(header, SERIALIZED_HEADER, SERIALIZED_HEADER_SZ) == 0, "Header error");
 
-    uint8_t versionMajor, versionMinor;
+    uint8_t versionMajor, versionMinor, formatVersion;
     if(!deserializeByte(&d, &versionMajor)) return NULL;
     if(!deserializeByte(&d, &versionMinor)) return NULL;
+    if(!deserializeByte(&d, &formatVersion)) return NULL;
 
-    if(versionMajor != JSTAR_VERSION_MAJOR || versionMinor != JSTAR_VERSION_MINOR) {
+    if(versionMajor != JSTAR_VERSION_MAJOR || versionMinor != JSTAR_VERSION_MINOR ||
+       formatVersion != SERIALIZED_FORMAT_VERSION) {
         *res = JSR_VERSION_ERR;
         return NULL;
     }
@@ -9,8 +9,27 @@
 #define SERIALIZED_HEADER    "\xb5JsrC"
 #define SERIALIZED_HEADER_SZ (sizeof(SERIALIZED_HEADER) - 1)
 
+// Version of the instruction set and of the serialized code layout. Must be bumped on every
+// change to `opcode.def` or to the format, so that stale compiled files are rejected
+#define SERIALIZED_FORMAT_VERSION 10
+
+typedef enum DeserializeMode {
+    // Everything is copied out of the buffer
+    DESERIALIZE_COPY,
+    // Only the body of the top level function is deserialized, while nested functions are left as
+    // stubs pointing into the buffer until their first call. The buffer must outlive the module
+    DESERIALIZE_LAZY,
+    // Like DESERIALIZE_LAZY, but the bytecode of the functions also points directly into the
+    // buffer instead of being copied, so the buffer must be writable
+    DESERIALIZE_BORROW,
+} DeserializeMode;
+
 JStarBuffer serialize(JStarVM* vm, ObjFunction* f);
-ObjFunction* deserialize(JStarVM* vm, ObjModule* mod, const JStarBuffer* buf, JStarResult* res);
+ObjFunction* deserialize(JStarVM* vm, ObjModule* mod, const JStarBuffer* buf,
+                         DeserializeMode mode, JStarResult* res);
+// Deserializes the body of a function left as a stub by lazy deserialization.
+// Raises an exception and returns false if the body is malformed
+bool deserializeLazyBody(JStarVM* vm, ObjFunction* fn);
 bool isCompiledCode(const JStarBuffer* buf);
 
 #endif
@@ -0,0 +1,78 @@
+#include "slab.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profiler.h"
+
+#define SIZE_CLASS(size) (((size) + SLAB_GRANULE - 1) / SLAB_GRANULE - 1)
+
+void initSlab(SlabAllocator* s, JStarVM* vm, JStarPageAllocCB pageAlloc) {
+    s->vm = vm;
+    s->pageAlloc = pageAlloc;
+    s->pages = NULL;
+    for(int i = 0; i < SLAB_CLASSES; i++) {
+        s->freeLists[i] = NULL;
+    }
+}
+
+void freeSlab(SlabAllocator* s) {
+    SlabPage* page = s->pages;
+    while(page != NULL) {
+        SlabPage* next = page->next;
+        if(s->pageAlloc) {
+            s->pageAlloc(s->vm, page, 0);
+        } else {
+            free(page);
+        }
+        page = next;
+    }
+    initSlab(s, s->vm, s->pageAlloc);
+}
+
+static void newPage(SlabAllocator* s, int sizeClass) {
+    PROFILE_FUNC()
+
+    SlabPage* page = s->pageAlloc ? s->pageAlloc(s->vm, NULL, SLAB_PAGE_SIZE)
+                                  : malloc(SLAB_PAGE_SIZE);
+    if(!page) {
+        perror("Error");
+        abort();
+    }
+
+    page->next = s->pages;
+    s->pages = page;
+
+    // Thread all the blocks of the page in the free list of the size class, in address order
+    size_t blockSize = (sizeClass + 1) * SLAB_GRANULE;
+    char* start = (char*)page + SLAB_GRANULE;
+    size_t count = (SLAB_PAGE_SIZE - SLAB_GRANULE) / blockSize;
+
+    SlabBlock* head = s->freeLists[sizeClass];
+    for(size_t i = count; i > 0; i--) {
+        SlabBlock* b = (SlabBlock*)(start + (i - 1) * blockSize);
+        b->next = head;
+        head = b;
+    }
+    s->freeLists[sizeClass] = head;
+}
+
+void* slabAlloc(SlabAllocator* s, size_t size) {
+    if(size > SLAB_MAX_SIZE) return NULL;
+
+    int sizeClass = SIZE_CLASS(size);
+    if(s->freeLists[sizeClass] == NULL) {
+        newPage(s, sizeClass);
+    }
+
+    SlabBlock* b = s->freeLists[sizeClass];
+    s->freeLists[sizeClass] = b->next;
+    return b;
+}
+
+void slabFree(SlabAllocator* s, void* ptr, size_t size) {
+    int sizeClass = SIZE_CLASS(size);
+    SlabBlock* b = ptr;
+    b->next = s->freeLists[sizeClass];
+    s->freeLists[sizeClass] = b;
+}
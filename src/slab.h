@@ -0,0 +1,41 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+#include "jstar.h"
+
+// Allocations up to SLAB_MAX_SIZE bytes are rounded up to a multiple of SLAB_GRANULE and
+// served from per-size-class free lists, carved out of SLAB_PAGE_SIZE pages
+#define SLAB_GRANULE   16
+#define SLAB_MAX_SIZE  256
+#define SLAB_CLASSES   (SLAB_MAX_SIZE / SLAB_GRANULE)
+#define SLAB_PAGE_SIZE (64 * 1024)
+
+typedef struct SlabBlock {
+    struct SlabBlock* next;
+} SlabBlock;
+
+typedef struct SlabPage {
+    struct SlabPage* next;
+} SlabPage;
+
+// Size-class allocator used for the fixed-size part of objects. Freed blocks go back to the
+// free list of their class and are reused by the next allocation of the same size. Pages are
+// released only when the allocator is freed.
+typedef struct SlabAllocator {
+    JStarVM* vm;
+    JStarPageAllocCB pageAlloc;
+    SlabPage* pages;
+    SlabBlock* freeLists[SLAB_CLASSES];
+} SlabAllocator;
+
+void initSlab(SlabAllocator* s, JStarVM* vm, JStarPageAllocCB pageAlloc);
+void freeSlab(SlabAllocator* s);
+
+// Returns NULL if `size` is bigger than SLAB_MAX_SIZE
+void* slabAlloc(SlabAllocator* s, size_t size);
+// `size` must be the same one passed to slabAlloc
+void slabFree(SlabAllocator* s, void* ptr, size_t size);
+
+#endif
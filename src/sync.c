@@ -0,0 +1,241 @@
+#include "sync.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(JSTAR_POSIX)
+    #include <unistd.h>
+#endif
+
+#if defined(JSTAR_POSIX) || defined(JSTAR_WINDOWS)
+
+typedef struct ThreadStart {
+    void (*fn)(void*);
+    void* arg;
+} ThreadStart;
+
+static ThreadStart* newThreadStart(void (*fn)(void*), void* arg) {
+    ThreadStart* start = malloc(sizeof(*start));
+    start->fn = fn;
+    start->arg = arg;
+    return start;
+}
+
+static void runThreadStart(ThreadStart* start) {
+    void (*fn)(void*) = start->fn;
+    void* arg = start->arg;
+    free(start);
+    fn(arg);
+}
+
+#endif
+
+#if defined(JSTAR_POSIX)
+
+void initMutex(Mutex* m) {
+    pthread_mutex_init(&m->handle, NULL);
+}
+
+void freeMutex(Mutex* m) {
+    pthread_mutex_destroy(&m->handle);
+}
+
+void lockMutex(Mutex* m) {
+    pthread_mutex_lock(&m->handle);
+}
+
+void unlockMutex(Mutex* m) {
+    pthread_mutex_unlock(&m->handle);
+}
+
+void initCond(Cond* c) {
+    pthread_cond_init(&c->handle, NULL);
+}
+
+void freeCond(Cond* c) {
+    pthread_cond_destroy(&c->handle);
+}
+
+void waitCond(Cond* c, Mutex* m) {
+    pthread_cond_wait(&c->handle, &m->handle);
+}
+
+void signalCond(Cond* c) {
+    pthread_cond_signal(&c->handle);
+}
+
+void broadcastCond(Cond* c) {
+    pthread_cond_broadcast(&c->handle);
+}
+
+static void* threadMain(void* arg) {
+    runThreadStart(arg);
+    return NULL;
+}
+
+bool startThread(Thread* t, void (*fn)(void*), void* arg) {
+    ThreadStart* start = newThreadStart(fn, arg);
+    if(pthread_create(&t->handle, NULL, &threadMain, start) != 0) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void joinThread(Thread* t) {
+    pthread_join(t->handle, NULL);
+}
+
+void detachThread(Thread* t) {
+    pthread_detach(t->handle);
+}
+
+int cpuCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+double monotonicTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#elif defined(JSTAR_WINDOWS)
+
+void initMutex(Mutex* m) {
+    InitializeCriticalSection(&m->handle);
+}
+
+void freeMutex(Mutex* m) {
+    DeleteCriticalSection(&m->handle);
+}
+
+void lockMutex(Mutex* m) {
+    EnterCriticalSection(&m->handle);
+}
+
+void unlockMutex(Mutex* m) {
+    LeaveCriticalSection(&m->handle);
+}
+
+void initCond(Cond* c) {
+    InitializeConditionVariable(&c->handle);
+}
+
+void freeCond(Cond* c) {
+    (void)c;
+}
+
+void waitCond(Cond* c, Mutex* m) {
+    SleepConditionVariableCS(&c->handle, &m->handle, INFINITE);
+}
+
+void signalCond(Cond* c) {
+    WakeConditionVariable(&c->handle);
+}
+
+void broadcastCond(Cond* c) {
+    WakeAllConditionVariable(&c->handle);
+}
+
+static DWORD WINAPI threadMain(LPVOID arg) {
+    runThreadStart(arg);
+    return 0;
+}
+
+bool startThread(Thread* t, void (*fn)(void*), void* arg) {
+    ThreadStart* start = newThreadStart(fn, arg);
+    t->handle = CreateThread(NULL, 0, &threadMain, start, 0, NULL);
+    if(t->handle == NULL) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void joinThread(Thread* t) {
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+}
+
+void detachThread(Thread* t) {
+    CloseHandle(t->handle);
+}
+
+int cpuCount(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+double monotonicTime(void) {
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / freq.QuadPart;
+}
+
+#else
+
+void initMutex(Mutex* m) {
+    (void)m;
+}
+
+void freeMutex(Mutex* m) {
+    (void)m;
+}
+
+void lockMutex(Mutex* m) {
+    (void)m;
+}
+
+void unlockMutex(Mutex* m) {
+    (void)m;
+}
+
+void initCond(Cond* c) {
+    (void)c;
+}
+
+void freeCond(Cond* c) {
+    (void)c;
+}
+
+void waitCond(Cond* c, Mutex* m) {
+    (void)c;
+    (void)m;
+}
+
+void signalCond(Cond* c) {
+    (void)c;
+}
+
+void broadcastCond(Cond* c) {
+    (void)c;
+}
+
+bool startThread(Thread* t, void (*fn)(void*), void* arg) {
+    (void)t;
+    (void)fn;
+    (void)arg;
+    return false;
+}
+
+void joinThread(Thread* t) {
+    (void)t;
+}
+
+void detachThread(Thread* t) {
+    (void)t;
+}
+
+int cpuCount(void) {
+    return 1;
+}
+
+double monotonicTime(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#endif
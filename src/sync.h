@@ -0,0 +1,104 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "conf.h"
+
+#if defined(JSTAR_POSIX)
+    #include <pthread.h>
+#elif defined(JSTAR_WINDOWS)
+    #include <Windows.h>
+#endif
+
+// Mutual exclusion lock, used to protect the state shared between VMs running on different
+// threads. On platforms without threads locking is a no-op
+typedef struct Mutex {
+#if defined(JSTAR_POSIX)
+    pthread_mutex_t handle;
+#elif defined(JSTAR_WINDOWS)
+    CRITICAL_SECTION handle;
+#else
+    char unused;
+#endif
+} Mutex;
+
+void initMutex(Mutex* m);
+void freeMutex(Mutex* m);
+void lockMutex(Mutex* m);
+void unlockMutex(Mutex* m);
+
+// Condition variable, always used together with a locked Mutex.
+// On platforms without threads waiting returns immediately
+typedef struct Cond {
+#if defined(JSTAR_POSIX)
+    pthread_cond_t handle;
+#elif defined(JSTAR_WINDOWS)
+    CONDITION_VARIABLE handle;
+#else
+    char unused;
+#endif
+} Cond;
+
+void initCond(Cond* c);
+void freeCond(Cond* c);
+void waitCond(Cond* c, Mutex* m);
+void signalCond(Cond* c);
+void broadcastCond(Cond* c);
+
+// OS thread. A started thread must be either joined or detached exactly once
+typedef struct Thread {
+#if defined(JSTAR_POSIX)
+    pthread_t handle;
+#elif defined(JSTAR_WINDOWS)
+    HANDLE handle;
+#else
+    char unused;
+#endif
+} Thread;
+
+// Starts a thread running `fn(arg)`. Returns false if the thread couldn't be created, always the
+// case on platforms without threads
+bool startThread(Thread* t, void (*fn)(void*), void* arg);
+void joinThread(Thread* t);
+void detachThread(Thread* t);
+
+// Number of processors available to the process (at least 1)
+int cpuCount(void);
+
+// Seconds elapsed since an arbitrary point in time, from a monotonic clock when available
+double monotonicTime(void);
+
+// Lock free accesses to a value shared between two threads. A thread that reads with
+// `loadAcquire` the value written by `storeRelease` also sees all the writes made before the store
+#if defined(__GNUC__) || defined(__clang__)
+static inline size_t loadAcquire(const volatile size_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void storeRelease(volatile size_t* p, size_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#elif defined(JSTAR_WINDOWS)
+static inline size_t loadAcquire(const volatile size_t* p) {
+    size_t v = *p;
+    MemoryBarrier();
+    return v;
+}
+
+static inline void storeRelease(volatile size_t* p, size_t v) {
+    MemoryBarrier();
+    *p = v;
+}
+#else
+static inline size_t loadAcquire(const volatile size_t* p) {
+    return *p;
+}
+
+static inline void storeRelease(volatile size_t* p, size_t v) {
+    *p = v;
+}
+#endif
+
+#endif
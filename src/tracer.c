@@ -0,0 +1,121 @@
+#include "tracer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sync.h"
+#include "vm.h"
+
+void initTracer(Tracer* t) {
+    *t = (Tracer){0};
+}
+
+void freeTracer(Tracer* t) {
+    free(t->events);
+    initTracer(t);
+}
+
+// Returns the slot of the next event, or NULL after counting it as dropped if the buffer is full.
+// The event becomes visible to the consumer only once committed
+static JStarTraceEvent* reserveEvent(JStarVM* vm, JStarTraceEventType type, int depth) {
+    Tracer* t = &vm->tracer;
+    size_t head = t->head;
+    if(head - loadAcquire(&t->tail) == t->capacity) {
+        storeRelease(&t->dropped, t->dropped + 1);
+        return NULL;
+    }
+
+    JStarTraceEvent* e = &t->events[head & (t->capacity - 1)];
+    e->time = monotonicTime();
+    e->type = type;
+    e->depth = depth;
+    e->data[0] = e->data[1] = 0;
+    e->name[0] = '\0';
+    return e;
+}
+
+static void commitEvent(JStarVM* vm) {
+    storeRelease(&vm->tracer.head, vm->tracer.head + 1);
+}
+
+static void appendName(char* name, size_t* length, const char* str) {
+    size_t len = strlen(str);
+    size_t avail = JSR_TRACE_NAME_SIZE - 1 - *length;
+    if(len > avail) len = avail;
+    memcpy(name + *length, str, len);
+    *length += len;
+    name[*length] = '\0';
+}
+
+void traceFunction(JStarVM* vm, JStarTraceEventType type, const Prototype* proto, int depth,
+                   bool unwound) {
+    JStarTraceEvent* e = reserveEvent(vm, type, depth);
+    if(e == NULL) return;
+
+    size_t length = 0;
+    appendName(e->name, &length, proto->module->name->data);
+    appendName(e->name, &length, ".");
+    appendName(e->name, &length, proto->name ? proto->name->data : "<main>");
+
+    e->data[0] = proto->base.type == OBJ_NATIVE;
+    e->data[1] = unwound;
+    commitEvent(vm);
+}
+
+void traceNamed(JStarVM* vm, JStarTraceEventType type, const char* name, uint64_t data) {
+    JStarTraceEvent* e = reserveEvent(vm, type, vm->frameCount);
+    if(e == NULL) return;
+
+    size_t length = 0;
+    appendName(e->name, &length, name);
+    e->data[0] = data;
+    commitEvent(vm);
+}
+
+void traceGC(JStarVM* vm, JStarTraceEventType type, uint64_t data0, uint64_t data1) {
+    JStarTraceEvent* e = reserveEvent(vm, type, vm->frameCount);
+    if(e == NULL) return;
+
+    e->data[0] = data0;
+    e->data[1] = data1;
+    commitEvent(vm);
+}
+
+bool jsrStartTracing(JStarVM* vm, size_t capacity, uint32_t mask) {
+    mask &= JSR_TRACE_ALL;
+    if(capacity == 0 || mask == 0) return false;
+
+    size_t size = 1;
+    while(size < capacity) size *= 2;
+
+    Tracer* t = &vm->tracer;
+    freeTracer(t);
+    t->events = malloc(sizeof(JStarTraceEvent) * size);
+    t->capacity = size;
+    t->mask = mask;
+    return true;
+}
+
+void jsrStopTracing(JStarVM* vm) {
+    vm->tracer.mask = 0;
+}
+
+size_t jsrDrainTrace(JStarVM* vm, JStarTraceEvent* out, size_t max) {
+    Tracer* t = &vm->tracer;
+    if(t->events == NULL) return 0;
+
+    size_t tail = t->tail;
+    size_t count = loadAcquire(&t->head) - tail;
+    if(count > max) count = max;
+
+    for(size_t i = 0; i < count; i++) {
+        out[i] = t->events[(tail + i) & (t->capacity - 1)];
+    }
+
+    storeRelease(&t->tail, tail + count);
+    return count;
+}
+
+size_t jsrTraceDropped(JStarVM* vm) {
+    return loadAcquire(&vm->tracer.dropped);
+}
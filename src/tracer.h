@@ -0,0 +1,38 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jstar.h"
+#include "object.h"
+
+// Ring buffer of the events recorded by the tracer.
+// The VM thread is the only producer and advances `head`, a single draining thread is the only
+// consumer and advances `tail`. Both are free running counters, so the buffer is full when they
+// are `capacity` apart. Events are kept in malloc'd memory, so that tracing doesn't perturb the GC.
+typedef struct Tracer {
+    uint32_t mask;  // Events to record, checked by the hooks. 0 when tracing is stopped
+    JStarTraceEvent* events;
+    size_t capacity;  // Always a power of 2
+    volatile size_t head, tail;
+    volatile size_t dropped;  // Events not recorded because the buffer was full
+} Tracer;
+
+void initTracer(Tracer* t);
+void freeTracer(Tracer* t);
+
+// True if events of type `type` are being recorded. The hooks are guarded by this check, which is
+// the only cost of tracing when it's disabled
+#define TRACING(vm, type) (((vm)->tracer.mask & (type)) != 0)
+
+// Record the call or return of the function of `proto`, `depth` frames deep
+void traceFunction(JStarVM* vm, JStarTraceEventType type, const Prototype* proto, int depth,
+                   bool unwound);
+// Record an event carrying a name, like an import or an exception
+void traceNamed(JStarVM* vm, JStarTraceEventType type, const char* name, uint64_t data);
+// Record a garbage collection event
+void traceGC(JStarVM* vm, JStarTraceEventType type, uint64_t data0, uint64_t data1);
+
+#endif
@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 // Reinterprets the bits of the value `v` from type F to type T
 #define REINTERPRET_CAST(F, T, v) ((union {F from; T to;}){.from = (v)}.to)
@@ -14,15 +15,37 @@
 #define STRLEN_FOR_SIGNED(t)   (STRLEN_FOR_UNSIGNED(t) + 1)
 #define STRLEN_FOR_UNSIGNED(t) (((((sizeof(t) * CHAR_BIT)) * 1233) >> 12) + 1)
 
-// Utility function to hash arbitrary data
+// Utility function to hash arbitrary data.
+// Short inputs are hashed a byte at a time with FNV-1a, longer ones 8 bytes at a time with a
+// multiply and xor-shift mix, which is several times faster on long strings
 static inline uint32_t hashBytes(const void* data, size_t length) {
-    const char* str = data;
-    uint32_t hash = 2166136261u;
+    const unsigned char* str = data;
+
+    if(length < 16) {
+        uint32_t hash = 2166136261u;
+        for(size_t i = 0; i < length; i++) {
+            hash ^= str[i];
+            hash *= 16777619;
+        }
+        return hash;
+    }
+
+    uint64_t hash = length * UINT64_C(0x9e3779b97f4a7c15);
+    for(; length >= 8; str += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, str, sizeof(word));
+        hash = (hash ^ word) * UINT64_C(0xbf58476d1ce4e5b9);
+        hash ^= hash >> 31;
+    }
+
+    uint64_t tail = 0;
     for(size_t i = 0; i < length; i++) {
-        hash ^= str[i];
-        hash *= 16777619;
+        tail |= (uint64_t)str[i] << (i * 8);
     }
-    return hash;
+    hash = (hash ^ tail) * UINT64_C(0x94d049bb133111eb);
+    hash ^= hash >> 32;
+
+    return (uint32_t)hash;
 }
 
 // Debug assertions
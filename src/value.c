@@ -1,6 +1,8 @@
 #include "value.h"
 
 #include <float.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -39,7 +41,8 @@ void printValue(Value val) {
     } else if(IS_BOOL(val)) {
         printf(AS_BOOL(val) ? "true" : "false");
     } else if(IS_NUM(val)) {
-        printf("%.*g", DBL_DIG, AS_NUM(val));
+        char str[NUM_STR_MAX];
+        fwrite(str, 1, numberToString(AS_NUM(val), str), stdout);
     } else if(IS_HANDLE(val)) {
         printf("<handle:%p>", AS_HANDLE(val));
     } else if(IS_NULL(val)) {
@@ -47,6 +50,31 @@ void printValue(Value val) {
     }
 }
 
+int numberToString(double num, char* out) {
+    // Integers of up to DBL_DIG digits are printed in full by "%.15g", so their digits can be
+    // generated directly. Negative zero is left to printf, that prints it as "-0"
+    if(num > -1e15 && num < 1e15 && num == (int64_t)num && (num != 0 || !signbit(num))) {
+        uint64_t n = num < 0 ? -(int64_t)num : (int64_t)num;
+
+        char digits[DBL_DIG];
+        int count = 0;
+        do {
+            digits[count++] = '0' + n % 10;
+            n /= 10;
+        } while(n != 0);
+
+        int len = 0;
+        if(num < 0) out[len++] = '-';
+        while(count > 0) {
+            out[len++] = digits[--count];
+        }
+        out[len] = '\0';
+        return len;
+    }
+
+    return snprintf(out, NUM_STR_MAX, "%.*g", DBL_DIG, num);
+}
+
 extern inline bool valueIsInt(Value v);
 extern inline bool valueEquals(Value v1, Value v2);
 extern inline bool valueToBool(Value v);
\ No newline at end of file
@@ -204,4 +204,11 @@ int valueArrayAppend(ValueArray* a, Value v);
 
 void printValue(Value val);
 
+// Maximum length of the String representation of a Number, including the terminating NUL
+#define NUM_STR_MAX 24
+
+// Writes the String representation of a Number (as printed by "%.15g") in `out`, returns its
+// length. Integers are converted directly, without going through printf
+int numberToString(double num, char* out);
+
 #endif
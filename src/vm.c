@@ -5,12 +5,18 @@
 
 #include "builtins/builtins.h"
 #include "builtins/core.h"
+#ifdef JSTAR_RE
+    #include "builtins/re.h"
+#endif
+#include "bundle.h"
 #include "code.h"
 #include "disassemble.h"
 #include "gc.h"
 #include "import.h"
 #include "opcode.h"
+#include "parse/arena.h"
 #include "profiler.h"
+#include "serialize.h"
 
 static const char* const methodSyms[SYM_END] = {
     [SYM_CTOR] = CTOR_STR,        [SYM_ITER] = "__iter__",      [SYM_NEXT] = "__next__",
@@ -24,7 +30,7 @@ static const char* const methodSyms[SYM_END] = {
     [SYM_SET] = "__set__",        [SYM_EQ] = "__eq__",          [SYM_LT] = "__lt__",
     [SYM_LE] = "__le__",          [SYM_GT] = "__gt__",          [SYM_GE] = "__ge__",
     [SYM_NEG] = "__neg__",        [SYM_INV] = "__invert__",     [SYM_POW] = "__pow__",
-    [SYM_RPOW] = "__rpow__",
+    [SYM_RPOW] = "__rpow__",      [SYM_SUM] = "sum",
 };
 
 // Enumeration encoding the cause of stack unwinding.
@@ -56,6 +62,12 @@ JStarVM* jsrNewVM(const JStarConf* conf) {
     JStarVM* vm = calloc(1, sizeof(*vm));
     vm->errorCallback = conf->errorCallback;
     vm->customData = conf->customData;
+    initSlab(&vm->slab, vm, conf->pageAllocator);
+    initSampler(&vm->sampler);
+    initTracer(&vm->tracer);
+#ifdef JSTAR_OPCODE_STATS
+    initOpcodeStats(&vm->opStats);
+#endif
 
     // VM program stack
     vm->stackSz = roundUp(conf->startingStackSize, MAX_LOCALS + 1);
@@ -67,10 +79,26 @@ JStarVM* jsrNewVM(const JStarConf* conf) {
     // GC Values
     vm->nextGC = conf->firstGCCollectionPoint;
     vm->heapGrowRate = conf->heapGrowRate;
+    vm->nurserySize = conf->nurserySize;
+    vm->nextMinorGC = conf->nurserySize;
+    vm->memoryLimit = conf->memoryLimit;
 
     // Module cache and interned string pool
     initHashTable(&vm->modules);
     initHashTable(&vm->stringPool);
+    vm->maxInternedLength = conf->maxInternedLength;
+    initImportCache(&vm->importCache);
+    vm->codeCache = conf->codeCache;
+    initEvalCache(&vm->evalCache, conf->evalCacheSize);
+    vm->streamCompileSize = conf->streamCompileSize;
+    vm->lazyImports = conf->lazyImports;
+    vm->traceImports = conf->traceImports;
+    vm->bytecodeCache = conf->bytecodeCache;
+    if(conf->bytecodeCacheDir) {
+        size_t length = strlen(conf->bytecodeCacheDir);
+        vm->bytecodeCacheDir = malloc(length + 1);
+        memcpy(vm->bytecodeCacheDir, conf->bytecodeCacheDir, length + 1);
+    }
 
     // Create string constants of special method names
     for(int i = 0; i < SYM_END; i++) {
@@ -80,27 +108,173 @@ JStarVM* jsrNewVM(const JStarConf* conf) {
     // Core module bootstrap
     initCoreModule(vm);
 
+    // Enabled only now, as the bootstrap patches up the objects created before the
+    // builtin classes by walking the young objects list
+    vm->generationalGC = conf->generationalGC;
+
     // Create empty tuple singleton
     vm->emptyTup = newTuple(vm, 0);
 
+    jsrCheckpointVM(vm);
+
     return vm;
 }
 
+static void freeCheckpoint(JStarVM* vm) {
+    for(size_t i = 0; i < vm->checkpointCount; i++) {
+        free(vm->checkpoint[i].globals);
+    }
+    free(vm->checkpoint);
+    vm->checkpoint = NULL;
+    vm->checkpointCount = 0;
+}
+
+static ObjList* copyList(JStarVM* vm, ObjList* lst) {
+    ObjList* copy = newList(vm, lst->size);
+    listAppendValues(vm, copy, lst->arr, lst->size);
+    return copy;
+}
+
+static void restoreList(JStarVM* vm, ObjList* lst, ObjList* saved) {
+    lst->size = 0;
+    listAppendValues(vm, lst, saved->arr, saved->size);
+}
+
+static void freeSymbols(JStarVM* vm) {
+    JStarSymbol* s = vm->symbols;
+    while(s != NULL) {
+        JStarSymbol* next = s->next;
+        free(s);
+        s = next;
+    }
+    vm->symbols = NULL;
+}
+
+void jsrCheckpointVM(JStarVM* vm) {
+    PROFILE_FUNC()
+
+    freeCheckpoint(vm);
+    vm->checkpointPaths = NULL;
+    vm->checkpointArgv = NULL;
+
+    // The lists are copied first, as allocating them can trigger a collection
+    ObjList* paths = copyList(vm, vm->importPaths);
+    push(vm, OBJ_VAL(paths));
+    vm->checkpointArgv = copyList(vm, vm->argv);
+    vm->checkpointPaths = paths;
+    pop(vm);
+
+    const HashTable* modules = &vm->modules;
+    vm->checkpoint = malloc(sizeof(ModuleCheckpoint) * (modules->sizeMask + 1));
+    for(const Entry* e = modules->entries; e < modules->entries + modules->sizeMask + 1; e++) {
+        if(e->key) {
+            ObjModule* mod = AS_MODULE(e->value);
+            ModuleCheckpoint* cp = &vm->checkpoint[vm->checkpointCount++];
+            cp->module = mod;
+            cp->lazy = mod->lazy;
+            cp->globalCount = mod->globals.size;
+            cp->globals = malloc(sizeof(Value) * (cp->globalCount ? cp->globalCount : 1));
+            if(cp->globalCount) {
+                memcpy(cp->globals, mod->globals.arr, sizeof(Value) * cp->globalCount);
+            }
+        }
+    }
+}
+
+// Empty the inline caches of all functions, so that they don't keep alive the classes (and the
+// methods) of the dropped modules
+static void clearInlineCaches(Obj* objects) {
+    for(Obj* o = objects; o != NULL; o = o->next) {
+        if(o->type == OBJ_FUNCTION) {
+            Code* c = &((ObjFunction*)o)->code;
+            for(size_t i = 0; i < c->cacheCount; i++) {
+                c->caches[i] = (InlineCache){0};
+            }
+        }
+    }
+}
+
+// Same as above for the caches of the API symbols, which may also refer to dropped modules
+static void clearSymbolCaches(JStarVM* vm) {
+    for(JStarSymbol* s = vm->symbols; s != NULL; s = s->next) {
+        s->methodCache = s->getCache = s->setCache = (InlineCache){0};
+        s->module = NULL;
+    }
+}
+
+void jsrResetVM(JStarVM* vm) {
+    PROFILE_FUNC()
+    ASSERT(vm->frameCount == 0 && vm->reentrantCalls == 0, "Cannot reset a running VM");
+
+    resetStack(vm);
+    vm->upvalues = NULL;
+    vm->evalBreak = 0;
+    vm->interrupt = 0;
+    vm->sampleRequest = 0;
+    vm->memoryExceeded = false;
+
+    freeHashTable(&vm->modules);
+    initHashTable(&vm->modules);
+
+    for(size_t i = 0; i < vm->checkpointCount; i++) {
+        ModuleCheckpoint* cp = &vm->checkpoint[i];
+        ObjModule* mod = cp->module;
+        mod->lazy = cp->lazy;
+        hashTablePut(&vm->modules, mod->name, OBJ_VAL(mod));
+
+        // Globals keep their slot for the whole lifetime of a module, and quickened code may
+        // refer to them by slot, so globals defined since the checkpoint cannot be removed
+        for(size_t j = 0; j < cp->globalCount; j++) {
+            mod->globals.arr[j] = cp->globals[j];
+        }
+        for(size_t j = cp->globalCount; j < (size_t)mod->globals.size; j++) {
+            mod->globals.arr[j] = NULL_VAL;
+        }
+    }
+
+    restoreList(vm, vm->importPaths, vm->checkpointPaths);
+    restoreList(vm, vm->argv, vm->checkpointArgv);
+    freeImportCache(&vm->importCache);
+    initImportCache(&vm->importCache);
+    clearEvalCache(&vm->evalCache);
+
+    // Functions are never in the list of tracked old objects
+    gcCompleteSweep(vm);
+    clearInlineCaches(vm->objects);
+    clearInlineCaches(vm->oldRoots);
+    clearSymbolCaches(vm);
+    garbageCollect(vm);
+}
+
 void jsrFreeVM(JStarVM* vm) {
     PROFILE_FUNC()
 
     resetStack(vm);
+    jsrStopProfiler(vm);
 
     {
         PROFILE("{free-vm-state}::jsrFreeVM")
 
+        freeSampler(&vm->sampler);
+        freeTracer(&vm->tracer);
+        freeSymbols(vm);
+        freeCheckpoint(vm);
         free(vm->stack);
         free(vm->frames);
         freeHashTable(&vm->stringPool);
         freeHashTable(&vm->modules);
+        freeImportCache(&vm->importCache);
+        freeEvalCache(&vm->evalCache);
+        jsrFreeASTArena(vm->astArena);
+        free(vm->bytecodeCacheDir);
+#ifdef JSTAR_RE
+        freeRegexCache(vm);
+#endif
     }
 
-    sweepObjects(vm);
+    freeObjects(vm);
+    freeBundles(vm);
+    freeSlab(&vm->slab);
 
 #ifdef JSTAR_DBG_PRINT_GC
     printf("Allocated at exit: %lu bytes.\n", vm->allocated);
@@ -121,7 +295,8 @@ static Frame* getFrame(JStarVM* vm, Prototype* proto) {
 
     Frame* callFrame = &vm->frames[vm->frameCount++];
     callFrame->stack = vm->sp - (proto->argsCount + 1) - (int)proto->vararg;
-    callFrame->handlerc = 0;
+    callFrame->tailCalls = 0;
+    callFrame->gen = NULL;
     return callFrame;
 }
 
@@ -141,12 +316,15 @@ static Frame* appendNativeFrame(JStarVM* vm, ObjNative* native) {
 
 static bool isNonInstantiableBuiltin(JStarVM* vm, ObjClass* cls) {
     return cls == vm->nullClass || cls == vm->funClass || cls == vm->modClass ||
-           cls == vm->stClass || cls == vm->clsClass || cls == vm->udataClass;
+           cls == vm->stClass || cls == vm->clsClass || cls == vm->udataClass ||
+           cls == vm->genClass;
 }
 
 static bool isInstatiableBuiltin(JStarVM* vm, ObjClass* cls) {
     return cls == vm->lstClass || cls == vm->tupClass || cls == vm->numClass ||
-           cls == vm->boolClass || cls == vm->strClass || cls == vm->tableClass;
+           cls == vm->boolClass || cls == vm->strClass || cls == vm->tableClass ||
+           cls == vm->weakTableClass || cls == vm->weakRefClass || cls == vm->f64ArrClass ||
+           cls == vm->i32ArrClass || cls == vm->u8ArrClass;
 }
 
 static bool isBuiltinClass(JStarVM* vm, ObjClass* cls) {
@@ -157,6 +335,27 @@ static bool isInt(double n) {
     return trunc(n) == n;
 }
 
+// Converts a Number to the 32-bit operand of the bitwise operators, wrapping it modulo 2^32.
+// The conversion through int64_t is exact and well defined for all the values in its range,
+// which are the only ones expected in practice
+static inline uint32_t toBitwiseOperand(double n) {
+    if(fabs(n) < 9223372036854775808.0) return (uint32_t)(int64_t)n;
+    if(!isfinite(n)) return 0;
+    double m = fmod(trunc(n), 4294967296.0);
+    return (uint32_t)(int64_t)(m < 0 ? m + 4294967296.0 : m);
+}
+
+// Returns the position of `index` in a sequence of `size` elements, or SIZE_MAX if it isn't an
+// integral Number in bounds. Used by the inline subscript paths, that leave the reporting of
+// errors to the generic ones
+static inline size_t sequenceIndex(Value index, size_t size) {
+    if(!IS_NUM(index)) return SIZE_MAX;
+    double n = AS_NUM(index);
+    if(!(n >= 0 && n < (double)size)) return SIZE_MAX;
+    size_t i = (size_t)n;
+    return (double)i == n ? i : SIZE_MAX;
+}
+
 static void createClass(JStarVM* vm, ObjString* name, ObjClass* superCls) {
     ObjClass* cls = newClass(vm, name, superCls);
     hashTableMerge(&cls->methods, &superCls->methods);
@@ -164,8 +363,16 @@ static void createClass(JStarVM* vm, ObjString* name, ObjClass* superCls) {
 }
 
 static ObjUpvalue* captureUpvalue(JStarVM* vm, Value* addr) {
-    if(!vm->upvalues) {
-        vm->upvalues = newUpvalue(vm, addr);
+    // The open upvalues are sorted by stack address, and closures usually capture the locals of the
+    // topmost frame. These are either already at the head of the list, or go right before it
+    if(!vm->upvalues || vm->upvalues->addr < addr) {
+        ObjUpvalue* created = newUpvalue(vm, addr);
+        created->next = vm->upvalues;
+        vm->upvalues = created;
+        return created;
+    }
+
+    if(vm->upvalues->addr == addr) {
         return vm->upvalues;
     }
 
@@ -238,13 +445,17 @@ static bool adjustArguments(JStarVM* vm, Prototype* p, uint8_t argc) {
     return true;
 }
 
-static bool callFunction(JStarVM* vm, ObjClosure* closure, uint8_t argc) {
+static bool checkFrameOverflow(JStarVM* vm) {
     if(vm->frameCount + 1 == MAX_FRAMES) {
         jsrRaise(vm, "StackOverflowException", "Exceeded maximum recursion depth");
         return false;
     }
+    return true;
+}
 
-    if(!adjustArguments(vm, &closure->fn->proto, argc)) {
+// Pushes the frame of `closure`, whose arguments have already been adjusted to its prototype
+static bool pushFunctionFrame(JStarVM* vm, ObjClosure* closure) {
+    if(closure->fn->lazy.data && !deserializeLazyBody(vm, closure->fn)) {
         return false;
     }
 
@@ -255,19 +466,246 @@ static bool callFunction(JStarVM* vm, ObjClosure* closure, uint8_t argc) {
     appendCallFrame(vm, closure);
     vm->module = closure->fn->proto.module;
 
+    if(TRACING(vm, JSR_TRACE_CALL)) {
+        traceFunction(vm, JSR_TRACE_CALL, &closure->fn->proto, vm->frameCount, false);
+    }
+
+#ifdef JSTAR_OPCODE_STATS
+    closure->fn->proto.calls++;
+#endif
+
     return true;
 }
 
-static bool callNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
+static bool callFunction(JStarVM* vm, ObjClosure* closure, uint8_t argc) {
+    if(!checkFrameOverflow(vm)) return false;
+    if(!adjustArguments(vm, &closure->fn->proto, argc)) return false;
+    return pushFunctionFrame(vm, closure);
+}
+
+// Replaces the topmost frame, that must belong to a function executing a tail call, with the one
+// of `closure`. The callee and its already adjusted arguments are moved to the base of the frame,
+// discarding the locals of the caller, so that the recursion depth doesn't grow
+static bool replaceFunctionFrame(JStarVM* vm, ObjClosure* closure) {
+    Prototype* proto = &closure->fn->proto;
+
+    if(closure->fn->lazy.data && !deserializeLazyBody(vm, closure->fn)) {
+        return false;
+    }
+
+    Frame* frame = &vm->frames[vm->frameCount - 1];
+    size_t windowSize = proto->argsCount + 1 + (int)proto->vararg;
+
+    if(TRACING(vm, JSR_TRACE_RETURN)) {
+        Prototype* caller = &((ObjClosure*)frame->fn)->fn->proto;
+        traceFunction(vm, JSR_TRACE_RETURN, caller, vm->frameCount, false);
+    }
+
+    closeUpvalues(vm, frame->stack);
+    memmove(frame->stack, vm->sp - windowSize, sizeof(Value) * windowSize);
+    vm->sp = frame->stack + windowSize;
+
+    frame->fn = (Obj*)closure;
+    frame->ip = closure->fn->code.bytecode;
+    frame->tailCalls++;
+    vm->module = proto->module;
+
+    if(TRACING(vm, JSR_TRACE_CALL)) {
+        traceFunction(vm, JSR_TRACE_CALL, proto, vm->frameCount, false);
+    }
+
+#ifdef JSTAR_OPCODE_STATS
+    proto->calls++;
+#endif
+
+    reserveStack(vm, UINT8_MAX);
+    return true;
+}
+
+static bool tailCallFunction(JStarVM* vm, ObjClosure* closure, uint8_t argc) {
+    if(!adjustArguments(vm, &closure->fn->proto, argc)) return false;
+    return replaceFunctionFrame(vm, closure);
+}
+
+// Like callValue, but J* functions and methods bound to them replace the frame of the caller.
+// Other callables are called normally
+static bool tailCallValue(JStarVM* vm, Value callee, uint8_t argc) {
+    if(IS_CLOSURE(callee)) {
+        return tailCallFunction(vm, AS_CLOSURE(callee), argc);
+    }
+    if(IS_BOUND_METHOD(callee) && AS_BOUND_METHOD(callee)->method->type == OBJ_CLOSURE) {
+        ObjBoundMethod* m = AS_BOUND_METHOD(callee);
+        vm->sp[-argc - 1] = m->bound;
+        return tailCallFunction(vm, (ObjClosure*)m->method, argc);
+    }
+    return callValue(vm, callee, argc);
+}
+
+// Saves the state of the topmost frame, that executes `gen`, in the generator. The values of the
+// frame in the range [frameStack, top) are copied, and its open upvalues are closed and recorded,
+// so that they can be reopened when the generator is resumed
+static void saveGenerator(JStarVM* vm, ObjGenerator* gen, Value* frameStack, Value* top,
+                          uint8_t* ip) {
+    size_t stackSize = top - frameStack;
+    if(stackSize > gen->stackCapacity) {
+        size_t oldCapacity = gen->stackCapacity;
+        size_t newCapacity = oldCapacity ? oldCapacity : 8;
+        while(newCapacity < stackSize) newCapacity *= 2;
+        gen->stack = gcAlloc(vm, gen->stack, sizeof(Value) * oldCapacity,
+                             sizeof(Value) * newCapacity);
+        gen->stackCapacity = newCapacity;
+    }
+
+    size_t upvalueCount = 0;
+    for(ObjUpvalue* u = vm->upvalues; u && u->addr >= frameStack; u = u->next) {
+        upvalueCount++;
+    }
+
+    if(upvalueCount > gen->upvalueCapacity) {
+        size_t oldCapacity = gen->upvalueCapacity;
+        gen->upvalues = gcAlloc(vm, gen->upvalues, sizeof(SavedUpvalue) * oldCapacity,
+                                sizeof(SavedUpvalue) * upvalueCount);
+        gen->upvalueCapacity = upvalueCount;
+    }
+
+    for(size_t i = 0; i < upvalueCount; i++) {
+        ObjUpvalue* upvalue = vm->upvalues;
+        gen->upvalues[i].upvalue = upvalue;
+        gen->upvalues[i].slot = upvalue->addr - frameStack;
+        upvalue->closed = *upvalue->addr;
+        upvalue->addr = &upvalue->closed;
+        vm->upvalues = upvalue->next;
+        upvalue->next = NULL;
+    }
+
+    memcpy(gen->stack, frameStack, sizeof(Value) * stackSize);
+    gen->stackSize = stackSize;
+    gen->upvalueCount = upvalueCount;
+    gen->ip = ip;
+    gen->state = GEN_SUSPENDED;
+    GC_WRITE_BARRIER(vm, gen);
+}
+
+// Resumes a suspended generator in a new frame. Its saved stack replaces the generator on top of
+// the VM stack, followed by the value sent to the generator, i.e. the result of its `yield`
+static bool resumeGenerator(JStarVM* vm, ObjGenerator* gen, uint8_t argc) {
+    if(argc > 1) {
+        jsrRaise(vm, "TypeException", "A generator takes at most 1 argument, %d supplied.", argc);
+        return false;
+    }
+
+    if(gen->state == GEN_RUNNING) {
+        jsrRaise(vm, "GeneratorException", "Generator is already running.");
+        return false;
+    }
+
+    if(gen->state == GEN_DONE) {
+        jsrRaise(vm, "GeneratorException", "Generator has terminated.");
+        return false;
+    }
+
     if(vm->frameCount + 1 == MAX_FRAMES) {
         jsrRaise(vm, "StackOverflowException", "Exceeded maximum recursion depth");
         return false;
     }
 
-    if(!adjustArguments(vm, &native->proto, argc)) {
+    Value sent = argc == 1 ? pop(vm) : NULL_VAL;
+    reserveStack(vm, gen->stackSize + UINT8_MAX);
+
+    Value* frameStack = vm->sp - 1;
+    memcpy(frameStack, gen->stack, sizeof(Value) * gen->stackSize);
+    vm->sp = frameStack + gen->stackSize;
+    push(vm, sent);
+
+    // Upvalues were saved starting from the one with the highest address
+    for(size_t i = gen->upvalueCount; i-- > 0;) {
+        ObjUpvalue* upvalue = gen->upvalues[i].upvalue;
+        upvalue->addr = frameStack + gen->upvalues[i].slot;
+        *upvalue->addr = upvalue->closed;
+        upvalue->next = vm->upvalues;
+        vm->upvalues = upvalue;
+    }
+
+    Frame* frame = appendCallFrame(vm, gen->closure);
+    frame->stack = frameStack;
+    frame->ip = gen->ip;
+    frame->gen = gen;
+    vm->module = gen->closure->fn->proto.module;
+
+    if(TRACING(vm, JSR_TRACE_CALL)) {
+        traceFunction(vm, JSR_TRACE_CALL, &gen->closure->fn->proto, vm->frameCount, false);
+    }
+
+    // The running generator is kept alive by its frame
+    gen->state = GEN_RUNNING;
+    gen->stackSize = 0;
+    gen->upvalueCount = 0;
+    return true;
+}
+
+static void finishGenerator(ObjGenerator* gen) {
+    gen->state = GEN_DONE;
+    gen->lastYield = NULL_VAL;
+}
+
+// Call a leaf native without pushing a frame. Since leaf natives cannot call back into the VM, the
+// only state to save is the API stack of the caller. The current module is still switched, as it's
+// where `jsrRaise` looks up exception classes. On failure the frame is pushed after the fact, so
+// that the unwinder finds the same state left by `callNative` and records the native's frame
+static bool callLeafNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
+    reserveStack(vm, JSTAR_MIN_NATIVE_STACK_SZ);
+
+    ObjModule* oldModule = vm->module;
+    size_t savedApiStack = vm->apiStack - vm->stack;
+
+    vm->module = native->proto.module;
+    vm->apiStack = vm->sp - argc - 1;
+
+    // Traced with the depth of the frame the native would have
+    if(TRACING(vm, JSR_TRACE_CALL)) {
+        traceFunction(vm, JSR_TRACE_CALL, &native->proto, vm->frameCount + 1, false);
+    }
+
+#ifdef JSTAR_OPCODE_STATS
+    Prototype* caller = vm->opStats.current;
+    native->proto.calls++;
+    switchFunction(&vm->opStats, &native->proto);
+    bool res = native->fn(vm);
+    switchFunction(&vm->opStats, caller);
+#else
+    bool res = native->fn(vm);
+#endif
+
+    if(!res) {
+        if(vm->frameCount + 1 < MAX_FRAMES) {
+            Frame* frame = appendNativeFrame(vm, native);
+            frame->stack = vm->apiStack;
+        } else {
+            if(TRACING(vm, JSR_TRACE_RETURN)) {
+                traceFunction(vm, JSR_TRACE_RETURN, &native->proto, vm->frameCount + 1, true);
+            }
+            vm->module = oldModule;
+        }
+        vm->apiStack = vm->stack + savedApiStack;
         return false;
     }
 
+    if(TRACING(vm, JSR_TRACE_RETURN)) {
+        traceFunction(vm, JSR_TRACE_RETURN, &native->proto, vm->frameCount + 1, false);
+    }
+
+    vm->module = oldModule;
+
+    Value ret = pop(vm);
+    vm->sp = vm->apiStack;
+    vm->apiStack = vm->stack + savedApiStack;
+
+    push(vm, ret);
+    return true;
+}
+
+// Runs `native` in a new frame, its arguments must have already been adjusted to its prototype
+static bool runNative(JStarVM* vm, ObjNative* native) {
     reserveStack(vm, JSTAR_MIN_NATIVE_STACK_SZ);
     Frame* frame = appendNativeFrame(vm, native);
 
@@ -277,12 +715,30 @@ static bool callNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
     vm->module = native->proto.module;
     vm->apiStack = frame->stack;
 
-    if(!native->fn(vm)) {
+    if(TRACING(vm, JSR_TRACE_CALL)) {
+        traceFunction(vm, JSR_TRACE_CALL, &native->proto, vm->frameCount, false);
+    }
+
+#ifdef JSTAR_OPCODE_STATS
+    Prototype* caller = vm->opStats.current;
+    native->proto.calls++;
+    switchFunction(&vm->opStats, &native->proto);
+    bool res = native->fn(vm);
+    switchFunction(&vm->opStats, caller);
+#else
+    bool res = native->fn(vm);
+#endif
+
+    if(!res) {
         vm->module = oldModule;
         vm->apiStack = vm->stack + savedApiStack;
         return false;
     }
 
+    if(TRACING(vm, JSR_TRACE_RETURN)) {
+        traceFunction(vm, JSR_TRACE_RETURN, &native->proto, vm->frameCount, false);
+    }
+
     Value ret = pop(vm);
     vm->frameCount--;
     vm->sp = vm->apiStack;
@@ -293,6 +749,16 @@ static bool callNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
     return true;
 }
 
+static bool callNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
+    if(native->leaf && argc == native->proto.argsCount && !native->proto.vararg) {
+        return callLeafNative(vm, native, argc);
+    }
+
+    if(!checkFrameOverflow(vm)) return false;
+    if(!adjustArguments(vm, &native->proto, argc)) return false;
+    return runNative(vm, native);
+}
+
 static bool invokeMethod(JStarVM* vm, ObjClass* cls, ObjString* name, uint8_t argc) {
     Value method;
     if(!hashTableGet(&cls->methods, name, &method)) {
@@ -303,16 +769,33 @@ static bool invokeMethod(JStarVM* vm, ObjClass* cls, ObjString* name, uint8_t ar
     return callValue(vm, method, argc);
 }
 
-static bool bindMethod(JStarVM* vm, ObjClass* cls, ObjString* name) {
+// Replaces the value on top of the stack with `method` bound to it
+static void pushBoundMethod(JStarVM* vm, Obj* method) {
+    Value receiver = peek(vm);
+    if(!IS_OBJ(receiver)) {
+        vm->sp[-1] = OBJ_VAL(newBoundMethod(vm, receiver, method));
+        return;
+    }
+
+    uintptr_t hash = ((uintptr_t)AS_OBJ(receiver) >> 3) ^ ((uintptr_t)method >> 4);
+    ObjBoundMethod** entry = &vm->boundMethods[hash & (BOUND_METHOD_CACHE_SZ - 1)];
+
+    ObjBoundMethod* bm = *entry;
+    if(bm == NULL || bm->method != method || !valueEquals(bm->bound, receiver)) {
+        bm = newBoundMethod(vm, receiver, method);
+        *entry = bm;
+    }
+
+    vm->sp[-1] = OBJ_VAL(bm);
+}
+
+bool bindMethod(JStarVM* vm, ObjClass* cls, ObjString* name) {
     Value v;
     if(!hashTableGet(&cls->methods, name, &v)) {
         return false;
     }
 
-    ObjBoundMethod* boundMeth = newBoundMethod(vm, peek(vm), AS_OBJ(v));
-    pop(vm);
-
-    push(vm, OBJ_VAL(boundMeth));
+    pushBoundMethod(vm, AS_OBJ(v));
     return true;
 }
 
@@ -374,6 +857,35 @@ static bool getListSubscript(JStarVM* vm) {
     return false;
 }
 
+static bool getArraySubscript(JStarVM* vm) {
+    ObjArray* arr = AS_ARRAY(peek2(vm));
+    Value arg = peek(vm);
+
+    if(IS_INT(arg)) {
+        size_t idx = jsrCheckIndexNum(vm, AS_NUM(arg), arr->length);
+        if(idx == SIZE_MAX) return false;
+
+        pop(vm), pop(vm);
+        push(vm, NUM_VAL(arrayGet(arr, idx)));
+        return true;
+    }
+    if(IS_TUPLE(arg)) {
+        size_t low = 0, high = 0;
+        if(!checkSliceIndex(vm, AS_TUPLE(arg), arr->length, &low, &high)) return false;
+
+        // Slices of arrays are views, they don't copy the elements
+        ObjArray* view = newArrayView(vm, arr, low, high - low);
+
+        pop(vm), pop(vm);
+        push(vm, OBJ_VAL(view));
+        return true;
+    }
+
+    jsrRaise(vm, "TypeException", "Index of %s subscript must be an integer or a Tuple",
+             arr->base.cls->name->data);
+    return false;
+}
+
 static bool getTupleSubscript(JStarVM* vm) {
     ObjTuple* tup = AS_TUPLE(peek2(vm));
     Value arg = peek(vm);
@@ -431,12 +943,84 @@ static bool getStringSubscript(JStarVM* vm) {
     return false;
 }
 
+// Iteration fast path for Lists, Tuples, Strings and Tables, which skips the calls to their
+// `__iter__` and `__next__` methods. Iterators are computed exactly like those methods do: the index
+// of the current element, or false once the iteration is over.
+// Advances `*iter` and pushes the next element, setting `done` if there are no more elements.
+// Returns false if `iterable` is not one of the supported types
+static bool iterateBuiltin(JStarVM* vm, Value iterable, Value* iter, bool* done) {
+    if(!IS_OBJ(iterable)) return false;
+
+    size_t size;
+    switch(AS_OBJ(iterable)->type) {
+    case OBJ_LIST:
+        size = AS_LIST(iterable)->size;
+        break;
+    case OBJ_TUPLE:
+        size = AS_TUPLE(iterable)->size;
+        break;
+    case OBJ_STRING:
+        size = AS_STRING(iterable)->length;
+        break;
+    case OBJ_TABLE: {
+        ObjTable* t = AS_TABLE(iterable);
+        size_t i = IS_NUM(*iter) ? (size_t)AS_NUM(*iter) + 1 : 0;
+        if(t->entries != NULL && (IS_NULL(*iter) || IS_NUM(*iter))) {
+            for(; i < t->numEntries; i++) {
+                if(!IS_NULL(t->entries[i].key)) {
+                    *iter = NUM_VAL(i);
+                    *done = false;
+                    push(vm, t->entries[i].key);
+                    return true;
+                }
+            }
+        }
+        *iter = BOOL_VAL(false);
+        *done = true;
+        return true;
+    }
+    default:
+        return false;
+    }
+
+    size_t idx = 0;
+    if(IS_NUM(*iter)) {
+        idx = (size_t)AS_NUM(*iter) + 1;
+    } else if(!IS_NULL(*iter)) {
+        idx = size;
+    }
+
+    if(idx >= size) {
+        *iter = BOOL_VAL(false);
+        *done = true;
+        return true;
+    }
+
+    *iter = NUM_VAL(idx);
+    *done = false;
+
+    switch(AS_OBJ(iterable)->type) {
+    case OBJ_LIST:
+        push(vm, AS_LIST(iterable)->arr[idx]);
+        break;
+    case OBJ_TUPLE:
+        push(vm, AS_TUPLE(iterable)->arr[idx]);
+        break;
+    case OBJ_STRING: {
+        ObjString* str = AS_STRING(iterable);
+        push(vm, OBJ_VAL(copyString(vm, str->data + idx, 1)));
+        break;
+    }
+    default:
+        UNREACHABLE();
+        break;
+    }
+
+    return true;
+}
+
 static void concatStrings(JStarVM* vm) {
-    ObjString *s1 = AS_STRING(peek2(vm)), *s2 = AS_STRING(peek(vm));
-    size_t length = s1->length + s2->length;
-    ObjString* conc = allocateString(vm, length);
-    memcpy(conc->data, s1->data, s1->length);
-    memcpy(conc->data + s1->length, s2->data, s2->length);
+    ObjString* conc = stringConcat(vm, AS_STRING(peek2(vm)), AS_STRING(peek(vm)));
     pop(vm), pop(vm);
     push(vm, OBJ_VAL(conc));
 }
@@ -506,6 +1090,59 @@ static bool unpackCall(JStarVM* vm, uint8_t argc, uint8_t* out) {
     return true;
 }
 
+// Returns the function object that should receive the Tuple on top of the stack as its varargs
+// Tuple as is, or NULL if the call has to go through `unpackCall`. This is the case of calls like
+// `f(args...)` where `f` only takes varargs, so that forwarding wrappers don't copy their
+// arguments on the stack just for them to be packed again in an identical tuple.
+// Tuples are immutable, so sharing the caller's one is not observable
+static Obj* varargsForwardTarget(JStarVM* vm, uint8_t argc) {
+    if(argc != 1 || !IS_TUPLE(peek(vm))) {
+        return NULL;
+    }
+
+    Value callee = peek2(vm);
+    if(!IS_OBJ(callee)) {
+        return NULL;
+    }
+
+    Obj* fn = AS_OBJ(callee);
+    if(fn->type == OBJ_BOUND_METHOD) {
+        fn = ((ObjBoundMethod*)fn)->method;
+    }
+
+    Prototype* proto;
+    switch(fn->type) {
+    case OBJ_CLOSURE:
+        proto = &((ObjClosure*)fn)->fn->proto;
+        break;
+    case OBJ_NATIVE:
+        proto = &((ObjNative*)fn)->proto;
+        break;
+    default:
+        return NULL;
+    }
+
+    return proto->vararg && proto->argsCount == 0 ? fn : NULL;
+}
+
+// Calls `fn`, as returned by `varargsForwardTarget`, with the Tuple on top of the stack as its
+// varargs. If `tail` is true J* functions replace the frame of the caller
+static bool forwardVarargs(JStarVM* vm, Obj* fn, bool tail) {
+    Value callee = peek2(vm);
+    if(IS_BOUND_METHOD(callee)) {
+        vm->sp[-2] = AS_BOUND_METHOD(callee)->bound;
+    }
+
+    if(fn->type == OBJ_CLOSURE) {
+        if(tail) return replaceFunctionFrame(vm, (ObjClosure*)fn);
+        if(!checkFrameOverflow(vm)) return false;
+        return pushFunctionFrame(vm, (ObjClosure*)fn);
+    }
+
+    if(!checkFrameOverflow(vm)) return false;
+    return runNative(vm, (ObjNative*)fn);
+}
+
 static bool unpackObject(JStarVM* vm, Obj* o, uint8_t n) {
     size_t size;
     Value* array = getValues(o, &size);
@@ -522,10 +1159,10 @@ static bool unpackObject(JStarVM* vm, Obj* o, uint8_t n) {
     return true;
 }
 
-static JStarNative resolveNative(ObjModule* m, const char* cls, const char* name) {
-    JStarNative n;
-    if((n = resolveBuiltIn(m->name->data, cls, name)) != NULL) {
-        return n;
+// Sets the C function (and the leaf flag) of `native`. Returns false if it cannot be found
+static bool resolveNative(ObjModule* m, const char* cls, const char* name, ObjNative* native) {
+    if((native->fn = resolveBuiltIn(m->name->data, cls, name, &native->leaf)) != NULL) {
+        return true;
     }
 
     JStarNativeReg* reg = m->natives.registry;
@@ -535,18 +1172,22 @@ static JStarNative resolveNative(ObjModule* m, const char* cls, const char* name
                 const char* clsName = reg[i].as.method.cls;
                 const char* methName = reg[i].as.method.name;
                 if(strcmp(cls, clsName) == 0 && strcmp(name, methName) == 0) {
-                    return reg[i].as.method.meth;
+                    native->fn = reg[i].as.method.meth;
+                    native->leaf = reg[i].leaf;
+                    return true;
                 }
             } else if(reg[i].type == REG_FUNCTION && cls == NULL) {
                 const char* funName = reg[i].as.function.name;
                 if(strcmp(name, funName) == 0) {
-                    return reg[i].as.function.fun;
+                    native->fn = reg[i].as.function.fun;
+                    native->leaf = reg[i].leaf;
+                    return true;
                 }
             }
         }
     }
 
-    return NULL;
+    return false;
 }
 
 // -----------------------------------------------------------------------------
@@ -562,7 +1203,7 @@ bool getValueField(JStarVM* vm, ObjString* name) {
             ObjInstance* inst = AS_INSTANCE(val);
 
             // Try top find a field
-            if(!hashTableGet(&inst->fields, name, &field)) {
+            if(!instanceGetField(inst, name, &field)) {
                 // No field, try to bind method
                 if(!bindMethod(vm, inst->base.cls, name)) {
                     jsrRaise(vm, "FieldException", "Object %s doesn't have field `%s`.",
@@ -580,8 +1221,12 @@ bool getValueField(JStarVM* vm, ObjString* name) {
             Value global;
             ObjModule* mod = AS_MODULE(val);
 
+            if(mod->lazy && !resolveLazyModule(vm, mod)) {
+                return false;
+            }
+
             // Try to find global variable
-            if(!hashTableGet(&mod->globals, name, &global)) {
+            if(!moduleGetGlobal(mod, name, &global)) {
                 // No global, try to bind method
                 if(!bindMethod(vm, mod->base.cls, name)) {
                     jsrRaise(vm, "NameException", "Name `%s` is not defined in module %s",
@@ -615,12 +1260,16 @@ bool setValueField(JStarVM* vm, ObjString* name) {
         switch(AS_OBJ(val)->type) {
         case OBJ_INST: {
             ObjInstance* inst = AS_INSTANCE(val);
-            hashTablePut(&inst->fields, name, peek(vm));
+            instanceSetField(inst, name, peek(vm));
+            GC_WRITE_BARRIER(vm, inst);
             return true;
         }
         case OBJ_MODULE: {
             ObjModule* mod = AS_MODULE(val);
-            hashTablePut(&mod->globals, name, peek(vm));
+            if(mod->lazy && !resolveLazyModule(vm, mod)) {
+                return false;
+            }
+            moduleSetGlobal(mod, name, peek(vm));
             return true;
         }
         default:
@@ -634,6 +1283,40 @@ bool setValueField(JStarVM* vm, ObjString* name) {
     return false;
 }
 
+// Tables are accessed directly instead of through their `__get__` and `__set__` natives, since
+// builtin classes cannot be subclassed
+static bool getTableSubscript(JStarVM* vm) {
+    Value key = peek(vm);
+    if(IS_NULL(key)) {
+        jsrRaise(vm, "TypeException", "Key of Table cannot be null.");
+        return false;
+    }
+
+    Value val;
+    if(!tableGet(vm, AS_TABLE(peek2(vm)), key, &val)) return false;
+
+    pop(vm);
+    vm->sp[-1] = val;
+    return true;
+}
+
+static bool setTableSubscript(JStarVM* vm) {
+    Value key = peek2(vm);
+    if(IS_NULL(key)) {
+        jsrRaise(vm, "TypeException", "Key of Table cannot be null.");
+        return false;
+    }
+
+    // Like `__set__`, evaluates to whether the key was newly inserted
+    bool inserted;
+    if(!tableSet(vm, AS_TABLE(peek(vm)), key, peekn(vm, 2), &inserted)) return false;
+
+    pop(vm);
+    pop(vm);
+    vm->sp[-1] = BOOL_VAL(inserted);
+    return true;
+}
+
 bool getValueSubscript(JStarVM* vm) {
     if(IS_OBJ(peek2(vm))) {
         Value operand = peek2(vm);
@@ -644,6 +1327,10 @@ bool getValueSubscript(JStarVM* vm) {
             return getTupleSubscript(vm);
         case OBJ_STRING:
             return getStringSubscript(vm);
+        case OBJ_ARRAY:
+            return getArraySubscript(vm);
+        case OBJ_TABLE:
+            return getTableSubscript(vm);
         default:
             break;
         }
@@ -669,6 +1356,34 @@ bool setValueSubscript(JStarVM* vm) {
         if(index == SIZE_MAX) return false;
 
         list->arr[index] = val;
+        GC_WRITE_BARRIER(vm, list);
+        return true;
+    }
+
+    if(IS_TABLE(peek(vm))) {
+        return setTableSubscript(vm);
+    }
+
+    if(IS_ARRAY(peek(vm))) {
+        Value operand = pop(vm), arg = pop(vm), val = peek(vm);
+        ObjArray* arr = AS_ARRAY(operand);
+
+        if(!IS_NUM(arg) || !isInt(AS_NUM(arg))) {
+            jsrRaise(vm, "TypeException", "Index of %s subscript access must be an integer.",
+                     arr->base.cls->name->data);
+            return false;
+        }
+
+        size_t index = jsrCheckIndexNum(vm, AS_NUM(arg), arr->length);
+        if(index == SIZE_MAX) return false;
+
+        if(!IS_NUM(val)) {
+            jsrRaise(vm, "TypeException", "Elements of %s must be numbers.",
+                     arr->base.cls->name->data);
+            return false;
+        }
+
+        arraySet(arr, index, AS_NUM(val));
         return true;
     }
 
@@ -696,6 +1411,8 @@ bool callValue(JStarVM* vm, Value callee, uint8_t argc) {
                 return callNative(vm, (ObjNative*)m->method, argc);
             }
         }
+        case OBJ_GENERATOR:
+            return resumeGenerator(vm, AS_GENERATOR(callee), argc);
         case OBJ_CLASS: {
             ObjClass* cls = AS_CLASS(callee);
 
@@ -749,7 +1466,7 @@ bool invokeValue(JStarVM* vm, ObjString* name, uint8_t argc) {
 
             // If no method is found try a field
             Value field;
-            if(hashTableGet(&inst->fields, name, &field)) {
+            if(instanceGetField(inst, name, &field)) {
                 return callValue(vm, field, argc);
             }
 
@@ -761,13 +1478,17 @@ bool invokeValue(JStarVM* vm, ObjString* name, uint8_t argc) {
             Value func;
             ObjModule* mod = AS_MODULE(val);
 
+            if(mod->lazy && !resolveLazyModule(vm, mod)) {
+                return false;
+            }
+
             // Check if method shadows a function in the module
             if(hashTableGet(&vm->modClass->methods, name, &func)) {
                 return callValue(vm, func, argc);
             }
 
             // If no method is found on the ObjModule, try to get global variable
-            if(hashTableGet(&mod->globals, name, &func)) {
+            if(moduleGetGlobal(mod, name, &func)) {
                 return callValue(vm, func, argc);
             }
 
@@ -814,10 +1535,6 @@ inline void reserveStack(JStarVM* vm, size_t needed) {
         for(int i = 0; i < vm->frameCount; i++) {
             Frame* frame = &vm->frames[i];
             frame->stack = vm->stack + (frame->stack - oldStack);
-            for(int j = 0; j < frame->handlerc; j++) {
-                Handler* h = &frame->handlers[j];
-                h->savedSp = vm->stack + (h->savedSp - oldStack);
-            }
         }
 
         ObjUpvalue* upvalue = vm->upvalues;
@@ -836,10 +1553,178 @@ inline void swapStackSlots(JStarVM* vm, int a, int b) {
     vm->sp[b] = tmp;
 }
 
+// -----------------------------------------------------------------------------
+// INLINE CACHES
+// -----------------------------------------------------------------------------
+
+static int nextCacheEntry(InlineCache* ic, InlineCacheKind kind, ObjClass* cls) {
+    int i = ic->nextEntry;
+    ic->nextEntry = (i + 1) % IC_ENTRIES;
+    ic->kind = kind;
+    ic->entries[i].cls = cls;
+    return i;
+}
+
+static bool cachedMethod(InlineCache* ic, ObjClass* cls, ObjString* name, Value* method) {
+    for(int i = 0; i < IC_ENTRIES; i++) {
+        if(ic->entries[i].cls == cls) {
+            ic->hits++;
+            *method = ic->entries[i].as.method;
+            return true;
+        }
+    }
+
+    ic->misses++;
+    if(!hashTableGet(&cls->methods, name, method)) {
+        return false;
+    }
+
+    int i = nextCacheEntry(ic, IC_METHOD, cls);
+    ic->entries[i].as.method = *method;
+    return true;
+}
+
+static void cacheField(InlineCache* ic, ObjInstance* inst, Shape* shape, Shape* transition,
+                       size_t slot) {
+    int i = nextCacheEntry(ic, IC_FIELD, inst->base.cls);
+    ic->entries[i].as.field.shape = shape;
+    ic->entries[i].as.field.transition = transition;
+    ic->entries[i].as.field.slot = slot;
+}
+
+bool getFieldCached(JStarVM* vm, ObjString* name, InlineCache* ic) {
+    Value val = peek(vm);
+    if(IS_INSTANCE(val) && AS_INSTANCE(val)->shape != NULL) {
+        ObjInstance* inst = AS_INSTANCE(val);
+        for(int i = 0; i < IC_ENTRIES; i++) {
+            if(ic->entries[i].as.field.shape == inst->shape) {
+                ic->hits++;
+                vm->sp[-1] = inst->fields[ic->entries[i].as.field.slot];
+                return true;
+            }
+        }
+
+        ic->misses++;
+        size_t slot;
+        if(shapeGetSlot(inst->shape, name, &slot)) {
+            cacheField(ic, inst, inst->shape, NULL, slot);
+            vm->sp[-1] = inst->fields[slot];
+            return true;
+        }
+    }
+    return getValueField(vm, name);
+}
+
+bool setFieldCached(JStarVM* vm, ObjString* name, InlineCache* ic) {
+    Value val = peek(vm);
+    if(IS_INSTANCE(val) && AS_INSTANCE(val)->shape != NULL) {
+        ObjInstance* inst = AS_INSTANCE(pop(vm));
+        for(int i = 0; i < IC_ENTRIES; i++) {
+            if(ic->entries[i].as.field.shape == inst->shape) {
+                ic->hits++;
+                Shape* transition = ic->entries[i].as.field.transition;
+                if(transition != NULL) {
+                    instanceAddField(inst, transition, peek(vm));
+                } else {
+                    inst->fields[ic->entries[i].as.field.slot] = peek(vm);
+                }
+                GC_WRITE_BARRIER(vm, inst);
+                return true;
+            }
+        }
+
+        ic->misses++;
+        Shape* shape = inst->shape;
+        instanceSetField(inst, name, peek(vm));
+        GC_WRITE_BARRIER(vm, inst);
+
+        size_t slot;
+        if(inst->shape == shape) {
+            // The field already existed, a failed lookup just leaves the access uncached
+            if(shapeGetSlot(shape, name, &slot)) {
+                cacheField(ic, inst, shape, NULL, slot);
+            }
+        } else if(inst->shape != NULL) {
+            cacheField(ic, inst, shape, inst->shape, shape->fieldCount);
+        }
+        return true;
+    }
+    return setValueField(vm, name);
+}
+
+// If `tail` is true methods found through the inline cache are tail called
+bool invokeValueCached(JStarVM* vm, ObjString* name, uint8_t argc, InlineCache* ic, bool tail) {
+    Value val = peekn(vm, argc);
+
+    // Modules resolve names in their globals, which can change at any time
+    if(!IS_MODULE(val)) {
+        Value method;
+        if(cachedMethod(ic, getClass(vm, val), name, &method)) {
+            return tail ? tailCallValue(vm, method, argc) : callValue(vm, method, argc);
+        }
+    }
+
+    return invokeValue(vm, name, argc);
+}
+
+static bool invokeMethodCached(JStarVM* vm, ObjClass* cls, ObjString* name, uint8_t argc,
+                               InlineCache* ic, bool tail) {
+    Value method;
+    if(!cachedMethod(ic, cls, name, &method)) {
+        jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", cls->name->data,
+                 name->data);
+        return false;
+    }
+    return tail ? tailCallValue(vm, method, argc) : callValue(vm, method, argc);
+}
+
+static bool bindMethodCached(JStarVM* vm, ObjClass* cls, ObjString* name, InlineCache* ic) {
+    Value method;
+    if(!cachedMethod(ic, cls, name, &method)) {
+        jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", cls->name->data,
+                 name->data);
+        return false;
+    }
+
+    pushBoundMethod(vm, AS_OBJ(method));
+    return true;
+}
+
 // -----------------------------------------------------------------------------
 // EVAL LOOP
 // -----------------------------------------------------------------------------
 
+// Handle the requests that broke the evaluation. Samples of the call stack are recorded and the
+// evaluation continues, while `jsrEvalBreak` raises a ProgramInterrupt and exceeding the memory
+// limit a MemoryException. Returns true if an exception has been raised.
+// Since the code may have dropped some references after the memory limit was exceeded, memory is
+// collected again before raising. Its flag is cleared only after raising, so that allocating the
+// exception doesn't check the limit again
+static bool handleEvalBreak(JStarVM* vm) {
+    if(vm->sampleRequest) {
+        vm->sampleRequest = 0;
+        sampleStack(vm);
+    }
+
+    if(vm->interrupt) {
+        vm->interrupt = 0;
+        jsrRaise(vm, "ProgramInterrupt", NULL);
+        return true;
+    }
+
+    if(vm->memoryExceeded) {
+        garbageCollect(vm);
+        if(vm->allocated > vm->memoryLimit) {
+            jsrRaise(vm, "MemoryException", "Memory limit of %zu bytes exceeded", vm->memoryLimit);
+            vm->memoryExceeded = false;
+            return true;
+        }
+        vm->memoryExceeded = false;
+    }
+
+    return false;
+}
+
 bool runEval(JStarVM* vm, int evalDepth) {
     PROFILE_FUNC()
 
@@ -868,19 +1753,104 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
 #define GET_CONST()  (fn->code.consts.arr[NEXT_SHORT()])
 #define GET_STRING() (AS_STRING(GET_CONST()))
+#define GET_CACHE()  (&fn->code.caches[NEXT_SHORT()])
+
+// Arithmetic results that are immediately assigned to a local are written straight into its
+// slot, skipping the OP_STORE_LOCAL that follows. The pair thus executes as a single
+// three-address instruction, while the slow paths still go through the stack
+#define PUSH_RESULT(v)               \
+    do {                             \
+        if(*ip == OP_STORE_LOCAL) {  \
+            frameStack[ip[1]] = (v); \
+            ip += 2;                 \
+        } else {                     \
+            push(vm, (v));           \
+        }                            \
+    } while(0)
+
+// Generic arithmetic and comparison instructions rewrite themselves into a variant specialized
+// on the operand types seen on their first execution. Quickened variants only check their
+// guard, and on a miss revert the instruction to its generic form and re-execute it
+#define QUICKEN(op) (ip[-1] = (op))
+
+// Rewrites an instruction with a two byte operand, replacing the operand with `arg`
+#define QUICKEN_SHORT(op, arg)             \
+    do {                                   \
+        ip[-3] = (op);                     \
+        ip[-2] = (uint8_t)((arg) >> 8);    \
+        ip[-1] = (uint8_t)((arg) & 0xff);  \
+    } while(0)
 
-#define BINARY(type, op, overload, reverse)         \
+#define DEQUICKEN(op)   \
+    do {                \
+        ip[-1] = (op);  \
+        ip--;           \
+        DISPATCH();     \
+    } while(0)
+
+#define BINARY(op, overload, reverse, quickened)    \
     do {                                            \
         if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) { \
+            QUICKEN(quickened);                     \
             double b = AS_NUM(pop(vm));             \
             double a = AS_NUM(pop(vm));             \
-            push(vm, type(a op b));                 \
+            PUSH_RESULT(NUM_VAL(a op b));           \
         } else {                                    \
             BINARY_OVERLOAD(op, overload, reverse); \
         }                                           \
         DISPATCH();                                 \
     } while(0)
 
+// Comparisons are almost always followed by a conditional jump. In that case branch directly,
+// without pushing the boolean result and dispatching to the OP_JUMPF that would pop it
+#define PUSH_CONDITION(cond)            \
+    do {                                \
+        if(*ip == OP_JUMPF) {           \
+            ip++;                       \
+            int16_t off = NEXT_SHORT(); \
+            if(!(cond)) ip += off;      \
+        } else {                        \
+            push(vm, BOOL_VAL(cond));   \
+        }                               \
+    } while(0)
+
+#define COMPARE(op, overload, quickened)            \
+    do {                                            \
+        if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) { \
+            QUICKEN(quickened);                     \
+            double b = AS_NUM(pop(vm));             \
+            double a = AS_NUM(pop(vm));             \
+            PUSH_CONDITION(a op b);                 \
+        } else {                                    \
+            BINARY_OVERLOAD(op, overload, SYM_END); \
+        }                                           \
+        DISPATCH();                                 \
+    } while(0)
+
+#define BINARY_NUM(op, generic)                     \
+    do {                                            \
+        if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) { \
+            double b = AS_NUM(pop(vm));             \
+            double a = AS_NUM(pop(vm));             \
+            PUSH_RESULT(NUM_VAL(a op b));           \
+        } else {                                    \
+            DEQUICKEN(generic);                     \
+        }                                           \
+        DISPATCH();                                 \
+    } while(0)
+
+#define COMPARE_NUM(op, generic)                    \
+    do {                                            \
+        if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) { \
+            double b = AS_NUM(pop(vm));             \
+            double a = AS_NUM(pop(vm));             \
+            PUSH_CONDITION(a op b);                 \
+        } else {                                    \
+            DEQUICKEN(generic);                     \
+        }                                           \
+        DISPATCH();                                 \
+    } while(0)
+
 #define BINARY_OVERLOAD(op, overload, reverse)              \
     do {                                                    \
         SAVE_STATE();                                       \
@@ -889,16 +1859,46 @@ bool runEval(JStarVM* vm, int evalDepth) {
         if(!res) UNWIND_STACK(vm);                          \
     } while(0)
 
-#define BITWISE(name, op, overload, reverse)          \
-    do {                                              \
-        if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) {   \
-            uint32_t b = (uint32_t)AS_NUM(pop(vm));   \
-            uint32_t a = (uint32_t)AS_NUM(pop(vm));   \
-            push(vm, NUM_VAL(a op b));                \
-        } else {                                      \
-            BINARY_OVERLOAD(name, overload, reverse); \
-        }                                             \
-        DISPATCH();                                   \
+// Binary operation between a local and an operand loaded by `loadRight`
+#define FUSED_BINARY(type, op, overload, reverse, loadRight) \
+    do {                                                     \
+        Value a = frameStack[NEXT_CODE()];                   \
+        Value b = loadRight;                                 \
+        if(IS_NUM(a) && IS_NUM(b)) {                         \
+            PUSH_RESULT(type(AS_NUM(a) op AS_NUM(b)));       \
+        } else {                                             \
+            push(vm, a);                                     \
+            push(vm, b);                                     \
+            BINARY_OVERLOAD(op, overload, reverse);          \
+        }                                                    \
+        DISPATCH();                                          \
+    } while(0)
+
+#define FUSED_COMPARE(op, overload, loadRight)      \
+    do {                                            \
+        Value a = frameStack[NEXT_CODE()];          \
+        Value b = loadRight;                        \
+        if(IS_NUM(a) && IS_NUM(b)) {                \
+            PUSH_CONDITION(AS_NUM(a) op AS_NUM(b)); \
+        } else {                                    \
+            push(vm, a);                            \
+            push(vm, b);                            \
+            BINARY_OVERLOAD(op, overload, SYM_END); \
+        }                                           \
+        DISPATCH();                                 \
+    } while(0)
+
+// The right operand is masked with `mask`, so that shift counts are always in range
+#define BITWISE(name, op, mask, overload, reverse)           \
+    do {                                                     \
+        if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) {          \
+            uint32_t b = toBitwiseOperand(AS_NUM(pop(vm)));  \
+            uint32_t a = toBitwiseOperand(AS_NUM(pop(vm)));  \
+            PUSH_RESULT(NUM_VAL(a op (b & (mask))));         \
+        } else {                                             \
+            BINARY_OVERLOAD(name, overload, reverse);        \
+        }                                                    \
+        DISPATCH();                                          \
     } while(0)
 
 #define UNARY(type, op, overload)               \
@@ -920,13 +1920,13 @@ bool runEval(JStarVM* vm, int evalDepth) {
         if(!res) UNWIND_STACK(vm);                   \
     } while(0)
 
-#define RESTORE_HANDLER(vm, h, frame, cause, exc) \
-    do {                                          \
-        frame->ip = h->address;                   \
-        vm->sp = h->savedSp;                      \
-        closeUpvalues(vm, vm->sp);                \
-        push(vm, exc);                            \
-        push(vm, NUM_VAL(cause));                 \
+#define RESTORE_HANDLER(vm, code, h, frame, cause, exc) \
+    do {                                                \
+        frame->ip = (code)->bytecode + h->address;      \
+        vm->sp = frame->stack + h->stackDepth;          \
+        closeUpvalues(vm, vm->sp);                      \
+        push(vm, exc);                                  \
+        push(vm, NUM_VAL(cause));                       \
     } while(0)
 
 #define UNWIND_STACK(vm)                  \
@@ -943,11 +1943,26 @@ bool runEval(JStarVM* vm, int evalDepth) {
     do {                                            \
         if(vm->evalBreak) {                         \
             vm->evalBreak = 0;                      \
-            jsrRaise(vm, "ProgramInterrupt", NULL); \
-            UNWIND_STACK(vm);                       \
+            SAVE_STATE();                           \
+            if(handleEvalBreak(vm)) {               \
+                UNWIND_STACK(vm);                   \
+            }                                       \
         }                                           \
     } while(0)
 
+// Loads the placeholder of a lazy import on its first use. This executes the body of the module,
+// so the state of the frame has to be saved and reloaded
+#define RESOLVE_LAZY_MODULE(vm, val)                              \
+    do {                                                          \
+        Value v_ = (val);                                         \
+        if(IS_MODULE(v_) && AS_MODULE(v_)->lazy) {                \
+            SAVE_STATE();                                         \
+            bool resolved_ = resolveLazyModule(vm, AS_MODULE(v_)); \
+            LOAD_STATE();                                         \
+            if(!resolved_) UNWIND_STACK(vm);                      \
+        }                                                         \
+    } while(0)
+
 #ifdef JSTAR_DBG_PRINT_EXEC
     #define PRINT_DBG_STACK()                        \
         printf("     ");                             \
@@ -962,6 +1977,12 @@ bool runEval(JStarVM* vm, int evalDepth) {
     #define PRINT_DBG_STACK()
 #endif
 
+#ifdef JSTAR_OPCODE_STATS
+    #define COUNT_OPCODE(op) countOpcode(&vm->opStats, &fn->proto, op)
+#else
+    #define COUNT_OPCODE(op) (op)
+#endif
+
 #ifdef JSTAR_COMPUTED_GOTOS
     // create jumptable
     static void* opJmpTable[] = {
@@ -970,10 +1991,10 @@ bool runEval(JStarVM* vm, int evalDepth) {
     };
 
     #define TARGET(op) TARGET_##op
-    #define DISPATCH()                            \
-        do {                                      \
-            PRINT_DBG_STACK()                     \
-            goto* opJmpTable[(op = NEXT_CODE())]; \
+    #define DISPATCH()                                          \
+        do {                                                    \
+            PRINT_DBG_STACK()                                   \
+            goto* opJmpTable[COUNT_OPCODE(op = NEXT_CODE())];   \
         } while(0)
 
     #define DECODE(op) DISPATCH();
@@ -983,7 +2004,7 @@ bool runEval(JStarVM* vm, int evalDepth) {
     #define DECODE(op)     \
     decode:                \
         PRINT_DBG_STACK(); \
-        switch((op = NEXT_CODE()))
+        switch(COUNT_OPCODE(op = NEXT_CODE()))
 #endif
 
     // clang-format off
@@ -995,16 +2016,29 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
     TARGET(OP_ADD): {
         if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) {
+            QUICKEN(OP_ADD_NUM);
             double b = AS_NUM(pop(vm));
             double a = AS_NUM(pop(vm));
-            push(vm, NUM_VAL(a + b));
+            PUSH_RESULT(NUM_VAL(a + b));
         } else if(IS_STRING(peek(vm)) && IS_STRING(peek2(vm))) {
+            QUICKEN(OP_ADD_STR);
             concatStrings(vm);
         } else {
             BINARY_OVERLOAD(+, SYM_ADD, SYM_RADD);
         }
         DISPATCH();
     }
+
+    TARGET(OP_ADD_NUM): BINARY_NUM(+, OP_ADD);
+
+    TARGET(OP_ADD_STR): {
+        if(IS_STRING(peek(vm)) && IS_STRING(peek2(vm))) {
+            concatStrings(vm);
+        } else {
+            DEQUICKEN(OP_ADD);
+        }
+        DISPATCH();
+    }
     
     TARGET(OP_MOD): {
         if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) {
@@ -1030,7 +2064,8 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
     TARGET(OP_EQ): {
         if(IS_NUM(peek2(vm)) || IS_NULL(peek2(vm)) || IS_BOOL(peek2(vm))) {
-            push(vm, BOOL_VAL(valueEquals(pop(vm), pop(vm))));
+            Value b = pop(vm), a = pop(vm);
+            PUSH_CONDITION(valueEquals(a, b));
         } else {
             BINARY_OVERLOAD(==, SYM_EQ, SYM_END);
         }
@@ -1039,7 +2074,7 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
     TARGET(OP_INVERT): {
         if(IS_NUM(peek(vm))) {
-            push(vm, NUM_VAL(~(uint32_t)AS_NUM(pop(vm))));
+            PUSH_RESULT(NUM_VAL(~toBitwiseOperand(AS_NUM(pop(vm)))));
         } else {
             UNARY_OVERLOAD(NUM_VAL, ~, SYM_INV);
         }
@@ -1051,20 +2086,57 @@ bool runEval(JStarVM* vm, int evalDepth) {
         DISPATCH();
     }
 
-    TARGET(OP_SUB):    BINARY(NUM_VAL, -, SYM_SUB, SYM_RSUB);
-    TARGET(OP_MUL):    BINARY(NUM_VAL, *, SYM_MUL, SYM_RMUL);
-    TARGET(OP_DIV):    BINARY(NUM_VAL, /, SYM_DIV, SYM_RDIV);
-    TARGET(OP_LT):     BINARY(BOOL_VAL, <, SYM_LT, SYM_END);
-    TARGET(OP_LE):     BINARY(BOOL_VAL, <=, SYM_LE, SYM_END);
-    TARGET(OP_GT):     BINARY(BOOL_VAL, >, SYM_GT, SYM_END);
-    TARGET(OP_GE):     BINARY(BOOL_VAL, >=, SYM_GE, SYM_END);
-    TARGET(OP_LSHIFT): BITWISE(<<, <<, SYM_LSHFT, SYM_RLSHFT);
-    TARGET(OP_RSHIFT): BITWISE(>>, >>, SYM_RSHFT, SYM_RRSHFT);
-    TARGET(OP_BAND):   BITWISE(&, &, SYM_BAND, SYM_RBAND);
-    TARGET(OP_BOR):    BITWISE(|, |, SYM_BOR, SYM_RBOR);
-    TARGET(OP_XOR):    BITWISE(~, ^, SYM_XOR, SYM_RXOR);
+    TARGET(OP_SUB):    BINARY(-, SYM_SUB, SYM_RSUB, OP_SUB_NUM);
+    TARGET(OP_MUL):    BINARY(*, SYM_MUL, SYM_RMUL, OP_MUL_NUM);
+    TARGET(OP_DIV):    BINARY(/, SYM_DIV, SYM_RDIV, OP_DIV_NUM);
+    TARGET(OP_LT):     COMPARE(<, SYM_LT, OP_LT_NUM);
+    TARGET(OP_LE):     COMPARE(<=, SYM_LE, OP_LE_NUM);
+    TARGET(OP_GT):     COMPARE(>, SYM_GT, OP_GT_NUM);
+    TARGET(OP_GE):     COMPARE(>=, SYM_GE, OP_GE_NUM);
+    TARGET(OP_LSHIFT): BITWISE(<<, <<, 31, SYM_LSHFT, SYM_RLSHFT);
+    TARGET(OP_RSHIFT): BITWISE(>>, >>, 31, SYM_RSHFT, SYM_RRSHFT);
+    TARGET(OP_BAND):   BITWISE(&, &, UINT32_MAX, SYM_BAND, SYM_RBAND);
+    TARGET(OP_BOR):    BITWISE(|, |, UINT32_MAX, SYM_BOR, SYM_RBOR);
+    TARGET(OP_XOR):    BITWISE(~, ^, UINT32_MAX, SYM_XOR, SYM_RXOR);
     TARGET(OP_NEG):    UNARY(NUM_VAL, -, SYM_NEG);
 
+    TARGET(OP_SUB_NUM): BINARY_NUM(-, OP_SUB);
+    TARGET(OP_MUL_NUM): BINARY_NUM(*, OP_MUL);
+    TARGET(OP_DIV_NUM): BINARY_NUM(/, OP_DIV);
+    TARGET(OP_LT_NUM):  COMPARE_NUM(<, OP_LT);
+    TARGET(OP_LE_NUM):  COMPARE_NUM(<=, OP_LE);
+    TARGET(OP_GT_NUM):  COMPARE_NUM(>, OP_GT);
+    TARGET(OP_GE_NUM):  COMPARE_NUM(>=, OP_GE);
+
+    TARGET(OP_ADD_LOCAL_CONST): FUSED_BINARY(NUM_VAL, +, SYM_ADD, SYM_RADD, GET_CONST());
+    TARGET(OP_SUB_LOCAL_CONST): FUSED_BINARY(NUM_VAL, -, SYM_SUB, SYM_RSUB, GET_CONST());
+    TARGET(OP_LT_LOCAL_CONST):  FUSED_COMPARE(<, SYM_LT, GET_CONST());
+    TARGET(OP_LE_LOCAL_CONST):  FUSED_COMPARE(<=, SYM_LE, GET_CONST());
+    TARGET(OP_GT_LOCAL_CONST):  FUSED_COMPARE(>, SYM_GT, GET_CONST());
+    TARGET(OP_GE_LOCAL_CONST):  FUSED_COMPARE(>=, SYM_GE, GET_CONST());
+    TARGET(OP_SUB_LOCALS):      FUSED_BINARY(NUM_VAL, -, SYM_SUB, SYM_RSUB, frameStack[NEXT_CODE()]);
+    TARGET(OP_LT_LOCALS):       FUSED_COMPARE(<, SYM_LT, frameStack[NEXT_CODE()]);
+    TARGET(OP_LE_LOCALS):       FUSED_COMPARE(<=, SYM_LE, frameStack[NEXT_CODE()]);
+    TARGET(OP_GT_LOCALS):       FUSED_COMPARE(>, SYM_GT, frameStack[NEXT_CODE()]);
+    TARGET(OP_GE_LOCALS):       FUSED_COMPARE(>=, SYM_GE, frameStack[NEXT_CODE()]);
+
+    TARGET(OP_ADD_LOCALS): {
+        Value a = frameStack[NEXT_CODE()];
+        Value b = frameStack[NEXT_CODE()];
+        if(IS_NUM(a) && IS_NUM(b)) {
+            PUSH_RESULT(NUM_VAL(AS_NUM(a) + AS_NUM(b)));
+        } else {
+            push(vm, a);
+            push(vm, b);
+            if(IS_STRING(a) && IS_STRING(b)) {
+                concatStrings(vm);
+            } else {
+                BINARY_OVERLOAD(+, SYM_ADD, SYM_RADD);
+            }
+        }
+        DISPATCH();
+    }
+
     TARGET(OP_IS): {
         if(!IS_CLASS(peek(vm))) {
             jsrRaise(vm, "TypeException", "Right operand of `is` must be a Class");
@@ -1077,6 +2149,33 @@ bool runEval(JStarVM* vm, int evalDepth) {
     }
 
     TARGET(OP_SUBSCR_GET): {
+        // Index in bounds of a List, Tuple or numeric array
+        if(IS_LIST(peek2(vm))) {
+            ObjList* lst = AS_LIST(peek2(vm));
+            size_t i = sequenceIndex(peek(vm), lst->size);
+            if(i != SIZE_MAX) {
+                vm->sp -= 2;
+                PUSH_RESULT(lst->arr[i]);
+                DISPATCH();
+            }
+        } else if(IS_TUPLE(peek2(vm))) {
+            ObjTuple* tup = AS_TUPLE(peek2(vm));
+            size_t i = sequenceIndex(peek(vm), tup->size);
+            if(i != SIZE_MAX) {
+                vm->sp -= 2;
+                PUSH_RESULT(tup->arr[i]);
+                DISPATCH();
+            }
+        } else if(IS_ARRAY(peek2(vm))) {
+            ObjArray* arr = AS_ARRAY(peek2(vm));
+            size_t i = sequenceIndex(peek(vm), arr->length);
+            if(i != SIZE_MAX) {
+                vm->sp -= 2;
+                PUSH_RESULT(NUM_VAL(arrayGet(arr, i)));
+                DISPATCH();
+            }
+        }
+
         SAVE_STATE();
         bool res = getValueSubscript(vm);
         LOAD_STATE();
@@ -1085,6 +2184,26 @@ bool runEval(JStarVM* vm, int evalDepth) {
     }
 
     TARGET(OP_SUBSCR_SET): {
+        // Index in bounds of a List or numeric array. The stored value is left on the stack
+        if(IS_LIST(peek(vm))) {
+            ObjList* lst = AS_LIST(peek(vm));
+            size_t i = sequenceIndex(peek2(vm), lst->size);
+            if(i != SIZE_MAX) {
+                lst->arr[i] = vm->sp[-3];
+                GC_WRITE_BARRIER(vm, lst);
+                vm->sp -= 2;
+                DISPATCH();
+            }
+        } else if(IS_ARRAY(peek(vm)) && IS_NUM(vm->sp[-3])) {
+            ObjArray* arr = AS_ARRAY(peek(vm));
+            size_t i = sequenceIndex(peek2(vm), arr->length);
+            if(i != SIZE_MAX) {
+                arraySet(arr, i, AS_NUM(vm->sp[-3]));
+                vm->sp -= 2;
+                DISPATCH();
+            }
+        }
+
         SAVE_STATE();
         bool res = setValueSubscript(vm);
         LOAD_STATE();
@@ -1093,14 +2212,28 @@ bool runEval(JStarVM* vm, int evalDepth) {
     }
 
     TARGET(OP_GET_FIELD): {
-        if(!getValueField(vm, GET_STRING())) {
+        RESOLVE_LAZY_MODULE(vm, peek(vm));
+        ObjString* name = GET_STRING();
+        if(!getFieldCached(vm, name, GET_CACHE())) {
+            UNWIND_STACK(vm);
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_GET_LOCAL_FIELD): {
+        push(vm, frameStack[NEXT_CODE()]);
+        RESOLVE_LAZY_MODULE(vm, peek(vm));
+        ObjString* name = GET_STRING();
+        if(!getFieldCached(vm, name, GET_CACHE())) {
             UNWIND_STACK(vm);
         }
         DISPATCH();
     }
 
     TARGET(OP_SET_FIELD): {
-        if(!setValueField(vm, GET_STRING())) {
+        RESOLVE_LAZY_MODULE(vm, peek(vm));
+        ObjString* name = GET_STRING();
+        if(!setFieldCached(vm, name, GET_CACHE())) {
             UNWIND_STACK(vm);
         }
         DISPATCH();
@@ -1108,8 +2241,10 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
     TARGET(OP_JUMP): {
         int16_t off = NEXT_SHORT();
-        ip += off;
+        // Checked before jumping, so that the interrupt is raised inside the exception handlers
+        // protecting the jump instruction, rather than those protecting its target
         CHECK_EVAL_BREAK(vm);
+        ip += off;
         DISPATCH();
     }
 
@@ -1138,6 +2273,33 @@ bool runEval(JStarVM* vm, int evalDepth) {
     }
 
     TARGET(OP_FOR_ITER): {
+        // Builtin iterables are advanced directly, along with the OP_FOR_NEXT that follows
+        bool done;
+        if(iterateBuiltin(vm, vm->sp[-4], &vm->sp[-3], &done)) {
+            ip++;
+            int16_t off = NEXT_SHORT();
+            if(done) ip += off;
+            DISPATCH();
+        }
+
+        // Generators are resumed directly, and OP_FOR_NEXT finds the yielded value on the stack
+        if(IS_GENERATOR(vm->sp[-4])) {
+            ObjGenerator* gen = AS_GENERATOR(vm->sp[-4]);
+            if(gen->state == GEN_DONE) {
+                ip++;
+                int16_t off = NEXT_SHORT();
+                ip += off;
+                DISPATCH();
+            }
+
+            push(vm, OBJ_VAL(gen));
+            SAVE_STATE();
+            bool res = resumeGenerator(vm, gen, 0);
+            LOAD_STATE();
+            if(!res) UNWIND_STACK(vm);
+            DISPATCH();
+        }
+
         vm->sp[0] = vm->sp[-4];
         vm->sp[1] = vm->sp[-3];
         vm->sp += 2;
@@ -1150,6 +2312,15 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
     TARGET(OP_FOR_NEXT): {
         int16_t off = NEXT_SHORT();
+        if(IS_GENERATOR(vm->sp[-5])) {
+            // The generator either yielded the next element, or returned
+            if(AS_GENERATOR(vm->sp[-5])->state == GEN_DONE) {
+                pop(vm);
+                ip += off;
+            }
+            DISPATCH();
+        }
+
         vm->sp[-4] = vm->sp[-1];
         if(valueToBool(pop(vm))) {
             vm->sp[0] = vm->sp[-4];
@@ -1187,11 +2358,21 @@ bool runEval(JStarVM* vm, int evalDepth) {
         argc = op - OP_CALL_0;
         goto call;
 
-    TARGET(OP_CALL_UNPACK):
-        if(!unpackCall(vm, NEXT_CODE(), &argc)) {
+    TARGET(OP_CALL_UNPACK): {
+        argc = NEXT_CODE();
+        Obj* target = varargsForwardTarget(vm, argc);
+        if(target) {
+            SAVE_STATE();
+            bool res = forwardVarargs(vm, target, false);
+            LOAD_STATE();
+            if(!res) UNWIND_STACK(vm);
+            DISPATCH();
+        }
+        if(!unpackCall(vm, argc, &argc)) {
             UNWIND_STACK(vm);
         }
         goto call;
+    }
 
     TARGET(OP_CALL):
         argc = NEXT_CODE();
@@ -1233,9 +2414,11 @@ call:
         goto invoke;
 
 invoke:;
+        RESOLVE_LAZY_MODULE(vm, peekn(vm, argc));
         ObjString* name = GET_STRING();
+        InlineCache* ic = GET_CACHE();
         SAVE_STATE();
-        bool res = invokeValue(vm, name, argc);
+        bool res = invokeValueCached(vm, name, argc, ic, false);
         LOAD_STATE();
         if(!res) UNWIND_STACK(vm);
         DISPATCH();
@@ -1270,9 +2453,94 @@ invoke:;
 
 supinvoke:;
         ObjString* name = GET_STRING();
+        InlineCache* ic = GET_CACHE();
+        ObjClass* superCls = AS_CLASS(fn->code.consts.arr[SUPER_SLOT]);
+        SAVE_STATE();
+        bool res = invokeMethodCached(vm, superCls, name, argc, ic, false);
+        LOAD_STATE();
+        if(!res) UNWIND_STACK(vm);
+        DISPATCH();
+    }
+
+    // Tail calls are checked for interrupts, since a loop made of them never reaches a jump
+    {
+        uint8_t argc;
+
+    TARGET(OP_TAIL_CALL_UNPACK): {
+        argc = NEXT_CODE();
+        Obj* target = varargsForwardTarget(vm, argc);
+        if(target) {
+            CHECK_EVAL_BREAK(vm);
+            SAVE_STATE();
+            bool res = forwardVarargs(vm, target, true);
+            LOAD_STATE();
+            if(!res) UNWIND_STACK(vm);
+            DISPATCH();
+        }
+        if(!unpackCall(vm, argc, &argc)) {
+            UNWIND_STACK(vm);
+        }
+        goto tailcall;
+    }
+
+    TARGET(OP_TAIL_CALL):
+        argc = NEXT_CODE();
+        goto tailcall;
+
+tailcall:
+        CHECK_EVAL_BREAK(vm);
+        SAVE_STATE();
+        bool res = tailCallValue(vm, peekn(vm, argc), argc);
+        LOAD_STATE();
+        if(!res) UNWIND_STACK(vm);
+        DISPATCH();
+    }
+
+    {
+        uint8_t argc;
+
+    TARGET(OP_TAIL_INVOKE_UNPACK):
+        if(!unpackCall(vm, NEXT_CODE(), &argc)) {
+            UNWIND_STACK(vm);
+        }
+        goto tailinvoke;
+
+    TARGET(OP_TAIL_INVOKE):
+        argc = NEXT_CODE();
+        goto tailinvoke;
+
+tailinvoke:;
+        RESOLVE_LAZY_MODULE(vm, peekn(vm, argc));
+        ObjString* name = GET_STRING();
+        InlineCache* ic = GET_CACHE();
+        CHECK_EVAL_BREAK(vm);
+        SAVE_STATE();
+        bool res = invokeValueCached(vm, name, argc, ic, true);
+        LOAD_STATE();
+        if(!res) UNWIND_STACK(vm);
+        DISPATCH();
+    }
+
+    {
+        uint8_t argc;
+
+    TARGET(OP_TAIL_SUPER_UNPACK):
+        if(!unpackCall(vm, NEXT_CODE(), &argc)) {
+            UNWIND_STACK(vm);
+        }
+        goto tailsupinvoke;
+
+    TARGET(OP_TAIL_SUPER):
+        argc = NEXT_CODE();
+        goto tailsupinvoke;
+
+tailsupinvoke:;
+        ObjString* name = GET_STRING();
+        InlineCache* ic = GET_CACHE();
         ObjClass* superCls = AS_CLASS(fn->code.consts.arr[SUPER_SLOT]);
+        CHECK_EVAL_BREAK(vm);
         SAVE_STATE();
-        bool res = invokeMethod(vm, superCls, name, argc);
+        bool res = invokeMethodCached(vm, superCls, name, argc, ic, true);
         LOAD_STATE();
         if(!res) UNWIND_STACK(vm);
         DISPATCH();
@@ -1280,10 +2548,9 @@ supinvoke:;
 
     TARGET(OP_SUPER_BIND): {
         ObjString* name = GET_STRING();
+        InlineCache* ic = GET_CACHE();
         ObjClass* superCls = AS_CLASS(fn->code.consts.arr[SUPER_SLOT]);
-        if(!bindMethod(vm, superCls, name)) {
-            jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", superCls->name->data,
-                     name->data);
+        if(!bindMethodCached(vm, superCls, name, ic)) {
             UNWIND_STACK(vm);
         }
         DISPATCH();
@@ -1291,16 +2558,23 @@ supinvoke:;
 
 op_return:
     TARGET(OP_RETURN): {
-        Value ret = pop(vm);
+        // Checked while the returned value is still on the stack, as the check can collect memory
         CHECK_EVAL_BREAK(vm);
+        Value ret = pop(vm);
 
-        while(frame->handlerc > 0) {
-            Handler* h = &frame->handlers[--frame->handlerc];
-            if(h->type == HANDLER_ENSURE) {
-                RESTORE_HANDLER(vm, h, frame, CAUSE_RETURN, ret);
-                LOAD_STATE();
-                DISPATCH();
-            }
+        const Handler* h = findHandler(&fn->code, ip - fn->code.bytecode - 1, true);
+        if(h) {
+            RESTORE_HANDLER(vm, &fn->code, h, frame, CAUSE_RETURN, ret);
+            LOAD_STATE();
+            DISPATCH();
+        }
+
+        if(frame->gen) {
+            finishGenerator(frame->gen);
+        }
+
+        if(TRACING(vm, JSR_TRACE_RETURN)) {
+            traceFunction(vm, JSR_TRACE_RETURN, &fn->proto, vm->frameCount, false);
         }
 
         closeUpvalues(vm, frameStack);
@@ -1317,9 +2591,59 @@ op_return:
         DISPATCH();
     }
 
+    {
+        Value yielded;
+
+    TARGET(OP_GENERATOR):
+        // Generator functions start with this instruction. Instead of executing the body, the call
+        // returns a new generator, suspended at the start of the function
+        frame->gen = newGenerator(vm, closure);
+        saveGenerator(vm, frame->gen, frameStack, vm->sp, ip);
+        yielded = OBJ_VAL(frame->gen);
+        goto suspend;
+
+    TARGET(OP_YIELD):
+        saveGenerator(vm, frame->gen, frameStack, vm->sp - 1, ip);
+        yielded = peek(vm);
+        goto suspend;
+
+suspend:
+        if(TRACING(vm, JSR_TRACE_RETURN)) {
+            traceFunction(vm, JSR_TRACE_RETURN, &fn->proto, vm->frameCount, false);
+        }
+
+        vm->sp = frameStack;
+        push(vm, yielded);
+
+        if(--vm->frameCount == evalDepth) {
+            return true;
+        }
+
+        LOAD_STATE();
+        vm->module = fn->proto.module;
+
+        DISPATCH();
+    }
+
     TARGET(OP_IMPORT): 
     TARGET(OP_IMPORT_FROM): {
         ObjString* name = GET_STRING();
+
+        // Lazy imports are loaded on first use, timed and traced ones are executed to completion
+        // here so that their end can be recorded
+        if(vm->lazyImports || vm->traceImports ||
+           TRACING(vm, JSR_TRACE_IMPORT_BEGIN | JSR_TRACE_IMPORT_END)) {
+            SAVE_STATE();
+            ObjModule* module = vm->lazyImports ? importModuleLazy(vm, name)
+                                                : importModuleSync(vm, name);
+            LOAD_STATE();
+            if(module == NULL) UNWIND_STACK(vm);
+
+            if(op == OP_IMPORT) push(vm, OBJ_VAL(module));
+            push(vm, NULL_VAL);
+            DISPATCH();
+        }
+
         ObjModule* module = importModule(vm, name);
 
         if(module == NULL) {
@@ -1344,8 +2668,9 @@ op_return:
     
     TARGET(OP_IMPORT_NAME): {
         ObjModule* module = getModule(vm, GET_STRING());
+        RESOLVE_LAZY_MODULE(vm, OBJ_VAL(module));
         ObjString* name = GET_STRING();
-        if(!hashTableGet(&module->globals, name, vm->sp)) {
+        if(!moduleGetGlobal(module, name, vm->sp)) {
             jsrRaise(vm, "NameException", "Name `%s` not defined in module `%s`.", 
                      name->data, module->name->data);
             UNWIND_STACK(vm);
@@ -1355,7 +2680,7 @@ op_return:
     }
 
     TARGET(OP_NEW_LIST): {
-        push(vm, OBJ_VAL(newList(vm, 0)));
+        push(vm, OBJ_VAL(newList(vm, NEXT_SHORT())));
         DISPATCH();
     }
 
@@ -1376,12 +2701,52 @@ op_return:
     }
 
     TARGET(OP_NEW_TABLE): {
-        push(vm, OBJ_VAL(newTable(vm)));
+        push(vm, OBJ_VAL(newTable(vm, NEXT_SHORT())));
+        DISPATCH();
+    }
+
+    TARGET(OP_NEW_CONST_LIST): {
+        ObjTuple* elems = AS_TUPLE(GET_CONST());
+        ObjList* lst = newList(vm, elems->size);
+        memcpy(lst->arr, elems->arr, sizeof(Value) * elems->size);
+        lst->size = elems->size;
+        push(vm, OBJ_VAL(lst));
+        DISPATCH();
+    }
+
+    TARGET(OP_NEW_CONST_TABLE): {
+        ObjTuple* keyVals = AS_TUPLE(GET_CONST());
+        ObjTable* t = newTable(vm, keyVals->size / 2);
+        push(vm, OBJ_VAL(t));
+
+        SAVE_STATE();
+        for(size_t i = 0; i + 1 < keyVals->size; i += 2) {
+            bool inserted;
+            if(!tableSet(vm, t, keyVals->arr[i], keyVals->arr[i + 1], &inserted)) {
+                LOAD_STATE();
+                UNWIND_STACK(vm);
+            }
+        }
+        LOAD_STATE();
+
         DISPATCH();
     }
 
     TARGET(OP_CLOSURE): {
-        ObjClosure* c = newClosure(vm, AS_FUNC(GET_CONST()));
+        ObjFunction* closureFn = AS_FUNC(GET_CONST());
+
+        // A closure without upvalues has no state of its own, so a single one can be shared by
+        // all evaluations of the function expression, e.g. a lambda created in a loop
+        if(closureFn->upvalueCount == 0) {
+            if(!closureFn->closure) {
+                closureFn->closure = newClosure(vm, closureFn);
+                GC_WRITE_BARRIER(vm, closureFn);
+            }
+            push(vm, OBJ_VAL(closureFn->closure));
+            DISPATCH();
+        }
+
+        ObjClosure* c = newClosure(vm, closureFn);
         push(vm, OBJ_VAL(c));
         for(uint8_t i = 0; i < c->upvalueCount; i++) {
             uint8_t isLocal = NEXT_CODE();
@@ -1439,8 +2804,7 @@ op_return:
         ObjClass* cls = AS_CLASS(peek(vm));
         ObjString* methodName = GET_STRING();
         ObjNative* native = AS_NATIVE(GET_CONST());
-        native->fn = resolveNative(vm->module, cls->name->data, methodName->data);
-        if(native->fn == NULL) {
+        if(!resolveNative(vm->module, cls->name->data, methodName->data, native)) {
             jsrRaise(vm, "Exception", "Cannot resolve native method %s().", native->proto.name->data);
             UNWIND_STACK(vm);
         }
@@ -1451,8 +2815,7 @@ op_return:
     TARGET(OP_NATIVE): {
         ObjString* name = GET_STRING();
         ObjNative* nat  = AS_NATIVE(peek(vm));
-        nat->fn = resolveNative(vm->module, NULL, name->data);
-        if(nat->fn == NULL) {
+        if(!resolveNative(vm->module, NULL, name->data, nat)) {
             jsrRaise(vm, "Exception", "Cannot resolve native function %s.%s.", 
                      vm->module->name->data, nat->proto.name->data);
             UNWIND_STACK(vm);
@@ -1465,40 +2828,51 @@ op_return:
         DISPATCH();
     }
 
+    TARGET(OP_GET_SMALL_INT): {
+        push(vm, NUM_VAL((int8_t)NEXT_CODE()));
+        DISPATCH();
+    }
+
     TARGET(OP_DEFINE_GLOBAL): {
-        hashTablePut(&vm->module->globals, GET_STRING(), pop(vm));
+        moduleSetGlobal(vm->module, GET_STRING(), pop(vm));
         DISPATCH();
     }
 
+    // Once a global is found, the instruction is rewritten to address its slot directly
     TARGET(OP_GET_GLOBAL): {
         ObjString* name = GET_STRING();
-        if(!hashTableGet(&vm->module->globals, name, vm->sp)) {
+        size_t slot;
+        if(!moduleGetSlot(vm->module, name, &slot)) {
             jsrRaise(vm, "NameException", "Name `%s` is not defined.", name->data);
             UNWIND_STACK(vm);
         }
-        vm->sp++;
+        if(slot <= UINT16_MAX) QUICKEN_SHORT(OP_GET_GLOBAL_SLOT, slot);
+        push(vm, vm->module->globals.arr[slot]);
+        DISPATCH();
+    }
+
+    TARGET(OP_GET_GLOBAL_SLOT): {
+        push(vm, vm->module->globals.arr[NEXT_SHORT()]);
         DISPATCH();
     }
 
     TARGET(OP_SET_GLOBAL): {
         ObjString* name = GET_STRING();
-        if(hashTablePut(&vm->module->globals, name, peek(vm))) {
+        size_t slot;
+        if(!moduleGetSlot(vm->module, name, &slot)) {
             jsrRaise(vm, "NameException", "Name `%s` is not defined.", name->data);
             UNWIND_STACK(vm);
         }
+        if(slot <= UINT16_MAX) QUICKEN_SHORT(OP_SET_GLOBAL_SLOT, slot);
+        vm->module->globals.arr[slot] = peek(vm);
         DISPATCH();
     }
 
-    TARGET(OP_SETUP_EXCEPT): 
-    TARGET(OP_SETUP_ENSURE): {
-        uint16_t offset = NEXT_SHORT();
-        Handler* handler = &frame->handlers[frame->handlerc++];
-        handler->type = op == OP_SETUP_ENSURE ? HANDLER_ENSURE : HANDLER_EXCEPT;
-        handler->address = ip + offset;
-        handler->savedSp = vm->sp;
+    TARGET(OP_SET_GLOBAL_SLOT): {
+        vm->module->globals.arr[NEXT_SHORT()] = peek(vm);
         DISPATCH();
     }
-    
+
     TARGET(OP_END_HANDLER): {
         if(!IS_NULL(peek(vm))) { // Is the exception still unhandled?
             UnwindCause cause = AS_NUM(pop(vm));
@@ -1518,11 +2892,6 @@ op_return:
         DISPATCH();
     }
 
-    TARGET(OP_POP_HANDLER): {
-        frame->handlerc--;
-        DISPATCH();
-    }
-    
     TARGET(OP_RAISE): {
         jsrRaiseException(vm, -1);
         UNWIND_STACK(vm);
@@ -1538,6 +2907,11 @@ op_return:
         DISPATCH();
     }
 
+    TARGET(OP_STORE_LOCAL): {
+        frameStack[NEXT_CODE()] = pop(vm);
+        DISPATCH();
+    }
+
     TARGET(OP_GET_UPVALUE): {
         push(vm, *closure->upvalues[NEXT_CODE()]->addr);
         DISPATCH();
@@ -1586,14 +2960,12 @@ op_return:
     return false;
 }
 
-bool unwindStack(JStarVM* vm, int depth) {
-    PROFILE_FUNC()
-
+static bool unwindFrames(JStarVM* vm, int depth) {
     ASSERT(isInstance(vm, peek(vm), vm->excClass), "Top of stack is not an Exception");
     ObjInstance* exception = AS_INSTANCE(peek(vm));
 
     Value stacktraceVal = NULL_VAL;
-    hashTableGet(&exception->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stacktraceVal);
+    instanceGetField(exception, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stacktraceVal);
     ASSERT(IS_STACK_TRACE(stacktraceVal), "Exception doesn't have a stacktrace object");
     ObjStackTrace* stacktrace = AS_STACK_TRACE(stacktraceVal);
 
@@ -1618,15 +2990,33 @@ bool unwindStack(JStarVM* vm, int depth) {
 
         stacktraceDump(vm, stacktrace, frame, vm->frameCount);
 
-        // If current frame has except or ensure handlers restore handler state and exit
-        if(frame->handlerc > 0) {
-            Value exc = pop(vm);
-            Handler* h = &frame->handlers[--frame->handlerc];
-            RESTORE_HANDLER(vm, h, frame, CAUSE_EXCEPT, exc);
-            return true;
+        // If the current instruction is protected by an except or ensure handler restore handler
+        // state and exit. Handlers are looked up only here, so entering a try block costs nothing
+        if(frame->fn->type == OBJ_CLOSURE) {
+            Code* code = &((ObjClosure*)frame->fn)->fn->code;
+            const Handler* h = findHandler(code, frame->ip - code->bytecode - 1, false);
+            if(h) {
+                Value exc = pop(vm);
+                RESTORE_HANDLER(vm, code, h, frame, CAUSE_EXCEPT, exc);
+                return true;
+            }
+        }
+
+        if(TRACING(vm, JSR_TRACE_RETURN)) {
+            Prototype* proto;
+            if(frame->fn->type == OBJ_CLOSURE) {
+                proto = &((ObjClosure*)frame->fn)->fn->proto;
+            } else {
+                proto = &((ObjNative*)frame->fn)->proto;
+            }
+            traceFunction(vm, JSR_TRACE_RETURN, proto, vm->frameCount, true);
         }
 
         closeUpvalues(vm, frame->stack);
+
+        if(frame->gen) {
+            finishGenerator(frame->gen);
+        }
     }
 
     // We have reached the end of the stack or a native/function boundary,
@@ -1634,6 +3024,17 @@ bool unwindStack(JStarVM* vm, int depth) {
     return false;
 }
 
+bool unwindStack(JStarVM* vm, int depth) {
+    PROFILE_FUNC()
+
+    // The values of the unwound frames stay on the stack until a handler is restored, so the
+    // memory limit is not checked in the meantime: a collection couldn't reclaim them
+    vm->unwinding = true;
+    bool handled = unwindFrames(vm, depth);
+    vm->unwinding = false;
+    return handled;
+}
+
 // Inline function declarations
 extern inline void push(JStarVM* vm, Value v);
 extern inline Value pop(JStarVM* vm);
@@ -1641,4 +3042,4 @@ extern inline Value peek(JStarVM* vm);
 extern inline Value peek2(JStarVM* vm);
 extern inline Value peekn(JStarVM* vm, int n);
 extern inline ObjClass* getClass(JStarVM* vm, Value v);
-extern inline bool isInstance(JStarVM* vm, Value i, ObjClass* cls);
\ No newline at end of file
+extern inline bool isInstance(JStarVM* vm, Value i, ObjClass* cls);
\ No newline at end of file
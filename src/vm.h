@@ -7,10 +7,16 @@
 #include <stdlib.h>
 
 #include "compiler.h"
+#include "evalcache.h"
 #include "hashtable.h"
+#include "importcache.h"
 #include "jstar.h"
 #include "jstar_limits.h"
 #include "object.h"
+#include "opstats.h"
+#include "sampler.h"
+#include "slab.h"
+#include "tracer.h"
 #include "util.h"
 #include "value.h"
 
@@ -60,29 +66,40 @@ typedef enum MethodSymbol {
     SYM_POW,
     SYM_RPOW,
 
+    SYM_SUM,
+
     SYM_END
 } MethodSymbol;
 
-// Struct that stores the info needed to
-// jump to handler code and to restore the
-// VM state when handling exceptions
-typedef struct Handler {
-    enum {
-        HANDLER_ENSURE,
-        HANDLER_EXCEPT,
-    } type;            // The type of the handler block
-    uint8_t* address;  // The address of handler code
-    Value* savedSp;    // Saved stack state before the try block was enterd
-} Handler;
+// Number of entries of the bound method cache (must be a power of two)
+#define BOUND_METHOD_CACHE_SZ 64
+
+// The globals of a module saved by a checkpoint (see jsrCheckpointVM)
+typedef struct ModuleCheckpoint {
+    ObjModule* module;
+    Value* globals;
+    size_t globalCount;
+    bool lazy;
+} ModuleCheckpoint;
+
+// A name resolved once by `jsrInternSymbol`, along with the inline caches of the API calls that
+// use it. Each kind of access has its own cache, as entries of different kinds aren't compatible
+struct JStarSymbol {
+    ObjString* name;
+    InlineCache methodCache, getCache, setCache;
+    ObjModule* module;  // Module of the last global lookup (NULL if none)
+    size_t globalSlot;  // Slot of the global in `module`
+    JStarSymbol *prev, *next;
+};
 
 // Stackframe of a function executing in
 // the virtual machine
 typedef struct Frame {
-    uint8_t* ip;                     // Instruction pointer
-    Value* stack;                    // Base of stack for current frame
-    Obj* fn;                         // Function associated with the frame (ObjClosure or ObjNative)
-    Handler handlers[MAX_HANDLERS];  // Exception handlers
-    uint8_t handlerc;                // Exception handlers count
+    uint8_t* ip;        // Instruction pointer
+    Value* stack;       // Base of stack for current frame
+    Obj* fn;            // Function associated with the frame (ObjClosure or ObjNative)
+    int tailCalls;      // Number of frames replaced by tail calls before reaching `fn`
+    ObjGenerator* gen;  // The generator executing in the frame, if any
 } Frame;
 
 // The J* VM. This struct stores all the
@@ -106,6 +123,14 @@ struct JStarVM {
     ObjClass* excClass;
     ObjClass* tableClass;
     ObjClass* udataClass;
+    ObjClass* genClass;
+    ObjClass* weakRefClass;
+    ObjClass* weakTableClass;
+
+    // Numeric array classes of the `math` module, NULL until it's imported
+    ObjClass* f64ArrClass;
+    ObjClass* i32ArrClass;
+    ObjClass* u8ArrClass;
 
     // Script arguments
     ObjList* argv;
@@ -119,9 +144,51 @@ struct JStarVM {
     // Cached method names needed at runtime
     ObjString* methodSyms[SYM_END];
 
+    // Recently created bound methods, indexed by receiver and method. Binding the same method to
+    // the same object again reuses the cached one, since bound methods are immutable.
+    // The cache doesn't keep its entries alive, and it's cleared at every collection
+    ObjBoundMethod* boundMethods[BOUND_METHOD_CACHE_SZ];
+
     // Loaded modules
     HashTable modules;
 
+    // State restored by jsrResetVM: the modules loaded at the last checkpoint, and the contents
+    // of the import paths and script arguments lists
+    ModuleCheckpoint* checkpoint;
+    size_t checkpointCount;
+    ObjList *checkpointPaths, *checkpointArgv;
+
+    // Bundles opened during import (see "bundle.h")
+    struct Bundle* bundles;
+
+    // Results of import path resolution
+    ImportCache importCache;
+
+    // Compiled modules shared with other VMs (if any)
+    JStarCodeCache* codeCache;
+
+    // Whether imported sources are cached compiled on disk, and where (see bytecache.h)
+    bool bytecodeCache;
+    char* bytecodeCacheDir;
+
+    // Sources at least this long are compiled while being parsed (see compiler.h)
+    size_t streamCompileSize;
+
+    // Whether imports are lazy or timed (see import.h)
+    bool lazyImports, traceImports;
+    double importChildTime;  // Seconds taken by the imports nested in the one being timed
+
+    // Functions compiled by `eval` and `jsrEvalString`
+    EvalCache evalCache;
+
+    // Arena holding the trees of the sources being compiled, reset when the last one is released
+    // (see `parseSource` in import.c). Created on first use
+    struct JStarASTArena* astArena;
+    int astArenaUsers;
+
+    // Compiled regexes of the `re` module (see "builtins/re.c")
+    struct RegexCache* regexCache;
+
     // Current module and core module
     ObjModule *module, *core;
 
@@ -141,6 +208,7 @@ struct JStarVM {
 
     // Constant string pool, for interned strings
     HashTable stringPool;
+    size_t maxInternedLength;  // Longer strings are not added to the pool
 
     // Linked list of all open upvalues
     ObjUpvalue* upvalues;
@@ -152,22 +220,81 @@ struct JStarVM {
     // Can be set asynchronously by a signal handler
     volatile sig_atomic_t evalBreak;
 
+    // Reasons of the eval break, set before `evalBreak` itself
+    volatile sig_atomic_t interrupt;      // Raise a ProgramInterrupt (`jsrEvalBreak`)
+    volatile sig_atomic_t sampleRequest;  // Record a sample of the call stack
+
+    // Samples of the sampling profiler
+    Sampler sampler;
+
+    // Events recorded by the tracer
+    Tracer tracer;
+
+#ifdef JSTAR_OPCODE_STATS
+    // Counters of executed opcodes
+    OpcodeStats opStats;
+#endif
+
     // Custom data associated with the VM
     void* customData;
 
+    // State of the default random generator of the `math` module
+    uint64_t randomState[4];
+
+    // Symbols created by `jsrInternSymbol`
+    JStarSymbol* symbols;
+
     // ---- Memory management ----
 
     // Linked list of all allocated objects (used in
-    // the sweep phase of GC to free unreached objects)
+    // the sweep phase of GC to free unreached objects).
+    // In generational mode, this only holds the young generation
     Obj* objects;
 
+    // Objects still to be examined by the lazy sweep of the last collection
+    Obj* unswept;
+
+    // Objects promoted to the old generation. Objects whose stores are not tracked by the
+    // write barrier are kept in their own list, since minor collections have to rescan them
+    Obj* oldObjects;
+    Obj* oldRoots;
+
     size_t allocated;  // Bytes currently allocated
     size_t nextGC;     // Bytes at which the next GC will be triggered
     int heapGrowRate;  // Rate at which the heap will grow after a GC
 
+    bool generationalGC;  // Whether the generational mode of the GC is enabled
+    size_t nurserySize;   // Bytes allocated between two minor collections
+    size_t nextMinorGC;   // Bytes at which the next minor collection will be triggered
+
+    size_t memoryLimit;   // Bytes allocated before raising a MemoryException (0 if unlimited)
+    bool memoryExceeded;  // Set when the limit was exceeded, until the exception is raised
+    bool unwinding;       // Set while unwinding the stack, when the limit is not checked
+
+    // Statistics returned by jsrGetGCStats
+    struct {
+        size_t fullCollections, minorCollections, bytesFreed;
+        double totalPause, maxPause;
+        size_t pauses[JSR_GC_PAUSE_BUCKETS];
+        size_t allocations[OBJ_TYPE_COUNT], bytes[OBJ_TYPE_COUNT], live[OBJ_TYPE_COUNT];
+    } gcStats;
+
+    // Old objects that may hold references to young ones (recorded by the write barrier)
+    Obj** remembered;
+    size_t rememberedCapacity, rememberedCount;
+
+    // Allocator for the fixed-size part of small objects
+    SlabAllocator slab;
+
     // Stack used to recursevely reach all the fields of reached objects
     Obj** reachedStack;
     size_t reachedCapacity, reachedCount;
+
+    // WeakRefs and WeakTables found while tracing a full collection, their weak references are
+    // processed once all the strongly reachable objects are known. NULL during minor collections,
+    // that treat all references as strong
+    Obj** weakObjects;
+    size_t weakCapacity, weakCount;
 };
 
 bool getValueField(JStarVM* vm, ObjString* name);
@@ -179,6 +306,16 @@ bool setValueSubscript(JStarVM* vm);
 bool callValue(JStarVM* vm, Value callee, uint8_t argc);
 bool invokeValue(JStarVM* vm, ObjString* name, uint8_t argc);
 
+// Replace the value on top of the stack with the method `name` of `cls` bound to it, reusing a
+// cached bound method when possible. Returns false, leaving the stack untouched, if `cls` doesn't
+// have the method
+bool bindMethod(JStarVM* vm, ObjClass* cls, ObjString* name);
+
+// Variants of the above that first look for the result in an inline cache
+bool getFieldCached(JStarVM* vm, ObjString* name, InlineCache* ic);
+bool setFieldCached(JStarVM* vm, ObjString* name, InlineCache* ic);
+bool invokeValueCached(JStarVM* vm, ObjString* name, uint8_t argc, InlineCache* ic, bool tail);
+
 void reserveStack(JStarVM* vm, size_t needed);
 void swapStackSlots(JStarVM* vm, int a, int b);
 